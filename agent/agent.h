@@ -86,6 +86,9 @@ struct
   /* Enable pinentry debugging (--debug 1024 should also be used).  */
   int debug_pinentry;
 
+  /* Write the log from a separate thread.  */
+  int log_async;
+
   /* Filename of the program to start as pinentry.  */
   const char *pinentry_program;
 
@@ -109,6 +112,11 @@ struct
      upon this timeout value.  */
   unsigned long pinentry_timeout;
 
+  /* The number of seconds a pinentry is kept running after its use
+     so that it can be reused by the next request.  0 disables
+     this.  */
+  unsigned long pinentry_grace_period;
+
   /* If set, then passphrase formatting is enabled in pinentry.  */
   int pinentry_formatted_passphrase;
 
@@ -118,6 +126,16 @@ struct
   unsigned long max_cache_ttl;     /* Default. */
   unsigned long max_cache_ttl_ssh; /* for SSH. */
 
+  /* The maximum number of unprotected private keys to cache and the
+   * lifetime of these cache entries.  The cache is disabled if the
+   * number is 0.  */
+  unsigned int max_cached_keys;
+  unsigned long cached_key_ttl;
+
+  /* The time the results of PKDECRYPT are cached.  The cache is
+   * disabled if this is 0.  */
+  unsigned long pkdecrypt_cache_ttl;
+
   /* Flag disallowing bypassing of the warning.  */
   int enforce_passphrase_constraints;
 
@@ -147,6 +165,11 @@ struct
      for signing operations.  */
   int ignore_cache_for_signing;
 
+  /* If true the private key operations of PKSIGN and PKDECRYPT are
+     run without holding the nPth lock so that several connections
+     can use all cores.  */
+  int concurrent_pk_operations;
+
   /* If this global option is true, the user is allowed to
      interactively mark certificate in trustlist.txt as trusted. */
   int allow_mark_trusted;
@@ -406,6 +429,12 @@ gpg_error_t agent_copy_startup_env (ctrl_t ctrl);
 const char *get_agent_socket_name (void);
 const char *get_agent_ssh_socket_name (void);
 int get_agent_active_connection_count (void);
+void agent_secmem_enter (void);
+void agent_secmem_leave (gpg_error_t err);
+void agent_secmem_get_stats (unsigned long *r_size, unsigned long *r_expand,
+                             unsigned int *r_active,
+                             unsigned int *r_max_active,
+                             unsigned long *r_failures);
 #ifdef HAVE_W32_SYSTEM
 void *get_agent_daemon_notify_event (void);
 #endif
@@ -489,6 +518,7 @@ gpg_error_t agent_update_private_key (const unsigned char *grip, nvc_t pk);
 void initialize_module_call_pinentry (void);
 void agent_query_dump_state (void);
 void agent_reset_query (ctrl_t ctrl);
+void agent_pinentry_housekeeping (void);
 int pinentry_active_p (ctrl_t ctrl, int waitseconds);
 gpg_error_t agent_askpin (ctrl_t ctrl,
                           const char *desc_text, const char *prompt_text,
@@ -513,11 +543,24 @@ int agent_clear_passphrase (ctrl_t ctrl,
 void initialize_module_cache (void);
 void deinitialize_module_cache (void);
 void agent_cache_housekeeping (void);
+void agent_cache_get_stats (unsigned int *r_count, unsigned long *r_expired,
+                            unsigned long *r_removed);
 void agent_flush_cache (int pincache_only);
 int agent_put_cache (ctrl_t ctrl, const char *key, cache_mode_t cache_mode,
                      const char *data, int ttl);
+gpg_error_t agent_put_cache_list (ctrl_t ctrl,
+                                  const char **keys, const char **data,
+                                  int nitems, cache_mode_t cache_mode,
+                                  int ttl);
 char *agent_get_cache (ctrl_t ctrl, const char *key, cache_mode_t cache_mode);
 void agent_store_cache_hit (const char *key);
+void agent_put_unprotected_key (ctrl_t ctrl, const unsigned char *grip,
+                                const unsigned char *digest,
+                                const unsigned char *key);
+gpg_error_t agent_get_unprotected_key (ctrl_t ctrl, const unsigned char *grip,
+                                       const unsigned char *digest,
+                                       unsigned char **r_key);
+void agent_forget_unprotected_key (const char *hexgrip);
 
 
 /*-- pksign.c --*/
@@ -553,6 +596,9 @@ gpg_error_t agent_protect_and_store (ctrl_t ctrl, gcry_sexp_t s_skey,
 
 /*-- protect.c --*/
 void set_s2k_calibration_time (unsigned int milliseconds);
+void enable_s2k_calibration_cache (void);
+unsigned long compute_s2k_calibration (void);
+void set_s2k_calibrated_count (unsigned long count);
 unsigned long get_calibrated_s2k_count (void);
 unsigned long get_standard_s2k_count (void);
 unsigned char get_standard_s2k_count_rfc4880 (void);
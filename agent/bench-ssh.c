@@ -0,0 +1,357 @@
+/* bench-ssh.c - Measure the signature throughput of the ssh-agent
+ * Copyright (C) 2026 g10 Code GmbH
+ *
+ * This file is part of GnuPG.
+ *
+ * GnuPG is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * GnuPG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see <https://www.gnu.org/licenses/>.
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+/* This program is not a test but used by the bench-scale scenarios.
+ * It connects to the ssh-agent socket given by SSH_AUTH_SOCK, takes
+ * the first identity and sends sign requests for it over several
+ * concurrent connections.  The result is printed as one JSON line to
+ * stdout:
+ *
+ *   {"bench":"ssh-sign","ops":N,"usec":N,"sigs_per_sec":X}
+ */
+
+#include <config.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <poll.h>
+#include <sys/time.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#define PGM "bench-ssh"
+
+#define SSH_REQUEST_REQUEST_IDENTITIES  11
+#define SSH_RESPONSE_IDENTITIES_ANSWER  12
+#define SSH_REQUEST_SIGN_REQUEST        13
+#define SSH_RESPONSE_SIGN_RESPONSE      14
+
+/* The maximum number of concurrent connections.  */
+#define MAX_CLIENTS 256
+
+static int verbose;
+static unsigned int nrequests = 1000;
+static unsigned int nclients = 8;
+
+
+static void
+die (const char *text)
+{
+  fprintf (stderr, PGM ": %s\n", text);
+  exit (1);
+}
+
+
+/* Return the current time in microseconds.  */
+static unsigned long long
+now_usec (void)
+{
+  struct timeval tv;
+
+  gettimeofday (&tv, NULL);
+  return (unsigned long long)tv.tv_sec * 1000000 + tv.tv_usec;
+}
+
+
+static unsigned long
+buf32 (const unsigned char *p)
+{
+  return ((unsigned long)p[0] << 24 | (unsigned long)p[1] << 16
+          | (unsigned long)p[2] << 8 | p[3]);
+}
+
+
+static void
+put32 (unsigned char *p, unsigned long value)
+{
+  p[0] = value >> 24;
+  p[1] = value >> 16;
+  p[2] = value >> 8;
+  p[3] = value;
+}
+
+
+/* Connect to the agent's ssh socket.  */
+static int
+connect_agent (const char *name)
+{
+  struct sockaddr_un addr;
+  int fd;
+
+  if (strlen (name) >= sizeof addr.sun_path)
+    die ("socket name too long");
+  memset (&addr, 0, sizeof addr);
+  addr.sun_family = AF_UNIX;
+  strcpy (addr.sun_path, name);
+
+  fd = socket (AF_UNIX, SOCK_STREAM, 0);
+  if (fd == -1)
+    die ("socket failed");
+  if (connect (fd, (struct sockaddr *)&addr, sizeof addr))
+    {
+      fprintf (stderr, PGM ": can't connect to '%s': %s\n",
+               name, strerror (errno));
+      exit (1);
+    }
+  return fd;
+}
+
+
+static void
+write_all (int fd, const unsigned char *buffer, size_t length)
+{
+  ssize_t n;
+
+  while (length)
+    {
+      n = write (fd, buffer, length);
+      if (n == -1 && errno == EINTR)
+        continue;
+      if (n <= 0)
+        die ("write to agent failed");
+      buffer += n;
+      length -= n;
+    }
+}
+
+
+static void
+read_all (int fd, unsigned char *buffer, size_t length)
+{
+  ssize_t n;
+
+  while (length)
+    {
+      n = read (fd, buffer, length);
+      if (n == -1 && errno == EINTR)
+        continue;
+      if (n <= 0)
+        die ("read from agent failed");
+      buffer += n;
+      length -= n;
+    }
+}
+
+
+/* Read a response from FD and return it as malloced buffer with its
+ * length stored at R_LENGTH.  */
+static unsigned char *
+read_response (int fd, size_t *r_length)
+{
+  unsigned char lenbuf[4];
+  unsigned char *buffer;
+  size_t length;
+
+  read_all (fd, lenbuf, 4);
+  length = buf32 (lenbuf);
+  if (!length || length > 256*1024)
+    die ("invalid response length");
+  buffer = malloc (length);
+  if (!buffer)
+    die ("out of core");
+  read_all (fd, buffer, length);
+  *r_length = length;
+  return buffer;
+}
+
+
+/* Ask the agent for its identities and return the blob of the first
+ * one as malloced buffer.  */
+static unsigned char *
+get_first_key (int fd, size_t *r_bloblen)
+{
+  unsigned char request[5];
+  unsigned char *response, *blob;
+  size_t length, bloblen;
+
+  put32 (request, 1);
+  request[4] = SSH_REQUEST_REQUEST_IDENTITIES;
+  write_all (fd, request, sizeof request);
+
+  response = read_response (fd, &length);
+  if (length < 9 || response[0] != SSH_RESPONSE_IDENTITIES_ANSWER)
+    die ("request identities failed");
+  if (!buf32 (response + 1))
+    die ("no ssh key available");
+  bloblen = buf32 (response + 5);
+  if (!bloblen || bloblen > length - 9)
+    die ("invalid identities answer");
+
+  blob = malloc (bloblen);
+  if (!blob)
+    die ("out of core");
+  memcpy (blob, response + 9, bloblen);
+  free (response);
+  *r_bloblen = bloblen;
+  return blob;
+}
+
+
+/* Build a sign request for the key BLOB.  */
+static unsigned char *
+make_sign_request (const unsigned char *blob, size_t bloblen,
+                   size_t *r_length)
+{
+  unsigned char data[64];
+  unsigned char *request, *p;
+  size_t length;
+
+  memset (data, 0x42, sizeof data);
+  length = 4 + 1 + 4 + bloblen + 4 + sizeof data + 4;
+  request = malloc (length);
+  if (!request)
+    die ("out of core");
+  p = request;
+  put32 (p, length - 4);
+  p += 4;
+  *p++ = SSH_REQUEST_SIGN_REQUEST;
+  put32 (p, bloblen);
+  p += 4;
+  memcpy (p, blob, bloblen);
+  p += bloblen;
+  put32 (p, sizeof data);
+  p += 4;
+  memcpy (p, data, sizeof data);
+  p += sizeof data;
+  put32 (p, 0);  /* Flags.  */
+  *r_length = length;
+  return request;
+}
+
+
+int
+main (int argc, char **argv)
+{
+  const char *sockname = NULL;
+  struct pollfd fds[MAX_CLIENTS];
+  unsigned char *blob, *request, *response;
+  size_t bloblen, requestlen, length;
+  unsigned int i, sent, done;
+  unsigned long long start, usec;
+  int fd;
+
+  if (argc)
+    { argc--; argv++; }
+  while (argc && **argv == '-')
+    {
+      if (!strcmp (*argv, "--verbose"))
+        {
+          verbose++;
+          argc--; argv++;
+        }
+      else if (!strcmp (*argv, "--requests") && argc > 1)
+        {
+          nrequests = atoi (argv[1]);
+          argc -= 2; argv += 2;
+        }
+      else if (!strcmp (*argv, "--clients") && argc > 1)
+        {
+          nclients = atoi (argv[1]);
+          argc -= 2; argv += 2;
+        }
+      else if (!strcmp (*argv, "--socket") && argc > 1)
+        {
+          sockname = argv[1];
+          argc -= 2; argv += 2;
+        }
+      else
+        {
+          fprintf (stderr, "usage: " PGM " [--verbose] [--requests N]"
+                   " [--clients N] [--socket NAME]\n");
+          exit (1);
+        }
+    }
+  if (!nrequests)
+    nrequests = 1;
+  if (!nclients)
+    nclients = 1;
+  if (nclients > MAX_CLIENTS)
+    nclients = MAX_CLIENTS;
+  if (nclients > nrequests)
+    nclients = nrequests;
+
+  if (!sockname)
+    sockname = getenv ("SSH_AUTH_SOCK");
+  if (!sockname || !*sockname)
+    die ("SSH_AUTH_SOCK not set");
+
+  fd = connect_agent (sockname);
+  blob = get_first_key (fd, &bloblen);
+  close (fd);
+  request = make_sign_request (blob, bloblen, &requestlen);
+  free (blob);
+
+  for (i=0; i < nclients; i++)
+    {
+      fds[i].fd = connect_agent (sockname);
+      fds[i].events = POLLIN;
+    }
+  if (verbose)
+    fprintf (stderr, PGM ": %u sign requests over %u connections\n",
+             nrequests, nclients);
+
+  /* Keep one request outstanding on each connection.  */
+  start = now_usec ();
+  for (sent=0; sent < nclients; sent++)
+    write_all (fds[sent].fd, request, requestlen);
+  done = 0;
+  while (done < nrequests)
+    {
+      if (poll (fds, nclients, -1) == -1)
+        {
+          if (errno == EINTR)
+            continue;
+          die ("poll failed");
+        }
+      for (i=0; i < nclients; i++)
+        {
+          if (!(fds[i].revents & (POLLIN|POLLHUP|POLLERR)))
+            continue;
+          response = read_response (fds[i].fd, &length);
+          if (response[0] != SSH_RESPONSE_SIGN_RESPONSE)
+            die ("sign request failed");
+          free (response);
+          done++;
+          if (sent < nrequests)
+            {
+              write_all (fds[i].fd, request, requestlen);
+              sent++;
+            }
+          else
+            {
+              close (fds[i].fd);
+              fds[i].fd = -1;  /* Ignored by poll.  */
+            }
+        }
+    }
+  usec = now_usec () - start;
+  if (!usec)
+    usec = 1;
+
+  printf ("{\"bench\":\"ssh-sign\",\"ops\":%u,\"usec\":%llu,"
+          "\"sigs_per_sec\":%.1f}\n",
+          nrequests, usec, (double)nrequests * 1000000.0 / (double)usec);
+  fflush (stdout);
+
+  free (request);
+  return 0;
+}
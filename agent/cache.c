@@ -53,10 +53,19 @@ struct secret_data_s {
   char data[1];  /* A string.  */
 };
 
+/* The number of hash buckets of the cache.  All items with the same
+ * key are in the same bucket.  */
+#define CACHE_HASH_SIZE 1024
+
+/* Unused entries are removed after this many seconds.  */
+#define UNUSED_ITEM_TTL (60*30)
+
 /* The cache object.  */
 typedef struct cache_item_s *ITEM;
 struct cache_item_s {
-  ITEM next;
+  ITEM next;        /* Next item in the same hash bucket.  */
+  time_t deadline;  /* Time after which housekeeping has to look at it.  */
+  int heapidx;      /* Index into TTLHEAP or -1 if not there.  */
   time_t created;
   time_t accessed;  /* Not updated for CACHE_MODE_DATA */
   int ttl;  /* max. lifetime given in seconds, -1 one means infinite */
@@ -67,11 +76,50 @@ struct cache_item_s {
 };
 
 /* The cache himself.  */
-static ITEM thecache;
+static ITEM thecache[CACHE_HASH_SIZE];
+
+/* The number of items in the cache.  */
+static unsigned int cache_count;
+
+/* The number of cached secrets expired by housekeeping and the number
+ * of items removed because they were not used for a long time.  */
+static unsigned long cache_expired_count;
+static unsigned long cache_removed_count;
+
+/* A binary min-heap with the items which need to be looked at by
+ * housekeeping ordered by their deadline.  The allocated size is
+ * kept at least at CACHE_COUNT so that inserting into the heap never
+ * fails.  */
+static ITEM *ttlheap;
+static unsigned int ttlheap_len;
+static unsigned int ttlheap_size;
+
+/* The values of the max-cache-ttl options used to compute the
+ * deadlines in the heap.  */
+static unsigned long heap_max_cache_ttl;
+static unsigned long heap_max_cache_ttl_ssh;
 
 /* NULL or the last cache key stored by agent_store_cache_hit.  */
 static char *last_stored_cache_key;
 
+/* An item of the cache of unprotected private keys.  */
+typedef struct key_item_s *KEY_ITEM;
+struct key_item_s {
+  KEY_ITEM next;
+  time_t created;
+  int restricted;            /* The value of ctrl->restricted.  */
+  unsigned char grip[KEYGRIP_LEN];
+  unsigned char digest[20];  /* SHA-1 of the protected key.  */
+  size_t keylen;
+  unsigned char *key;        /* The canonical S-expression in
+                              * secure memory.  */
+};
+
+/* The cache of unprotected private keys ordered by the time of their
+ * last use; the most recently used item is the first.  This cache is
+ * only used if opt.max_cached_keys is not 0.  */
+static KEY_ITEM thekeycache;
+
 
 /* This function must be called once to initialize this module. It
    has to be done before a second thread is spawned.  */
@@ -194,16 +242,261 @@ new_data (const char *string, struct secret_data_s **r_data)
 
 
 
-/* Check whether there are items to expire.  */
+/* Return the hash bucket for KEY.  */
+static ITEM *
+cache_bucket (const char *key)
+{
+  const unsigned char *p;
+  unsigned int h = 0;
+
+  for (p = (const unsigned char *)key; *p; p++)
+    h = (h << 5) + h + *p;
+  return thecache + (h % CACHE_HASH_SIZE);
+}
+
+
+/* Store the maximum time an item with CACHE_MODE is kept after its
+ * creation at R_MAXTTL.  Returns false if there is no such limit.  */
+static int
+max_ttl_for_mode (cache_mode_t cache_mode, unsigned long *r_maxttl)
+{
+  switch (cache_mode)
+    {
+    case CACHE_MODE_DATA:
+    case CACHE_MODE_PIN:
+      return 0;  /* No MAX TTL here.  */
+    case CACHE_MODE_SSH: *r_maxttl = opt.max_cache_ttl_ssh; break;
+    default: *r_maxttl = opt.max_cache_ttl; break;
+    }
+  return 1;
+}
+
+
+/* Compute the time after which housekeeping needs to look at R.
+ * Returns false if that will never be needed.  */
+static int
+compute_deadline (ITEM r, time_t *r_deadline)
+{
+  unsigned long maxttl;
+  time_t deadline = 0;
+  int any = 0;
+
+  if (r->pw)
+    {
+      if (r->cache_mode != CACHE_MODE_PIN && r->ttl >= 0)
+        {
+          deadline = r->accessed + r->ttl;
+          any = 1;
+        }
+      if (max_ttl_for_mode (r->cache_mode, &maxttl)
+          && (!any || r->created + maxttl < deadline))
+        {
+          deadline = r->created + maxttl;
+          any = 1;
+        }
+    }
+  else if (r->ttl >= 0)
+    {
+      deadline = r->accessed + UNUSED_ITEM_TTL;
+      any = 1;
+    }
+
+  *r_deadline = deadline;
+  return any;
+}
+
+
+static void
+ttlheap_swap (unsigned int a, unsigned int b)
+{
+  ITEM tmp = ttlheap[a];
+
+  ttlheap[a] = ttlheap[b];
+  ttlheap[b] = tmp;
+  ttlheap[a]->heapidx = a;
+  ttlheap[b]->heapidx = b;
+}
+
+
+/* Restore the heap property for the item at IDX.  */
+static void
+ttlheap_fix (unsigned int idx)
+{
+  unsigned int child;
+
+  while (idx && ttlheap[idx]->deadline < ttlheap[(idx-1)/2]->deadline)
+    {
+      ttlheap_swap (idx, (idx-1)/2);
+      idx = (idx-1)/2;
+    }
+  for (;;)
+    {
+      child = 2*idx + 1;
+      if (child >= ttlheap_len)
+        break;
+      if (child + 1 < ttlheap_len
+          && ttlheap[child+1]->deadline < ttlheap[child]->deadline)
+        child++;
+      if (ttlheap[idx]->deadline <= ttlheap[child]->deadline)
+        break;
+      ttlheap_swap (idx, child);
+      idx = child;
+    }
+}
+
+
+/* Remove R from the heap.  */
+static void
+ttlheap_remove (ITEM r)
+{
+  unsigned int idx = r->heapidx;
+
+  if (r->heapidx < 0)
+    return;
+  r->heapidx = -1;
+  ttlheap_len--;
+  if (idx == ttlheap_len)
+    return;
+  ttlheap[idx] = ttlheap[ttlheap_len];
+  ttlheap[idx]->heapidx = idx;
+  ttlheap_fix (idx);
+}
+
+
+/* Update the position of R in the heap after a change of R.  */
+static void
+ttlheap_update (ITEM r)
+{
+  time_t deadline;
+
+  if (!compute_deadline (r, &deadline))
+    {
+      ttlheap_remove (r);
+      return;
+    }
+  r->deadline = deadline;
+  if (r->heapidx < 0)
+    {
+      log_assert (ttlheap_len < ttlheap_size);
+      r->heapidx = ttlheap_len;
+      ttlheap[ttlheap_len++] = r;
+    }
+  ttlheap_fix (r->heapidx);
+}
+
+
+/* Make sure that the heap has room for one more item.  */
+static gpg_error_t
+ttlheap_reserve (void)
+{
+  ITEM *newheap;
+  unsigned int newsize;
+
+  if (cache_count < ttlheap_size)
+    return 0;
+  newsize = ttlheap_size? 2 * ttlheap_size : 64;
+  newheap = xtryrealloc (ttlheap, newsize * sizeof *newheap);
+  if (!newheap)
+    return gpg_error_from_syserror ();
+  ttlheap = newheap;
+  ttlheap_size = newsize;
+  return 0;
+}
+
+
+/* Remove the item R from the cache and release it.  */
+static void
+remove_item (ITEM r)
+{
+  ITEM *rp;
+
+  for (rp = cache_bucket (r->key); *rp; rp = &(*rp)->next)
+    if (*rp == r)
+      {
+        *rp = r->next;
+        break;
+      }
+  ttlheap_remove (r);
+  release_data (r->pw);
+  xfree (r);
+  cache_count--;
+}
+
+
+/* Recompute the deadlines of all items.  This is required after the
+ * max-cache-ttl options have been changed.  */
+static void
+rebuild_ttlheap (void)
+{
+  ITEM r;
+  int i;
+
+  for (i = 0; i < CACHE_HASH_SIZE; i++)
+    for (r = thecache[i]; r; r = r->next)
+      ttlheap_update (r);
+  heap_max_cache_ttl = opt.max_cache_ttl;
+  heap_max_cache_ttl_ssh = opt.max_cache_ttl_ssh;
+}
+
+
+/* Release the key cache item R.  */
+static void
+release_key_item (KEY_ITEM r)
+{
+  wipememory (r->key, r->keylen);
+  xfree (r->key);
+  xfree (r);
+}
+
+
+/* Remove all items from the key cache which are older than
+ * opt.cached_key_ttl and those which exceed opt.max_cached_keys.  */
+static void
+expire_key_items (time_t current)
+{
+  KEY_ITEM r, *rp;
+  unsigned int n = 0;
+
+  for (rp = &thekeycache; (r = *rp); )
+    {
+      if (n >= opt.max_cached_keys
+          || r->created + (time_t)opt.cached_key_ttl < current)
+        {
+          if (DBG_CACHE)
+            log_debug ("  expired unprotected key\n");
+          *rp = r->next;
+          release_key_item (r);
+        }
+      else
+        {
+          n++;
+          rp = &r->next;
+        }
+    }
+}
+
+
+/* Check whether there are items to expire.  Only the items with a
+ * passed deadline are looked at.  */
 static void
 housekeeping (void)
 {
-  ITEM r, rprev;
+  ITEM r;
   time_t current = gnupg_get_time ();
+  unsigned long maxttl;
+
+  if (heap_max_cache_ttl != opt.max_cache_ttl
+      || heap_max_cache_ttl_ssh != opt.max_cache_ttl_ssh)
+    rebuild_ttlheap ();
 
-  /* First expire the actual data */
-  for (r=thecache; r; r = r->next)
+  if (thekeycache)
+    expire_key_items (current);
+
+  while (ttlheap_len && ttlheap[0]->deadline < current)
     {
+      r = ttlheap[0];
+
+      /* First expire the actual data */
       if (r->cache_mode == CACHE_MODE_PIN)
         ; /* Don't let it expire - scdaemon explicitly flushes them.  */
       else if (r->pw && r->ttl >= 0 && r->accessed + r->ttl < current)
@@ -214,58 +507,38 @@ housekeeping (void)
           release_data (r->pw);
           r->pw = NULL;
           r->accessed = current;
+          cache_expired_count++;
         }
-    }
-
-  /* Second, make sure that we also remove them based on the created
-   * stamp so that the user has to enter it from time to time.  We
-   * don't do this for data items which are used to storage secrets in
-   * meory and are not user entered passphrases etc.  */
-  for (r=thecache; r; r = r->next)
-    {
-      unsigned long maxttl;
 
-      switch (r->cache_mode)
-        {
-        case CACHE_MODE_DATA:
-        case CACHE_MODE_PIN:
-          continue;  /* No MAX TTL here.  */
-        case CACHE_MODE_SSH: maxttl = opt.max_cache_ttl_ssh; break;
-        default: maxttl = opt.max_cache_ttl; break;
-        }
-      if (r->pw && r->created + maxttl < current)
+      /* Second, make sure that we also remove them based on the
+       * created stamp so that the user has to enter it from time to
+       * time.  We don't do this for data items which are used to
+       * storage secrets in meory and are not user entered passphrases
+       * etc.  */
+      if (r->pw && max_ttl_for_mode (r->cache_mode, &maxttl)
+          && r->created + maxttl < current)
         {
           if (DBG_CACHE)
             log_debug ("  expired '%s'.%d (%lus after creation)\n",
-                       r->key, r->restricted, opt.max_cache_ttl);
+                       r->key, r->restricted, maxttl);
           release_data (r->pw);
           r->pw = NULL;
           r->accessed = current;
+          cache_expired_count++;
         }
-    }
 
-  /* Third, make sure that we don't have too many items in the list.
-   * Expire old and unused entries after 30 minutes.  */
-  for (rprev=NULL, r=thecache; r; )
-    {
-      if (!r->pw && r->ttl >= 0 && r->accessed + 60*30 < current)
+      /* Third, make sure that we don't have too many items in the
+       * list.  Expire old and unused entries after 30 minutes.  */
+      if (!r->pw && r->ttl >= 0 && r->accessed + UNUSED_ITEM_TTL < current)
         {
-          ITEM r2 = r->next;
           if (DBG_CACHE)
             log_debug ("  removed '%s'.%d (mode %d) (slot not used for 30m)\n",
                        r->key, r->restricted, r->cache_mode);
-          xfree (r);
-          if (!rprev)
-            thecache = r2;
-          else
-            rprev->next = r2;
-          r = r2;
+          remove_item (r);
+          cache_removed_count++;
         }
       else
-        {
-          rprev = r;
-          r = r->next;
-        }
+        ttlheap_update (r);
     }
 }
 
@@ -290,11 +563,24 @@ agent_cache_housekeeping (void)
 }
 
 
+/* Return the number of items in the cache at R_COUNT, the number of
+ * expired secrets at R_EXPIRED and the number of removed items at
+ * R_REMOVED.  */
+void
+agent_cache_get_stats (unsigned int *r_count, unsigned long *r_expired,
+                       unsigned long *r_removed)
+{
+  *r_count = cache_count;
+  *r_expired = cache_expired_count;
+  *r_removed = cache_removed_count;
+}
+
+
 void
 agent_flush_cache (int pincache_only)
 {
   ITEM r;
-  int res;
+  int res, i;
 
   if (DBG_CACHE)
     log_debug ("agent_flush_cache%s\n", pincache_only?" (pincache only)":"");
@@ -303,17 +589,30 @@ agent_flush_cache (int pincache_only)
   if (res)
     log_fatal ("failed to acquire cache mutex: %s\n", strerror (res));
 
-  for (r=thecache; r; r = r->next)
+  for (i = 0; i < CACHE_HASH_SIZE; i++)
+    for (r = thecache[i]; r; r = r->next)
+      {
+        if (pincache_only && r->cache_mode != CACHE_MODE_PIN)
+          continue;
+        if (r->pw)
+          {
+            if (DBG_CACHE)
+              log_debug ("  flushing '%s'.%d\n", r->key, r->restricted);
+            release_data (r->pw);
+            r->pw = NULL;
+            r->accessed = 0;
+            ttlheap_update (r);
+          }
+      }
+
+  if (!pincache_only)
     {
-      if (pincache_only && r->cache_mode != CACHE_MODE_PIN)
-        continue;
-      if (r->pw)
+      KEY_ITEM kr;
+
+      while ((kr = thekeycache))
         {
-          if (DBG_CACHE)
-            log_debug ("  flushing '%s'.%d\n", r->key, r->restricted);
-          release_data (r->pw);
-          r->pw = NULL;
-          r->accessed = 0;
+          thekeycache = kr->next;
+          release_key_item (kr);
         }
     }
 
@@ -336,29 +635,19 @@ cache_mode_equal (cache_mode_t a, cache_mode_t b)
 }
 
 
-/* Store the string DATA in the cache under KEY and mark it with a
-   maximum lifetime of TTL seconds.  If there is already data under
-   this key, it will be replaced.  Using a DATA of NULL deletes the
-   entry.  A TTL of 0 is replaced by the default TTL and a TTL of -1
-   set infinite timeout.  CACHE_MODE is stored with the cache entry
-   and used to select different timeouts.  */
-int
-agent_put_cache (ctrl_t ctrl, const char *key, cache_mode_t cache_mode,
-                 const char *data, int ttl)
+/* Worker for agent_put_cache and agent_put_cache_list.  Must be
+   called with CACHE_LOCK held.  */
+static gpg_error_t
+put_cache_locked (ctrl_t ctrl, const char *key, cache_mode_t cache_mode,
+                  const char *data, int ttl)
 {
   gpg_error_t err = 0;
   ITEM r;
-  int res;
   int restricted = ctrl? ctrl->restricted : -1;
 
-  res = npth_mutex_lock (&cache_lock);
-  if (res)
-    log_fatal ("failed to acquire cache mutex: %s\n", strerror (res));
-
   if (DBG_CACHE)
     log_debug ("agent_put_cache '%s'.%d (mode %d) requested ttl=%d\n",
                key, restricted, cache_mode, ttl);
-  housekeeping ();
 
   if (!ttl)
     {
@@ -371,9 +660,9 @@ agent_put_cache (ctrl_t ctrl, const char *key, cache_mode_t cache_mode,
         }
     }
   if ((!ttl && data) || cache_mode == CACHE_MODE_IGNORE)
-    goto out;
+    return 0;
 
-  for (r=thecache; r; r = r->next)
+  for (r = *cache_bucket (key); r; r = r->next)
     {
       if (cache_mode == CACHE_MODE_PIN && data)
         {
@@ -411,15 +700,21 @@ agent_put_cache (ctrl_t ctrl, const char *key, cache_mode_t cache_mode,
           if (err)
             log_error ("error replacing cache item: %s\n", gpg_strerror (err));
         }
+      ttlheap_update (r);
     }
   else if (data) /* Insert.  */
     {
-      r = xtrycalloc (1, sizeof *r + strlen (key));
+      err = ttlheap_reserve ();
+      r = err? NULL : xtrycalloc (1, sizeof *r + strlen (key));
       if (!r)
-        err = gpg_error_from_syserror ();
+        {
+          if (!err)
+            err = gpg_error_from_syserror ();
+        }
       else
         {
           strcpy (r->key, key);
+          r->heapidx = -1;
           r->restricted = restricted;
           r->created = r->accessed = gnupg_get_time ();
           r->ttl = ttl;
@@ -429,15 +724,74 @@ agent_put_cache (ctrl_t ctrl, const char *key, cache_mode_t cache_mode,
             xfree (r);
           else
             {
-              r->next = thecache;
-              thecache = r;
+              ITEM *bucket = cache_bucket (key);
+
+              r->next = *bucket;
+              *bucket = r;
+              cache_count++;
+              ttlheap_update (r);
             }
         }
       if (err)
         log_error ("error inserting cache item: %s\n", gpg_strerror (err));
     }
 
- out:
+  return err;
+}
+
+
+/* Store the string DATA in the cache under KEY and mark it with a
+   maximum lifetime of TTL seconds.  If there is already data under
+   this key, it will be replaced.  Using a DATA of NULL deletes the
+   entry.  A TTL of 0 is replaced by the default TTL and a TTL of -1
+   set infinite timeout.  CACHE_MODE is stored with the cache entry
+   and used to select different timeouts.  */
+int
+agent_put_cache (ctrl_t ctrl, const char *key, cache_mode_t cache_mode,
+                 const char *data, int ttl)
+{
+  gpg_error_t err;
+  int res;
+
+  res = npth_mutex_lock (&cache_lock);
+  if (res)
+    log_fatal ("failed to acquire cache mutex: %s\n", strerror (res));
+
+  housekeeping ();
+  err = put_cache_locked (ctrl, key, cache_mode, data, ttl);
+
+  res = npth_mutex_unlock (&cache_lock);
+  if (res)
+    log_fatal ("failed to release cache mutex: %s\n", strerror (res));
+
+  return err;
+}
+
+
+/* Store the NITEMS strings DATA under the respective KEYS in the
+   cache.  This is the same as calling agent_put_cache for each item
+   but the cache is locked only once and either all or no items are
+   stored; on error the items already stored are removed again.  */
+gpg_error_t
+agent_put_cache_list (ctrl_t ctrl, const char **keys, const char **data,
+                      int nitems, cache_mode_t cache_mode, int ttl)
+{
+  gpg_error_t err = 0;
+  int res, i;
+
+  res = npth_mutex_lock (&cache_lock);
+  if (res)
+    log_fatal ("failed to acquire cache mutex: %s\n", strerror (res));
+
+  housekeeping ();
+  for (i=0; i < nitems && !err; i++)
+    err = put_cache_locked (ctrl, keys[i], cache_mode, data[i], ttl);
+  if (err)
+    {
+      for (i--; i >= 0; i--)
+        put_cache_locked (ctrl, keys[i], cache_mode, NULL, ttl);
+    }
+
   res = npth_mutex_unlock (&cache_lock);
   if (res)
     log_fatal ("failed to release cache mutex: %s\n", strerror (res));
@@ -480,7 +834,7 @@ agent_get_cache (ctrl_t ctrl, const char *key, cache_mode_t cache_mode)
                last_stored? " (stored cache key)":"");
   housekeeping ();
 
-  for (r=thecache; r; r = r->next)
+  for (r = *cache_bucket (key); r; r = r->next)
     {
       if (cache_mode == CACHE_MODE_PIN)
         yes = (r->pw && !strcmp (r->key, key));
@@ -500,7 +854,10 @@ agent_get_cache (ctrl_t ctrl, const char *key, cache_mode_t cache_mode)
            * below.  Note also that we don't update the accessed time
            * for data items.  */
           if (r->cache_mode != CACHE_MODE_DATA)
-            r->accessed = gnupg_get_time ();
+            {
+              r->accessed = gnupg_get_time ();
+              ttlheap_update (r);
+            }
           if (DBG_CACHE)
             log_debug ("... hit\n");
           if (r->pw->totallen < 32)
@@ -569,3 +926,155 @@ agent_store_cache_hit (const char *key)
 
   xfree (old);
 }
+
+
+/* Store the unprotected private key KEY for the keygrip GRIP in the
+ * key cache.  DIGEST is the SHA-1 hash of the protected key as read
+ * from the key file; a later lookup succeeds only if the key file
+ * still has the same content.  Nothing is done if the key cache has
+ * not been enabled.  */
+void
+agent_put_unprotected_key (ctrl_t ctrl, const unsigned char *grip,
+                           const unsigned char *digest,
+                           const unsigned char *key)
+{
+  KEY_ITEM r, *rp;
+  size_t keylen;
+  int res;
+
+  if (!opt.max_cached_keys || !opt.cached_key_ttl)
+    return;
+  keylen = gcry_sexp_canon_len (key, 0, NULL, NULL);
+  if (!keylen)
+    return;
+
+  res = npth_mutex_lock (&cache_lock);
+  if (res)
+    log_fatal ("failed to acquire cache mutex: %s\n", strerror (res));
+
+  for (rp = &thekeycache; (r = *rp); rp = &r->next)
+    if (r->restricted == ctrl->restricted
+        && !memcmp (r->grip, grip, KEYGRIP_LEN))
+      {
+        *rp = r->next;
+        release_key_item (r);
+        break;
+      }
+
+  r = xtrycalloc (1, sizeof *r);
+  if (r && !(r->key = xtrymalloc_secure (keylen)))
+    {
+      xfree (r);
+      r = NULL;
+    }
+  if (!r)
+    log_error ("error caching unprotected key: %s\n",
+               gpg_strerror (gpg_error_from_syserror ()));
+  else
+    {
+      r->created = gnupg_get_time ();
+      r->restricted = ctrl->restricted;
+      memcpy (r->grip, grip, KEYGRIP_LEN);
+      memcpy (r->digest, digest, sizeof r->digest);
+      memcpy (r->key, key, keylen);
+      r->keylen = keylen;
+      r->next = thekeycache;
+      thekeycache = r;
+      housekeeping ();
+    }
+
+  res = npth_mutex_unlock (&cache_lock);
+  if (res)
+    log_fatal ("failed to release cache mutex: %s\n", strerror (res));
+}
+
+
+/* Look up the unprotected private key for the keygrip GRIP whose
+ * protected form has the SHA-1 hash DIGEST.  On success a copy of
+ * the key allocated in secure memory is stored at R_KEY; if no such
+ * key is cached GPG_ERR_NOT_FOUND is returned.  */
+gpg_error_t
+agent_get_unprotected_key (ctrl_t ctrl, const unsigned char *grip,
+                           const unsigned char *digest,
+                           unsigned char **r_key)
+{
+  gpg_error_t err = gpg_error (GPG_ERR_NOT_FOUND);
+  KEY_ITEM r, *rp;
+  int res;
+
+  *r_key = NULL;
+  if (!thekeycache)
+    return err;
+
+  res = npth_mutex_lock (&cache_lock);
+  if (res)
+    log_fatal ("failed to acquire cache mutex: %s\n", strerror (res));
+
+  housekeeping ();
+  for (rp = &thekeycache; (r = *rp); rp = &r->next)
+    if (r->restricted == ctrl->restricted
+        && !memcmp (r->grip, grip, KEYGRIP_LEN))
+      break;
+  if (r && memcmp (r->digest, digest, sizeof r->digest))
+    {
+      /* The key file has been changed.  */
+      *rp = r->next;
+      release_key_item (r);
+    }
+  else if (r)
+    {
+      *r_key = xtrymalloc_secure (r->keylen);
+      if (!*r_key)
+        err = gpg_error_from_syserror ();
+      else
+        {
+          memcpy (*r_key, r->key, r->keylen);
+          err = 0;
+          if (DBG_CACHE)
+            log_debug ("agent_get_unprotected_key: hit\n");
+          /* Move it to the front.  */
+          *rp = r->next;
+          r->next = thekeycache;
+          thekeycache = r;
+        }
+    }
+
+  res = npth_mutex_unlock (&cache_lock);
+  if (res)
+    log_fatal ("failed to release cache mutex: %s\n", strerror (res));
+
+  return err;
+}
+
+
+/* Remove the unprotected key for the keygrip given as hex string
+ * HEXGRIP from the key cache.  HEXGRIP may be any cache id; it is
+ * ignored if it is not a keygrip.  */
+void
+agent_forget_unprotected_key (const char *hexgrip)
+{
+  unsigned char grip[KEYGRIP_LEN];
+  KEY_ITEM r, *rp;
+  int res;
+
+  if (!thekeycache || strlen (hexgrip) != 2*KEYGRIP_LEN
+      || hex2bin (hexgrip, grip, KEYGRIP_LEN) < 0)
+    return;
+
+  res = npth_mutex_lock (&cache_lock);
+  if (res)
+    log_fatal ("failed to acquire cache mutex: %s\n", strerror (res));
+
+  for (rp = &thekeycache; (r = *rp); )
+    if (!memcmp (r->grip, grip, KEYGRIP_LEN))
+      {
+        *rp = r->next;
+        release_key_item (r);
+      }
+    else
+      rp = &r->next;
+
+  res = npth_mutex_unlock (&cache_lock);
+  if (res)
+    log_fatal ("failed to release cache mutex: %s\n", strerror (res));
+}
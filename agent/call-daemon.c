@@ -66,6 +66,10 @@ struct daemon_local_s
 };
 
 
+/* The maximum number of idle secondary connections kept open for
+ * later use by another connection.  */
+#define MAX_IDLE_CONNECTIONS 8
+
 /* Primary holder of all the started daemons */
 struct daemon_global_s
 {
@@ -85,6 +89,12 @@ struct daemon_global_s
      to true if the primary context has been reset and is not in use by
      any connection. */
   int primary_ctx_reusable;
+
+  /* Secondary connections which have been reset by their last user
+     and are kept open so that new connections don't need to connect
+     to the daemon again.  */
+  assuan_context_t idle_ctx[MAX_IDLE_CONNECTIONS];
+  int n_idle;
 };
 
 static struct daemon_global_s daemon_global[DAEMON_MAX_TYPE];
@@ -181,6 +191,9 @@ wait_child_thread (void *arg)
       g->primary_ctx = NULL;
       g->primary_ctx_reusable = 0;
 
+      while (g->n_idle)
+        assuan_release (g->idle_ctx[--g->n_idle]);
+
       xfree (g->socket_name);
       g->socket_name = NULL;
 
@@ -330,6 +343,14 @@ daemon_start (enum daemon_type type, ctrl_t ctrl)
       goto leave;
     }
 
+  if (g->n_idle)
+    {
+      ctx = g->idle_ctx[--g->n_idle];
+      if (opt.verbose)
+        log_info ("new connection to %s daemon established (idle)\n", name);
+      goto leave;
+    }
+
   rc = assuan_new (&ctx);
   if (rc)
     {
@@ -566,6 +587,8 @@ agent_daemon_dump_state (void)
 	      g->primary_ctx,
 	      (long)assuan_get_pid (g->primary_ctx),
 	      g->primary_ctx_reusable);
+    if (g->n_idle)
+      log_info ("%s: idle connections=%d\n", __func__, g->n_idle);
     if (g->socket_name)
       log_info ("%s: socket='%s'\n", __func__, g->socket_name);
   }
@@ -641,6 +664,16 @@ agent_reset_daemon (ctrl_t ctrl)
 				 NULL, NULL, NULL, NULL, NULL, NULL);
 		g->primary_ctx_reusable = 1;
 	      }
+	    else if (g->socket_name && g->n_idle < MAX_IDLE_CONNECTIONS
+                     && !ctrl->d_local[i]->invalid
+                     && !assuan_transact (ctrl->d_local[i]->ctx, "RESTART",
+                                          NULL, NULL, NULL, NULL, NULL, NULL))
+              {
+                /* Keep the secondary connection for reuse by another
+                 * connection.  The RESTART makes sure that no state
+                 * of this connection is left in the daemon.  */
+                g->idle_ctx[g->n_idle++] = ctrl->d_local[i]->ctx;
+              }
 	    else /* Secondary connections.  */
 	      assuan_release (ctrl->d_local[i]->ctx);
 	    ctrl->d_local[i]->ctx = NULL;
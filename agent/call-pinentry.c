@@ -86,6 +86,27 @@ static npth_t  popup_tid;
    its stop function. */
 static int popup_finished;
 
+/* The PID and the flavor and version string of the current pinentry
+ * as used for the PINENTRY_LAUNCHED inquiry.  */
+static unsigned long entry_pid;
+static char *entry_flavor_version;
+
+/* If set the current pinentry may not be kept for reuse.  */
+static int entry_no_reuse;
+
+/* A pinentry which is kept running for opt.pinentry_grace_period
+ * seconds after its last use so that a batch of operations does not
+ * need to launch a pinentry for each passphrase.  ENVKEY describes
+ * the environment the pinentry was started with; it may only be
+ * reused by a client with the same environment.  Access is protected
+ * by ENTRY_LOCK.  */
+static struct
+{
+  assuan_context_t ctx;
+  time_t since;
+  char *envkey;
+} idle_entry;
+
 
 
 /* Data to be passed to our callbacks, */
@@ -144,16 +165,130 @@ agent_reset_query (ctrl_t ctrl)
 }
 
 
+/* Return a malloced string describing the environment which is
+ * used by start_pinentry for CTRL or NULL on error.  */
+static char *
+make_pinentry_envkey (ctrl_t ctrl)
+{
+  membuf_t mb;
+  int iterator = 0;
+  const char *name, *value;
+
+  init_membuf (&mb, 256);
+  while ((name = session_env_list_stdenvnames (&iterator, NULL)))
+    {
+      value = session_env_getenv (ctrl->session_env, name);
+      if (value)
+        put_membuf_printf (&mb, "%s=%s\n", name, value);
+    }
+  put_membuf_printf (&mb, "lc-ctype=%s\nlc-messages=%s\n",
+                     ctrl->lc_ctype? ctrl->lc_ctype : "",
+                     ctrl->lc_messages? ctrl->lc_messages : "");
+  put_membuf (&mb, "", 1);
+  return get_membuf (&mb, NULL);
+}
+
+
+/* Release the idle pinentry.  Must be called with ENTRY_LOCK held.
+ * Returns the context which needs to be released by the caller after
+ * unlocking ENTRY_LOCK.  */
+static assuan_context_t
+drop_idle_pinentry (void)
+{
+  assuan_context_t ctx = idle_entry.ctx;
+
+  idle_entry.ctx = NULL;
+  xfree (idle_entry.envkey);
+  idle_entry.envkey = NULL;
+  return ctx;
+}
+
+
+/* Try to take the idle pinentry for CTRL.  Must be called with
+ * ENTRY_LOCK held.  Returns true if ENTRY_CTX has been set.  */
+static int
+take_idle_pinentry (ctrl_t ctrl)
+{
+  assuan_context_t ctx;
+  char *envkey;
+  int okay;
+
+  if (!idle_entry.ctx)
+    return 0;
+
+  envkey = make_pinentry_envkey (ctrl);
+  okay = (envkey && idle_entry.envkey && !strcmp (envkey, idle_entry.envkey)
+          && idle_entry.since + opt.pinentry_grace_period >= gnupg_get_time ());
+  xfree (envkey);
+  ctx = drop_idle_pinentry ();
+
+  /* The RESET clears the texts of the former use but keeps the
+   * options we set in start_pinentry.  If that fails the pinentry is
+   * probably gone.  */
+  if (okay && assuan_transact (ctx, "RESET",
+                               NULL, NULL, NULL, NULL, NULL, NULL))
+    okay = 0;
+  if (!okay)
+    {
+      assuan_release (ctx);
+      return 0;
+    }
+
+  if (opt.verbose)
+    log_info ("reusing the PIN Entry\n");
+  ctrl->pinentry_active = 1;
+  entry_ctx = ctx;
+  return 1;
+}
+
+
+/* Called from the ticker to release an idle pinentry after the grace
+ * period.  */
+void
+agent_pinentry_housekeeping (void)
+{
+  assuan_context_t ctx;
+
+  if (!idle_entry.ctx)
+    return;
+  if (idle_entry.since + opt.pinentry_grace_period >= gnupg_get_time ())
+    return;
+  if (npth_mutex_trylock (&entry_lock))
+    return;  /* In use; we will try again later.  */
+  ctx = drop_idle_pinentry ();
+  npth_mutex_unlock (&entry_lock);
+  assuan_release (ctx);
+}
+
+
 /* Unlock the pinentry so that another thread can start one and
    disconnect that pinentry - we do this after the unlock so that a
    stalled pinentry does not block other threads.  Fixme: We should
-   have a timeout in Assuan for the disconnect operation. */
+   have a timeout in Assuan for the disconnect operation.  If a grace
+   period has been configured a pinentry which is still usable is
+   kept instead.  */
 static gpg_error_t
 unlock_pinentry (ctrl_t ctrl, gpg_error_t rc)
 {
   assuan_context_t ctx = entry_ctx;
+  assuan_context_t oldctx = NULL;
+  int keep;
   int err;
 
+  switch (gpg_err_code (rc))
+    {
+    case GPG_ERR_NO_ERROR:
+    case GPG_ERR_CANCELED:
+    case GPG_ERR_NO_PASSPHRASE:
+    case GPG_ERR_BAD_PASSPHRASE:
+    case GPG_ERR_BAD_PIN:
+      keep = (opt.pinentry_grace_period && !entry_no_reuse);
+      break;
+    default:
+      keep = 0;
+      break;
+    }
+
   if (rc)
     {
       if (DBG_IPC)
@@ -189,6 +324,18 @@ unlock_pinentry (ctrl_t ctrl, gpg_error_t rc)
   if (--ctrl->pinentry_active == 0)
     {
       entry_ctx = NULL;
+      entry_no_reuse = 0;
+      if (keep && ctx)
+        {
+          oldctx = drop_idle_pinentry ();
+          idle_entry.envkey = make_pinentry_envkey (ctrl);
+          if (idle_entry.envkey)
+            {
+              idle_entry.ctx = ctx;
+              idle_entry.since = gnupg_get_time ();
+              ctx = NULL;
+            }
+        }
       err = npth_mutex_unlock (&entry_lock);
       if (err)
         {
@@ -196,6 +343,7 @@ unlock_pinentry (ctrl_t ctrl, gpg_error_t rc)
           if (!rc)
             rc = gpg_error_from_errno (err);
         }
+      assuan_release (oldctx);
       assuan_release (ctx);
     }
   return rc;
@@ -345,6 +493,35 @@ start_pinentry (ctrl_t ctrl)
   if (entry_ctx)
     return 0;
 
+  if (take_idle_pinentry (ctrl))
+    {
+      /* Update the per-request options which are not kept by the
+       * RESET and tell the client about the pinentry.  */
+      if (opt.pinentry_timeout)
+        {
+          char *optstr;
+
+          if ((optstr = xtryasprintf ("SETTIMEOUT %lu",
+                                      opt.pinentry_timeout)))
+            {
+              assuan_transact (entry_ctx, optstr, NULL, NULL, NULL, NULL,
+                               NULL, NULL);
+              xfree (optstr);
+            }
+        }
+      if (entry_pid && entry_pid != (unsigned long)(-1L))
+        {
+          rc = agent_inq_pinentry_launched (ctrl, entry_pid,
+                                            entry_flavor_version);
+          if (gpg_err_code (rc) == GPG_ERR_CANCELED
+              || gpg_err_code (rc) == GPG_ERR_FULLY_CANCELED)
+            return unlock_pinentry (ctrl,
+                                    gpg_err_make (GPG_ERR_SOURCE_DEFAULT,
+                                                  gpg_err_code (rc)));
+        }
+      return 0;
+    }
+
   if (opt.verbose)
     log_info ("starting a new PIN Entry\n");
 
@@ -692,6 +869,9 @@ start_pinentry (ctrl_t ctrl)
   rc = assuan_transact (entry_ctx, "GETINFO pid",
                         getinfo_pid_cb, &pinentry_pid,
                         NULL, NULL, NULL, NULL);
+  entry_pid = rc? 0 : pinentry_pid;
+  xfree (entry_flavor_version);
+  entry_flavor_version = xtrystrdup (flavor_version);
   if (rc)
     {
       log_info ("You may want to update to a newer pinentry\n");
@@ -2164,7 +2344,9 @@ agent_popup_message_stop (ctrl_t ctrl)
      to the same content that a static global variable has.  */
   memset (&popup_tid, '\0', sizeof (popup_tid));
 
-  /* Now we can close the connection. */
+  /* Now we can close the connection.  The pinentry has been killed
+     and can't be reused.  */
+  entry_no_reuse = 1;
   unlock_pinentry (ctrl, 0);
 }
 
@@ -231,12 +231,41 @@ struct ssh_control_file_s
 };
 
 
+/* An entry of the parsed sshcontrol file.  */
+struct control_cache_item_s
+{
+  char hexgrip[40+1];  /* The hexgrip of the item (uppercase).  */
+  int disabled;
+  int ttl;
+  int confirm;
+  int lnr;             /* The line number of the entry.  */
+};
+
+/* The parsed sshcontrol file together with the identity of the file
+ * it has been read from.  The items are sorted by keygrip and line
+ * number.  If the file could not be parsed completely, ERR is the
+ * error and ITEMS has only the entries before the bad line.  */
+static struct
+{
+  int valid;
+  time_t mtime;
+  off_t size;
+  ino_t ino;
+  gpg_error_t err;
+  struct control_cache_item_s *items;
+  size_t nitems;
+} control_cache;
+
+
 /* Two objects definition to hold keys for later sorting.  */
 struct key_collection_item_s
 {
   gcry_sexp_t key;  /* Public key. (owned by us)                        */
   char *cardsn;     /* Serial number of a card or NULL. (owned by us)   */
   int order;        /* Computed ordinal                                 */
+  unsigned char *blob; /* If not NULL the serialized key used instead
+                          of KEY and CARDSN. (owned by us)              */
+  size_t bloblen;
 };
 
 struct key_collection_s
@@ -247,6 +276,55 @@ struct key_collection_s
 };
 
 
+/* The number of seconds the list of keys on cards is re-used.  */
+#define CARD_KEYINFO_TTL 5
+
+/* The cached list of keys on cards and the time it was retrieved.  */
+static struct card_key_info_s *card_keyinfo_cache;
+static int card_keyinfo_cache_valid;
+static time_t card_keyinfo_cache_time;
+
+/* The number of hash buckets of the key blob cache.  */
+#define KEY_BLOB_CACHE_HASH_SIZE 256
+
+/* An item of the cache of serialized public keys as sent in the
+ * answer to a request identities.  The item is valid as long as the
+ * key file has not changed.  */
+struct key_blob_item_s
+{
+  struct key_blob_item_s *next;
+  unsigned char grip[KEYGRIP_LEN];
+  int for_ssh;           /* Read by agent_ssh_key_from_file.  */
+  time_t mtime;          /* The identity of the key file.  */
+  off_t size;
+  ino_t ino;
+  unsigned int seqno;    /* The last listing which used this item.  */
+  gpg_error_t err;       /* The error from reading the key.  */
+  int order;             /* The Use-for-ssh ordinal.  */
+  unsigned char *blob;   /* The serialized key.  */
+  size_t bloblen;
+};
+static struct key_blob_item_s *key_blob_cache[KEY_BLOB_CACHE_HASH_SIZE];
+
+/* A counter incremented with each listing of the keys.  */
+static unsigned int key_blob_cache_seqno;
+
+/* The number of slots of the sign key cache.  */
+#define SIGN_KEY_CACHE_SIZE 32
+
+/* An item of the cache which maps the key blob of a sign request to
+ * the type and the keygrip of the key.  Both are derived from the
+ * public key alone and thus an item never gets stale.  */
+struct sign_key_item_s
+{
+  unsigned char *blob;   /* The key blob as received or NULL.  */
+  size_t bloblen;
+  ssh_key_type_spec_t spec;
+  unsigned char grip[KEYGRIP_LEN];
+};
+static struct sign_key_item_s sign_key_cache[SIGN_KEY_CACHE_SIZE];
+
+
 /* Prototypes.  */
 static gpg_error_t ssh_handler_request_identities (ctrl_t ctrl,
 						   estream_t request,
@@ -1089,6 +1167,165 @@ search_control_file (ssh_control_file_t cf, const char *hexgrip,
 
 
 
+/* Helper for the qsort in load_control_cache.  */
+static int
+compare_control_cache_items (const void *arg_a, const void *arg_b)
+{
+  const struct control_cache_item_s *a = arg_a;
+  const struct control_cache_item_s *b = arg_b;
+  int res;
+
+  res = strcmp (a->hexgrip, b->hexgrip);
+  if (!res)
+    res = a->lnr - b->lnr;
+  return res;
+}
+
+
+/* Make sure that CONTROL_CACHE reflects the current sshcontrol file.
+ * The file is only read again if its modification time, size or
+ * inode changed.  If the file has been modified within the last
+ * second it is read again at the next call because another change
+ * within the same second may not be detected.  */
+static gpg_error_t
+load_control_cache (void)
+{
+  gpg_error_t err;
+  char *fname;
+  struct stat st;
+  ssh_control_file_t cf;
+  struct control_cache_item_s *items = NULL;
+  struct control_cache_item_s *tmp;
+  size_t nitems = 0;
+  size_t allocated = 0;
+
+  fname = make_filename_try (gnupg_homedir (), SSH_CONTROL_FILE_NAME, NULL);
+  if (!fname)
+    return gpg_error_from_syserror ();
+  if (!gnupg_stat (fname, &st)
+      && control_cache.valid
+      && control_cache.mtime == st.st_mtime
+      && control_cache.size == st.st_size
+      && control_cache.ino == st.st_ino)
+    {
+      xfree (fname);
+      return 0;
+    }
+  xfree (fname);
+
+  /* Note that opening the file creates it if it does not exist.  */
+  err = open_control_file (&cf, 0);
+  if (err)
+    return err;
+  if (fstat (es_fileno (cf->fp), &st))
+    {
+      err = gpg_error_from_syserror ();
+      close_control_file (cf);
+      return err;
+    }
+
+  while (!(err = read_control_file_item (cf)))
+    {
+      if (!cf->item.valid)
+        continue; /* Should not happen.  */
+      if (nitems == allocated)
+        {
+          allocated += 64;
+          tmp = xtryreallocarray (items, nitems, allocated, sizeof *items);
+          if (!tmp)
+            {
+              err = gpg_error_from_syserror ();
+              xfree (items);
+              close_control_file (cf);
+              return err;
+            }
+          items = tmp;
+        }
+      strcpy (items[nitems].hexgrip, cf->item.hexgrip);
+      items[nitems].disabled = cf->item.disabled;
+      items[nitems].ttl = cf->item.ttl;
+      items[nitems].confirm = cf->item.confirm;
+      items[nitems].lnr = cf->lnr;
+      nitems++;
+    }
+  close_control_file (cf);
+  if (gpg_err_code (err) == GPG_ERR_EOF)
+    err = 0;
+
+  if (nitems)
+    qsort (items, nitems, sizeof *items, compare_control_cache_items);
+
+  /* Now replace the cache.  There is no chance for a thread switch
+   * from here on.  */
+  xfree (control_cache.items);
+  control_cache.items = items;
+  control_cache.nitems = nitems;
+  control_cache.err = err;
+  control_cache.mtime = st.st_mtime;
+  control_cache.size = st.st_size;
+  control_cache.ino = st.st_ino;
+  control_cache.valid = (st.st_mtime + 1 < time (NULL));
+  return 0;
+}
+
+
+/* Same as search_control_file but use the cached sshcontrol file.
+ * The error codes are the same as if the file would have been read
+ * from start; thus GPG_ERR_EOF is returned if HEXGRIP was not found. */
+static gpg_error_t
+search_control_cache (const char *hexgrip,
+                      int *r_disabled, int *r_ttl, int *r_confirm, int *r_lnr)
+{
+  gpg_error_t err;
+  size_t lo, hi, mid;
+  struct control_cache_item_s *item;
+  int cmp;
+
+  log_assert (strlen (hexgrip) == 40 );
+
+  if (r_disabled)
+    *r_disabled = 0;
+  if (r_ttl)
+    *r_ttl = 0;
+  if (r_confirm)
+    *r_confirm = 0;
+  if (r_lnr)
+    *r_lnr = -1;
+
+  err = load_control_cache ();
+  if (err)
+    return err;
+
+  /* Find the first item with HEXGRIP.  */
+  lo = 0;
+  hi = control_cache.nitems;
+  while (lo < hi)
+    {
+      mid = lo + (hi - lo) / 2;
+      cmp = strcmp (control_cache.items[mid].hexgrip, hexgrip);
+      if (cmp < 0)
+        lo = mid + 1;
+      else
+        hi = mid;
+    }
+  if (lo == control_cache.nitems
+      || strcmp (control_cache.items[lo].hexgrip, hexgrip))
+    return control_cache.err? control_cache.err : gpg_error (GPG_ERR_EOF);
+
+  item = control_cache.items + lo;
+  if (r_disabled)
+    *r_disabled = item->disabled;
+  if (r_ttl)
+    *r_ttl = item->ttl;
+  if (r_confirm)
+    *r_confirm = item->confirm;
+  if (r_lnr)
+    *r_lnr = item->lnr;
+  return 0;
+}
+
+
+
 /* Add an entry to the control file to mark the key with the keygrip
    HEXGRIP as usable for SSH; i.e. it will be returned when ssh asks
    for it.  FMTFPR is the fingerprint string.  This function is in
@@ -1145,6 +1382,7 @@ add_control_entry (ctrl_t ctrl, ssh_key_type_spec_t *spec,
   xfree (fpr_md5);
   xfree (fpr_sha256);
   close_control_file (cf);
+  control_cache.valid = 0;
   return 0;
 }
 
@@ -1153,20 +1391,15 @@ add_control_entry (ctrl_t ctrl, ssh_key_type_spec_t *spec,
 static int
 ttl_from_sshcontrol (const char *hexgrip)
 {
-  ssh_control_file_t cf;
   int disabled, ttl;
 
   if (!hexgrip || strlen (hexgrip) != 40)
     return 0;  /* Wrong input: Use global default.  */
 
-  if (open_control_file (&cf, 0))
-    return 0; /* Error: Use the global default TTL.  */
-
-  if (search_control_file (cf, hexgrip, &disabled, &ttl, NULL, NULL)
+  if (search_control_cache (hexgrip, &disabled, &ttl, NULL, NULL)
       || disabled)
-    ttl = 0;  /* Use the global default if not found or disabled.  */
-
-  close_control_file (cf);
+    ttl = 0;  /* Use the global default if not found, disabled or on
+                 error.  */
 
   return ttl;
 }
@@ -1176,22 +1409,19 @@ ttl_from_sshcontrol (const char *hexgrip)
 static int
 confirm_flag_from_sshcontrol (const char *hexgrip)
 {
-  ssh_control_file_t cf;
   int disabled, confirm;
 
   if (!hexgrip || strlen (hexgrip) != 40)
     return 1;  /* Wrong input: Better ask for confirmation.  */
 
-  if (open_control_file (&cf, 0))
+  if (load_control_cache ())
     return 1; /* Error: Better ask for confirmation.  */
 
-  if (search_control_file (cf, hexgrip, &disabled, NULL, &confirm, NULL)
+  if (search_control_cache (hexgrip, &disabled, NULL, &confirm, NULL)
       || disabled)
     confirm = 0;  /* If not found or disabled, there is no reason to
                      ask for confirmation.  */
 
-  close_control_file (cf);
-
   return confirm;
 }
 
@@ -2476,16 +2706,60 @@ card_key_available (ctrl_t ctrl, const struct card_key_info_s *keyinfo,
   return 0;
 }
 
+/* Return a copy of the list of card infos LIST or NULL on error.  */
+static struct card_key_info_s *
+copy_card_keyinfo (const struct card_key_info_s *list)
+{
+  struct card_key_info_s *result = NULL;
+  struct card_key_info_s **tail = &result;
+  struct card_key_info_s *item;
+
+  for (; list; list = list->next)
+    {
+      item = xtrycalloc (1, sizeof *item);
+      if (!item)
+        goto fail;
+      *tail = item;
+      tail = &item->next;
+      strcpy (item->keygrip, list->keygrip);
+      if ((list->serialno && !(item->serialno = xtrystrdup (list->serialno)))
+          || (list->idstr && !(item->idstr = xtrystrdup (list->idstr)))
+          || (list->usage && !(item->usage = xtrystrdup (list->usage))))
+        goto fail;
+    }
+  return result;
+
+ fail:
+  agent_card_free_keyinfo (result);
+  return NULL;
+}
+
+
+/* Return the keys available on cards.  To avoid asking the scdaemon
+ * for each request the list is cached for CARD_KEYINFO_TTL
+ * seconds.  */
 static struct card_key_info_s *
 get_ssh_keyinfo_on_cards (ctrl_t ctrl)
 {
   struct card_key_info_s *keyinfo_on_cards = NULL;
   gpg_error_t err;
   char *serialno;
+  time_t now;
 
   if (opt.disable_daemon[DAEMON_SCD])
     return NULL;
 
+  now = gnupg_get_time ();
+  if (card_keyinfo_cache_valid && now >= card_keyinfo_cache_time
+      && now < card_keyinfo_cache_time + CARD_KEYINFO_TTL)
+    {
+      if (!card_keyinfo_cache)
+        return NULL;
+      keyinfo_on_cards = copy_card_keyinfo (card_keyinfo_cache);
+      if (keyinfo_on_cards)
+        return keyinfo_on_cards;
+    }
+
   /* Scan for new device(s).  */
   err = agent_card_serialno (ctrl, &serialno, NULL);
   if (err)
@@ -2493,19 +2767,207 @@ get_ssh_keyinfo_on_cards (ctrl_t ctrl)
       if (opt.verbose)
         log_info (_("error getting list of cards: %s\n"),
                   gpg_strerror (err));
-      return NULL;
     }
+  else
+    {
+      xfree (serialno);
 
-  xfree (serialno);
+      err = agent_card_keyinfo (ctrl, NULL, GCRY_PK_USAGE_AUTH,
+                                &keyinfo_on_cards);
+      if (err)
+        keyinfo_on_cards = NULL;
+    }
 
-  err = agent_card_keyinfo (ctrl, NULL, GCRY_PK_USAGE_AUTH, &keyinfo_on_cards);
-  if (err)
-    return NULL;
+  agent_card_free_keyinfo (card_keyinfo_cache);
+  card_keyinfo_cache = copy_card_keyinfo (keyinfo_on_cards);
+  card_keyinfo_cache_valid = (!keyinfo_on_cards || card_keyinfo_cache);
+  card_keyinfo_cache_time = now;
 
   return keyinfo_on_cards;
 }
 
 
+/* Serialize the public KEY the same way ssh_send_key_public does
+ * and store the result in a newly allocated buffer at (R_BLOB,
+ * R_BLOBLEN).  */
+static gpg_error_t
+serialize_key_public (gcry_sexp_t key,
+                      unsigned char **r_blob, size_t *r_bloblen)
+{
+  gpg_error_t err;
+  estream_t stream;
+  void *buffer;
+  size_t buflen;
+
+  *r_blob = NULL;
+  *r_bloblen = 0;
+
+  stream = es_fopenmem (0, "r+b");
+  if (!stream)
+    return gpg_error_from_syserror ();
+  err = ssh_send_key_public (stream, key, NULL);
+  if (err)
+    {
+      es_fclose (stream);
+      return err;
+    }
+  if (es_fclose_snatch (stream, &buffer, &buflen))
+    return gpg_error_from_syserror ();
+  if (!buflen)
+    err = gpg_error (GPG_ERR_PUBKEY_ALGO);  /* Nothing written.  */
+  else if (!(*r_blob = xtrymalloc (buflen)))
+    err = gpg_error_from_syserror ();
+  else
+    {
+      memcpy (*r_blob, buffer, buflen);
+      *r_bloblen = buflen;
+    }
+  es_free (buffer);
+  return err;
+}
+
+
+/* Return the serialized public key for the keygrip GRIP at (R_BLOB,
+ * R_BLOBLEN).  If FOR_SSH is set the key is read using
+ * agent_ssh_key_from_file and its ordinal is stored at R_ORDER.  An
+ * error is returned if the key shall not be listed.  The result is
+ * taken from the cache if the key file did not change.  */
+static gpg_error_t
+get_key_blob (ctrl_t ctrl, const unsigned char *grip, int for_ssh,
+              unsigned int seqno, int *r_order,
+              unsigned char **r_blob, size_t *r_bloblen)
+{
+  gpg_error_t err;
+  char hexgrip[40+4+1];
+  char *fname;
+  struct stat st;
+  struct key_blob_item_s *item;
+  gcry_sexp_t key = NULL;
+  int order = 0;
+  unsigned char *blob = NULL;
+  size_t bloblen = 0;
+
+  *r_blob = NULL;
+  *r_bloblen = 0;
+  if (r_order)
+    *r_order = 0;
+
+  bin2hex (grip, 20, hexgrip);
+  strcpy (hexgrip+40, ".key");
+  fname = make_filename_try (gnupg_homedir (), GNUPG_PRIVATE_KEYS_DIR,
+                             hexgrip, NULL);
+  if (!fname)
+    return gpg_error_from_syserror ();
+  if (gnupg_stat (fname, &st))
+    {
+      err = gpg_error_from_syserror ();
+      xfree (fname);
+      return err;
+    }
+  xfree (fname);
+
+  for (item = key_blob_cache[*grip % KEY_BLOB_CACHE_HASH_SIZE];
+       item; item = item->next)
+    if (!memcmp (item->grip, grip, KEYGRIP_LEN) && item->for_ssh == for_ssh)
+      break;
+  if (item && item->mtime == st.st_mtime && item->size == st.st_size
+      && item->ino == st.st_ino)
+    {
+      item->seqno = seqno;
+      if (item->err)
+        return item->err;
+      *r_blob = xtrymalloc (item->bloblen);
+      if (!*r_blob)
+        return gpg_error_from_syserror ();
+      memcpy (*r_blob, item->blob, item->bloblen);
+      *r_bloblen = item->bloblen;
+      if (r_order)
+        *r_order = item->order;
+      return 0;
+    }
+
+  if (for_ssh)
+    err = agent_ssh_key_from_file (ctrl, grip, &key, &order);
+  else
+    err = agent_public_key_from_file (ctrl, grip, &key);
+  if (!err)
+    err = serialize_key_public (key, &blob, &bloblen);
+  gcry_sexp_release (key);
+
+  /* Cache the result unless it is a system error or the file has been
+   * modified within the last second so that a further change might
+   * go unnoticed.  Note that we need to look up the item again
+   * because reading the key may have switched threads.  */
+  if ((!err || !(gpg_err_code (err) & GPG_ERR_SYSTEM_ERROR))
+      && st.st_mtime + 1 < time (NULL))
+    {
+      for (item = key_blob_cache[*grip % KEY_BLOB_CACHE_HASH_SIZE];
+           item; item = item->next)
+        if (!memcmp (item->grip, grip, KEYGRIP_LEN)
+            && item->for_ssh == for_ssh)
+          break;
+      if (!item && (item = xtrycalloc (1, sizeof *item)))
+        {
+          memcpy (item->grip, grip, KEYGRIP_LEN);
+          item->for_ssh = for_ssh;
+          item->next = key_blob_cache[*grip % KEY_BLOB_CACHE_HASH_SIZE];
+          key_blob_cache[*grip % KEY_BLOB_CACHE_HASH_SIZE] = item;
+        }
+      if (item)
+        {
+          xfree (item->blob);
+          item->blob = NULL;
+          item->bloblen = 0;
+          item->mtime = st.st_mtime;
+          item->size = st.st_size;
+          item->ino = st.st_ino;
+          item->seqno = seqno;
+          item->err = err;
+          item->order = order;
+          if (!err && (item->blob = xtrymalloc (bloblen)))
+            {
+              memcpy (item->blob, blob, bloblen);
+              item->bloblen = bloblen;
+            }
+          else if (!err)
+            item->mtime = (time_t)(-1);  /* Make it invalid.  */
+        }
+    }
+
+  if (err)
+    {
+      xfree (blob);
+      return err;
+    }
+  *r_blob = blob;
+  *r_bloblen = bloblen;
+  if (r_order)
+    *r_order = order;
+  return 0;
+}
+
+
+/* Remove all items from the key blob cache which have not been used
+ * by the listing SEQNO.  */
+static void
+prune_key_blob_cache (unsigned int seqno)
+{
+  struct key_blob_item_s *item, **itemp;
+  int i;
+
+  for (i=0; i < KEY_BLOB_CACHE_HASH_SIZE; i++)
+    for (itemp = &key_blob_cache[i]; (item = *itemp); )
+      if (item->seqno != seqno)
+        {
+          *itemp = item->next;
+          xfree (item->blob);
+          xfree (item);
+        }
+      else
+        itemp = &item->next;
+}
+
+
 /* Append (KEY,CARDSN,LNR,ORDER) to ARRAY.  The array must initially
  * be passed as a cleared struct.  ARRAY takes ownership of KEY and
  * CARDSN.  */
@@ -2528,10 +2990,30 @@ add_to_key_array (struct key_collection_s *array, gcry_sexp_t key,
   array->items[array->nitems].key = key;
   array->items[array->nitems].cardsn = cardsn;
   array->items[array->nitems].order = order;
+  array->items[array->nitems].blob = NULL;
+  array->items[array->nitems].bloblen = 0;
   array->nitems++;
   return 0;
 }
 
+
+/* Append the serialized key (BLOB,BLOBLEN) with ORDER to ARRAY.
+ * ARRAY takes ownership of BLOB.  */
+static gpg_error_t
+add_blob_to_key_array (struct key_collection_s *array,
+                       unsigned char *blob, size_t bloblen, int order)
+{
+  gpg_error_t err;
+
+  err = add_to_key_array (array, NULL, NULL, order);
+  if (!err)
+    {
+      array->items[array->nitems-1].blob = blob;
+      array->items[array->nitems-1].bloblen = bloblen;
+    }
+  return err;
+}
+
 /* Release the content of ARRAY.  */
 static void
 free_key_array (struct key_collection_s *array)
@@ -2544,6 +3026,7 @@ free_key_array (struct key_collection_s *array)
         {
           gcry_sexp_release (array->items[n].key);
           xfree (array->items[n].cardsn);
+          xfree (array->items[n].blob);
         }
       xfree (array->items);
     }
@@ -2576,16 +3059,19 @@ ssh_send_available_keys (ctrl_t ctrl, estream_t key_blobs, u32 *r_key_counter)
   gnupg_dir_t dir = NULL;
   gnupg_dirent_t dir_entry;
   char hexgrip[41];
-  ssh_control_file_t cf = NULL;
   struct card_key_info_s *keyinfo_on_cards, *l;
   char *cardsn;
   gcry_sexp_t key_public = NULL;
+  unsigned char *blob;
+  size_t bloblen;
   int count;
   struct key_collection_s keyarray = { NULL };
+  unsigned int seqno;
 
-  err = open_control_file (&cf, 0);
+  err = load_control_cache ();
   if (err)
     return err;
+  seqno = ++key_blob_cache_seqno;
 
   /* First, get information keys available on cards on-line. */
   keyinfo_on_cards = get_ssh_keyinfo_on_cards (ctrl);
@@ -2617,6 +3103,8 @@ ssh_send_available_keys (ctrl_t ctrl, estream_t key_blobs, u32 *r_key_counter)
       unsigned char grip[20];
 
       cardsn = NULL;
+      key_public = NULL;
+      blob = NULL;
       if (strlen (dir_entry->d_name) != 44
           || strcmp (dir_entry->d_name + 40, ".key"))
         continue;
@@ -2635,7 +3123,7 @@ ssh_send_available_keys (ctrl_t ctrl, estream_t key_blobs, u32 *r_key_counter)
 
       /* Check if it's listed in "ssh_control" file.  */
       disabled = is_ssh = 0;
-      err = search_control_file (cf, hexgrip, &disabled, NULL, NULL, &lnr);
+      err = search_control_cache (hexgrip, &disabled, NULL, NULL, &lnr);
       if (!err)
         {
           if (!disabled)
@@ -2682,10 +3170,10 @@ ssh_send_available_keys (ctrl_t ctrl, estream_t key_blobs, u32 *r_key_counter)
           order = 1000;
         }
       else if (is_ssh)
-        err = agent_public_key_from_file (ctrl, grip, &key_public);
+        err = get_key_blob (ctrl, grip, 0, seqno, NULL, &blob, &bloblen);
       else /* Examine the file if it's suitable for SSH.  */
         {
-          err = agent_ssh_key_from_file (ctrl, grip, &key_public, &order);
+          err = get_key_blob (ctrl, grip, 1, seqno, &order, &blob, &bloblen);
           if (err)
             order = 0;
           else if (order < 0)
@@ -2706,17 +3194,24 @@ ssh_send_available_keys (ctrl_t ctrl, estream_t key_blobs, u32 *r_key_counter)
           continue;
         }
 
-      err = add_to_key_array (&keyarray, key_public, cardsn, order);
+      if (blob)
+        err = add_blob_to_key_array (&keyarray, blob, bloblen, order);
+      else
+        err = add_to_key_array (&keyarray, key_public, cardsn, order);
       if (err)
         {
           gcry_sexp_release (key_public);
           xfree (cardsn);
+          xfree (blob);
           goto leave;
         }
     }
 
   gnupg_closedir (dir);
-  ssh_close_control_file (cf);
+  if (err)
+    goto leave;
+  if (seqno == key_blob_cache_seqno)
+    prune_key_blob_cache (seqno);
 
   /* Lastly, handle remaining keys which don't have the stub files.  */
   for (l = keyinfo_on_cards, count=0; l; l = l->next, count++)
@@ -2746,6 +3241,16 @@ ssh_send_available_keys (ctrl_t ctrl, estream_t key_blobs, u32 *r_key_counter)
   /* And print the keys.  */
   for (count=0; count < keyarray.nitems; count++)
     {
+      if (keyarray.items[count].blob)
+        {
+          if (es_write (key_blobs, keyarray.items[count].blob,
+                        keyarray.items[count].bloblen, NULL))
+            {
+              err = gpg_error_from_syserror ();
+              goto leave;
+            }
+          continue;
+        }
       err = ssh_send_key_public (key_blobs, keyarray.items[count].key,
                                  keyarray.items[count].cardsn);
       if (err)
@@ -2959,11 +3464,58 @@ data_sign (ctrl_t ctrl, ssh_key_type_spec_t *spec,
 }
 
 
+/* Return the type of the key and its keygrip for the KEY_BLOB of a
+ * sign request at R_SPEC and R_GRIP.  The result is taken from the
+ * sign key cache so that the blob needs to be parsed only for the
+ * first request with that key.  */
+static gpg_error_t
+get_sign_key (const unsigned char *key_blob, size_t key_blob_size,
+              ssh_key_type_spec_t *r_spec, unsigned char *r_grip)
+{
+  gpg_error_t err;
+  struct sign_key_item_s *item;
+  gcry_sexp_t key = NULL;
+  unsigned int hash = 0;
+  size_t n;
+
+  for (n=0; n < key_blob_size; n++)
+    hash = hash * 31 + key_blob[n];
+  item = &sign_key_cache[hash % SIGN_KEY_CACHE_SIZE];
+
+  if (item->blob && item->bloblen == key_blob_size
+      && !memcmp (item->blob, key_blob, key_blob_size))
+    {
+      *r_spec = item->spec;
+      memcpy (r_grip, item->grip, KEYGRIP_LEN);
+      return 0;
+    }
+
+  err = ssh_read_key_public_from_blob ((unsigned char *)key_blob,
+                                       key_blob_size, &key, r_spec);
+  if (!err)
+    err = ssh_key_grip (key, r_grip);
+  gcry_sexp_release (key);
+  if (err)
+    return err;
+
+  /* Note that we did not switch threads since the lookup.  */
+  xfree (item->blob);
+  item->blob = xtrymalloc (key_blob_size);
+  if (item->blob)
+    {
+      memcpy (item->blob, key_blob, key_blob_size);
+      item->bloblen = key_blob_size;
+      item->spec = *r_spec;
+      memcpy (item->grip, r_grip, KEYGRIP_LEN);
+    }
+  return 0;
+}
+
+
 /* Handler for the "sign_request" command.  */
 static gpg_error_t
 ssh_handler_sign_request (ctrl_t ctrl, estream_t request, estream_t response)
 {
-  gcry_sexp_t key = NULL;
   ssh_key_type_spec_t spec;
   unsigned char hash[MAX_DIGEST_LEN];
   unsigned int hash_n;
@@ -2984,7 +3536,7 @@ ssh_handler_sign_request (ctrl_t ctrl, estream_t request, estream_t response)
   if (err)
     goto out;
 
-  err = ssh_read_key_public_from_blob (key_blob, key_blob_size, &key, &spec);
+  err = get_sign_key (key_blob, key_blob_size, &spec, key_grip);
   if (err)
     goto out;
 
@@ -3039,10 +3591,6 @@ ssh_handler_sign_request (ctrl_t ctrl, estream_t request, estream_t response)
   else
     ctrl->digest.raw_value = 1;
 
-  /* Calculate key grip.  */
-  err = ssh_key_grip (key, key_grip);
-  if (err)
-    goto out;
   ctrl->have_keygrip = 1;
   memcpy (ctrl->keygrip, key_grip, 20);
 
@@ -3094,7 +3642,6 @@ ssh_handler_sign_request (ctrl_t ctrl, estream_t request, estream_t response)
 
  leave:
 
-  gcry_sexp_release (key);
   xfree (key_blob);
   xfree (data);
   es_free (sig);
@@ -3679,6 +4226,9 @@ ssh_request_process (ctrl_t ctrl, estream_t stream_sock)
   unsigned char *request_data = NULL;
   u32 request_data_size;
   u32 response_size;
+  void *response_data = NULL;
+  size_t response_len;
+  unsigned char *p;
 
   /* Create memory streams for request/response data.  The entire
      request will be stored in secure memory, since it might contain
@@ -3692,8 +4242,11 @@ ssh_request_process (ctrl_t ctrl, estream_t stream_sock)
      agent's owner floods his own agent with many large messages.
      -moritz */
 
-  /* Retrieve request.  */
+  /* Retrieve request.  An EOF here is the regular end of the
+     connection and thus we do not try to send an error.  */
   err = stream_read_string (stream_sock, 1, &request_data, &request_data_size);
+  if (gpg_err_code (err) == GPG_ERR_EOF)
+    goto leave;
   if (err)
     goto out;
 
@@ -3737,12 +4290,17 @@ ssh_request_process (ctrl_t ctrl, estream_t stream_sock)
     goto out;
   es_rewind (request);
 
+  /* The response starts with a placeholder for its length so that
+     it can be sent with just one write.  */
   response = es_fopenmem (0, "r+b");
   if (! response)
     {
       err = gpg_error_from_syserror ();
       goto out;
     }
+  err = stream_write_uint32 (response, 0);
+  if (err)
+    goto out;
 
   if (opt.verbose)
     log_info ("ssh request handler for %s (%u) started\n",
@@ -3766,26 +4324,26 @@ ssh_request_process (ctrl_t ctrl, estream_t stream_sock)
       goto out;
     }
 
-  response_size = es_ftell (response);
-  if (opt.verbose > 1)
-    log_info ("sending ssh response of length %u\n",
-              (unsigned int)response_size);
-
-  err = es_fseek (response, 0, SEEK_SET);
-  if (err)
+  if (es_fclose_snatch (response, &response_data, &response_len))
     {
+      err = gpg_error_from_syserror ();
       send_err = 1;
       goto out;
     }
+  response = NULL;
+  log_assert (response_len >= 4);
 
-  err = stream_write_uint32 (stream_sock, response_size);
-  if (err)
-    {
-      send_err = 1;
-      goto out;
-    }
+  response_size = response_len - 4;
+  if (opt.verbose > 1)
+    log_info ("sending ssh response of length %u\n",
+              (unsigned int)response_size);
 
-  err = stream_copy (stream_sock, response);
+  p = response_data;
+  p[0] = response_size >> 24;
+  p[1] = response_size >> 16;
+  p[2] = response_size >>  8;
+  p[3] = response_size >>  0;
+  err = stream_write_data (stream_sock, response_data, response_len);
   if (err)
     goto out;
 
@@ -3801,12 +4359,12 @@ ssh_request_process (ctrl_t ctrl, estream_t stream_sock)
 
   if (send_err)
     {
+      static const unsigned char failure[5] =
+        { 0, 0, 0, 1, SSH_RESPONSE_FAILURE };
+
       if (opt.verbose > 1)
         log_info ("sending ssh error response\n");
-      err = stream_write_uint32 (stream_sock, 1);
-      if (err)
-	goto leave;
-      err = stream_write_byte (stream_sock, SSH_RESPONSE_FAILURE);
+      err = stream_write_data (stream_sock, failure, sizeof failure);
       if (err)
 	goto leave;
     }
@@ -3815,6 +4373,7 @@ ssh_request_process (ctrl_t ctrl, estream_t stream_sock)
 
   es_fclose (request);
   es_fclose (response);
+  es_free (response_data);
   xfree (request_data);
 
   return !!err;
@@ -3917,18 +4476,10 @@ start_command_handler_ssh_stream (ctrl_t ctrl, estream_t stream)
       goto out;
     }
 
-  /* Main processing loop. */
+  /* Main processing loop.  An EOF while waiting for the next request
+     terminates the loop.  */
   while ( !ssh_request_process (ctrl, stream) )
-    {
-      /* Check whether we have reached EOF before trying to read
-         another request.  */
-      int c;
-
-      c = es_fgetc (stream);
-      if (c == EOF)
-        break;
-      es_ungetc (c, stream);
-    }
+    ;
 
   /* Reset the daemon in case it has been used. */
   agent_reset_daemon (ctrl);
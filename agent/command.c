@@ -41,6 +41,7 @@
 #include "../common/ssh-utils.h"
 #include "../common/asshelp.h"
 #include "../common/server-help.h"
+#include "../common/opstats.h"
 
 
 /* Maximum allowed size of the inquired ciphertext.  */
@@ -51,6 +52,8 @@
 #define MAXLEN_KEYDATA 8192
 /* Maximum length of a secret to store under one key.  */
 #define MAXLEN_PUT_SECRET 4096
+/* Maximum length of the list for PRESET_PASSPHRASE --list.  */
+#define MAXLEN_PRESET_LIST (256*1024)
 /* The size of the import/export KEK key (in bytes).  */
 #define KEYWRAP_KEYSIZE (128/8)
 
@@ -122,6 +125,8 @@ struct server_local_s
     unsigned int maybe_key_change;
   } last_card_keyinfo;
 
+  /* Start time of the current command for the statistics.  */
+  unsigned long long cmd_start;
 };
 
 
@@ -2232,6 +2237,8 @@ cmd_clear_passphrase (assuan_context_t ctx, char *line)
     return set_error (GPG_ERR_ASS_PARAMETER, "invalid length of cacheID");
 
   agent_put_cache (ctrl, cacheid, cache_mode, NULL, 0);
+  if (cache_mode != CACHE_MODE_SSH)
+    agent_forget_unprotected_key (cacheid);
 
   agent_clear_passphrase (ctrl, cacheid, cache_mode);
 
@@ -2490,9 +2497,104 @@ cmd_passwd (assuan_context_t ctx, char *line)
 }
 
 
+/* Helper for cmd_preset_passphrase to implement the --list
+ * option.  */
+static gpg_error_t
+preset_passphrase_list (assuan_context_t ctx, ctrl_t ctrl, int opt_restricted)
+{
+  gpg_error_t err;
+  unsigned char *buffer = NULL;
+  size_t buflen;
+  const char **keys = NULL;
+  const char **passphrases = NULL;
+  int nitems, maxitems;
+  char *p, *pend, *grip, *hexpw;
+  size_t n;
+  int save_restricted;
+
+  err = print_assuan_status (ctx, "INQUIRE_MAXLEN", "%u", MAXLEN_PRESET_LIST);
+  if (err)
+    goto leave;
+  assuan_begin_confidential (ctx);
+  err = assuan_inquire (ctx, "PASSPHRASES", &buffer, &buflen,
+                        MAXLEN_PRESET_LIST);
+  assuan_end_confidential (ctx);
+  if (err)
+    goto leave;
+
+  maxitems = 1;
+  for (n=0; n < buflen; n++)
+    if (buffer[n] == '\n')
+      maxitems++;
+  keys = xtrycalloc (maxitems, sizeof *keys);
+  passphrases = xtrycalloc (maxitems, sizeof *passphrases);
+  if (!keys || !passphrases)
+    {
+      err = out_of_core ();
+      goto leave;
+    }
+
+  /* Parse all lines of the form "<keygrip> -1 <hexstring>" before
+   * changing the cache.  The hex strings are converted in place.  */
+  nitems = 0;
+  for (p = (char*)buffer; p < (char*)buffer + buflen; p = pend + 1)
+    {
+      pend = memchr (p, '\n', (char*)buffer + buflen - p);
+      if (!pend)
+        pend = (char*)buffer + buflen;
+      *pend = 0;
+      p = trim_spaces (p);
+      if (!*p || *p == '#')
+        continue;
+      grip = p;
+      for (; *p && !spacep (p); p++)
+        ;
+      if (*p)
+        *p++ = 0;
+      while (spacep (p))
+        p++;
+      if (strncmp (p, "-1", 2) || (p[2] && !spacep (p+2)))
+        {
+          /* Currently, only infinite timeouts are allowed.  */
+          err = set_error (GPG_ERR_NOT_IMPLEMENTED, "timeout must be -1");
+          goto leave;
+        }
+      for (p += 2; spacep (p); p++)
+        ;
+      hexpw = p;
+      if (!*hexpw || !hex2str (hexpw, hexpw, strlen (hexpw)+1, NULL))
+        {
+          err = set_error (GPG_ERR_ASS_PARAMETER, "invalid hexstring");
+          goto leave;
+        }
+      keys[nitems] = grip;
+      passphrases[nitems] = hexpw;
+      nitems++;
+    }
+
+  save_restricted = ctrl->restricted;
+  if (opt_restricted)
+    ctrl->restricted = 1;
+  err = agent_put_cache_list (ctrl, keys, passphrases, nitems,
+                              CACHE_MODE_ANY, -1);
+  ctrl->restricted = save_restricted;
+
+ leave:
+  if (buffer)
+    {
+      wipememory (buffer, buflen);
+      xfree (buffer);
+    }
+  xfree (keys);
+  xfree (passphrases);
+  return err;
+}
+
+
 static const char hlp_preset_passphrase[] =
   "PRESET_PASSPHRASE [--inquire] [--restricted] \\\n"
   "                  <string_or_keygrip> <timeout> [<hexstring>]\n"
+  "PRESET_PASSPHRASE --list [--restricted]\n"
   "\n"
   "Set the cached passphrase/PIN for the key identified by the keygrip\n"
   "to passwd for the given time, where -1 means infinite and 0 means\n"
@@ -2501,7 +2603,11 @@ static const char hlp_preset_passphrase[] =
   "pinentry module unless --inquire is passed in which case the passphrase\n"
   "is retrieved from the client via a server inquire.  The option\n"
   "--restricted can be used to put the passphrase into the cache used\n"
-  "by restricted connections.";
+  "by restricted connections.\n"
+  "\n"
+  "With --list the data is retrieved via the inquiry PASSPHRASES\n"
+  "which returns lines of the form \"<keygrip> <timeout> <hexstring>\".\n"
+  "Either all or none of the passphrases are stored in the cache.";
 static gpg_error_t
 cmd_preset_passphrase (assuan_context_t ctx, char *line)
 {
@@ -2522,6 +2628,14 @@ cmd_preset_passphrase (assuan_context_t ctx, char *line)
 
   opt_inquire = has_option (line, "--inquire");
   opt_restricted = has_option (line, "--restricted");
+  if (has_option (line, "--list"))
+    {
+      if (opt_inquire || *skip_options (line))
+        return leave_cmd (ctx, set_error (GPG_ERR_ASS_PARAMETER,
+                                          "--list takes no arguments"));
+      return leave_cmd (ctx, preset_passphrase_list (ctx, ctrl,
+                                                     opt_restricted));
+    }
   line = skip_options (line);
   grip_clear = line;
   while (*line && (*line != ' ' && *line != '\t'))
@@ -3101,7 +3215,7 @@ cmd_export_key (assuan_context_t ctx, char *line)
   cipherhd = NULL;
 
   assuan_begin_confidential (ctx);
-  err = assuan_send_data (ctx, wrappedkey, wrappedkeylen);
+  err = write_assuan_data_lines (ctx, wrappedkey, wrappedkeylen);
   assuan_end_confidential (ctx);
 
 
@@ -3827,6 +3941,14 @@ static const char hlp_getinfo[] =
   "  std_startup_env - List the standard startup environment.\n"
   "  getenv NAME     - Return value of envvar NAME.\n"
   "  connections     - Return number of active connections.\n"
+  "  cache_stats     - Return the number of cache entries, expired\n"
+  "                    passphrases and removed entries.\n"
+  "  secmem_stats    - Return the size of the secure memory pool, the\n"
+  "                    size of expansion areas, the number of running\n"
+  "                    and the maximum number of concurrent secret key\n"
+  "                    operations, and the number of operations which\n"
+  "                    ran out of secure memory.\n"
+  "  stats           - Return command statistics in Prometheus format.\n"
   "  jent_active     - Returns OK if Libgcrypt's JENT is active.\n"
   "  restricted      - Returns OK if the connection is in restricted mode.\n"
   "  cmd_has_option CMD OPT\n"
@@ -3987,6 +4109,40 @@ cmd_getinfo (assuan_context_t ctx, char *line)
                 get_agent_active_connection_count ());
       rc = assuan_send_data (ctx, numbuf, strlen (numbuf));
     }
+  else if (!strcmp (line, "stats"))
+    {
+      char *string = opstats_format ("gpg-agent");
+
+      if (!string)
+        rc = gpg_error_from_syserror ();
+      else
+        {
+          rc = assuan_send_data (ctx, string, strlen (string));
+          xfree (string);
+        }
+    }
+  else if (!strcmp (line, "cache_stats"))
+    {
+      char numbuf[80];
+      unsigned int count;
+      unsigned long expired, removed;
+
+      agent_cache_get_stats (&count, &expired, &removed);
+      snprintf (numbuf, sizeof numbuf, "%u %lu %lu", count, expired, removed);
+      rc = assuan_send_data (ctx, numbuf, strlen (numbuf));
+    }
+  else if (!strcmp (line, "secmem_stats"))
+    {
+      char numbuf[100];
+      unsigned long size, expand, failures;
+      unsigned int active, max_active;
+
+      agent_secmem_get_stats (&size, &expand, &active, &max_active,
+                              &failures);
+      snprintf (numbuf, sizeof numbuf, "%lu %lu %u %u %lu",
+                size, expand, active, max_active, failures);
+      rc = assuan_send_data (ctx, numbuf, strlen (numbuf));
+    }
   else if (!strcmp (line, "jent_active"))
     {
       char *buf;
@@ -4142,12 +4298,26 @@ option_handler (assuan_context_t ctx, const char *key, const char *value)
 
 /* Called by libassuan after all commands. ERR is the error from the
    last assuan operation and not the one returned from the command. */
+/* This function is called by libassuan before a command is run.  */
+static gpg_error_t
+pre_cmd_notify (assuan_context_t ctx, const char *cmd)
+{
+  ctrl_t ctrl = assuan_get_pointer (ctx);
+
+  (void)cmd;
+
+  ctrl->server_local->cmd_start = opstats_now ();
+  return 0;
+}
+
+
 static void
 post_cmd_notify (assuan_context_t ctx, gpg_error_t err)
 {
   ctrl_t ctrl = assuan_get_pointer (ctx);
 
-  (void)err;
+  opstats_record (assuan_get_command_name (ctx),
+                  ctrl->server_local->cmd_start, err);
 
   /* Switch off any I/O monitor controlled logging pausing. */
   ctrl->server_local->pause_io_logging = 0;
@@ -4284,6 +4454,7 @@ register_commands (assuan_context_t ctx)
       if (rc)
         return rc;
     }
+  assuan_register_pre_cmd_notify (ctx, pre_cmd_notify);
   assuan_register_post_cmd_notify (ctx, post_cmd_notify);
   assuan_register_reset_notify (ctx, reset_notify);
   assuan_register_option_handler (ctx, option_handler);
@@ -39,6 +39,11 @@
 #define O_BINARY 0
 #endif
 
+#if defined(HAVE_OPENAT) && defined(HAVE_FACCESSAT) \
+    && defined(HAVE_UNLINKAT) && defined(O_DIRECTORY) && defined(O_CLOEXEC)
+# define USE_KEYDIR_FD 1
+#endif
+
 /* Helper to pass data to the check callback of the unprotect function. */
 struct try_unprotect_arg_s
 {
@@ -80,6 +85,245 @@ linefeed_to_percent0A (const char *string)
 }
 
 
+/* The number of hash buckets of the key index.  */
+#define KEY_INDEX_HASH_SIZE 256
+
+/* An item of the in-core index of the private key directory.  The
+ * key type and the shadow info are filled in when the key file has
+ * been read for the first time.  */
+typedef struct key_index_item_s *key_index_item_t;
+struct key_index_item_s
+{
+  key_index_item_t next;
+  unsigned char grip[KEYGRIP_LEN];
+  int keytype;                      /* PRIVATE_KEY_UNKNOWN if not known.  */
+  unsigned char *shadow_info;       /* Only for PRIVATE_KEY_SHADOWED.  */
+  unsigned char *shadow_info_type;  /* Ditto.  */
+};
+
+/* The index of the private key directory and the modification time
+ * of the directory at the time the index was built.  The index is
+ * rebuilt if the directory has been modified; changes done by the
+ * agent itself are recorded directly.  */
+static key_index_item_t key_index[KEY_INDEX_HASH_SIZE];
+static int key_index_valid;
+static time_t key_index_mtime;
+
+#ifdef USE_KEYDIR_FD
+/* An open file descriptor of the private key directory or -1.  This
+ * saves the lookup of the entire path for each access to a key file,
+ * which is noticeable on network file systems.  */
+static int keydir_fd = -1;
+#endif
+
+
+#ifdef USE_KEYDIR_FD
+/* Return the file descriptor of the private key directory and store
+ * its current status at R_ST.  Returns -1 if the directory can't be
+ * opened.  The directory is opened again if it has been removed.  */
+static int
+get_keydir_fd (struct stat *r_st)
+{
+  char *dirname;
+
+  if (keydir_fd != -1)
+    {
+      if (!fstat (keydir_fd, r_st) && r_st->st_nlink)
+        return keydir_fd;
+      close (keydir_fd);
+      keydir_fd = -1;
+    }
+
+  dirname = make_filename_try (gnupg_homedir (), GNUPG_PRIVATE_KEYS_DIR, NULL);
+  if (!dirname)
+    return -1;
+  keydir_fd = open (dirname, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+  xfree (dirname);
+  if (keydir_fd != -1 && fstat (keydir_fd, r_st))
+    {
+      close (keydir_fd);
+      keydir_fd = -1;
+    }
+  return keydir_fd;
+}
+#endif /*USE_KEYDIR_FD*/
+
+
+/* Open the key file HEXGRIP with the full name FNAME for reading.  */
+static estream_t
+open_key_file (const char *hexgrip, const char *fname)
+{
+#ifdef USE_KEYDIR_FD
+  struct stat st;
+  estream_t fp;
+  int dirfd, fd, saved_errno;
+
+  dirfd = get_keydir_fd (&st);
+  if (dirfd != -1)
+    {
+      fd = openat (dirfd, hexgrip, O_RDONLY | O_CLOEXEC);
+      if (fd == -1)
+        return NULL;
+      fp = es_fdopen (fd, "rb");
+      if (!fp)
+        {
+          saved_errno = errno;
+          close (fd);
+          gpg_err_set_errno (saved_errno);
+        }
+      return fp;
+    }
+#else
+  (void)hexgrip;
+#endif
+  return es_fopen (fname, "rb");
+}
+
+
+/* Release all items of the key index.  */
+static void
+release_key_index (void)
+{
+  key_index_item_t item;
+  int i;
+
+  for (i=0; i < KEY_INDEX_HASH_SIZE; i++)
+    while ((item = key_index[i]))
+      {
+        key_index[i] = item->next;
+        xfree (item->shadow_info);
+        xfree (item->shadow_info_type);
+        xfree (item);
+      }
+  key_index_valid = 0;
+}
+
+
+/* Return the index item for GRIP or NULL if there is none.  If
+ * CREATE is set a new item is created if needed.  */
+static key_index_item_t
+find_key_index_item (const unsigned char *grip, int create)
+{
+  key_index_item_t item;
+
+  for (item = key_index[*grip % KEY_INDEX_HASH_SIZE]; item; item = item->next)
+    if (!memcmp (item->grip, grip, KEYGRIP_LEN))
+      return item;
+
+  if (create && (item = xtrycalloc (1, sizeof *item)))
+    {
+      memcpy (item->grip, grip, KEYGRIP_LEN);
+      item->keytype = PRIVATE_KEY_UNKNOWN;
+      item->next = key_index[*grip % KEY_INDEX_HASH_SIZE];
+      key_index[*grip % KEY_INDEX_HASH_SIZE] = item;
+    }
+  return item;
+}
+
+
+/* Make sure the key index reflects the private key directory.
+ * Returns true if the index may be used.  The directory is scanned
+ * only if its modification time changed.  If the directory has been
+ * modified within the last second the index is used only for this
+ * call because a further change in the same second would not be
+ * detected.  */
+static int
+update_key_index (void)
+{
+  char *dirname;
+  struct stat st;
+  gnupg_dir_t dir;
+  gnupg_dirent_t dir_entry;
+  char hexgrip[40+1];
+  unsigned char grip[KEYGRIP_LEN];
+  int okay = 1;
+
+#ifdef USE_KEYDIR_FD
+  if (get_keydir_fd (&st) == -1)
+    {
+      release_key_index ();
+      return 0;
+    }
+  if (key_index_valid && st.st_mtime == key_index_mtime)
+    return 1;
+#endif
+
+  dirname = make_filename_try (gnupg_homedir (), GNUPG_PRIVATE_KEYS_DIR, NULL);
+  if (!dirname)
+    return 0;
+#ifndef USE_KEYDIR_FD
+  if (gnupg_stat (dirname, &st))
+    {
+      release_key_index ();
+      xfree (dirname);
+      return 0;
+    }
+  if (key_index_valid && st.st_mtime == key_index_mtime)
+    {
+      xfree (dirname);
+      return 1;
+    }
+#endif
+
+  release_key_index ();
+  dir = gnupg_opendir (dirname);
+  xfree (dirname);
+  if (!dir)
+    return 0;
+  while ((dir_entry = gnupg_readdir (dir)))
+    {
+      if (strlen (dir_entry->d_name) != 44
+          || strcmp (dir_entry->d_name + 40, ".key"))
+        continue;
+      strncpy (hexgrip, dir_entry->d_name, 40);
+      hexgrip[40] = 0;
+      if (hex2bin (hexgrip, grip, KEYGRIP_LEN) < 0)
+        continue;  /* Bad hex string.  */
+      if (!find_key_index_item (grip, 1))
+        {
+          okay = 0;
+          break;
+        }
+    }
+  gnupg_closedir (dir);
+
+  if (!okay)
+    {
+      release_key_index ();
+      return 0;
+    }
+  key_index_mtime = st.st_mtime;
+  key_index_valid = (st.st_mtime + 1 < time (NULL));
+  return 1;
+}
+
+
+/* Record in the key index that the key file for GRIP has been
+ * written (or removed if REMOVED is set).  */
+static void
+update_key_index_item (const unsigned char *grip, int removed)
+{
+  key_index_item_t item, *itemp;
+
+  if (!key_index_valid)
+    return;
+
+  for (itemp = &key_index[*grip % KEY_INDEX_HASH_SIZE];
+       (item = *itemp); itemp = &item->next)
+    if (!memcmp (item->grip, grip, KEYGRIP_LEN))
+      {
+        *itemp = item->next;
+        xfree (item->shadow_info);
+        xfree (item->shadow_info_type);
+        xfree (item);
+        break;
+      }
+
+  if (!removed && !find_key_index_item (grip, 1))
+    release_key_index ();
+}
+
+
 /* Write the S-expression formatted key (BUFFER,LENGTH) to our key
  * storage.  With FORCE passed as true an existing key with the given
  * GRIP will get overwritten.  If SERIALNO and KEYREF are given a
@@ -302,6 +546,7 @@ agent_write_private_key (const unsigned char *grip,
   es_fclose (fp);
   if (remove)
     gnupg_remove (fname);
+  update_key_index_item (grip, remove);
   xfree (fname);
   gcry_sexp_release (key);
   nvc_release (pk);
@@ -358,6 +603,7 @@ agent_update_private_key (const unsigned char *grip, nvc_t pk)
       log_error (_("error renaming '%s' to '%s': %s\n"),
                  fname, fname0, strerror (errno));
     }
+  update_key_index_item (grip, 0);
 
   xfree (fname);
   return err;
@@ -858,7 +1104,7 @@ read_key_file (const unsigned char *grip, gcry_sexp_t *result, nvc_t *r_keymeta)
 
   fname = make_filename (gnupg_homedir (), GNUPG_PRIVATE_KEYS_DIR,
                          hexgrip, NULL);
-  fp = es_fopen (fname, "rb");
+  fp = open_key_file (hexgrip, fname);
   if (!fp)
     {
       err = gpg_error_from_syserror ();
@@ -974,13 +1220,27 @@ remove_key_file (const unsigned char *grip)
   gpg_error_t err = 0;
   char *fname;
   char hexgrip[40+4+1];
+#ifdef USE_KEYDIR_FD
+  struct stat st;
+  int dirfd;
+#endif
 
   bin2hex (grip, 20, hexgrip);
   strcpy (hexgrip+40, ".key");
+#ifdef USE_KEYDIR_FD
+  if ((dirfd = get_keydir_fd (&st)) != -1)
+    {
+      if (unlinkat (dirfd, hexgrip, 0))
+        err = gpg_error_from_syserror ();
+      update_key_index_item (grip, !err);
+      return err;
+    }
+#endif
   fname = make_filename (gnupg_homedir (), GNUPG_PRIVATE_KEYS_DIR,
                          hexgrip, NULL);
   if (gnupg_remove (fname))
     err = gpg_error_from_syserror ();
+  update_key_index_item (grip, !err);
   xfree (fname);
   return err;
 }
@@ -1144,6 +1404,8 @@ agent_key_from_file (ctrl_t ctrl, const char *cache_nonce,
   gcry_sexp_t s_skey;
   nvc_t keymeta = NULL;
   char *desc_text_buffer = NULL;  /* Used in case we extend DESC_TEXT.  */
+  int use_key_cache;
+  unsigned char digest[20];
 
   *result = NULL;
   if (shadow_info)
@@ -1251,6 +1513,27 @@ agent_key_from_file (ctrl_t ctrl, const char *cache_nonce,
 	char *comment_buffer = NULL;
 	const char *comment = NULL;
 
+        /* If enabled, look into the cache of unprotected keys.  The
+         * cache is not used if the caller wants the passphrase or
+         * asked to bypass the passphrase cache.  The hash of the
+         * protected key makes sure that a changed key file is not
+         * served from the cache.  */
+        use_key_cache = (opt.max_cached_keys && !r_passphrase
+                         && cache_mode != CACHE_MODE_IGNORE);
+        if (use_key_cache)
+          {
+            unsigned char *buf_new;
+
+            gcry_md_hash_buffer (GCRY_MD_SHA1, digest, buf, len);
+            if (!agent_get_unprotected_key (ctrl, grip? grip : ctrl->keygrip,
+                                            digest, &buf_new))
+              {
+                xfree (buf);
+                buf = buf_new;
+                break;
+              }
+          }
+
         /* Note, that we will take the comment as a C string for
          * display purposes; i.e. all stuff beyond a Nul character is
          * ignored.  If a "Label" entry is available in the meta data
@@ -1294,6 +1577,9 @@ agent_key_from_file (ctrl_t ctrl, const char *cache_nonce,
             if (err)
               log_error ("failed to unprotect the secret key: %s\n",
                          gpg_strerror (err));
+            else if (use_key_cache)
+              agent_put_unprotected_key (ctrl, grip? grip : ctrl->keygrip,
+                                         digest, buf);
           }
 
 	xfree (desc_text_final);
@@ -1570,9 +1856,20 @@ agent_key_available (const unsigned char *grip)
   int result;
   char *fname;
   char hexgrip[40+4+1];
+#ifdef USE_KEYDIR_FD
+  struct stat st;
+  int dirfd;
+#endif
+
+  if (update_key_index ())
+    return find_key_index_item (grip, 0)? 0 : -1;
 
   bin2hex (grip, 20, hexgrip);
   strcpy (hexgrip+40, ".key");
+#ifdef USE_KEYDIR_FD
+  if ((dirfd = get_keydir_fd (&st)) != -1)
+    return !faccessat (dirfd, hexgrip, R_OK, 0)? 0 : -1;
+#endif
 
   fname = make_filename (gnupg_homedir (), GNUPG_PRIVATE_KEYS_DIR,
                          hexgrip, NULL);
@@ -1596,6 +1893,9 @@ agent_key_info_from_file (ctrl_t ctrl, const unsigned char *grip,
   unsigned char *buf;
   size_t len;
   int keytype;
+  key_index_item_t item;
+  unsigned char *shadow_info = NULL;
+  unsigned char *shadow_info_type = NULL;
 
   (void)ctrl;
 
@@ -1604,6 +1904,41 @@ agent_key_info_from_file (ctrl_t ctrl, const unsigned char *grip,
   if (r_shadow_info)
     *r_shadow_info = NULL;
 
+  /* Try to get the information from the key index.  */
+  if (update_key_index ())
+    {
+      item = find_key_index_item (grip, 0);
+      if (!item)
+        return gpg_error (GPG_ERR_NOT_FOUND);
+      if (item->keytype != PRIVATE_KEY_UNKNOWN)
+        {
+          keytype = item->keytype;
+          err = 0;
+          if (keytype == PRIVATE_KEY_SHADOWED && r_shadow_info)
+            {
+              len = gcry_sexp_canon_len (item->shadow_info, 0, NULL, NULL);
+              *r_shadow_info = xtrymalloc (len);
+              if (!*r_shadow_info)
+                err = gpg_error_from_syserror ();
+              else
+                {
+                  memcpy (*r_shadow_info, item->shadow_info, len);
+                  if (r_shadow_info_type
+                      && !(*r_shadow_info_type
+                           = xtrystrdup (item->shadow_info_type)))
+                    {
+                      err = gpg_error_from_syserror ();
+                      xfree (*r_shadow_info);
+                      *r_shadow_info = NULL;
+                    }
+                }
+            }
+          if (!err && r_keytype)
+            *r_keytype = keytype;
+          return err;
+        }
+    }
+
   {
     gcry_sexp_t sexp;
 
@@ -1632,33 +1967,75 @@ agent_key_info_from_file (ctrl_t ctrl, const unsigned char *grip,
          from such a key. */
       break;
     case PRIVATE_KEY_SHADOWED:
-      if (r_shadow_info)
-        {
-          const unsigned char *s;
-          size_t n;
+      {
+        const unsigned char *s;
+        size_t n;
 
-          err = agent_get_shadow_info_type (buf, &s, r_shadow_info_type);
-          if (!err)
-            {
-              n = gcry_sexp_canon_len (s, 0, NULL, NULL);
-              log_assert (n);
-              *r_shadow_info = xtrymalloc (n);
-              if (!*r_shadow_info)
-                err = gpg_error_from_syserror ();
-              else
-                memcpy (*r_shadow_info, s, n);
-            }
-        }
+        err = agent_get_shadow_info_type (buf, &s, &shadow_info_type);
+        if (!err)
+          {
+            n = gcry_sexp_canon_len (s, 0, NULL, NULL);
+            log_assert (n);
+            shadow_info = xtrymalloc (n);
+            if (!shadow_info)
+              err = gpg_error_from_syserror ();
+            else
+              memcpy (shadow_info, s, n);
+          }
+        else if (!r_shadow_info)
+          err = 0;  /* Not requested - don't care.  */
+      }
       break;
     default:
       err = gpg_error (GPG_ERR_BAD_SECKEY);
       break;
     }
+  xfree (buf);
+
+  /* Remember the information in the key index.  Note that we need
+   * to look up the item again because reading the file may have
+   * switched to another thread.  */
+  if (!err && (item = find_key_index_item (grip, 0))
+      && item->keytype == PRIVATE_KEY_UNKNOWN)
+    {
+      if (keytype == PRIVATE_KEY_SHADOWED && !shadow_info)
+        ; /* Bad shadow info - don't cache.  */
+      else if (keytype == PRIVATE_KEY_SHADOWED)
+        {
+          len = gcry_sexp_canon_len (shadow_info, 0, NULL, NULL);
+          item->shadow_info = xtrymalloc (len);
+          item->shadow_info_type = xtrystrdup (shadow_info_type);
+          if (item->shadow_info && item->shadow_info_type)
+            {
+              memcpy (item->shadow_info, shadow_info, len);
+              item->keytype = keytype;
+            }
+          else
+            {
+              xfree (item->shadow_info);
+              item->shadow_info = NULL;
+              xfree (item->shadow_info_type);
+              item->shadow_info_type = NULL;
+            }
+        }
+      else
+        item->keytype = keytype;
+    }
 
   if (!err && r_keytype)
     *r_keytype = keytype;
-
-  xfree (buf);
+  if (!err && r_shadow_info)
+    {
+      *r_shadow_info = shadow_info;
+      shadow_info = NULL;
+      if (r_shadow_info_type)
+        {
+          *r_shadow_info_type = shadow_info_type;
+          shadow_info_type = NULL;
+        }
+    }
+  xfree (shadow_info);
+  xfree (shadow_info_type);
   return err;
 }
 
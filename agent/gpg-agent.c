@@ -61,6 +61,8 @@
 #include "../common/asshelp.h"
 #include "../common/comopt.h"
 #include "../common/init.h"
+#include "../common/asynclog.h"
+#include "../common/hotpath.h"
 
 
 enum cmd_and_opt_values
@@ -87,6 +89,7 @@ enum cmd_and_opt_values
   oGrab,
   oNoGrab,
   oLogFile,
+  oLogAsync,
   oServer,
   oDaemon,
   oSupervised,
@@ -96,6 +99,7 @@ enum cmd_and_opt_values
   oPinentryTouchFile,
   oPinentryInvisibleChar,
   oPinentryTimeout,
+  oPinentryGracePeriod,
   oPinentryFormattedPassphrase,
   oDisplay,
   oTTYname,
@@ -109,6 +113,9 @@ enum cmd_and_opt_values
   oDefCacheTTLSSH,
   oMaxCacheTTL,
   oMaxCacheTTLSSH,
+  oMaxCachedKeys,
+  oCachedKeyTTL,
+  oPkdecryptCacheTTL,
   oEnforcePassphraseConstraints,
   oMinPassphraseLen,
   oMinPassphraseNonalpha,
@@ -124,6 +131,7 @@ enum cmd_and_opt_values
   oFakedSystemTime,
 
   oIgnoreCacheForSigning,
+  oConcurrentPkOperations,
   oAllowMarkTrusted,
   oNoAllowMarkTrusted,
   oNoUserTrustlist,
@@ -144,6 +152,7 @@ enum cmd_and_opt_values
   oS2KCount,
   oS2KCalibration,
   oAutoExpandSecmem,
+  oSecmemSize,
   oListenBacklog,
   oInactivityTimeout,
 
@@ -198,6 +207,7 @@ static gpgrt_opt_t opts[] = {
   ARGPARSE_s_n (oDebugPinentry, "debug-pinentry", "@"),
   ARGPARSE_s_s (oLogFile,   "log-file",
                 /* */       N_("|FILE|write server mode logs to FILE")),
+  ARGPARSE_s_n (oLogAsync,  "log-async", "@"),
 
 
   ARGPARSE_header ("Configuration",
@@ -238,6 +248,7 @@ static gpgrt_opt_t opts[] = {
                 ),
   ARGPARSE_s_i (oListenBacklog, "listen-backlog", "@"),
   ARGPARSE_op_u (oAutoExpandSecmem, "auto-expand-secmem", "@"),
+  ARGPARSE_s_u (oSecmemSize, "secmem-size", "@"),
   ARGPARSE_s_s (oFakedSystemTime, "faked-system-time", "@"),
 
 
@@ -251,8 +262,15 @@ static gpgrt_opt_t opts[] = {
                 /* */     N_("|N|set maximum PIN cache lifetime to N seconds")),
   ARGPARSE_s_u (oMaxCacheTTLSSH, "max-cache-ttl-ssh",
                 /* */     N_("|N|set maximum SSH key lifetime to N seconds")),
+  ARGPARSE_s_u (oMaxCachedKeys, "max-cached-keys",
+                /* */     N_("|N|cache up to N unprotected secret keys")),
+  ARGPARSE_s_u (oCachedKeyTTL,  "cached-key-ttl",
+                /* */     N_("|N|expire cached secret keys after N seconds")),
+  ARGPARSE_s_u (oPkdecryptCacheTTL, "pkdecrypt-cache-ttl",
+                /* */     N_("|N|cache decrypted session keys for N seconds")),
   ARGPARSE_s_n (oIgnoreCacheForSigning, "ignore-cache-for-signing",
                 /* */    N_("do not use the PIN cache when signing")),
+  ARGPARSE_s_n (oConcurrentPkOperations, "concurrent-pk-operations", "@"),
   ARGPARSE_s_n (oNoAllowExternalCache,  "no-allow-external-cache",
                 /* */    N_("disallow the use of an external password cache")),
   ARGPARSE_s_n (oNoAllowMarkTrusted, "no-allow-mark-trusted",
@@ -299,6 +317,7 @@ static gpgrt_opt_t opts[] = {
   ARGPARSE_s_s (oPinentryInvisibleChar, "pinentry-invisible-char", "@"),
   ARGPARSE_s_u (oPinentryTimeout, "pinentry-timeout",
                 N_("|N|set the Pinentry timeout to N seconds")),
+  ARGPARSE_s_u (oPinentryGracePeriod, "pinentry-grace-period", "@"),
   ARGPARSE_s_n (oPinentryFormattedPassphrase, "pinentry-formatted-passphrase",
                 "@"),
   ARGPARSE_s_n (oAllowEmacsPinentry,  "allow-emacs-pinentry",
@@ -470,6 +489,19 @@ static int reliable_homedir_inotify;
 /* Number of active connections.  */
 static int active_connections;
 
+/* The size of the secure memory pool and the size of the areas used
+ * to expand it.  */
+static unsigned long secmem_size = SECMEM_BUFFER_SIZE;
+static unsigned long secmem_expand_size;
+
+/* Statistics about the use of the secure memory.  */
+static struct
+{
+  unsigned int active;     /* Running secret key operations.  */
+  unsigned int max_active; /* High-water mark of ACTIVE.  */
+  unsigned long failures;  /* Operations failed due to ENOMEM.  */
+} secmem_stats;
+
 /* This object is used to dispatch progress messages from Libgcrypt to
  * the right thread.  Given that we will have at max only a few dozen
  * connections at a time, using a linked list is the easiest way to
@@ -869,12 +901,16 @@ parse_rereadable_options (gpgrt_argparse_t *pargs, int reread)
       xfree (opt.pinentry_invisible_char);
       opt.pinentry_invisible_char = NULL;
       opt.pinentry_timeout = 0;
+      opt.pinentry_grace_period = 0;
       opt.pinentry_formatted_passphrase = 0;
       memset (opt.daemon_program, 0, sizeof opt.daemon_program);
       opt.def_cache_ttl = DEFAULT_CACHE_TTL;
       opt.def_cache_ttl_ssh = DEFAULT_CACHE_TTL_SSH;
       opt.max_cache_ttl = MAX_CACHE_TTL;
       opt.max_cache_ttl_ssh = MAX_CACHE_TTL_SSH;
+      opt.max_cached_keys = 0;
+      opt.cached_key_ttl = DEFAULT_CACHE_TTL;
+      opt.pkdecrypt_cache_ttl = 0;
       opt.enforce_passphrase_constraints = 0;
       opt.min_passphrase_len = MIN_PASSPHRASE_LEN;
       opt.min_passphrase_nonalpha = MIN_PASSPHRASE_NONALPHA;
@@ -883,6 +919,7 @@ parse_rereadable_options (gpgrt_argparse_t *pargs, int reread)
       opt.max_passphrase_days = MAX_PASSPHRASE_DAYS;
       opt.enable_passphrase_history = 0;
       opt.ignore_cache_for_signing = 0;
+      opt.concurrent_pk_operations = 0;
       opt.allow_mark_trusted = 1;
       opt.sys_trustlist_name = NULL;
       opt.allow_external_cache = 1;
@@ -916,6 +953,8 @@ parse_rereadable_options (gpgrt_argparse_t *pargs, int reread)
           || strcmp (current_logfile, pargs->r.ret_str))
         {
           log_set_file (pargs->r.ret_str);
+          if (opt.log_async)
+            async_log_start ();
           xfree (current_logfile);
           current_logfile = xtrystrdup (pargs->r.ret_str);
         }
@@ -931,6 +970,9 @@ parse_rereadable_options (gpgrt_argparse_t *pargs, int reread)
       opt.pinentry_invisible_char = xtrystrdup (pargs->r.ret_str); break;
       break;
     case oPinentryTimeout: opt.pinentry_timeout = pargs->r.ret_ulong; break;
+    case oPinentryGracePeriod:
+      opt.pinentry_grace_period = pargs->r.ret_ulong;
+      break;
     case oPinentryFormattedPassphrase:
       opt.pinentry_formatted_passphrase = 1;
       break;
@@ -949,6 +991,11 @@ parse_rereadable_options (gpgrt_argparse_t *pargs, int reread)
     case oDefCacheTTLSSH: opt.def_cache_ttl_ssh = pargs->r.ret_ulong; break;
     case oMaxCacheTTL: opt.max_cache_ttl = pargs->r.ret_ulong; break;
     case oMaxCacheTTLSSH: opt.max_cache_ttl_ssh = pargs->r.ret_ulong; break;
+    case oMaxCachedKeys: opt.max_cached_keys = pargs->r.ret_ulong; break;
+    case oCachedKeyTTL: opt.cached_key_ttl = pargs->r.ret_ulong; break;
+    case oPkdecryptCacheTTL:
+      opt.pkdecrypt_cache_ttl = pargs->r.ret_ulong;
+      break;
 
     case oEnforcePassphraseConstraints:
       opt.enforce_passphrase_constraints=1;
@@ -971,6 +1018,7 @@ parse_rereadable_options (gpgrt_argparse_t *pargs, int reread)
       break;
 
     case oIgnoreCacheForSigning: opt.ignore_cache_for_signing = 1; break;
+    case oConcurrentPkOperations: opt.concurrent_pk_operations = 1; break;
 
     case oAllowMarkTrusted: opt.allow_mark_trusted = 1; break;
     case oNoAllowMarkTrusted: opt.allow_mark_trusted = 0; break;
@@ -1058,6 +1106,7 @@ initialize_modules (void)
   initialize_module_call_pinentry ();
   initialize_module_daemon ();
   initialize_module_trustlist ();
+  enable_s2k_calibration_cache ();
 }
 
 
@@ -1187,13 +1236,18 @@ main (int argc, char **argv)
         case oDebugQuickRandom:
           gcry_control (GCRYCTL_ENABLE_QUICK_RANDOM, 0);
           break;
+
+        case oSecmemSize:
+          if (pargs.r.ret_ulong)
+            secmem_size = pargs.r.ret_ulong;
+          break;
         }
     }
   /* Reset the flags.  */
   pargs.flags &= ~(ARGPARSE_FLAG_KEEP | ARGPARSE_FLAG_NOVERSION);
 
   /* Initialize the secure memory. */
-  gcry_control (GCRYCTL_INIT_SECMEM, SECMEM_BUFFER_SIZE, 0);
+  gcry_control (GCRYCTL_INIT_SECMEM, secmem_size, 0);
   maybe_setuid = 0;
 
   /*
@@ -1247,6 +1301,7 @@ main (int argc, char **argv)
         case oHomedir: gnupg_set_homedir (pargs.r.ret_str); break;
         case oNoDetach: nodetach = 1; break;
         case oLogFile: logfile = pargs.r.ret_str; break;
+        case oLogAsync: opt.log_async = 1; break;
         case oCsh: csh_style = 1; break;
         case oSh: csh_style = 0; break;
         case oServer: pipe_server = 1; break;
@@ -1315,6 +1370,20 @@ main (int argc, char **argv)
            * on the quiet and thus we use the numeric value value.  */
           gcry_control (78 /*GCRYCTL_AUTO_EXPAND_SECMEM*/,
                         (unsigned int)pargs.r.ret_ulong,  0);
+          secmem_expand_size = pargs.r.ret_ulong;
+          break;
+
+        case oSecmemSize:
+          /* The pool has already been initialized using the value
+           * from the command line.  A larger value from the config
+           * file can only be honored by letting Libgcrypt expand the
+           * pool.  */
+          if (pargs.r.ret_ulong > secmem_size && !secmem_expand_size)
+            {
+              secmem_expand_size = pargs.r.ret_ulong - secmem_size;
+              gcry_control (78 /*GCRYCTL_AUTO_EXPAND_SECMEM*/,
+                            (unsigned int)secmem_expand_size,  0);
+            }
           break;
 
         case oListenBacklog:
@@ -2094,6 +2163,8 @@ reread_configuration (void)
           || strcmp (current_logfile, comopt.logfile))
         {
           log_set_file (comopt.logfile);
+          if (opt.log_async)
+            async_log_start ();
           xfree (current_logfile);
           current_logfile = comopt.logfile? xtrystrdup (comopt.logfile) : NULL;
         }
@@ -2130,6 +2201,46 @@ get_agent_active_connection_count (void)
 }
 
 
+/* This is called before an operation which loads a secret key into
+ * the secure memory.  */
+void
+agent_secmem_enter (void)
+{
+  secmem_stats.active++;
+  if (secmem_stats.active > secmem_stats.max_active)
+    secmem_stats.max_active = secmem_stats.active;
+}
+
+
+/* This is called after an operation started with agent_secmem_enter
+ * has finished with ERR.  */
+void
+agent_secmem_leave (gpg_error_t err)
+{
+  if (secmem_stats.active)
+    secmem_stats.active--;
+  if (gpg_err_code (err) == GPG_ERR_ENOMEM)
+    secmem_stats.failures++;
+}
+
+
+/* Return the configured size of the secure memory pool and of the
+ * areas used to expand it, the number of running secret key
+ * operations and their high-water mark, as well as the number of
+ * operations which failed due to a lack of memory.  */
+void
+agent_secmem_get_stats (unsigned long *r_size, unsigned long *r_expand,
+                        unsigned int *r_active, unsigned int *r_max_active,
+                        unsigned long *r_failures)
+{
+  *r_size = secmem_size;
+  *r_expand = secmem_expand_size;
+  *r_active = secmem_stats.active;
+  *r_max_active = secmem_stats.max_active;
+  *r_failures = secmem_stats.failures;
+}
+
+
 /* Under W32, this function returns the handle of the scdaemon
    notification event.  Calling it the first time creates that
    event.  */
@@ -2463,6 +2574,9 @@ handle_tick (void)
   /* Need to check for expired cache entries.  */
   agent_cache_housekeeping ();
 
+  /* Close an idle pinentry after its grace period.  */
+  agent_pinentry_housekeeping ();
+
   /* Check whether the homedir is still available.  */
   if (!shutdown_pending
       && (!have_homedir_inotify || !reliable_homedir_inotify)
@@ -2503,6 +2617,7 @@ agent_sigusr2_action (void)
     log_info ("SIGUSR2 received - updating card event counter\n");
   /* Nothing to check right now.  We only increment a counter.  */
   bump_card_eventcounter ();
+  hotpath_dump ();
 }
 
 
@@ -2963,6 +3078,28 @@ start_connection_thread_ssh (void *arg)
 }
 
 
+/* This thread re-calibrates the S2K count in the background so that
+ * the first passphrase operation does not need to wait for it.  The
+ * calibration only uses the CPU and thus we run it without the nPth
+ * lock.  */
+static void *
+s2k_calibration_thread (void *arg)
+{
+  unsigned long count;
+
+  (void)arg;
+
+  npth_unprotect ();
+  count = compute_s2k_calibration ();
+  npth_protect ();
+
+  set_s2k_calibrated_count (count);
+  if (opt.verbose)
+    log_info ("S2K calibration: %lu (background)\n", count);
+  return NULL;
+}
+
+
 /* Connection handler loop.  Wait for connection requests and spawn a
    thread after accepting a connection.  */
 static void
@@ -3001,6 +3138,11 @@ handle_connections (gnupg_fd_t listen_fd,
   };
 
 
+  /* Now that we are detached and npth is running the log may be
+   * written by a separate thread.  */
+  if (opt.log_async)
+    async_log_start ();
+
   ret = npth_attr_init(&tattr);
   if (ret)
     log_fatal ("error allocating thread attributes: %s\n",
@@ -3064,6 +3206,18 @@ handle_connections (gnupg_fd_t listen_fd,
     }
 #endif /*HAVE_W32_SYSTEM*/
 
+  /* Calibrate the S2K count unless we use a fixed one.  A value
+     stored by a previous run is used until this has finished.  */
+  if (!opt.s2k_count)
+    {
+      npth_t thread;
+
+      ret = npth_create (&thread, &tattr, s2k_calibration_thread, NULL);
+      if (ret)
+        log_error ("error spawning S2K calibration thread: %s\n",
+                   strerror (ret));
+    }
+
   /* Set a flag to tell call-scd.c that it may enable event
      notifications.  */
   opt.sigusr2_enabled = 1;
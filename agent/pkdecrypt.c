@@ -25,10 +25,93 @@
 #include <ctype.h>
 #include <unistd.h>
 #include <sys/stat.h>
+#include <npth.h>
 
 #include "agent.h"
 
 
+/* The prefix of the cache keys used for --pkdecrypt-cache-ttl.  */
+#define PKDECRYPT_CACHE_PREFIX "pkdecrypt:"
+
+/* Store the cache key for the decryption of CIPHERTEXT with the key
+ * of CTRL at KEYBUF.  */
+static void
+make_pkdecrypt_cache_key (ctrl_t ctrl,
+                          const unsigned char *ciphertext,
+                          size_t ciphertextlen,
+                          char keybuf[sizeof PKDECRYPT_CACHE_PREFIX + 64])
+{
+  unsigned char digest[32];
+  gcry_buffer_t iov[2];
+
+  memset (iov, 0, sizeof iov);
+  iov[0].data = ctrl->keygrip;
+  iov[0].len = 20;
+  iov[1].data = (void *)ciphertext;
+  iov[1].len = ciphertextlen;
+  gcry_md_hash_buffers (GCRY_MD_SHA256, 0, digest, iov, DIM (iov));
+
+  strcpy (keybuf, PKDECRYPT_CACHE_PREFIX);
+  bin2hex (digest, sizeof digest, keybuf + strlen (PKDECRYPT_CACHE_PREFIX));
+}
+
+
+/* Look up the result for CACHEKEY and put it to OUTBUF.  The padding
+ * is stored at R_PADDING.  The cached value is the padding as a
+ * decimal number, a colon and the hex encoded result.  Returns true
+ * on a cache hit.  */
+static int
+get_pkdecrypt_cache (ctrl_t ctrl, const char *cachekey,
+                     membuf_t *outbuf, int *r_padding)
+{
+  char *value, *p;
+  size_t n;
+  int padding;
+
+  value = agent_get_cache (ctrl, cachekey, CACHE_MODE_DATA);
+  if (!value)
+    return 0;
+
+  padding = atoi (value);
+  p = strchr (value, ':');
+  if (!p || !(n = strlen (p+1)) || (n % 2)
+      || hex2bin (p+1, p+1, n/2) < 0)
+    {
+      wipememory (value, strlen (value));
+      xfree (value);
+      return 0;
+    }
+  put_membuf (outbuf, p+1, n/2);
+  wipememory (value, strlen (value));
+  xfree (value);
+  *r_padding = padding;
+  if (DBG_CACHE)
+    log_debug ("pkdecrypt: result taken from the cache\n");
+  return 1;
+}
+
+
+/* Store the result RESULT of RESULTLEN bytes with PADDING under
+ * CACHEKEY for TTL seconds.  */
+static void
+put_pkdecrypt_cache (ctrl_t ctrl, const char *cachekey,
+                     const void *result, size_t resultlen, int padding,
+                     unsigned long ttl)
+{
+  char *value;
+  size_t n;
+
+  value = xtrymalloc_secure (20 + 2*resultlen + 1);
+  if (!value)
+    return;
+  n = snprintf (value, 20, "%d:", padding);
+  bin2hex (result, resultlen, value + n);
+  agent_put_cache (ctrl, cachekey, CACHE_MODE_DATA, value, (int)ttl);
+  wipememory (value, strlen (value));
+  xfree (value);
+}
+
+
 /* DECRYPT the stuff in ciphertext which is expected to be a S-Exp.
    Try to get the key from CTRL and write the decoded stuff back to
    OUTFP.   The padding information is stored at R_PADDING with -1
@@ -42,10 +125,16 @@ agent_pkdecrypt (ctrl_t ctrl, const char *desc_text,
   unsigned char *shadow_info = NULL;
   gpg_error_t err = 0;
   int no_shadow_info = 0;
+  int unlocked;
   char *buf = NULL;
   size_t len;
+  unsigned long cache_ttl;
+  char cachekey[sizeof PKDECRYPT_CACHE_PREFIX + 64];
+  size_t outstart = 0;
+  const unsigned char *result;
 
   *r_padding = -1;
+  agent_secmem_enter ();
 
   if (!ctrl->have_keygrip)
     {
@@ -54,6 +143,17 @@ agent_pkdecrypt (ctrl_t ctrl, const char *desc_text,
       goto leave;
     }
 
+  /* Remember the TTL because the options may be reloaded while we do
+   * not hold the lock.  */
+  cache_ttl = opt.pkdecrypt_cache_ttl;
+  if (cache_ttl)
+    {
+      make_pkdecrypt_cache_key (ctrl, ciphertext, ciphertextlen, cachekey);
+      if (get_pkdecrypt_cache (ctrl, cachekey, outbuf, r_padding))
+        goto leave;
+      peek_membuf (outbuf, &outstart);
+    }
+
   err = gcry_sexp_sscan (&s_cipher, NULL, (char*)ciphertext, ciphertextlen);
   if (err)
     {
@@ -119,7 +219,14 @@ agent_pkdecrypt (ctrl_t ctrl, const char *desc_text,
 /*           gcry_sexp_dump (s_skey); */
 /*         } */
 
+      /* Note that a reload of the options may happen while we do
+       * not hold the lock; thus we need to remember the state.  */
+      unlocked = opt.concurrent_pk_operations;
+      if (unlocked)
+        npth_unprotect ();
       err = gcry_pk_decrypt (&s_plain, s_cipher, s_skey);
+      if (unlocked)
+        npth_protect ();
       if (err)
         {
           log_error ("decryption failed: %s\n", gpg_strerror (err));
@@ -148,6 +255,13 @@ agent_pkdecrypt (ctrl_t ctrl, const char *desc_text,
         }
     }
 
+  if (cache_ttl)
+    {
+      result = peek_membuf (outbuf, &len);
+      if (result && len > outstart)
+        put_pkdecrypt_cache (ctrl, cachekey, result + outstart,
+                             len - outstart, *r_padding, cache_ttl);
+    }
 
  leave:
   gcry_sexp_release (s_skey);
@@ -155,5 +269,6 @@ agent_pkdecrypt (ctrl_t ctrl, const char *desc_text,
   gcry_sexp_release (s_cipher);
   xfree (buf);
   xfree (shadow_info);
+  agent_secmem_leave (err);
   return err;
 }
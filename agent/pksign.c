@@ -25,6 +25,7 @@
 #include <string.h>
 #include <ctype.h>
 #include <sys/stat.h>
+#include <npth.h>
 
 #include "agent.h"
 #include "../common/i18n.h"
@@ -293,6 +294,7 @@ agent_pksign_do (ctrl_t ctrl, const char *cache_nonce,
   const unsigned char *data;
   int datalen;
   int check_signature = 0;
+  int unlocked;
   int algo;
 
   if (overridedata)
@@ -314,6 +316,7 @@ agent_pksign_do (ctrl_t ctrl, const char *cache_nonce,
   if (!ctrl->have_keygrip)
     return gpg_error (GPG_ERR_NO_SECKEY);
 
+  agent_secmem_enter ();
   err = agent_key_from_file (ctrl, cache_nonce, desc_text, NULL,
                              &shadow_info, cache_mode, lookup_ttl,
                              &s_skey, NULL, NULL);
@@ -374,7 +377,7 @@ agent_pksign_do (ctrl_t ctrl, const char *cache_nonce,
           if (keyref)
             agent_write_shadow_key (ctrl->keygrip, serialno, keyref, pkbuf, 0);
 
-          algo = get_pk_algo_from_key (s_pkey);
+          algo = get_pk_algo_from_canon_sexp (pkbuf, pkbuflen);
 
           xfree (serialno);
           xfree (pkbuf);
@@ -520,7 +523,14 @@ agent_pksign_do (ctrl_t ctrl, const char *cache_nonce,
         }
 
       /* sign */
+      /* Note that a reload of the options may happen while we do
+       * not hold the lock; thus we need to remember the state.  */
+      unlocked = opt.concurrent_pk_operations;
+      if (unlocked)
+        npth_unprotect ();
       err = gcry_pk_sign (&s_sig, s_hash, s_skey);
+      if (unlocked)
+        npth_protect ();
       if (err)
         {
           log_error ("signing failed: %s\n", gpg_strerror (err));
@@ -584,6 +594,7 @@ agent_pksign_do (ctrl_t ctrl, const char *cache_nonce,
   gcry_sexp_release (s_skey);
   gcry_sexp_release (s_hash);
   xfree (shadow_info);
+  agent_secmem_leave (err);
 
   return err;
 }
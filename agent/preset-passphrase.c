@@ -64,12 +64,14 @@ enum cmd_and_opt_values
 
   oHomedir,
   oRestricted,
+  oStdinList,
 
 aTest };
 
 
 static const char *opt_passphrase;
 static int opt_restricted;
+static int opt_stdin_list;
 
 static gpgrt_opt_t opts[] = {
 
@@ -82,6 +84,7 @@ static gpgrt_opt_t opts[] = {
 
   { oHomedir, "homedir", 2, "@" },
   { oRestricted,  "restricted", 0, "put into the restricted cache"},
+  { oStdinList,  "stdin-list", 0, "read a list of keygrips from stdin"},
 
   ARGPARSE_end ()
 };
@@ -187,6 +190,112 @@ preset_passphrase (const char *keygrip)
 }
 
 
+/* Read lines of the form "KEYGRIP PASSPHRASE" from stdin and preset
+   all of them using a single request.  The gpg-agent stores either
+   all or none of them.  */
+static void
+preset_passphrase_list (void)
+{
+  gpg_error_t err;
+  membuf_t input, request;
+  char buffer[4096];
+  ssize_t nread;
+  char *data = NULL;
+  char *hexpw;
+  char *p, *pend, *grip, *pw;
+  size_t datalen, reqlen;
+  unsigned int lnr = 0;
+  int count = 0;
+  int failed = 0;
+  char *req;
+
+  init_membuf (&input, 4096);
+  while ((nread = read (0, buffer, sizeof buffer)) > 0)
+    put_membuf (&input, buffer, nread);
+  if (nread < 0)
+    {
+      log_error ("reading passphrases failed: %s\n",
+                 gpg_strerror (gpg_error_from_syserror ()));
+      wipememory (buffer, sizeof buffer);
+      xfree (get_membuf (&input, NULL));
+      return;
+    }
+  wipememory (buffer, sizeof buffer);
+  put_membuf (&input, "", 1);
+  data = get_membuf (&input, &datalen);
+  if (!data)
+    {
+      log_error ("reading passphrases failed: %s\n",
+                 gpg_strerror (gpg_error_from_syserror ()));
+      return;
+    }
+
+  init_membuf (&request, 4096);
+  for (p = data; *p; p = pend)
+    {
+      lnr++;
+      pend = strchr (p, '\n');
+      if (pend)
+        {
+          if (pend > p && pend[-1] == '\r')
+            pend[-1] = 0;
+          *pend++ = 0;
+        }
+      else
+        pend = p + strlen (p);
+
+      if (!*p || *p == '#')
+        continue;
+      grip = p;
+      pw = strchr (p, ' ');
+      if (!pw)
+        {
+          log_error ("line %u: passphrase missing\n", lnr);
+          failed = 1;
+          break;
+        }
+      *pw++ = 0;
+      hexpw = bin2hex (pw, strlen (pw), NULL);
+      if (!hexpw)
+        {
+          log_error ("can not escape string: %s\n",
+                     gpg_strerror (gpg_error_from_syserror ()));
+          failed = 1;
+          break;
+        }
+      put_membuf_printf (&request, "%s -1 %s\n", grip, hexpw);
+      wipememory (hexpw, strlen (hexpw));
+      xfree (hexpw);
+      count++;
+    }
+
+  req = get_membuf (&request, &reqlen);
+  if (!req)
+    log_error ("caching passphrases failed: %s\n",
+               gpg_strerror (gpg_error_from_syserror ()));
+  if (!req || failed || !count)
+    goto leave;
+
+  err = simple_query_with_data (opt_restricted
+                                ? "PRESET_PASSPHRASE --list --restricted\n"
+                                : "PRESET_PASSPHRASE --list\n",
+                                "PASSPHRASES", req, reqlen);
+  if (err)
+    log_error ("caching passphrases failed: %s\n", gpg_strerror (err));
+  else if (opt.verbose)
+    log_info ("%d passphrases cached\n", count);
+
+ leave:
+  if (req)
+    {
+      wipememory (req, reqlen);
+      xfree (req);
+    }
+  wipememory (data, datalen);
+  xfree (data);
+}
+
+
 static void
 forget_passphrase (const char *keygrip)
 {
@@ -238,6 +347,7 @@ main (int argc, char **argv)
         case oPassphrase: opt_passphrase = pargs.r.ret_str; break;
 
         case oRestricted: opt_restricted = 1; break;
+        case oStdinList: opt_stdin_list = 1; break;
 
         default : pargs.err = 2; break;
 	}
@@ -247,7 +357,9 @@ main (int argc, char **argv)
   if (log_get_errorcount(0))
     exit(2);
 
-  if (argc == 1)
+  if (opt_stdin_list && !argc && cmd == oPreset)
+    ;
+  else if (argc == 1 && !opt_stdin_list)
     keygrip = *argv;
   else
     gpgrt_usage (1);
@@ -259,7 +371,9 @@ main (int argc, char **argv)
     xfree (tmp);
   }
 
-  if (cmd == oPreset)
+  if (cmd == oPreset && opt_stdin_list)
+    preset_passphrase_list ();
+  else if (cmd == oPreset)
     preset_passphrase (keygrip);
   else if (cmd == oForget)
     forget_passphrase (keygrip);
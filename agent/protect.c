@@ -42,6 +42,7 @@
 #include "cvt-openpgp.h"
 #include "../common/sexp-parse.h"
 #include "../common/openpgpdefs.h"  /* For s2k functions.  */
+#include "../common/hotpath.h"
 
 
 /* The protection mode for encryption.  The supported modes for
@@ -75,6 +76,13 @@ static const struct {
 static unsigned int s2k_calibration_time = AGENT_S2K_CALIBRATION;
 static unsigned long s2k_calibrated_count;
 
+/* If set the calibrated count is stored in the homedir so that a
+ * restarted agent does not need to calibrate again.  */
+static int s2k_calibration_persistent;
+
+/* Name of the file in the homedir to keep the calibrated count.  */
+#define S2K_CALIBRATION_FILE "s2k-calibration"
+
 
 /* A helper object for time measurement.  */
 struct calibrate_time_s
@@ -185,7 +193,7 @@ calibrate_s2k_count_one (unsigned long count)
 /* Measure the time we need to do the hash operations and deduce an
    S2K count which requires roughly some targeted amount of time.  */
 static unsigned long
-calibrate_s2k_count (void)
+calibrate_s2k_count (int quiet)
 {
   unsigned long count;
   unsigned long ms;
@@ -193,7 +201,7 @@ calibrate_s2k_count (void)
   for (count = 65536; count; count *= 2)
     {
       ms = calibrate_s2k_count_one (count);
-      if (opt.verbose > 1)
+      if (!quiet && opt.verbose > 1)
         log_info ("S2K calibration: %lu -> %lums\n", count, ms);
       if (ms > s2k_calibration_time)
         break;
@@ -205,7 +213,7 @@ calibrate_s2k_count (void)
   if (count < 65536)
     count = 65536;
 
-  if (opt.verbose)
+  if (!quiet && opt.verbose)
     {
       ms = calibrate_s2k_count_one (count);
       log_info ("S2K calibration: %lu -> %lums\n", count, ms);
@@ -215,6 +223,170 @@ calibrate_s2k_count (void)
 }
 
 
+/* Return a malloced string identifying the parameters the calibrated
+ * count depends on: The calibration time, the Libgcrypt version and
+ * the CPU.  Returns NULL on error.  */
+static char *
+s2k_calibration_id (void)
+{
+  char *hwflags, *result, *p;
+  char model[100];
+
+  *model = 0;
+#ifdef __linux__
+  {
+    estream_t fp;
+    char line[256];
+
+    fp = es_fopen ("/proc/cpuinfo", "r");
+    if (fp)
+      {
+        while (es_fgets (line, sizeof line, fp))
+          if (!strncmp (line, "model name", 10) && (p = strchr (line, ':')))
+            {
+              mem2str (model, p + 1, sizeof model);
+              break;
+            }
+        es_fclose (fp);
+      }
+  }
+#endif /*__linux__*/
+
+  hwflags = gcry_get_config (0, "hwflags");
+  result = xtryasprintf ("%u %s %s %s", s2k_calibration_time,
+                         gcry_check_version (NULL),
+                         hwflags? hwflags : "", model);
+  gcry_free (hwflags);
+  if (result)
+    {
+      /* Make it a single line.  */
+      for (p = result; *p; p++)
+        if (*p == '\n' || *p == '\r' || *p == '\t')
+          *p = ' ';
+      trim_spaces (result);
+    }
+  return result;
+}
+
+
+/* Return the count stored in the calibration file or 0 if there is
+ * none or it does not match our current parameters.  */
+static unsigned long
+read_s2k_calibration (void)
+{
+  char *fname, *id, *p;
+  estream_t fp;
+  char line[512];
+  unsigned long count = 0;
+
+  id = s2k_calibration_id ();
+  if (!id)
+    return 0;
+  fname = make_filename_try (gnupg_homedir (), S2K_CALIBRATION_FILE, NULL);
+  fp = fname? es_fopen (fname, "r") : NULL;
+  if (fp)
+    {
+      if (es_fgets (line, sizeof line, fp))
+        {
+          trim_spaces (line);
+          p = strchr (line, ' ');
+          if (p && !strcmp (p + 1, id))
+            {
+              count = strtoul (line, NULL, 10);
+              if (count < 65536)
+                count = 0;
+            }
+        }
+      es_fclose (fp);
+    }
+  xfree (fname);
+  xfree (id);
+  return count;
+}
+
+
+/* Store COUNT in the calibration file.  Errors are only logged
+ * because we can always calibrate again.  */
+static void
+write_s2k_calibration (unsigned long count)
+{
+  gpg_error_t err;
+  char *fname = NULL;
+  char *tmpfname = NULL;
+  char *id;
+  estream_t fp;
+
+  id = s2k_calibration_id ();
+  if (!id)
+    return;
+  fname = make_filename_try (gnupg_homedir (), S2K_CALIBRATION_FILE, NULL);
+  tmpfname = fname? strconcat (fname, ".tmp", NULL) : NULL;
+  if (!tmpfname)
+    {
+      err = gpg_error_from_syserror ();
+      goto leave;
+    }
+
+  fp = es_fopen (tmpfname, "w,mode=-rw");
+  if (!fp)
+    {
+      err = gpg_error_from_syserror ();
+      goto leave;
+    }
+  es_fprintf (fp, "%lu %s\n", count, id);
+  if (es_fclose (fp))
+    {
+      err = gpg_error_from_syserror ();
+      gnupg_remove (tmpfname);
+      goto leave;
+    }
+  err = gnupg_rename_file (tmpfname, fname, NULL);
+  if (err)
+    gnupg_remove (tmpfname);
+
+ leave:
+  if (err)
+    log_info ("error storing the S2K calibration: %s\n", gpg_strerror (err));
+  xfree (tmpfname);
+  xfree (fname);
+  xfree (id);
+}
+
+
+/* Enable storing of the calibrated count in the homedir.  This is
+ * only used by gpg-agent and not by the other users of this
+ * module.  */
+void
+enable_s2k_calibration_cache (void)
+{
+  s2k_calibration_persistent = 1;
+}
+
+
+/* Compute a new calibrated count without logging and without touching
+ * any global state.  This is intended to be called by a background
+ * thread with the npth lock released; the result should then be
+ * stored using set_s2k_calibrated_count.  */
+unsigned long
+compute_s2k_calibration (void)
+{
+  return calibrate_s2k_count (1);
+}
+
+
+/* Use COUNT as the calibrated count and store it in the homedir if
+ * enabled.  */
+void
+set_s2k_calibrated_count (unsigned long count)
+{
+  if (count < 65536)
+    return;
+  s2k_calibrated_count = count;
+  if (s2k_calibration_persistent)
+    write_s2k_calibration (count);
+}
+
+
 /* Set the calibration time.  This may be called early at startup or
  * at any time.  Thus it should one set variables.  */
 void
@@ -234,8 +406,14 @@ set_s2k_calibration_time (unsigned int milliseconds)
 unsigned long
 get_calibrated_s2k_count (void)
 {
+  if (!s2k_calibrated_count && s2k_calibration_persistent)
+    s2k_calibrated_count = read_s2k_calibration ();
   if (!s2k_calibrated_count)
-    s2k_calibrated_count = calibrate_s2k_count ();
+    {
+      s2k_calibrated_count = calibrate_s2k_count (0);
+      if (s2k_calibration_persistent)
+        write_s2k_calibration (s2k_calibrated_count);
+    }
 
   /* Enforce a lower limit.  */
   return s2k_calibrated_count < 65536 ? 65536 : s2k_calibrated_count;
@@ -1007,11 +1185,11 @@ merge_lists (const unsigned char *protectedkey,
 /* Unprotect the key encoded in canonical format.  We assume a valid
    S-Exp here.  If a protected-at item is available, its value will
    be stored at protected_at unless this is NULL.  */
-gpg_error_t
-agent_unprotect (ctrl_t ctrl,
-                 const unsigned char *protectedkey, const char *passphrase,
-                 gnupg_isotime_t protected_at,
-                 unsigned char **result, size_t *resultlen)
+static gpg_error_t
+do_agent_unprotect (ctrl_t ctrl,
+                    const unsigned char *protectedkey, const char *passphrase,
+                    gnupg_isotime_t protected_at,
+                    unsigned char **result, size_t *resultlen)
 {
   static const struct {
     const char *name; /* Name of the protection method. */
@@ -1288,6 +1466,21 @@ agent_unprotect (ctrl_t ctrl,
 }
 
 
+gpg_error_t
+agent_unprotect (ctrl_t ctrl,
+                 const unsigned char *protectedkey, const char *passphrase,
+                 gnupg_isotime_t protected_at,
+                 unsigned char **result, size_t *resultlen)
+{
+  gpg_error_t err;
+
+  HOTPATH_COUNT ("agent_unprotect",
+                 err = do_agent_unprotect (ctrl, protectedkey, passphrase,
+                                           protected_at, result, resultlen));
+  return err;
+}
+
+
 /* Check the type of the private key, this is one of the constants:
    PRIVATE_KEY_UNKNOWN if we can't figure out the type (this is the
    value 0), PRIVATE_KEY_CLEAR for an unprotected private key.
@@ -31,6 +31,7 @@
 #include "agent.h"
 #include <assuan.h> /* fixme: need a way to avoid assuan calls here */
 #include "../common/i18n.h"
+#include "../common/host2net.h"
 
 
 /* A structure to store the information from the trust file. */
@@ -54,6 +55,20 @@ typedef struct trustitem_s trustitem_t;
 /* Malloced table and its allocated size with all trust items. */
 static trustitem_t *trusttable;
 static size_t trusttablesize;
+
+/* A hash index over the fingerprints of TRUSTTABLE.  This is an open
+   addressing table with TRUSTINDEXSIZE slots (a power of two); a slot
+   holds the index into TRUSTTABLE plus one or 0 if the slot is
+   empty.  If the index could not be allocated TRUSTINDEX is NULL and
+   a linear scan is used.  */
+static unsigned int *trustindex;
+static size_t trustindexsize;
+
+/* The modification times of the user's and of the system trustlist
+   at the time TRUSTTABLE was read and the time we last checked
+   them.  */
+static time_t trustfile_mtimes[2];
+static time_t trustfile_checked;
 /* A mutex used to protect the table. */
 static npth_mutex_t trusttable_lock;
 
@@ -126,6 +141,84 @@ clear_trusttable (void)
   xfree (trusttable);
   trusttable = NULL;
   trusttablesize = 0;
+  xfree (trustindex);
+  trustindex = NULL;
+  trustindexsize = 0;
+}
+
+
+/* Return the slot for the fingerprint FPR in an index of SIZE slots.
+   The fingerprint is a hash value, thus its first bytes are good
+   enough as hash.  */
+static inline size_t
+trustindex_slot (const unsigned char *fpr, size_t size)
+{
+  return buf32_to_size_t (fpr) & (size - 1);
+}
+
+
+/* Build the hash index for the TRUSTTABLE.  The caller needs to make
+   sure that the trusttable is locked.  On a memory failure no index
+   is created.  */
+static void
+build_trustindex (void)
+{
+  size_t size, idx, slot;
+
+  xfree (trustindex);
+  trustindex = NULL;
+  trustindexsize = 0;
+
+  for (size = 16; size < 2 * trusttablesize; size <<= 1)
+    ;
+  trustindex = xtrycalloc (size, sizeof *trustindex);
+  if (!trustindex)
+    return;
+  trustindexsize = size;
+
+  for (idx=0; idx < trusttablesize; idx++)
+    {
+      for (slot = trustindex_slot (trusttable[idx].fpr, size);
+           trustindex[slot];
+           slot = (slot + 1) & (size - 1))
+        if (!memcmp (trusttable[trustindex[slot]-1].fpr,
+                     trusttable[idx].fpr, 20))
+          break;  /* Duplicate - the first entry takes precedence.  */
+      if (!trustindex[slot])
+        trustindex[slot] = idx + 1;
+    }
+}
+
+
+/* Return the entry for the binary fingerprint FPR or NULL if it is
+   not in the trusttable.  The caller needs to make sure that the
+   trusttable is locked.  */
+static trustitem_t *
+find_trustitem (const unsigned char *fpr)
+{
+  trustitem_t *ti;
+  size_t len, slot;
+
+  if (!trusttable)
+    return NULL;
+
+  if (!trustindex)
+    {
+      for (ti=trusttable, len = trusttablesize; len; ti++, len--)
+        if (!memcmp (ti->fpr, fpr, 20))
+          return ti;
+      return NULL;
+    }
+
+  for (slot = trustindex_slot (fpr, trustindexsize);
+       trustindex[slot];
+       slot = (slot + 1) & (trustindexsize - 1))
+    {
+      ti = trusttable + trustindex[slot] - 1;
+      if (!memcmp (ti->fpr, fpr, 20))
+        return ti;
+    }
+  return NULL;
 }
 
 
@@ -147,6 +240,58 @@ make_sys_trustlist_name (void)
 }
 
 
+/* Store the modification times of the user's and of the system
+   trustlist at R_MTIMES.  A missing file is reported as 0.  */
+static void
+get_trustfile_mtimes (time_t *r_mtimes)
+{
+  struct stat st;
+  char *fname;
+
+  r_mtimes[0] = r_mtimes[1] = 0;
+
+  if (!opt.no_user_trustlist)
+    {
+      fname = make_filename_try (gnupg_homedir (), "trustlist.txt", NULL);
+      if (fname && !gnupg_stat (fname, &st))
+        r_mtimes[0] = st.st_mtime;
+      xfree (fname);
+    }
+
+  fname = make_sys_trustlist_name ();
+  if (!gnupg_stat (fname, &st))
+    r_mtimes[1] = st.st_mtime;
+  xfree (fname);
+}
+
+
+/* Clear the trusttable if one of the trust files has been modified
+   since it was read.  To avoid stat calls for each lookup this is
+   done at most once per second.  The caller needs to make sure that
+   the trusttable is locked.  */
+static void
+check_trustfiles (void)
+{
+  time_t now, mtimes[2];
+
+  if (!trusttable)
+    return;
+
+  now = gnupg_get_time ();
+  if (now == trustfile_checked)
+    return;
+  trustfile_checked = now;
+
+  get_trustfile_mtimes (mtimes);
+  if (mtimes[0] != trustfile_mtimes[0] || mtimes[1] != trustfile_mtimes[1])
+    {
+      if (opt.verbose)
+        log_info ("trustlist modified - reloading\n");
+      clear_trusttable ();
+    }
+}
+
+
 static gpg_error_t
 read_one_trustfile (const char *fname, int systrust,
                     trustitem_t **addr_of_table,
@@ -362,6 +507,12 @@ read_trustfiles (void)
   char *fname;
   int systrust = 0;
   gpg_err_code_t ec;
+  time_t mtimes[2];
+
+  /* Take the times before reading so that a concurrent modification
+     triggers another reload.  */
+  get_trustfile_mtimes (mtimes);
+  trustfile_checked = gnupg_get_time ();
 
   tablesize = 20;
   table = xtrycalloc (tablesize, sizeof *table);
@@ -400,19 +551,20 @@ read_trustfiles (void)
   err = read_one_trustfile (fname, systrust, &table, &tablesize, &tableidx);
   xfree (fname);
 
+  if (err && gpg_err_code (err) == GPG_ERR_ENOENT)
+    {
+      /* Take a missing trustlist as an empty one.  We keep the
+         empty table so that we do not try to read it again for
+         each lookup.  */
+      tableidx = 0;
+      err = 0;
+    }
   if (err)
     {
       xfree (table);
-      if (gpg_err_code (err) == GPG_ERR_ENOENT)
-        {
-          /* Take a missing trustlist as an empty one.  */
-          clear_trusttable ();
-          err = 0;
-        }
       return err;
     }
 
-  /* Fixme: we should drop duplicates and sort the table. */
   ti = xtryrealloc (table, (tableidx?tableidx:1) * sizeof *table);
   if (!ti)
     {
@@ -422,9 +574,12 @@ read_trustfiles (void)
     }
 
   /* Replace the trusttable.  */
-  xfree (trusttable);
+  clear_trusttable ();
   trusttable = ti;
   trusttablesize = tableidx;
+  trustfile_mtimes[0] = mtimes[0];
+  trustfile_mtimes[1] = mtimes[1];
+  build_trustindex ();
   return 0;
 }
 
@@ -439,7 +594,6 @@ istrusted_internal (ctrl_t ctrl, const char *fpr, int *r_disabled,
   gpg_error_t err = 0;
   int locked = already_locked;
   trustitem_t *ti;
-  size_t len;
   unsigned char fprbin[20];
 
   if (r_disabled)
@@ -457,6 +611,7 @@ istrusted_internal (ctrl_t ctrl, const char *fpr, int *r_disabled,
       locked = 1;
     }
 
+  check_trustfiles ();
   if (!trusttable)
     {
       err = read_trustfiles ();
@@ -467,38 +622,38 @@ istrusted_internal (ctrl_t ctrl, const char *fpr, int *r_disabled,
         }
     }
 
-  if (trusttable)
+  ti = find_trustitem (fprbin);
+  if (ti)
     {
-      for (ti=trusttable, len = trusttablesize; len; ti++, len--)
-        if (!memcmp (ti->fpr, fprbin, 20))
-          {
-            if (ti->flags.disabled && r_disabled)
-              *r_disabled = 1;
-
-            /* Print status messages only if we have not been called
-               in a locked state.  */
-            if (already_locked)
-              ;
-            else if (ti->flags.relax || ti->flags.cm || ti->flags.qual
-                     || ti->flags.de_vs)
-              {
-                unlock_trusttable ();
-                locked = 0;
-                err = 0;
-                if (ti->flags.relax)
-                  err = agent_write_status (ctrl,"TRUSTLISTFLAG", "relax",NULL);
-                if (!err && ti->flags.cm)
-                  err = agent_write_status (ctrl,"TRUSTLISTFLAG", "cm", NULL);
-                if (!err && ti->flags.qual)
-                  err = agent_write_status (ctrl,"TRUSTLISTFLAG", "qual",NULL);
-                if (!err && ti->flags.de_vs)
-                  err = agent_write_status (ctrl,"TRUSTLISTFLAG", "de-vs",NULL);
-              }
-
-            if (!err)
-              err = ti->flags.disabled? gpg_error (GPG_ERR_NOT_TRUSTED) : 0;
-            goto leave;
-          }
+      trustitem_t item = *ti;
+
+      if (item.flags.disabled && r_disabled)
+        *r_disabled = 1;
+
+      /* Print status messages only if we have not been called in a
+         locked state.  We work on a copy of the item because the
+         table may be replaced as soon as we release the lock.  */
+      if (already_locked)
+        ;
+      else if (item.flags.relax || item.flags.cm || item.flags.qual
+               || item.flags.de_vs)
+        {
+          unlock_trusttable ();
+          locked = 0;
+          err = 0;
+          if (item.flags.relax)
+            err = agent_write_status (ctrl,"TRUSTLISTFLAG", "relax",NULL);
+          if (!err && item.flags.cm)
+            err = agent_write_status (ctrl,"TRUSTLISTFLAG", "cm", NULL);
+          if (!err && item.flags.qual)
+            err = agent_write_status (ctrl,"TRUSTLISTFLAG", "qual",NULL);
+          if (!err && item.flags.de_vs)
+            err = agent_write_status (ctrl,"TRUSTLISTFLAG", "de-vs",NULL);
+        }
+
+      if (!err)
+        err = item.flags.disabled? gpg_error (GPG_ERR_NOT_TRUSTED) : 0;
+      goto leave;
     }
   err = gpg_error (GPG_ERR_NOT_TRUSTED);
 
@@ -528,6 +683,7 @@ agent_listtrusted (void *assuan_context)
   size_t len;
 
   lock_trusttable ();
+  check_trustfiles ();
   if (!trusttable)
     {
       err = read_trustfiles ();
@@ -310,6 +310,11 @@ unlock_spawning (lock_spawn_t *lock, const char *name)
  * the usual verbose flag.  CTX is the assuan context.  CONNECT_FLAGS
  * are the assuan connect flags.  DID_SUCCESS_MSG will be set to 1 if
  * a success messages has been printed.
+ *
+ * On POSIX systems the daemons create and listen on their socket
+ * before the process we started forks and exits.  Because we wait for
+ * that process, the first connect usually succeeds and thus we do not
+ * sleep before trying it.
  */
 static gpg_error_t
 wait_for_sock (int secs, int module_name_id, const char *sockname,
@@ -328,8 +333,25 @@ wait_for_sock (int secs, int module_name_id, const char *sockname,
   int lastalert = secs+1;
   int secsleft;
 
-  while (elapsed_us < target_us)
+  for (;;)
     {
+      err = assuan_socket_connect (ctx, sockname, 0, connect_flags);
+      if (!err)
+        {
+          if (verbose)
+            {
+              log_info (module_name_id == GNUPG_MODULE_NAME_DIRMNGR?
+                        _("connection to the dirmngr established\n"):
+                        module_name_id == GNUPG_MODULE_NAME_KEYBOXD?
+                        _("connection to the keyboxd established\n"):
+                        _("connection to the agent established\n"));
+              *did_success_msg = 1;
+            }
+          break;
+        }
+      if (elapsed_us >= target_us)
+        break;
+
       if (verbose)
         {
           secsleft = (target_us - elapsed_us + 999999)/1000000;
@@ -349,20 +371,6 @@ wait_for_sock (int secs, int module_name_id, const char *sockname,
         }
       gnupg_usleep (next_sleep_us);
       elapsed_us += next_sleep_us;
-      err = assuan_socket_connect (ctx, sockname, 0, connect_flags);
-      if (!err)
-        {
-          if (verbose)
-            {
-              log_info (module_name_id == GNUPG_MODULE_NAME_DIRMNGR?
-                        _("connection to the dirmngr established\n"):
-                        module_name_id == GNUPG_MODULE_NAME_KEYBOXD?
-                        _("connection to the keyboxd established\n"):
-                        _("connection to the agent established\n"));
-              *did_success_msg = 1;
-            }
-          break;
-        }
       next_sleep_us *= 2;
       if (next_sleep_us > 1000000)
         next_sleep_us = 1000000;
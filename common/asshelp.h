@@ -128,5 +128,8 @@ gpg_error_t print_assuan_status_strings (assuan_context_t ctx,
                                          const char *keyword,
                                          ...) GPGRT_ATTR_SENTINEL(1);
 
+gpg_error_t write_assuan_data_lines (assuan_context_t ctx,
+                                     const void *data, size_t datalen);
+
 
 #endif /*GNUPG_COMMON_ASSHELP_H*/
@@ -177,6 +177,45 @@ status_printf (ctrl_t ctrl, const char *keyword, const char *format, ...)
 }
 
 
+/* Send (DATA,DATALEN) as Assuan data lines.  This has the same
+ * effect as assuan_send_data but uses a faster escaping method and
+ * is thus preferable for large payloads.  Pending data of a previous
+ * assuan_send_data is flushed first.  */
+gpg_error_t
+write_assuan_data_lines (assuan_context_t ctx,
+                         const void *data, size_t datalen)
+{
+  gpg_error_t err;
+  char line[ASSUAN_LINELENGTH];
+  const char *s = data;
+  size_t n, nread;
+
+  /* For small data the buffering of libassuan is better.  */
+  if (datalen < 2 * ASSUAN_LINELENGTH)
+    return assuan_send_data (ctx, data, datalen);
+
+  err = assuan_send_data (ctx, NULL, 0);
+  if (err)
+    return err;
+
+  line[0] = 'D';
+  line[1] = ' ';
+  while (datalen)
+    {
+      n = percent_dline_escape (line + 2, sizeof line - 5,
+                                s, datalen, &nread);
+      line[2 + n] = 0;
+      err = assuan_write_line (ctx, line);
+      if (err)
+        return err;
+      s += nread;
+      datalen -= nread;
+    }
+
+  return 0;
+}
+
+
 /* Same as status_printf but takes a status number instead of a
  * keyword.  */
 gpg_error_t
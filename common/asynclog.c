@@ -0,0 +1,425 @@
+/* asynclog.c - Asynchronous writing of the log for daemons
+ * Copyright (C) 2026 g10 Code GmbH
+ *
+ * This file is part of GnuPG.
+ *
+ * GnuPG is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * GnuPG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see <https://www.gnu.org/licenses/>.
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+/* With a verbose or debug log each request writes many lines to the
+ * log file.  Writing them directly delays the request.  The code here
+ * replaces the log stream of gpgrt by a stream which only copies the
+ * lines into a ring buffer; a separate thread writes them to the real
+ * log file.  If the buffer is full lines are dropped and the number
+ * of dropped lines is logged as soon as there is room again.
+ *
+ * If gpgrt shall print timestamps, we take this over so that the time
+ * needs only be formatted once per second.
+ */
+
+#include <config.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <npth.h>
+
+#include "util.h"
+#include "asynclog.h"
+
+
+/* The size of the ring buffer.  */
+#define ASYNC_LOG_BUFSIZE (256*1024)
+
+/* The state of the asynchronous log.  There is only one instance
+ * because there is only one log stream.  */
+struct async_log_s
+{
+  estream_t target;       /* The stream writing to the real log.  */
+  npth_t thread;          /* The writer thread.  */
+  npth_mutex_t lock;      /* Protects the fields below.  */
+  npth_cond_t cond;       /* Signaled when data is available.  */
+  int stop;               /* Ask the writer thread to terminate.  */
+  int running;            /* The writer thread is running.  */
+  char *ring;             /* The ring buffer.  */
+  size_t head;            /* Total number of bytes put into RING.  */
+  size_t tail;            /* Total number of bytes written.  */
+  int at_line_start;      /* The next byte starts a new line.  */
+  int dropping;           /* The rest of the line is dropped.  */
+  unsigned long dropped;  /* Dropped lines not yet reported.  */
+};
+typedef struct async_log_s *async_log_t;
+
+/* The active instance or NULL.  */
+static async_log_t active_log;
+
+/* Set if we print the timestamps instead of gpgrt.  */
+static int with_time;
+
+/* The total number of dropped lines.  */
+static unsigned long total_dropped;
+
+/* The timestamp for STAMP_TIME.  */
+static time_t stamp_time = (time_t)(-1);
+static char stamp[32];
+static size_t stamplen;
+
+
+/* Return the timestamp for the current time in the same format as
+ * used by gpgrt.  */
+static const char *
+get_stamp (void)
+{
+  time_t now = time (NULL);
+  struct tm *tp;
+
+  if (now != stamp_time)
+    {
+      tp = localtime (&now);
+      if (!tp)
+        *stamp = 0;
+      else
+        snprintf (stamp, sizeof stamp, "%04d-%02d-%02d %02d:%02d:%02d ",
+                  1900+tp->tm_year, tp->tm_mon+1, tp->tm_mday,
+                  tp->tm_hour, tp->tm_min, tp->tm_sec);
+      stamplen = strlen (stamp);
+      stamp_time = now;
+    }
+  return stamp;
+}
+
+
+/* Copy LENGTH bytes from DATA into the ring buffer of AL.  The caller
+ * must have checked that there is enough room.  */
+static void
+ring_put (async_log_t al, const void *data, size_t length)
+{
+  size_t pos = al->head % ASYNC_LOG_BUFSIZE;
+  size_t n = ASYNC_LOG_BUFSIZE - pos;
+
+  if (n > length)
+    n = length;
+  memcpy (al->ring + pos, data, n);
+  memcpy (al->ring, (const char *)data + n, length - n);
+  al->head += length;
+}
+
+
+/* Put the LENGTH bytes at P which are at most one line into the ring
+ * buffer of AL or drop them.  Returns true if something has been put
+ * into the buffer.  */
+static int
+put_segment (async_log_t al, const char *p, size_t length)
+{
+  char note[80];
+  size_t avail, need;
+  int ends_line = (p[length-1] == '\n');
+  int any = 0;
+
+  avail = ASYNC_LOG_BUFSIZE - (al->head - al->tail);
+  if (al->at_line_start && al->dropped)
+    {
+      snprintf (note, sizeof note, "%s[%lu log lines dropped]\n",
+                with_time? get_stamp () : "", al->dropped);
+      if (strlen (note) + length + stamplen <= avail)
+        {
+          ring_put (al, note, strlen (note));
+          avail -= strlen (note);
+          al->dropped = 0;
+          any = 1;
+        }
+    }
+
+  need = length;
+  if (with_time && al->at_line_start)
+    {
+      get_stamp ();
+      need += stamplen;
+    }
+
+  if (al->dropping || al->dropped || need > avail)
+    {
+      /* Drop the rest of the line.  */
+      al->dropping = !ends_line;
+      if (ends_line)
+        {
+          al->dropped++;
+          total_dropped++;
+        }
+    }
+  else
+    {
+      if (with_time && al->at_line_start)
+        ring_put (al, stamp, stamplen);
+      ring_put (al, p, length);
+      any = 1;
+    }
+  al->at_line_start = ends_line;
+  return any;
+}
+
+
+/* The write function of the stream used by gpgrt.  This is called
+ * with the gpgrt log lock held and must not block.  */
+static gpgrt_ssize_t
+async_log_cookie_write (void *cookie, const void *buffer, size_t size)
+{
+  async_log_t al = cookie;
+  const char *p = buffer;
+  const char *s;
+  size_t left, n;
+  int any = 0;
+
+  npth_mutex_lock (&al->lock);
+  for (left = size; left; p += n, left -= n)
+    {
+      s = memchr (p, '\n', left);
+      n = s? (size_t)(s - p + 1) : left;
+      if (put_segment (al, p, n))
+        any = 1;
+    }
+  if (any && !al->running)
+    {
+      /* We are past the atexit handler; write directly.  */
+      es_fwrite (al->ring + (al->tail % ASYNC_LOG_BUFSIZE),
+                 al->head - al->tail, 1, al->target);
+      es_fflush (al->target);
+      al->tail = al->head = 0;
+      any = 0;
+    }
+  if (any)
+    npth_cond_signal (&al->cond);
+  npth_mutex_unlock (&al->lock);
+
+  return (gpgrt_ssize_t)size;
+}
+
+
+/* The writer thread.  */
+static void *
+async_log_writer (void *opaque)
+{
+  async_log_t al = opaque;
+  size_t pos, n;
+
+  npth_mutex_lock (&al->lock);
+  for (;;)
+    {
+      while (al->head == al->tail && !al->stop)
+        npth_cond_wait (&al->cond, &al->lock);
+      if (al->head == al->tail)
+        break;  /* Stop requested and everything written.  */
+
+      pos = al->tail % ASYNC_LOG_BUFSIZE;
+      n = al->head - al->tail;
+      if (n > ASYNC_LOG_BUFSIZE - pos)
+        n = ASYNC_LOG_BUFSIZE - pos;
+      npth_mutex_unlock (&al->lock);
+
+      /* The syscall clamp releases the global lock while writing.
+       * Errors are ignored because there is no way to report them.  */
+      es_fwrite (al->ring + pos, n, 1, al->target);
+      es_fflush (al->target);
+
+      npth_mutex_lock (&al->lock);
+      al->tail += n;
+    }
+  npth_mutex_unlock (&al->lock);
+  return NULL;
+}
+
+
+/* Stop the writer thread of AL after it has written everything.  */
+static void
+async_log_stop (async_log_t al)
+{
+  if (!al->running)
+    return;
+  npth_mutex_lock (&al->lock);
+  al->stop = 1;
+  npth_cond_signal (&al->cond);
+  npth_mutex_unlock (&al->lock);
+  npth_join (al->thread, NULL);
+  al->running = 0;
+}
+
+
+/* Stop the writer thread of AL and release AL.  */
+static void
+async_log_release (async_log_t al)
+{
+  if (active_log == al)
+    active_log = NULL;
+
+  async_log_stop (al);
+  es_fclose (al->target);
+  npth_cond_destroy (&al->cond);
+  npth_mutex_destroy (&al->lock);
+  xfree (al->ring);
+  xfree (al);
+}
+
+
+/* The close function of the stream used by gpgrt.  This is called
+ * when the log file is changed.  */
+static int
+async_log_cookie_close (void *cookie)
+{
+  async_log_release (cookie);
+  return 0;
+}
+
+
+static es_cookie_io_functions_t async_log_cookie_functions =
+  {
+    NULL,
+    async_log_cookie_write,
+    NULL,
+    async_log_cookie_close
+  };
+
+
+/* Make sure that all buffered lines are written at exit.  The stream
+ * is still used by gpgrt; thus AL is not released but lines logged
+ * after this are written directly.  */
+static void
+async_log_atexit (void)
+{
+  if (active_log)
+    async_log_stop (active_log);
+}
+
+
+/* Switch the current log file to asynchronous writing.  This needs
+ * to be called after npth has been initialized and the process has
+ * been detached, and again after the log file has been changed.  If
+ * the log goes to a socket (e.g. to watchgnupg) nothing is changed so
+ * that the reconnect logic of gpgrt keeps on working; an error is
+ * returned in this case.  */
+gpg_error_t
+async_log_start (void)
+{
+  static int atexit_registered;
+  gpg_error_t err;
+  async_log_t al;
+  estream_t fp;
+  unsigned int flags;
+  int fd;
+#ifdef S_ISSOCK
+  struct stat st;
+#endif
+
+  if (active_log)
+    return 0;  /* Already active.  */
+
+  fd = log_get_fd ();
+  if (fd == -1)
+    err = gpg_error (GPG_ERR_NOT_SUPPORTED);
+#ifdef S_ISSOCK
+  else if (!fstat (fd, &st) && S_ISSOCK (st.st_mode))
+    err = gpg_error (GPG_ERR_NOT_SUPPORTED);
+#endif
+  else
+    err = 0;
+  if (err)
+    {
+      /* Give the timestamps back to gpgrt.  */
+      if (with_time)
+        {
+          log_get_prefix (&flags);
+          log_set_prefix (NULL, flags | GPGRT_LOG_WITH_TIME);
+          with_time = 0;
+        }
+      return err;
+    }
+
+  al = xtrycalloc (1, sizeof *al);
+  if (!al)
+    return gpg_error_from_syserror ();
+  al->ring = xtrymalloc (ASYNC_LOG_BUFSIZE);
+  if (!al->ring)
+    {
+      err = gpg_error_from_syserror ();
+      xfree (al);
+      return err;
+    }
+  al->at_line_start = 1;
+  npth_mutex_init (&al->lock, NULL);
+  npth_cond_init (&al->cond, NULL);
+
+  fd = dup (fd);
+  al->target = fd == -1? NULL : es_fdopen (fd, "w");
+  if (!al->target)
+    {
+      err = gpg_error_from_syserror ();
+      if (fd != -1)
+        close (fd);
+      goto leave;
+    }
+
+  err = gpg_error_from_errno (npth_create (&al->thread, NULL,
+                                           async_log_writer, al));
+  if (err)
+    goto leave;
+  al->running = 1;
+
+  fp = es_fopencookie (al, "w", async_log_cookie_functions);
+  if (!fp)
+    {
+      err = gpg_error_from_syserror ();
+      async_log_release (al);
+      return err;
+    }
+  es_setvbuf (fp, NULL, _IOLBF, 0);
+
+  if (!atexit_registered)
+    {
+      atexit (async_log_atexit);
+      atexit_registered = 1;
+    }
+
+  log_get_prefix (&flags);
+  if ((flags & GPGRT_LOG_WITH_TIME))
+    {
+      with_time = 1;
+      log_set_prefix (NULL, flags & ~GPGRT_LOG_WITH_TIME);
+    }
+
+  /* Switch to the new stream.  This closes the old stream; we keep a
+   * dup of its file descriptor.  */
+  active_log = al;
+  log_set_sink (NULL, fp, -1);
+  return 0;
+
+ leave:
+  es_fclose (al->target);
+  npth_cond_destroy (&al->cond);
+  npth_mutex_destroy (&al->lock);
+  xfree (al->ring);
+  xfree (al);
+  return err;
+}
+
+
+/* Return the total number of dropped log lines.  */
+unsigned long
+async_log_dropped (void)
+{
+  return total_dropped;
+}
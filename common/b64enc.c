@@ -138,6 +138,60 @@ static const u32 crc_table[256] = {
   0x56d11cce, 0x56575035, 0x575bc9c3, 0x57dd8538
 };
 
+/* Tables for a slice-by-8 implementation of the above CRC.  The CRC
+   is kept left aligned in a 32 bit word so that bits shifted out are
+   simply dropped.  They are computed at runtime from crc_table.  */
+static u32 crc_slice_table[8][256];
+static int crc_slice_table_ready;
+
+
+static void
+init_crc_slice_table (void)
+{
+  int i, k;
+  u32 t;
+
+  for (i=0; i < 256; i++)
+    crc_slice_table[0][i] = (crc_table[i] & 0x00ffffff) << 8;
+  for (k=1; k < 8; k++)
+    for (i=0; i < 256; i++)
+      {
+        t = crc_slice_table[k-1][i];
+        crc_slice_table[k][i] = (t << 8) ^ crc_slice_table[0][t >> 24];
+      }
+  crc_slice_table_ready = 1;
+}
+
+
+/* Update the OpenPGP CRC in CRC with the NBYTES at BUFFER and return
+   the new CRC.  */
+static u32
+update_crc (u32 crc, const unsigned char *p, size_t nbytes)
+{
+  u32 c;
+
+  if (!crc_slice_table_ready)
+    init_crc_slice_table ();
+
+  c = crc << 8;
+  for (; nbytes >= 8; p += 8, nbytes -= 8)
+    {
+      c ^= ((u32)p[0] << 24) | ((u32)p[1] << 16) | ((u32)p[2] << 8) | p[3];
+      c = (crc_slice_table[7][c >> 24]
+           ^ crc_slice_table[6][(c >> 16) & 0xff]
+           ^ crc_slice_table[5][(c >> 8) & 0xff]
+           ^ crc_slice_table[4][c & 0xff]
+           ^ crc_slice_table[3][p[4]]
+           ^ crc_slice_table[2][p[5]]
+           ^ crc_slice_table[1][p[6]]
+           ^ crc_slice_table[0][p[7]]);
+    }
+  for (; nbytes; p++, nbytes--)
+    c = (c << 8) ^ crc_slice_table[0][(c >> 24) ^ *p];
+
+  return c >> 8;
+}
+
 
 static gpg_error_t
 enc_start (struct b64state *state, FILE *fp, estream_t stream,
@@ -197,6 +251,51 @@ my_fputs (const char *string, struct b64state *state)
 }
 
 
+/* Write LENGTH bytes from BUFFER to the stream of STATE.  Returns
+   true on error.  */
+static int
+my_fwrite (const void *buffer, size_t length, struct b64state *state)
+{
+  if (state->stream)
+    return es_write (state->stream, buffer, length, NULL);
+  else
+    return fwrite (buffer, length, 1, state->fp) != 1;
+}
+
+
+/* Encode NLINES complete lines from BUFFER, each of 48 bytes, into
+   OUTBUF.  Each line of 64 characters is terminated by the string
+   EOL.  OUTBUF must provide room for NLINES * (64 + strlen (EOL))
+   bytes.  Returns the number of bytes stored at OUTBUF.  This is the
+   inner loop of the armor encoders; it does not keep any state.  */
+size_t
+b64enc_lines (const void *buffer, size_t nlines, const char *eol,
+              void *outbuf)
+{
+  const unsigned char *p = buffer;
+  unsigned char *d = outbuf;
+  size_t eollen = strlen (eol);
+  u32 in;
+  int i;
+
+  for (; nlines; nlines--)
+    {
+      for (i=0; i < 64/4; i++, p += 3, d += 4)
+        {
+          in = ((u32)p[0] << 16) | ((u32)p[1] << 8) | p[2];
+          d[0] = bintoasc[(in >> 18) & 077];
+          d[1] = bintoasc[(in >> 12) & 077];
+          d[2] = bintoasc[(in >> 6) & 077];
+          d[3] = bintoasc[in & 077];
+        }
+      memcpy (d, eol, eollen);
+      d += eollen;
+    }
+
+  return d - (unsigned char *)outbuf;
+}
+
+
 /* Write NBYTES from BUFFER to the Base 64 stream identified by
    STATE. With BUFFER and NBYTES being 0, merely do a fflush on the
    stream. */
@@ -206,6 +305,9 @@ b64enc_write (struct b64state *state, const void *buffer, size_t nbytes)
   unsigned char radbuf[4];
   int idx, quad_count;
   const unsigned char *p;
+  char outbuf[16 * (64 + 1)];  /* Room for 16 lines.  */
+  size_t outlen;
+  u32 in;
 
   if (state->lasterr)
     return state->lasterr;
@@ -240,51 +342,74 @@ b64enc_write (struct b64state *state, const void *buffer, size_t nbytes)
   memcpy (radbuf, state->radbuf, idx);
 
   if ( (state->flags & B64ENC_USE_PGPCRC) )
-    {
-      size_t n;
-      u32 crc = state->crc;
-
-      for (p=buffer, n=nbytes; n; p++, n-- )
-        crc = ((u32)crc << 8) ^ crc_table[((crc >> 16)&0xff) ^ *p];
-      state->crc = (crc & 0x00ffffff);
-    }
+    state->crc = update_crc (state->crc, buffer, nbytes);
 
-  for (p=buffer; nbytes; p++, nbytes--)
+  /* Encode into OUTBUF and write it out in large chunks instead of
+     calling putc for each character.  */
+  outlen = 0;
+  p = buffer;
+  while (nbytes)
     {
-      radbuf[idx++] = *p;
-      if (idx > 2)
+      if (!idx && !quad_count && nbytes >= (64/4)*3
+          && !(state->flags & B64ENC_NO_LINEFEEDS))
         {
-          char tmp[4];
+          /* At the start of a line: Encode as many complete lines
+             as fit into OUTBUF at once.  */
+          size_t nlines = nbytes / ((64/4)*3);
 
-          tmp[0] = bintoasc[(*radbuf >> 2) & 077];
-          tmp[1] = bintoasc[(((*radbuf<<4)&060)|((radbuf[1] >> 4)&017))&077];
-          tmp[2] = bintoasc[(((radbuf[1]<<2)&074)|((radbuf[2]>>6)&03))&077];
-          tmp[3] = bintoasc[radbuf[2]&077];
-          if (state->stream)
+          if (nlines > (sizeof outbuf - outlen) / (64 + 1))
+            nlines = (sizeof outbuf - outlen) / (64 + 1);
+          if (nlines)
             {
-              for (idx=0; idx < 4; idx++)
-                es_putc (tmp[idx], state->stream);
-              idx = 0;
-              if (es_ferror (state->stream))
-                goto write_error;
+              outlen += b64enc_lines (p, nlines, "\n", outbuf + outlen);
+              p += nlines * ((64/4)*3);
+              nbytes -= nlines * ((64/4)*3);
             }
-          else
+          if (outlen > sizeof outbuf - (64 + 1))
             {
-              for (idx=0; idx < 4; idx++)
-                putc (tmp[idx], state->fp);
-              idx = 0;
-              if (ferror (state->fp))
+              if (my_fwrite (outbuf, outlen, state))
                 goto write_error;
+              outlen = 0;
             }
-          if (++quad_count >= (64/4))
+          continue;
+        }
+
+      if (idx || nbytes < 3)
+        {
+          radbuf[idx++] = *p++;
+          nbytes--;
+          if (idx < 3)
+            continue;
+          idx = 0;
+        }
+      else
+        {
+          memcpy (radbuf, p, 3);
+          p += 3;
+          nbytes -= 3;
+        }
+
+      in = ((u32)radbuf[0] << 16) | ((u32)radbuf[1] << 8) | radbuf[2];
+      outbuf[outlen++] = bintoasc[(in >> 18) & 077];
+      outbuf[outlen++] = bintoasc[(in >> 12) & 077];
+      outbuf[outlen++] = bintoasc[(in >> 6) & 077];
+      outbuf[outlen++] = bintoasc[in & 077];
+      if (++quad_count >= (64/4))
+        {
+          quad_count = 0;
+          if (!(state->flags & B64ENC_NO_LINEFEEDS))
+            outbuf[outlen++] = '\n';
+          if (outlen > sizeof outbuf - (64 + 1))
             {
-              quad_count = 0;
-              if (!(state->flags & B64ENC_NO_LINEFEEDS)
-                  && my_fputs ("\n", state) == EOF)
+              if (my_fwrite (outbuf, outlen, state))
                 goto write_error;
+              outlen = 0;
             }
         }
     }
+  if (outlen && my_fwrite (outbuf, outlen, state))
+    goto write_error;
+
   memcpy (state->radbuf, radbuf, idx);
   state->idx = idx;
   state->quad_count = quad_count;
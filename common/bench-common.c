@@ -0,0 +1,361 @@
+/* bench-common.c - Micro benchmarks for some hot paths
+ * Copyright (C) 2026 g10 Code GmbH
+ *
+ * This file is part of GnuPG.
+ *
+ * GnuPG is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * GnuPG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see <https://www.gnu.org/licenses/>.
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+/* This program is not a test but run by "make bench".  It prints one
+ * JSON object per line to stdout so that the results can easily be
+ * collected and compared between releases:
+ *
+ *   {"bench":"NAME","bytes":N,"usec":N,"mbps":X}
+ *
+ * The input data is generated from a fixed seed so that each run
+ * processes exactly the same bytes.
+ */
+
+#include <config.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+
+#include "util.h"
+#include "iobuf.h"
+
+#define PGM "bench-common"
+
+static int verbose;
+static unsigned int iterations = 16;
+
+/* The size of the input buffer.  */
+#define DATALEN (1024*1024)
+static unsigned char *data;
+
+
+/* Return the current time in microseconds.  */
+static unsigned long long
+now_usec (void)
+{
+  struct timeval tv;
+
+  gettimeofday (&tv, NULL);
+  return (unsigned long long)tv.tv_sec * 1000000 + tv.tv_usec;
+}
+
+
+/* Print the result line for benchmark NAME which processed NBYTES
+ * in USEC microseconds.  */
+static void
+report_usec (const char *name, unsigned long long nbytes,
+             unsigned long long usec)
+{
+  if (!usec)
+    usec = 1;
+  printf ("{\"bench\":\"%s\",\"bytes\":%llu,\"usec\":%llu,\"mbps\":%.2f}\n",
+          name, nbytes, usec, (double)nbytes / (double)usec);
+  fflush (stdout);
+}
+
+
+/* Same as report_usec but takes the START time.  */
+static void
+report (const char *name, unsigned long long nbytes,
+        unsigned long long start)
+{
+  report_usec (name, nbytes, now_usec () - start);
+}
+
+
+/* Fill DATA with a deterministic pattern.  A simple LCG is sufficient;
+ * the data only needs to be the same for each run.  */
+static void
+prepare_data (void)
+{
+  u32 seed = 0x5eed;
+  size_t n;
+
+  data = xmalloc (DATALEN);
+  for (n=0; n < DATALEN; n++)
+    {
+      seed = seed * 1103515245 + 12345;
+      data[n] = seed >> 16;
+    }
+}
+
+
+/* A filter which passes the data unchanged.  Used to measure the
+ * overhead of a filter chain.  */
+static int
+copy_filter (void *opaque, int control,
+             iobuf_t chain, byte *buf, size_t *len)
+{
+  (void)opaque;
+
+  if (control == IOBUFCTRL_DESC)
+    mem2str (buf, "copy_filter", *len);
+  else if (control == IOBUFCTRL_UNDERFLOW)
+    {
+      int n = iobuf_read (chain, buf, *len);
+
+      if (n == -1)
+        {
+          *len = 0;
+          return -1;
+        }
+      *len = n;
+    }
+  return 0;
+}
+
+
+/* Read DATA through an iobuf with NFILTERS copy filters pushed.  */
+static void
+bench_iobuf_read (const char *name, int nfilters)
+{
+  unsigned long long start, total = 0;
+  unsigned int iter;
+  char buffer[4096];
+  iobuf_t a;
+  int i, n;
+
+  start = now_usec ();
+  for (iter=0; iter < iterations; iter++)
+    {
+      a = iobuf_temp_with_content ((const char *)data, DATALEN);
+      for (i=0; i < nfilters; i++)
+        iobuf_push_filter (a, copy_filter, NULL);
+      while ((n = iobuf_read (a, buffer, sizeof buffer)) > 0)
+        total += n;
+      iobuf_close (a);
+    }
+  report (name, total, start);
+}
+
+
+/* Read DATA byte by byte through a plain iobuf.  */
+static void
+bench_iobuf_getc (void)
+{
+  unsigned long long start, total = 0;
+  unsigned int iter;
+  iobuf_t a;
+
+  start = now_usec ();
+  for (iter=0; iter < iterations; iter++)
+    {
+      a = iobuf_temp_with_content ((const char *)data, DATALEN);
+      while (iobuf_get (a) != -1)
+        total++;
+      iobuf_close (a);
+    }
+  report ("iobuf-getc", total, start);
+}
+
+
+/* Write DATA in small chunks to a temp iobuf.  */
+static void
+bench_iobuf_write (void)
+{
+  unsigned long long start, total = 0;
+  unsigned int iter;
+  size_t n;
+  iobuf_t a;
+
+  start = now_usec ();
+  for (iter=0; iter < iterations; iter++)
+    {
+      a = iobuf_temp ();
+      for (n=0; n < DATALEN; n += 512)
+        iobuf_write (a, data + n, 512);
+      total += iobuf_get_temp_length (a);
+      iobuf_close (a);
+    }
+  report ("iobuf-write", total, start);
+}
+
+
+/* Base64 encode DATA into a memory stream and decode it again.  This
+ * is the core of the armor code.  */
+static void
+bench_b64 (void)
+{
+  unsigned long long t0, enctime = 0, dectime = 0;
+  unsigned long long encbytes = 0, decbytes = 0;
+  unsigned int iter;
+  struct b64state state;
+  estream_t fp;
+  void *buffer;
+  size_t buflen, nbytes;
+  gpg_error_t err;
+
+  for (iter=0; iter < iterations; iter++)
+    {
+      fp = es_fopenmem (0, "w+b");
+      if (!fp)
+        {
+          fprintf (stderr, PGM ": es_fopenmem failed: %s\n",
+                   gpg_strerror (gpg_error_from_syserror ()));
+          exit (1);
+        }
+      t0 = now_usec ();
+      err = b64enc_start_es (&state, fp, "PGP MESSAGE");
+      if (!err)
+        err = b64enc_write (&state, data, DATALEN);
+      if (!err)
+        err = b64enc_finish (&state);
+      enctime += now_usec () - t0;
+      if (err)
+        {
+          fprintf (stderr, PGM ": b64enc failed: %s\n", gpg_strerror (err));
+          exit (1);
+        }
+      encbytes += DATALEN;
+
+      if (es_fclose_snatch (fp, &buffer, &buflen))
+        {
+          fprintf (stderr, PGM ": es_fclose_snatch failed\n");
+          exit (1);
+        }
+      t0 = now_usec ();
+      err = b64dec_start (&state, "");
+      if (!err)
+        err = b64dec_proc (&state, buffer, buflen, &nbytes);
+      if (!err)
+        err = b64dec_finish (&state);
+      dectime += now_usec () - t0;
+      if (err)
+        {
+          fprintf (stderr, PGM ": b64dec failed: %s\n", gpg_strerror (err));
+          exit (1);
+        }
+      decbytes += nbytes;
+      es_free (buffer);
+    }
+
+  report_usec ("b64-encode", encbytes, enctime);
+  report_usec ("b64-decode", decbytes, dectime);
+}
+
+
+static void
+bench_hash (const char *name, int algo)
+{
+  unsigned long long start;
+  unsigned int iter;
+  unsigned char digest[64];
+
+  start = now_usec ();
+  for (iter=0; iter < iterations; iter++)
+    gcry_md_hash_buffer (algo, digest, data, DATALEN);
+  report (name, (unsigned long long)iterations * DATALEN, start);
+}
+
+
+/* Encrypt a copy of DATA in place using cipher ALGO and MODE.  */
+static void
+bench_cipher (const char *name, int algo, int mode)
+{
+  unsigned long long start;
+  unsigned int iter;
+  unsigned char key[32], iv[16];
+  unsigned char *buffer;
+  gcry_cipher_hd_t hd;
+  gpg_error_t err;
+
+  memset (key, 0x42, sizeof key);
+  memset (iv, 0x17, sizeof iv);
+  buffer = xmalloc (DATALEN);
+  memcpy (buffer, data, DATALEN);
+
+  err = gcry_cipher_open (&hd, algo, mode, 0);
+  if (!err)
+    err = gcry_cipher_setkey (hd, key, gcry_cipher_get_algo_keylen (algo));
+  if (err)
+    {
+      fprintf (stderr, PGM ": cipher %s failed: %s\n",
+               name, gpg_strerror (err));
+      exit (1);
+    }
+
+  start = now_usec ();
+  for (iter=0; iter < iterations; iter++)
+    {
+      gcry_cipher_setiv (hd, iv, gcry_cipher_get_algo_blklen (algo));
+      gcry_cipher_encrypt (hd, buffer, DATALEN, NULL, 0);
+    }
+  report (name, (unsigned long long)iterations * DATALEN, start);
+
+  gcry_cipher_close (hd);
+  xfree (buffer);
+}
+
+
+int
+main (int argc, char **argv)
+{
+  if (argc)
+    { argc--; argv++; }
+  while (argc && **argv == '-')
+    {
+      if (!strcmp (*argv, "--verbose"))
+        {
+          verbose++;
+          argc--; argv++;
+        }
+      else if (!strcmp (*argv, "--iterations") && argc > 1)
+        {
+          iterations = atoi (argv[1]);
+          if (!iterations)
+            iterations = 1;
+          argc -= 2; argv += 2;
+        }
+      else
+        {
+          fprintf (stderr, "usage: " PGM " [--verbose] [--iterations N]\n");
+          exit (1);
+        }
+    }
+
+  if (!gcry_check_version (NEED_LIBGCRYPT_VERSION))
+    {
+      fprintf (stderr, PGM ": libgcrypt is too old (need %s, have %s)\n",
+               NEED_LIBGCRYPT_VERSION, gcry_check_version (NULL));
+      exit (1);
+    }
+  gcry_control (GCRYCTL_DISABLE_SECMEM, 0);
+  gcry_control (GCRYCTL_INITIALIZATION_FINISHED, 0);
+
+  prepare_data ();
+  if (verbose)
+    fprintf (stderr, PGM ": %u iterations over %d bytes\n",
+             iterations, DATALEN);
+
+  bench_iobuf_read ("iobuf-read", 0);
+  bench_iobuf_read ("iobuf-read-3filters", 3);
+  bench_iobuf_getc ();
+  bench_iobuf_write ();
+  bench_b64 ();
+  bench_hash ("sha1", GCRY_MD_SHA1);
+  bench_hash ("sha256", GCRY_MD_SHA256);
+  bench_hash ("sha512", GCRY_MD_SHA512);
+  bench_cipher ("aes128-cfb", GCRY_CIPHER_AES128, GCRY_CIPHER_MODE_CFB);
+  bench_cipher ("aes256-cfb", GCRY_CIPHER_AES256, GCRY_CIPHER_MODE_CFB);
+
+  xfree (data);
+  return 0;
+}
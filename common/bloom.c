@@ -0,0 +1,244 @@
+/* bloom.c - A simple Bloom filter
+ * Copyright (C) 2023 g10 Code GmbH
+ *
+ * This file is part of GnuPG.
+ *
+ * This file is free software; you can redistribute it and/or modify
+ * it under the terms of either
+ *
+ *   - the GNU Lesser General Public License as published by the Free
+ *     Software Foundation; either version 3 of the License, or (at
+ *     your option) any later version.
+ *
+ * or
+ *
+ *   - the GNU General Public License as published by the Free
+ *     Software Foundation; either version 2 of the License, or (at
+ *     your option) any later version.
+ *
+ * or both in parallel, as here.
+ *
+ * This file is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see <https://www.gnu.org/licenses/>.
+ * SPDX-License-Identifier: (LGPL-3.0-or-later OR GPL-2.0-or-later)
+ */
+
+/* A Bloom filter answers the question whether an item is in a set
+ * with either "definitely not" or "possibly".  We use it to avoid
+ * database lookups for keys we don't have.  The filter uses 10 bits
+ * per item and 7 hash functions which gives a false positive rate of
+ * about 1%.  The bit positions are derived from a single 64 bit FNV-1a
+ * hash using double hashing.
+ *
+ * The serialized form is:
+ *
+ *   byte 4  magic "BLM1"
+ *   u32     number of bits (a power of 2)
+ *   u32     number of hash functions
+ *   u32     number of items
+ *   byte n  the bits
+ *
+ * All numbers are stored in network byte order.
+ */
+
+#include <config.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include "util.h"
+#include "host2net.h"
+#include "bloom.h"
+
+#define BLOOM_MAGIC        "BLM1"
+#define BLOOM_HDRLEN       16
+#define BLOOM_BITS_PER_ITEM 10
+#define BLOOM_NHASHES      7
+#define BLOOM_MIN_BITS     1024
+#define BLOOM_MAX_BITS     (1u << 31)
+
+
+struct bloom_filter_s
+{
+  unsigned int nbits;    /* Number of bits; a power of 2.  */
+  unsigned int nhashes;  /* Number of hash functions.  */
+  unsigned int nitems;   /* Number of items added.  */
+  unsigned char *bits;
+};
+
+
+/* Compute the 64 bit FNV-1a hash over the TYPE and DATA.  */
+static uint64_t
+bloom_hash (int type, const void *data, size_t datalen)
+{
+  const unsigned char *s = data;
+  uint64_t hash = 0xcbf29ce484222325ULL;
+
+  hash ^= (type & 0xff);
+  hash *= 0x100000001b3ULL;
+  for (; datalen; datalen--, s++)
+    {
+      hash ^= *s;
+      hash *= 0x100000001b3ULL;
+    }
+  return hash;
+}
+
+
+/* Allocate a filter object with NBITS bits and NHASHES.  */
+static gpg_error_t
+bloom_alloc (bloom_filter_t *r_bf, unsigned int nbits, unsigned int nhashes)
+{
+  bloom_filter_t bf;
+
+  *r_bf = NULL;
+  bf = xtrycalloc (1, sizeof *bf);
+  if (!bf)
+    return gpg_error_from_syserror ();
+  bf->bits = xtrycalloc (1, nbits / 8);
+  if (!bf->bits)
+    {
+      gpg_error_t err = gpg_error_from_syserror ();
+      xfree (bf);
+      return err;
+    }
+  bf->nbits = nbits;
+  bf->nhashes = nhashes;
+  *r_bf = bf;
+  return 0;
+}
+
+
+/* Create a new Bloom filter suitable for NITEMS items and store it at
+ * R_BF.  Adding more items works but increases the false positive
+ * rate.  */
+gpg_error_t
+bloom_new (bloom_filter_t *r_bf, unsigned int nitems)
+{
+  unsigned int nbits;
+
+  for (nbits = BLOOM_MIN_BITS;
+       nbits < BLOOM_MAX_BITS && nbits / BLOOM_BITS_PER_ITEM < nitems;
+       nbits <<= 1)
+    ;
+  return bloom_alloc (r_bf, nbits, BLOOM_NHASHES);
+}
+
+
+/* Release the filter BF.  */
+void
+bloom_release (bloom_filter_t bf)
+{
+  if (!bf)
+    return;
+  xfree (bf->bits);
+  xfree (bf);
+}
+
+
+/* Add the item of TYPE given by (DATA,DATALEN) to the filter BF.  */
+void
+bloom_add (bloom_filter_t bf, int type, const void *data, size_t datalen)
+{
+  uint64_t hash = bloom_hash (type, data, datalen);
+  u32 h1 = hash;
+  u32 h2 = (hash >> 32) | 1;
+  unsigned int i, bit;
+
+  for (i=0; i < bf->nhashes; i++, h1 += h2)
+    {
+      bit = h1 & (bf->nbits - 1);
+      bf->bits[bit / 8] |= (1 << (bit % 8));
+    }
+  bf->nitems++;
+}
+
+
+/* Return true if the item of TYPE given by (DATA,DATALEN) may have
+ * been added to the filter BF.  False is returned if the item has
+ * definitely not been added.  */
+int
+bloom_test (bloom_filter_t bf, int type, const void *data, size_t datalen)
+{
+  uint64_t hash = bloom_hash (type, data, datalen);
+  u32 h1 = hash;
+  u32 h2 = (hash >> 32) | 1;
+  unsigned int i, bit;
+
+  for (i=0; i < bf->nhashes; i++, h1 += h2)
+    {
+      bit = h1 & (bf->nbits - 1);
+      if (!(bf->bits[bit / 8] & (1 << (bit % 8))))
+        return 0;
+    }
+  return 1;
+}
+
+
+/* Return the number of items added to BF.  */
+unsigned int
+bloom_count (bloom_filter_t bf)
+{
+  return bf? bf->nitems : 0;
+}
+
+
+/* Serialize the filter BF into a malloced buffer which is stored at
+ * R_BUFFER and its length at R_BUFLEN.  */
+gpg_error_t
+bloom_to_buffer (bloom_filter_t bf, void **r_buffer, size_t *r_buflen)
+{
+  unsigned char *buffer;
+  size_t buflen;
+
+  *r_buffer = NULL;
+  *r_buflen = 0;
+
+  buflen = BLOOM_HDRLEN + bf->nbits / 8;
+  buffer = xtrymalloc (buflen);
+  if (!buffer)
+    return gpg_error_from_syserror ();
+  memcpy (buffer, BLOOM_MAGIC, 4);
+  ulongtobuf (buffer + 4, bf->nbits);
+  ulongtobuf (buffer + 8, bf->nhashes);
+  ulongtobuf (buffer + 12, bf->nitems);
+  memcpy (buffer + BLOOM_HDRLEN, bf->bits, bf->nbits / 8);
+
+  *r_buffer = buffer;
+  *r_buflen = buflen;
+  return 0;
+}
+
+
+/* Create a filter from (BUFFER,BUFLEN) as created by bloom_to_buffer
+ * and store it at R_BF.  */
+gpg_error_t
+bloom_from_buffer (bloom_filter_t *r_bf, const void *buffer, size_t buflen)
+{
+  gpg_error_t err;
+  const unsigned char *s = buffer;
+  unsigned int nbits, nhashes;
+
+  *r_bf = NULL;
+  if (buflen < BLOOM_HDRLEN || memcmp (s, BLOOM_MAGIC, 4))
+    return gpg_error (GPG_ERR_INV_OBJ);
+  nbits = buf32_to_uint (s + 4);
+  nhashes = buf32_to_uint (s + 8);
+  if (nbits < 8 || nbits > BLOOM_MAX_BITS || (nbits & (nbits - 1))
+      || !nhashes || nhashes > 32
+      || buflen != BLOOM_HDRLEN + nbits / 8)
+    return gpg_error (GPG_ERR_INV_OBJ);
+
+  err = bloom_alloc (r_bf, nbits, nhashes);
+  if (err)
+    return err;
+  (*r_bf)->nitems = buf32_to_uint (s + 12);
+  memcpy ((*r_bf)->bits, s + BLOOM_HDRLEN, nbits / 8);
+  return 0;
+}
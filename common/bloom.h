@@ -0,0 +1,70 @@
+/* bloom.h - A simple Bloom filter
+ * Copyright (C) 2023 g10 Code GmbH
+ *
+ * This file is part of GnuPG.
+ *
+ * This file is free software; you can redistribute it and/or modify
+ * it under the terms of either
+ *
+ *   - the GNU Lesser General Public License as published by the Free
+ *     Software Foundation; either version 3 of the License, or (at
+ *     your option) any later version.
+ *
+ * or
+ *
+ *   - the GNU General Public License as published by the Free
+ *     Software Foundation; either version 2 of the License, or (at
+ *     your option) any later version.
+ *
+ * or both in parallel, as here.
+ *
+ * This file is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see <https://www.gnu.org/licenses/>.
+ * SPDX-License-Identifier: (LGPL-3.0-or-later OR GPL-2.0-or-later)
+ */
+
+#ifndef GNUPG_COMMON_BLOOM_H
+#define GNUPG_COMMON_BLOOM_H
+
+/* The types of items stored in a Bloom filter; they are hashed along
+ * with the data so that for example a keyid can't be mistaken for the
+ * prefix of a fingerprint.  */
+enum bloom_item_types
+  {
+    BLOOM_ITEM_FPR = 1,  /* An OpenPGP fingerprint.  */
+    BLOOM_ITEM_KID = 2   /* A long keyid as 8 bytes big endian.  */
+  };
+
+struct bloom_filter_s;
+typedef struct bloom_filter_s *bloom_filter_t;
+
+/* Create a new Bloom filter sized for NITEMS items.  */
+gpg_error_t bloom_new (bloom_filter_t *r_bf, unsigned int nitems);
+
+/* Release a Bloom filter.  */
+void bloom_release (bloom_filter_t bf);
+
+/* Add an item of TYPE to the filter.  */
+void bloom_add (bloom_filter_t bf, int type, const void *data, size_t datalen);
+
+/* Return true if the item of TYPE may be in the filter.  */
+int bloom_test (bloom_filter_t bf, int type,
+                const void *data, size_t datalen);
+
+/* Return the number of items added to the filter.  */
+unsigned int bloom_count (bloom_filter_t bf);
+
+/* Serialize the filter into a malloced buffer.  */
+gpg_error_t bloom_to_buffer (bloom_filter_t bf,
+                             void **r_buffer, size_t *r_buflen);
+
+/* Create a filter from a buffer created by bloom_to_buffer.  */
+gpg_error_t bloom_from_buffer (bloom_filter_t *r_bf,
+                               const void *buffer, size_t buflen);
+
+#endif /*GNUPG_COMMON_BLOOM_H*/
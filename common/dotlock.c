@@ -93,6 +93,17 @@
    is to check at runtime whether link(2) works for a specific lock
    file.
 
+   On Posix systems the owner of a lock additionally holds a fcntl
+   write lock on the lock file.  This lock is only used as a wakeup
+   hint: A process waiting without a timeout blocks on a fcntl read
+   lock of the lock file and is thus woken up as soon as the owner
+   releases the lock instead of sleeping with increasing intervals.
+   The lock file itself is still the only thing which decides about
+   the ownership; if the fcntl lock is missing (e.g. because the lock
+   was taken by an older version or fcntl locks are not supported)
+   or vanishes due to the auto unlock feature of POSIX, the waiter
+   falls back to polling.
+
 
    How to use:
    ===========
@@ -402,6 +413,8 @@ struct dotlock_handle
   char *tname;         /* Name of the lockfile template.        */
   size_t nodename_off; /* Offset in TNAME of the nodename part. */
   size_t nodename_len; /* Length of the nodename part.          */
+  int wakeup_fd;       /* FD of the lockfile with the fcntl lock
+                          used as wakeup hint or -1.            */
 #endif /*!HAVE_DOSISH_SYSTEM */
 };
 
@@ -654,6 +667,83 @@ use_hardlinks_p (const char *tname)
 
 
 
+#ifdef HAVE_POSIX_SYSTEM
+/* Return the current time in milliseconds.  */
+static unsigned long
+now_msec (void)
+{
+  struct timeval tv;
+
+  gettimeofday (&tv, NULL);
+  return (unsigned long)tv.tv_sec * 1000 + tv.tv_usec / 1000;
+}
+
+
+/* Take a fcntl write lock on the lock file of H which we own to
+   allow waiters to block until we release it.  Errors are ignored
+   because this is only a hint.  */
+static void
+set_wakeup_lock (dotlock_t h)
+{
+  struct flock fl;
+  int fd;
+
+  fd = open (h->lockname, O_WRONLY);
+  if (fd == -1)
+    return;
+
+  memset (&fl, 0, sizeof fl);
+  fl.l_type = F_WRLCK;
+  fl.l_whence = SEEK_SET;
+  if (fcntl (fd, F_SETLK, &fl))
+    {
+      close (fd);
+      return;
+    }
+  h->wakeup_fd = fd;
+}
+
+
+/* Release the fcntl lock taken by set_wakeup_lock.  This must be
+   called after the lock file has been removed.  */
+static void
+clear_wakeup_lock (dotlock_t h)
+{
+  if (h->wakeup_fd != -1)
+    {
+      close (h->wakeup_fd);
+      h->wakeup_fd = -1;
+    }
+}
+
+
+/* Wait until the owner of the lock file opened at FD releases its
+   fcntl lock.  Returns true if we waited and false if the owner does
+   not hold a fcntl lock or an error occurred.  */
+static int
+wait_for_wakeup_lock (int fd)
+{
+  struct flock fl;
+  int rc;
+
+  memset (&fl, 0, sizeof fl);
+  fl.l_type = F_RDLCK;
+  fl.l_whence = SEEK_SET;
+  if (!fcntl (fd, F_SETLK, &fl))
+    return 0;  /* The owner does not use the wakeup hint.  */
+  if (errno != EAGAIN && errno != EACCES)
+    return 0;
+
+  do
+    rc = fcntl (fd, F_SETLKW, &fl);
+  while (rc == -1 && errno == EINTR);
+
+  /* The read lock is released by the caller's close.  */
+  return !rc;
+}
+#endif /*HAVE_POSIX_SYSTEM*/
+
+
 #ifdef  HAVE_POSIX_SYSTEM
 /* Locking core for Unix.  It used a temporary file and the link
    system call to make locking an atomic operation. */
@@ -668,6 +758,7 @@ dotlock_create_unix (dotlock_t h, const char *file_to_lock)
   struct utsname utsbuf;
   size_t tnamelen;
 
+  h->wakeup_fd = -1;
   snprintf (pidstr, sizeof pidstr, "%10d\n", (int)getpid() );
 
   /* Create a temporary file. */
@@ -950,6 +1041,7 @@ dotlock_destroy_unix (dotlock_t h)
 {
   if (h->locked && h->lockname)
     unlink (h->lockname);
+  clear_wakeup_lock (h);
   if (h->tname && !h->use_o_excl)
     unlink (h->tname);
   xfree (h->tname);
@@ -1027,6 +1119,7 @@ dotlock_take_unix (dotlock_t h, long timeout)
   int same_node;
   int saveerrno;
   int fd;
+  unsigned long waitstart = 0;
 
  again:
   if (h->use_o_excl)
@@ -1062,7 +1155,7 @@ dotlock_take_unix (dotlock_t h, long timeout)
               && !close (fd))
             {
               h->locked = 1;
-              return 0;
+              goto locked;
             }
           /* Write error.  */
           saveerrno = errno;
@@ -1096,7 +1189,7 @@ dotlock_take_unix (dotlock_t h, long timeout)
       if (sb.st_nlink == 2)
         {
           h->locked = 1;
-          return 0; /* Okay.  */
+          goto locked; /* Okay.  */
         }
     }
 
@@ -1162,11 +1255,24 @@ dotlock_take_unix (dotlock_t h, long timeout)
       goto again;
     }
 
-  close (fd);
   if (lastpid == -1)
     lastpid = pid;
   ownerchanged = (pid != lastpid);
 
+  if (timeout && !waitstart)
+    waitstart = now_msec ();
+
+  /* Without a timeout block until the owner releases the lock.  */
+  if (timeout < 0)
+    {
+      if (wait_for_wakeup_lock (fd))
+        {
+          close (fd);
+          goto again;
+        }
+    }
+  close (fd);
+
   if (timeout)
     {
       struct timeval tv;
@@ -1207,6 +1313,18 @@ dotlock_take_unix (dotlock_t h, long timeout)
 
   my_set_errno (EACCES);
   return -1;
+
+ locked:
+  set_wakeup_lock (h);
+  if (waitstart)
+    {
+      unsigned long waited = now_msec () - waitstart;
+
+      if (waited >= 1500)
+        my_info_2 (_("lock '%s' acquired after %lu ms\n"),
+                   h->lockname, waited);
+    }
+  return 0;
 }
 #endif /*HAVE_POSIX_SYSTEM*/
 
@@ -1308,17 +1426,24 @@ dotlock_release_unix (dotlock_t h)
 {
   int pid, same_node;
   int saveerrno;
+  int fd = -1;
 
-  pid = read_lockfile (h, &same_node, NULL);
+  /* We keep the file open until after the unlink because closing
+     any descriptor of the file releases our fcntl lock and would thus
+     wake up waiters too early.  */
+  pid = read_lockfile (h, &same_node, &fd);
   if ( pid == -1 )
     {
       saveerrno = errno;
+      if (fd != -1)
+        close (fd);
       my_error_0 ("release_dotlock: lockfile error\n");
       my_set_errno (saveerrno);
       return -1;
     }
   if ( pid != getpid() || !same_node )
     {
+      close (fd);
       my_error_1 ("release_dotlock: not our lock (pid=%d)\n", pid);
       my_set_errno (EACCES);
       return -1;
@@ -1327,11 +1452,15 @@ dotlock_release_unix (dotlock_t h)
   if ( unlink( h->lockname ) )
     {
       saveerrno = errno;
+      close (fd);
       my_error_1 ("release_dotlock: error removing lockfile '%s'\n",
                   h->lockname);
       my_set_errno (saveerrno);
       return -1;
     }
+  /* Wake up waiting processes.  */
+  close (fd);
+  clear_wakeup_lock (h);
   /* Fixme: As an extra check we could check whether the link count is
      now really at 1. */
   return 0;
@@ -190,9 +190,35 @@ get_max_fds (void)
 void
 close_all_fds (int first, int *except)
 {
-  int max_fd = get_max_fds ();
+  int max_fd;
   int fd, i, except_start;
 
+#ifdef HAVE_CLOSE_RANGE
+  /* Close the ranges between the exceptions using one system call
+   * each.  This does not depend on the highest possible descriptor
+   * which can be very large.  If the system call is not supported by
+   * the kernel we fall back to the loop below.  */
+  {
+    int lo = first;
+
+    for (i=0; except && except[i] != -1; i++)
+      {
+        if (except[i] < lo)
+          continue;
+        if (except[i] > lo && close_range (lo, except[i] - 1, 0))
+          goto fallback;
+        lo = except[i] + 1;
+      }
+    if (!close_range (lo, ~0U, 0))
+      {
+        gpg_err_set_errno (0);
+        return;
+      }
+  }
+ fallback:
+#endif /*HAVE_CLOSE_RANGE*/
+
+  max_fd = get_max_fds ();
   if (except)
     {
       except_start = 0;
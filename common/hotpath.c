@@ -0,0 +1,104 @@
+/* hotpath.c - Optional call counters for hot code paths
+ * Copyright (C) 2026 g10 Code GmbH
+ *
+ * This file is part of GnuPG.
+ *
+ * This file is free software; you can redistribute it and/or modify
+ * it under the terms of either
+ *
+ *   - the GNU Lesser General Public License as published by the Free
+ *     Software Foundation; either version 3 of the License, or (at
+ *     your option) any later version.
+ *
+ * or
+ *
+ *   - the GNU General Public License as published by the Free
+ *     Software Foundation; either version 2 of the License, or (at
+ *     your option) any later version.
+ *
+ * or both in parallel, as here.
+ *
+ * This file is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see <https://www.gnu.org/licenses/>.
+ */
+
+/* If configured with --enable-hotpath-counters, a few functions known
+ * to dominate the run time (iobuf underflow and flush, parse_packet,
+ * keybox_search, check_signature, agent_unprotect, crl_cache_isvalid
+ * and the HTTP connect) count their calls and the ticks spent in
+ * them.  The counters are written to the log at exit and the daemons
+ * also write them on SIGUSR2.  The format of the lines is
+ *
+ *   hotpath: name=<name> calls=<n> ticks=<n> unit=<unit>
+ *
+ * sorted by name so that the output of different builds can be
+ * compared with diff.  The counters are not locked: gpg and gpgsm are
+ * single threaded and the daemons use nPth which does not preempt
+ * threads.  */
+
+#include <config.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "util.h"
+#include "hotpath.h"
+
+
+#ifdef ENABLE_HOTPATH_COUNTERS
+
+/* The list of used counters sorted by name.  */
+static struct hotpath_counter_s *counter_list;
+
+
+static void
+hotpath_atexit (void)
+{
+  hotpath_dump ();
+}
+
+
+/* Account the time since START and one call to CTR.  */
+void
+hotpath_account (struct hotpath_counter_s *ctr, unsigned long long start)
+{
+  static int atexit_registered;
+  struct hotpath_counter_s **pp;
+
+  ctr->calls++;
+  ctr->ticks += hotpath_now () - start;
+
+  if (!ctr->registered)
+    {
+      for (pp = &counter_list; *pp; pp = &(*pp)->next)
+        if (strcmp ((*pp)->name, ctr->name) > 0)
+          break;
+      ctr->next = *pp;
+      *pp = ctr;
+      ctr->registered = 1;
+      if (!atexit_registered)
+        {
+          atexit (hotpath_atexit);
+          atexit_registered = 1;
+        }
+    }
+}
+
+#endif /*ENABLE_HOTPATH_COUNTERS*/
+
+
+void
+hotpath_dump (void)
+{
+#ifdef ENABLE_HOTPATH_COUNTERS
+  struct hotpath_counter_s *ctr;
+
+  for (ctr = counter_list; ctr; ctr = ctr->next)
+    log_info ("hotpath: name=%s calls=%llu ticks=%llu unit=%s\n",
+              ctr->name, ctr->calls, ctr->ticks, HOTPATH_TICK_UNIT);
+#endif /*ENABLE_HOTPATH_COUNTERS*/
+}
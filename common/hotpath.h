@@ -0,0 +1,88 @@
+/* hotpath.h - Optional call counters for hot code paths
+ * Copyright (C) 2026 g10 Code GmbH
+ *
+ * This file is part of GnuPG.
+ *
+ * This file is free software; you can redistribute it and/or modify
+ * it under the terms of either
+ *
+ *   - the GNU Lesser General Public License as published by the Free
+ *     Software Foundation; either version 3 of the License, or (at
+ *     your option) any later version.
+ *
+ * or
+ *
+ *   - the GNU General Public License as published by the Free
+ *     Software Foundation; either version 2 of the License, or (at
+ *     your option) any later version.
+ *
+ * or both in parallel, as here.
+ *
+ * This file is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef GNUPG_COMMON_HOTPATH_H
+#define GNUPG_COMMON_HOTPATH_H
+
+#ifdef ENABLE_HOTPATH_COUNTERS
+
+#include "opstats.h"
+
+/* A counter for one hot path.  These objects are statically
+ * allocated by HOTPATH_COUNT and linked into a list on first use.  */
+struct hotpath_counter_s
+{
+  struct hotpath_counter_s *next;
+  const char *name;
+  int registered;
+  unsigned long long calls;
+  unsigned long long ticks;
+};
+
+/* Return the current value of the tick counter.  On x86 this is the
+ * cycle counter; elsewhere we fall back to microseconds.  */
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+# define HOTPATH_TICK_UNIT "cycles"
+static inline unsigned long long
+hotpath_now (void)
+{
+  return __builtin_ia32_rdtsc ();
+}
+#else
+# define HOTPATH_TICK_UNIT "usec"
+static inline unsigned long long
+hotpath_now (void)
+{
+  return opstats_now ();
+}
+#endif
+
+void hotpath_account (struct hotpath_counter_s *ctr, unsigned long long start);
+
+/* Run the statement given as second argument and account it to the
+ * counter NAME.  */
+#define HOTPATH_COUNT(name, ...)                                        \
+  do {                                                                  \
+    static struct hotpath_counter_s hotpath_ctr_ = { NULL, (name) };    \
+    unsigned long long hotpath_start_ = hotpath_now ();                 \
+    __VA_ARGS__;                                                        \
+    hotpath_account (&hotpath_ctr_, hotpath_start_);                    \
+  } while (0)
+
+#else /*!ENABLE_HOTPATH_COUNTERS*/
+
+#define HOTPATH_COUNT(name, ...)  do { __VA_ARGS__; } while (0)
+
+#endif /*!ENABLE_HOTPATH_COUNTERS*/
+
+/* Write the counters to the log.  Does nothing if the counters have
+ * not been enabled at build time.  */
+void hotpath_dump (void);
+
+#endif /*GNUPG_COMMON_HOTPATH_H*/
@@ -40,6 +40,9 @@
 #include <sys/stat.h>
 #include <fcntl.h>
 #include <unistd.h>
+#ifdef HAVE_MMAP
+# include <sys/mman.h>
+#endif
 #ifdef HAVE_W32_SYSTEM
 # ifdef HAVE_WINSOCK2_H
 #  include <winsock2.h>
@@ -56,6 +59,7 @@
 #include "util.h"
 #include "sysutils.h"
 #include "iobuf.h"
+#include "hotpath.h"
 
 /*-- Begin configurable part.  --*/
 
@@ -70,6 +74,21 @@
    instead of the internal buffers. */
 #define IOBUF_ZEROCOPY_THRESHOLD_SIZE 1024
 
+/* The maximum size to which the internal buffers of a filter are
+   grown if the filter is observed to stream large amounts of data.  */
+#define IOBUF_MAX_ADAPTIVE_BUFFER_SIZE (1024*1024)
+
+/* The number of consecutive completely filled (or flushed) buffers and
+   the minimum number of bytes a filter needs to have transferred
+   before its buffer is enlarged.  The byte limit keeps the buffers
+   small when parsing keyrings and other small files.  */
+#define IOBUF_ADAPTIVE_STREAK    4
+#define IOBUF_ADAPTIVE_MIN_BYTES (1024*1024)
+
+/* The minimum size of a regular file for IOBUF_IOCTL_MMAP to actually
+   map it.  Smaller files are cheaper to read using read(2).  */
+#define IOBUF_MMAP_THRESHOLD_SIZE (1024*1024)
+
 /*-- End configurable part.  --*/
 
 /* The size of the iobuffers.  This can be changed using the
@@ -98,6 +117,11 @@ typedef struct
   char peeked[32];     /* Read ahead buffer.  */
   byte npeeked;        /* Number of bytes valid in peeked.  */
   byte upeeked;        /* Number of bytes used from peeked.  */
+#ifdef HAVE_MMAP
+  byte *map;           /* If not NULL the file is mapped at this address.  */
+  size_t maplen;       /* Length of the mapping.  */
+  size_t mappos;       /* Offset of the next byte to return.  */
+#endif
   char fname[1];       /* Name of the file.  */
 } file_filter_ctx_t;
 
@@ -147,6 +171,11 @@ typedef struct
 #define OP_MIN_PARTIAL_CHUNK	  512
 #define OP_MIN_PARTIAL_CHUNK_2POW 9
 
+/* The largest chunk we write.  The actual chunk size is the largest
+ * power of two not exceeding the iobuf buffer size but limited to
+ * this value.  */
+#define OP_MAX_PARTIAL_CHUNK_2POW 24
+
 /* The context we use for the block filter (used to handle OpenPGP
    length information header).  */
 typedef struct
@@ -157,6 +186,8 @@ typedef struct
   int partial;	   /* 1 = partial header, 2 in last partial packet.  */
   char *buffer;	   /* Used for partial header.  */
   size_t buflen;   /* Used size of buffer.  */
+  size_t chunk;    /* The size of the chunks we write.  */
+  int chunk_2pow;  /* The same as a power of two.  */
   int first_c;	   /* First character of a partial header (which is > 0).  */
   int eof;
 }
@@ -166,6 +197,8 @@ block_filter_ctx_t;
 /* Local prototypes.  */
 static int underflow (iobuf_t a, int clear_pending_eof);
 static int underflow_target (iobuf_t a, int clear_pending_eof, size_t target);
+static int do_underflow_target (iobuf_t a, int clear_pending_eof,
+                                size_t target);
 static int translate_file_handle (int fd, int for_write);
 
 /* Sends any pending data to the filter's FILTER function.  Note: this
@@ -179,6 +212,7 @@ static int translate_file_handle (int fd, int for_write);
 
    May only be called on an IOBUF_OUTPUT or IOBUF_OUTPUT_TEMP filters.  */
 static int filter_flush (iobuf_t a);
+static int do_filter_flush (iobuf_t a);
 
 
 
@@ -483,6 +517,27 @@ file_filter (void *opaque, int control, iobuf_t chain, byte * buf,
             a->eof_seen = -1;
 	  *ret_len = 0;
         }
+#ifdef HAVE_MMAP
+      else if (a->map)
+        {
+          /* Take the data straight from the mapping; this saves one
+             read syscall per buffer.  */
+          nbytes = a->maplen - a->mappos;
+          if (!nbytes)
+            {
+              a->eof_seen = 1;
+              rc = -1;
+            }
+          else
+            {
+              if (nbytes > size)
+                nbytes = size;
+              memcpy (buf, a->map + a->mappos, nbytes);
+              a->mappos += nbytes;
+            }
+	  *ret_len = nbytes;
+        }
+#endif /*HAVE_MMAP*/
       else
 	{
 #ifdef HAVE_W32_SYSTEM
@@ -610,6 +665,11 @@ file_filter (void *opaque, int control, iobuf_t chain, byte * buf,
       a->no_cache = 0;
       a->npeeked = 0;
       a->upeeked = 0;
+#ifdef HAVE_MMAP
+      a->map = NULL;
+      a->maplen = 0;
+      a->mappos = 0;
+#endif
     }
   else if (control == IOBUFCTRL_PEEK)
     {
@@ -682,6 +742,10 @@ file_filter (void *opaque, int control, iobuf_t chain, byte * buf,
     }
   else if (control == IOBUFCTRL_FREE)
     {
+#ifdef HAVE_MMAP
+      if (a->map)
+        munmap (a->map, a->maplen);
+#endif
       if (f != FD_FOR_STDIN && f != FD_FOR_STDOUT)
 	{
 	  if (DBG_IOBUF)
@@ -1051,62 +1115,52 @@ block_filter (void *opaque, int control, iobuf_t chain, byte * buffer,
     {
       if (a->partial)
 	{			/* the complicated openpgp scheme */
-	  size_t blen, n, nbytes = size + a->buflen;
-
-	  log_assert (a->buflen <= OP_MIN_PARTIAL_CHUNK);
-	  if (nbytes < OP_MIN_PARTIAL_CHUNK)
+	  size_t blen, n;
+
+	  /* We write only chunks of at least A->CHUNK bytes so that the
+	   * reader sees a few large chunks instead of many small ones.
+	   * Less data is kept in A->BUFFER until the next flush or the
+	   * end of the packet; thus the memory use is bounded by the
+	   * chunk size.  */
+	  log_assert (a->buflen < a->chunk);
+	  p = buf;
+	  if (a->buflen && a->buflen + size >= a->chunk)
 	    {
-	      /* not enough to write a partial block out; so we store it */
-	      if (!a->buffer)
-		a->buffer = xmalloc (OP_MIN_PARTIAL_CHUNK);
-	      memcpy (a->buffer + a->buflen, buf, size);
-	      a->buflen += size;
+	      /* Complete and write the buffered chunk.  */
+	      n = a->chunk - a->buflen;
+	      memcpy (a->buffer + a->buflen, p, n);
+	      p += n;
+	      size -= n;
+	      a->buflen = 0;
+	      if (iobuf_put (chain, 0xe0 | a->chunk_2pow)
+		  || iobuf_write (chain, a->buffer, a->chunk))
+		rc = gpg_error_from_syserror ();
 	    }
-	  else
-	    {			/* okay, we can write out something */
-	      /* do this in a loop to use the most efficient block lengths */
-	      p = buf;
-	      do
+	  if (!a->buflen)
+	    {
+	      /* Write directly from BUF using the largest possible
+	       * power of two for each chunk.  */
+	      while (!rc && size >= a->chunk)
 		{
-		  /* find the best matching block length - this is limited
-		   * by the size of the internal buffering */
-		  for (blen = OP_MIN_PARTIAL_CHUNK * 2,
-		       c = OP_MIN_PARTIAL_CHUNK_2POW + 1; blen <= nbytes;
-		       blen *= 2, c++)
+		  for (blen = a->chunk, c = a->chunk_2pow;
+		       c < 30 && blen * 2 <= size; blen *= 2, c++)
 		    ;
-		  blen /= 2;
-		  c--;
-		  /* write the partial length header */
-		  log_assert (c <= 0x1f);	/*;-) */
-		  c |= 0xe0;
-		  iobuf_put (chain, c);
-		  if ((n = a->buflen))
-		    {		/* write stuff from the buffer */
-		      log_assert (n == OP_MIN_PARTIAL_CHUNK);
-		      if (iobuf_write (chain, a->buffer, n))
-			rc = gpg_error_from_syserror ();
-		      a->buflen = 0;
-		      nbytes -= n;
-		    }
-		  if ((n = nbytes) > blen)
-		    n = blen;
-		  if (n && iobuf_write (chain, p, n))
+		  if (iobuf_put (chain, 0xe0 | c)
+		      || iobuf_write (chain, p, blen))
 		    rc = gpg_error_from_syserror ();
-		  p += n;
-		  nbytes -= n;
-		}
-	      while (!rc && nbytes >= OP_MIN_PARTIAL_CHUNK);
-	      /* store the rest in the buffer */
-	      if (!rc && nbytes)
-		{
-		  log_assert (!a->buflen);
-		  log_assert (nbytes < OP_MIN_PARTIAL_CHUNK);
-		  if (!a->buffer)
-		    a->buffer = xmalloc (OP_MIN_PARTIAL_CHUNK);
-		  memcpy (a->buffer, p, nbytes);
-		  a->buflen = nbytes;
+		  p += blen;
+		  size -= blen;
 		}
 	    }
+	  /* Store the rest in the buffer.  */
+	  if (!rc && size)
+	    {
+	      log_assert (a->buflen + size < a->chunk);
+	      if (!a->buffer)
+		a->buffer = xmalloc (a->chunk);
+	      memcpy (a->buffer + a->buflen, p, size);
+	      a->buflen += size;
+	    }
 	}
       else
 	BUG ();
@@ -1124,6 +1178,15 @@ block_filter (void *opaque, int control, iobuf_t chain, byte * buffer,
       a->eof = 0;
       a->buffer = NULL;
       a->buflen = 0;
+      if (a->partial && a->use != IOBUF_INPUT)
+        {
+          for (a->chunk = OP_MIN_PARTIAL_CHUNK,
+                 a->chunk_2pow = OP_MIN_PARTIAL_CHUNK_2POW;
+               (a->chunk_2pow < OP_MAX_PARTIAL_CHUNK_2POW
+                && a->chunk * 2 <= iobuf_buffer_size);
+               a->chunk *= 2, a->chunk_2pow++)
+            ;
+        }
     }
   else if (control == IOBUFCTRL_DESC)
     {
@@ -1256,6 +1319,74 @@ iobuf_print_chain (iobuf_t a)
   return 0;
 }
 
+
+/* Print the statistics of filter A.  Must be called before the filter
+ * has been freed.  */
+static void
+print_filter_stats (iobuf_t a)
+{
+  byte desc[MAX_IOBUF_DESC];
+
+  if (!DBG_IOBUF || !a->stats.ncalls)
+    return;
+
+  log_debug ("iobuf-%d.%d: '%s' %lu calls for %llu bytes"
+             " (%llu calls per MiB) buffer size %lu\n",
+             a->no, a->subno, iobuf_desc (a, desc), a->stats.ncalls,
+             (unsigned long long)a->stats.nbytes,
+             (unsigned long long)(a->stats.nbytes
+                                  ? ((uint64_t)a->stats.ncalls * 1024 * 1024
+                                     + a->stats.nbytes - 1) / a->stats.nbytes
+                                  : 0),
+             (ulong)a->d.size);
+}
+
+
+/* Update the statistics of A after a call to its filter which
+ * transferred NBYTES out of SIZE possible bytes.  If the filter
+ * repeatedly fills or flushes the entire buffer and has already
+ * transferred a good amount of bytes, the buffer is doubled up to
+ * IOBUF_MAX_ADAPTIVE_BUFFER_SIZE.  The buffer is enlarged only if it
+ * holds no more than D.LEN bytes of data.  */
+static void
+update_filter_stats (iobuf_t a, size_t nbytes, size_t size)
+{
+  size_t newsize;
+  byte *newbuf;
+
+  a->stats.ncalls++;
+  a->stats.nbytes += nbytes;
+  if (size != a->d.size || nbytes != size)
+    {
+      a->stats.streak = 0;
+      return;
+    }
+
+  if (++a->stats.streak < IOBUF_ADAPTIVE_STREAK
+      || a->stats.nbytes < IOBUF_ADAPTIVE_MIN_BYTES
+      || a->d.size >= IOBUF_MAX_ADAPTIVE_BUFFER_SIZE)
+    return;
+
+  newsize = a->d.size * 2;
+  if (newsize > IOBUF_MAX_ADAPTIVE_BUFFER_SIZE)
+    newsize = IOBUF_MAX_ADAPTIVE_BUFFER_SIZE;
+  newbuf = xtrymalloc (newsize);
+  if (!newbuf)
+    return;  /* Not fatal - we just keep on using the current buffer.  */
+
+  if (DBG_IOBUF)
+    log_debug ("iobuf-%d.%d: increasing buffer from %lu to %lu\n",
+               a->no, a->subno, (ulong)a->d.size, (ulong)newsize);
+
+  /* Do not use realloc so that we can wipe the old buffer.  */
+  memcpy (newbuf, a->d.buf, a->d.len);
+  wipememory (a->d.buf, a->d.size);
+  xfree (a->d.buf);
+  a->d.buf = newbuf;
+  a->d.size = newsize;
+  a->stats.streak = 0;
+}
+
 iobuf_t
 iobuf_alloc (int use, size_t bufsize)
 {
@@ -1304,6 +1435,8 @@ iobuf_close (iobuf_t a)
       if (DBG_IOBUF)
 	log_debug ("iobuf-%d.%d: close '%s'\n",
 		   a->no, a->subno, iobuf_desc (a, desc));
+      if (a->filter)
+        print_filter_stats (a);
 
       if (a->filter && (rc2 = a->filter (a->filter_ov, IOBUFCTRL_FREE,
 					 a->chain, NULL, &dummy_len)))
@@ -1376,6 +1509,23 @@ iobuf_temp (void)
   return iobuf_alloc (IOBUF_OUTPUT_TEMP, iobuf_buffer_size);
 }
 
+void
+iobuf_temp_reset (iobuf_t a, size_t size)
+{
+  log_assert (a->use == IOBUF_OUTPUT_TEMP && !a->chain);
+
+  wipememory (a->d.buf, a->d.len);
+  if (size > a->d.size)
+    {
+      xfree (a->d.buf);
+      a->d.buf = xmalloc (size);
+      a->d.size = size;
+    }
+  a->d.len = 0;
+  a->d.start = 0;
+  a->error = 0;
+}
+
 iobuf_t
 iobuf_temp_with_content (const char *buffer, size_t length)
 {
@@ -1674,6 +1824,56 @@ iobuf_ioctl (iobuf_t a, iobuf_ioctl_t cmd, int intval, void *ptrval)
             return (int)len;
         }
     }
+  else if (cmd == IOBUF_IOCTL_MMAP)
+    {
+      /* Map a just opened regular file into memory so that the file
+       * filter can take the data from there instead of calling read.
+       * Use this only directly after the file has been opened for
+       * reading and only if the file is not expected to be truncated
+       * while we are reading it.  This works only if just the file
+       * filter has been pushed.  Returns 0 if the file has been
+       * mapped and -1 if the standard read method will be used.  */
+      if (DBG_IOBUF)
+	log_debug ("iobuf-%d.%d: ioctl '%s' mmap=%d\n",
+		   a ? a->no : -1, a ? a->subno : -1, iobuf_desc (a, desc),
+                   intval);
+#ifdef HAVE_MMAP
+      if (a && intval && a->use == IOBUF_INPUT && a->filter == file_filter
+          && !a->chain)
+        {
+          file_filter_ctx_t *fcx = a->filter_ov;
+          struct stat st;
+          off_t pos;
+          void *map;
+
+          if (fcx->map)
+            return 0;  /* Already mapped.  */
+          if (fcx->print_only_name || fcx->eof_seen || fcx->delayed_rc
+              || fstat (fcx->fp, &st) || !S_ISREG (st.st_mode)
+              || st.st_size < IOBUF_MMAP_THRESHOLD_SIZE
+              || (uint64_t)st.st_size > (size_t)(-1))
+            return -1;
+          pos = lseek (fcx->fp, 0, SEEK_CUR);
+          if (pos == (off_t)(-1) || pos > st.st_size)
+            return -1;
+          map = mmap (NULL, st.st_size, PROT_READ, MAP_PRIVATE, fcx->fp, 0);
+          if (map == MAP_FAILED)
+            {
+              if (DBG_IOBUF)
+                log_debug ("%s: mmap failed: %s\n",
+                           fcx->fname, strerror (errno));
+              return -1;
+            }
+#ifdef MADV_SEQUENTIAL
+          madvise (map, st.st_size, MADV_SEQUENTIAL);
+#endif
+          fcx->map = map;
+          fcx->maplen = st.st_size;
+          fcx->mappos = pos;
+          return 0;
+        }
+#endif /*HAVE_MMAP*/
+    }
 
 
   return -1;
@@ -1767,6 +1967,7 @@ iobuf_push_filter2 (iobuf_t a,
   a->filter_ov = NULL;
   a->filter_ov_owner = 0;
   a->filter_eof = 0;
+  memset (&a->stats, 0, sizeof a->stats);
   if (a->use == IOBUF_OUTPUT_TEMP)
     /* A TEMP filter buffers any data sent to it; it does not forward
        any data down the pipeline.  If we add a new filter to the
@@ -1939,6 +2140,17 @@ underflow (iobuf_t a, int clear_pending_eof)
  */
 static int
 underflow_target (iobuf_t a, int clear_pending_eof, size_t target)
+{
+  int rc;
+
+  HOTPATH_COUNT ("iobuf_underflow",
+                 rc = do_underflow_target (a, clear_pending_eof, target));
+  return rc;
+}
+
+
+static int
+do_underflow_target (iobuf_t a, int clear_pending_eof, size_t target)
 {
   size_t len;
   int rc;
@@ -2013,6 +2225,8 @@ underflow_target (iobuf_t a, int clear_pending_eof, size_t target)
     /* We have a filter function and the last time we tried to read we
        didn't get an EOF or an error.  Try to fill the buffer.  */
     {
+      size_t fillsize = 0;
+
       /* Be careful to account for any buffered data.  */
       len = a->d.size - a->d.len;
 
@@ -2045,6 +2259,8 @@ underflow_target (iobuf_t a, int clear_pending_eof, size_t target)
 
 	    rc = a->filter (a->filter_ov, IOBUFCTRL_UNDERFLOW, a->chain,
 			    a->e_d.buf, &len);
+	    a->stats.ncalls++;
+	    a->stats.nbytes += len;
 	    a->e_d.used = len;
 	    len = 0;
 	  }
@@ -2054,11 +2270,14 @@ underflow_target (iobuf_t a, int clear_pending_eof, size_t target)
 	      log_debug ("iobuf-%d.%d: underflow: A->FILTER (%lu bytes)\n",
 			 a->no, a->subno, (ulong)len);
 
+	    fillsize = len;
 	    rc = a->filter (a->filter_ov, IOBUFCTRL_UNDERFLOW, a->chain,
 			    &a->d.buf[a->d.len], &len);
 	  }
       }
       a->d.len += len;
+      if (fillsize)
+        update_filter_stats (a, len, fillsize);
 
       if (DBG_IOBUF)
 	log_debug ("iobuf-%d.%d: A->FILTER() returned rc=%d (%s), read %lu bytes%s\n",
@@ -2074,6 +2293,7 @@ underflow_target (iobuf_t a, int clear_pending_eof, size_t target)
 	{
 	  size_t dummy_len = 0;
 
+	  print_filter_stats (a);
 	  /* Tell the filter to free itself */
 	  if ((rc = a->filter (a->filter_ov, IOBUFCTRL_FREE, a->chain,
 			       NULL, &dummy_len)))
@@ -2138,6 +2358,16 @@ underflow_target (iobuf_t a, int clear_pending_eof, size_t target)
 
 static int
 filter_flush (iobuf_t a)
+{
+  int rc;
+
+  HOTPATH_COUNT ("iobuf_filter_flush", rc = do_filter_flush (a));
+  return rc;
+}
+
+
+static int
+do_filter_flush (iobuf_t a)
 {
   int external_used = 0;
   byte *src_buf;
@@ -2188,7 +2418,13 @@ filter_flush (iobuf_t a)
     a->error = rc;
   a->d.len = 0;
   if (external_used)
-    a->e_d.used = len;
+    {
+      a->e_d.used = len;
+      a->stats.ncalls++;
+      a->stats.nbytes += len;
+    }
+  else if (!rc)
+    update_filter_stats (a, len, a->d.size);
 
   return rc;
 }
@@ -2336,6 +2572,81 @@ iobuf_read (iobuf_t a, void *buffer, unsigned int buflen)
 }
 
 
+gpg_error_t
+iobuf_read_direct (iobuf_t a, uint64_t maxlen,
+                   gpg_error_t (*writer)(void *opaque,
+                                         const void *buf, size_t buflen),
+                   void *opaque, uint64_t *r_nread)
+{
+  gpg_error_t err = 0;
+  uint64_t total = 0;
+  size_t n;
+
+  *r_nread = 0;
+
+  if (a->use == IOBUF_OUTPUT || a->use == IOBUF_OUTPUT_TEMP)
+    {
+      log_bug ("iobuf_read_direct called on a non-INPUT pipeline!\n");
+      return gpg_error (GPG_ERR_INTERNAL);
+    }
+
+  if (a->nlimit)
+    {
+      /* The limit is handled by iobuf_read; thus use a copy.  */
+      byte buffer[4096];
+      int nread;
+
+      while (!maxlen || total < maxlen)
+        {
+          n = sizeof buffer;
+          if (maxlen && maxlen - total < n)
+            n = maxlen - total;
+          nread = iobuf_read (a, buffer, n);
+          if (nread == -1)
+            break;
+          total += nread;
+          err = writer (opaque, buffer, nread);
+          if (err)
+            break;
+        }
+      *r_nread = total;
+      return err;
+    }
+
+  a->e_d.buf = NULL;
+  a->e_d.len = 0;
+  a->e_d.preferred = 0;
+
+  while (!maxlen || total < maxlen)
+    {
+      if (a->d.start >= a->d.len)
+        {
+          /* Let the filter fill our internal buffer.  This consumes
+           * exactly one EOF.  */
+          if (underflow (a, 1) == -1)
+            break;
+          /* Underflow consumes the first character (it's the return
+           * value).  unget() it by resetting the "file position".  */
+          log_assert (a->d.start == 1);
+          a->d.start = 0;
+        }
+
+      n = a->d.len - a->d.start;
+      if (maxlen && maxlen - total < n)
+        n = maxlen - total;
+      err = writer (opaque, a->d.buf + a->d.start, n);
+      if (err)
+        break;
+      a->d.start += n;
+      a->nbytes += n;
+      total += n;
+    }
+
+  *r_nread = total;
+  return err;
+}
+
+
 
 int
 iobuf_peek (iobuf_t a, byte * buf, unsigned buflen)
@@ -2757,6 +3068,10 @@ iobuf_seek (iobuf_t a, off_t newpos)
 	  log_error ("can't lseek: %s\n", strerror (errno));
 	  return -1;
 	}
+#endif
+#ifdef HAVE_MMAP
+      if (b->map)
+        b->mappos = (uint64_t)newpos < b->maplen? newpos : b->maplen;
 #endif
       /* Discard the buffer it is not a temp stream.  */
       a->d.len = 0;
@@ -2767,6 +3082,7 @@ iobuf_seek (iobuf_t a, off_t newpos)
   a->nofast = 0;
   a->ntotal = newpos;
   a->error = 0;
+  a->stats.streak = 0;  /* Random access: Do not grow the buffer.  */
 
   /* It is impossible for A->CHAIN to be non-NULL.  If A is an INPUT
      or OUTPUT buffer, then we find the last filter, which is defined
@@ -118,7 +118,8 @@ typedef enum
     IOBUF_IOCTL_INVALIDATE_CACHE = 2, /* Uses ptrval.  */
     IOBUF_IOCTL_NO_CACHE         = 3, /* Uses intval.  */
     IOBUF_IOCTL_FSYNC            = 4, /* Uses ptrval.  */
-    IOBUF_IOCTL_PEEK             = 5  /* Uses intval and ptrval.  */
+    IOBUF_IOCTL_PEEK             = 5, /* Uses intval and ptrval.  */
+    IOBUF_IOCTL_MMAP             = 6  /* Uses intval.  */
   } iobuf_ioctl_t;
 
 enum iobuf_use
@@ -247,6 +248,19 @@ struct iobuf_struct
      filter.  */
   int filter_ov_owner;
 
+  /* Statistics about the calls to FILTER.  These are also used to
+     adapt the size of the buffer D to the observed access pattern.  */
+  struct
+  {
+    /* The number of underflow or flush calls to FILTER.  */
+    unsigned long ncalls;
+    /* The number of bytes transferred by these calls.  */
+    uint64_t nbytes;
+    /* The number of consecutive calls which filled or flushed the
+       entire buffer.  */
+    unsigned int streak;
+  } stats;
+
   /* When using iobuf_open, iobuf_create, iobuf_openrw to open a file,
      the file's name is saved here.  This is used to delete the file
      when an output pipeline (IOBUF_OUPUT) is canceled
@@ -306,6 +320,11 @@ iobuf_t iobuf_alloc (int use, size_t bufsize);
    iobuf_temp_to_buffer().  */
 iobuf_t iobuf_temp (void);
 
+/* Truncate the temp iobuf A (as created by iobuf_temp) so that it can
+   be reused and make sure that its buffer can hold at least SIZE
+   bytes without being enlarged.  */
+void iobuf_temp_reset (iobuf_t a, size_t size);
+
 /* Create an input filter that contains some data for reading.  */
 iobuf_t iobuf_temp_with_content (const char *buffer, size_t length);
 
@@ -508,6 +527,21 @@ int iobuf_readbyte (iobuf_t a);
    bytes read.  */
 int iobuf_read (iobuf_t a, void *buf, unsigned buflen);
 
+/* Read up to MAXLEN bytes from pipeline A and pass them to WRITER.
+   If MAXLEN is 0 everything up to the next EOF is read.  In contrast
+   to iobuf_read the data is handed over directly from the internal
+   buffer of the pipeline and thus a separate buffer and a copy of the
+   data is not required.  WRITER is called with OPAQUE, a pointer to
+   the data and its length and shall return 0 on success or an error
+   code which stops the reading.  The number of bytes passed to
+   WRITER is stored at R_NREAD.  Returns 0 on success or EOF, or the
+   error code returned by WRITER.  */
+gpg_error_t iobuf_read_direct (iobuf_t a, uint64_t maxlen,
+                               gpg_error_t (*writer)(void *opaque,
+                                                     const void *buf,
+                                                     size_t buflen),
+                               void *opaque, uint64_t *r_nread);
+
 /* Read a line of input (including the '\n') from the pipeline.
 
    The semantics are the same as for fgets(), but if the buffer is too
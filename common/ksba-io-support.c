@@ -191,6 +191,23 @@ base64_reader_cb (void *cb_value, char *buffer, size_t count, size_t *nread)
   if (!buffer)
     return -1; /* not supported */
 
+  /* Once we know that the input is DER encoded there is no need to
+     go through the line buffer; read directly into the caller's
+     buffer.  */
+  if (count && parm->identified && !parm->is_pem && !parm->is_base64
+      && !parm->linelen)
+    {
+      if (es_read (parm->fp, buffer, count, &n))
+        return -1;
+      if (!n)
+        {
+          parm->eof_seen = 1;
+          return -1; /* eof */
+        }
+      *nread = n;
+      return 0;
+    }
+
  next:
   if (!parm->linelen)
     {
@@ -330,6 +347,28 @@ base64_reader_cb (void *cb_value, char *buffer, size_t count, size_t *nread)
 
           while (n < count && parm->readpos < parm->linelen )
             {
+              /* Fast path: Decode a complete group of 4 characters
+                 at once.  Anything special like white space, padding
+                 or the END line is handled by the code below.  */
+              if (!idx && n + 3 <= count
+                  && parm->readpos + 4 <= parm->linelen)
+                {
+                  const unsigned char *s = parm->line + parm->readpos;
+                  unsigned char q0 = asctobin[s[0]];
+                  unsigned char q1 = asctobin[s[1]];
+                  unsigned char q2 = asctobin[s[2]];
+                  unsigned char q3 = asctobin[s[3]];
+
+                  if ((q0 | q1 | q2 | q3) < 64)
+                    {
+                      buffer[n++] = (q0 << 2) | (q1 >> 4);
+                      buffer[n++] = (q1 << 4) | (q2 >> 2);
+                      buffer[n++] = (q2 << 6) | q3;
+                      parm->readpos += 4;
+                      continue;
+                    }
+                }
+
               c = parm->line[parm->readpos++];
               if (c == '\n' || c == ' ' || c == '\r' || c == '\t')
                 continue;
@@ -485,6 +524,29 @@ simple_reader_cb (void *cb_value, char *buffer, size_t count, size_t *nread)
         }
     }
 
+  /* Fast path: Read as much as possible in one go as long as we do
+     not hit the limit.  The limit itself is handled by the loop
+     below.  */
+  if (count && !parm->nzeroes && !(parm->use_maxread && parm->maxread < 2))
+    {
+      n = count;
+      if (parm->use_maxread && n > parm->maxread - 1)
+        n = parm->maxread - 1;
+      if (es_read (parm->fp, buffer, n, &n))
+        {
+          parm->eof_seen = 1;
+          return -1;
+        }
+      if (!n)
+        {
+          parm->eof_seen = 1;
+          return -1;
+        }
+      if (parm->use_maxread)
+        parm->maxread -= n;
+      goto leave;
+    }
+
   for (n=0; n < count; n++)
     {
       if (parm->use_maxread && !--parm->maxread)
@@ -87,6 +87,57 @@ clear_membuf (membuf_t *mb, size_t amount)
 }
 
 
+/* Make sure that at least NEEDED more bytes fit into MB.  The buffer
+   is grown geometrically so that appending many small pieces does not
+   lead to a quadratic number of copies.  Buffers in secure memory are
+   grown only by what is needed plus a small chunk to save space in
+   the limited secure memory pool.  */
+static void
+grow_membuf (membuf_t *mb, size_t needed)
+{
+  size_t newsize;
+  char *p;
+
+  if (mb->out_of_core || mb->len + needed < mb->size)
+    return;
+
+  newsize = mb->len + needed + 1024;
+  if (!gcry_is_secure (mb->buf) && newsize < 2 * mb->size)
+    newsize = 2 * mb->size;
+  if (newsize < mb->len + needed)
+    {
+      /* Overflow.  */
+      mb->out_of_core = ENOMEM;
+      wipememory (mb->buf, mb->len);
+      return;
+    }
+
+  p = xtryrealloc (mb->buf, newsize);
+  if (!p)
+    {
+      mb->out_of_core = errno ? errno : ENOMEM;
+      /* Wipe out what we already accumulated.  This is required
+         in case we are storing sensitive data here.  The membuf
+         API does not provide another way to cleanup after an
+         error. */
+      wipememory (mb->buf, mb->len);
+      return;
+    }
+  mb->buf = p;
+  mb->size = newsize;
+}
+
+
+/* Tell MB that another AMOUNT bytes are expected.  This may be used
+   if the final size is known after init_membuf to allocate the space
+   at once.  */
+void
+reserve_membuf (membuf_t *mb, size_t amount)
+{
+  grow_membuf (mb, amount);
+}
+
+
 void
 put_membuf (membuf_t *mb, const void *buf, size_t len)
 {
@@ -95,21 +146,9 @@ put_membuf (membuf_t *mb, const void *buf, size_t len)
 
   if (mb->len + len >= mb->size)
     {
-      char *p;
-
-      mb->size += len + 1024;
-      p = xtryrealloc (mb->buf, mb->size);
-      if (!p)
-        {
-          mb->out_of_core = errno ? errno : ENOMEM;
-          /* Wipe out what we already accumulated.  This is required
-             in case we are storing sensitive data here.  The membuf
-             API does not provide another way to cleanup after an
-             error. */
-          wipememory (mb->buf, mb->len);
-          return;
-        }
-      mb->buf = p;
+      grow_membuf (mb, len);
+      if (mb->out_of_core)
+        return;
     }
   if (buf)
     memcpy (mb->buf + mb->len, buf, len);
@@ -187,20 +226,23 @@ get_membuf (membuf_t *mb, size_t *len)
 
 
 /* Same as get_membuf but shrinks the reallocated space to the
-   required size.  */
+   required size.  Because the buffer grows geometrically the slack
+   may be large; if it is small we save the realloc and hand back the
+   buffer as is.  */
 void *
 get_membuf_shrink (membuf_t *mb, size_t *len)
 {
   void *p, *pp;
-  size_t dummylen;
+  size_t dummylen, slack;
 
   if (!len)
     len = &dummylen;
 
+  slack = mb->size - mb->len;
   p = get_membuf (mb, len);
   if (!p)
     return NULL;
-  if (*len)
+  if (*len && slack > 1024 && slack > *len / 8)
     {
       pp = xtryrealloc (p, *len);
       if (pp)
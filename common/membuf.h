@@ -52,6 +52,7 @@ typedef struct private_membuf_s membuf_t;
 void init_membuf (membuf_t *mb, int initiallen);
 void init_membuf_secure (membuf_t *mb, int initiallen);
 void clear_membuf (membuf_t *mb, size_t amount);
+void reserve_membuf (membuf_t *mb, size_t amount);
 void put_membuf  (membuf_t *mb, const void *buf, size_t len);
 gpg_error_t put_membuf_cb (void *opaque, const void *buf, size_t len);
 void put_membuf_str (membuf_t *mb, const char *string);
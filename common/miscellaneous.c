@@ -189,6 +189,14 @@ do_print_utf8_buffer (estream_t stream,
   const char *p = buffer;
   size_t i;
 
+  /* Most strings do not need any quoting or conversion at all.  */
+  if (is_plain_utf8_buffer (p, length, delimiters))
+    {
+      if (bytes_written)
+        *bytes_written = length;
+      return es_write (stream, p, length, NULL);
+    }
+
   /* We can handle plain ascii simpler, so check for it first. */
   for (i=0; i < length; i++ )
     {
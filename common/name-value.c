@@ -719,6 +719,30 @@ nvc_set_private_key (nvc_t pk, gcry_sexp_t sexp)
 
 /* Parsing and serialization.  */
 
+/* Append STRING to the list at *LIST whose last item is at *TAIL.
+ * This is the same as append_to_strlist_try but does not need to
+ * walk the list; values of private keys may span many lines.  */
+static strlist_t
+append_raw_line (strlist_t *list, strlist_t *tail, const char *string)
+{
+  strlist_t sl;
+
+  sl = xtrymalloc (sizeof *sl + strlen (string));
+  if (!sl)
+    return NULL;
+
+  sl->flags = 0;
+  strcpy (sl->d, string);
+  sl->next = NULL;
+  if (!*list)
+    *list = sl;
+  else
+    (*tail)->next = sl;
+  *tail = sl;
+  return sl;
+}
+
+
 static gpg_error_t
 do_nvc_parse (nvc_t *result, int *errlinep, estream_t stream,
               int for_private_key)
@@ -729,6 +753,7 @@ do_nvc_parse (nvc_t *result, int *errlinep, estream_t stream,
   size_t buf_len = 0;
   char *name = NULL;
   strlist_t raw_value = NULL;
+  strlist_t raw_tail = NULL;
 
   *result = for_private_key? nvc_new_private_key () : nvc_new ();
   if (*result == NULL)
@@ -749,7 +774,7 @@ do_nvc_parse (nvc_t *result, int *errlinep, estream_t stream,
       if (name && (spacep (buf) || *p == 0))
 	{
 	  /* A continuation.  */
-	  if (append_to_strlist_try (&raw_value, buf) == NULL)
+	  if (append_raw_line (&raw_value, &raw_tail, buf) == NULL)
 	    {
 	      err = my_error_from_syserror ();
 	      goto leave;
@@ -762,6 +787,7 @@ do_nvc_parse (nvc_t *result, int *errlinep, estream_t stream,
 	{
 	  err = _nvc_add (*result, name, NULL, raw_value, 1);
           name = NULL;
+          raw_value = NULL;
 	  if (err)
 	    goto leave;
 	}
@@ -793,7 +819,7 @@ do_nvc_parse (nvc_t *result, int *errlinep, estream_t stream,
 	      goto leave;
 	    }
 
-	  if (append_to_strlist_try (&raw_value, value) == NULL)
+	  if (append_raw_line (&raw_value, &raw_tail, value) == NULL)
 	    {
 	      err = my_error_from_syserror ();
 	      goto leave;
@@ -801,7 +827,7 @@ do_nvc_parse (nvc_t *result, int *errlinep, estream_t stream,
 	  continue;
 	}
 
-      if (append_to_strlist_try (&raw_value, buf) == NULL)
+      if (append_raw_line (&raw_value, &raw_tail, buf) == NULL)
 	{
 	  err = my_error_from_syserror ();
 	  goto leave;
@@ -818,10 +844,14 @@ do_nvc_parse (nvc_t *result, int *errlinep, estream_t stream,
     {
       err = _nvc_add (*result, name, NULL, raw_value, 1);
       name = NULL;
+      raw_value = NULL;
     }
 
  leave:
   xfree (name);
+  free_strlist_wipe (raw_value);
+  if (buf && for_private_key)
+    wipememory (buf, buf_len);
   gpgrt_free (buf);
   if (err)
     {
@@ -0,0 +1,185 @@
+/* opstats.c - Per-command counters and latency histograms
+ * Copyright (C) 2026 g10 Code GmbH
+ *
+ * This file is part of GnuPG.
+ *
+ * This file is free software; you can redistribute it and/or modify
+ * it under the terms of either
+ *
+ *   - the GNU Lesser General Public License as published by the Free
+ *     Software Foundation; either version 3 of the License, or (at
+ *     your option) any later version.
+ *
+ * or
+ *
+ *   - the GNU General Public License as published by the Free
+ *     Software Foundation; either version 2 of the License, or (at
+ *     your option) any later version.
+ *
+ * or both in parallel, as here.
+ *
+ * This file is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see <https://www.gnu.org/licenses/>.
+ */
+
+/* The daemons call opstats_record after each Assuan command (and
+ * scdaemon also for each APDU) and return the table via "GETINFO
+ * stats".  The daemons use nPth which does not preempt threads, thus
+ * no locking is required as long as this code does not yield.  */
+
+#include <config.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#ifdef HAVE_SYS_TIME_H
+# include <sys/time.h>
+#endif
+
+#include "util.h"
+#include "membuf.h"
+#include "opstats.h"
+
+
+/* The upper bounds of the histogram buckets in microseconds.  An
+ * implicit last bucket takes all larger values.  */
+static const unsigned long bucket_bounds[] =
+  { 1000, 5000, 10000, 50000, 100000, 500000, 1000000, 5000000 };
+#define NBUCKETS (DIM (bucket_bounds) + 1)
+
+/* The maximum number of distinct operations we track.  This is
+ * larger than the number of commands of any of our servers.  */
+#define MAX_OPS 64
+
+struct opstat_s
+{
+  char name[32];
+  unsigned long count;
+  unsigned long errors;
+  unsigned long long sum;   /* Total time in microseconds.  */
+  unsigned long buckets[NBUCKETS];
+};
+
+static struct opstat_s opstats_table[MAX_OPS];
+static int opstats_used;
+
+
+
+unsigned long long
+opstats_now (void)
+{
+#if defined(HAVE_CLOCK_GETTIME) && defined(CLOCK_MONOTONIC)
+  struct timespec ts;
+
+  if (!clock_gettime (CLOCK_MONOTONIC, &ts))
+    return (unsigned long long)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+#endif
+  {
+    struct timeval tv;
+
+    gettimeofday (&tv, NULL);
+    return (unsigned long long)tv.tv_sec * 1000000 + tv.tv_usec;
+  }
+}
+
+
+void
+opstats_record (const char *name, unsigned long long start, gpg_error_t err)
+{
+  struct opstat_s *op;
+  unsigned long long elapsed, now;
+  int i;
+
+  if (!name || !*name)
+    return;
+
+  for (i=0; i < opstats_used; i++)
+    if (!strcmp (opstats_table[i].name, name))
+      break;
+  if (i == opstats_used)
+    {
+      if (opstats_used == MAX_OPS || strlen (name) >= sizeof op->name)
+        return;  /* Table full or name too long - ignore.  */
+      strcpy (opstats_table[i].name, name);
+      opstats_used++;
+    }
+  op = opstats_table + i;
+
+  now = opstats_now ();
+  elapsed = now > start? now - start : 0;
+
+  op->count++;
+  if (err)
+    op->errors++;
+  op->sum += elapsed;
+  for (i=0; i < DIM (bucket_bounds); i++)
+    if (elapsed <= bucket_bounds[i])
+      break;
+  op->buckets[i]++;
+}
+
+
+char *
+opstats_format (const char *daemon)
+{
+  membuf_t mb;
+  struct opstat_s *op;
+  unsigned long cumulated;
+  int i, b;
+
+  init_membuf (&mb, 4096);
+
+  put_membuf_str (&mb,
+                  "# HELP gnupg_command_duration_seconds"
+                  " Time spent in a command.\n"
+                  "# TYPE gnupg_command_duration_seconds histogram\n");
+  for (i=0; i < opstats_used; i++)
+    {
+      op = opstats_table + i;
+      cumulated = 0;
+      for (b=0; b < NBUCKETS; b++)
+        {
+          cumulated += op->buckets[b];
+          if (b < DIM (bucket_bounds))
+            put_membuf_printf (&mb,
+                               "gnupg_command_duration_seconds_bucket"
+                               "{daemon=\"%s\",command=\"%s\",le=\"%g\"}"
+                               " %lu\n",
+                               daemon, op->name,
+                               bucket_bounds[b] / 1000000.0, cumulated);
+          else
+            put_membuf_printf (&mb,
+                               "gnupg_command_duration_seconds_bucket"
+                               "{daemon=\"%s\",command=\"%s\",le=\"+Inf\"}"
+                               " %lu\n",
+                               daemon, op->name, cumulated);
+        }
+      put_membuf_printf (&mb,
+                         "gnupg_command_duration_seconds_sum"
+                         "{daemon=\"%s\",command=\"%s\"} %.6f\n"
+                         "gnupg_command_duration_seconds_count"
+                         "{daemon=\"%s\",command=\"%s\"} %lu\n",
+                         daemon, op->name, op->sum / 1000000.0,
+                         daemon, op->name, op->count);
+    }
+
+  put_membuf_str (&mb,
+                  "# HELP gnupg_command_errors_total"
+                  " Number of commands which returned an error.\n"
+                  "# TYPE gnupg_command_errors_total counter\n");
+  for (i=0; i < opstats_used; i++)
+    {
+      op = opstats_table + i;
+      put_membuf_printf (&mb,
+                         "gnupg_command_errors_total"
+                         "{daemon=\"%s\",command=\"%s\"} %lu\n",
+                         daemon, op->name, op->errors);
+    }
+
+  put_membuf (&mb, "", 1);
+  return get_membuf (&mb, NULL);
+}
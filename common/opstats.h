@@ -0,0 +1,47 @@
+/* opstats.h - Per-command counters and latency histograms
+ * Copyright (C) 2026 g10 Code GmbH
+ *
+ * This file is part of GnuPG.
+ *
+ * This file is free software; you can redistribute it and/or modify
+ * it under the terms of either
+ *
+ *   - the GNU Lesser General Public License as published by the Free
+ *     Software Foundation; either version 3 of the License, or (at
+ *     your option) any later version.
+ *
+ * or
+ *
+ *   - the GNU General Public License as published by the Free
+ *     Software Foundation; either version 2 of the License, or (at
+ *     your option) any later version.
+ *
+ * or both in parallel, as here.
+ *
+ * This file is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef GNUPG_COMMON_OPSTATS_H
+#define GNUPG_COMMON_OPSTATS_H
+
+/* Return a timestamp in microseconds to be passed to opstats_record.
+ * The value has no defined epoch.  */
+unsigned long long opstats_now (void);
+
+/* Record one operation NAME which was started at START (a value from
+ * opstats_now) and finished with error code ERR.  */
+void opstats_record (const char *name, unsigned long long start,
+                     gpg_error_t err);
+
+/* Return the collected statistics in the Prometheus text format.
+ * DAEMON is used as value of the "daemon" label.  The caller must
+ * xfree the result.  Returns NULL on malloc failure.  */
+char *opstats_format (const char *daemon);
+
+#endif /*GNUPG_COMMON_OPSTATS_H*/
@@ -29,6 +29,7 @@
 
 #include <config.h>
 #include <stdlib.h>
+#include <string.h>
 #include <errno.h>
 #include <ctype.h>
 #include <assert.h>
@@ -170,6 +171,74 @@ percent_data_escape (int plus_escape, const char *prefix,
 }
 
 
+/* Return the number of leading bytes of (DATA,DATALEN) which may be
+ * put into an Assuan data line without escaping; that is all bytes
+ * except for '%', CR and LF.  The scan is done a machine word at a
+ * time using the usual "has zero byte" trick.  */
+static size_t
+dline_plain_span (const unsigned char *data, size_t datalen)
+{
+  const unsigned long ones = (unsigned long)-1 / 0xff;
+  const unsigned long highs = ones * 0x80;
+  unsigned long w, a, b, c;
+  size_t n = 0;
+
+  for (; n + sizeof w <= datalen; n += sizeof w)
+    {
+      memcpy (&w, data + n, sizeof w);
+      a = w ^ (ones * '%');
+      b = w ^ (ones * '\r');
+      c = w ^ (ones * '\n');
+      if ((((a - ones) & ~a) | ((b - ones) & ~b) | ((c - ones) & ~c)) & highs)
+        break;
+    }
+  for (; n < datalen; n++)
+    if (data[n] == '%' || data[n] == '\r' || data[n] == '\n')
+      break;
+
+  return n;
+}
+
+
+/* Escape (DATA,DATALEN) for use in an Assuan data line and store the
+ * result at BUFFER which has room for BUFSIZE bytes.  Only '%', CR
+ * and LF are escaped and an escape sequence is never split.  The
+ * number of consumed bytes of DATA is stored at R_NREAD and the
+ * number of bytes written to BUFFER is returned.  BUFFER will not be
+ * Nul terminated.  */
+size_t
+percent_dline_escape (char *buffer, size_t bufsize,
+                      const void *data, size_t datalen, size_t *r_nread)
+{
+  static const char hexdigits[] = "0123456789ABCDEF";
+  const unsigned char *s = data;
+  size_t nread = 0;
+  size_t nout = 0;
+  size_t n;
+
+  while (nread < datalen && nout < bufsize)
+    {
+      n = datalen - nread;
+      if (n > bufsize - nout)
+        n = bufsize - nout;
+      n = dline_plain_span (s + nread, n);
+      memcpy (buffer + nout, s + nread, n);
+      nout += n;
+      nread += n;
+      if (nread == datalen || nout + 3 > bufsize)
+        break;
+      /* S[NREAD] is now a character which needs to be escaped.  */
+      buffer[nout++] = '%';
+      buffer[nout++] = hexdigits[s[nread] >> 4];
+      buffer[nout++] = hexdigits[s[nread] & 0x0f];
+      nread++;
+    }
+
+  *r_nread = nread;
+  return nout;
+}
+
+
 /* Do the percent and plus/space unescaping from STRING to BUFFER and
    return the length of the valid buffer.  Plus unescaping is only
    done if WITHPLUS is true.  An escaped Nul character will be
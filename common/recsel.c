@@ -31,6 +31,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <ctype.h>
 #include <unistd.h>
 #include <errno.h>
 
@@ -64,7 +65,12 @@ struct recsel_expr_s
   unsigned int not:1;   /* Negate operators. */
   unsigned int disjun:1;/* Start of a disjunction.  */
   unsigned int xcase:1; /* String match is case sensitive.  */
+  unsigned int numop:1; /* The operator needs the numerical value.  */
+  unsigned int samename:1; /* NAME is the same as in the previous
+                              expression.  */
   const char *value;    /* (Points into NAME.)  */
+  size_t valuelen;      /* strlen of VALUE.  */
+  const char *ucvalue;  /* Uppercase VALUE.  (Points into NAME.)  */
   long numvalue;        /* strtol of VALUE.  */
   char name[1];         /* Name of the property.  */
 };
@@ -116,6 +122,31 @@ my_memstr (const void *buffer, size_t buflen, const char *sub)
 }
 
 
+/* This is a version of memistr which expects SUB of length SUBLEN
+ * to be already in uppercase.  */
+static const char *
+my_memistr_uc (const void *buffer, size_t buflen,
+               const char *sub, size_t sublen)
+{
+  const unsigned char *buf = buffer;
+  const unsigned char *s = (const unsigned char *)sub;
+  size_t n, i;
+
+  if (!sublen)
+    return buffer;
+  for (n = 0; n + sublen <= buflen; n++)
+    {
+      if (toupper (buf[n]) != *s)
+        continue;
+      for (i = 1; i < sublen && toupper (buf[n+i]) == s[i]; i++)
+        ;
+      if (i == sublen)
+        return (const char *)buf + n;
+    }
+  return NULL;
+}
+
+
 /* Return a pointer to the next logical connection operator or NULL if
  * none.  */
 static char *
@@ -252,7 +283,8 @@ recsel_parse_expr (recsel_expr_t *selector, const char *expression)
   if (next_lc)
     *next_lc = 0;  /* Terminate this term.  */
 
-  se = xtrymalloc (sizeof *se + strlen (expr));
+  /* Allocate twice the space to store the uppercase value.  */
+  se = xtrymalloc (sizeof *se + 2 * strlen (expr) + 1);
   if (!se)
     {
       gpg_error_t err = my_error_from_syserror ();
@@ -450,7 +482,39 @@ recsel_parse_expr (recsel_expr_t *selector, const char *expression)
       return my_error (GPG_ERR_MISSING_VALUE);
     }
 
+  se->valuelen = strlen (se->value);
   se->numvalue = strtol (se->value, NULL, 0);
+  se->numop = !(se->op == SELECT_SAME || se->op == SELECT_SUB
+                || se->op == SELECT_NONEMPTY
+                || se->op == SELECT_STRLE || se->op == SELECT_STRGE
+                || se->op == SELECT_STRLT || se->op == SELECT_STRGT);
+
+  /* Precompute the uppercase value for case-insensitive matching.  */
+  {
+    char *p = se->name + strlen (expr) + 1;
+    size_t n;
+
+    for (n=0; n < se->valuelen; n++)
+      p[n] = toupper (((const unsigned char *)se->value)[n]);
+    p[n] = 0;
+    se->ucvalue = p;
+  }
+
+  se2 = se_head;
+  if (se2 != se)
+    {
+      while (se2->next != se)
+        se2 = se2->next;
+      se->samename = !strcmp (se2->name, se->name);
+    }
+  else if (*selector)
+    {
+      for (se2 = *selector; se2->next; se2 = se2->next)
+        ;
+      se->samename = !strcmp (se2->name, se->name);
+    }
+  else
+    se->samename = 0;
 
   if (next_lc)
     {
@@ -527,17 +591,27 @@ recsel_select (recsel_expr_t selector,
                void *cookie)
 {
   recsel_expr_t se;
-  const char *value;
-  size_t selen, valuelen;
-  long numvalue;
+  recsel_expr_t prev = NULL;  /* The previous evaluated expression.  */
+  const char *value = NULL;
+  size_t selen, valuelen = 0;
+  long numvalue = 0;
+  int numvalid = 0;
   int result = 1;
 
   se = selector;
   while (se)
     {
-      value = getval? getval (cookie, se->name) : NULL;
-      if (!value)
-        value = "";
+      /* Fetch the value unless the previous evaluated expression used
+       * the same property.  */
+      if (!prev || prev->next != se || !se->samename)
+        {
+          value = getval? getval (cookie, se->name) : NULL;
+          if (!value)
+            value = "";
+          valuelen = strlen (value);
+          numvalid = 0;
+        }
+      prev = se;
 
       if (!*value)
         {
@@ -546,23 +620,37 @@ recsel_select (recsel_expr_t selector,
         }
       else /* Field has a value.  */
         {
-          valuelen = strlen (value);
-          numvalue = strtol (value, NULL, 0);
-          selen = strlen (se->value);
+          if (se->numop && !numvalid)
+            {
+              numvalue = strtol (value, NULL, 0);
+              numvalid = 1;
+            }
+          selen = se->valuelen;
 
           switch (se->op)
             {
             case SELECT_SAME:
-              if (se->xcase)
-                result = (valuelen==selen && !memcmp (value,se->value,selen));
+              if (valuelen != selen)
+                result = 0;
+              else if (se->xcase)
+                result = !memcmp (value, se->value, selen);
               else
-                result = (valuelen==selen && !memicmp (value,se->value,selen));
+                {
+                  size_t n;
+
+                  for (n=0; n < selen; n++)
+                    if (toupper (((const unsigned char *)value)[n])
+                        != ((const unsigned char *)se->ucvalue)[n])
+                      break;
+                  result = (n == selen);
+                }
               break;
             case SELECT_SUB:
               if (se->xcase)
                 result = !!my_memstr (value, valuelen, se->value);
               else
-                result = !!memistr (value, valuelen, se->value);
+                result = !!my_memistr_uc (value, valuelen,
+                                          se->ucvalue, selen);
               break;
             case SELECT_NONEMPTY:
               result = !!valuelen;
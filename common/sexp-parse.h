@@ -104,6 +104,50 @@ smatch (unsigned char const **buf, size_t buflen, const char *token)
   return 1;
 }
 
+/* Search the remaining elements of the list BUF points into for a
+   sublist whose first element matches TOKEN.  This does not allocate
+   any memory and may thus be used to pick a parameter from a
+   canonical encoded key.  On success true is returned and BUF is
+   updated to point right behind TOKEN in that sublist.  On failure
+   false is returned and BUF is not changed.  The search stops at the
+   end of the current list.  */
+static inline int
+sfind (unsigned char const **buf, const char *token)
+{
+  const unsigned char *s = *buf;
+  size_t n;
+  int depth;
+
+  while (*s && *s != ')')
+    {
+      if (*s == '(')
+        {
+          s++;
+          n = snext (&s);
+          if (!n)
+            return 0;
+          if (smatch (&s, n, token))
+            {
+              *buf = s;
+              return 1;
+            }
+          s += n;
+          depth = 1;
+          if (sskip (&s, &depth))
+            return 0;
+        }
+      else
+        {
+          n = snext (&s);
+          if (!n)
+            return 0;
+          s += n;
+        }
+    }
+  return 0;
+}
+
+
 /* Format VALUE for use as the length indicatior of an S-expression.
    The caller needs to provide a buffer HELP_BUFFER with a length of
    HELP_BUFLEN.  The return value is a pointer into HELP_BUFFER with
@@ -399,6 +399,78 @@ make_simple_sexp_from_hexstr (const char *line, size_t *nscanned)
 }
 
 
+/* Check the canonical encoded key KEYDATA of length KEYDATALEN and
+   return a pointer to its algorithm name at R_ALGO and R_ALGOLEN.  On
+   return R_PARMS points behind the algorithm name, i.e. to the list of
+   key parameters.  The type of the key (e.g. "public-key") is not
+   checked.  No memory is allocated; all returned pointers point into
+   KEYDATA.  */
+static gpg_error_t
+open_canon_key (const unsigned char *keydata, size_t keydatalen,
+                unsigned char const **r_algo, size_t *r_algolen,
+                unsigned char const **r_parms)
+{
+  const unsigned char *s = keydata;
+  size_t n;
+
+  if (!keydata || !gcry_sexp_canon_len (keydata, keydatalen, NULL, NULL))
+    return gpg_error (GPG_ERR_INV_SEXP);
+
+  if (*s != '(')
+    return gpg_error (GPG_ERR_INV_SEXP);
+  s++;
+  n = snext (&s);
+  if (!n)
+    return gpg_error (GPG_ERR_INV_SEXP);
+  s += n;
+  if (*s != '(')
+    return gpg_error (GPG_ERR_BAD_PUBKEY);
+  s++;
+  n = snext (&s);
+  if (!n)
+    return gpg_error (GPG_ERR_INV_SEXP);
+
+  *r_algo = s;
+  *r_algolen = n;
+  *r_parms = s + n;
+  return 0;
+}
+
+
+/* Return the value of the key parameter NAME of the canonical encoded
+   key KEYDATA of length KEYDATALEN.  On success a pointer to the
+   value is stored at R_VALUE and its length at R_VALUELEN.  Unlike
+   using gcry_sexp_find_token this does not allocate any memory;
+   R_VALUE points into KEYDATA.  GPG_ERR_NOT_FOUND is returned if the
+   key has no such parameter.  */
+gpg_error_t
+get_key_param_from_canon_sexp (const unsigned char *keydata,
+                               size_t keydatalen, const char *name,
+                               unsigned char const **r_value,
+                               size_t *r_valuelen)
+{
+  gpg_error_t err;
+  const unsigned char *algo, *s;
+  size_t algolen, n;
+
+  *r_value = NULL;
+  *r_valuelen = 0;
+
+  err = open_canon_key (keydata, keydatalen, &algo, &algolen, &s);
+  if (err)
+    return err;
+  if (!sfind (&s, name))
+    return gpg_error (GPG_ERR_NOT_FOUND);
+  n = snext (&s);
+  if (!n)
+    return gpg_error (GPG_ERR_INV_SEXP);
+
+  *r_value = s;
+  *r_valuelen = n;
+  return 0;
+}
+
+
 /* Return the hash algorithm from a KSBA sig-val. SIGVAL is a
    canonical encoded S-expression.  Return 0 if the hash algorithm is
    not encoded in SIG-VAL or it is not supported by libgcrypt.  */
@@ -1043,18 +1115,48 @@ get_pk_algo_from_key (gcry_sexp_t key)
 
 /* This is a variant of get_pk_algo_from_key but takes an canonical
  * encoded S-expression as input.  Returns a GCRYPT public key
- * identiier or 0 on error.  */
+ * identiier or 0 on error.  The key is parsed in place and thus no
+ * memory is allocated.  */
 int
 get_pk_algo_from_canon_sexp (const unsigned char *keydata, size_t keydatalen)
 {
-  gcry_sexp_t sexp;
+  const unsigned char *s, *parms;
+  size_t n;
+  char algoname[6];
   int algo;
 
-  if (gcry_sexp_sscan (&sexp, NULL, keydata, keydatalen))
+  if (open_canon_key (keydata, keydatalen, &s, &n, &parms))
     return 0;
+  if (n >= sizeof (algoname))
+    return 0;
+  memcpy (algoname, s, n);
+  algoname[n] = 0;
+
+  algo = gcry_pk_map_name (algoname);
+  if (algo == GCRY_PK_ECC)
+    {
+      s = parms;
+      if (sfind (&s, "flags"))
+        {
+          while (*s != ')')
+            {
+              n = snext (&s);
+              if (!n)
+                break; /* Not a data element or end of list.  */
+              if (smatch (&s, n, "eddsa"))
+                {
+                  algo = GCRY_PK_EDDSA;
+                  break;
+                }
+              s += n;
+            }
+        }
+
+      s = parms;
+      if (sfind (&s, "curve") && (n = snext (&s)) && smatch (&s, n, "Ed448"))
+        algo = GCRY_PK_EDDSA;
+    }
 
-  algo = get_pk_algo_from_key (sexp);
-  gcry_sexp_release (sexp);
   return algo;
 }
 
@@ -493,3 +493,54 @@ simple_query (const char *query)
   assuan_release (ctx);
   return rc;
 }
+
+
+/* Parameter for data_inq_cb.  */
+struct data_inq_parm_s
+{
+  assuan_context_t ctx;
+  const char *keyword;
+  const void *data;
+  size_t datalen;
+};
+
+
+/* Inquiry callback for simple_query_with_data.  */
+static gpg_error_t
+data_inq_cb (void *opaque, const char *line)
+{
+  struct data_inq_parm_s *parm = opaque;
+  size_t n = strlen (parm->keyword);
+
+  if (!strncmp (line, parm->keyword, n) && (line[n] == ' ' || !line[n]))
+    return assuan_send_data (parm->ctx, parm->data, parm->datalen);
+
+  return default_inq_cb (NULL, line);
+}
+
+
+/* Perform the simple query QUERY (which must be new-line and 0
+   terminated) and answer the inquiry KEYWORD with DATA of length
+   DATALEN.  Returns the error code.  */
+int
+simple_query_with_data (const char *query, const char *keyword,
+                        const void *data, size_t datalen)
+{
+  assuan_context_t ctx;
+  struct data_inq_parm_s parm;
+  int rc;
+
+  rc = agent_open (&ctx);
+  if (rc)
+    return rc;
+
+  parm.ctx = ctx;
+  parm.keyword = keyword;
+  parm.data = data;
+  parm.datalen = datalen;
+  rc = assuan_transact (ctx, query, NULL, NULL,
+                        data_inq_cb, &parm, NULL, NULL);
+
+  assuan_release (ctx);
+  return rc;
+}
@@ -62,6 +62,11 @@ int simple_pwclear (const char *cacheid);
    terminated) and return the error code.  */
 int simple_query (const char *query);
 
+/* Same as simple_query but answer an inquiry KEYWORD with the
+   DATALEN bytes at DATA.  */
+int simple_query_with_data (const char *query, const char *keyword,
+                            const void *data, size_t datalen);
+
 /* Set the name of the standard socket to be used if GPG_AGENT_INFO is
    not defined.  The use of this function is optional but if it needs
    to be called before any other function.  Returns 0 on success.  */
@@ -0,0 +1,181 @@
+/* t-bloom.c - Module tests for bloom.c
+ * Copyright (C) 2023 g10 Code GmbH
+ *
+ * This file is part of GnuPG.
+ *
+ * This file is free software; you can redistribute it and/or modify
+ * it under the terms of either
+ *
+ *   - the GNU Lesser General Public License as published by the Free
+ *     Software Foundation; either version 3 of the License, or (at
+ *     your option) any later version.
+ *
+ * or
+ *
+ *   - the GNU General Public License as published by the Free
+ *     Software Foundation; either version 2 of the License, or (at
+ *     your option) any later version.
+ *
+ * or both in parallel, as here.
+ *
+ * This file is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see <https://www.gnu.org/licenses/>.
+ * SPDX-License-Identifier: (LGPL-3.0-or-later OR GPL-2.0-or-later)
+ */
+
+#include <config.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "util.h"
+#include "bloom.h"
+
+#define PGM "t-bloom"
+
+#define pass()  do { ; } while(0)
+#define fail(a)  do { fprintf (stderr, "%s:%d: test %d failed\n",\
+                               __FILE__,__LINE__, (a));          \
+                     errcount++;                                 \
+                   } while(0)
+
+static int errcount;
+
+
+/* Create a pseudo keyid from N.  */
+static void
+make_kid (unsigned int n, unsigned char *kid)
+{
+  unsigned int i;
+
+  for (i=0; i < 8; i++)
+    kid[i] = (n * 2654435761u) >> ((i % 4) * 8) ^ (i * 31) ^ (n >> 24);
+  kid[7] ^= n;
+  kid[6] ^= n >> 8;
+}
+
+
+static void
+test_basic (void)
+{
+  gpg_error_t err;
+  bloom_filter_t bf;
+  unsigned char kid[8];
+  unsigned int n, fp;
+
+  err = bloom_new (&bf, 1000);
+  if (err)
+    {
+      fprintf (stderr, PGM ": bloom_new failed: %s\n", gpg_strerror (err));
+      exit (1);
+    }
+
+  for (n=0; n < 1000; n++)
+    {
+      make_kid (n, kid);
+      bloom_add (bf, BLOOM_ITEM_KID, kid, 8);
+    }
+  if (bloom_count (bf) != 1000)
+    fail (1);
+
+  /* No false negatives.  */
+  for (n=0; n < 1000; n++)
+    {
+      make_kid (n, kid);
+      if (!bloom_test (bf, BLOOM_ITEM_KID, kid, 8))
+        fail (2);
+    }
+
+  /* The type is part of the item.  */
+  make_kid (0, kid);
+  if (bloom_test (bf, BLOOM_ITEM_FPR, kid, 8))
+    fail (3);
+
+  /* The false positive rate shall be around 1% - allow for 5%.  */
+  for (fp=0, n=1000; n < 11000; n++)
+    {
+      make_kid (n, kid);
+      if (bloom_test (bf, BLOOM_ITEM_KID, kid, 8))
+        fp++;
+    }
+  if (fp > 500)
+    fail (4);
+
+  bloom_release (bf);
+}
+
+
+static void
+test_buffer (void)
+{
+  gpg_error_t err;
+  bloom_filter_t bf, bf2;
+  unsigned char kid[8];
+  unsigned int n;
+  void *buffer;
+  size_t buflen;
+
+  err = bloom_new (&bf, 10);
+  if (err)
+    {
+      fprintf (stderr, PGM ": bloom_new failed: %s\n", gpg_strerror (err));
+      exit (1);
+    }
+  for (n=0; n < 10; n++)
+    {
+      make_kid (n, kid);
+      bloom_add (bf, BLOOM_ITEM_KID, kid, 8);
+    }
+
+  err = bloom_to_buffer (bf, &buffer, &buflen);
+  if (err)
+    {
+      fprintf (stderr, PGM ": bloom_to_buffer failed: %s\n",
+               gpg_strerror (err));
+      exit (1);
+    }
+
+  err = bloom_from_buffer (&bf2, buffer, buflen);
+  if (err)
+    fail (1);
+  else
+    {
+      if (bloom_count (bf2) != 10)
+        fail (2);
+      for (n=0; n < 10; n++)
+        {
+          make_kid (n, kid);
+          if (!bloom_test (bf2, BLOOM_ITEM_KID, kid, 8))
+            fail (3);
+        }
+      bloom_release (bf2);
+    }
+
+  /* Truncated and corrupted buffers must be rejected.  */
+  if (!bloom_from_buffer (&bf2, buffer, buflen - 1))
+    fail (4);
+  ((unsigned char *)buffer)[0] = 'X';
+  if (!bloom_from_buffer (&bf2, buffer, buflen))
+    fail (5);
+
+  xfree (buffer);
+  bloom_release (bf);
+}
+
+
+int
+main (int argc, char **argv)
+{
+  (void)argc;
+  (void)argv;
+
+  test_basic ();
+  test_buffer ();
+
+  return !!errcount;
+}
@@ -126,6 +126,18 @@ content_filter (void *opaque, int control,
   return 0;
 }
 
+/* Writer for iobuf_read_direct which appends to a string buffer.  */
+static gpg_error_t
+append_writer (void *opaque, const void *buf, size_t buflen)
+{
+  char *buffer = opaque;
+  size_t n = strlen (buffer);
+
+  memcpy (buffer + n, buf, buflen);
+  buffer[n + buflen] = 0;
+  return 0;
+}
+
 int
 main (int argc, char *argv[])
 {
@@ -390,5 +402,33 @@ main (int argc, char *argv[])
     iobuf_close (iobuf);
   }
 
+  /* Check iobuf_read_direct with and without a length limit.  */
+  {
+    iobuf_t iobuf;
+    int rc;
+    char content[] = "0123456789abcdefghij";
+    char buffer[32];
+    uint64_t nread;
+
+    iobuf = iobuf_temp_with_content (content, strlen (content));
+    assert (iobuf);
+    rc = iobuf_push_filter (iobuf, every_other_filter, NULL);
+    assert (rc == 0);
+
+    *buffer = 0;
+    rc = iobuf_read_direct (iobuf, 4, append_writer, buffer, &nread);
+    assert (rc == 0);
+    assert (nread == 4);
+    assert (strcmp (buffer, "1357") == 0);
+
+    *buffer = 0;
+    rc = iobuf_read_direct (iobuf, 0, append_writer, buffer, &nread);
+    assert (rc == 0);
+    assert (nread == 6);
+    assert (strcmp (buffer, "9bdfhj") == 0);
+
+    iobuf_close (iobuf);
+  }
+
   return 0;
 }
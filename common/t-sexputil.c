@@ -497,6 +497,64 @@ test_ecc_uncompress (void)
 }
 
 
+static void
+test_get_key_param (void)
+{
+  static struct {
+    const char *key;
+    int algo;
+    const char *name;
+    const char *value;
+  } tests[] = {
+    { "(10:public-key(3:rsa(1:n3:abc)(1:e1:A)))",
+      GCRY_PK_RSA, "e", "A" },
+    { "(11:private-key(3:rsa(1:n3:abc)(1:e1:A)(1:d2:xy)))",
+      GCRY_PK_RSA, "d", "xy" },
+    { "(10:public-key(3:ecc(5:curve10:NIST P-256)(1:q3:abc)))",
+      GCRY_PK_ECC, "curve", "NIST P-256" },
+    { "(10:public-key(3:ecc(5:curve7:Ed25519)(5:flags5:eddsa)(1:q3:abc)))",
+      GCRY_PK_EDDSA, "q", "abc" },
+    { "(10:public-key(3:ecc(5:curve5:Ed448)(1:q3:abc)))",
+      GCRY_PK_EDDSA, "x", NULL },
+    { "(10:public-key(3:foo(1:q3:abc)))",
+      0, "q", "abc" },
+    { NULL }
+  };
+  int idx, algo;
+  gpg_error_t err;
+  const unsigned char *key, *value;
+  size_t keylen, valuelen;
+
+  for (idx=0; tests[idx].key; idx++)
+    {
+      key = (const unsigned char *)tests[idx].key;
+      keylen = strlen (tests[idx].key);
+      algo = get_pk_algo_from_canon_sexp (key, keylen);
+      if (algo != tests[idx].algo)
+        fail (idx);
+
+      err = get_key_param_from_canon_sexp (key, keylen,
+                                           tests[idx].name,
+                                           &value, &valuelen);
+      if (!tests[idx].value)
+        {
+          if (gpg_err_code (err) != GPG_ERR_NOT_FOUND)
+            fail (idx);
+        }
+      else if (err)
+        fail2 (idx, err);
+      else if (valuelen != strlen (tests[idx].value)
+               || memcmp (value, tests[idx].value, valuelen))
+        fail (idx);
+    }
+
+  /* A truncated S-expression must not be accepted.  */
+  if (get_pk_algo_from_canon_sexp
+      ((const unsigned char *)"(10:public-key(3:rsa(1:n3:abc)", 30))
+    fail (0);
+}
+
+
 
 
 int
@@ -509,6 +567,7 @@ main (int argc, char **argv)
   test_make_canon_sexp_from_rsa_pk ();
   test_cmp_canon_sexp ();
   test_ecc_uncompress ();
+  test_get_key_param ();
 
   return 0;
 }
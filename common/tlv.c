@@ -149,6 +149,220 @@ find_tlv_unchecked (const unsigned char *buffer, size_t length,
 }
 
 
+/* An index over all TLV objects of a buffer.  The items are kept in
+   an open addressing hash table keyed by the tag.  */
+struct tlv_index_item_s
+{
+  int tag;       /* The tag or -1 for an empty slot.  */
+  size_t off;    /* Offset of the value.  */
+  size_t len;    /* Length of the value as given by the header.  */
+};
+
+struct tlv_index_s
+{
+  unsigned int size;     /* Number of slots; a power of 2.  */
+  unsigned int used;     /* Number of used slots.  */
+  struct tlv_index_item_s *items;
+};
+
+
+static struct tlv_index_item_s *
+tlv_index_slot (tlv_index_t tix, int tag)
+{
+  unsigned int i = ((unsigned int)tag * 2654435761u) & (tix->size - 1);
+
+  while (tix->items[i].tag != -1 && tix->items[i].tag != tag)
+    i = (i + 1) & (tix->size - 1);
+  return tix->items + i;
+}
+
+
+/* Insert TAG unless it is already known.  Returns an error code.  */
+static gpg_error_t
+tlv_index_put (tlv_index_t tix, int tag, size_t off, size_t len)
+{
+  struct tlv_index_item_s *item;
+
+  if ((tix->used + 1) * 2 > tix->size)
+    {
+      struct tlv_index_item_s *olditems = tix->items;
+      unsigned int oldsize = tix->size;
+      unsigned int i;
+
+      tix->size = oldsize * 2;
+      tix->items = xtrymalloc (tix->size * sizeof *tix->items);
+      if (!tix->items)
+        {
+          tix->items = olditems;
+          tix->size = oldsize;
+          return gpg_error_from_syserror ();
+        }
+      for (i=0; i < tix->size; i++)
+        tix->items[i].tag = -1;
+      for (i=0; i < oldsize; i++)
+        if (olditems[i].tag != -1)
+          *tlv_index_slot (tix, olditems[i].tag) = olditems[i];
+      xfree (olditems);
+    }
+
+  item = tlv_index_slot (tix, tag);
+  if (item->tag == -1)
+    {
+      /* Only the first object with TAG is stored to return the same
+       * object as find_tlv.  */
+      item->tag = tag;
+      item->off = off;
+      item->len = len;
+      tix->used++;
+    }
+  return 0;
+}
+
+
+/* Walk over BUFFER in the same order as do_find_tlv and add all
+   objects to TIX.  BASE and END delimit the entire buffer.  Unlike
+   do_find_tlv this never reads beyond END.  */
+static gpg_error_t
+tlv_index_walk (tlv_index_t tix,
+                const unsigned char *base, const unsigned char *end,
+                const unsigned char *buffer, size_t length, int nestlevel)
+{
+  gpg_error_t err;
+  const unsigned char *s = buffer;
+  size_t n = length;
+  size_t len;
+  int this_tag;
+  int composite;
+
+  for (;;)
+    {
+      if (n < 2)
+        return 0;
+      if (!*s || *s == 0xff)
+        {
+          s++;
+          n--;
+          continue;
+        }
+      composite = !!(*s & 0x20);
+      if ((*s & 0x1f) == 0x1f)
+        {
+          s++;
+          n--;
+          if (n < 2)
+            return 0;
+          if ((*s & 0x1f) == 0x1f)
+            return 0;
+          this_tag = (s[-1] << 8) | (s[0] & 0x7f);
+        }
+      else
+        this_tag = s[0];
+      len = s[1];
+      s += 2; n -= 2;
+      if (len < 0x80)
+        ;
+      else if (len == 0x81)
+        {
+          if (!n)
+            return 0;
+          len = s[0];
+          s++; n--;
+        }
+      else if (len == 0x82)
+        {
+          if (n < 2)
+            return 0;
+          len = ((size_t)s[0] << 8) | s[1];
+          s += 2; n -= 2;
+        }
+      else
+        return 0;
+
+      if (composite && nestlevel < 100)
+        {
+          err = tlv_index_walk (tix, base, end, s,
+                                len < (size_t)(end - s)? len : end - s,
+                                nestlevel+1);
+          if (err)
+            return err;
+        }
+
+      err = tlv_index_put (tix, this_tag, s - base, len);
+      if (err)
+        return err;
+      if (len > n)
+        return 0;
+      s += len; n -= len;
+    }
+}
+
+
+/* Parse BUFFER of LENGTH once and return an index which allows to
+   look up tags in constant time.  The index stores offsets and is
+   thus also valid for copies of BUFFER.  */
+gpg_error_t
+tlv_index_new (tlv_index_t *r_index,
+               const unsigned char *buffer, size_t length)
+{
+  gpg_error_t err;
+  tlv_index_t tix;
+  unsigned int i;
+
+  *r_index = NULL;
+  tix = xtrycalloc (1, sizeof *tix);
+  if (!tix)
+    return gpg_error_from_syserror ();
+  tix->size = 32;
+  tix->items = xtrymalloc (tix->size * sizeof *tix->items);
+  if (!tix->items)
+    {
+      err = gpg_error_from_syserror ();
+      xfree (tix);
+      return err;
+    }
+  for (i=0; i < tix->size; i++)
+    tix->items[i].tag = -1;
+
+  err = tlv_index_walk (tix, buffer, buffer + length, buffer, length, 0);
+  if (err)
+    {
+      tlv_index_release (tix);
+      return err;
+    }
+  *r_index = tix;
+  return 0;
+}
+
+
+/* Release an index created by tlv_index_new.  */
+void
+tlv_index_release (tlv_index_t tix)
+{
+  if (!tix)
+    return;
+  xfree (tix->items);
+  xfree (tix);
+}
+
+
+/* Look up TAG in INDEX and store the offset and the length of its
+   value at R_OFF and R_LEN.  Returns false if not found.  */
+int
+tlv_index_lookup (tlv_index_t tix, int tag, size_t *r_off, size_t *r_len)
+{
+  struct tlv_index_item_s *item;
+
+  if (!tix || tag < 0)
+    return 0;
+  item = tlv_index_slot (tix, tag);
+  if (item->tag == -1)
+    return 0;
+  *r_off = item->off;
+  *r_len = item->len;
+  return 1;
+}
+
+
 /* ASN.1 BER parser: Parse BUFFER of length SIZE and return the tag
    and the length part from the TLV triplet.  Update BUFFER and SIZE
    on success. */
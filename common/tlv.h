@@ -75,6 +75,9 @@ enum tlv_tag_type {
 struct tlv_builder_s;
 typedef struct tlv_builder_s *tlv_builder_t;
 
+struct tlv_index_s;
+typedef struct tlv_index_s *tlv_index_t;
+
 /*-- tlv.c --*/
 
 /* Locate a TLV encoded data object in BUFFER of LENGTH and return a
@@ -92,6 +95,22 @@ const unsigned char *find_tlv_unchecked (const unsigned char *buffer,
                                          size_t length,
                                          int tag, size_t *nbytes);
 
+/* Parse BUFFER of LENGTH once and return an index which allows to
+   look up tags in constant time.  The index stores offsets and is
+   thus also valid for copies of BUFFER.  */
+gpg_error_t tlv_index_new (tlv_index_t *r_index,
+                           const unsigned char *buffer, size_t length);
+
+/* Release an index created by tlv_index_new.  */
+void tlv_index_release (tlv_index_t tix);
+
+/* Look up TAG in TIX and store the offset and the length of its
+   value at R_OFF and R_LEN.  The result is the same as with
+   find_tlv_unchecked; in particular the caller needs to check that
+   the value fits into the buffer.  Returns false if not found.  */
+int tlv_index_lookup (tlv_index_t tix, int tag,
+                      size_t *r_off, size_t *r_len);
+
 /* ASN.1 BER parser: Parse BUFFER of length SIZE and return the tag
    and the length part from the TLV triplet.  Update BUFFER and SIZE
    on success. */
@@ -312,6 +312,75 @@ is_native_utf8 (void)
 }
 
 
+/* Return the number of leading bytes of the LENGTH bytes at S which
+ * are ASCII.  If PRINTABLE is set, control characters and DEL also
+ * end the prefix.  The bulk of the bytes is checked a word at a time;
+ * a word with a suspicious byte is then checked bytewise.  */
+static size_t
+ascii_prefix_len (const unsigned char *s, size_t length, int printable)
+{
+  const unsigned long ones = (unsigned long)-1 / 0xff;
+  const unsigned long highs = ones * 0x80;
+  unsigned long w, bad;
+  size_t n;
+
+  for (n=0; n + sizeof w <= length; n += sizeof w)
+    {
+      memcpy (&w, s + n, sizeof w);
+      bad = w;
+      if (printable) /* Any byte < 0x20 or == 0x7f.  */
+        bad |= ((w - ones * 0x20) | ((w ^ ones * 0x7f) - ones)) & ~w;
+      if ((bad & highs))
+        break;
+    }
+  for (; n < length; n++)
+    if ((s[n] & 0x80) || (printable && (s[n] < 0x20 || s[n] == 0x7f)))
+      break;
+  return n;
+}
+
+
+/* Return true if the LENGTH bytes at BUFFER would be printed
+ * unchanged by utf8_to_native and es_write_sanitized; that is they
+ * are printable ASCII or, if the native charset is utf-8, valid UTF-8
+ * without control characters.  If DELIMITERS is not NULL none of its
+ * characters and no backslash may appear either.  This allows the
+ * callers to skip the conversion for the vast majority of user IDs.  */
+int
+is_plain_utf8_buffer (const void *buffer, size_t length,
+                      const char *delimiters)
+{
+  const unsigned char *s = buffer;
+  size_t n, nbytes, i;
+
+  n = ascii_prefix_len (s, length, 1);
+  while (n < length)
+    {
+      /* Only accept what do_utf8_to_native would pass through.  */
+      if (!no_translation || s[n] < 0xc0 || s[n] > 0xf7)
+        return 0;
+      nbytes = s[n] < 0xe0? 2 : s[n] < 0xf0? 3 : 4;
+      if (nbytes > length - n)
+        return 0;
+      for (i=1; i < nbytes; i++)
+        if ((s[n+i] & 0xc0) != 0x80)
+          return 0;
+      n += nbytes;
+      n += ascii_prefix_len (s + n, length - n, 1);
+    }
+
+  if (delimiters)
+    {
+      if (memchr (s, '\\', length))
+        return 0;
+      for (; *delimiters; delimiters++)
+        if (memchr (s, *delimiters, length))
+          return 0;
+    }
+  return 1;
+}
+
+
 /* Convert string, which is in native encoding to UTF8 and return a
    new allocated UTF-8 string.  This function terminates the process
    on memory shortage.  */
@@ -329,6 +398,11 @@ native_to_utf8 (const char *orig_string)
       /* Already utf-8 encoded. */
       buffer = xstrdup (orig_string);
     }
+  else if (!string[ascii_prefix_len (string, strlen (orig_string), 0)])
+    {
+      /* Plain ASCII is the same in all supported charsets.  */
+      buffer = xstrdup (orig_string);
+    }
   else if (!use_iconv)
     {
       /* For Latin-1 we can avoid the iconv overhead. */
@@ -687,6 +761,19 @@ do_utf8_to_native (const char *string, size_t length, int delim,
 char *
 utf8_to_native (const char *string, size_t length, int delim)
 {
+  char tmp[2];
+  char *buffer;
+
+  tmp[0] = delim;
+  tmp[1] = 0;
+  if (is_plain_utf8_buffer (string, length, delim > 0? tmp : NULL))
+    {
+      buffer = xmalloc (length + 1);
+      memcpy (buffer, string, length);
+      buffer[length] = 0;
+      return buffer;
+    }
+
   return do_utf8_to_native (string, length, delim, use_iconv);
 }
 
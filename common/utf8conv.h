@@ -34,6 +34,8 @@
 int set_native_charset (const char *newset);
 const char *get_native_charset (void);
 int is_native_utf8 (void);
+int is_plain_utf8_buffer (const void *buffer, size_t length,
+                          const char *delimiters);
 
 char *native_to_utf8 (const char *string);
 char *utf8_to_native (const char *string, size_t length, int delim);
@@ -166,6 +166,8 @@ gpg_error_t b64enc_start_es (struct b64state *state, estream_t fp,
 gpg_error_t b64enc_write (struct b64state *state,
                           const void *buffer, size_t nbytes);
 gpg_error_t b64enc_finish (struct b64state *state);
+size_t b64enc_lines (const void *buffer, size_t nlines, const char *eol,
+                     void *outbuf);
 
 gpg_error_t b64dec_start (struct b64state *state, const char *title);
 gpg_error_t b64dec_proc (struct b64state *state, void *buffer, size_t length,
@@ -212,6 +214,12 @@ gpg_error_t uncompress_ecc_q_in_canon_sexp (const unsigned char *keydata,
                                             unsigned char **r_newkeydata,
                                             size_t *r_newkeydatalen);
 
+gpg_error_t get_key_param_from_canon_sexp (const unsigned char *keydata,
+                                           size_t keydatalen,
+                                           const char *name,
+                                           unsigned char const **r_value,
+                                           size_t *r_valuelen);
+
 int get_pk_algo_from_key (gcry_sexp_t key);
 int get_pk_algo_from_canon_sexp (const unsigned char *keydata,
                                  size_t keydatalen);
@@ -234,6 +242,9 @@ unsigned int hex2fixedbuf (const char *hexstr, void *buffer, size_t bufsize);
 char *percent_plus_escape (const char *string);
 char *percent_data_escape (int plus, const char *prefix,
                            const void *data, size_t datalen);
+size_t percent_dline_escape (char *buffer, size_t bufsize,
+                             const void *data, size_t datalen,
+                             size_t *r_nread);
 char *percent_plus_unescape (const char *string, int nulrepl);
 char *percent_unescape (const char *string, int nulrepl);
 
@@ -35,6 +35,19 @@
 
 #define MAX_NONPERM_CACHED_CERTS 1000
 
+/* The number of slots of each of the secondary indexes.  */
+#define CERT_INDEX_SIZE 1021
+
+/* The secondary indexes into the cache.  */
+enum cert_index
+  {
+    INDEX_SUBJECT = 0,   /* Subject DN.  */
+    INDEX_ISSUER,        /* Issuer DN.  */
+    INDEX_ISSUER_SN,     /* Issuer DN and serial number.  */
+    INDEX_SKI,           /* Subject key identifier.  */
+    N_CERT_INDEXES
+  };
+
 /* Constants used to classify search patterns.  */
 enum pattern_class
   {
@@ -56,16 +69,22 @@ enum pattern_class
 /* A certificate cache item.  This consists of a the KSBA cert object
    and some meta data for easier lookup.  We use a hash table to keep
    track of all items and use the (randomly distributed) first byte of
-   the fingerprint directly as the hash which makes it pretty easy. */
+   the fingerprint directly as the hash which makes it pretty easy.
+   Valid items are also linked into secondary hash tables so that
+   lookups by DN, by issuer and serial number, and by subject key
+   identifier don't need to scan the entire cache. */
 struct cert_item_s
 {
   struct cert_item_s *next; /* Next item with the same hash value. */
+  /* Next item with the same hash value in the secondary indexes.  */
+  struct cert_item_s *next_in[N_CERT_INDEXES];
   ksba_cert_t cert;         /* The KSBA cert object or NULL is this is
                                not a valid item.  */
   unsigned char fpr[20];    /* The fingerprint of this object. */
   char *issuer_dn;          /* The malloced issuer DN.  */
   ksba_sexp_t sn;           /* The malloced serial number  */
   char *subject_dn;         /* The malloced subject DN - maybe NULL.  */
+  ksba_sexp_t ski;          /* The malloced subject key id - maybe NULL.  */
 
   /* If this field is set the certificate has been taken from some
    * configuration and shall not be flushed from the cache.  */
@@ -81,6 +100,9 @@ typedef struct cert_item_s *cert_item_t;
    the first byte of the fingerprint.  */
 static cert_item_t cert_cache[256];
 
+/* The secondary indexes.  See enum cert_index.  */
+static cert_item_t cert_index[N_CERT_INDEXES][CERT_INDEX_SIZE];
+
 /* This is the global cache_lock variable. In general locking is not
    needed but it would take extra efforts to make sure that no
    indirect use of npth functions is done, so we simply lock it
@@ -224,6 +246,117 @@ cert_compute_fpr (ksba_cert_t cert, unsigned char *digest)
 
 
 
+/* Hash the LENGTH bytes at BUFFER into the running hash value HASH
+ * (FNV-1a) and return the new hash value.  */
+static unsigned int
+hash_buffer (unsigned int hash, const void *buffer, size_t length)
+{
+  const unsigned char *s = buffer;
+
+  for (; length; length--, s++)
+    hash = (hash ^ *s) * 16777619;
+  return hash;
+}
+
+
+/* Return the hash value of the canonical S-expression SEXP.  */
+static unsigned int
+hash_sexp (unsigned int hash, ksba_sexp_t sexp)
+{
+  return hash_buffer (hash, sexp, gcry_sexp_canon_len (sexp, 0, NULL, NULL));
+}
+
+
+/* Return the slot of the secondary index for the string STRING.  */
+static unsigned int
+index_by_string (const char *string)
+{
+  return hash_buffer (2166136261, string, strlen (string)) % CERT_INDEX_SIZE;
+}
+
+
+/* Return the slot of the INDEX_ISSUER_SN index for ISSUER_DN and
+ * SERIALNO.  */
+static unsigned int
+index_by_issuer_sn (const char *issuer_dn, ksba_sexp_t serialno)
+{
+  unsigned int hash;
+
+  hash = hash_buffer (2166136261, issuer_dn, strlen (issuer_dn));
+  return hash_sexp (hash, serialno) % CERT_INDEX_SIZE;
+}
+
+
+/* Return the slot of the INDEX_SKI index for KEYID.  */
+static unsigned int
+index_by_ski (ksba_sexp_t keyid)
+{
+  return hash_sexp (2166136261, keyid) % CERT_INDEX_SIZE;
+}
+
+
+/* Return the slot of the index IDX for the cache item CI or -1 if CI
+ * shall not be put into that index.  */
+static int
+index_slot_of_item (cert_item_t ci, enum cert_index idx)
+{
+  switch (idx)
+    {
+    case INDEX_SUBJECT:
+      return ci->subject_dn? index_by_string (ci->subject_dn) : -1;
+    case INDEX_ISSUER:
+      return index_by_string (ci->issuer_dn);
+    case INDEX_ISSUER_SN:
+      return index_by_issuer_sn (ci->issuer_dn, ci->sn);
+    case INDEX_SKI:
+      return ci->ski? index_by_ski (ci->ski) : -1;
+    default:
+      return -1;
+    }
+}
+
+
+/* Link the cache item CI into all secondary indexes.  */
+static void
+link_cache_slot (cert_item_t ci)
+{
+  int idx, slot;
+
+  for (idx = 0; idx < N_CERT_INDEXES; idx++)
+    {
+      slot = index_slot_of_item (ci, idx);
+      if (slot < 0)
+        continue;
+      ci->next_in[idx] = cert_index[idx][slot];
+      cert_index[idx][slot] = ci;
+    }
+}
+
+
+/* Remove the cache item CI from all secondary indexes.  */
+static void
+unlink_cache_slot (cert_item_t ci)
+{
+  cert_item_t *ciptr;
+  int idx, slot;
+
+  for (idx = 0; idx < N_CERT_INDEXES; idx++)
+    {
+      slot = index_slot_of_item (ci, idx);
+      if (slot < 0)
+        continue;
+      for (ciptr = &cert_index[idx][slot]; *ciptr;
+           ciptr = &(*ciptr)->next_in[idx])
+        if (*ciptr == ci)
+          {
+            *ciptr = ci->next_in[idx];
+            break;
+          }
+      ci->next_in[idx] = NULL;
+    }
+}
+
+
 /* Cleanup one slot.  This releases all resourses but keeps the actual
    slot in the cache marked for reuse. */
 static void
@@ -234,12 +367,17 @@ clean_cache_slot (cert_item_t ci)
   if (!ci->cert)
     return; /* Already cleaned.  */
 
+  if (ci->issuer_dn && ci->sn)
+    unlink_cache_slot (ci);  /* Only linked items have both.  */
+
   ksba_free (ci->sn);
   ci->sn = NULL;
   ksba_free (ci->issuer_dn);
   ci->issuer_dn = NULL;
   ksba_free (ci->subject_dn);
   ci->subject_dn = NULL;
+  ksba_free (ci->ski);
+  ci->ski = NULL;
   cert = ci->cert;
   ci->cert = NULL;
 
@@ -368,8 +506,11 @@ put_cert (ksba_cert_t cert, int permanent, unsigned int trustclass,
       return gpg_error (GPG_ERR_INV_CERT_OBJ);
     }
   ci->subject_dn = ksba_cert_get_subject (cert, 0);
+  if (ksba_cert_get_subj_key_id (cert, NULL, &ci->ski))
+    ci->ski = NULL;
   ci->permanent = !!permanent;
   ci->trustclasses = trustclass;
+  link_cache_slot (ci);
 
   if (permanent)
     any_cert_of_class |= trustclass;
@@ -873,15 +1014,56 @@ cert_cache_any_in_class (unsigned int mask)
 }
 
 
+/* Return true if a certificate with the fingerprint FPR is in the
+ * cache.  Only the read lock is taken so that this check does not
+ * block concurrent lookups.  */
+static int
+cert_is_cached (const unsigned char *fpr)
+{
+  cert_item_t ci;
+  int found = 0;
+
+  acquire_cache_read_lock ();
+  for (ci=cert_cache[*fpr]; ci; ci = ci->next)
+    if (ci->cert && !memcmp (ci->fpr, fpr, 20))
+      {
+        found = 1;
+        break;
+      }
+  release_cache_lock ();
+  return found;
+}
+
+
+/* Put CERT into the cache unless it is already cached.  Most of the
+ * certificates seen during a validation are already cached; thus we
+ * first check under the read lock and take the write lock only for
+ * new certificates.  FPR_BUFFER is as for put_cert.  */
+static gpg_error_t
+put_cert_if_new (ksba_cert_t cert, void *fpr_buffer)
+{
+  gpg_error_t err;
+  unsigned char help_fpr_buffer[20], *fpr;
+
+  fpr = fpr_buffer? fpr_buffer : help_fpr_buffer;
+  cert_compute_fpr (cert, fpr);
+  if (cert_is_cached (fpr))
+    return gpg_error (GPG_ERR_DUP_VALUE);
+
+  acquire_cache_write_lock ();
+  err = put_cert (cert, 0, 0, fpr);
+  release_cache_lock ();
+  return err;
+}
+
+
 /* Put CERT into the certificate cache.  */
 gpg_error_t
 cache_cert (ksba_cert_t cert)
 {
   gpg_error_t err;
 
-  acquire_cache_write_lock ();
-  err = put_cert (cert, 0, 0, NULL);
-  release_cache_lock ();
+  err = put_cert_if_new (cert, NULL);
   if (gpg_err_code (err) == GPG_ERR_DUP_VALUE)
     log_info (_("certificate already cached\n"));
   else if (!err)
@@ -903,9 +1085,7 @@ cache_cert_silent (ksba_cert_t cert, void *fpr_buffer)
 {
   gpg_error_t err;
 
-  acquire_cache_write_lock ();
-  err = put_cert (cert, 0, 0, fpr_buffer);
-  release_cache_lock ();
+  err = put_cert_if_new (cert, fpr_buffer);
   if (gpg_err_code (err) == GPG_ERR_DUP_VALUE)
     err = 0;
 
@@ -988,22 +1168,19 @@ get_cert_byhexfpr (const char *string)
 ksba_cert_t
 get_cert_bysn (const char *issuer_dn, ksba_sexp_t serialno)
 {
-  /* Simple and inefficient implementation.   fixme! */
   cert_item_t ci;
-  int i;
 
   acquire_cache_read_lock ();
-  for (i=0; i < 256; i++)
-    {
-      for (ci=cert_cache[i]; ci; ci = ci->next)
-        if (ci->cert && !strcmp (ci->issuer_dn, issuer_dn)
-            && !compare_serialno (ci->sn, serialno))
-          {
-            ksba_cert_ref (ci->cert);
-            release_cache_lock ();
-            return ci->cert;
-          }
-    }
+  for (ci = cert_index[INDEX_ISSUER_SN][index_by_issuer_sn (issuer_dn,
+                                                            serialno)];
+       ci; ci = ci->next_in[INDEX_ISSUER_SN])
+    if (ci->cert && !strcmp (ci->issuer_dn, issuer_dn)
+        && !compare_serialno (ci->sn, serialno))
+      {
+        ksba_cert_ref (ci->cert);
+        release_cache_lock ();
+        return ci->cert;
+      }
 
   release_cache_lock ();
   return NULL;
@@ -1015,22 +1192,18 @@ get_cert_bysn (const char *issuer_dn, ksba_sexp_t serialno)
 ksba_cert_t
 get_cert_byissuer (const char *issuer_dn, unsigned int seq)
 {
-  /* Simple and very inefficient implementation and API.  fixme! */
   cert_item_t ci;
-  int i;
 
   acquire_cache_read_lock ();
-  for (i=0; i < 256; i++)
-    {
-      for (ci=cert_cache[i]; ci; ci = ci->next)
-        if (ci->cert && !strcmp (ci->issuer_dn, issuer_dn))
-          if (!seq--)
-            {
-              ksba_cert_ref (ci->cert);
-              release_cache_lock ();
-              return ci->cert;
-            }
-    }
+  for (ci = cert_index[INDEX_ISSUER][index_by_string (issuer_dn)];
+       ci; ci = ci->next_in[INDEX_ISSUER])
+    if (ci->cert && !strcmp (ci->issuer_dn, issuer_dn))
+      if (!seq--)
+        {
+          ksba_cert_ref (ci->cert);
+          release_cache_lock ();
+          return ci->cert;
+        }
 
   release_cache_lock ();
   return NULL;
@@ -1042,26 +1215,22 @@ get_cert_byissuer (const char *issuer_dn, unsigned int seq)
 ksba_cert_t
 get_cert_bysubject (const char *subject_dn, unsigned int seq)
 {
-  /* Simple and very inefficient implementation and API.  fixme! */
   cert_item_t ci;
-  int i;
 
   if (!subject_dn)
     return NULL;
 
   acquire_cache_read_lock ();
-  for (i=0; i < 256; i++)
-    {
-      for (ci=cert_cache[i]; ci; ci = ci->next)
-        if (ci->cert && ci->subject_dn
-            && !strcmp (ci->subject_dn, subject_dn))
-          if (!seq--)
-            {
-              ksba_cert_ref (ci->cert);
-              release_cache_lock ();
-              return ci->cert;
-            }
-    }
+  for (ci = cert_index[INDEX_SUBJECT][index_by_string (subject_dn)];
+       ci; ci = ci->next_in[INDEX_SUBJECT])
+    if (ci->cert && ci->subject_dn
+        && !strcmp (ci->subject_dn, subject_dn))
+      if (!seq--)
+        {
+          ksba_cert_ref (ci->cert);
+          release_cache_lock ();
+          return ci->cert;
+        }
 
   release_cache_lock ();
   return NULL;
@@ -1502,24 +1671,23 @@ find_cert_bysubject (ctrl_t ctrl, const char *subject_dn, ksba_sexp_t keyid)
     {
       cert_item_t ci;
       cert_ref_t cr;
-      int i;
 
       /* For efficiency reasons we won't use get_cert_bysubject here. */
       acquire_cache_read_lock ();
-      for (i=0; i < 256; i++)
-        for (ci=cert_cache[i]; ci; ci = ci->next)
-          if (ci->cert && ci->subject_dn
-              && !strcmp (ci->subject_dn, subject_dn))
-            for (cr=ctrl->ocsp_certs; cr; cr = cr->next)
-              if (!memcmp (ci->fpr, cr->fpr, 20))
-                {
-                  ksba_cert_ref (ci->cert);
-                  release_cache_lock ();
-                  if (DBG_LOOKUP)
-                    log_debug ("%s: certificate found in the cache"
-                               " via ocsp_certs\n", __func__);
-                  return ci->cert; /* We use this certificate. */
-                }
+      for (ci = cert_index[INDEX_SUBJECT][index_by_string (subject_dn)];
+           ci; ci = ci->next_in[INDEX_SUBJECT])
+        if (ci->cert && ci->subject_dn
+            && !strcmp (ci->subject_dn, subject_dn))
+          for (cr=ctrl->ocsp_certs; cr; cr = cr->next)
+            if (!memcmp (ci->fpr, cr->fpr, 20))
+              {
+                ksba_cert_ref (ci->cert);
+                release_cache_lock ();
+                if (DBG_LOOKUP)
+                  log_debug ("%s: certificate found in the cache"
+                             " via ocsp_certs\n", __func__);
+                return ci->cert; /* We use this certificate. */
+              }
       release_cache_lock ();
       if (DBG_LOOKUP)
         log_debug ("find_cert_bysubject: certificate not in ocsp_certs\n");
@@ -1571,27 +1739,20 @@ find_cert_bysubject (ctrl_t ctrl, const char *subject_dn, ksba_sexp_t keyid)
    * by keyid.  */
   if (!subject_dn && keyid)
     {
-      int i;
       cert_item_t ci;
-      ksba_sexp_t ski;
 
       acquire_cache_read_lock ();
-      for (i=0; i < 256; i++)
-        for (ci=cert_cache[i]; ci; ci = ci->next)
-          if (ci->cert && !ksba_cert_get_subj_key_id (ci->cert, NULL, &ski))
-            {
-              if (!cmp_simple_canon_sexp (keyid, ski))
-                {
-                  ksba_free (ski);
-                  ksba_cert_ref (ci->cert);
-                  release_cache_lock ();
-                  if (DBG_LOOKUP)
-                    log_debug ("%s: certificate found in the cache"
-                               " via ski\n", __func__);
-                  return ci->cert;
-                }
-              ksba_free (ski);
-            }
+      for (ci = cert_index[INDEX_SKI][index_by_ski (keyid)];
+           ci; ci = ci->next_in[INDEX_SKI])
+        if (ci->cert && ci->ski && !cmp_simple_canon_sexp (keyid, ci->ski))
+          {
+            ksba_cert_ref (ci->cert);
+            release_cache_lock ();
+            if (DBG_LOOKUP)
+              log_debug ("%s: certificate found in the cache"
+                         " via ski\n", __func__);
+            return ci->cert;
+          }
       release_cache_lock ();
     }
 
@@ -102,6 +102,8 @@
 #include <sys/utsname.h>
 #endif
 
+#include <npth.h>
+
 #include "dirmngr.h"
 #include "validate.h"
 #include "certcache.h"
@@ -109,6 +111,7 @@
 #include "crlfetch.h"
 #include "misc.h"
 #include "cdb.h"
+#include "../common/hotpath.h"
 
 /* Change this whenever the format changes */
 #define DBDIR_D "crls.d"
@@ -121,6 +124,12 @@
    idea anyway to limit the number of opened cache files. */
 #define MAX_OPEN_DB_FILES 5
 
+/* A CRL which has been used is refreshed in the background this many
+   seconds before its nextUpdate time.  A failed refresh is retried
+   after CRL_REFRESH_RETRY seconds.  */
+#define CRL_REFRESH_AHEAD  3600
+#define CRL_REFRESH_RETRY  1800
+
 #ifndef O_BINARY
 # define O_BINARY 0
 #endif
@@ -155,6 +164,8 @@ struct crl_cache_entry_s
   ksba_isotime_t this_update;
   ksba_isotime_t next_update;
   ksba_isotime_t last_refresh; /* Use for the force_crl_refresh feature. */
+  int used;           /* The CRL has been looked up since it was loaded. */
+  time_t refresh_attempt; /* Time of the last background refresh.  */
   char *crl_number;
   char *authority_issuer;
   char *authority_serialno;
@@ -1038,7 +1049,11 @@ hash_dbfile (const char *fname, unsigned char *md5buffer)
         }
       if (!n)
         break;
+      /* Hashing a large file takes a while; let other threads run
+       * meanwhile.  */
+      npth_unprotect ();
       gcry_md_write (md5, buffer, n);
+      npth_protect ();
     }
   es_fclose (fp);
   xfree (buffer);
@@ -1262,6 +1277,7 @@ crl_cache_flush (void)
   crl_cache_deinit ();
   rc = cleanup_cache_dir (0)? -1 : 0;
   crl_cache_init ();
+  validate_flush_chain_cache ();
 
   return rc;
 }
@@ -1274,9 +1290,9 @@ crl_cache_flush (void)
    that invoking this function several times won't load the CRL over
    and over.  */
 static crl_cache_result_t
-cache_isvalid (ctrl_t ctrl, const char *issuer_hash,
-               const unsigned char *sn, size_t snlen,
-               int force_refresh)
+do_cache_isvalid (ctrl_t ctrl, const char *issuer_hash,
+                  const unsigned char *sn, size_t snlen,
+                  int force_refresh)
 {
   crl_cache_t cache = get_current_cache ();
   crl_cache_result_t retval;
@@ -1294,6 +1310,7 @@ cache_isvalid (ctrl_t ctrl, const char *issuer_hash,
       log_info (_("no CRL available for issuer id %s\n"), issuer_hash );
       return CRL_CACHE_DONTKNOW;
     }
+  entry->used = 1;
 
   gnupg_get_isotime (current_time);
   if (strcmp (entry->next_update, current_time) < 0 )
@@ -1417,6 +1434,20 @@ cache_isvalid (ctrl_t ctrl, const char *issuer_hash,
 }
 
 
+static crl_cache_result_t
+cache_isvalid (ctrl_t ctrl, const char *issuer_hash,
+               const unsigned char *sn, size_t snlen,
+               int force_refresh)
+{
+  crl_cache_result_t result;
+
+  HOTPATH_COUNT ("crl_cache_isvalid",
+                 result = do_cache_isvalid (ctrl, issuer_hash, sn, snlen,
+                                            force_refresh));
+  return result;
+}
+
+
 /* Check whether the certificate identified by ISSUER_HASH and
    SERIALNO is valid; i.e. not listed in our cache.  With
    FORCE_REFRESH set to true, a new CRL will be retrieved even if the
@@ -1888,6 +1919,176 @@ abort_sig_check (ksba_crl_t crl, gcry_md_hd_t md)
 }
 
 
+/* The size and number of the buffers used to pass the signed data of
+   a CRL to the hasher thread.  */
+#define CRL_HASH_BUFSIZE 65536
+#define CRL_HASH_NBUFS   4
+
+/* The state of a hasher thread.  The parser fills the buffer at TAIL
+   while the thread hashes the NFILLED buffers starting at HEAD.  */
+struct crl_hasher_s
+{
+  gcry_md_hd_t md;
+  npth_mutex_t lock;
+  npth_cond_t cond;
+  npth_t thread;
+  int stop;              /* No more buffers will be filled.  */
+  unsigned int head;
+  unsigned int tail;
+  unsigned int nfilled;
+  size_t used[CRL_HASH_NBUFS];
+  unsigned char buffers[CRL_HASH_NBUFS][CRL_HASH_BUFSIZE];
+};
+typedef struct crl_hasher_s *crl_hasher_t;
+
+
+/* The hasher thread.  The nPth lock is released while hashing so
+   that the parser can insert the items meanwhile.  */
+static void *
+crl_hasher_thread (void *opaque)
+{
+  crl_hasher_t hasher = opaque;
+  unsigned int idx;
+
+  npth_mutex_lock (&hasher->lock);
+  for (;;)
+    {
+      while (!hasher->nfilled && !hasher->stop)
+        npth_cond_wait (&hasher->cond, &hasher->lock);
+      if (!hasher->nfilled)
+        break;
+      idx = hasher->head;
+      npth_mutex_unlock (&hasher->lock);
+
+      npth_unprotect ();
+      gcry_md_write (hasher->md, hasher->buffers[idx], hasher->used[idx]);
+      npth_protect ();
+
+      npth_mutex_lock (&hasher->lock);
+      hasher->used[idx] = 0;
+      hasher->head = (idx + 1) % CRL_HASH_NBUFS;
+      hasher->nfilled--;
+      npth_cond_signal (&hasher->cond);
+    }
+  npth_mutex_unlock (&hasher->lock);
+  return NULL;
+}
+
+
+/* Pass the current buffer of HASHER to the thread and wait until the
+   next one is available.  */
+static void
+crl_hasher_submit (crl_hasher_t hasher)
+{
+  npth_mutex_lock (&hasher->lock);
+  hasher->nfilled++;
+  hasher->tail = (hasher->tail + 1) % CRL_HASH_NBUFS;
+  npth_cond_signal (&hasher->cond);
+  while (hasher->nfilled == CRL_HASH_NBUFS)
+    npth_cond_wait (&hasher->cond, &hasher->lock);
+  npth_mutex_unlock (&hasher->lock);
+}
+
+
+/* The hash function set for Libksba.  */
+static void
+crl_hasher_write (void *opaque, const void *buffer, size_t length)
+{
+  crl_hasher_t hasher = opaque;
+  const unsigned char *p = buffer;
+  size_t n;
+
+  while (length)
+    {
+      n = CRL_HASH_BUFSIZE - hasher->used[hasher->tail];
+      if (n > length)
+        n = length;
+      memcpy (hasher->buffers[hasher->tail] + hasher->used[hasher->tail],
+              p, n);
+      hasher->used[hasher->tail] += n;
+      p += n;
+      length -= n;
+      if (hasher->used[hasher->tail] == CRL_HASH_BUFSIZE)
+        crl_hasher_submit (hasher);
+    }
+}
+
+
+/* Start a thread which hashes the signed data of CRL into MD.  This
+   is used after start_sig_check so that hashing a large CRL runs
+   concurrently with the insertion of its items.  Returns NULL if no
+   thread could be started; the data is then hashed by the parser as
+   before.  */
+static crl_hasher_t
+start_crl_hasher (ksba_crl_t crl, gcry_md_hd_t md)
+{
+  crl_hasher_t hasher;
+  npth_attr_t tattr;
+  int rc;
+
+  hasher = xtrycalloc (1, sizeof *hasher);
+  if (!hasher)
+    return NULL;
+  hasher->md = md;
+  if (npth_mutex_init (&hasher->lock, NULL))
+    {
+      xfree (hasher);
+      return NULL;
+    }
+  if (npth_cond_init (&hasher->cond, NULL))
+    {
+      npth_mutex_destroy (&hasher->lock);
+      xfree (hasher);
+      return NULL;
+    }
+
+  rc = npth_attr_init (&tattr);
+  if (!rc)
+    {
+      npth_attr_setdetachstate (&tattr, NPTH_CREATE_JOINABLE);
+      rc = npth_create (&hasher->thread, &tattr, crl_hasher_thread, hasher);
+      npth_attr_destroy (&tattr);
+    }
+  if (rc)
+    {
+      log_info ("error starting the CRL hasher thread: %s\n",
+                strerror (rc));
+      npth_cond_destroy (&hasher->cond);
+      npth_mutex_destroy (&hasher->lock);
+      xfree (hasher);
+      return NULL;
+    }
+
+  ksba_crl_set_hash_function (crl, crl_hasher_write, hasher);
+  return hasher;
+}
+
+
+/* Hash the remaining data of HASHER, wait for its thread and release
+   it.  Thereafter the hash context is complete.  */
+static void
+stop_crl_hasher (crl_hasher_t hasher)
+{
+  if (!hasher)
+    return;
+
+  npth_mutex_lock (&hasher->lock);
+  if (hasher->used[hasher->tail])
+    {
+      hasher->nfilled++;
+      hasher->tail = (hasher->tail + 1) % CRL_HASH_NBUFS;
+    }
+  hasher->stop = 1;
+  npth_cond_signal (&hasher->cond);
+  npth_mutex_unlock (&hasher->lock);
+  npth_join (hasher->thread, NULL);
+
+  npth_cond_destroy (&hasher->cond);
+  npth_mutex_destroy (&hasher->lock);
+  xfree (hasher);
+}
+
+
 /* Workhorse of the CRL loading machinery.  The CRL is read using the
    CRL object and stored in the data base file DB with the name FNAME
    (only used for printing error messages).  That DB should be a
@@ -1914,6 +2115,7 @@ crl_parse_insert (ctrl_t ctrl, ksba_crl_t crl,
   ksba_stop_reason_t stopreason;
   ksba_cert_t crlissuer_cert = NULL;
   gcry_md_hd_t md = NULL;
+  crl_hasher_t hasher = NULL;
   int algo = 0;
   int use_pss = 0;
   size_t n;
@@ -1941,6 +2143,7 @@ crl_parse_insert (ctrl_t ctrl, ksba_crl_t crl,
             err = start_sig_check (crl, &md, &algo, &use_pss);
             if (err)
               goto failure;
+            hasher = start_crl_hasher (crl, md);
 
             err = ksba_crl_get_update_times (crl, thisupdate, nextupdate);
             if (err)
@@ -2075,6 +2278,8 @@ crl_parse_insert (ctrl_t ctrl, ksba_crl_t crl,
                 goto failure;
               }
 
+            stop_crl_hasher (hasher);
+            hasher = NULL;
             err = finish_sig_check (crl, md, algo, crlissuer_cert, use_pss);
             md = NULL; /* Closed.  */
             if (err)
@@ -2111,6 +2316,7 @@ crl_parse_insert (ctrl_t ctrl, ksba_crl_t crl,
 
 
  failure:
+  stop_crl_hasher (hasher);
   abort_sig_check (crl, md);
   ksba_cert_release (crlissuer_cert);
   return err;
@@ -2118,6 +2324,24 @@ crl_parse_insert (ctrl_t ctrl, ksba_crl_t crl,
 
 
 
+/* Finish the database CDB which is private to the caller.  Building
+   the hash tables of a large CRL may take quite some time but does
+   not touch any shared data; thus we let other threads run in the
+   meantime.  Returns 0 on success or -1 with ERRNO set.  */
+static int
+finish_cdb (struct cdb_make *cdb)
+{
+  int rc, saved_errno;
+
+  npth_unprotect ();
+  rc = cdb_make_finish (cdb);
+  saved_errno = errno;
+  npth_protect ();
+  gpg_err_set_errno (saved_errno);
+  return rc;
+}
+
+
 /* Return the crlNumber extension as an allocated hex string or NULL
    if there is none. */
 static char *
@@ -2300,12 +2524,12 @@ crl_cache_insert (ctrl_t ctrl, const char *url, ksba_reader_t reader)
     {
       log_error (_("crl_parse_insert failed: %s\n"), gpg_strerror (err));
       /* Error in cleanup ignored.  */
-      cdb_make_finish (&cdb);
+      finish_cdb (&cdb);
       goto leave;
     }
 
   /* Finish the database. */
-  if (cdb_make_finish (&cdb))
+  if (finish_cdb (&cdb))
     {
       err = gpg_error_from_errno (errno);
       log_error (_("error finishing temporary cache file '%s': %s\n"),
@@ -2464,6 +2688,9 @@ crl_cache_insert (ctrl_t ctrl, const char *url, ksba_reader_t reader)
   cache->entries = entry;
   entry = NULL;
 
+  /* Cached chain validations may now be outdated.  */
+  validate_flush_chain_cache ();
+
   err = update_dir (cache);
   if (err)
     {
@@ -2807,3 +3034,104 @@ crl_cache_reload_crl (ctrl_t ctrl, ksba_cert_t cert)
   ksba_free (issuer);
   return err;
 }
+
+
+/* Return true if the CRL of ENTRY can be refetched from its URL.  */
+static int
+refreshable_entry_p (crl_cache_entry_t entry)
+{
+  const char *url = entry->url;
+
+  if (!url)
+    return 0;
+  if (!strncmp (url, "http:", 5) || !strncmp (url, "https:", 6))
+    return !opt.ignore_http_dp && !opt.disable_http;
+  if (!strncmp (url, "ldap:", 5) || !strncmp (url, "ldaps:", 6))
+    return !opt.ignore_ldap_dp && !opt.disable_ldap;
+  return 0;  /* E.g. a file loaded using LOADCRL.  */
+}
+
+
+/* Task to refresh the CRL of the issuer identified by ISSUER_HASH.  */
+static const char *
+task_refresh_crl (ctrl_t ctrl, const char *issuer_hash)
+{
+  gpg_error_t err;
+  crl_cache_entry_t entry;
+  ksba_reader_t reader = NULL;
+  char *url;
+
+  if (!ctrl || !issuer_hash)
+    return "refresh_crl";
+
+  entry = find_entry (get_current_cache ()->entries, issuer_hash);
+  if (!entry || !refreshable_entry_p (entry))
+    return NULL;  /* Gone in the meantime.  */
+
+  /* Take a copy because the entry may be replaced while we fetch.  */
+  url = xtrystrdup (entry->url);
+  if (!url)
+    {
+      log_error ("%s: %s\n", __func__, gpg_strerror (gpg_error_from_syserror ()));
+      return NULL;
+    }
+
+  /* Tell the server to send the CRL only if it has changed since we
+   * fetched it.  */
+  if (*entry->last_refresh)
+    ctrl->http_if_modified_since = isotime2epoch (entry->last_refresh);
+  if (ctrl->http_if_modified_since == (time_t)(-1))
+    ctrl->http_if_modified_since = 0;
+
+  if (opt.verbose)
+    log_info ("refreshing CRL for issuer id %s from '%s'\n", issuer_hash, url);
+  err = crl_fetch (ctrl, url, &reader);
+  ctrl->http_if_modified_since = 0;
+  if (gpg_err_code (err) == GPG_ERR_ALREADY_FETCHED)
+    {
+      if (opt.verbose)
+        log_info ("CRL for issuer id %s has not been modified\n", issuer_hash);
+    }
+  else if (err)
+    log_error (_("crl_fetch via DP failed: %s\n"), gpg_strerror (err));
+  else if ((err = crl_cache_insert (ctrl, url, reader)))
+    log_error (_("crl_cache_insert via DP failed: %s\n"), gpg_strerror (err));
+
+  crl_close_reader (reader);
+  xfree (url);
+  return NULL;
+}
+
+
+/* Schedule a background refresh for all CRLs which have been used
+   and which will expire soon.  This is called by the housekeeping
+   thread; the actual work is done by the workqueue.  */
+void
+crl_cache_schedule_refresh (void)
+{
+  crl_cache_t cache = current_cache;
+  crl_cache_entry_t entry;
+  time_t now, next_update;
+
+  if (!cache)
+    return;
+
+  now = gnupg_get_time ();
+  for (entry = cache->entries; entry; entry = entry->next)
+    {
+      if (entry->deleted || !entry->used || !refreshable_entry_p (entry))
+        continue;
+      if (entry->refresh_attempt
+          && entry->refresh_attempt + CRL_REFRESH_RETRY > now)
+        continue;
+      next_update = isotime2epoch (entry->next_update);
+      if (next_update == (time_t)(-1) || next_update - CRL_REFRESH_AHEAD > now)
+        continue;
+
+      entry->refresh_attempt = now;
+      if (workqueue_add_task (task_refresh_crl, entry->issuer_hash, 0, 1,
+                              WQ_PRIO_HIGH))
+        log_error ("error scheduling a CRL refresh for issuer id %s\n",
+                   entry->issuer_hash);
+    }
+}
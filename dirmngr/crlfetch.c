@@ -162,7 +162,9 @@ no_crl_due_to_tor (ctrl_t ctrl)
 
 /* Fetch CRL from URL and return the entire CRL using new ksba reader
    object in READER.  Note that this reader object should be closed
-   only using ldap_close_reader. */
+   only using ldap_close_reader.  If CTRL->HTTP_IF_MODIFIED_SINCE is
+   set and a HTTP server tells that the CRL has not been modified
+   since then, GPG_ERR_ALREADY_FETCHED is returned. */
 gpg_error_t
 crl_fetch (ctrl_t ctrl, const char *url, ksba_reader_t *reader)
 {
@@ -199,10 +201,12 @@ crl_fetch (ctrl_t ctrl, const char *url, ksba_reader_t *reader)
                                (KS_HTTP_FETCH_TRUST_CFG
                                 | KS_HTTP_FETCH_NO_CRL
                                 | KS_HTTP_FETCH_ALLOW_DOWNGRADE ),
-                               &httpfp);
+                               NULL, &httpfp);
         }
 
-      if (err)
+      if (gpg_err_code (err) == GPG_ERR_ALREADY_FETCHED)
+        ; /* Not modified since CTRL->HTTP_IF_MODIFIED_SINCE.  */
+      else if (err)
         log_error (_("error retrieving '%s': %s\n"), url, gpg_strerror (err));
       else
         {
@@ -427,7 +431,8 @@ read_cert_via_http (ctrl_t ctrl, const char *url, estream_t *r_fp)
   size_t nread, nwritten;
   char buffer[1024];
 
-  if ((err = ks_http_fetch (ctrl, url, KS_HTTP_FETCH_TRUST_CFG, &httpfp)))
+  if ((err = ks_http_fetch (ctrl, url, KS_HTTP_FETCH_TRUST_CFG,
+                            NULL, &httpfp)))
     goto leave;
 
   /* We now read the data from the web server into a memory buffer.
@@ -70,9 +70,12 @@
 #include "../common/asshelp.h"
 #if USE_LDAP
 # include "ldap-wrapper.h"
+# include "ks-engine.h"
 #endif
 #include "../common/comopt.h"
 #include "../common/init.h"
+#include "../common/asynclog.h"
+#include "../common/hotpath.h"
 #include "../common/gc-opt-flags.h"
 #include "dns-stuff.h"
 #include "http-common.h"
@@ -114,6 +117,7 @@ enum cmd_and_opt_values {
   oHomedir,
   oNoDetach,
   oLogFile,
+  oLogAsync,
   oBatch,
   oDisableHTTP,
   oDisableLDAP,
@@ -122,6 +126,7 @@ enum cmd_and_opt_values {
   oIgnoreLDAPDP,
   oIgnoreHTTPDP,
   oIgnoreOCSPSvcUrl,
+  oDisableOCSPNonce,
   oHonorHTTPProxy,
   oHTTPProxy,
   oLDAPProxy,
@@ -157,6 +162,8 @@ enum cmd_and_opt_values {
   oResolverTimeout,
   oConnectTimeout,
   oConnectQuickTimeout,
+  oAKLCacheTTL,
+  oAKLCacheNegTTL,
   oListenBacklog,
   oFakeCRL,
   aTest
@@ -209,6 +216,7 @@ static gpgrt_opt_t opts[] = {
   ARGPARSE_s_i (oDebugWait, "debug-wait", "@"),
   ARGPARSE_s_s (oLogFile,  "log-file",
                 N_("|FILE|write server mode logs to FILE")),
+  ARGPARSE_s_n (oLogAsync, "log-async", "@"),
 
 
   ARGPARSE_header ("Configuration",
@@ -237,6 +245,8 @@ static gpgrt_opt_t opts[] = {
   ARGPARSE_s_s (oNameServer, "nameserver", "@"),
   ARGPARSE_s_i (oConnectTimeout, "connect-timeout", "@"),
   ARGPARSE_s_i (oConnectQuickTimeout, "connect-quick-timeout", "@"),
+  ARGPARSE_s_u (oAKLCacheTTL, "akl-cache-ttl", "@"),
+  ARGPARSE_s_u (oAKLCacheNegTTL, "akl-cache-neg-ttl", "@"),
 
 
   ARGPARSE_header ("HTTP", N_("Configuration for HTTP servers")),
@@ -282,6 +292,8 @@ static gpgrt_opt_t opts[] = {
   ARGPARSE_s_n (oAllowOCSP, "allow-ocsp", N_("allow sending OCSP requests")),
   ARGPARSE_s_n (oIgnoreOCSPSvcUrl, "ignore-ocsp-service-url",
                 N_("ignore certificate contained OCSP service URLs")),
+  ARGPARSE_s_n (oDisableOCSPNonce, "disable-ocsp-nonce",
+                N_("do not send nonces and cache OCSP responses")),
   ARGPARSE_s_s (oOCSPResponder, "ocsp-responder",
                 N_("|URL|use OCSP responder at URL")),
   ARGPARSE_s_s (oOCSPSigner, "ocsp-signer",
@@ -335,6 +347,9 @@ static struct debug_flags_s debug_flags [] =
 #define DEFAULT_CONNECT_TIMEOUT       (15*1000)  /* 15 seconds */
 #define DEFAULT_CONNECT_QUICK_TIMEOUT ( 2*1000)  /*  2 seconds */
 
+#define DEFAULT_AKL_CACHE_TTL     (24*3600)   /* One day.  */
+#define DEFAULT_AKL_CACHE_NEG_TTL (30*60)     /* 30 minutes.  */
+
 /* For the cleanup handler we need to keep track of the socket's name.  */
 static const char *socket_name;
 /* If the socket has been redirected, this is the name of the
@@ -676,6 +691,7 @@ parse_rereadable_options (gpgrt_argparse_t *pargs, int reread)
       opt.ignore_http_dp = 0;
       opt.ignore_ldap_dp = 0;
       opt.ignore_ocsp_service_url = 0;
+      opt.disable_ocsp_nonce = 0;
       opt.allow_ocsp = 0;
       opt.allow_version_check = 0;
       opt.ocsp_responder = NULL;
@@ -708,6 +724,8 @@ parse_rereadable_options (gpgrt_argparse_t *pargs, int reread)
       opt.connect_timeout = 0;
       opt.connect_quick_timeout = 0;
       opt.ldaptimeout = DEFAULT_LDAP_TIMEOUT;
+      opt.akl_cache_ttl = DEFAULT_AKL_CACHE_TTL;
+      opt.akl_cache_neg_ttl = DEFAULT_AKL_CACHE_NEG_TTL;
       ldapserver_list_needs_reset = 1;
       opt.debug_cache_expired_certs = 0;
       xfree (opt.fake_crl);
@@ -733,6 +751,8 @@ parse_rereadable_options (gpgrt_argparse_t *pargs, int reread)
           || strcmp (current_logfile, pargs->r.ret_str))
         {
           log_set_file (pargs->r.ret_str);
+          if (opt.log_async)
+            async_log_start ();
           xfree (current_logfile);
           current_logfile = xtrystrdup (pargs->r.ret_str);
         }
@@ -758,6 +778,7 @@ parse_rereadable_options (gpgrt_argparse_t *pargs, int reread)
     case oIgnoreHTTPDP: opt.ignore_http_dp = 1; break;
     case oIgnoreLDAPDP: opt.ignore_ldap_dp = 1; break;
     case oIgnoreOCSPSvcUrl: opt.ignore_ocsp_service_url = 1; break;
+    case oDisableOCSPNonce: opt.disable_ocsp_nonce = 1; break;
 
     case oAllowOCSP: opt.allow_ocsp = 1; break;
     case oAllowVersionCheck: opt.allow_version_check = 1; break;
@@ -870,6 +891,14 @@ parse_rereadable_options (gpgrt_argparse_t *pargs, int reread)
       opt.ldaptimeout = pargs->r.ret_int;
       break;
 
+    case oAKLCacheTTL:
+      opt.akl_cache_ttl = pargs->r.ret_uint;
+      break;
+
+    case oAKLCacheNegTTL:
+      opt.akl_cache_neg_ttl = pargs->r.ret_uint;
+      break;
+
     case oDebugCacheExpiredCerts:
       opt.debug_cache_expired_certs = 0;
       break;
@@ -1139,6 +1168,7 @@ main (int argc, char **argv)
         case oNoDetach: nodetach = 1; break;
         case oStealSocket: steal_socket = 1; break;
         case oLogFile: logfile = pargs.r.ret_str; break;
+        case oLogAsync: opt.log_async = 1; break;
         case oCsh: csh_style = 1; break;
         case oSh: csh_style = 0; break;
 	case oLDAPFile:
@@ -1993,6 +2023,8 @@ reread_configuration (void)
           || strcmp (current_logfile, comopt.logfile))
         {
           log_set_file (comopt.logfile);
+          if (opt.log_async)
+            async_log_start ();
           xfree (current_logfile);
           current_logfile = comopt.logfile? xtrystrdup (comopt.logfile) : NULL;
         }
@@ -2014,7 +2046,13 @@ dirmngr_sighup_action (void)
   cert_cache_init (hkp_cacert_filenames);
   crl_cache_init ();
   reload_dns_stuff (0);
+  http_release_idle_connections ();
+  domaininfo_flush_wkd_cache ();
+  domaininfo_flush_akl_cache ();
   ks_hkp_reload ();
+#if USE_LDAP
+  ks_ldap_release_idle_connections (1);
+#endif
 }
 
 
@@ -2048,6 +2086,7 @@ handle_signal (int signo)
 
     case SIGUSR2:
       log_info (_("SIGUSR2 received - no action defined\n"));
+      hotpath_dump ();
       break;
 
     case SIGTERM:
@@ -2080,6 +2119,20 @@ handle_signal (int signo)
 #endif /*!HAVE_W32_SYSTEM*/
 
 
+/* Task to update the software version database.  */
+static const char *
+task_load_swdb (ctrl_t ctrl, const char *args)
+{
+  (void)args;
+
+  if (!ctrl)
+    return "load_swdb";
+
+  dirmngr_load_swdb (ctrl, 0);
+  return NULL;
+}
+
+
 /* Thread to do the housekeeping.  */
 static void *
 housekeeping_thread (void *arg)
@@ -2105,11 +2158,16 @@ housekeeping_thread (void *arg)
 
   dns_stuff_housekeeping ();
   ks_hkp_housekeeping (curtime);
+#if USE_LDAP
+  ks_ldap_release_idle_connections (0);
+#endif
+  crl_cache_schedule_refresh ();
   if (network_activity_seen)
     {
       network_activity_seen = 0;
-      if (opt.allow_version_check)
-        dirmngr_load_swdb (&ctrlbuf, 0);
+      if (opt.allow_version_check
+          && workqueue_add_task (task_load_swdb, "", 0, 1, WQ_PRIO_LOW))
+        log_error ("error scheduling the swdb update\n");
       workqueue_run_global_tasks (&ctrlbuf, 1);
     }
   else
@@ -2304,6 +2362,11 @@ handle_connections (assuan_fd_t listen_fd)
   int saved_errno;
   int my_inotify_fd = -1;
 
+  /* Now that we are detached and npth is running the log may be
+   * written by a separate thread.  */
+  if (opt.log_async)
+    async_log_start ();
+
   npth_attr_init (&tattr);
   npth_attr_setdetachstate (&tattr, NPTH_CREATE_DETACHED);
 
@@ -90,6 +90,7 @@ struct
   int quiet;          /* be as quiet as possible */
   int dry_run;        /* don't change any persistent data */
   int batch;          /* batch mode */
+  int log_async;      /* Write the log from a separate thread.  */
   const char *homedir_cache; /* Dir for cache files (/var/cache/dirmngr).  */
 
   char *config_filename;     /* Name of a config file, which will be
@@ -122,6 +123,8 @@ struct
   int ignore_ldap_dp;     /* Ignore LDAP CRL distribution points.  */
   int ignore_ocsp_service_url; /* Ignore OCSP service URLs as given in
                                   the certificate.  */
+  int disable_ocsp_nonce; /* Do not send nonces with OCSP requests
+                             so that responses can be cached.  */
 
   /* A list of fingerprints of certififcates we should completely
    * ignore.  These are all stored in binary format.  */
@@ -154,6 +157,9 @@ struct
                                        current after nextUpdate. */
 
   strlist_t keyserver;              /* List of default keyservers.  */
+
+  unsigned int akl_cache_ttl;     /* Seconds to keep found AKL results.  */
+  unsigned int akl_cache_neg_ttl; /* Seconds to keep failed AKL lookups.  */
 } opt;
 
 
@@ -225,6 +231,8 @@ struct server_control_s
 
   unsigned int timeout; /* Timeout for connect calls in ms.  */
 
+  time_t http_if_modified_since; /* If set send an If-Modified-Since.  */
+
   unsigned int http_no_crl:1;  /* Do not check CRLs for https.  */
   unsigned int rootdse_tried:1;/* Already tried to get the rootDSE.  */
 };
@@ -279,13 +287,31 @@ void domaininfo_set_no_name (const char *domain);
 void domaininfo_set_wkd_supported (const char *domain);
 void domaininfo_set_wkd_not_supported (const char *domain);
 void domaininfo_set_wkd_not_found (const char *domain);
+void domaininfo_flush_wkd_cache (void);
+int  domaininfo_get_wkd_result (const char *hash, const char *domain,
+                                void **r_data, size_t *r_datalen,
+                                gpg_error_t *r_err);
+void domaininfo_put_wkd_result (const char *hash, const char *domain,
+                                const void *data, size_t datalen,
+                                gpg_error_t err, unsigned int maxage);
+void domaininfo_flush_akl_cache (void);
+int  domaininfo_get_akl_result (const char *mechanism, const char *mbox,
+                                char *r_fpr, gpg_error_t *r_err);
+void domaininfo_put_akl_result (const char *mechanism, const char *mbox,
+                                const char *fpr, gpg_error_t err);
 
 /*-- workqueue.c --*/
 typedef const char *(*wqtask_t)(ctrl_t ctrl, const char *args);
 
+/* Priorities for workqueue tasks; lower values run first.  */
+#define WQ_PRIO_HIGH    0
+#define WQ_PRIO_NORMAL  1
+#define WQ_PRIO_LOW     2
+
 void workqueue_dump_queue (ctrl_t ctrl);
 gpg_error_t workqueue_add_task (wqtask_t func, const char *args,
-                                unsigned int session_id, int need_network);
+                                unsigned int session_id, int need_network,
+                                int priority);
 void workqueue_run_global_tasks (ctrl_t ctrl, int with_network);
 void workqueue_run_post_session_tasks (unsigned int session_id);
 
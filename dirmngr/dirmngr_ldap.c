@@ -72,6 +72,9 @@ static void npth_protect (void) { }
 
 #define DEFAULT_LDAP_TIMEOUT 15 /* Arbitrary long timeout. */
 
+/* The maximum number of arguments accepted in server mode.  */
+#define MAX_SERVER_ARGS 64
+
 
 /* Constants for the options.  */
 enum
@@ -156,6 +159,9 @@ static struct
 #ifndef HAVE_W32_SYSTEM
 static void catch_alarm (int dummy);
 #endif
+static int process_request (int argc, char **argv, estream_t outstream);
+static int server_loop (void);
+static void clear_timeout (void);
 static gpg_error_t connect_ldap (LDAP **r_ld);
 static gpg_error_t process_filter (LDAP *ld, const char *string);
 
@@ -196,13 +202,6 @@ my_strusage (int level)
 int
 main (int argc, char **argv)
 {
-  gpgrt_argparse_t pargs;
-  int any_err = 0;
-  char *p;
-  int only_search_timeout = 0;
-  char *malloced_buffer1 = NULL;
-  LDAP *ld;
-
   early_system_init ();
 
   gpgrt_set_strusage (my_strusage);
@@ -211,7 +210,34 @@ main (int argc, char **argv)
   init_common_subsystems (&argc, &argv);
 
   es_set_binary (es_stdout);
-  opt.outstream = es_stdout;
+
+  /* The server mode must be requested by the first argument because
+   * the remaining arguments are read per request from stdin.  */
+  if (argc > 1 && !strcmp (argv[1], "--server"))
+    return server_loop ();
+
+  return process_request (argc, argv, es_stdout);
+}
+
+
+/* Parse the options in ARGV and run the requested queries writing
+ * the result to OUTSTREAM.  ARGV[0] is the program name.  Returns 0
+ * on success, 1 on a query error and 2 on a usage error.  */
+static int
+process_request (int argc, char **argv, estream_t outstream)
+{
+  gpgrt_argparse_t pargs;
+  int any_err = 0;
+  char *p;
+  int only_search_timeout = 0;
+  char *malloced_buffer1 = NULL;
+  unsigned int errcount;
+  LDAP *ld;
+
+  errcount = log_get_errorcount (0);
+
+  memset (&opt, 0, sizeof opt);
+  opt.outstream = outstream;
 
   /* LDAP defaults */
   opt.timeout.tv_sec = DEFAULT_LDAP_TIMEOUT;
@@ -219,6 +245,7 @@ main (int argc, char **argv)
   opt.alarm_timeout = 0;
 
   /* Parse the command line.  */
+  memset (&pargs, 0, sizeof pargs);
   pargs.argc = &argc;
   pargs.argv = &argv;
   pargs.flags= ARGPARSE_FLAG_KEEP;
@@ -298,8 +325,11 @@ main (int argc, char **argv)
 #endif
 
 
-  if (log_get_errorcount (0))
-    exit (2);
+  if (log_get_errorcount (0) != errcount)
+    {
+      xfree (malloced_buffer1);
+      return 2;
+    }
 
   if (opt.alarm_timeout)
     {
@@ -336,10 +366,164 @@ main (int argc, char **argv)
       ldap_unbind (ld);
     }
 
+  clear_timeout ();
   xfree (malloced_buffer1);
   return any_err;
 }
 
+
+/* Cookie write function for the per-request output stream in server
+ * mode.  Each chunk is sent to stdout as a data frame
+ *
+ *   D <reqid> <length> LF <length bytes>
+ *
+ * so that dirmngr can tell apart the responses to its requests.  */
+static gpgrt_ssize_t
+frame_writer (void *cookie, const void *buffer, size_t size)
+{
+  unsigned int *reqid = cookie;
+
+  if (!buffer && !size)
+    return 0;  /* Flush - nothing to do.  */
+
+  if (es_fprintf (es_stdout, "D %u %lu\n", *reqid, (unsigned long)size) < 0
+      || es_fwrite (buffer, size, 1, es_stdout) != 1)
+    return -1;
+  return size;
+}
+
+static es_cookie_io_functions_t frame_cookie_functions =
+  {
+    NULL,
+    frame_writer,
+    NULL,
+    NULL
+  };
+
+
+/* Run as a long-lived helper for dirmngr.  Requests are read from
+ * stdin as
+ *
+ *   REQ <reqid> <nargs> LF
+ *   <arg> LF
+ *   ...
+ *
+ * where each of the NARGS arguments is percent-plus escaped and
+ * consists of the same options and filters as used on the command
+ * line.  The output is sent as data frames (see frame_writer) and
+ * the request is terminated by
+ *
+ *   E <reqid> <rc> LF
+ *
+ * with RC being the value the one-shot mode would use as exit code.
+ * The helper terminates on EOF from stdin.  A timeout still
+ * terminates the process with exit code 10; dirmngr will then start a
+ * new one.  */
+static int
+server_loop (void)
+{
+  char *line = NULL;
+  size_t linesize = 0;
+  size_t maxlen;
+  gpgrt_ssize_t len;
+  unsigned int reqid;
+  int nargs, i;
+  char **args;
+  char *p;
+  estream_t fp;
+  int rc = 0;
+
+  for (;;)
+    {
+      maxlen = 1024;
+      len = es_read_line (es_stdin, &line, &linesize, &maxlen);
+      if (len < 0)
+        {
+          log_error ("error reading request: %s\n",
+                     gpg_strerror (gpg_error_from_syserror ()));
+          rc = 2;
+          break;
+        }
+      if (!len)
+        break;  /* EOF - dirmngr does not want us anymore.  */
+      if (!maxlen || strncmp (line, "REQ ", 4))
+        {
+          log_error ("invalid request line received\n");
+          rc = 2;
+          break;
+        }
+      reqid = strtoul (line + 4, &p, 10);
+      nargs = atoi (p);
+      if (nargs < 0 || nargs > MAX_SERVER_ARGS)
+        {
+          log_error ("invalid number of arguments in request\n");
+          rc = 2;
+          break;
+        }
+
+      args = xtrycalloc (nargs + 2, sizeof *args);
+      if (!args)
+        {
+          log_error ("error allocating memory: %s\n", strerror (errno));
+          rc = 2;
+          break;
+        }
+      args[0] = xtrystrdup ("dirmngr_ldap");
+      for (i=1; args[0] && i <= nargs; i++)
+        {
+          maxlen = 16384;
+          len = es_read_line (es_stdin, &line, &linesize, &maxlen);
+          if (len <= 0 || !maxlen)
+            {
+              log_error ("error reading request argument\n");
+              rc = 2;
+              break;
+            }
+          trim_trailing_chars ((unsigned char *)line, len, "\n");
+          percent_plus_unescape_inplace (line, 0);
+          args[i] = xtrystrdup (line);
+          if (!args[i])
+            {
+              log_error ("error allocating memory: %s\n", strerror (errno));
+              rc = 2;
+              break;
+            }
+        }
+      if (!args[0])
+        rc = 2;
+
+      if (!rc)
+        {
+          fp = es_fopencookie (&reqid, "w", frame_cookie_functions);
+          if (!fp)
+            {
+              log_error ("error creating output stream: %s\n",
+                         gpg_strerror (gpg_error_from_syserror ()));
+              rc = 2;
+            }
+          else
+            {
+              i = process_request (nargs + 1, args, fp);
+              if (es_fclose (fp) && !i)
+                i = 1;
+              es_fprintf (es_stdout, "E %u %d\n", reqid, i);
+              if (es_fflush (es_stdout))
+                rc = 2;
+            }
+        }
+
+      for (i=0; i <= nargs; i++)
+        xfree (args[i]);
+      xfree (args);
+      if (rc)
+        break;
+    }
+
+  xfree (line);
+  return rc;
+}
+
+
 #ifndef HAVE_W32_SYSTEM
 static void
 catch_alarm (int dummy)
@@ -364,19 +548,23 @@ alarm_thread (void *arg)
 #endif
 
 
+#ifdef HAVE_W32_SYSTEM
+/* The timer used by set_timeout.  */
+static HANDLE alarm_timer;
+#endif
+
 static void
 set_timeout (void)
 {
   if (opt.alarm_timeout)
     {
 #ifdef HAVE_W32_SYSTEM
-      static HANDLE timer;
       LARGE_INTEGER due_time;
 
       /* A negative value is a relative time.  */
       due_time.QuadPart = (unsigned long long)-10000000 * opt.alarm_timeout;
 
-      if (!timer)
+      if (!alarm_timer)
         {
           SECURITY_ATTRIBUTES sec_attr;
           DWORD tid;
@@ -386,15 +574,15 @@ set_timeout (void)
           sec_attr.bInheritHandle = FALSE;
 
           /* Create a manual resettable timer.  */
-          timer = CreateWaitableTimer (NULL, TRUE, NULL);
+          alarm_timer = CreateWaitableTimer (NULL, TRUE, NULL);
           /* Initially set the timer.  */
-          SetWaitableTimer (timer, &due_time, 0, NULL, NULL, 0);
+          SetWaitableTimer (alarm_timer, &due_time, 0, NULL, NULL, 0);
 
-          if (CreateThread (&sec_attr, 0, alarm_thread, timer, 0, &tid))
+          if (CreateThread (&sec_attr, 0, alarm_thread, alarm_timer, 0, &tid))
             log_error ("failed to create alarm thread\n");
         }
       else /* Retrigger the timer.  */
-        SetWaitableTimer (timer, &due_time, 0, NULL, NULL, 0);
+        SetWaitableTimer (alarm_timer, &due_time, 0, NULL, NULL, 0);
 #else
       alarm (opt.alarm_timeout);
 #endif
@@ -402,6 +590,23 @@ set_timeout (void)
 }
 
 
+/* Stop a timeout started by set_timeout.  This is required in server
+ * mode where the process lives on after the request.  */
+static void
+clear_timeout (void)
+{
+  if (opt.alarm_timeout)
+    {
+#ifdef HAVE_W32_SYSTEM
+      if (alarm_timer)
+        CancelWaitableTimer (alarm_timer);
+#else
+      alarm (0);
+#endif
+    }
+}
+
+
 
 /* Connect to the ldap server.  On success the connection handle is
  * stored at R_LD. */
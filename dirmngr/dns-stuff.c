@@ -44,6 +44,7 @@
 #  include <resolv.h>
 # endif
 # include <netdb.h>
+# include <sys/select.h>
 #endif
 #ifdef HAVE_STAT
 # include <sys/stat.h>
@@ -108,6 +109,16 @@
 #define TOR_PORT2  9150   /* (Used by the Tor browser) */
 
 
+/* Parameters of the answer cache.  The TTL of an answer is capped
+ * at DNS_CACHE_MAX_TTL; negative answers are kept for at most
+ * DNS_CACHE_NEG_TTL seconds.  If the TTL is not known (getaddrinfo
+ * and the standard resolver for CERT and CNAME) DNS_CACHE_DEF_TTL is
+ * used.  */
+#define DNS_CACHE_SIZE     256
+#define DNS_CACHE_MAX_TTL  3600
+#define DNS_CACHE_NEG_TTL  60
+#define DNS_CACHE_DEF_TTL  60
+
 /* The default nameserver used in Tor mode.  */
 #define DEFAULT_NAMESERVER "8.8.8.8"
 
@@ -158,6 +169,57 @@ static struct
 } cached_inet_support;
 
 
+/* The types of answers we cache.  */
+enum dns_cache_types
+  {
+    DNS_CACHE_ADDR,   /* resolve_dns_name   */
+    DNS_CACHE_SRV,    /* get_dns_srv        */
+    DNS_CACHE_CERT,   /* get_dns_cert       */
+    DNS_CACHE_CNAME   /* get_dns_cname      */
+  };
+
+/* An item of the answer cache.  The answer is identified by TYPE,
+ * NAME and the type specific parameters P1 to P3.  If ERR is set this
+ * is a negative answer.  */
+struct dns_cache_item_s
+{
+  struct dns_cache_item_s *next;
+  time_t expires;
+  int type;
+  int p1, p2, p3;
+  gpg_error_t err;
+  union {
+    struct {
+      dns_addrinfo_t ai;
+      char *canonname;
+    } addr;
+    struct {
+      struct srventry *list;
+      unsigned int count;
+    } srv;
+    struct {
+      void *key;
+      size_t keylen;
+      unsigned char *fpr;
+      size_t fprlen;
+      char *url;
+    } cert;
+    char *cname;
+  } u;
+  char name[1];
+};
+typedef struct dns_cache_item_s *dns_cache_item_t;
+
+/* The answer cache and the number of items in it.  */
+static dns_cache_item_t dns_cache;
+static unsigned int dns_cache_count;
+
+/* Statistics for the answer cache.  */
+static unsigned long dns_cache_hits;
+static unsigned long dns_cache_misses;
+static unsigned long dns_cache_expired;
+
+
 
 #ifdef USE_LIBDNS
 /* Libdns global data.  */
@@ -176,9 +238,19 @@ static int libdns_reinit_pending;
 /* The Tor port to be used.  */
 static int libdns_tor_port;
 
+/* Resolvers which are not in use are kept in this pool so that they
+ * and their sockets can be reused for the next query.  The pool is
+ * emptied whenever libdns is deinitialized.  No lock is required
+ * because the pool is only accessed between blocking calls.  */
+#define LIBDNS_RES_POOL_SIZE 8
+static struct dns_resolver *libdns_res_pool[LIBDNS_RES_POOL_SIZE];
+static unsigned int libdns_res_pool_count;
+
 #endif /*USE_LIBDNS*/
 
 
+static void dns_cache_flush (void);
+
 /* Calling this function with YES set to True forces the use of the
  * standard resolver even if dirmngr has been built with support for
  * an alternative resolver.  */
@@ -236,6 +308,8 @@ enable_dns_tormode (int new_circuit)
                       "p%u", counter);
       counter++;
     }
+  if (!tor_mode)
+    dns_cache_flush ();  /* Don't use answers from outside of Tor.  */
   tor_mode = 1;
 }
 
@@ -244,6 +318,8 @@ enable_dns_tormode (int new_circuit)
 void
 disable_dns_tormode (void)
 {
+  if (tor_mode)
+    dns_cache_flush ();
   tor_mode = 0;
 }
 
@@ -320,6 +396,223 @@ free_dns_addrinfo (dns_addrinfo_t ai)
 }
 
 
+/* Release the cache item ITEM.  */
+static void
+dns_cache_release_item (dns_cache_item_t item)
+{
+  if (!item)
+    return;
+  switch (item->type)
+    {
+    case DNS_CACHE_ADDR:
+      free_dns_addrinfo (item->u.addr.ai);
+      xfree (item->u.addr.canonname);
+      break;
+    case DNS_CACHE_SRV:
+      xfree (item->u.srv.list);
+      break;
+    case DNS_CACHE_CERT:
+      xfree (item->u.cert.key);
+      xfree (item->u.cert.fpr);
+      xfree (item->u.cert.url);
+      break;
+    case DNS_CACHE_CNAME:
+      xfree (item->u.cname);
+      break;
+    }
+  xfree (item);
+}
+
+
+/* Remove all items from the answer cache.  */
+static void
+dns_cache_flush (void)
+{
+  dns_cache_item_t item;
+
+  while ((item = dns_cache))
+    {
+      dns_cache = item->next;
+      dns_cache_release_item (item);
+    }
+  dns_cache_count = 0;
+}
+
+
+/* Remove all expired items from the answer cache.  */
+static void
+dns_cache_expire (void)
+{
+  dns_cache_item_t item, prev, next;
+  time_t now = gnupg_get_time ();
+
+  for (prev = NULL, item = dns_cache; item; item = next)
+    {
+      next = item->next;
+      if (item->expires > now)
+        {
+          prev = item;
+          continue;
+        }
+      if (prev)
+        prev->next = next;
+      else
+        dns_cache = next;
+      dns_cache_release_item (item);
+      dns_cache_count--;
+      dns_cache_expired++;
+    }
+}
+
+
+/* Return the valid cache item for TYPE, NAME and P1 to P3 or NULL if
+ * there is none.  The item is only valid until the next I/O.  */
+static dns_cache_item_t
+dns_cache_find (int type, const char *name, int p1, int p2, int p3)
+{
+  dns_cache_item_t item;
+  time_t now = gnupg_get_time ();
+
+  for (item = dns_cache; item; item = item->next)
+    if (item->type == type && item->p1 == p1 && item->p2 == p2
+        && item->p3 == p3 && !ascii_strcasecmp (item->name, name))
+      break;
+
+  if (item && item->expires > now)
+    {
+      dns_cache_hits++;
+      return item;
+    }
+  dns_cache_misses++;
+  return NULL;
+}
+
+
+/* Return a new cache item for TYPE, NAME and P1 to P3 or NULL on
+ * error.  */
+static dns_cache_item_t
+dns_cache_new_item (int type, const char *name, int p1, int p2, int p3)
+{
+  dns_cache_item_t item;
+
+  item = xtrycalloc (1, sizeof *item + strlen (name));
+  if (!item)
+    return NULL;
+  item->type = type;
+  item->p1 = p1;
+  item->p2 = p2;
+  item->p3 = p3;
+  strcpy (item->name, name);
+  return item;
+}
+
+
+/* Store ITEM in the cache with an expiration time computed from TTL
+ * and the error code ERR.  Only errors telling that the name or data
+ * does not exist are cached.  ITEM is consumed.  */
+static void
+dns_cache_put (dns_cache_item_t item, gpg_error_t err, unsigned int ttl)
+{
+  dns_cache_item_t x, prev;
+
+  if (err)
+    {
+      if (gpg_err_code (err) != GPG_ERR_NO_NAME
+          && gpg_err_code (err) != GPG_ERR_NOT_FOUND
+          && gpg_err_code (err) != GPG_ERR_NO_DATA)
+        {
+          dns_cache_release_item (item);
+          return;
+        }
+      if (ttl > DNS_CACHE_NEG_TTL)
+        ttl = DNS_CACHE_NEG_TTL;
+    }
+  else if (ttl > DNS_CACHE_MAX_TTL)
+    ttl = DNS_CACHE_MAX_TTL;
+  if (!ttl)
+    {
+      dns_cache_release_item (item);
+      return;
+    }
+  item->err = err;
+  item->expires = gnupg_get_time () + ttl;
+
+  /* Replace an old answer.  */
+  for (prev = NULL, x = dns_cache; x; prev = x, x = x->next)
+    if (x->type == item->type && x->p1 == item->p1 && x->p2 == item->p2
+        && x->p3 == item->p3 && !ascii_strcasecmp (x->name, item->name))
+      {
+        if (prev)
+          prev->next = x->next;
+        else
+          dns_cache = x->next;
+        dns_cache_release_item (x);
+        dns_cache_count--;
+        break;
+      }
+
+  if (dns_cache_count >= DNS_CACHE_SIZE)
+    dns_cache_expire ();
+  if (dns_cache_count >= DNS_CACHE_SIZE)
+    {
+      /* Still full - drop the oldest item which is the last one.  */
+      for (prev = NULL, x = dns_cache; x->next; prev = x, x = x->next)
+        ;
+      if (prev)
+        prev->next = NULL;
+      else
+        dns_cache = NULL;
+      dns_cache_release_item (x);
+      dns_cache_count--;
+    }
+
+  item->next = dns_cache;
+  dns_cache = item;
+  dns_cache_count++;
+}
+
+
+/* Return a copy of the address list AI or NULL on error.  */
+static dns_addrinfo_t
+copy_dns_addrinfo (dns_addrinfo_t ai)
+{
+  dns_addrinfo_t head = NULL;
+  dns_addrinfo_t *tail = &head;
+  dns_addrinfo_t x;
+
+  for (; ai; ai = ai->next)
+    {
+      x = xtrymalloc (sizeof *x);
+      if (!x)
+        {
+          free_dns_addrinfo (head);
+          return NULL;
+        }
+      *x = *ai;
+      x->next = NULL;
+      *tail = x;
+      tail = &x->next;
+    }
+  return head;
+}
+
+
+/* Return a malloced copy of the buffer (DATA,LEN) or store
+ * NULL if DATA is NULL.  Returns an error code.  */
+static gpg_error_t
+copy_dns_buffer (void **r_dst, const void *data, size_t len)
+{
+  *r_dst = NULL;
+  if (!data)
+    return 0;
+  *r_dst = xtrymalloc (len? len : 1);
+  if (!*r_dst)
+    return gpg_error_from_syserror ();
+  memcpy (*r_dst, data, len);
+  return 0;
+}
+
+
 #ifndef HAVE_W32_SYSTEM
 /* Return H_ERRNO mapped to a gpg-error code.  Will never return 0. */
 static gpg_error_t
@@ -664,6 +957,9 @@ libdns_deinit (void)
 {
   struct libdns_s ld;
 
+  while (libdns_res_pool_count)
+    dns_res_close (libdns_res_pool[--libdns_res_pool_count]);
+
   if (!libdns.resolv_conf)
     return; /* Not initialized.  */
 
@@ -698,6 +994,8 @@ reload_dns_stuff (int force)
 
   /* We also flush the IPv4/v6 support flag cache.  */
   cached_inet_support.valid = 0;
+
+  dns_cache_flush ();
 }
 
 
@@ -710,14 +1008,22 @@ dns_stuff_housekeeping (void)
    * later than 10 minutes after it changed.  This way the user does
    * not need a reload.  */
   cached_inet_support.valid = 0;
+
+  dns_cache_expire ();
+  if (opt_verbose)
+    log_info ("dns: cache: %u items, %lu hits, %lu misses, %lu expired\n",
+              dns_cache_count, dns_cache_hits, dns_cache_misses,
+              dns_cache_expired);
 }
 
 
 #ifdef USE_LIBDNS
 /*
- * Initialize libdns if needed and open a dns_resolver context.
- * Returns 0 on success and stores the new context at R_RES.  On
- * failure an error code is returned and NULL stored at R_RES.
+ * Initialize libdns if needed and open a dns_resolver context.  An
+ * idle resolver from the pool is used if available.  Returns 0 on
+ * success and stores the new context at R_RES.  On failure an error
+ * code is returned and NULL stored at R_RES.  The context must be
+ * released using libdns_res_close.
  */
 static gpg_error_t
 libdns_res_open (ctrl_t ctrl, struct dns_resolver **r_res)
@@ -754,6 +1060,12 @@ libdns_res_open (ctrl_t ctrl, struct dns_resolver **r_res)
   if (!opt_timeout)
     set_dns_timeout (0);
 
+  if (libdns_res_pool_count)
+    {
+      *r_res = libdns_res_pool[--libdns_res_pool_count];
+      return 0;
+    }
+
   res = dns_res_open (libdns.resolv_conf, libdns.hosts, libdns.hints, NULL,
                       &opts, &derr);
   if (!res)
@@ -765,6 +1077,39 @@ libdns_res_open (ctrl_t ctrl, struct dns_resolver **r_res)
 #endif /*USE_LIBDNS*/
 
 
+#ifdef USE_LIBDNS
+/* Release the resolver RES which was used for a query finished with
+ * ERR.  If the query did not fail for a reason which may have left
+ * the resolver in a bad state, RES is put back into the pool.  */
+static void
+libdns_res_close (struct dns_resolver *res, gpg_error_t err)
+{
+  if (!res)
+    return;
+
+  switch (gpg_err_code (err))
+    {
+    case 0:
+    case GPG_ERR_NO_NAME:
+    case GPG_ERR_NOT_FOUND:
+    case GPG_ERR_NO_DATA:
+    case GPG_ERR_ENOENT:
+      if (libdns.resolv_conf && !libdns_reinit_pending
+          && libdns_res_pool_count < LIBDNS_RES_POOL_SIZE)
+        {
+          dns_res_reset (res);
+          libdns_res_pool[libdns_res_pool_count++] = res;
+          return;
+        }
+      break;
+    default:
+      break;
+    }
+  dns_res_close (res);
+}
+#endif /*USE_LIBDNS*/
+
+
 #ifdef USE_LIBDNS
 /* Helper to test whether we need to try again after having switched
  * the Tor port.  */
@@ -821,6 +1166,75 @@ libdns_res_wait (struct dns_resolver *res)
 
   return err;
 }
+
+
+/* Wait until one of the NAI queries in AI which are not yet marked
+ * in DONE can make progress or TIMEOUT seconds elapsed.  */
+static void
+libdns_ai_poll (struct dns_addrinfo **ai, const int *done, int nai,
+                int timeout)
+{
+  fd_set rset, wset;
+  struct timeval tv;
+  int i, fd, events;
+  int maxfd = -1;
+
+  FD_ZERO (&rset);
+  FD_ZERO (&wset);
+  for (i=0; i < nai; i++)
+    {
+      if (done[i])
+        continue;
+      events = dns_ai_events (ai[i]);
+      fd = dns_ai_pollfd (ai[i]);
+      if (!events)
+        return;  /* This one does not need to wait.  */
+      if (fd < 0 || fd >= FD_SETSIZE)
+        {
+          /* Can't wait for several - fall back to the simple way.  */
+          my_unprotect ();
+          dns_ai_poll (ai[i], timeout);
+          my_protect ();
+          return;
+        }
+      if ((events & DNS_POLLIN))
+        FD_SET (fd, &rset);
+      if ((events & DNS_POLLOUT))
+        FD_SET (fd, &wset);
+      if (fd > maxfd)
+        maxfd = fd;
+    }
+  if (maxfd == -1)
+    return;
+
+  tv.tv_sec = timeout;
+  tv.tv_usec = 0;
+  my_unprotect ();
+  select (maxfd + 1, &rset, &wset, NULL, &tv);
+  my_protect ();
+}
+
+
+/* Return the lowest TTL of the records in the answer and authority
+ * sections of ANS.  For a negative answer this is the TTL of the SOA
+ * record.  Returns DNS_CACHE_DEF_TTL if there are no records.  */
+static unsigned int
+libdns_min_ttl (struct dns_packet *ans)
+{
+  struct dns_rr rr;
+  struct dns_rr_i rri;
+  int derr;
+  int any = 0;
+  unsigned int ttl = DNS_CACHE_DEF_TTL;
+
+  memset (&rri, 0, sizeof rri);
+  dns_rr_i_init (&rri);
+  rri.section = DNS_S_AN | DNS_S_NS;
+  while (dns_rr_grep (&rr, 1, &rri, ans, &derr))
+    if (!any++ || rr.ttl < ttl)
+      ttl = rr.ttl;
+  return ttl;
+}
 #endif /*USE_LIBDNS*/
 
 
@@ -833,8 +1247,12 @@ resolve_name_libdns (ctrl_t ctrl, const char *name, unsigned short port,
   gpg_error_t err;
   dns_addrinfo_t daihead = NULL;
   dns_addrinfo_t dai;
-  struct dns_resolver *res = NULL;
-  struct dns_addrinfo *ai = NULL;
+  dns_addrinfo_t results[2] = { NULL, NULL };
+  dns_addrinfo_t *tail;
+  struct dns_resolver *res[2] = { NULL, NULL };
+  struct dns_addrinfo *ai[2] = { NULL, NULL };
+  int done[2] = { 0, 0 };
+  int nai, i, progress, pending;
   struct addrinfo hints;
   struct addrinfo *ent;
   char portstr_[21];
@@ -859,7 +1277,7 @@ resolve_name_libdns (ctrl_t ctrl, const char *name, unsigned short port,
       portstr = portstr_;
     }
 
-  err = libdns_res_open (ctrl, &res);
+  err = libdns_res_open (ctrl, &res[0]);
   if (err)
     goto leave;
 
@@ -882,74 +1300,114 @@ resolve_name_libdns (ctrl_t ctrl, const char *name, unsigned short port,
         }
     }
 
-  ai = dns_ai_open (name, portstr, 0, &hints, res, &derr);
-  if (!ai)
+  /* If both address families are requested we use a second resolver
+   * so that the A and the AAAA query are in flight at the same time;
+   * a single resolver would send them one after the other.  */
+  nai = 1;
+  if (want_family == AF_UNSPEC && !(hints.ai_flags & AI_NUMERICHOST))
     {
-      err = libdns_error_to_gpg_error (derr);
-      goto leave;
+      err = libdns_res_open (ctrl, &res[1]);
+      if (err)
+        goto leave;
+      nai = 2;
     }
 
-  /* Loop over all records.  */
-  for (;;)
+  for (i=0; i < nai; i++)
     {
-      err = libdns_error_to_gpg_error (dns_ai_nextent (&ent, ai));
-      if (gpg_err_code (err) == GPG_ERR_ENOENT)
+      if (nai == 2)
+        hints.ai_family = i? AF_INET : AF_INET6;
+      ai[i] = dns_ai_open (name, portstr, 0, &hints, res[i], &derr);
+      if (!ai[i])
         {
-          if (daihead)
-            err = 0; /* We got some results, we're good.  */
-          break; /* Ready.  */
+          err = libdns_error_to_gpg_error (derr);
+          goto leave;
         }
-      if (gpg_err_code (err) == GPG_ERR_EAGAIN)
+    }
+
+  /* Loop over all records of all queries.  */
+  for (;;)
+    {
+      progress = pending = 0;
+      for (i=0; i < nai; i++)
         {
-          if (dns_ai_elapsed (ai) > opt_timeout)
+          if (done[i])
+            continue;
+          err = libdns_error_to_gpg_error (dns_ai_nextent (&ent, ai[i]));
+          if (gpg_err_code (err) == GPG_ERR_ENOENT)
             {
-              err = gpg_error (GPG_ERR_DNS_TIMEOUT);
-              goto leave;
+              done[i] = 1;
+              continue;
             }
+          if (gpg_err_code (err) == GPG_ERR_EAGAIN)
+            {
+              pending = 1;
+              continue;
+            }
+          if (err)
+            goto leave;
+          progress = 1;
 
-          my_unprotect ();
-          dns_ai_poll (ai, 1);
-          my_protect ();
-          continue;
-        }
-      if (err)
-        goto leave;
+          if (r_canonname && ! *r_canonname && ent && ent->ai_canonname)
+            {
+              *r_canonname = xtrystrdup (ent->ai_canonname);
+              if (!*r_canonname)
+                {
+                  err = gpg_error_from_syserror ();
+                  goto leave;
+                }
+              /* Libdns appends the root zone part which is problematic
+               * for most other functions - strip it.  */
+              if (**r_canonname
+                  && (*r_canonname)[strlen (*r_canonname)-1] == '.')
+                (*r_canonname)[strlen (*r_canonname)-1] = 0;
+            }
 
-      if (r_canonname && ! *r_canonname && ent && ent->ai_canonname)
-        {
-          *r_canonname = xtrystrdup (ent->ai_canonname);
-          if (!*r_canonname)
+          dai = xtrymalloc (sizeof *dai);
+          if (dai == NULL)
             {
               err = gpg_error_from_syserror ();
               goto leave;
             }
-          /* Libdns appends the root zone part which is problematic
-           * for most other functions - strip it.  */
-          if (**r_canonname && (*r_canonname)[strlen (*r_canonname)-1] == '.')
-            (*r_canonname)[strlen (*r_canonname)-1] = 0;
+
+          dai->family = ent->ai_family;
+          dai->socktype = ent->ai_socktype;
+          dai->protocol = ent->ai_protocol;
+          dai->addrlen = ent->ai_addrlen;
+          memcpy (dai->addr, ent->ai_addr, ent->ai_addrlen);
+          dai->next = results[i];
+          results[i] = dai;
+
+          xfree (ent);
         }
 
-      dai = xtrymalloc (sizeof *dai);
-      if (dai == NULL)
+      if (!pending && !progress)
+        break; /* Ready.  */
+      if (pending && !progress)
         {
-          err = gpg_error_from_syserror ();
-          goto leave;
+          if (dns_ai_elapsed (ai[0]) > opt_timeout)
+            {
+              err = gpg_error (GPG_ERR_DNS_TIMEOUT);
+              goto leave;
+            }
+          libdns_ai_poll (ai, done, nai, 1);
         }
+    }
 
-      dai->family = ent->ai_family;
-      dai->socktype = ent->ai_socktype;
-      dai->protocol = ent->ai_protocol;
-      dai->addrlen = ent->ai_addrlen;
-      memcpy (dai->addr, ent->ai_addr, ent->ai_addrlen);
-      dai->next = daihead;
-      daihead = dai;
-
-      xfree (ent);
-  }
+  /* Return the IPv6 addresses first as the single query did.  */
+  daihead = results[0];
+  for (tail = &daihead; *tail; tail = &(*tail)->next)
+    ;
+  *tail = results[1];
+  results[0] = results[1] = NULL;
+  err = daihead? 0 : gpg_error (GPG_ERR_ENOENT);
 
  leave:
-  dns_ai_close (ai);
-  dns_res_close (res);
+  for (i=0; i < 2; i++)
+    {
+      dns_ai_close (ai[i]);
+      libdns_res_close (res[i], err);
+      free_dns_addrinfo (results[i]);
+    }
 
   if (err)
     {
@@ -1099,6 +1557,43 @@ resolve_dns_name (ctrl_t ctrl, const char *name, unsigned short port,
                   dns_addrinfo_t *r_ai, char **r_canonname)
 {
   gpg_error_t err;
+  dns_cache_item_t item = NULL;
+  int use_cache = !is_ip_address (name);
+
+  /* Bit 16 of P2 tells whether the canonical name was requested.  If
+   * it was, the item can also be used without.  */
+  if (use_cache)
+    {
+      item = dns_cache_find (DNS_CACHE_ADDR, name, port,
+                             want_family | 0x10000, want_socktype);
+      if (!item && !r_canonname)
+        item = dns_cache_find (DNS_CACHE_ADDR, name, port,
+                               want_family, want_socktype);
+    }
+  if (item)
+    {
+      *r_ai = NULL;
+      if (r_canonname)
+        *r_canonname = NULL;
+      err = item->err;
+      if (!err)
+        {
+          *r_ai = copy_dns_addrinfo (item->u.addr.ai);
+          if (!*r_ai)
+            err = gpg_error_from_syserror ();
+          else if (r_canonname && item->u.addr.canonname
+                   && !(*r_canonname = xtrystrdup (item->u.addr.canonname)))
+            {
+              err = gpg_error_from_syserror ();
+              free_dns_addrinfo (*r_ai);
+              *r_ai = NULL;
+            }
+        }
+      if (opt_debug)
+        log_debug ("dns: resolve_dns_name(%s): %s (cached)\n",
+                   name, gpg_strerror (err));
+      return err;
+    }
 
 #ifdef USE_LIBDNS
   if (!standard_resolver)
@@ -1115,6 +1610,23 @@ resolve_dns_name (ctrl_t ctrl, const char *name, unsigned short port,
                                  r_ai, r_canonname);
   if (opt_debug)
     log_debug ("dns: resolve_dns_name(%s): %s\n", name, gpg_strerror (err));
+
+  /* Neither getaddrinfo nor libdns' dns_ai tell us the TTL and thus
+   * we use a short default.  */
+  if (use_cache
+      && (item = dns_cache_new_item (DNS_CACHE_ADDR, name, port,
+                                     want_family | (r_canonname? 0x10000:0),
+                                     want_socktype)))
+    {
+      if (!err
+          && (!(item->u.addr.ai = copy_dns_addrinfo (*r_ai))
+              || (r_canonname && *r_canonname
+                  && !(item->u.addr.canonname = xtrystrdup (*r_canonname)))))
+        dns_cache_release_item (item);
+      else
+        dns_cache_put (item, err, DNS_CACHE_DEF_TTL);
+    }
+
   return err;
 }
 
@@ -1249,7 +1761,7 @@ resolve_addr_libdns (ctrl_t ctrl,
 
  leave:
   dns_free (ans);
-  dns_res_close (res);
+  libdns_res_close (res, err);
   return err;
 }
 #endif /*USE_LIBDNS*/
@@ -1431,7 +1943,8 @@ is_onion_address (const char *name)
 static gpg_error_t
 get_dns_cert_libdns (ctrl_t ctrl, const char *name, int want_certtype,
                      void **r_key, size_t *r_keylen,
-                     unsigned char **r_fpr, size_t *r_fprlen, char **r_url)
+                     unsigned char **r_fpr, size_t *r_fprlen, char **r_url,
+                     unsigned int *r_ttl)
 {
   gpg_error_t err;
   struct dns_resolver *res = NULL;
@@ -1448,7 +1961,7 @@ get_dns_cert_libdns (ctrl_t ctrl, const char *name, int want_certtype,
            ? T_CERT
            : (want_certtype - DNS_CERTTYPE_RRBASE));
 
-
+  *r_ttl = DNS_CACHE_DEF_TTL;
   err = libdns_res_open (ctrl, &res);
   if (err)
     goto leave;
@@ -1473,6 +1986,7 @@ get_dns_cert_libdns (ctrl_t ctrl, const char *name, int want_certtype,
       err = libdns_error_to_gpg_error (derr);
       goto leave;
     }
+  *r_ttl = libdns_min_ttl (ans);
 
   /* Check the rcode.  */
   switch (dns_p_rcode (ans))
@@ -1595,7 +2109,7 @@ get_dns_cert_libdns (ctrl_t ctrl, const char *name, int want_certtype,
 
  leave:
   dns_free (ans);
-  dns_res_close (res);
+  libdns_res_close (res, err);
   return err;
 }
 #endif /*USE_LIBDNS*/
@@ -1820,6 +2334,8 @@ get_dns_cert (ctrl_t ctrl, const char *name, int want_certtype,
               unsigned char **r_fpr, size_t *r_fprlen, char **r_url)
 {
   gpg_error_t err;
+  dns_cache_item_t item;
+  unsigned int ttl = DNS_CACHE_DEF_TTL;
 
   if (r_key)
     *r_key = NULL;
@@ -1829,14 +2345,49 @@ get_dns_cert (ctrl_t ctrl, const char *name, int want_certtype,
   *r_fprlen = 0;
   *r_url = NULL;
 
+  if ((item = dns_cache_find (DNS_CACHE_CERT, name, want_certtype,
+                              !!r_key, 0)))
+    {
+      err = item->err;
+      if (!err && r_key)
+        {
+          err = copy_dns_buffer (r_key, item->u.cert.key, item->u.cert.keylen);
+          if (!err && r_keylen)
+            *r_keylen = item->u.cert.keylen;
+        }
+      if (!err)
+        err = copy_dns_buffer ((void **)r_fpr, item->u.cert.fpr,
+                               item->u.cert.fprlen);
+      if (!err)
+        {
+          *r_fprlen = item->u.cert.fprlen;
+          if (item->u.cert.url && !(*r_url = xtrystrdup (item->u.cert.url)))
+            err = gpg_error_from_syserror ();
+        }
+      if (err && !item->err)
+        {
+          if (r_key)
+            {
+              xfree (*r_key);
+              *r_key = NULL;
+            }
+          xfree (*r_fpr);
+          *r_fpr = NULL;
+        }
+      if (opt_debug)
+        log_debug ("dns: get_dns_cert(%s): %s (cached)\n",
+                   name, gpg_strerror (err));
+      return err;
+    }
+
 #ifdef USE_LIBDNS
   if (!standard_resolver)
     {
       err = get_dns_cert_libdns (ctrl, name, want_certtype, r_key, r_keylen,
-                                 r_fpr, r_fprlen, r_url);
+                                 r_fpr, r_fprlen, r_url, &ttl);
       if (err && libdns_switch_port_p (err))
         err = get_dns_cert_libdns (ctrl, name, want_certtype, r_key, r_keylen,
-                                   r_fpr, r_fprlen, r_url);
+                                   r_fpr, r_fprlen, r_url, &ttl);
     }
   else
 #endif /*USE_LIBDNS*/
@@ -1845,6 +2396,28 @@ get_dns_cert (ctrl_t ctrl, const char *name, int want_certtype,
 
   if (opt_debug)
     log_debug ("dns: get_dns_cert(%s): %s\n", name, gpg_strerror (err));
+
+  if ((item = dns_cache_new_item (DNS_CACHE_CERT, name, want_certtype,
+                                  !!r_key, 0)))
+    {
+      if (!err)
+        {
+          item->u.cert.keylen = r_keylen? *r_keylen : 0;
+          item->u.cert.fprlen = *r_fprlen;
+          if (copy_dns_buffer (&item->u.cert.key, r_key? *r_key : NULL,
+                               item->u.cert.keylen)
+              || copy_dns_buffer ((void **)&item->u.cert.fpr, *r_fpr,
+                                  *r_fprlen)
+              || (*r_url && !(item->u.cert.url = xtrystrdup (*r_url))))
+            {
+              dns_cache_release_item (item);
+              item = NULL;
+            }
+        }
+      if (item)
+        dns_cache_put (item, err, ttl);
+    }
+
   return err;
 }
 
@@ -1868,7 +2441,8 @@ priosort(const void *a,const void *b)
 #ifdef USE_LIBDNS
 static gpg_error_t
 getsrv_libdns (ctrl_t ctrl,
-               const char *name, struct srventry **list, unsigned int *r_count)
+               const char *name, struct srventry **list, unsigned int *r_count,
+               unsigned int *r_ttl)
 {
   gpg_error_t err;
   struct dns_resolver *res = NULL;
@@ -1879,6 +2453,7 @@ getsrv_libdns (ctrl_t ctrl,
   int derr;
   unsigned int srvcount = 0;
 
+  *r_ttl = DNS_CACHE_DEF_TTL;
   err = libdns_res_open (ctrl, &res);
   if (err)
     goto leave;
@@ -1903,6 +2478,7 @@ getsrv_libdns (ctrl_t ctrl,
       err = libdns_error_to_gpg_error (derr);
       goto leave;
     }
+  *r_ttl = libdns_min_ttl (ans);
 
   /* Check the rcode.  */
   switch (dns_p_rcode (ans))
@@ -1959,7 +2535,7 @@ getsrv_libdns (ctrl_t ctrl,
       *list = NULL;
     }
   dns_free (ans);
-  dns_res_close (res);
+  libdns_res_close (res, err);
   return err;
 }
 #endif /*USE_LIBDNS*/
@@ -1970,7 +2546,8 @@ getsrv_libdns (ctrl_t ctrl,
  * at the address of R_COUNT.  */
 static gpg_error_t
 getsrv_standard (const char *name,
-                 struct srventry **list, unsigned int *r_count)
+                 struct srventry **list, unsigned int *r_count,
+                 unsigned int *r_ttl)
 {
 #ifdef HAVE_SYSTEM_RESOLVER
   union {
@@ -1984,6 +2561,9 @@ getsrv_standard (const char *name,
   u16 dlen;
   unsigned int srvcount = 0;
   u16 count;
+  u32 ttl;
+
+  *r_ttl = DNS_CACHE_DEF_TTL;
 
   /* Do not allow a query using the standard resolver in Tor mode.  */
   if (tor_mode)
@@ -2046,7 +2626,10 @@ getsrv_standard (const char *name,
       if (class != C_IN)
         goto fail;
 
-      pt += 4; /* ttl */
+      ttl = buf32_to_u32 (pt);
+      if (srvcount == 1 || ttl < *r_ttl)
+        *r_ttl = ttl;
+      pt += 4;
       dlen = buf16_to_u16 (pt);
       pt += 2;
 
@@ -2087,6 +2670,7 @@ getsrv_standard (const char *name,
   (void)name;
   (void)list;
   (void)r_count;
+  (void)r_ttl;
   return gpg_error (GPG_ERR_NOT_SUPPORTED);
 
 #endif /*!HAVE_SYSTEM_RESOLVER*/
@@ -2105,6 +2689,8 @@ get_dns_srv (ctrl_t ctrl,
   gpg_error_t err;
   char *namebuffer = NULL;
   unsigned int srvcount;
+  unsigned int ttl = DNS_CACHE_DEF_TTL;
+  dns_cache_item_t item;
   int i;
 
   *list = NULL;
@@ -2124,17 +2710,49 @@ get_dns_srv (ctrl_t ctrl,
       name = namebuffer;
     }
 
-
-#ifdef USE_LIBDNS
-  if (!standard_resolver)
+  if ((item = dns_cache_find (DNS_CACHE_SRV, name, 0, 0, 0)))
     {
-      err = getsrv_libdns (ctrl, name, list, &srvcount);
-      if (err && libdns_switch_port_p (err))
-        err = getsrv_libdns (ctrl, name, list, &srvcount);
+      err = item->err;
+      if (!err && item->u.srv.count)
+        {
+          err = copy_dns_buffer ((void **)list, item->u.srv.list,
+                                 item->u.srv.count * sizeof **list);
+          if (!err)
+            srvcount = item->u.srv.count;
+        }
+      if (opt_debug)
+        log_debug ("dns: getsrv(%s): %u records (cached)\n", name, srvcount);
     }
   else
+    {
+#ifdef USE_LIBDNS
+      if (!standard_resolver)
+        {
+          err = getsrv_libdns (ctrl, name, list, &srvcount, &ttl);
+          if (err && libdns_switch_port_p (err))
+            err = getsrv_libdns (ctrl, name, list, &srvcount, &ttl);
+        }
+      else
 #endif /*USE_LIBDNS*/
-    err = getsrv_standard (name, list, &srvcount);
+        err = getsrv_standard (name, list, &srvcount, &ttl);
+
+      /* Cache the answer in the order returned by the server; the
+       * weighting below is done for each request.  */
+      if ((item = dns_cache_new_item (DNS_CACHE_SRV, name, 0, 0, 0)))
+        {
+          if (!err && srvcount
+              && copy_dns_buffer ((void **)&item->u.srv.list, *list,
+                                  srvcount * sizeof **list))
+            {
+              dns_cache_release_item (item);
+              item = NULL;
+            }
+          else if (!err)
+            item->u.srv.count = srvcount;
+          if (item)
+            dns_cache_put (item, err, ttl);
+        }
+    }
 
   if (err)
     {
@@ -2235,7 +2853,8 @@ get_dns_srv (ctrl_t ctrl,
 #ifdef USE_LIBDNS
 /* libdns version of get_dns_cname.  */
 gpg_error_t
-get_dns_cname_libdns (ctrl_t ctrl, const char *name, char **r_cname)
+get_dns_cname_libdns (ctrl_t ctrl, const char *name, char **r_cname,
+                      unsigned int *r_ttl)
 {
   gpg_error_t err;
   struct dns_resolver *res;
@@ -2243,6 +2862,7 @@ get_dns_cname_libdns (ctrl_t ctrl, const char *name, char **r_cname)
   struct dns_cname cname;
   int derr;
 
+  *r_ttl = DNS_CACHE_DEF_TTL;
   err = libdns_res_open (ctrl, &res);
   if (err)
     goto leave;
@@ -2261,6 +2881,7 @@ get_dns_cname_libdns (ctrl_t ctrl, const char *name, char **r_cname)
       err = libdns_error_to_gpg_error (derr);
       goto leave;
     }
+  *r_ttl = libdns_min_ttl (ans);
 
   /* Check the rcode.  */
   switch (dns_p_rcode (ans))
@@ -2297,7 +2918,7 @@ get_dns_cname_libdns (ctrl_t ctrl, const char *name, char **r_cname)
 
  leave:
   dns_free (ans);
-  dns_res_close (res);
+  libdns_res_close (res, err);
   return err;
 }
 #endif /*USE_LIBDNS*/
@@ -2391,24 +3012,51 @@ gpg_error_t
 get_dns_cname (ctrl_t ctrl, const char *name, char **r_cname)
 {
   gpg_error_t err;
+  unsigned int ttl = DNS_CACHE_DEF_TTL;
+  dns_cache_item_t item;
 
   *r_cname = NULL;
 
+  if ((item = dns_cache_find (DNS_CACHE_CNAME, name, 0, 0, 0)))
+    {
+      err = item->err;
+      if (!err && !(*r_cname = xtrystrdup (item->u.cname)))
+        err = gpg_error_from_syserror ();
+      if (opt_debug)
+        log_debug ("get_dns_cname(%s)%s%s (cached)\n", name,
+                   err ? ": " : " -> ",
+                   err ? gpg_strerror (err) : *r_cname);
+      return err;
+    }
+
 #ifdef USE_LIBDNS
   if (!standard_resolver)
     {
-      err = get_dns_cname_libdns (ctrl, name, r_cname);
+      err = get_dns_cname_libdns (ctrl, name, r_cname, &ttl);
       if (err && libdns_switch_port_p (err))
-        err = get_dns_cname_libdns (ctrl, name, r_cname);
-      return err;
+        err = get_dns_cname_libdns (ctrl, name, r_cname, &ttl);
     }
+  else
 #endif /*USE_LIBDNS*/
+    {
+      err = get_dns_cname_standard (name, r_cname);
+      if (opt_debug)
+        log_debug ("get_dns_cname(%s)%s%s\n", name,
+                   err ? ": " : " -> ",
+                   err ? gpg_strerror (err) : *r_cname);
+    }
+
+  if ((item = dns_cache_new_item (DNS_CACHE_CNAME, name, 0, 0, 0)))
+    {
+      if (!err && !(item->u.cname = xtrystrdup (*r_cname)))
+        {
+          dns_cache_release_item (item);
+          item = NULL;
+        }
+      if (item)
+        dns_cache_put (item, err, ttl);
+    }
 
-  err = get_dns_cname_standard (name, r_cname);
-  if (opt_debug)
-    log_debug ("get_dns_cname(%s)%s%s\n", name,
-               err ? ": " : " -> ",
-               err ? gpg_strerror (err) : *r_cname);
   return err;
 }
 
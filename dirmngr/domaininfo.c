@@ -26,17 +26,32 @@
 #include "dirmngr.h"
 
 
-/* Number of bucket for the hash array and limit for the length of a
- * bucket chain.  For debugging values of 13 and 10 are more suitable
- * and a command like
+/* Limit for the length of a bucket chain.  The hash array starts
+ * with the first size from domainbucket_sizes and grows whenever the
+ * average chain length exceeds DOMAINBUCKET_LOAD; only after the
+ * largest size has been reached chains are purged.  For debugging
+ * values of 13 and 10 are more suitable and a command like
  *   for j   in a b c d e f g h i j k l m n o p q r s t u v w z y z; do \
  *     for i in a b c d e f g h i j k l m n o p q r s t u v w z y z; do \
  *       gpg-connect-agent --dirmngr "wkd_get foo@$i.$j.gnupg.net" /bye \
  *       >/dev/null ; done; done
  * will quickly add a couple of domains.
  */
-#define NO_OF_DOMAINBUCKETS  103
 #define MAX_DOMAINBUCKET_LEN  20
+#define DOMAINBUCKET_LOAD      4
+
+/* Limits for the cache of WKD results.  The times are in seconds and
+ * used if the server did not give a max-age.  */
+#define WKD_CACHE_SIZE         100
+#define WKD_CACHE_MAX_DATALEN  (128*1024)
+#define WKD_CACHE_DEF_TTL      3600
+#define WKD_CACHE_MAX_TTL     86400
+#define WKD_CACHE_NEG_TTL       900
+
+/* The maximum number of cached auto-key-locate results.  The TTLs
+ * are given by opt.akl_cache_ttl and opt.akl_cache_neg_ttl.  */
+#define AKL_CACHE_SIZE        1000
+#define AKL_CACHE_MAX_FPRLEN    64   /* Hex digits.  */
 
 
 /* Object to keep track of a domain name.  */
@@ -52,11 +67,63 @@ struct domaininfo_s
 };
 typedef struct domaininfo_s *domaininfo_t;
 
-/* And the hashed array.  */
-static domaininfo_t domainbuckets[NO_OF_DOMAINBUCKETS];
+/* The possible sizes of the hash array.  */
+static const unsigned int domainbucket_sizes[] =
+  { 103, 211, 421, 839, 1669, 3347, 6689 };
+
+/* And the hashed array with its current size and the number of items
+ * stored.  */
+static domaininfo_t *domainbuckets;
+static unsigned int no_of_domainbuckets;
+static unsigned int no_of_domains;
+
+
+/* Object to keep a WKD result.  The key is the z-base-32 encoded hash
+ * of the local part and the domain.  If ERR is set this is a negative
+ * result; DATA is then NULL.  */
+struct wkdresult_s
+{
+  struct wkdresult_s *next;
+  time_t expires;
+  gpg_error_t err;
+  void *data;
+  size_t datalen;
+  char key[1];
+};
+typedef struct wkdresult_s *wkdresult_t;
+
+/* The list of cached WKD results, with the most recently used item
+ * first, and some statistics.  */
+static wkdresult_t wkdresults;
+static unsigned int no_of_wkdresults;
+static unsigned long wkdresults_hits;
+static unsigned long wkdresults_misses;
 
 
-/* The hash function we use.  Must not call a system function.  */
+/* Object to keep the outcome of an auto-key-locate mechanism as
+ * reported by gpg.  The key is "MECHANISM MBOX".  If ERR is set this
+ * is a negative result; otherwise FPR is the hex encoded fingerprint
+ * of the found key.  */
+struct aklresult_s
+{
+  struct aklresult_s *next;
+  time_t expires;
+  gpg_error_t err;
+  char fpr[AKL_CACHE_MAX_FPRLEN+1];
+  char key[1];
+};
+typedef struct aklresult_s *aklresult_t;
+
+/* The list of cached AKL results, with the most recently used item
+ * first, and some statistics.  */
+static aklresult_t aklresults;
+static unsigned int no_of_aklresults;
+static unsigned long aklresults_hits;
+static unsigned long aklresults_misses;
+
+
+/* The hash function we use.  Must not call a system function.  The
+ * caller needs to take the value modulo the size of the array.  */
 static inline u32
 hash_domain (const char *domain)
 {
@@ -76,7 +143,55 @@ hash_domain (const char *domain)
         }
     }
 
-  return hashval % NO_OF_DOMAINBUCKETS;
+  return hashval;
+}
+
+
+/* Grow the hash array if it has become too crowded.  Does nothing
+ * if the array already has the maximum size or on error.  */
+static void
+maybe_grow_domainbuckets (void)
+{
+  domaininfo_t *array, di, next;
+  unsigned int size, oldsize, idx;
+  u32 hash;
+
+  oldsize = no_of_domainbuckets;
+  if (oldsize && no_of_domains < oldsize * DOMAINBUCKET_LOAD)
+    return;
+  for (idx=0; idx < DIM (domainbucket_sizes); idx++)
+    if (domainbucket_sizes[idx] > oldsize)
+      break;
+  if (idx == DIM (domainbucket_sizes))
+    return;  /* Already at the maximum size.  */
+  size = domainbucket_sizes[idx];
+
+  array = xtrycalloc (size, sizeof *array);
+  if (!array)
+    return;  /* Out of core - we ignore this.  */
+
+  /* Check again because the malloc is a system call and another
+   * thread may have resized the array in the meantime.  */
+  if (no_of_domainbuckets != oldsize)
+    {
+      xfree (array);
+      return;
+    }
+
+  for (idx=0; idx < oldsize; idx++)
+    for (di = domainbuckets[idx]; di; di = next)
+      {
+        next = di->next;
+        hash = hash_domain (di->name) % size;
+        di->next = array[hash];
+        array[hash] = di;
+      }
+  xfree (domainbuckets);
+  domainbuckets = array;
+  no_of_domainbuckets = size;
+
+  if (opt.verbose)
+    log_info ("domaininfo: resized table to %u buckets\n", size);
 }
 
 
@@ -91,7 +206,7 @@ domaininfo_print_stats (ctrl_t ctrl)
   count = no_name = wkd_not_found = wkd_supported = wkd_not_supported = 0;
   maxlen = 0;
   minlen = -1;
-  for (bidx = 0; bidx < NO_OF_DOMAINBUCKETS; bidx++)
+  for (bidx = 0; bidx < no_of_domainbuckets; bidx++)
     {
       len = 0;
       for (di = domainbuckets[bidx]; di; di = di->next)
@@ -113,11 +228,19 @@ domaininfo_print_stats (ctrl_t ctrl)
         minlen = len;
     }
   dirmngr_status_helpf
-    (ctrl, "domaininfo: items=%d chainlen=%d..%d nn=%d nf=%d ns=%d s=%d\n",
+    (ctrl, "domaininfo: items=%d buckets=%u chainlen=%d..%d"
+     " nn=%d nf=%d ns=%d s=%d\n",
      count,
+     no_of_domainbuckets,
      minlen > 0? minlen : 0,
      maxlen,
      no_name, wkd_not_found, wkd_not_supported, wkd_supported);
+  dirmngr_status_helpf
+    (ctrl, "wkdcache: items=%u hits=%lu misses=%lu\n",
+     no_of_wkdresults, wkdresults_hits, wkdresults_misses);
+  dirmngr_status_helpf
+    (ctrl, "aklcache: items=%u hits=%lu misses=%lu\n",
+     no_of_aklresults, aklresults_hits, aklresults_misses);
 }
 
 
@@ -128,7 +251,11 @@ domaininfo_is_wkd_not_supported (const char *domain)
 {
   domaininfo_t di;
 
-  for (di = domainbuckets[hash_domain (domain)]; di; di = di->next)
+  if (!no_of_domainbuckets)
+    return 0;  /* We don't know.  */
+
+  for (di = domainbuckets[hash_domain (domain) % no_of_domainbuckets];
+       di; di = di->next)
     if (!strcmp (di->name, domain))
       return !!di->wkd_not_supported;
 
@@ -152,19 +279,30 @@ insert_or_update (const char *domain,
   u32 hash;
   int count;
 
-  hash = hash_domain (domain);
-  for (di = domainbuckets[hash]; di; di = di->next)
-    if (!strcmp (di->name, domain))
-      {
-        callback (di, 0);  /* Update */
-        return;
-      }
+  if (no_of_domainbuckets)
+    {
+      hash = hash_domain (domain) % no_of_domainbuckets;
+      for (di = domainbuckets[hash]; di; di = di->next)
+        if (!strcmp (di->name, domain))
+          {
+            callback (di, 0);  /* Update */
+            return;
+          }
+    }
 
   di_new = xtrycalloc (1, sizeof *di + strlen (domain));
   if (!di_new)
     return;  /* Out of core - we ignore this.  */
   strcpy (di_new->name, domain);
 
+  maybe_grow_domainbuckets ();
+  if (!no_of_domainbuckets)
+    {
+      xfree (di_new);
+      return;  /* Out of core - we ignore this.  */
+    }
+  hash = hash_domain (domain) % no_of_domainbuckets;
+
   /* Need to do another lookup because the malloc is a system call and
    * thus the hash array may have been changed by another thread.  */
   for (count=0, di = domainbuckets[hash]; di; di = di->next, count++)
@@ -175,7 +313,9 @@ insert_or_update (const char *domain,
         return;
       }
 
-  /* Before we insert we need to check whether the chain gets too long.  */
+  /* Before we insert we need to check whether the chain gets too long.
+   * Note that this can only happen with the largest array size or if
+   * the array could not be resized.  */
   if (count >= MAX_DOMAINBUCKET_LEN)
     {
       domaininfo_t bucket;
@@ -266,6 +406,7 @@ insert_or_update (const char *domain,
   di = di_new;
   di->next = domainbuckets[hash];
   domainbuckets[hash] = di;
+  no_of_domains++;
 
   if (opt.verbose && (nkept || ndropped))
     log_info ("domaininfo: bucket=%lu kept=%d purged=%d\n",
@@ -278,12 +419,14 @@ insert_or_update (const char *domain,
       di = drop->next;
       xfree (drop);
       drop = di;
+      no_of_domains--;
     }
   while (drop_extra)
     {
       di = drop_extra->next;
       xfree (drop_extra);
       drop_extra = di;
+      no_of_domains--;
     }
 }
 
@@ -377,3 +520,291 @@ domaininfo_set_wkd_not_found (const char *domain)
 {
   insert_or_update (domain, set_wkd_not_found_cb);
 }
+
+
+
+/* Release the WKD result item WR.  */
+static void
+release_wkdresult (wkdresult_t wr)
+{
+  if (!wr)
+    return;
+  xfree (wr->data);
+  xfree (wr);
+}
+
+
+/* Remove all WKD results from the cache.  */
+void
+domaininfo_flush_wkd_cache (void)
+{
+  wkdresult_t wr, list;
+
+  /* Unlink first so that no other thread sees items being freed.  */
+  list = wkdresults;
+  wkdresults = NULL;
+  no_of_wkdresults = 0;
+  while ((wr = list))
+    {
+      list = wr->next;
+      release_wkdresult (wr);
+    }
+}
+
+
+/* Look up the cached WKD result for the z-base-32 encoded hash HASH
+ * of the local part at DOMAIN.  Returns true if a result was found.
+ * In this case the error code of a negative result is stored at
+ * R_ERR; for a positive result 0 is stored at R_ERR and a malloced
+ * copy of the key at R_DATA and R_DATALEN.  If allocating the copy
+ * fails false is returned.  */
+int
+domaininfo_get_wkd_result (const char *hash, const char *domain,
+                           void **r_data, size_t *r_datalen,
+                           gpg_error_t *r_err)
+{
+  wkdresult_t wr, prev;
+  size_t hashlen = strlen (hash);
+  time_t now = gnupg_get_time ();
+  void *data;
+
+  *r_data = NULL;
+  *r_datalen = 0;
+  *r_err = 0;
+
+  for (prev = NULL, wr = wkdresults; wr; prev = wr, wr = wr->next)
+    if (!strncmp (wr->key, hash, hashlen) && wr->key[hashlen] == '@'
+        && !strcmp (wr->key + hashlen + 1, domain))
+      break;
+  if (!wr || wr->expires <= now)
+    {
+      wkdresults_misses++;
+      return 0;
+    }
+
+  /* Move to the front of the list.  */
+  if (prev)
+    {
+      prev->next = wr->next;
+      wr->next = wkdresults;
+      wkdresults = wr;
+    }
+
+  if (wr->err)
+    *r_err = wr->err;
+  else
+    {
+      /* Note that we won't yield under nPth when calling malloc.  */
+      data = xtrymalloc (wr->datalen? wr->datalen : 1);
+      if (!data)
+        return 0;
+      memcpy (data, wr->data, wr->datalen);
+      *r_data = data;
+      *r_datalen = wr->datalen;
+    }
+  wkdresults_hits++;
+  return 1;
+}
+
+
+/* Store a WKD result for the z-base-32 encoded hash HASH of the local
+ * part at DOMAIN.  If ERR is 0 (DATA,DATALEN) is the key which is
+ * kept for MAXAGE seconds; (unsigned int)(-1) may be used if the
+ * server did not tell.  Only the "no data" error is cached.  */
+void
+domaininfo_put_wkd_result (const char *hash, const char *domain,
+                           const void *data, size_t datalen,
+                           gpg_error_t err, unsigned int maxage)
+{
+  wkdresult_t wr, x, prev;
+  wkdresult_t drop = NULL;
+
+  if (err)
+    {
+      if (gpg_err_code (err) != GPG_ERR_NO_DATA)
+        return;
+      if (maxage > WKD_CACHE_NEG_TTL)
+        maxage = WKD_CACHE_NEG_TTL;
+    }
+  else if (maxage == (unsigned int)(-1))
+    maxage = WKD_CACHE_DEF_TTL;
+  else if (maxage > WKD_CACHE_MAX_TTL)
+    maxage = WKD_CACHE_MAX_TTL;
+  if (!maxage || datalen > WKD_CACHE_MAX_DATALEN)
+    return;
+
+  wr = xtrycalloc (1, sizeof *wr + strlen (hash) + 1 + strlen (domain));
+  if (!wr)
+    return;  /* Out of core - we ignore this.  */
+  strcpy (stpcpy (stpcpy (wr->key, hash), "@"), domain);
+  if (!err)
+    {
+      wr->data = xtrymalloc (datalen? datalen : 1);
+      if (!wr->data)
+        {
+          xfree (wr);
+          return;
+        }
+      memcpy (wr->data, data, datalen);
+      wr->datalen = datalen;
+    }
+  wr->err = err;
+  wr->expires = gnupg_get_time () + maxage;
+
+  /* Now that all syscalls are done, replace an older result and make
+   * room for the new one.  */
+  for (prev = NULL, x = wkdresults; x; prev = x, x = x->next)
+    if (!strcmp (x->key, wr->key))
+      {
+        if (prev)
+          prev->next = x->next;
+        else
+          wkdresults = x->next;
+        drop = x;
+        no_of_wkdresults--;
+        break;
+      }
+  if (!drop && no_of_wkdresults >= WKD_CACHE_SIZE)
+    {
+      /* Drop the least recently used item.  */
+      for (prev = NULL, x = wkdresults; x && x->next; prev = x, x = x->next)
+        ;
+      if (x)
+        {
+          if (prev)
+            prev->next = NULL;
+          else
+            wkdresults = NULL;
+          drop = x;
+          no_of_wkdresults--;
+        }
+    }
+  wr->next = wkdresults;
+  wkdresults = wr;
+  no_of_wkdresults++;
+
+  release_wkdresult (drop);
+}
+
+
+
+/* Remove all AKL results from the cache.  */
+void
+domaininfo_flush_akl_cache (void)
+{
+  aklresult_t ar, list;
+
+  list = aklresults;
+  aklresults = NULL;
+  no_of_aklresults = 0;
+  while ((ar = list))
+    {
+      list = ar->next;
+      xfree (ar);
+    }
+}
+
+
+/* Look up the cached result of the auto-key-locate MECHANISM for the
+ * lowercase mail address MBOX.  Returns true if a result was found.
+ * In this case the error code of a negative result is stored at
+ * R_ERR; for a positive result 0 is stored at R_ERR and the hex
+ * encoded fingerprint is copied to R_FPR which must provide space
+ * for AKL_CACHE_MAX_FPRLEN+1 bytes.  */
+int
+domaininfo_get_akl_result (const char *mechanism, const char *mbox,
+                           char *r_fpr, gpg_error_t *r_err)
+{
+  aklresult_t ar, prev;
+  size_t mechlen = strlen (mechanism);
+  time_t now = gnupg_get_time ();
+
+  *r_fpr = 0;
+  *r_err = 0;
+
+  for (prev = NULL, ar = aklresults; ar; prev = ar, ar = ar->next)
+    if (!strncmp (ar->key, mechanism, mechlen) && ar->key[mechlen] == ' '
+        && !strcmp (ar->key + mechlen + 1, mbox))
+      break;
+  if (!ar || ar->expires <= now)
+    {
+      aklresults_misses++;
+      return 0;
+    }
+
+  /* Move to the front of the list.  */
+  if (prev)
+    {
+      prev->next = ar->next;
+      ar->next = aklresults;
+      aklresults = ar;
+    }
+
+  *r_err = ar->err;
+  if (!ar->err)
+    strcpy (r_fpr, ar->fpr);
+  aklresults_hits++;
+  return 1;
+}
+
+
+/* Store the result of the auto-key-locate MECHANISM for the
+ * lowercase mail address MBOX.  If ERR is 0, FPR is the hex encoded
+ * fingerprint of the found key.  */
+void
+domaininfo_put_akl_result (const char *mechanism, const char *mbox,
+                           const char *fpr, gpg_error_t err)
+{
+  aklresult_t ar, x, prev;
+  aklresult_t drop = NULL;
+  unsigned int ttl;
+
+  ttl = err? opt.akl_cache_neg_ttl : opt.akl_cache_ttl;
+  if (!ttl)
+    return;
+  if (!err && (!fpr || strlen (fpr) > AKL_CACHE_MAX_FPRLEN))
+    return;
+
+  ar = xtrycalloc (1, sizeof *ar + strlen (mechanism) + 1 + strlen (mbox));
+  if (!ar)
+    return;  /* Out of core - we ignore this.  */
+  strcpy (stpcpy (stpcpy (ar->key, mechanism), " "), mbox);
+  ar->err = err;
+  if (!err)
+    strcpy (ar->fpr, fpr);
+  ar->expires = gnupg_get_time () + ttl;
+
+  /* Now that all syscalls are done, replace an older result and make
+   * room for the new one.  */
+  for (prev = NULL, x = aklresults; x; prev = x, x = x->next)
+    if (!strcmp (x->key, ar->key))
+      {
+        if (prev)
+          prev->next = x->next;
+        else
+          aklresults = x->next;
+        drop = x;
+        no_of_aklresults--;
+        break;
+      }
+  if (!drop && no_of_aklresults >= AKL_CACHE_SIZE)
+    {
+      /* Drop the least recently used item.  */
+      for (prev = NULL, x = aklresults; x && x->next; prev = x, x = x->next)
+        ;
+      if (x)
+        {
+          if (prev)
+            prev->next = NULL;
+          else
+            aklresults = NULL;
+          drop = x;
+          no_of_aklresults--;
+        }
+    }
+  ar->next = aklresults;
+  aklresults = ar;
+  no_of_aklresults++;
+
+  xfree (drop);
+}
@@ -57,6 +57,7 @@
 #include <string.h>
 #include <ctype.h>
 #include <errno.h>
+#include <limits.h>
 #include <unistd.h>
 
 #ifdef HAVE_W32_SYSTEM
@@ -77,6 +78,7 @@
 # include <time.h>
 # include <fcntl.h>
 # include <netinet/in.h>
+# include <netinet/tcp.h>
 # include <arpa/inet.h>
 # include <netdb.h>
 #endif /*!HAVE_W32_SYSTEM*/
@@ -105,6 +107,7 @@
 #include "../common/util.h"
 #include "../common/i18n.h"
 #include "../common/sysutils.h" /* (gnupg_fd_t) */
+#include "../common/hotpath.h"
 #include "dns-stuff.h"
 #include "dirmngr-status.h"    /* (dirmngr_status_printf)  */
 #include "http.h"
@@ -134,6 +137,10 @@
 
 #define HTTP_PROXY_ENV           "http_proxy"
 #define MAX_LINELEN 20000  /* Max. length of a HTTP header line. */
+#define MAX_IDLE_CONNECTIONS 8  /* Max. number of kept-alive connections. */
+#define IDLE_CONNECTION_TTL 10  /* Seconds to keep an idle connection.  */
+#define MAX_CONNECT_ATTEMPTS 8  /* Max. number of parallel connects.  */
+#define CONNECT_ATTEMPT_DELAY 250 /* Milliseconds between connects.  */
 #define VALID_URI_CHARS "abcdefghijklmnopqrstuvwxyz"   \
                         "ABCDEFGHIJKLMNOPQRSTUVWXYZ"   \
                         "01234567890@"                 \
@@ -180,6 +187,15 @@ static gpgrt_ssize_t simple_cookie_write (void *cookie,
                                           const void *buffer, size_t size);
 #endif
 
+/* A pending connection attempt of connect_server.  */
+struct connect_attempt_s
+{
+  assuan_fd_t sock;        /* The socket in non-blocking mode.  */
+  int oflags;              /* The original flags of the socket.  */
+  unsigned long started;   /* Start time of the attempt in ms.  */
+};
+
+
 /* A socket object used to a allow ref counting of sockets.  */
 struct my_socket_s
 {
@@ -214,6 +230,14 @@ struct cookie_s
      the content length.  */
   uint64_t content_length;
   unsigned int content_length_valid:1;
+
+  /* The total number of bytes returned by cookie_read.  */
+  uint64_t nread;
+
+  /* If not NULL the server agreed to keep the connection open and
+   * this is the malloced key to put it into the idle list after the
+   * response has been read completely.  */
+  char *keep_alive_key;
 };
 typedef struct cookie_s *cookie_t;
 
@@ -308,7 +332,21 @@ struct http_context_s
   size_t buffer_size;
   unsigned int flags;
   header_t headers;      /* Received headers. */
+  char *keep_alive_key;  /* Malloced key if keep-alive was requested.  */
+};
+
+
+/* A connection which has been kept open after a completed response.
+ * SESSION is only used for TLS connections and is in that case the
+ * session object owning the TLS state.  */
+struct idle_connection_s
+{
+  char *key;               /* Malloced; NULL marks an unused slot.  */
+  my_socket_t sock;
+  http_session_t session;
+  time_t stamp;            /* Time the connection was put here.  */
 };
+static struct idle_connection_s idle_connections[MAX_IDLE_CONNECTIONS];
 
 
 /* Two flags to enable verbose and debug mode.  Although currently not
@@ -967,6 +1005,159 @@ http_session_set_timeout (http_session_t sess, unsigned int timeout)
 
 
 
+/* Close the idle connection at slot IDX.  */
+static void
+release_idle_connection (int idx)
+{
+  struct idle_connection_s conn = idle_connections[idx];
+
+  /* Clear the slot first because closing may switch threads.  */
+  memset (&idle_connections[idx], 0, sizeof *idle_connections);
+  xfree (conn.key);
+  my_socket_unref (conn.sock, NULL, NULL);
+  http_session_unref (conn.session);
+}
+
+
+/* Return the malloced key used to find an idle connection for HD to
+ * SERVER and PORT.  Returns NULL if keep-alive shall not be used or
+ * on error.  */
+static char *
+make_keep_alive_key (http_t hd, const char *server, unsigned short port,
+                     const char *httphost)
+{
+  if (!(hd->flags & HTTP_FLAG_KEEP_ALIVE)
+      || (hd->flags & HTTP_FLAG_SHUTDOWN))
+    return NULL;
+#if HTTP_USE_NTBTLS
+  /* We can't re-attach an ntbtls context to a new request.  */
+  if (hd->uri->use_tls)
+    return NULL;
+#endif
+
+  return xtryasprintf ("%s:%s:%hu:%s:%u",
+                       hd->uri->use_tls? "https" : "http",
+                       server, port, httphost? httphost : "",
+                       ((hd->flags & HTTP_FLAG_FORCE_TOR)
+                        | (hd->uri->use_tls? hd->session->flags : 0)));
+}
+
+
+/* Take an idle connection matching HD->KEEP_ALIVE_KEY and use it for
+ * HD.  Returns true if a connection has been found.  */
+static int
+reuse_idle_connection (http_t hd)
+{
+  struct idle_connection_s conn;
+  time_t now = gnupg_get_time ();
+  fd_set rset;
+  struct timeval tv;
+  int idx;
+
+  for (idx = 0; idx < MAX_IDLE_CONNECTIONS; idx++)
+    {
+      if (!idle_connections[idx].key)
+        continue;
+      if (idle_connections[idx].stamp + IDLE_CONNECTION_TTL < now)
+        {
+          release_idle_connection (idx);
+          continue;
+        }
+      if (strcmp (idle_connections[idx].key, hd->keep_alive_key))
+        continue;
+      if (hd->uri->use_tls
+          && idle_connections[idx].session->verify_cb
+             != hd->session->verify_cb)
+        continue;
+
+      conn = idle_connections[idx];
+      memset (&idle_connections[idx], 0, sizeof *idle_connections);
+
+      /* An idle connection must not be readable; if it is, the
+       * server closed it or sent garbage.  */
+      FD_ZERO (&rset);
+      FD_SET (FD2INT (conn.sock->fd), &rset);
+      tv.tv_sec = 0;
+      tv.tv_usec = 0;
+      if (my_select (FD2INT (conn.sock->fd)+1, &rset, NULL, NULL, &tv))
+        {
+          xfree (conn.key);
+          my_socket_unref (conn.sock, NULL, NULL);
+          http_session_unref (conn.session);
+          continue;
+        }
+
+      xfree (conn.key);
+      hd->sock = conn.sock;
+      if (conn.session)
+        {
+          /* Take the TLS state from the old session but the callback
+           * data and timeout of the new one.  */
+          conn.session->verify_cb_value = hd->session->verify_cb_value;
+          conn.session->cert_log_cb = hd->session->cert_log_cb;
+          conn.session->connect_timeout = hd->session->connect_timeout;
+          http_session_unref (hd->session);
+          hd->session = conn.session;
+        }
+      if (opt_debug)
+        log_debug ("http.c:reusing connection fd %d\n", FD2INT (hd->sock->fd));
+      return 1;
+    }
+
+  return 0;
+}
+
+
+/* Put the connection of the read COOKIE into the idle list.  On
+ * success the references to the socket and for TLS also to the
+ * session are moved to the list.  */
+static void
+put_idle_connection (cookie_t cookie)
+{
+  time_t now = gnupg_get_time ();
+  int idx, oldest = 0;
+
+  for (idx = 0; idx < MAX_IDLE_CONNECTIONS; idx++)
+    {
+      if (!idle_connections[idx].key)
+        break;
+      if (idle_connections[idx].stamp < idle_connections[oldest].stamp)
+        oldest = idx;
+    }
+  if (idx == MAX_IDLE_CONNECTIONS)
+    {
+      idx = oldest;
+      release_idle_connection (idx);
+      if (idle_connections[idx].key)
+        return;  /* Slot taken by another thread meanwhile.  */
+    }
+
+  idle_connections[idx].key = cookie->keep_alive_key;
+  cookie->keep_alive_key = NULL;
+  idle_connections[idx].sock = cookie->sock;
+  cookie->sock = NULL;
+  if (cookie->use_tls)
+    {
+      idle_connections[idx].session = cookie->session;
+      cookie->session = NULL;
+    }
+  idle_connections[idx].stamp = now;
+}
+
+
+/* Close all idle connections.  */
+void
+http_release_idle_connections (void)
+{
+  int idx;
+
+  for (idx = 0; idx < MAX_IDLE_CONNECTIONS; idx++)
+    if (idle_connections[idx].key)
+      release_idle_connection (idx);
+}
+
+
+
 
 /* Start a HTTP retrieval and on success store at R_HD a context
    pointer for completing the request and to wait for the response.
@@ -1009,6 +1200,7 @@ http_open (ctrl_t ctrl, http_t *r_hd, http_req_t reqtype, const char *url,
       if (hd->fp_write)
         es_fclose (hd->fp_write);
       http_session_unref (hd->session);
+      xfree (hd->keep_alive_key);
       xfree (hd);
     }
   else
@@ -1263,6 +1455,7 @@ http_close (http_t hd, int keep_read_stream)
       hd->headers = tmp;
     }
   xfree (hd->buffer);
+  xfree (hd->keep_alive_key);
   xfree (hd);
 }
 
@@ -1878,6 +2071,8 @@ send_request (ctrl_t ctrl, http_t hd, const char *httphost, const char *auth,
 #endif /*HTTP_USE_GNUTLS*/
     }
 
+  hd->keep_alive_key = make_keep_alive_key (hd, server, port, httphost);
+
   if ( (proxy && *proxy)
        || ( (hd->flags & HTTP_FLAG_TRY_PROXY)
             && (http_proxy = getenv (HTTP_PROXY_ENV))
@@ -1885,6 +2080,10 @@ send_request (ctrl_t ctrl, http_t hd, const char *httphost, const char *auth,
     {
       parsed_uri_t uri;
 
+      /* We do not keep connections to proxies.  */
+      xfree (hd->keep_alive_key);
+      hd->keep_alive_key = NULL;
+
       if (proxy)
 	http_proxy = proxy;
 
@@ -1937,6 +2136,8 @@ send_request (ctrl_t ctrl, http_t hd, const char *httphost, const char *auth,
                             hd->flags, NULL, timeout, &sock);
       http_release_parsed_uri (uri);
     }
+  else if (hd->keep_alive_key && reuse_idle_connection (hd))
+    goto build_request;  /* TLS has already been negotiated.  */
   else
     {
       err = connect_server (ctrl,
@@ -2215,6 +2416,7 @@ send_request (ctrl_t ctrl, http_t hd, const char *httphost, const char *auth,
 
 #endif /*HTTP_USE_GNUTLS*/
 
+ build_request:
   if (auth || hd->uri->auth)
     {
       char *myauth;
@@ -2280,13 +2482,14 @@ send_request (ctrl_t ctrl, http_t hd, const char *httphost, const char *auth,
         snprintf (portstr, sizeof portstr, ":%u", port);
 
       request = es_bsprintf
-        ("%s %s%s HTTP/1.0\r\nHost: %s%s\r\n%s",
+        ("%s %s%s HTTP/1.0\r\nHost: %s%s\r\n%s%s",
          hd->req_type == HTTP_REQ_GET ? "GET" :
          hd->req_type == HTTP_REQ_HEAD ? "HEAD" :
          hd->req_type == HTTP_REQ_POST ? "POST" : "OOPS",
          *p == '/' ? "" : "/", p,
          httphost? httphost : server,
          portstr,
+         hd->keep_alive_key? "Connection: keep-alive\r\n" : "",
          authstr? authstr:"");
     }
   xfree (p);
@@ -2325,19 +2528,21 @@ send_request (ctrl_t ctrl, http_t hd, const char *httphost, const char *auth,
         xfree (cookie);
         hd->write_cookie = NULL;
       }
-    else if (es_fputs (request, hd->fp_write) || es_fflush (hd->fp_write))
+    else if (es_fputs (request, hd->fp_write))
       err = gpg_err_make (default_errsource, gpg_err_code_from_syserror ());
     else
       err = 0;
 
+  /* Note that we do not flush here so that the entire header is sent
+   * in one go by http_start_data.  */
   if (!err)
     {
       for (;headers; headers=headers->next)
         {
           if (opt_debug || (hd->flags & HTTP_FLAG_LOG_RESP))
             log_debug_string (headers->d, "http.c:request-header:");
-          if ((es_fputs (headers->d, hd->fp_write) || es_fflush (hd->fp_write))
-              || (es_fputs("\r\n",hd->fp_write) || es_fflush(hd->fp_write)))
+          if (es_fputs (headers->d, hd->fp_write)
+              || es_fputs ("\r\n", hd->fp_write))
             {
               err = gpg_err_make (default_errsource,
                                   gpg_err_code_from_syserror ());
@@ -2562,6 +2767,9 @@ parse_response (http_t hd)
   size_t maxlen, len;
   cookie_t cookie = hd->read_cookie;
   const char *s;
+  uint64_t nconsumed = 0;
+  int truncated = 0;
+  int is_http_1_1;
 
   /* Delete old header lines.  */
   while (hd->headers)
@@ -2584,6 +2792,7 @@ parse_response (http_t hd)
 	return gpg_error (GPG_ERR_TRUNCATED); /* Line has been truncated. */
       if (!len)
 	return gpg_error (GPG_ERR_EOF);
+      nconsumed += len;
 
       if (opt_debug || (hd->flags & HTTP_FLAG_LOG_RESP))
         log_debug_string (line, "http.c:response:\n");
@@ -2602,6 +2811,7 @@ parse_response (http_t hd)
     }
   if (!p2)
     return 0; /* Also assume http 0.9. */
+  is_http_1_1 = !strcmp (p, "1.1");
   p = p2;
   /* TODO: Add HTTP version number check. */
   if ((p2 = strpbrk (p, " \t")))
@@ -2627,6 +2837,9 @@ parse_response (http_t hd)
       /* Note, that we can silently ignore truncated lines. */
       if (!len)
 	return gpg_error (GPG_ERR_EOF);
+      if (!maxlen)
+        truncated = 1;
+      nconsumed += len;
       /* Trim line endings of empty lines. */
       if ((*line == '\r' && line[1] == '\n') || *line == '\n')
 	*line = 0;
@@ -2650,9 +2863,29 @@ parse_response (http_t hd)
         {
           cookie->content_length_valid = 1;
           cookie->content_length = string_to_u64 (s);
+          /* Account for the part of the body already buffered while
+           * reading the header.  */
+          if (!truncated && cookie->nread >= nconsumed)
+            {
+              if (cookie->nread - nconsumed < cookie->content_length)
+                cookie->content_length -= cookie->nread - nconsumed;
+              else
+                cookie->content_length = 0;
+            }
         }
     }
 
+  /* Decide whether the connection may be used for another request.
+   * Without a content length we can't know the end of the body.  */
+  if (hd->keep_alive_key && cookie->content_length_valid && !truncated
+      && hd->status_code >= 200
+      && !http_get_header (hd, "Transfer-Encoding"))
+    {
+      s = http_get_header (hd, "Connection");
+      if (s? !ascii_strcasecmp (s, "keep-alive") : is_http_1_1)
+        cookie->keep_alive_key = xtrystrdup (hd->keep_alive_key);
+    }
+
   return 0;
 }
 
@@ -2945,25 +3178,187 @@ connect_with_timeout (assuan_fd_t sock,
 }
 
 
+/* Switch the socket SOCK back into blocking mode.  OFLAGS are the
+ * flags as returned by fcntl before the switch to non-blocking mode.  */
+static void
+restore_blocking (assuan_fd_t sock, int oflags)
+{
+#ifdef HAVE_W32_SYSTEM
+  unsigned long along = 0;
+
+  (void)oflags;
+  ioctlsocket (FD2INT (sock), FIONBIO, &along);
+#else
+  fcntl (sock, F_SETFL, oflags);
+#endif
+}
+
+
+/* Return the number of milliseconds elapsed since T0.  */
+static unsigned long
+elapsed_ms (const struct timeval *t0)
+{
+  struct timeval t;
+
+  gettimeofday (&t, NULL);
+  return ((unsigned long)(t.tv_sec - t0->tv_sec) * 1000
+          + (t.tv_usec - t0->tv_usec) / 1000);
+}
+
+
+/* Return true if the address AI may be used as per FLAGS and the
+ * validity flags for the address families.  */
+static int
+usable_addr_p (dns_addrinfo_t ai, unsigned int flags,
+               int v4_valid, int v6_valid)
+{
+  if (ai->family == AF_INET
+      && ((flags & HTTP_FLAG_IGNORE_IPv4) || !v4_valid))
+    return 0;
+  if (ai->family == AF_INET6
+      && ((flags & HTTP_FLAG_IGNORE_IPv6) || !v6_valid))
+    return 0;
+  return 1;
+}
+
+
+/* Append the usable addresses from AIBUF to the array at R_CANDS
+ * which has R_NCANDS items.  As described by RFC-8305 the addresses
+ * are interleaved by family, starting with the family of the first
+ * address returned by the resolver.  */
+static gpg_error_t
+add_connect_candidates (dns_addrinfo_t aibuf, unsigned int flags,
+                        int v4_valid, int v6_valid,
+                        dns_addrinfo_t **r_cands, size_t *r_ncands)
+{
+  dns_addrinfo_t *cands;
+  dns_addrinfo_t ai, first, other;
+  int family = 0;
+  size_t n, i;
+
+  for (n=0, ai = aibuf; ai; ai = ai->next)
+    if (usable_addr_p (ai, flags, v4_valid, v6_valid))
+      {
+        if (!n)
+          family = ai->family;
+        n++;
+      }
+  if (!n)
+    return 0;
+
+  cands = xtryrealloc (*r_cands, (*r_ncands + n) * sizeof *cands);
+  if (!cands)
+    return gpg_err_make (default_errsource, gpg_err_code_from_syserror ());
+  *r_cands = cands;
+  cands += *r_ncands;
+  *r_ncands += n;
+
+  first = other = aibuf;
+  for (i=0; i < n; i++)
+    {
+      /* Advance both cursors to the next usable address of their
+       * family.  */
+      for (; first; first = first->next)
+        if (first->family == family
+            && usable_addr_p (first, flags, v4_valid, v6_valid))
+          break;
+      for (; other; other = other->next)
+        if (other->family != family
+            && usable_addr_p (other, flags, v4_valid, v6_valid))
+          break;
+
+      if (first && (!(i % 2) || !other))
+        {
+          cands[i] = first;
+          first = first->next;
+        }
+      else
+        {
+          cands[i] = other;
+          other = other->next;
+        }
+    }
+
+  return 0;
+}
+
+
+/* Start a connection attempt to AI using the new socket SOCK.  On
+ * success 0 is returned; GPG_ERR_EINPROGRESS is returned if the
+ * connection is still pending, in which case the socket is in
+ * non-blocking mode and the old flags are stored at R_OFLAGS.  If a
+ * SOCKS proxy is used the connection is made synchronously using
+ * TIMEOUT.  */
+static gpg_error_t
+start_connect (assuan_fd_t sock, dns_addrinfo_t ai, unsigned int timeout,
+               int *r_oflags)
+{
+  gpg_error_t err;
+
+  *r_oflags = 0;
+  if (use_socks (ai->addr))
+    return connect_with_timeout (sock, (struct sockaddr *)ai->addr,
+                                 ai->addrlen, timeout);
+
+#ifdef HAVE_W32_SYSTEM
+  {
+    unsigned long along = 1;
+    if (ioctlsocket (FD2INT (sock), FIONBIO, &along))
+      return my_wsagetlasterror ();
+  }
+#else
+  *r_oflags = fcntl (sock, F_GETFL, 0);
+  if (fcntl (sock, F_SETFL, *r_oflags | O_NONBLOCK))
+    return gpg_err_make (default_errsource, gpg_err_code_from_syserror ());
+#endif
+
+  if (!assuan_sock_connect (sock, (struct sockaddr *)ai->addr, ai->addrlen))
+    err = 0;
+  else
+    {
+      err = gpg_err_make (default_errsource, gpg_err_code_from_syserror ());
+#ifdef HAVE_W32_SYSTEM
+      if (gpg_err_code (err) == GPG_ERR_EAGAIN)
+        err = gpg_err_make (default_errsource, GPG_ERR_EINPROGRESS);
+#endif
+      if (gpg_err_code (err) == GPG_ERR_EINPROGRESS)
+        return err;
+    }
+
+  restore_blocking (sock, *r_oflags);
+  return err;
+}
+
+
 /* Actually connect to a server.  On success 0 is returned and the
  * file descriptor for the socket is stored at R_SOCK; on error an
  * error code is returned and ASSUAN_INVALID_FD is stored at R_SOCK.
  * TIMEOUT is the connect timeout in milliseconds.  Note that the
  * function tries to connect to all known addresses and the timeout is
- * for each one. */
+ * for each one.  Several attempts may run in parallel. */
 static gpg_error_t
-connect_server (ctrl_t ctrl, const char *server, unsigned short port,
-                unsigned int flags, const char *srvtag, unsigned int timeout,
-                assuan_fd_t *r_sock)
+do_connect_server (ctrl_t ctrl, const char *server, unsigned short port,
+                   unsigned int flags, const char *srvtag,
+                   unsigned int timeout, assuan_fd_t *r_sock)
 {
   gpg_error_t err;
   assuan_fd_t sock = ASSUAN_INVALID_FD;
   unsigned int srvcount = 0;
   int hostfound = 0;
   int anyhostaddr = 0;
-  int srv, connected, v4_valid, v6_valid;
+  int srv, v4_valid, v6_valid;
   gpg_error_t last_err = 0;
   struct srventry *serverlist = NULL;
+  dns_addrinfo_t *aibufs;
+  dns_addrinfo_t *cands = NULL;
+  size_t ncands = 0;
+  size_t nextcand = 0;
+  struct connect_attempt_s attempts[MAX_CONNECT_ATTEMPTS];
+  int nattempts = 0;
+  struct timeval t0, tval;
+  unsigned long now, nextstart, wait;
+  fd_set rset, wset;
+  int i, n, maxfd, syserr;
 
   *r_sock = ASSUAN_INVALID_FD;
 
@@ -3029,37 +3424,59 @@ connect_server (ctrl_t ctrl, const char *server, unsigned short port,
       srvcount = 1;
     }
 
-  connected = 0;
-  for (srv=0; srv < srvcount && !connected; srv++)
+  /* Now try the addresses of all servers.  Following RFC-8305 we do
+   * not wait for a connection attempt to time out but start the next
+   * one after CONNECT_ATTEMPT_DELAY; the first connection established
+   * wins.  The next server is only resolved when we have run out of
+   * addresses.  */
+  aibufs = xtrycalloc (srvcount, sizeof *aibufs);
+  if (!aibufs)
     {
-      dns_addrinfo_t aibuf, ai;
-
-      if (opt_debug)
-        log_debug ("http.c:connect_server: trying name='%s' port=%hu\n",
-                   serverlist[srv].target, port);
-      err = resolve_dns_name (ctrl,
-                              serverlist[srv].target, port, 0, SOCK_STREAM,
-                              &aibuf, NULL);
-      if (err)
+      err = gpg_err_make (default_errsource, gpg_err_code_from_syserror ());
+      xfree (serverlist);
+      return err;
+    }
+  gettimeofday (&t0, NULL);
+  nextstart = 0;
+  srv = 0;
+  for (;;)
+    {
+      while (nextcand == ncands && srv < srvcount)
         {
-          log_info ("resolving '%s' failed: %s\n",
-                    serverlist[srv].target, gpg_strerror (err));
-          last_err = err;
-          continue; /* Not found - try next one. */
+          if (opt_debug)
+            log_debug ("http.c:connect_server: trying name='%s' port=%hu\n",
+                       serverlist[srv].target, port);
+          err = resolve_dns_name (ctrl,
+                                  serverlist[srv].target, port, 0, SOCK_STREAM,
+                                  &aibufs[srv], NULL);
+          if (err)
+            {
+              log_info ("resolving '%s' failed: %s\n",
+                        serverlist[srv].target, gpg_strerror (err));
+              last_err = err;
+              srv++;
+              continue; /* Not found - try next one. */
+            }
+          hostfound = 1;
+          err = add_connect_candidates (aibufs[srv], flags, v4_valid, v6_valid,
+                                        &cands, &ncands);
+          srv++;
+          if (err)
+            goto leave;
         }
-      hostfound = 1;
 
-      for (ai = aibuf; ai && !connected; ai = ai->next)
+      now = elapsed_ms (&t0);
+      if (nextcand < ncands && nattempts < MAX_CONNECT_ATTEMPTS
+          && (!nattempts || now >= nextstart))
         {
-          if (ai->family == AF_INET
-              && ((flags & HTTP_FLAG_IGNORE_IPv4) || !v4_valid))
-            continue;
-          if (ai->family == AF_INET6
-              && ((flags & HTTP_FLAG_IGNORE_IPv6) || !v6_valid))
+          dns_addrinfo_t ai = cands[nextcand++];
+          int oflags;
+
+          /* Check again because a family may have been found to be
+           * not supported.  */
+          if (!usable_addr_p (ai, flags, v4_valid, v6_valid))
             continue;
 
-          if (sock != ASSUAN_INVALID_FD)
-            assuan_sock_close (sock);
           sock = my_sock_new_for_addr (ai->addr, ai->socktype, ai->protocol);
           if (sock == ASSUAN_INVALID_FD)
             {
@@ -3075,30 +3492,122 @@ connect_server (ctrl_t ctrl, const char *server, unsigned short port,
               err = gpg_err_make (default_errsource,
                                   gpg_err_code_from_syserror ());
               log_error ("error creating socket: %s\n", gpg_strerror (err));
-              free_dns_addrinfo (aibuf);
-              xfree (serverlist);
-              return err;
+              goto leave;
             }
 
           anyhostaddr = 1;
-          err = connect_with_timeout (sock, (struct sockaddr *)ai->addr,
-                                      ai->addrlen, timeout);
-          if (err)
+          err = start_connect (sock, ai, timeout, &oflags);
+          if (!err)
+            break;  /* Connected.  */
+          if (gpg_err_code (err) != GPG_ERR_EINPROGRESS)
             {
               last_err = err;
+              assuan_sock_close (sock);
+              sock = ASSUAN_INVALID_FD;
+              continue;
             }
-          else
+          attempts[nattempts].sock = sock;
+          attempts[nattempts].oflags = oflags;
+          attempts[nattempts].started = now;
+          nattempts++;
+          sock = ASSUAN_INVALID_FD;
+          nextstart = now + CONNECT_ATTEMPT_DELAY;
+          continue;
+        }
+
+      if (!nattempts)
+        {
+          err = last_err? last_err : gpg_err_make (default_errsource,
+                                                   GPG_ERR_UNKNOWN_HOST);
+          goto leave;
+        }
+
+      /* Wait until one of the pending attempts completes, the next
+       * attempt shall be started, or an attempt times out.  */
+      FD_ZERO (&rset);
+      maxfd = -1;
+      wait = (nextcand < ncands && nattempts < MAX_CONNECT_ATTEMPTS)
+        ? (nextstart > now? nextstart - now : 0) : ULONG_MAX;
+      for (i=0; i < nattempts; i++)
+        {
+          FD_SET (FD2INT (attempts[i].sock), &rset);
+          if (FD2INT (attempts[i].sock) > maxfd)
+            maxfd = FD2INT (attempts[i].sock);
+          if (timeout)
+            {
+              if (now >= attempts[i].started + timeout)
+                wait = 0;
+              else if (attempts[i].started + timeout - now < wait)
+                wait = attempts[i].started + timeout - now;
+            }
+        }
+      wset = rset;
+      if (wait != ULONG_MAX)
+        {
+          tval.tv_sec = wait / 1000;
+          tval.tv_usec = (wait % 1000) * 1000;
+        }
+      n = my_select (maxfd+1, &rset, &wset, NULL,
+                     wait != ULONG_MAX? &tval : NULL);
+      if (n < 0 && errno != EINTR)
+        {
+          err = gpg_err_make (default_errsource, gpg_err_code_from_syserror ());
+          goto leave;
+        }
+      if (n < 0)
+        {
+          FD_ZERO (&rset);
+          FD_ZERO (&wset);
+        }
+
+      now = elapsed_ms (&t0);
+      for (i=0; i < nattempts; i++)
+        {
+          if (FD_ISSET (FD2INT (attempts[i].sock), &rset)
+              || FD_ISSET (FD2INT (attempts[i].sock), &wset))
             {
-              connected = 1;
-              notify_netactivity ();
+              socklen_t slen = sizeof (syserr);
+
+              if (getsockopt (FD2INT (attempts[i].sock), SOL_SOCKET, SO_ERROR,
+                              (void*)&syserr, &slen) < 0)
+                err = gpg_err_make (default_errsource,
+                                    gpg_err_code_from_syserror ());
+              else if (syserr)
+                err = gpg_err_make (default_errsource,
+                                    gpg_err_code_from_errno (syserr));
+              else
+                {
+                  /* Connected.  */
+                  sock = attempts[i].sock;
+                  restore_blocking (sock, attempts[i].oflags);
+                  attempts[i] = attempts[--nattempts];
+                  err = 0;
+                  goto leave;
+                }
+              /* Failed - start the next attempt right away.  */
+              nextstart = now;
             }
+          else if (timeout && now >= attempts[i].started + timeout)
+            err = gpg_err_make (default_errsource, GPG_ERR_ETIMEDOUT);
+          else
+            continue;
+
+          last_err = err;
+          assuan_sock_close (attempts[i].sock);
+          attempts[i--] = attempts[--nattempts];
         }
-      free_dns_addrinfo (aibuf);
     }
 
+ leave:
+  for (i=0; i < nattempts; i++)
+    assuan_sock_close (attempts[i].sock);
+  for (i=0; i < srvcount; i++)
+    free_dns_addrinfo (aibufs[i]);
+  xfree (aibufs);
+  xfree (cands);
   xfree (serverlist);
 
-  if (!connected)
+  if (err)
     {
       if (!hostfound)
         log_error ("can't connect to '%s': %s\n",
@@ -3113,21 +3622,45 @@ connect_server (ctrl_t ctrl, const char *server, unsigned short port,
                    server, (int)WSAGetLastError());
 #else
         log_error ("can't connect to '%s': %s\n",
-                   server, gpg_strerror (last_err));
+                   server, gpg_strerror (err));
 #endif
         }
-      err = last_err? last_err : gpg_err_make (default_errsource,
-                                               GPG_ERR_UNKNOWN_HOST);
       if (sock != ASSUAN_INVALID_FD)
 	assuan_sock_close (sock);
       return err;
     }
 
+  notify_netactivity ();
+#ifdef TCP_NODELAY
+  {
+    /* We write a request in one go and then wait for the
+     * response; Nagle's algorithm would only delay a
+     * following write, for example the body of a POST.  */
+    int one = 1;
+
+    setsockopt (FD2INT (sock), IPPROTO_TCP, TCP_NODELAY,
+                (void *)&one, sizeof one);
+  }
+#endif
   *r_sock = sock;
   return 0;
 }
 
 
+static gpg_error_t
+connect_server (ctrl_t ctrl, const char *server, unsigned short port,
+                unsigned int flags, const char *srvtag, unsigned int timeout,
+                assuan_fd_t *r_sock)
+{
+  gpg_error_t err;
+
+  HOTPATH_COUNT ("http_connect",
+                 err = do_connect_server (ctrl, server, port, flags, srvtag,
+                                          timeout, r_sock));
+  return err;
+}
+
+
 /* Helper to read from a socket.  This handles npth things and
  * EINTR.  */
 static gpgrt_ssize_t
@@ -3281,6 +3814,9 @@ cookie_read (void *cookie, void *buffer, size_t size)
       nread = read_server (c->sock->fd, buffer, size);
     }
 
+  if (nread > 0)
+    c->nread += nread;
+
   if (c->content_length_valid && nread > 0)
     {
       if (nread < c->content_length)
@@ -3421,6 +3957,13 @@ cookie_close (void *cookie)
   if (!c)
     return 0;
 
+  /* Keep the connection if the response has been read completely.  */
+  if (c->keep_alive_key && c->sock
+      && c->content_length_valid && !c->content_length
+      && (!c->use_tls || (c->session && c->session->tls_session)))
+    put_idle_connection (c);
+  xfree (c->keep_alive_key);
+
 #if HTTP_USE_NTBTLS
   if (c->use_tls && c->session && c->session->tls_session)
     {
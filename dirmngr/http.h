@@ -96,7 +96,8 @@ enum
     HTTP_FLAG_TRUST_DEF   = 256, /* Use the CAs configured for HKP.  */
     HTTP_FLAG_TRUST_SYS   = 512, /* Also use the system defined CAs. */
     HTTP_FLAG_TRUST_CFG  = 1024, /* Also use configured CAs.         */
-    HTTP_FLAG_NO_CRL     = 2048  /* Do not consult CRLs for https.   */
+    HTTP_FLAG_NO_CRL     = 2048, /* Do not consult CRLs for https.   */
+    HTTP_FLAG_KEEP_ALIVE = 4096  /* Try to reuse the connection.     */
   };
 
 
@@ -150,6 +151,7 @@ void http_session_set_log_cb (http_session_t sess,
                                          const char *,
                                          const void **, size_t *));
 void http_session_set_timeout (http_session_t sess, unsigned int timeout);
+void http_release_idle_connections (void);
 
 
 #define HTTP_PARSE_NO_SCHEME_CHECK 1
@@ -25,6 +25,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include <assert.h>
+#include <npth.h>
 
 #include "dirmngr.h"
 #include "misc.h"
@@ -261,11 +262,73 @@ ks_action_resolve (ctrl_t ctrl, uri_item_t keyservers)
 }
 
 
+/* Copy the machine readable search result from INFP to OUTFP.  The
+ * output is flushed after each key so that the client can display
+ * the first keys while the rest is still being received.  If LIMIT
+ * is not 0 only that many keys are copied and the remaining data is
+ * not read at all.  */
+static gpg_error_t
+copy_search_result (estream_t infp, estream_t outfp, unsigned int limit)
+{
+  gpg_error_t err = 0;
+  char *line = NULL;
+  size_t linesize = 0;
+  size_t maxlen;
+  ssize_t len;
+  unsigned int nkeys = 0;
+
+  for (;;)
+    {
+      maxlen = 16384;
+      len = es_read_line (infp, &line, &linesize, &maxlen);
+      if (len < 0)
+        {
+          err = gpg_error_from_syserror ();
+          break;
+        }
+      if (!len)
+        break; /* EOF.  */
+      if (!maxlen)
+        {
+          err = gpg_error (GPG_ERR_LINE_TOO_LONG);
+          break;
+        }
+
+      if (!ascii_strncasecmp (line, "pub:", 4))
+        {
+          if (limit && nkeys == limit)
+            {
+              if (opt.verbose)
+                log_info ("search result truncated after %u keys\n", nkeys);
+              break;
+            }
+          nkeys++;
+          /* Pass the previous key on to the client.  */
+          if (es_fflush (outfp))
+            {
+              err = gpg_error_from_syserror ();
+              break;
+            }
+        }
+
+      if (es_write (outfp, line, len, NULL))
+        {
+          err = gpg_error_from_syserror ();
+          break;
+        }
+    }
+
+  xfree (line);
+  return err;
+}
+
+
 /* Search all configured keyservers for keys matching PATTERNS and
-   write the result to the provided output stream.  */
+   write the result to the provided output stream.  If LIMIT is not
+   0 at most LIMIT keys are returned.  */
 gpg_error_t
 ks_action_search (ctrl_t ctrl, uri_item_t keyservers,
-		  strlist_t patterns, estream_t outfp)
+		  strlist_t patterns, unsigned int limit, estream_t outfp)
 {
   gpg_error_t err = 0;
   int any_server = 0;
@@ -317,7 +380,7 @@ ks_action_search (ctrl_t ctrl, uri_item_t keyservers,
 
           if (!err)
             {
-              err = copy_stream (infp, outfp);
+              err = copy_search_result (infp, outfp, limit);
               es_fclose (infp);
               any_results = 1;
               break;
@@ -333,6 +396,118 @@ ks_action_search (ctrl_t ctrl, uri_item_t keyservers,
 }
 
 
+/* The maximum number of concurrent requests to a HKP keyserver.  */
+#define MAX_CONCURRENT_KS_GET 8
+
+/* A key to be fetched by ks_get_worker.  */
+struct ks_get_job_s
+{
+  const char *pattern;  /* The pattern to fetch.  */
+  gpg_error_t err;      /* The error from the keyserver engine.  */
+  gpg_error_t copyerr;  /* The error from reading the response.  */
+  estream_t fp;         /* Memory stream with the response.  */
+};
+
+/* The parameters for the ks_get_worker threads.  */
+struct ks_get_jobs_s
+{
+  ctrl_t ctrl;
+  parsed_uri_t uri;
+  struct ks_get_job_s *jobs;
+  int njobs;
+  int next;             /* Index of the next job to take.  */
+};
+
+
+/* Thread function to fetch keys from a HKP keyserver until all jobs
+ * in ARG have been taken.  */
+static void *
+ks_get_worker (void *arg)
+{
+  struct ks_get_jobs_s *parm = arg;
+  struct ks_get_job_s *job;
+  estream_t infp;
+
+  /* Taking a job does not switch threads and thus needs no lock.  */
+  while (parm->next < parm->njobs)
+    {
+      job = parm->jobs + parm->next++;
+      job->err = ks_hkp_get (parm->ctrl, parm->uri, job->pattern, &infp);
+      if (job->err)
+        continue;
+      job->fp = es_fopenmem (0, "w+b");
+      if (!job->fp)
+        job->copyerr = gpg_error_from_syserror ();
+      else
+        job->copyerr = copy_stream (infp, job->fp);
+      es_fclose (infp);
+      if (!job->copyerr)
+        es_rewind (job->fp);
+    }
+  return NULL;
+}
+
+
+/* Fetch the keys matching PATTERNS from the HKP keyserver URI using
+ * several connections and write them in the order of PATTERNS to
+ * OUTFP.  The semantics of the return value, R_FIRST_ERR, and
+ * R_ANY_DATA are those of the loop in ks_action_get.  */
+static gpg_error_t
+ks_get_concurrent (ctrl_t ctrl, parsed_uri_t uri, strlist_t patterns,
+                   estream_t outfp, gpg_error_t *r_first_err, int *r_any_data)
+{
+  gpg_error_t err = 0;
+  struct ks_get_jobs_s parm;
+  npth_t threads[MAX_CONCURRENT_KS_GET];
+  npth_attr_t tattr;
+  int nthreads = 0;
+  strlist_t sl;
+  int i;
+
+  memset (&parm, 0, sizeof parm);
+  parm.ctrl = ctrl;
+  parm.uri = uri;
+  parm.njobs = strlist_length (patterns);
+  parm.jobs = xtrycalloc (parm.njobs, sizeof *parm.jobs);
+  if (!parm.jobs)
+    return gpg_error_from_syserror ();
+  for (sl = patterns, i = 0; sl; sl = sl->next, i++)
+    parm.jobs[i].pattern = sl->d;
+
+  if (!npth_attr_init (&tattr))
+    {
+      npth_attr_setdetachstate (&tattr, NPTH_CREATE_JOINABLE);
+      for (; nthreads < MAX_CONCURRENT_KS_GET && nthreads < parm.njobs;
+           nthreads++)
+        if (npth_create (&threads[nthreads], &tattr, ks_get_worker, &parm))
+          break;
+      npth_attr_destroy (&tattr);
+    }
+  /* Fetch the remaining keys here if no thread could be started.  */
+  if (!nthreads)
+    ks_get_worker (&parm);
+  for (i = 0; i < nthreads; i++)
+    npth_join (threads[i], NULL);
+
+  for (i = 0; !err && i < parm.njobs; i++)
+    {
+      if (parm.jobs[i].err)
+        *r_first_err = parm.jobs[i].err;
+      else if (!(err = parm.jobs[i].copyerr))
+        {
+          err = copy_stream (parm.jobs[i].fp, outfp);
+          if (!err)
+            *r_any_data = 1;
+        }
+    }
+
+  for (i = 0; i < parm.njobs; i++)
+    es_fclose (parm.jobs[i].fp);
+  xfree (parm.jobs);
+  return err;
+}
+
+
 /* Get the requested keys (matching PATTERNS) using all configured
    keyservers and write the result to the provided output stream.  */
 gpg_error_t
@@ -375,7 +550,30 @@ ks_action_get (ctrl_t ctrl, uri_item_t keyservers,
                  || uri->parsed_uri->opaque);
 #endif
 
-      if (is_hkp_s || is_http_s || is_ldap)
+      if (is_hkp_s && patterns->next)
+        {
+          any_server = 1;
+          err = ks_get_concurrent (ctrl, uri->parsed_uri, patterns, outfp,
+                                   &first_err, &any_data);
+        }
+#if USE_LDAP
+      else if (is_ldap && patterns->next
+               && !(ks_get_flags & (KS_GET_FLAG_FIRST|KS_GET_FLAG_NEXT)))
+        {
+          /* Fetch all keys with a few combined searches.  */
+          any_server = 1;
+          err = ks_ldap_get_many (ctrl, uri->parsed_uri, patterns, newer,
+                                  outfp);
+          if (!err)
+            any_data = 1;
+          else
+            {
+              first_err = err;
+              err = 0;
+            }
+        }
+#endif
+      else if (is_hkp_s || is_http_s || is_ldap)
         {
           any_server = 1;
           for (sl = patterns; !err && sl; sl = sl->next)
@@ -391,7 +589,7 @@ ks_action_get (ctrl_t ctrl, uri_item_t keyservers,
               else if (is_http_s)
                 err = ks_http_fetch (ctrl, uri->parsed_uri->original,
                                      KS_HTTP_FETCH_NOCACHE,
-                                     &infp);
+                                     NULL, &infp);
               else
                 BUG ();
 
@@ -431,14 +629,19 @@ ks_action_get (ctrl_t ctrl, uri_item_t keyservers,
 
 /* Retrieve keys from URL and write the result to the provided output
  * stream OUTFP.  If OUTFP is NULL the data is written to the bit
- * bucket. */
+ * bucket.  If R_MAXAGE is not NULL the number of seconds the result
+ * may be cached is stored there; (unsigned int)(-1) is stored if
+ * that is not known. */
 gpg_error_t
-ks_action_fetch (ctrl_t ctrl, const char *url, estream_t outfp)
+ks_action_fetch (ctrl_t ctrl, const char *url, estream_t outfp,
+                 unsigned int *r_maxage)
 {
   gpg_error_t err = 0;
   estream_t infp;
   parsed_uri_t parsed_uri;  /* The broken down URI.  */
 
+  if (r_maxage)
+    *r_maxage = (unsigned int)(-1);
   if (!url)
     return gpg_error (GPG_ERR_INV_URI);
 
@@ -448,7 +651,7 @@ ks_action_fetch (ctrl_t ctrl, const char *url, estream_t outfp)
 
   if (parsed_uri->is_http)
     {
-      err = ks_http_fetch (ctrl, url, KS_HTTP_FETCH_NOCACHE, &infp);
+      err = ks_http_fetch (ctrl, url, KS_HTTP_FETCH_NOCACHE, r_maxage, &infp);
       if (!err)
         {
           err = copy_stream (infp, outfp);
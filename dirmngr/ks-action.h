@@ -25,11 +25,13 @@ gpg_error_t ks_action_parse_uri (const char *uri, uri_item_t *r_parseduri);
 gpg_error_t ks_action_help (ctrl_t ctrl, const char *url);
 gpg_error_t ks_action_resolve (ctrl_t ctrl, uri_item_t keyservers);
 gpg_error_t ks_action_search (ctrl_t ctrl, uri_item_t keyservers,
-			      strlist_t patterns, estream_t outfp);
+			      strlist_t patterns, unsigned int limit,
+                              estream_t outfp);
 gpg_error_t ks_action_get (ctrl_t ctrl, uri_item_t keyservers,
 			   strlist_t patterns, unsigned int ks_get_flags,
                            gnupg_isotime_t newer, estream_t outfp);
-gpg_error_t ks_action_fetch (ctrl_t ctrl, const char *url, estream_t outfp);
+gpg_error_t ks_action_fetch (ctrl_t ctrl, const char *url, estream_t outfp,
+                             unsigned int *r_maxage);
 gpg_error_t ks_action_put (ctrl_t ctrl, uri_item_t keyservers,
 			   void *data, size_t datalen,
 			   void *info, size_t infolen);
@@ -71,6 +71,14 @@
 /* Number of retries done in case of transient errors.  */
 #define SEND_REQUEST_EXTRA_RETRIES 5
 
+/* The weight of a new sample for the moving averages of the round
+ * trip time and the error rate of a host given as a divisor.  */
+#define HOST_STATS_WEIGHT 4
+
+/* A selected pool member is replaced by another one if its score is
+ * this many times worse than the best score in the pool.  */
+#define HOST_SCORE_LAGGING 4
+
 
 enum ks_protocol { KS_PROTOCOL_HKP, KS_PROTOCOL_HKPS, KS_PROTOCOL_MAX };
 
@@ -99,6 +107,11 @@ struct hostinfo_s
                                      lookup.  */
   time_t died_at;    /* The time the host was marked dead.  If this is
                         0 the host has been manually marked dead.  */
+  unsigned long nrequests;  /* Number of requests sent to the host.  */
+  unsigned int rtt;  /* Moving average of the response time in
+                        milliseconds; 0 if not yet known.  */
+  unsigned int errrate; /* Moving average of the failed requests in
+                           permille.  */
   char *cname;       /* Canonical name of the host.  Only set if this
                         is a pool or NAME has a numerical IP address.  */
   char *iporname;    /* Numeric IP address or name for printing.  */
@@ -148,6 +161,9 @@ create_new_hostinfo (const char *name)
   hi->did_srv_lookup = 0;
   hi->iporname_valid = 0;
   hi->died_at = 0;
+  hi->nrequests = 0;
+  hi->rtt = 0;
+  hi->errrate = 0;
   hi->cname = NULL;
   hi->iporname = NULL;
   hi->port[KS_PROTOCOL_HKP] = 0;
@@ -222,9 +238,41 @@ host_in_pool_p (hostinfo_t hi, int tblidx)
 }
 
 
-/* Select a random host.  Consult HI->pool which indices into the global
-   hosttable.  Returns index into HI->pool or -1 if no host could be
-   selected.  */
+/* Return the score of the host HI; lower is better.  The score is
+ * the average response time weighted by the error rate.  A host
+ * without any statistics gets the best score so that it will be
+ * tried.  */
+static unsigned long
+host_score (hostinfo_t hi)
+{
+  return (unsigned long)hi->rtt * (1000 + 4 * hi->errrate) / 1000;
+}
+
+
+/* Return true if the selected host with the hosttable index TBLIDX
+ * performs much worse than the best alive host of the pool HI.  */
+static int
+host_is_lagging (hostinfo_t hi, int tblidx)
+{
+  unsigned long score, best;
+  int idx, pidx;
+
+  score = host_score (hosttable[tblidx]);
+  if (!score)
+    return 0;
+  best = score;
+  for (idx = 0; idx < hi->pool_len && (pidx = hi->pool[idx]) != -1; idx++)
+    if (hosttable[pidx] && !hosttable[pidx]->dead
+        && host_score (hosttable[pidx]) < best)
+      best = host_score (hosttable[pidx]);
+  return score > best * HOST_SCORE_LAGGING;
+}
+
+
+/* Select a host from the pool.  Consult HI->pool which indices into
+   the global hosttable.  Two alive hosts are picked at random and the
+   one with the better score is used.  Returns index into HI->pool or
+   -1 if no host could be selected.  */
 static int
 select_random_host (hostinfo_t hi)
 {
@@ -257,7 +305,16 @@ select_random_host (hostinfo_t hi)
   if (tblsize == 1)  /* Save a get_uint_nonce.  */
     pidx = tbl[0];
   else
-    pidx = tbl[get_uint_nonce () % tblsize];
+    {
+      int pidx2;
+
+      pidx = tbl[get_uint_nonce () % tblsize];
+      do
+        pidx2 = tbl[get_uint_nonce () % tblsize];
+      while (pidx2 == pidx);
+      if (host_score (hosttable[pidx2]) < host_score (hosttable[pidx]))
+        pidx = pidx2;
+    }
 
   xfree (tbl);
   return pidx;
@@ -618,6 +675,14 @@ map_host (ctrl_t ctrl, const char *name, const char *srvtag, int force_reselect,
       else if (hi->poolidx >= 0 && hi->poolidx < hosttable_size
                && hosttable[hi->poolidx] && hosttable[hi->poolidx]->dead)
         hi->poolidx = -1;
+      else if (hi->poolidx >= 0 && hi->poolidx < hosttable_size
+               && hosttable[hi->poolidx]
+               && host_is_lagging (hi, hi->poolidx))
+        {
+          log_info ("selecting a different host because '%s' is slow\n",
+                    hosttable[hi->poolidx]->name);
+          hi->poolidx = -1;
+        }
 
       /* Select a host if needed.  */
       if (hi->poolidx == -1)
@@ -722,16 +787,15 @@ map_host (ctrl_t ctrl, const char *name, const char *srvtag, int force_reselect,
 }
 
 
-/* Mark the host NAME as dead.  NAME may be given as an URL.  Returns
-   true if a host was really marked as dead or was already marked dead
-   (e.g. by a concurrent session).  */
+/* Find the host NAME in our table.  NAME may be given as an URL.
+ * Return the index into the hosttable or -1 if not found.  */
 static int
-mark_host_dead (const char *name)
+find_hostinfo_by_url (const char *name)
 {
   const char *host;
   char *host_buffer = NULL;
   parsed_uri_t parsed_uri = NULL;
-  int done = 0;
+  int idx = -1;
 
   if (name && *name
       && !http_parse_uri (&parsed_uri, name, HTTP_PARSE_NO_SCHEME_CHECK))
@@ -740,7 +804,7 @@ mark_host_dead (const char *name)
         {
           host_buffer = strconcat ("[", parsed_uri->host, "]", NULL);
           if (!host_buffer)
-            log_error ("out of core in mark_host_dead");
+            log_error ("out of core in find_hostinfo_by_url");
           host = host_buffer;
         }
       else
@@ -750,27 +814,72 @@ mark_host_dead (const char *name)
     host = name;
 
   if (host && *host && strcmp (host, "localhost"))
-    {
-      hostinfo_t hi;
-      int idx;
-
-      idx = find_hostinfo (host);
-      if (idx != -1)
-        {
-          hi = hosttable[idx];
-          log_info ("marking host '%s' as dead%s\n",
-                    hi->name, hi->dead? " (again)":"");
-          hi->dead = 1;
-          hi->died_at = gnupg_get_time ();
-          if (!hi->died_at)
-            hi->died_at = 1;
-          done = 1;
-        }
-    }
+    idx = find_hostinfo (host);
 
   http_release_parsed_uri (parsed_uri);
   xfree (host_buffer);
-  return done;
+  return idx;
+}
+
+
+/* Mark the host NAME as dead.  NAME may be given as an URL.  Returns
+   true if a host was really marked as dead or was already marked dead
+   (e.g. by a concurrent session).  */
+static int
+mark_host_dead (const char *name)
+{
+  hostinfo_t hi;
+  int idx;
+
+  idx = find_hostinfo_by_url (name);
+  if (idx == -1)
+    return 0;
+
+  hi = hosttable[idx];
+  log_info ("marking host '%s' as dead%s\n",
+            hi->name, hi->dead? " (again)":"");
+  hi->dead = 1;
+  hi->died_at = gnupg_get_time ();
+  if (!hi->died_at)
+    hi->died_at = 1;
+  return 1;
+}
+
+
+/* Update the statistics of the host NAME which may be given as an
+ * URL.  RTT is the time in milliseconds the host took to answer a
+ * request; if FAILED is set the request failed.  */
+static void
+update_host_stats (const char *name, unsigned long rtt, int failed)
+{
+  hostinfo_t hi;
+  int idx;
+
+  if (npth_mutex_lock (&hosttable_lock))
+    log_fatal ("failed to acquire mutex\n");
+
+  idx = find_hostinfo_by_url (name);
+  if (idx != -1)
+    {
+      hi = hosttable[idx];
+      if (!rtt)
+        rtt = 1;
+      if (rtt > 3600*1000)
+        rtt = 3600*1000;
+      if (failed)
+        ; /* The time of a failed request tells nothing.  */
+      else if (!hi->rtt)
+        hi->rtt = rtt;
+      else
+        hi->rtt = ((HOST_STATS_WEIGHT - 1) * (unsigned long)hi->rtt + rtt)
+                  / HOST_STATS_WEIGHT;
+      hi->errrate = ((HOST_STATS_WEIGHT - 1) * hi->errrate
+                     + (failed? 1000 : 0)) / HOST_STATS_WEIGHT;
+      hi->nrequests++;
+    }
+
+  if (npth_mutex_unlock (&hosttable_lock))
+    log_fatal ("failed to release mutex\n");
 }
 
 
@@ -872,8 +981,10 @@ ks_hkp_print_hosttable (ctrl_t ctrl)
   time_t curtime;
   char *p, *died;
   const char *diedstr;
+  char statsstr[40];
 
-  err = ks_print_help (ctrl, "hosttable (idx, ipv6, ipv4, dead, name, time):");
+  err = ks_print_help (ctrl, "hosttable (idx, ipv6, ipv4, dead, name,"
+                       " time, rtt, errors):");
   if (err)
     return err;
 
@@ -958,7 +1069,13 @@ ks_hkp_print_hosttable (ctrl_t ctrl)
             hi->iporname_valid = 1;
           }
 
-        err = ks_printf_help (ctrl, "%3d %s %s %s %s%s%s%s%s%s%s\n",
+        if (hi->nrequests)
+          snprintf (statsstr, sizeof statsstr, "  rtt=%ums err=%u.%u%%",
+                    hi->rtt, hi->errrate / 10, hi->errrate % 10);
+        else
+          *statsstr = 0;
+
+        err = ks_printf_help (ctrl, "%3d %s %s %s %s%s%s%s%s%s%s%s\n",
                               idx,
                               hi->onion? "O" : hi->v6? "6":" ",
                               hi->v4? "4":" ",
@@ -969,7 +1086,8 @@ ks_hkp_print_hosttable (ctrl_t ctrl)
                               hi->iporname? ")":"",
                               diedstr? "  (":"",
                               diedstr? diedstr:"",
-                              diedstr? ")":""   );
+                              diedstr? ")":"",
+                              statsstr);
         xfree (died);
         if (err)
 	  goto leave;
@@ -1232,9 +1350,12 @@ send_request (ctrl_t ctrl, const char *request, const char *hostportstr,
   estream_t fp = NULL;
   char *request_buffer = NULL;
   parsed_uri_t uri = NULL;
+  struct timespec starttime, endtime;
+  int failed = -1;  /* -1 := no sample, 0 := answered, 1 := failed.  */
 
   *r_fp = NULL;
 
+  npth_clock_gettime (&starttime);
   err = http_parse_uri (&uri, request, 0);
   if (err)
     goto leave;
@@ -1261,6 +1382,7 @@ send_request (ctrl_t ctrl, const char *request, const char *hostportstr,
                    httphost,
                    /* fixme: AUTH */ NULL,
                    (httpflags
+                    |HTTP_FLAG_KEEP_ALIVE
                     |(opt.honor_http_proxy? HTTP_FLAG_TRY_PROXY:0)
                     |(dirmngr_use_tor ()? HTTP_FLAG_FORCE_TOR:0)
                     |(opt.disable_ipv4? HTTP_FLAG_IGNORE_IPv4 : 0)
@@ -1291,6 +1413,7 @@ send_request (ctrl_t ctrl, const char *request, const char *hostportstr,
       /* Fixme: After a redirection we show the old host name.  */
       log_error (_("error connecting to '%s': %s\n"),
                  hostportstr, gpg_strerror (err));
+      failed = 1;
       goto leave;
     }
 
@@ -1301,6 +1424,7 @@ send_request (ctrl_t ctrl, const char *request, const char *hostportstr,
     {
       log_error (_("error reading HTTP response for '%s': %s\n"),
                  hostportstr, gpg_strerror (err));
+      failed = 1;
       goto leave;
     }
 
@@ -1314,6 +1438,11 @@ send_request (ctrl_t ctrl, const char *request, const char *hostportstr,
   if (r_http_status)
     *r_http_status = http_get_status_code (http);
 
+  /* Server errors count as failure of the host; everything else tells
+   * us how fast the host answers.  */
+  failed = (http_get_status_code (http) >= 500
+            && http_get_status_code (http) != 501);
+
   switch (http_get_status_code (http))
     {
     case 200:
@@ -1371,6 +1500,14 @@ send_request (ctrl_t ctrl, const char *request, const char *hostportstr,
   http = NULL;
 
  leave:
+  if (failed != -1 && !uri->onion)
+    {
+      npth_clock_gettime (&endtime);
+      update_host_stats (redirinfo.orig_url,
+                         ((endtime.tv_sec - starttime.tv_sec) * 1000
+                          + (endtime.tv_nsec - starttime.tv_nsec) / 1000000),
+                         failed);
+    }
   http_close (http, 0);
   http_session_release (session);
   xfree (request_buffer);
@@ -61,14 +61,64 @@ ks_http_help (ctrl_t ctrl, parsed_uri_t uri)
 }
 
 
+/* Return the number of seconds the response in HTTP may be cached as
+ * told by its Cache-Control and Age headers.  (unsigned int)(-1) is
+ * returned if the server did not say anything about it.  */
+static unsigned int
+get_max_age (http_t http)
+{
+  const char *s;
+  unsigned long maxage = (unsigned long)(-1);
+  unsigned long age;
+
+  s = http_get_header (http, "Cache-Control");
+  if (!s)
+    return (unsigned int)(-1);
+
+  while (*s)
+    {
+      while (*s == ' ' || *s == '\t' || *s == ',')
+        s++;
+      if (!ascii_strncasecmp (s, "no-store", 8)
+          || !ascii_strncasecmp (s, "no-cache", 8))
+        return 0;
+      if (!ascii_strncasecmp (s, "max-age=", 8))
+        {
+          s += 8;
+          if (*s == '"')
+            s++;
+          maxage = digitp (s)? strtoul (s, NULL, 10) : 0;
+        }
+      while (*s && *s != ',')
+        s++;
+    }
+
+  if (maxage == (unsigned long)(-1))
+    return (unsigned int)(-1);
+
+  if ((s = http_get_header (http, "Age")) && digitp (s))
+    {
+      age = strtoul (s, NULL, 10);
+      maxage = age < maxage? maxage - age : 0;
+    }
+
+  return maxage > 0x7fffffff? 0x7fffffff : maxage;
+}
+
+
 /* Get the key from URL which is expected to specify a http style
  * scheme.  On success R_FP has an open stream to read the data.
  * Despite its name this function is also used to retrieve arbitrary
- * data via https or http.
+ * data via https or http.  If R_MAXAGE is not NULL the number of
+ * seconds the response may be cached is stored there; see
+ * get_max_age for details.  This is also done for an error
+ * response.  If CTRL->HTTP_IF_MODIFIED_SINCE is set a conditional
+ * request is made and GPG_ERR_ALREADY_FETCHED returned if the data
+ * has not been modified.
  */
 gpg_error_t
 ks_http_fetch (ctrl_t ctrl, const char *url, unsigned int flags,
-               estream_t *r_fp)
+               unsigned int *r_maxage, estream_t *r_fp)
 {
   gpg_error_t err;
   http_session_t session = NULL;
@@ -106,12 +156,15 @@ ks_http_fetch (ctrl_t ctrl, const char *url, unsigned int flags,
   http_session_set_timeout (session, ctrl->timeout);
 
   *r_fp = NULL;
+  if (r_maxage)
+    *r_maxage = (unsigned int)(-1);
   err = http_open (ctrl, &http,
                    HTTP_REQ_GET,
                    url,
                    /* httphost */ NULL,
                    /* fixme: AUTH */ NULL,
-                   ((opt.honor_http_proxy? HTTP_FLAG_TRY_PROXY:0)
+                   (HTTP_FLAG_KEEP_ALIVE
+                    | (opt.honor_http_proxy? HTTP_FLAG_TRY_PROXY:0)
                     | (DBG_LOOKUP? HTTP_FLAG_LOG_RESP:0)
                     | (dirmngr_use_tor ()? HTTP_FLAG_FORCE_TOR:0)
                     | (opt.disable_ipv4? HTTP_FLAG_IGNORE_IPv4 : 0)
@@ -129,6 +182,21 @@ ks_http_fetch (ctrl_t ctrl, const char *url, unsigned int flags,
       if ((flags & KS_HTTP_FETCH_NOCACHE))
         es_fputs ("Pragma: no-cache\r\n"
                   "Cache-Control: no-cache\r\n", fp);
+      if (ctrl->http_if_modified_since)
+        {
+          struct tm tmbuf, *tp;
+
+          tp = gnupg_gmtime (&ctrl->http_if_modified_since, &tmbuf);
+          if (tp)
+            es_fprintf (fp, "If-Modified-Since: %.3s, %02d %.3s %04d"
+                        " %02d:%02d:%02d GMT\r\n",
+                        &"SunMonTueWedThuFriSat"[(tp->tm_wday%7)*3],
+                        tp->tm_mday,
+                        &"JanFebMarAprMayJunJulAugSepOctNovDec"
+                        [(tp->tm_mon%12)*3],
+                        tp->tm_year + 1900,
+                        tp->tm_hour, tp->tm_min, tp->tm_sec);
+        }
       http_start_data (http);
       if (es_ferror (fp))
         err = gpg_error_from_syserror ();
@@ -167,6 +235,9 @@ ks_http_fetch (ctrl_t ctrl, const char *url, unsigned int flags,
       goto leave;
     }
 
+  if (r_maxage)
+    *r_maxage = get_max_age (http);
+
   switch (http_get_status_code (http))
     {
     case 200:
@@ -192,6 +263,17 @@ ks_http_fetch (ctrl_t ctrl, const char *url, unsigned int flags,
       }
       goto once_more;
 
+    case 304:  /* Not modified */
+      if (ctrl->http_if_modified_since)
+        {
+          err = gpg_error (GPG_ERR_ALREADY_FETCHED);
+          goto leave;
+        }
+      log_error (_("error accessing '%s': http status %u\n"),
+                 url, http_get_status_code (http));
+      err = gpg_error (GPG_ERR_NO_DATA);
+      goto leave;
+
     case 413:  /* Payload too large */
       err = gpg_error (GPG_ERR_TOO_LARGE);
       goto leave;
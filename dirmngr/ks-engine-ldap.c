@@ -50,6 +50,18 @@
 /* The page size requested from the server.  */
 #define PAGE_SIZE  100
 
+/* The maximum number of idle connections kept in the pool.  */
+#define MAX_IDLE_LDAP_CONNECTIONS 8
+
+/* Seconds to keep an idle connection in the pool.  */
+#define IDLE_LDAP_CONNECTION_TTL 300
+
+/* The maximum number of keyspecs combined into one search filter.  */
+#define KEYSPEC_BATCH_SIZE 50
+
+/* Seconds to keep a base DN taken from the rootDSE.  */
+#define ROOTDSE_BASEDN_TTL 3600
+
 
 #ifndef HAVE_TIMEGM
 time_t timegm(struct tm *tm);
@@ -74,6 +86,42 @@ struct ks_engine_ldap_local_s
 };
 
 
+/* An object for a bound connection in the connection pool.  All
+ * connections established by my_ldap_connect are tracked here until
+ * they are released by my_ldap_release.  Released connections are
+ * kept for IDLE_LDAP_CONNECTION_TTL seconds so that the next request
+ * with the same parameters does not need to connect, bind, and
+ * interrogate the server again.  */
+struct ldap_pool_item_s
+{
+  struct ldap_pool_item_s *next;
+  LDAP *ldap_conn;           /* The bound connection.  */
+  char *basedn;              /* The discovered base DN or NULL.  */
+  unsigned int serverinfo;   /* The SERVERINFO flags.  */
+  unsigned int in_use:1;     /* The connection is in use.  */
+  time_t stamp;              /* The time the connection was released.  */
+  char key[65];              /* Hash over the connection parameters.  */
+};
+typedef struct ldap_pool_item_s *ldap_pool_item_t;
+
+/* The connection pool.  */
+static ldap_pool_item_t ldap_pool;
+
+
+/* An object to cache the base DN taken from the rootDSE.  */
+struct rootdse_basedn_s
+{
+  struct rootdse_basedn_s *next;
+  char *basedn;              /* The defaultNamingContext or NULL.  */
+  time_t expires;            /* Expiration time of this item.  */
+  char uri[1];               /* The URI used to fetch the rootDSE.  */
+};
+static struct rootdse_basedn_s *rootdse_basedn_cache;
+
+
+static void my_ldap_release (LDAP *ldap_conn, gpg_error_t err);
+
+
 
 
 static time_t
@@ -210,7 +258,7 @@ ks_ldap_clear_state (struct ks_engine_ldap_local_s *state)
 {
   if (state->ldap_conn)
     {
-      ldap_unbind (state->ldap_conn);
+      my_ldap_release (state->ldap_conn, 0);
       state->ldap_conn = NULL;
     }
   if (state->message)
@@ -481,6 +529,187 @@ interrogate_ldap_dn (LDAP *ldap_conn, const char *basedn_search,
 
 
 
+/* Release the pool item ITEM which must already be unlinked.  */
+static void
+release_pool_item (ldap_pool_item_t item)
+{
+  if (!item)
+    return;
+  if (item->ldap_conn)
+    ldap_unbind (item->ldap_conn);
+  xfree (item->basedn);
+  xfree (item);
+}
+
+
+/* Remove all idle connections from the pool.  With ALL set the
+ * connections are removed regardless of their age.  */
+static void
+purge_ldap_pool (int all)
+{
+  ldap_pool_item_t *itemptr, item;
+  time_t now = gnupg_get_time ();
+
+  for (itemptr = &ldap_pool; (item = *itemptr); )
+    if (!item->in_use
+        && (all || item->stamp + IDLE_LDAP_CONNECTION_TTL < now))
+      {
+        *itemptr = item->next;
+        release_pool_item (item);
+      }
+    else
+      itemptr = &item->next;
+}
+
+
+/* Compute the pool key from the connection parameters and store it
+ * at KEY which must have space for 65 bytes.  The key is a hash so
+ * that we do not need to keep the password in another place.  */
+static gpg_error_t
+make_pool_key (char *key, unsigned int generic, const char *host, int port,
+               const char *bindname, const char *password,
+               const char *basedn_arg, int use_tls, int use_ntds,
+               int use_areconly)
+{
+  char *string;
+  unsigned char digest[32];
+
+  string = xtryasprintf ("%u\n%s\n%d\n%s\n%s\n%s\n%d\n%d\n%d",
+                         generic, host? host:"", port,
+                         bindname? bindname:"", password? password:"",
+                         basedn_arg? basedn_arg:"",
+                         use_tls, use_ntds, use_areconly);
+  if (!string)
+    return gpg_error_from_syserror ();
+  gcry_md_hash_buffer (GCRY_MD_SHA256, digest, string, strlen (string));
+  wipememory (string, strlen (string));
+  xfree (string);
+  bin2hex (digest, 32, key);
+  return 0;
+}
+
+
+/* Take an idle connection matching KEY from the pool.  Returns NULL
+ * if there is none.  */
+static ldap_pool_item_t
+get_pooled_connection (const char *key)
+{
+  ldap_pool_item_t item;
+
+  purge_ldap_pool (0);
+  for (item = ldap_pool; item; item = item->next)
+    if (!item->in_use && !strcmp (item->key, key))
+      {
+        item->in_use = 1;
+        return item;
+      }
+  return NULL;
+}
+
+
+/* Track the new connection LDAP_CONN in the pool.  Errors are
+ * ignored; the connection is then simply not kept after use.  */
+static void
+add_pooled_connection (const char *key, LDAP *ldap_conn, const char *basedn,
+                       unsigned int serverinfo)
+{
+  ldap_pool_item_t item;
+
+  item = xtrycalloc (1, sizeof *item);
+  if (!item)
+    return;
+  if (basedn && !(item->basedn = xtrystrdup (basedn)))
+    {
+      xfree (item);
+      return;
+    }
+  item->ldap_conn = ldap_conn;
+  item->serverinfo = serverinfo;
+  item->in_use = 1;
+  strcpy (item->key, key);
+  item->next = ldap_pool;
+  ldap_pool = item;
+}
+
+
+/* Release the connection LDAP_CONN as returned by my_ldap_connect.
+ * ERR is the result of the last operation on this connection; if it
+ * indicates a problem with the connection the connection is closed
+ * instead of put back into the pool.  */
+static void
+my_ldap_release (LDAP *ldap_conn, gpg_error_t err)
+{
+  ldap_pool_item_t *itemptr, item;
+  unsigned int nidle;
+
+  if (!ldap_conn)
+    return;
+
+  nidle = 0;
+  for (itemptr = &ldap_pool; (item = *itemptr); itemptr = &item->next)
+    {
+      if (item->ldap_conn == ldap_conn)
+        break;
+      if (!item->in_use)
+        nidle++;
+    }
+  if (!item)
+    {
+      ldap_unbind (ldap_conn);
+      return;
+    }
+
+  switch (gpg_err_code (err))
+    {
+    case GPG_ERR_LDAP_SERVER_DOWN:
+    case GPG_ERR_LDAP_CONNECT:
+    case GPG_ERR_LDAP_TIMEOUT:
+    case GPG_ERR_LDAP_UNAVAILABLE:
+    case GPG_ERR_LDAP_BUSY:
+    case GPG_ERR_LDAP_LOCAL:
+      nidle = MAX_IDLE_LDAP_CONNECTIONS; /* Force closing.  */
+      break;
+    default:
+      break;
+    }
+  if (nidle >= MAX_IDLE_LDAP_CONNECTIONS)
+    {
+      *itemptr = item->next;
+      release_pool_item (item);
+      return;
+    }
+
+  item->in_use = 0;
+  item->stamp = gnupg_get_time ();
+}
+
+
+/* Close idle LDAP connections which are too old.  With ALL set all
+ * idle connections are closed and the cached base DNs are flushed.
+ * This is called by the housekeeping and on reload.  */
+void
+ks_ldap_release_idle_connections (int all)
+{
+  struct rootdse_basedn_s *rb, *rbnext, **rbptr;
+  time_t now = gnupg_get_time ();
+
+  purge_ldap_pool (all);
+
+  for (rbptr = &rootdse_basedn_cache; (rb = *rbptr); rb = rbnext)
+    {
+      rbnext = rb->next;
+      if (all || rb->expires <= now)
+        {
+          *rbptr = rbnext;
+          xfree (rb->basedn);
+          xfree (rb);
+        }
+      else
+        rbptr = &rb->next;
+    }
+}
+
+
 /* Connect to an LDAP server and interrogate it.
  *
  * URI describes the server to connect to and various options
@@ -493,8 +722,8 @@ interrogate_ldap_dn (LDAP *ldap_conn, const char *basedn_search,
  * to the base DN for the PGP key space, several flags will be stored
  * at SERVERINFO, If you pass NULL, then the value won't be returned.
  * It is the caller's responsibility to release *LDAP_CONNP with
- * ldap_unbind and to xfree *BASEDNP.  On error these variables are
- * cleared.
+ * my_ldap_release and to xfree *BASEDNP.  On error these variables are
+ * cleared.  Bound connections are taken from a pool if possible.
  *
  * Note: On success, you still need to check that *BASEDNP is valid.
  * If it is NULL, then the server does not appear to be an OpenPGP
@@ -517,6 +746,8 @@ my_ldap_connect (parsed_uri_t uri, unsigned int generic, LDAP **ldap_connp,
   const char *bindname;
   const char *password;
   const char *basedn_arg;
+  char poolkey[65];
+  ldap_pool_item_t pooled;
 #ifndef HAVE_W32_SYSTEM
   char *tmpstr;
 #endif
@@ -579,6 +810,26 @@ my_ldap_connect (parsed_uri_t uri, unsigned int generic, LDAP **ldap_connp,
               use_areconly? ",areconly":"",
               generic? " (generic)":"");
 
+  err = make_pool_key (poolkey, generic, host, port, bindname, password,
+                       basedn_arg, use_tls, use_ntds, use_areconly);
+  if (err)
+    goto out;
+  pooled = get_pooled_connection (poolkey);
+  if (pooled)
+    {
+      if (opt.verbose)
+        log_info ("ldap: reusing connection %p\n", pooled->ldap_conn);
+      if (pooled->basedn && !(basedn = xtrystrdup (pooled->basedn)))
+        {
+          err = gpg_error_from_syserror ();
+          my_ldap_release (pooled->ldap_conn, 0);
+          goto out;
+        }
+      ldap_conn = pooled->ldap_conn;
+      *r_serverinfo = pooled->serverinfo;
+      goto out;
+    }
+
   /* If the uri specifies a secure connection and we don't support
      TLS, then fail; don't silently revert to an insecure
      connection.  */
@@ -881,6 +1132,8 @@ my_ldap_connect (parsed_uri_t uri, unsigned int generic, LDAP **ldap_connp,
       ldap_msgfree (res);
     }
 
+  add_pooled_connection (poolkey, ldap_conn, basedn, *r_serverinfo);
+
  out:
   if (!err && opt.debug)
     {
@@ -1397,14 +1650,25 @@ fetch_rootdse (ctrl_t ctrl, parsed_uri_t uri)
 
 
 /* Return the baseDN for URI which might have already been cached for
- * this session.  */
+ * this session or by another session.  */
 static char *
 basedn_from_rootdse (ctrl_t ctrl, parsed_uri_t uri)
 {
   const char *s;
+  const char *uristr = uri && uri->original? uri->original : "ldap://";
+  struct rootdse_basedn_s *rb;
 
   if (!ctrl->rootdse && !ctrl->rootdse_tried)
     {
+      for (rb = rootdse_basedn_cache; rb; rb = rb->next)
+        if (!strcmp (rb->uri, uristr) && rb->expires > gnupg_get_time ())
+          {
+            if (opt.verbose)
+              log_info ("ldap: using cached base DN '%s'\n",
+                        rb->basedn? rb->basedn : "[none]");
+            return rb->basedn? xtrystrdup (rb->basedn) : NULL;
+          }
+
       ctrl->rootdse = fetch_rootdse (ctrl, uri);
       ctrl->rootdse_tried = 1;
       if (ctrl->rootdse)
@@ -1412,6 +1676,22 @@ basedn_from_rootdse (ctrl_t ctrl, parsed_uri_t uri)
           log_debug ("Dump of all rootDSE attributes:\n");
           nvc_write (ctrl->rootdse, log_get_stream ());
           log_debug ("End of dump\n");
+
+          /* Remember the base DN for other sessions.  */
+          s = nvc_get_string (ctrl->rootdse, "defaultNamingContext:");
+          rb = xtrycalloc (1, sizeof *rb + strlen (uristr));
+          if (rb && s && !(rb->basedn = xtrystrdup (s)))
+            {
+              xfree (rb);
+              rb = NULL;
+            }
+          if (rb)
+            {
+              strcpy (rb->uri, uristr);
+              rb->expires = gnupg_get_time () + ROOTDSE_BASEDN_TTL;
+              rb->next = rootdse_basedn_cache;
+              rootdse_basedn_cache = rb;
+            }
         }
     }
   s = nvc_get_string (ctrl->rootdse, "defaultNamingContext:");
@@ -1661,8 +1941,7 @@ ks_ldap_get (ctrl_t ctrl, parsed_uri_t uri, const char *keyspec,
   xfree (basedn);
   xfree (host);
 
-  if (ldap_conn)
-    ldap_unbind (ldap_conn);
+  my_ldap_release (ldap_conn, err);
 
   xfree (filter);
 
@@ -1670,6 +1949,243 @@ ks_ldap_get (ctrl_t ctrl, parsed_uri_t uri, const char *keyspec,
 }
 
 
+/* Helper for ks_ldap_get_many.  Run a paged search using FILTER and
+ * write all keys to OUTFP as soon as they arrive.  SEENP is used to
+ * skip duplicates.  The number of keys written is added to
+ * R_NKEYS.  */
+static gpg_error_t
+fetch_key_batch (LDAP *ldap_conn, const char *basedn, const char *filter,
+                 char **attrs, unsigned int serverinfo, estream_t outfp,
+                 strlist_t *seenp, unsigned int *r_nkeys)
+{
+  gpg_error_t err = 0;
+  int l_err, l_reserr, rc, msgid;
+  LDAPControl *srvctrls[2] = { NULL, NULL };
+  LDAPControl **resctrls = NULL;
+  LDAPMessage *msg = NULL;
+  struct berval *pagecookie = NULL;
+  unsigned int totalcount;
+  unsigned int pageno = 0;
+
+  do
+    {
+      l_err = ldap_create_page_control (ldap_conn, PAGE_SIZE, pagecookie, 0,
+                                        &srvctrls[0]);
+      if (l_err)
+        {
+          err = ldap_err_to_gpg_err (l_err);
+          log_error ("ks-ldap: create_page_control failed: %s\n",
+                     ldap_err2string (l_err));
+          goto leave;
+        }
+
+      npth_unprotect ();
+      l_err = ldap_search_ext (ldap_conn, basedn, LDAP_SCOPE_SUBTREE,
+                               filter, attrs, 0, srvctrls, NULL, NULL, 0,
+                               &msgid);
+      npth_protect ();
+      ldap_control_free (srvctrls[0]);
+      srvctrls[0] = NULL;
+      if (l_err)
+        {
+          err = ldap_err_to_gpg_err (l_err);
+          log_error ("ks-ldap: LDAP search error: %s\n",
+                     ldap_err2string (l_err));
+          goto leave;
+        }
+      pageno++;
+
+      /* Process the entries one by one as they arrive.  */
+      for (;;)
+        {
+          npth_unprotect ();
+          rc = ldap_result (ldap_conn, msgid, LDAP_MSG_ONE, NULL, &msg);
+          npth_protect ();
+          if (rc <= 0)
+            {
+              err = ldap_to_gpg_err (ldap_conn);
+              log_error ("ks-ldap: LDAP result error: %s\n",
+                         gpg_strerror (err));
+              goto leave;
+            }
+
+          if (rc == LDAP_RES_SEARCH_ENTRY)
+            {
+              err = return_one_keyblock (ldap_conn, msg, serverinfo,
+                                         &outfp, seenp);
+              if (!err)
+                ++*r_nkeys;
+              else if (gpg_err_code (err) == GPG_ERR_NO_DATA)
+                err = 0;  /* Skip empty/duplicate attributes. */
+              else
+                goto leave;
+            }
+          else if (rc == LDAP_RES_SEARCH_RESULT)
+            {
+              l_err = ldap_parse_result (ldap_conn, msg, &l_reserr,
+                                         NULL, NULL, NULL, &resctrls, 0);
+              if (!l_err && l_reserr != LDAP_SUCCESS
+                  && l_reserr != LDAP_NO_SUCH_OBJECT)
+                l_err = l_reserr;
+              if (l_err)
+                {
+                  err = ldap_err_to_gpg_err (l_err);
+                  log_error ("ks-ldap: LDAP parse result error: %s\n",
+                             ldap_err2string (l_err));
+                  goto leave;
+                }
+              if (pagecookie)
+                {
+                  ber_bvfree (pagecookie);
+                  pagecookie = NULL;
+                }
+              if (resctrls)
+                {
+                  /* Servers without paged results support may not
+                   * return the control; we then got all entries.  */
+                  ldap_parse_page_control (ldap_conn, resctrls,
+                                           &totalcount, &pagecookie);
+                  ldap_controls_free (resctrls);
+                  resctrls = NULL;
+                }
+              ldap_msgfree (msg);
+              msg = NULL;
+              break;
+            }
+          ldap_msgfree (msg);
+          msg = NULL;
+        }
+
+      if (opt.verbose)
+        log_info ("ks-ldap: received result page %u (%u keys)\n",
+                  pageno, *r_nkeys);
+    }
+  while (pagecookie && pagecookie->bv_val && pagecookie->bv_len);
+
+ leave:
+  if (msg)
+    ldap_msgfree (msg);
+  if (resctrls)
+    ldap_controls_free (resctrls);
+  if (pagecookie)
+    ber_bvfree (pagecookie);
+  return err;
+}
+
+
+/* Get the keys described by the KEYSPECS from the keyserver
+ * identified by URI and write them to OUTFP.  Instead of running one
+ * search per key the keyspecs are combined into OR-filters and each
+ * of them is run as a paged search.  If NEWER is set only keys
+ * modified since then are returned.  Keyspecs not supported by LDAP
+ * are skipped.  Returns GPG_ERR_NO_DATA if no key was found.  */
+gpg_error_t
+ks_ldap_get_many (ctrl_t ctrl, parsed_uri_t uri, strlist_t keyspecs,
+                  gnupg_isotime_t newer, estream_t outfp)
+{
+  gpg_error_t err;
+  unsigned int serverinfo;
+  char *host = NULL;
+  int use_tls;
+  LDAP *ldap_conn = NULL;
+  char *basedn = NULL;
+  char *filter = NULL;
+  char *tstr = NULL;
+  char *f;
+  membuf_t mb;
+  strlist_t sl;
+  strlist_t seen = NULL;
+  int nfilters;
+  unsigned int nkeys = 0;
+  char *attrs[] =
+    {
+     "dummy", /* (to be be replaced.)  */
+     "pgpcertid", "pgpuserid", "pgpkeyid", "pgprevoked", "pgpdisabled",
+     "pgpkeycreatetime", "modifyTimestamp", "pgpkeysize", "pgpkeytype",
+     "gpgfingerprint",
+     NULL
+    };
+
+  if (dirmngr_use_tor ())
+    {
+      return no_ldap_due_to_tor (ctrl);
+    }
+
+  /* Make sure we are talking to an OpenPGP LDAP server.  */
+  err = my_ldap_connect (uri, 0, &ldap_conn,
+                         &basedn, &host, &use_tls, &serverinfo);
+  if (err || !basedn)
+    {
+      if (!err)
+        err = gpg_error (GPG_ERR_GENERAL);
+      goto leave;
+    }
+
+  /* Replace "dummy".  */
+  attrs[0] = (serverinfo & SERVERINFO_PGPKEYV2)? "pgpKeyV2" : "pgpKey";
+
+  if (*newer && !(tstr = isotime2rfc4517 (newer)))
+    {
+      err = gpg_error_from_syserror ();
+      goto leave;
+    }
+
+  for (sl = keyspecs; sl && !err; )
+    {
+      init_membuf (&mb, 1024);
+      put_membuf_str (&mb, tstr? "(&(|" : "(|");
+      for (nfilters = 0; sl && nfilters < KEYSPEC_BATCH_SIZE; sl = sl->next)
+        {
+          if (keyspec_to_ldap_filter (sl->d, &f, 1, serverinfo))
+            continue; /* Already logged.  */
+          put_membuf_str (&mb, f);
+          xfree (f);
+          nfilters++;
+        }
+      put_membuf_str (&mb, ")");
+      if (tstr)
+        {
+          put_membuf_str (&mb, "(modifyTimestamp>=");
+          put_membuf_str (&mb, tstr);
+          put_membuf_str (&mb, "))");
+        }
+      put_membuf (&mb, "", 1);
+      xfree (filter);
+      filter = get_membuf (&mb, NULL);
+      if (!filter)
+        {
+          err = gpg_error_from_syserror ();
+          goto leave;
+        }
+      if (!nfilters)
+        continue;
+
+      if (opt.debug)
+        log_debug ("ks-ldap: using filter: %s\n", filter);
+
+      err = fetch_key_batch (ldap_conn, basedn, filter, attrs, serverinfo,
+                             outfp, &seen, &nkeys);
+    }
+
+  if (!err && !nkeys)
+    err = gpg_error (GPG_ERR_NO_DATA);
+
+  if (!err)
+    err = dirmngr_status_printf (ctrl, "SOURCE", "%s://%s",
+                                 use_tls? "ldaps" : "ldap",
+                                 host? host:"");
+
+ leave:
+  free_strlist (seen);
+  xfree (tstr);
+  xfree (filter);
+  xfree (basedn);
+  xfree (host);
+  my_ldap_release (ldap_conn, err);
+  return err;
+}
+
+
 /* Search the keyserver identified by URI for keys matching PATTERN.
    On success R_FP has an open stream to read the data.  */
 gpg_error_t
@@ -1961,8 +2477,7 @@ ks_ldap_search (ctrl_t ctrl, parsed_uri_t uri, const char *pattern,
 
   xfree (basedn);
 
-  if (ldap_conn)
-    ldap_unbind (ldap_conn);
+  my_ldap_release (ldap_conn, err);
 
   xfree (filter);
 
@@ -2793,8 +3308,7 @@ ks_ldap_put (ctrl_t ctrl, parsed_uri_t uri,
   if (dump)
     es_fclose (dump);
 
-  if (ldap_conn)
-    ldap_unbind (ldap_conn);
+  my_ldap_release (ldap_conn, err);
 
   xfree (basedn);
 
@@ -3044,8 +3558,7 @@ ks_ldap_query (ctrl_t ctrl, parsed_uri_t uri, unsigned int ks_get_flags,
   xfree (basedn);
   xfree (host);
 
-  if (ldap_conn)
-    ldap_unbind (ldap_conn);
+  my_ldap_release (ldap_conn, err);
 
   xfree (filter);
 
@@ -58,7 +58,7 @@ gpg_error_t ks_hkp_put (ctrl_t ctrl, parsed_uri_t uri,
 
 gpg_error_t ks_http_help (ctrl_t ctrl, parsed_uri_t uri);
 gpg_error_t ks_http_fetch (ctrl_t ctrl, const char *url, unsigned int flags,
-                           estream_t *r_fp);
+                           unsigned int *r_maxage, estream_t *r_fp);
 
 
 /*-- ks-engine-finger.c --*/
@@ -72,11 +72,15 @@ gpg_error_t ks_kdns_fetch (ctrl_t ctrl, parsed_uri_t uri, estream_t *r_fp);
 /*-- ks-engine-ldap.c --*/
 gpg_error_t ks_ldap_help (ctrl_t ctrl, parsed_uri_t uri);
 void ks_ldap_free_state (struct ks_engine_ldap_local_s *state);
+void ks_ldap_release_idle_connections (int all);
 gpg_error_t ks_ldap_search (ctrl_t ctrl, parsed_uri_t uri, const char *pattern,
 			    estream_t *r_fp);
 gpg_error_t ks_ldap_get (ctrl_t ctrl, parsed_uri_t uri,
 			 const char *keyspec, unsigned int ks_get_flags,
                          gnupg_isotime_t newer, estream_t *r_fp);
+gpg_error_t ks_ldap_get_many (ctrl_t ctrl, parsed_uri_t uri,
+                              strlist_t keyspecs, gnupg_isotime_t newer,
+                              estream_t outfp);
 gpg_error_t ks_ldap_put (ctrl_t ctrl, parsed_uri_t uri,
 			 void *data, size_t datalen,
 			 void *info, size_t infolen);
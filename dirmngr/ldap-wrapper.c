@@ -39,7 +39,12 @@
  *    cancellation of a query at any point of time.
  *
  * 4. Given that we are going out to the network and usually get back
- *    a long response, the fork/exec overhead is acceptable.
+ *    a long response, the fork/exec overhead is acceptable.  To avoid
+ *    paying it for each of many small queries we nevertheless keep a
+ *    few wrapper processes running in server mode ("--server"); they
+ *    read requests from stdin and send framed responses tagged with
+ *    a request id to stdout.  If all of them are busy a one-shot
+ *    wrapper is spawned as before.
  *
  * Note that under WindowsCE the number of processes is strongly
  * limited (32 processes including the kernel processes) and thus we
@@ -82,6 +87,11 @@
 
 #define TIMERTICK_INTERVAL 2
 
+/* The maximum number of wrapper processes kept running in server
+ * mode and the time after which an unused one is terminated.  */
+#define MAX_LDAP_HELPERS 4
+#define HELPER_IDLE_TIMEOUT (60*5)  /* seconds */
+
 /* To keep track of the LDAP wrapper state we use this structure.  */
 struct wrapper_context_s
 {
@@ -102,6 +112,16 @@ struct wrapper_context_s
   size_t linelen;      /* Use size of LINE.  */
   time_t stamp;        /* The last time we noticed ativity.  */
   int reaper_idx;      /* Private to ldap_wrapper_thread.   */
+
+  /* The fields below are only used by wrappers in server mode.  */
+  unsigned int helper:1; /* This is a long-lived wrapper.  */
+  unsigned int busy:1;   /* The wrapper is serving a request or is
+                          * not anymore usable.  */
+  estream_t in_fp;     /* Connected with stdin of the wrapper.  */
+  unsigned int reqid;  /* Id of the current request.  */
+  size_t frame_left;   /* Bytes left in the current data frame.  */
+  int req_done;        /* The end frame of the request has been seen.  */
+  time_t idle_since;   /* Time the wrapper became idle.  */
 };
 
 
@@ -176,6 +196,7 @@ destroy_wrapper (struct wrapper_context_s *ctx)
       gnupg_release_process (ctx->pid);
     }
   ksba_reader_release (ctx->reader);
+  SAFE_CLOSE (ctx->in_fp);
   SAFE_CLOSE (ctx->fp);
   SAFE_CLOSE (ctx->log_fp);
   xfree (ctx->line);
@@ -487,6 +508,20 @@ ldap_reaper_thread (void *dummy)
                 SAFE_CLOSE (ctx->log_fp);
                 any_action = 1;
               }
+
+            /* Check whether an idle wrapper in server mode should be
+             * terminated.  Closing its stdin makes it exit.  */
+            if (ctx->helper && !ctx->busy && ctx->in_fp
+                && (shutting_down
+                    || ctx->idle_since + HELPER_IDLE_TIMEOUT < time (NULL)))
+              {
+                if (DBG_EXTPROG)
+                  log_debug ("ldap wrapper %d idle - terminating\n",
+                             (int)ctx->pid);
+                SAFE_CLOSE (ctx->in_fp);
+                ctx->busy = 1;
+                any_action = 1;
+              }
           }
 
         /* If something has been printed to the log file or we got an
@@ -609,7 +644,25 @@ ldap_wrapper_release_context (ksba_reader_t reader)
                        ctx->ctrl, ctx->ctrl? ctx->ctrl->refcount:0);
 
           ctx->reader = NULL;
-          SAFE_CLOSE (ctx->fp);
+          if (!ctx->helper)
+            SAFE_CLOSE (ctx->fp);
+          else if (ctx->req_done && !ctx->fp_err && ctx->fp && ctx->in_fp
+                   && ctx->pid != (pid_t)(-1))
+            {
+              /* The response has been read completely; the wrapper
+               * may be used for the next request.  */
+              ctx->busy = 0;
+              ctx->stamp = (time_t)(-1);
+              ctx->idle_since = time (NULL);
+            }
+          else
+            {
+              /* The response has not been read completely and there
+               * is no way to skip the rest; get rid of the wrapper.  */
+              SAFE_CLOSE (ctx->in_fp);
+              if (ctx->pid != (pid_t)(-1))
+                gnupg_kill_process (ctx->pid);
+            }
           if (ctx->ctrl)
             {
               ctx->ctrl->refcount--;
@@ -639,6 +692,7 @@ ldap_wrapper_connection_cleanup (ctrl_t ctrl)
         {
           ctx->ctrl->refcount--;
           ctx->ctrl = NULL;
+          SAFE_CLOSE (ctx->in_fp);
           if (ctx->pid != (pid_t)(-1))
             gnupg_kill_process (ctx->pid);
           if (ctx->fp_err)
@@ -781,10 +835,282 @@ reader_callback (void *cb_value, char *buffer, size_t count,  size_t *nread)
 }
 
 
+/* Read the header line of the next frame from a wrapper in server
+ * mode.  On success either CTX->FRAME_LEFT or CTX->REQ_DONE is
+ * updated.  Returns -1 on EOF or error.  */
+static int
+read_frame_header (struct wrapper_context_s *ctx)
+{
+  char hdr[64];
+  size_t n = 0;
+  size_t nread;
+  unsigned long id, value;
+  char *p;
+
+  for (;;)
+    {
+      if (reader_callback (ctx, hdr + n, 1, &nread))
+        return -1;
+      if (hdr[n] == '\n')
+        break;
+      if (++n >= sizeof hdr - 1)
+        goto invalid;
+    }
+  hdr[n] = 0;
+
+  if ((*hdr != 'D' && *hdr != 'E') || hdr[1] != ' ')
+    goto invalid;
+  id = strtoul (hdr + 2, &p, 10);
+  if (id != ctx->reqid || *p != ' ')
+    goto invalid;
+  value = strtoul (p + 1, NULL, 10);
+
+  if (*hdr == 'D')
+    ctx->frame_left = value;
+  else
+    {
+      ctx->req_done = 1;
+      if (value)
+        log_info (_("ldap wrapper %d ready: exitcode=%d\n"),
+                  ctx->printable_pid, (int)value);
+    }
+  return 0;
+
+ invalid:
+  ctx->fp_err = gpg_error (GPG_ERR_INV_RESPONSE);
+  log_error ("invalid frame received from ldap wrapper %d\n",
+             ctx->printable_pid);
+  return -1;
+}
+
+
+/* This is the callback used to feed the ksba reader with the
+ * response of a wrapper in server mode.  It strips the framing and
+ * returns EOF at the end of the response.  See the description of
+ * ksba_reader_set_cb for details.  */
+static int
+helper_reader_callback (void *cb_value, char *buffer, size_t count,
+                        size_t *nread)
+{
+  struct wrapper_context_s *ctx = cb_value;
+
+  if (!buffer && !count && !nread)
+    return -1; /* Rewind is not supported. */
+
+  while (!ctx->frame_left)
+    {
+      if (ctx->req_done || read_frame_header (ctx))
+        {
+          *nread = 0;
+          return -1;
+        }
+    }
+
+  if (count > ctx->frame_left)
+    count = ctx->frame_left;
+  if (reader_callback (ctx, buffer, count, nread))
+    return -1;
+  ctx->frame_left -= *nread;
+  return 0;
+}
+
+
+/* Return the name of the LDAP wrapper program.  */
+static const char *
+wrapper_program_name (void)
+{
+  if (!opt.ldap_wrapper_program || !*opt.ldap_wrapper_program)
+    return gnupg_module_name (GNUPG_MODULE_NAME_DIRMNGR_LDAP);
+  else
+    return opt.ldap_wrapper_program;
+}
+
+
+/* Return an idle wrapper in server mode and mark it as busy.  If
+ * there is none, a new one is started unless the limit has been
+ * reached.  Returns NULL if no wrapper is available.  */
+static struct wrapper_context_s *
+acquire_helper (void)
+{
+  gpg_error_t err;
+  struct wrapper_context_s *ctx;
+  const char *arg_list[2];
+  const char *pgmname;
+  estream_t infp, outfp, errfp;
+  pid_t pid;
+  int count;
+
+  lock_reaper_list ();
+  {
+    for (count=0, ctx=reaper_list; ctx; ctx=ctx->next)
+      if (ctx->helper && ctx->in_fp && ctx->pid != (pid_t)(-1))
+        {
+          if (!ctx->busy)
+            {
+              ctx->busy = 1;
+              break;
+            }
+          count++;
+        }
+  }
+  unlock_reaper_list ();
+  if (ctx || count >= MAX_LDAP_HELPERS)
+    return ctx;
+
+  ctx = xtrycalloc (1, sizeof *ctx);
+  if (!ctx)
+    return NULL;
+
+  pgmname = wrapper_program_name ();
+  arg_list[0] = "--server";
+  arg_list[1] = NULL;
+  err = gnupg_spawn_process (pgmname, arg_list,
+                             NULL, GNUPG_SPAWN_NONBLOCK,
+                             &infp, &outfp, &errfp, &pid);
+  if (err)
+    {
+      xfree (ctx);
+      log_error ("error running '%s': %s\n", pgmname, gpg_strerror (err));
+      return NULL;
+    }
+
+  ctx->pid = pid;
+  ctx->printable_pid = (int) pid;
+  ctx->in_fp = infp;
+  ctx->fp = outfp;
+  ctx->log_fp = errfp;
+  ctx->stamp = (time_t)(-1);
+  ctx->helper = 1;
+  ctx->busy = 1;
+
+  lock_reaper_list ();
+  {
+    ctx->next = reaper_list;
+    reaper_list = ctx;
+    if (npth_cond_signal (&reaper_run_cond))
+      log_error ("ldap-wrapper: Ooops: signaling condition failed: %s (%d)\n",
+                 gpg_strerror (gpg_error_from_syserror ()), errno);
+  }
+  unlock_reaper_list ();
+
+  if (DBG_EXTPROG)
+    log_debug ("ldap wrapper %d started in server mode (%s)\n",
+               (int)ctx->pid, pgmname);
+  return ctx;
+}
+
+
+/* Send the request ARGV to the wrapper CTX which has been returned by
+ * acquire_helper and create a new ksba reader for the response at
+ * READER.  On error the wrapper is terminated.  */
+static gpg_error_t
+helper_request (ctrl_t ctrl, struct wrapper_context_s *ctx,
+                ksba_reader_t *reader, const char *argv[])
+{
+  static unsigned int reqcounter;
+  gpg_error_t err;
+  char *p;
+  int i;
+
+  for (i = 0; argv[i]; i++)
+    ;
+
+  ctx->reqid = ++reqcounter;
+  ctx->frame_left = 0;
+  ctx->req_done = 0;
+  ctx->fp_err = 0;
+
+  err = 0;
+  if (es_fprintf (ctx->in_fp, "REQ %u %d\n", ctx->reqid, i) < 0)
+    err = gpg_error_from_syserror ();
+  for (i = 0; !err && argv[i]; i++)
+    {
+      p = percent_plus_escape (argv[i]);
+      if (!p || es_fprintf (ctx->in_fp, "%s\n", p) < 0)
+        err = gpg_error_from_syserror ();
+      xfree (p);
+    }
+  if (!err && es_fflush (ctx->in_fp))
+    err = gpg_error_from_syserror ();
+  if (err)
+    log_error ("error sending request to ldap wrapper %d: %s\n",
+               ctx->printable_pid, gpg_strerror (err));
+
+  if (!err)
+    err = ksba_reader_new (reader);
+  if (!err)
+    err = ksba_reader_set_cb (*reader, helper_reader_callback, ctx);
+  if (err)
+    {
+      ksba_reader_release (*reader);
+      *reader = NULL;
+      lock_reaper_list ();
+      {
+        SAFE_CLOSE (ctx->in_fp);
+        if (ctx->pid != (pid_t)(-1))
+          gnupg_kill_process (ctx->pid);
+      }
+      unlock_reaper_list ();
+      return err;
+    }
+
+  lock_reaper_list ();
+  {
+    ctx->reader = *reader;
+    ctx->ctrl = ctrl;
+    ctrl->refcount++;
+    ctx->stamp = time (NULL);
+  }
+  unlock_reaper_list ();
+
+  if (DBG_EXTPROG)
+    {
+      log_debug ("ldap wrapper %d request %u (%p)",
+                 (int)ctx->pid, ctx->reqid, ctx->reader);
+      for (i=0; argv[i]; i++)
+        log_printf (" [%s]",
+                    (i && !strcmp (argv[i-1], "--pass"))? "*" : argv[i]);
+      log_printf ("\n");
+    }
+
+  return 0;
+}
+
+
+/* Wait for the first byte so we are able to detect an empty output
+   and not let the consumer see an EOF without further error
+   indications.  The CRL loading logic assumes that after return from
+   ldap_wrapper, a failed search (e.g. host not found ) is indicated
+   right away. */
+static gpg_error_t
+wait_first_byte (ksba_reader_t *reader)
+{
+  gpg_error_t err;
+  unsigned char c;
+
+  err = read_buffer (*reader, &c, 1);
+  if (err)
+    {
+      ldap_wrapper_release_context (*reader);
+      ksba_reader_release (*reader);
+      *reader = NULL;
+      if (gpg_err_code (err) == GPG_ERR_EOF)
+        return gpg_error (GPG_ERR_NO_DATA);
+      else
+        return err;
+    }
+  ksba_reader_unread (*reader, &c, 1);
+  return 0;
+}
+
+
 /* Fork and exec the LDAP wrapper and return a new libksba reader
    object at READER.  ARGV is a NULL terminated list of arguments for
    the wrapper.  The function returns 0 on success or an error code.
 
+   If possible the request is passed to a wrapper running in server
+   mode instead of forking a new process.
+
    Special hack to avoid passing a password through the command line
    which is globally visible: If the first element of ARGV is "--pass"
    it will be removed and instead the environment variable
@@ -818,12 +1144,15 @@ ldap_wrapper (ctrl_t ctrl, ksba_reader_t *reader, const char *argv[])
 
   *reader = NULL;
 
+  /* Prefer a wrapper in server mode; the password is then sent via
+     the pipe and there is no need for the environment hack.  */
+  ctx = acquire_helper ();
+  if (ctx && !helper_request (ctrl, ctx, reader, argv))
+    return wait_first_byte (reader);
+
   /* Files: We need to prepare stdin and stdout.  We get stderr from
      the function.  */
-  if (!opt.ldap_wrapper_program || !*opt.ldap_wrapper_program)
-    pgmname = gnupg_module_name (GNUPG_MODULE_NAME_DIRMNGR_LDAP);
-  else
-    pgmname = opt.ldap_wrapper_program;
+  pgmname = wrapper_program_name ();
 
   /* Create command line argument array.  */
   for (i = 0; argv[i]; i++)
@@ -909,28 +1238,5 @@ ldap_wrapper (ctrl_t ctrl, ksba_reader_t *reader, const char *argv[])
     }
   xfree (arg_list);
 
-
-  /* Need to wait for the first byte so we are able to detect an empty
-     output and not let the consumer see an EOF without further error
-     indications.  The CRL loading logic assumes that after return
-     from this function, a failed search (e.g. host not found ) is
-     indicated right away. */
-  {
-    unsigned char c;
-
-    err = read_buffer (*reader, &c, 1);
-    if (err)
-      {
-        ldap_wrapper_release_context (*reader);
-        ksba_reader_release (*reader);
-        *reader = NULL;
-        if (gpg_err_code (err) == GPG_ERR_EOF)
-          return gpg_error (GPG_ERR_NO_DATA);
-        else
-          return err;
-      }
-    ksba_reader_unread (*reader, &c, 1);
-  }
-
-  return 0;
+  return wait_first_byte (reader);
 }
@@ -126,7 +126,8 @@ fetch_file (ctrl_t ctrl, const char *url, estream_t *r_fp)
   size_t nread, nwritten;
   char buffer[1024];
 
-  if ((err = ks_http_fetch (ctrl, url, KS_HTTP_FETCH_NOCACHE, &httpfp)))
+  if ((err = ks_http_fetch (ctrl, url, KS_HTTP_FETCH_NOCACHE,
+                            NULL, &httpfp)))
     goto leave;
 
   /* We now read the data from the web server into a memory buffer.
@@ -208,6 +209,172 @@ verify_status_cb (void *opaque, const char *keyword, char *args)
 
 
 
+/* The meta data of our swdb file as last read or written.  */
+static struct
+{
+  int valid;
+  time_t filedate;  /* ".filedate" from our swdb.  */
+  time_t verified;  /* ".verified" from our swdb.  */
+} swdb_info;
+
+
+/* Return a memory stream at R_FP with the content of the saved swdb
+ * file FNAME but without our meta data lines.  That is the content
+ * as originally downloaded.  */
+static gpg_error_t
+read_saved_swdb (const char *fname, estream_t *r_fp)
+{
+  gpg_error_t err = 0;
+  estream_t fp = NULL;
+  estream_t outfp = NULL;
+  char *line = NULL;
+  size_t length_of_line = 0;
+  size_t  maxlen;
+  ssize_t len;
+
+  *r_fp = NULL;
+
+  fp = es_fopen (fname, "r");
+  if (!fp)
+    {
+      err = gpg_error_from_syserror ();
+      log_error (_("error opening '%s': %s\n"), fname, gpg_strerror (err));
+      goto leave;
+    }
+  outfp = es_fopenmem (64*1024, "rw");
+  if (!outfp)
+    {
+      err = gpg_error_from_syserror ();
+      log_error ("error allocating memory buffer: %s\n", gpg_strerror (err));
+      goto leave;
+    }
+
+  maxlen = 2048; /* Set limit.  */
+  while ((len = es_read_line (fp, &line, &length_of_line, &maxlen)) > 0)
+    {
+      if (!maxlen)
+        {
+          err = gpg_error (GPG_ERR_LINE_TOO_LONG);
+          goto leave;
+        }
+      if (!strncmp (line, ".filedate ", 10) || !strncmp (line, ".verified ", 10))
+        continue;
+      if (es_write (outfp, line, len, NULL))
+        {
+          err = gpg_error_from_syserror ();
+          goto leave;
+        }
+    }
+  if (len < 0 || es_ferror (fp))
+    {
+      err = gpg_error_from_syserror ();
+      log_error (_("error reading '%s': %s\n"), fname, gpg_strerror (err));
+      goto leave;
+    }
+
+  es_rewind (outfp);
+  *r_fp = outfp;
+  outfp = NULL;
+
+ leave:
+  xfree (line);
+  es_fclose (outfp);
+  es_fclose (fp);
+  return err;
+}
+
+
+/* Write the swdb from the stream SWDB to the file FNAME and prefix it
+ * with our meta data FILEDATE and VERIFIED.  The file is replaced
+ * atomically.  */
+static gpg_error_t
+write_swdb (const char *fname, estream_t swdb,
+            time_t filedate, time_t verified)
+{
+  gpg_error_t err;
+  char *tmp_fname = NULL;  /* The temporary swdb.lst file.  */
+  estream_t outfp = NULL;
+  gnupg_isotime_t isotime;
+
+  /* Create a file name for a temporary file in the home directory.
+   * We will later rename that file to the real name.  */
+  {
+    char *tmpstr;
+
+#ifdef HAVE_W32_SYSTEM
+    tmpstr = es_bsprintf ("tmp-%u-swdb", (unsigned int)getpid ());
+#else
+    tmpstr = es_bsprintf (".#%u.swdb", (unsigned int)getpid ());
+#endif
+    if (!tmpstr)
+      {
+        err = gpg_error_from_syserror ();
+        goto leave;
+      }
+    tmp_fname = make_filename_try (gnupg_homedir (), tmpstr, NULL);
+    xfree (tmpstr);
+    if (!tmp_fname)
+      {
+        err = gpg_error_from_syserror ();
+        goto leave;
+      }
+  }
+
+  outfp = es_fopen (tmp_fname, "w");
+  if (!outfp)
+    {
+      err = gpg_error_from_syserror ();
+      log_error (_("error creating '%s': %s\n"), tmp_fname, gpg_strerror (err));
+      goto leave;
+    }
+
+  epoch2isotime (isotime, filedate);
+  es_fprintf (outfp, ".filedate %s\n", isotime);
+  epoch2isotime (isotime, verified);
+  es_fprintf (outfp, ".verified %s\n", isotime);
+
+  if (es_fseek (swdb, 0, SEEK_SET))
+    {
+      err = gpg_error_from_syserror ();
+      goto leave;
+    }
+
+  err = copy_stream (swdb, outfp);
+  if (err)
+    {
+      /* Well, it might also be a reading error, but that is pretty
+       * unlikely for a memory stream.  */
+      log_error (_("error writing '%s': %s\n"), tmp_fname, gpg_strerror (err));
+      goto leave;
+    }
+
+  if (es_fclose (outfp))
+    {
+      err = gpg_error_from_syserror ();
+      log_error (_("error writing '%s': %s\n"), tmp_fname, gpg_strerror (err));
+      goto leave;
+    }
+  outfp = NULL;
+
+  err = gnupg_rename_file (tmp_fname, fname, NULL);
+  if (err)
+    goto leave;
+  xfree (tmp_fname);
+  tmp_fname = NULL;
+
+  swdb_info.filedate = filedate;
+  swdb_info.verified = verified;
+  swdb_info.valid = 1;
+
+ leave:
+  es_fclose (outfp);
+  if (tmp_fname)
+    gnupg_remove (tmp_fname);  /* This is a temporary file.  */
+  xfree (tmp_fname);
+  return err;
+}
+
+
 /* Load the swdb file into the current home directory.  Do this onlky
  * when needed unless FORCE is set which will always get a new
  * copy.  */
@@ -216,18 +383,15 @@ dirmngr_load_swdb (ctrl_t ctrl, int force)
 {
   gpg_error_t err;
   char *fname = NULL;      /* The swdb.lst file.  */
-  char *tmp_fname = NULL;  /* The temporary swdb.lst file.  */
   char *keyfile_fname = NULL;
   estream_t swdb = NULL;
   estream_t swdb_sig = NULL;
   ccparray_t ccp;
   const char **argv = NULL;
   struct verify_status_parm_s verify_status_parm = { (time_t)(-1), 0 };
-  estream_t outfp = NULL;
   time_t now = gnupg_get_time ();
   time_t filedate = 0;  /* ".filedate" from our swdb.  */
   time_t verified = 0;  /* ".verified" from our swdb.  */
-  gnupg_isotime_t isotime;
 
 
   fname = make_filename_try (gnupg_homedir (), "swdb.lst", NULL);
@@ -237,6 +401,28 @@ dirmngr_load_swdb (ctrl_t ctrl, int force)
       goto leave;
     }
 
+  /* Get the meta data of our swdb.  The file is only read if we do
+   * not yet know it.  */
+  if (!swdb_info.valid)
+    {
+      err = time_of_saved_swdb (fname, &filedate, &verified);
+      if (gpg_err_code (err) == GPG_ERR_INV_TIME)
+        err = 0; /* Force reading. */
+      else if (!err && filedate)
+        {
+          swdb_info.filedate = filedate;
+          swdb_info.verified = verified;
+          swdb_info.valid = 1;
+        }
+      if (err)
+        goto leave;
+    }
+  else
+    {
+      filedate = swdb_info.filedate;
+      verified = swdb_info.verified;
+    }
+
   /* Check whether there is a need to get an update.  */
   if (!force)
     {
@@ -254,17 +440,12 @@ dirmngr_load_swdb (ctrl_t ctrl, int force)
       if (now - lastcheck < 3600)
         {
           /* We checked our swdb file in the last hour - don't check
-           * again to avoid unnecessary disk access.  */
+           * again to avoid unnecessary work.  */
           err = 0;
           goto leave;
         }
       lastcheck = now;
 
-      err = time_of_saved_swdb (fname, &filedate, &verified);
-      if (gpg_err_code (err) == GPG_ERR_INV_TIME)
-        err = 0; /* Force reading. */
-      if (err)
-        goto leave;
       if (filedate >= now)
         goto leave; /* Current or newer.  */
       if (now - filedate < not_older_than)
@@ -281,8 +462,26 @@ dirmngr_load_swdb (ctrl_t ctrl, int force)
       goto leave;
     }
 
-  /* Fetch the swdb from the web.  */
+  /* Fetch the swdb from the web.  If we have a verified copy ask the
+   * server to send it only if it has been modified since we
+   * downloaded it.  */
+  if (!force && filedate && verified > 0)
+    ctrl->http_if_modified_since = verified;
   err = fetch_file (ctrl, "https://versions.gnupg.org/swdb.lst", &swdb);
+  ctrl->http_if_modified_since = 0;
+  if (gpg_err_code (err) == GPG_ERR_ALREADY_FETCHED)
+    {
+      /* Our copy is still current; there is no need to verify it
+       * again.  Only the time of the last check needs an update.  */
+      if (opt.verbose)
+        log_info ("swdb has not been modified\n");
+      err = read_saved_swdb (fname, &swdb);
+      if (!err)
+        err = write_swdb (fname, swdb, filedate, now);
+      if (err)
+        swdb_info.valid = 0;  /* Read the file again next time.  */
+      goto leave;
+    }
   if (err)
     goto leave;
   err = fetch_file (ctrl, "https://versions.gnupg.org/swdb.lst.sig", &swdb_sig);
@@ -324,82 +523,14 @@ dirmngr_load_swdb (ctrl_t ctrl, int force)
   if (!force && filedate >= verify_status_parm.sigtime)
     goto leave;
 
-  /* Create a file name for a temporary file in the home directory.
-   * We will later rename that file to the real name.  */
-  {
-    char *tmpstr;
-
-#ifdef HAVE_W32_SYSTEM
-    tmpstr = es_bsprintf ("tmp-%u-swdb", (unsigned int)getpid ());
-#else
-    tmpstr = es_bsprintf (".#%u.swdb", (unsigned int)getpid ());
-#endif
-    if (!tmpstr)
-      {
-        err = gpg_error_from_syserror ();
-        goto leave;
-      }
-    tmp_fname = make_filename_try (gnupg_homedir (), tmpstr, NULL);
-    xfree (tmpstr);
-    if (!tmp_fname)
-      {
-        err = gpg_error_from_syserror ();
-        goto leave;
-      }
-  }
-
-  outfp = es_fopen (tmp_fname, "w");
-  if (!outfp)
-    {
-      err = gpg_error_from_syserror ();
-      log_error (_("error creating '%s': %s\n"), tmp_fname, gpg_strerror (err));
-      goto leave;
-    }
-
-  epoch2isotime (isotime, verify_status_parm.sigtime);
-  es_fprintf (outfp, ".filedate %s\n", isotime);
-  epoch2isotime (isotime, now);
-  es_fprintf (outfp, ".verified %s\n", isotime);
-
-  if (es_fseek (swdb, 0, SEEK_SET))
-    {
-      err = gpg_error_from_syserror ();
-      goto leave;
-    }
-
-  err = copy_stream (swdb, outfp);
-  if (err)
-    {
-      /* Well, it might also be a reading error, but that is pretty
-       * unlikely for a memory stream.  */
-      log_error (_("error writing '%s': %s\n"), tmp_fname, gpg_strerror (err));
-      goto leave;
-    }
-
-  if (es_fclose (outfp))
-    {
-      err = gpg_error_from_syserror ();
-      log_error (_("error writing '%s': %s\n"), tmp_fname, gpg_strerror (err));
-      goto leave;
-    }
-  outfp = NULL;
-
-  err = gnupg_rename_file (tmp_fname, fname, NULL);
-  if (err)
-    goto leave;
-  xfree (tmp_fname);
-  tmp_fname = NULL;
+  err = write_swdb (fname, swdb, verify_status_parm.sigtime, now);
 
 
  leave:
-  es_fclose (outfp);
-  if (tmp_fname)
-    gnupg_remove (tmp_fname);  /* This is a temporary file.  */
   xfree (argv);
   es_fclose (swdb_sig);
   es_fclose (swdb);
   xfree (keyfile_fname);
-  xfree (tmp_fname);
   xfree (fname);
   return err;
 }
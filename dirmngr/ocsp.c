@@ -34,10 +34,42 @@
 /* The maximum size we allow as a response from an OCSP reponder. */
 #define MAX_RESPONSE_SIZE 65536
 
+/* The directory below the cache directory with cached responses.  */
+#define OCSP_CACHE_DIR "ocsp.d"
+
+/* The number of slots in the status cache and the maximum number of
+   seconds a status is kept there.  */
+#define OCSP_STATUS_CACHE_SIZE 256
+#define OCSP_STATUS_CACHE_TTL  60
+
+/* The maximum number of certificates asked for in one request.  */
+#define OCSP_MAX_BATCH 32
+
 
 static const char oidstr_ocsp[] = "1.3.6.1.5.5.7.48.1";
 
 
+/* The status cache keeps the verified status of certificates which
+   have been checked by ocsp_prefetch so that the following calls to
+   ocsp_isvalid for these certificates do not need to ask the
+   responder again.  Because responses to requests with a nonce can't
+   be stored in the file cache, this small cache is the only way to
+   make use of a batched request in the default configuration; thus
+   the entries are only kept for a short time.  The cache is directly
+   mapped by the first bytes of the fingerprint; there is no need for
+   a lock because the functions accessing it do not block.  */
+struct status_cache_item_s
+{
+  unsigned char fpr[20];
+  int force_default_responder;
+  time_t expires;             /* 0 for an unused slot.  */
+  gpg_error_t err;            /* 0 or GPG_ERR_CERT_REVOKED.  */
+  ksba_isotime_t revoked_at;
+  const char *reason;         /* Points to a string constant.  */
+};
+static struct status_cache_item_s status_cache[OCSP_STATUS_CACHE_SIZE];
+
+
 /* Telesec attribute used to implement a positive confirmation.
 
    CertHash ::= SEQUENCE {
@@ -114,17 +146,243 @@ read_response (estream_t fp, unsigned char **r_buffer, size_t *r_buflen)
 }
 
 
-/* Construct an OCSP request, send it to the configured OCSP responder
-   and parse the response. On success the OCSP context may be used to
-   further process the response.  The signature value and the
-   production date are returned at R_SIGVAL and R_PRODUCED_AT; they
-   may be NULL or an empty string if not available.  A new hash
-   context is returned at R_MD.  */
+/* Return the name of the file with a cached response for CERT which
+   has been issued by ISSUER_CERT.  The name is build from the
+   keygrip of the issuer's key and the serial number.  Returns NULL if
+   responses may not be cached; this is the case unless nonces have
+   been disabled because a response to a request with a nonce can't
+   be reused.  */
+static char *
+make_cache_file_name (ksba_cert_t cert, ksba_cert_t issuer_cert)
+{
+  ksba_sexp_t pk, serial;
+  gcry_sexp_t s_pk;
+  unsigned char grip[20];
+  char hexgrip[41];
+  char *serialhex, *name;
+  char *fname = NULL;
+
+  if (!opt.disable_ocsp_nonce)
+    return NULL;
+
+  pk = ksba_cert_get_public_key (issuer_cert);
+  if (!pk || canon_sexp_to_gcry (pk, &s_pk))
+    {
+      ksba_free (pk);
+      return NULL;
+    }
+  ksba_free (pk);
+  if (!gcry_pk_get_keygrip (s_pk, grip))
+    {
+      gcry_sexp_release (s_pk);
+      return NULL;
+    }
+  gcry_sexp_release (s_pk);
+  bin2hex (grip, 20, hexgrip);
+
+  serial = ksba_cert_get_serial (cert);
+  serialhex = serial_hex (serial);
+  ksba_free (serial);
+  if (serialhex && *serialhex && strlen (serialhex) <= 64)
+    {
+      name = strconcat (hexgrip, "-", serialhex, ".der", NULL);
+      if (name)
+        fname = make_filename (opt.homedir_cache, OCSP_CACHE_DIR, name, NULL);
+      xfree (name);
+    }
+  xfree (serialhex);
+  return fname;
+}
+
+
+/* Read the cached response from the file FNAME.  The file starts with
+   the nextUpdate time of the response and a LF, followed by the
+   response itself.  If there is no such file or the response has
+   expired GPG_ERR_NOT_FOUND is returned.  */
 static gpg_error_t
-do_ocsp_request (ctrl_t ctrl, ksba_ocsp_t ocsp,
-                 const char *url, ksba_cert_t cert, ksba_cert_t issuer_cert,
+read_cached_response (const char *fname,
+                      unsigned char **r_response, size_t *r_responselen)
+{
+  gpg_error_t err;
+  estream_t fp;
+  char next_update[16];
+  gnupg_isotime_t current_time;
+
+  *r_response = NULL;
+  *r_responselen = 0;
+
+  fp = es_fopen (fname, "rb");
+  if (!fp)
+    return gpg_error (GPG_ERR_NOT_FOUND);
+
+  gnupg_get_isotime (current_time);
+  if (es_fread (next_update, 16, 1, fp) != 1
+      || next_update[15] != '\n'
+      || (next_update[15] = 0, !isotime_p (next_update))
+      || strcmp (next_update, current_time) < 0)
+    {
+      /* Expired or garbled - remove it.  */
+      es_fclose (fp);
+      gnupg_remove (fname);
+      return gpg_error (GPG_ERR_NOT_FOUND);
+    }
+
+  err = read_response (fp, r_response, r_responselen);
+  es_fclose (fp);
+  return err;
+}
+
+
+/* Store RESPONSE which is valid until NEXT_UPDATE in the file FNAME.
+   Errors are only logged.  */
+static void
+write_cached_response (const char *fname, const ksba_isotime_t next_update,
+                       const unsigned char *response, size_t responselen)
+{
+  char *tmpfname, *p;
+  estream_t fp;
+
+  tmpfname = strconcat (fname, ".tmp", NULL);
+  if (!tmpfname)
+    return;
+
+  fp = es_fopen (tmpfname, "wbx");
+  if (!fp && errno == ENOENT)
+    {
+      /* Create the directory and try again.  */
+      p = strrchr (tmpfname, '/');
+      log_assert (p);
+      *p = 0;
+      if (!gnupg_mkdir (tmpfname, "-rwx"))
+        log_info (_("creating directory '%s'\n"), tmpfname);
+      *p = '/';
+      fp = es_fopen (tmpfname, "wbx");
+    }
+  if (!fp)
+    {
+      /* EEXIST means that another thread is just writing it.  */
+      if (errno != EEXIST)
+        log_error (_("error creating '%s': %s\n"), tmpfname, strerror (errno));
+      xfree (tmpfname);
+      return;
+    }
+
+  if (es_fprintf (fp, "%.15s\n", next_update) < 0
+      || es_fwrite (response, responselen, 1, fp) != 1)
+    {
+      log_error (_("error writing '%s': %s\n"), tmpfname, strerror (errno));
+      es_fclose (fp);
+      gnupg_remove (tmpfname);
+    }
+  else if (es_fclose (fp))
+    {
+      log_error (_("error writing '%s': %s\n"), tmpfname, strerror (errno));
+      gnupg_remove (tmpfname);
+    }
+  else if (gnupg_rename_file (tmpfname, fname, NULL))
+    {
+      log_error (_("error renaming '%s' to '%s': %s\n"),
+                 tmpfname, fname, strerror (errno));
+      gnupg_remove (tmpfname);
+    }
+  xfree (tmpfname);
+}
+
+
+/* Return the status cache slot for the certificate with the
+   fingerprint FPR.  */
+static struct status_cache_item_s *
+status_cache_slot (const unsigned char *fpr)
+{
+  return status_cache + ((fpr[0] << 8 | fpr[1]) % OCSP_STATUS_CACHE_SIZE);
+}
+
+
+/* Look up CERT in the status cache.  If a current entry exists its
+   status is stored at R_ERR, R_REVOKED_AT and R_REASON and true is
+   returned.  R_REVOKED_AT and R_REASON may be NULL.  */
+static int
+status_cache_get (ksba_cert_t cert, int force_default_responder,
+                  gpg_error_t *r_err,
+                  ksba_isotime_t r_revoked_at, const char **r_reason)
+{
+  struct status_cache_item_s *item;
+  unsigned char fpr[20];
+
+  cert_compute_fpr (cert, fpr);
+  item = status_cache_slot (fpr);
+  if (!item->expires || item->expires < gnupg_get_time ()
+      || memcmp (item->fpr, fpr, 20)
+      || item->force_default_responder != !!force_default_responder)
+    return 0;
+
+  if (opt.verbose)
+    log_info ("using cached OCSP status\n");
+  *r_err = item->err;
+  if (item->err)
+    {
+      if (r_revoked_at)
+        gnupg_copy_time (r_revoked_at, item->revoked_at);
+      if (r_reason)
+        *r_reason = item->reason;
+    }
+  return 1;
+}
+
+
+/* Store the status ERR of CERT in the status cache.  NEXT_UPDATE
+   limits the lifetime of the entry.  */
+static void
+status_cache_put (ksba_cert_t cert, int force_default_responder,
+                  gpg_error_t err, const ksba_isotime_t next_update,
+                  const ksba_isotime_t revoked_at, const char *reason)
+{
+  struct status_cache_item_s *item;
+  unsigned char fpr[20];
+  time_t expires, t;
+
+  expires = gnupg_get_time () + OCSP_STATUS_CACHE_TTL;
+  if (*next_update)
+    {
+      t = isotime2epoch (next_update);
+      if (t == (time_t)(-1))
+        return;
+      if (t < expires)
+        expires = t;
+    }
+
+  cert_compute_fpr (cert, fpr);
+  item = status_cache_slot (fpr);
+  memcpy (item->fpr, fpr, 20);
+  item->force_default_responder = !!force_default_responder;
+  item->expires = expires;
+  item->err = err;
+  if (err && revoked_at)
+    gnupg_copy_time (item->revoked_at, revoked_at);
+  else
+    *item->revoked_at = 0;
+  item->reason = err? reason : NULL;
+}
+
+
+/* Construct an OCSP request for the NCERTS certificates in CERTS
+   which have been issued by the respective certificates in
+   ISSUER_CERTS, send it to the configured OCSP responder and parse
+   the response. On success the OCSP context may be used to further
+   process the response.  The signature value and the production date
+   are returned at R_SIGVAL and R_PRODUCED_AT; they may be NULL or an
+   empty string if not available.  A new hash context is returned at
+   R_MD.  If CACHE_FNAME is not NULL a cached response is used instead
+   of asking the responder.  If R_RESPONSE is not NULL a fresh
+   response is returned there so that the caller can store it after
+   it has been verified.  */
+static gpg_error_t
+do_ocsp_request (ctrl_t ctrl, ksba_ocsp_t ocsp, const char *url,
+                 ksba_cert_t *certs, ksba_cert_t *issuer_certs, int ncerts,
+                 const char *cache_fname,
                  ksba_sexp_t *r_sigval, ksba_isotime_t r_produced_at,
-                 gcry_md_hd_t *r_md)
+                 gcry_md_hd_t *r_md,
+                 unsigned char **r_response, size_t *r_responselen)
 {
   gpg_error_t err;
   unsigned char *request, *response;
@@ -133,13 +391,39 @@ do_ocsp_request (ctrl_t ctrl, ksba_ocsp_t ocsp,
   ksba_ocsp_response_status_t response_status;
   const char *t;
   int redirects_left = 2;
+  int from_cache = 0;
   char *free_this = NULL;
+  int i;
 
   (void)ctrl;
 
   *r_sigval = NULL;
   *r_produced_at = 0;
   *r_md = NULL;
+  if (r_response)
+    {
+      *r_response = NULL;
+      *r_responselen = 0;
+    }
+
+  for (i=0; i < ncerts; i++)
+    {
+      err = ksba_ocsp_add_target (ocsp, certs[i], issuer_certs[i]);
+      if (err)
+        {
+          log_error (_("error setting OCSP target: %s\n"), gpg_strerror (err));
+          return err;
+        }
+    }
+
+  if (cache_fname
+      && !read_cached_response (cache_fname, &response, &responselen))
+    {
+      if (opt.verbose)
+        log_info (_("using cached OCSP response '%s'\n"), cache_fname);
+      from_cache = 1;
+      goto parse_response;
+    }
 
   if (dirmngr_use_tor ())
     {
@@ -158,24 +442,18 @@ do_ocsp_request (ctrl_t ctrl, ksba_ocsp_t ocsp,
       return gpg_error (GPG_ERR_NOT_SUPPORTED);
     }
 
-  err = ksba_ocsp_add_target (ocsp, cert, issuer_cert);
-  if (err)
+  if (!opt.disable_ocsp_nonce)
     {
-      log_error (_("error setting OCSP target: %s\n"), gpg_strerror (err));
-      return err;
+      size_t n;
+      unsigned char nonce[32];
+
+      n = ksba_ocsp_set_nonce (ocsp, NULL, 0);
+      if (n > sizeof nonce)
+        n = sizeof nonce;
+      gcry_create_nonce (nonce, n);
+      ksba_ocsp_set_nonce (ocsp, nonce, n);
     }
 
-  {
-    size_t n;
-    unsigned char nonce[32];
-
-    n = ksba_ocsp_set_nonce (ocsp, NULL, 0);
-    if (n > sizeof nonce)
-      n = sizeof nonce;
-    gcry_create_nonce (nonce, n);
-    ksba_ocsp_set_nonce (ocsp, nonce, n);
-  }
-
   err = ksba_ocsp_build_request (ocsp, &request, &requestlen);
   if (err)
     {
@@ -277,15 +555,14 @@ do_ocsp_request (ctrl_t ctrl, ksba_ocsp_t ocsp,
     }
   /* log_printhex (response, responselen, "ocsp response"); */
 
+ parse_response:
   err = ksba_ocsp_parse_response (ocsp, response, responselen,
                                   &response_status);
   if (err)
     {
       log_error (_("error parsing OCSP response for '%s': %s\n"),
                  url, gpg_strerror (err));
-      xfree (response);
-      xfree (free_this);
-      return err;
+      goto leave;
     }
 
   switch (response_status)
@@ -342,6 +619,15 @@ do_ocsp_request (ctrl_t ctrl, ksba_ocsp_t ocsp,
     }
 
  leave:
+  if (err && from_cache)
+    gnupg_remove (cache_fname);
+  else if (!err && r_response && !from_cache)
+    {
+      /* Hand the fresh response back for caching.  */
+      *r_response = response;
+      *r_responselen = responselen;
+      response = NULL;
+    }
   xfree (response);
   xfree (free_this);
   if (err)
@@ -647,87 +933,56 @@ check_signature (ctrl_t ctrl,
 }
 
 
-/* Check whether the certificate either given by fingerprint CERT_FPR
-   or directly through the CERT object is valid by running an OCSP
-   transaction.  With FORCE_DEFAULT_RESPONDER set only the configured
-   default responder is used.  If R_REVOKED_AT or R_REASON are not
-   NULL and the certificat has been revoked the revocation time and
-   the reasons are stored there. */
-gpg_error_t
-ocsp_isvalid (ctrl_t ctrl, ksba_cert_t cert, const char *cert_fpr,
-              int force_default_responder, ksba_isotime_t r_revoked_at,
-              const char **r_reason)
+/* Check the signature of the OCSP response in OCSP using the
+   signature value SIGVAL and the hash context MD as returned by
+   do_ocsp_request.  DEFAULT_SIGNER is the list of allowed signers if
+   the default responder has been used.  */
+static gpg_error_t
+check_response_signature (ctrl_t ctrl, ksba_ocsp_t ocsp,
+                          ksba_const_sexp_t sigval,
+                          const ksba_isotime_t produced_at,
+                          gcry_md_hd_t md,
+                          fingerprint_list_t default_signer)
 {
   gpg_error_t err;
-  ksba_ocsp_t ocsp = NULL;
-  ksba_cert_t issuer_cert = NULL;
-  ksba_sexp_t sigval = NULL;
-  gcry_sexp_t s_sig = NULL;
-  ksba_isotime_t current_time;
-  ksba_isotime_t this_update, next_update, revocation_time, produced_at;
-  ksba_isotime_t tmp_time;
-  ksba_status_t status;
-  ksba_crl_reason_t reason;
-  char *url_buffer = NULL;
-  const char *url;
-  gcry_md_hd_t md = NULL;
-  int i, idx;
-  char *oid;
-  ksba_name_t name;
-  fingerprint_list_t default_signer = NULL;
-  const char *sreason;
+  gcry_sexp_t s_sig;
 
-  if (r_revoked_at)
-    *r_revoked_at = 0;
-  if (r_reason)
-    *r_reason = NULL;
+  if (!sigval || !*produced_at || !md)
+    return gpg_error (GPG_ERR_INV_OBJ);
+  err = canon_sexp_to_gcry (sigval, &s_sig);
+  if (err)
+    return err;
+  err = check_signature (ctrl, ocsp, s_sig, md, default_signer);
+  gcry_sexp_release (s_sig);
+  return err;
+}
 
-  /* Get the certificate.  */
-  if (cert)
-    {
-      ksba_cert_ref (cert);
 
-      err = find_issuing_cert (ctrl, cert, &issuer_cert);
-      if (err)
-        {
-          log_error (_("issuer certificate not found: %s\n"),
-                     gpg_strerror (err));
-          goto leave;
-        }
-    }
-  else
-    {
-      cert = get_cert_local (ctrl, cert_fpr);
-      if (!cert)
-        {
-          log_error (_("caller did not return the target certificate\n"));
-          err = gpg_error (GPG_ERR_GENERAL);
-          goto leave;
-        }
-      issuer_cert = get_issuing_cert_local (ctrl, NULL);
-      if (!issuer_cert)
-        {
-          log_error (_("caller did not return the issuing certificate\n"));
-          err = gpg_error (GPG_ERR_GENERAL);
-          goto leave;
-        }
-    }
+/* Figure out the OCSP responder for CERT.  Its URL is stored at
+   R_URL.  If the URL has been taken from the certificate the buffer
+   holding it is also stored at R_URL_BUFFER and must be released by
+   the caller.  If the default responder is used its list of allowed
+   signers is stored at R_DEFAULT_SIGNER.  */
+static gpg_error_t
+get_responder_url (ksba_cert_t cert, int force_default_responder,
+                   const char **r_url, char **r_url_buffer,
+                   fingerprint_list_t *r_default_signer)
+{
+  gpg_error_t err = 0;
+  const char *url = NULL;
+  char *oid;
+  ksba_name_t name;
+  int i, idx;
 
-  /* Create an OCSP instance.  */
-  err = ksba_ocsp_new (&ocsp);
-  if (err)
-    {
-      log_error (_("failed to allocate OCSP context: %s\n"),
-                 gpg_strerror (err));
-      goto leave;
-    }
+  *r_url = NULL;
+  *r_url_buffer = NULL;
+  *r_default_signer = NULL;
 
   /* Figure out the OCSP responder to use.
      1. Try to get the reponder from the certificate.
         We do only take http and https style URIs into account.
      2. If this fails use the default responder, if any.
    */
-  url = NULL;
   for (idx=0; !url && !opt.ignore_ocsp_service_url && !force_default_responder
          && !(err=ksba_cert_get_authority_info_access (cert, idx,
                                                        &oid, &name)); idx++)
@@ -739,7 +994,7 @@ ocsp_isvalid (ctrl_t ctrl, ksba_cert_t cert, const char *cert_fpr,
               char *p = ksba_name_get_uri (name, i);
               if (p && (!ascii_strncasecmp (p, "http:", 5)
                         || !ascii_strncasecmp (p, "https:", 6)))
-                url = url_buffer = p;
+                url = *r_url_buffer = p;
               else
                 xfree (p);
             }
@@ -750,24 +1005,22 @@ ocsp_isvalid (ctrl_t ctrl, ksba_cert_t cert, const char *cert_fpr,
   if (err && gpg_err_code (err) != GPG_ERR_EOF)
     {
       log_error (_("can't get authorityInfoAccess: %s\n"), gpg_strerror (err));
-      goto leave;
+      return err;
     }
   if (!url)
     {
       if (!opt.ocsp_responder || !*opt.ocsp_responder)
         {
           log_info (_("no default OCSP responder defined\n"));
-          err = gpg_error (GPG_ERR_CONFIGURATION);
-          goto leave;
+          return gpg_error (GPG_ERR_CONFIGURATION);
         }
       if (!opt.ocsp_signer)
         {
           log_info (_("no default OCSP signer defined\n"));
-          err = gpg_error (GPG_ERR_CONFIGURATION);
-          goto leave;
+          return gpg_error (GPG_ERR_CONFIGURATION);
         }
       url = opt.ocsp_responder;
-      default_signer = opt.ocsp_signer;
+      *r_default_signer = opt.ocsp_signer;
       if (opt.verbose)
         log_info (_("using default OCSP responder '%s'\n"), url);
     }
@@ -777,63 +1030,39 @@ ocsp_isvalid (ctrl_t ctrl, ksba_cert_t cert, const char *cert_fpr,
         log_info (_("using OCSP responder '%s'\n"), url);
     }
 
-  /* Ask the OCSP responder. */
-  err = do_ocsp_request (ctrl, ocsp, url, cert, issuer_cert,
-                         &sigval, produced_at, &md);
-  if (err)
-    goto leave;
+  *r_url = url;
+  return 0;
+}
 
-  /* It is sometimes useful to know the responder ID. */
-  if (opt.verbose)
-    {
-      char *resp_name;
-      ksba_sexp_t resp_keyid;
 
-      err = ksba_ocsp_get_responder_id (ocsp, &resp_name, &resp_keyid);
-      if (err)
-        log_info (_("error getting responder ID: %s\n"), gpg_strerror (err));
-      else
-        {
-          log_info ("responder id: ");
-          if (resp_name)
-            log_printf ("'/%s' ", resp_name);
-          if (resp_keyid)
-            {
-              log_printf ("{");
-              dump_serial (resp_keyid);
-              log_printf ("} ");
-            }
-          log_printf ("\n");
-        }
-      ksba_free (resp_name);
-      ksba_free (resp_keyid);
-      err = 0;
-    }
+/* Get the status of CERT from the verified response in OCSP and
+   check that it is current.  The nextUpdate time of the response is
+   stored at R_NEXT_UPDATE.  If R_REVOKED_AT or R_REASON are not NULL
+   and the certificate has been revoked the revocation time and the
+   reason are stored there.  */
+static gpg_error_t
+get_target_status (ksba_ocsp_t ocsp, ksba_cert_t cert,
+                   ksba_isotime_t r_revoked_at, const char **r_reason,
+                   ksba_isotime_t r_next_update)
+{
+  gpg_error_t err;
+  ksba_isotime_t current_time;
+  ksba_isotime_t this_update, revocation_time, tmp_time;
+  ksba_status_t status;
+  ksba_crl_reason_t reason;
+  const char *sreason;
 
-  /* We got a useful answer, check that the answer has a valid signature. */
-  if (!sigval || !*produced_at || !md)
-    {
-      err = gpg_error (GPG_ERR_INV_OBJ);
-      goto leave;
-    }
-  if ( (err = canon_sexp_to_gcry (sigval, &s_sig)) )
-    goto leave;
-  xfree (sigval);
-  sigval = NULL;
-  err = check_signature (ctrl, ocsp, s_sig, md, default_signer);
-  if (err)
-    goto leave;
+  *r_next_update = 0;
 
-  /* We only support one certificate per request.  Check that the
-     answer matches the right certificate. */
+  /* Check that the answer has a status for our certificate.  */
   err = ksba_ocsp_get_status (ocsp, cert,
-                              &status, this_update, next_update,
+                              &status, this_update, r_next_update,
                               revocation_time, &reason);
   if (err)
     {
       log_error (_("error getting OCSP status for target certificate: %s\n"),
                  gpg_strerror (err));
-      goto leave;
+      return err;
     }
 
   /* In case the certificate has been revoked, we better invalidate
@@ -851,6 +1080,7 @@ ocsp_isvalid (ctrl_t ctrl, ksba_cert_t cert, const char *cert_fpr,
                       more important message than the failure of our
                       cache. */
         }
+      validate_flush_chain_cache ();
 
       switch (reason)
         {
@@ -889,7 +1119,7 @@ ocsp_isvalid (ctrl_t ctrl, ksba_cert_t cert, const char *cert_fpr,
                 status == KSBA_STATUS_REVOKED? _("revoked"):
                 status == KSBA_STATUS_UNKNOWN? _("unknown"):
                 status == KSBA_STATUS_NONE? _("none"): "?",
-                this_update, next_update);
+                this_update, r_next_update);
       if (status == KSBA_STATUS_REVOKED)
         log_info (_("certificate has been revoked at: %s due to: %s\n"),
                   revocation_time, sreason);
@@ -936,25 +1166,161 @@ ocsp_isvalid (ctrl_t ctrl, ksba_cert_t cert, const char *cert_fpr,
     }
 
   /* Check that we are not beyond NEXT_UPDATE  (plus some extra time). */
-  if (*next_update)
+  if (*r_next_update)
     {
-      gnupg_copy_time (tmp_time, next_update);
+      gnupg_copy_time (tmp_time, r_next_update);
       add_seconds_to_isotime (tmp_time,
                               opt.ocsp_current_period+opt.ocsp_max_clock_skew);
       if (!*tmp_time && strcmp (tmp_time, current_time) < 0 )
         {
           log_error (_("OCSP responder returned an too old status\n"));
           log_info ("used now: %s  next_update: %s\n",
-                    current_time, next_update);
+                    current_time, r_next_update);
           if (!err)
             err = gpg_error (GPG_ERR_TIME_CONFLICT);
         }
     }
 
+  return err;
+}
+
+
+/* Check whether the certificate either given by fingerprint CERT_FPR
+   or directly through the CERT object is valid by running an OCSP
+   transaction.  With FORCE_DEFAULT_RESPONDER set only the configured
+   default responder is used.  If R_REVOKED_AT or R_REASON are not
+   NULL and the certificat has been revoked the revocation time and
+   the reasons are stored there. */
+gpg_error_t
+ocsp_isvalid (ctrl_t ctrl, ksba_cert_t cert, const char *cert_fpr,
+              int force_default_responder, ksba_isotime_t r_revoked_at,
+              const char **r_reason)
+{
+  gpg_error_t err;
+  ksba_ocsp_t ocsp = NULL;
+  ksba_cert_t issuer_cert = NULL;
+  ksba_sexp_t sigval = NULL;
+  ksba_isotime_t next_update, produced_at;
+  char *url_buffer = NULL;
+  const char *url;
+  gcry_md_hd_t md = NULL;
+  fingerprint_list_t default_signer = NULL;
+  char *cache_fname = NULL;
+  unsigned char *response = NULL;
+  size_t responselen;
+
+  if (r_revoked_at)
+    *r_revoked_at = 0;
+  if (r_reason)
+    *r_reason = NULL;
+
+  /* Get the certificate.  */
+  if (cert)
+    {
+      ksba_cert_ref (cert);
+
+      /* A batch request may already have told us the status.  */
+      if (status_cache_get (cert, force_default_responder, &err,
+                            r_revoked_at, r_reason))
+        goto leave;
+
+      err = find_issuing_cert (ctrl, cert, &issuer_cert);
+      if (err)
+        {
+          log_error (_("issuer certificate not found: %s\n"),
+                     gpg_strerror (err));
+          goto leave;
+        }
+    }
+  else
+    {
+      cert = get_cert_local (ctrl, cert_fpr);
+      if (!cert)
+        {
+          log_error (_("caller did not return the target certificate\n"));
+          err = gpg_error (GPG_ERR_GENERAL);
+          goto leave;
+        }
+      if (status_cache_get (cert, force_default_responder, &err,
+                            r_revoked_at, r_reason))
+        goto leave;
+      issuer_cert = get_issuing_cert_local (ctrl, NULL);
+      if (!issuer_cert)
+        {
+          log_error (_("caller did not return the issuing certificate\n"));
+          err = gpg_error (GPG_ERR_GENERAL);
+          goto leave;
+        }
+    }
+
+  /* Create an OCSP instance.  */
+  err = ksba_ocsp_new (&ocsp);
+  if (err)
+    {
+      log_error (_("failed to allocate OCSP context: %s\n"),
+                 gpg_strerror (err));
+      goto leave;
+    }
+
+  err = get_responder_url (cert, force_default_responder,
+                           &url, &url_buffer, &default_signer);
+  if (err)
+    goto leave;
+
+  /* Ask the OCSP responder or use a cached response. */
+  cache_fname = make_cache_file_name (cert, issuer_cert);
+  err = do_ocsp_request (ctrl, ocsp, url, &cert, &issuer_cert, 1, cache_fname,
+                         &sigval, produced_at, &md,
+                         cache_fname? &response : NULL, &responselen);
+  if (err)
+    goto leave;
+
+  /* It is sometimes useful to know the responder ID. */
+  if (opt.verbose)
+    {
+      char *resp_name;
+      ksba_sexp_t resp_keyid;
+
+      err = ksba_ocsp_get_responder_id (ocsp, &resp_name, &resp_keyid);
+      if (err)
+        log_info (_("error getting responder ID: %s\n"), gpg_strerror (err));
+      else
+        {
+          log_info ("responder id: ");
+          if (resp_name)
+            log_printf ("'/%s' ", resp_name);
+          if (resp_keyid)
+            {
+              log_printf ("{");
+              dump_serial (resp_keyid);
+              log_printf ("} ");
+            }
+          log_printf ("\n");
+        }
+      ksba_free (resp_name);
+      ksba_free (resp_keyid);
+      err = 0;
+    }
+
+  /* We got a useful answer, check that the answer has a valid signature. */
+  err = check_response_signature (ctrl, ocsp, sigval, produced_at, md,
+                                  default_signer);
+  if (err)
+    goto leave;
+
+  err = get_target_status (ocsp, cert, r_revoked_at, r_reason, next_update);
+
+  /* Store a fresh and verified response so that it can be reused
+     until NEXT_UPDATE.  */
+  if (response && *next_update
+      && (!err || gpg_err_code (err) == GPG_ERR_CERT_REVOKED))
+    write_cached_response (cache_fname, next_update, response, responselen);
+
 
  leave:
+  xfree (response);
+  xfree (cache_fname);
   gcry_md_close (md);
-  gcry_sexp_release (s_sig);
   xfree (sigval);
   ksba_cert_release (issuer_cert);
   ksba_cert_release (cert);
@@ -964,6 +1330,163 @@ ocsp_isvalid (ctrl_t ctrl, ksba_cert_t cert, const char *cert_fpr,
 }
 
 
+/* Ask the OCSP responders for the status of the NCERTS certificates
+   in CERTS using as few requests as possible.  All certificates
+   served by the same responder are put into one request.  The
+   verified results are stored in the status cache and, if nonces are
+   disabled, also in the file cache, so that the following calls to
+   ocsp_isvalid for these certificates do not need to ask the
+   responder again.  Errors for single certificates are only logged
+   because ocsp_isvalid will anyway check them again.  */
+gpg_error_t
+ocsp_prefetch (ctrl_t ctrl, ksba_cert_t *certs, int ncerts,
+               int force_default_responder)
+{
+  gpg_error_t err;
+  struct {
+    ksba_cert_t cert;
+    ksba_cert_t issuer_cert;
+    const char *url;
+    char *url_buffer;
+    fingerprint_list_t default_signer;
+    char *cache_fname;
+    int done;
+  } *targets;
+  ksba_cert_t batch_certs[OCSP_MAX_BATCH];
+  ksba_cert_t batch_issuers[OCSP_MAX_BATCH];
+  int batch_idx[OCSP_MAX_BATCH];
+  ksba_cert_t issuer_cert;
+  ksba_ocsp_t ocsp;
+  ksba_sexp_t sigval;
+  ksba_isotime_t produced_at, next_update, revoked_at;
+  gcry_md_hd_t md;
+  unsigned char *response;
+  size_t responselen;
+  const char *reason;
+  int i, j, n, ntargets;
+
+  if (ncerts <= 0)
+    return 0;
+  targets = xtrycalloc (ncerts, sizeof *targets);
+  if (!targets)
+    return gpg_error_from_syserror ();
+
+  /* Collect the certificates for which we need to ask.  */
+  ntargets = 0;
+  for (i=0; i < ncerts; i++)
+    {
+      char *cache_fname;
+
+      if (status_cache_get (certs[i], force_default_responder, &err,
+                            NULL, NULL))
+        continue;
+
+      err = find_issuing_cert (ctrl, certs[i], &issuer_cert);
+      if (err)
+        {
+          log_info (_("issuer certificate not found: %s\n"),
+                    gpg_strerror (err));
+          continue;
+        }
+
+      cache_fname = make_cache_file_name (certs[i], issuer_cert);
+      if (cache_fname
+          && !read_cached_response (cache_fname, &response, &responselen))
+        {
+          xfree (response);
+          xfree (cache_fname);
+          ksba_cert_release (issuer_cert);
+          continue;
+        }
+
+      err = get_responder_url (certs[i], force_default_responder,
+                               &targets[ntargets].url,
+                               &targets[ntargets].url_buffer,
+                               &targets[ntargets].default_signer);
+      if (err)
+        {
+          xfree (cache_fname);
+          ksba_cert_release (issuer_cert);
+          continue;
+        }
+      ksba_cert_ref (certs[i]);
+      targets[ntargets].cert = certs[i];
+      targets[ntargets].issuer_cert = issuer_cert;
+      targets[ntargets].cache_fname = cache_fname;
+      ntargets++;
+    }
+
+  /* Send one request per responder.  */
+  for (i=0; i < ntargets; i++)
+    {
+      if (targets[i].done)
+        continue;
+      for (n=0, j=i; j < ntargets && n < OCSP_MAX_BATCH; j++)
+        if (!targets[j].done
+            && targets[j].default_signer == targets[i].default_signer
+            && !strcmp (targets[j].url, targets[i].url))
+          {
+            targets[j].done = 1;
+            batch_idx[n] = j;
+            batch_certs[n] = targets[j].cert;
+            batch_issuers[n] = targets[j].issuer_cert;
+            n++;
+          }
+      if (n < 2)
+        continue;  /* Not worth it; ocsp_isvalid will do this.  */
+
+      if (opt.verbose)
+        log_info ("asking for the status of %d certificates\n", n);
+      ocsp = NULL;
+      sigval = NULL;
+      md = NULL;
+      response = NULL;
+      err = ksba_ocsp_new (&ocsp);
+      if (err)
+        log_error (_("failed to allocate OCSP context: %s\n"),
+                   gpg_strerror (err));
+      else
+        err = do_ocsp_request (ctrl, ocsp, targets[i].url,
+                               batch_certs, batch_issuers, n, NULL,
+                               &sigval, produced_at, &md,
+                               targets[i].cache_fname? &response : NULL,
+                               &responselen);
+      if (!err)
+        err = check_response_signature (ctrl, ocsp, sigval, produced_at, md,
+                                        targets[i].default_signer);
+      for (j=0; !err && j < n; j++)
+        {
+          gpg_error_t tmperr;
+
+          reason = NULL;
+          tmperr = get_target_status (ocsp, batch_certs[j],
+                                      revoked_at, &reason, next_update);
+          if (tmperr && gpg_err_code (tmperr) != GPG_ERR_CERT_REVOKED)
+            continue;
+          status_cache_put (batch_certs[j], force_default_responder,
+                            tmperr, next_update, revoked_at, reason);
+          if (response && *next_update && targets[batch_idx[j]].cache_fname)
+            write_cached_response (targets[batch_idx[j]].cache_fname,
+                                   next_update, response, responselen);
+        }
+      xfree (response);
+      gcry_md_close (md);
+      xfree (sigval);
+      ksba_ocsp_release (ocsp);
+    }
+
+  for (i=0; i < ntargets; i++)
+    {
+      ksba_cert_release (targets[i].cert);
+      ksba_cert_release (targets[i].issuer_cert);
+      xfree (targets[i].url_buffer);
+      xfree (targets[i].cache_fname);
+    }
+  xfree (targets);
+  return 0;
+}
+
+
 /* Release the list of OCSP certificates hold in the CTRL object. */
 void
 release_ctrl_ocsp_certs (ctrl_t ctrl)
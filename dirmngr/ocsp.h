@@ -26,6 +26,8 @@ gpg_error_t ocsp_isvalid (ctrl_t ctrl, ksba_cert_t cert, const char *cert_fpr,
                           int force_default_responder,
                           gnupg_isotime_t r_revoked_at,
                           const char **r_reason);
+gpg_error_t ocsp_prefetch (ctrl_t ctrl, ksba_cert_t *certs, int ncerts,
+                           int force_default_responder);
 
 /* Release the list of OCSP certificates hold in the CTRL object. */
 void release_ctrl_ocsp_certs (ctrl_t ctrl);
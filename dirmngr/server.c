@@ -32,6 +32,7 @@
 #include <sys/stat.h>
 #include <unistd.h>
 #include <errno.h>
+#include <npth.h>
 
 #include "dirmngr.h"
 #include <assuan.h>
@@ -57,6 +58,7 @@
 #include "../common/mbox-util.h"
 #include "../common/zb32.h"
 #include "../common/server-help.h"
+#include "../common/opstats.h"
 
 /* To avoid DoS attacks we limit the size of a certificate to
    something reasonable.  The DoS was actually only an issue back when
@@ -113,6 +115,13 @@ struct server_local_s
   size_t inhibit_data_logging_count;
   unsigned int inhibit_data_logging : 1;
   unsigned int inhibit_data_logging_now : 1;
+
+  /* Lock to serialize status lines written by several threads
+   * working for this session (see ks_action_get).  */
+  npth_mutex_t status_lock;
+
+  /* Start time of the current command for the statistics.  */
+  unsigned long long cmd_start;
 };
 
 
@@ -233,7 +242,7 @@ data_line_write (assuan_context_t ctx, const void *buffer_arg, size_t size)
     }
   else
     {
-      err = assuan_send_data (ctx, buffer, size);
+      err = write_assuan_data_lines (ctx, buffer, size);
       if (err)
         {
           gpg_err_set_errno (EIO);  /* For use by data_line_cookie_write.  */
@@ -1046,11 +1055,34 @@ proc_wkd_get (ctrl_t ctrl, assuan_context_t ctx, char *line)
   /* Setup an output stream and perform the get.  */
   {
     estream_t outfp;
+    estream_t memfp = NULL;
+    void *data = NULL;
+    size_t datalen = 0;
+    unsigned int maxage;
 
     outfp = ctx? es_fopencookie (ctx, "w", data_line_cookie_functions) : NULL;
     if (!outfp && ctx)
       err = set_error (GPG_ERR_ASS_GENERAL,
                        "error setting up a data stream");
+    else if (is_wkd_query
+             && domaininfo_get_wkd_result (encodedhash, domain_orig,
+                                           &data, &datalen, &err))
+      {
+        dirmngr_status_printf (ctrl, "NOTE", "wkd_cached_result %u", err);
+        if (ctrl->server_local)
+          {
+            if (no_log)
+              ctrl->server_local->inhibit_data_logging = 1;
+            ctrl->server_local->inhibit_data_logging_now = 0;
+            ctrl->server_local->inhibit_data_logging_count = 0;
+          }
+        if (!err && outfp && es_write (outfp, data, datalen, NULL))
+          err = gpg_error_from_syserror ();
+        xfree (data);
+        es_fclose (outfp);
+        if (ctrl->server_local)
+          ctrl->server_local->inhibit_data_logging = 0;
+      }
     else
       {
         if (ctrl->server_local)
@@ -1060,7 +1092,27 @@ proc_wkd_get (ctrl_t ctrl, assuan_context_t ctx, char *line)
             ctrl->server_local->inhibit_data_logging_now = 0;
             ctrl->server_local->inhibit_data_logging_count = 0;
           }
-        err = ks_action_fetch (ctrl, uri, outfp);
+        /* For a WKD query we fetch into a memory stream so that we
+         * can cache the key.  */
+        if (is_wkd_query)
+          memfp = es_fopenmem (0, "w+b");
+        err = ks_action_fetch (ctrl, uri, memfp? memfp : outfp, &maxage);
+        if (memfp)
+          {
+            if (es_fclose_snatch (memfp, &data, &datalen))
+              {
+                if (!err)
+                  err = gpg_error_from_syserror ();
+              }
+            else
+              {
+                domaininfo_put_wkd_result (encodedhash, domain_orig,
+                                           data, datalen, err, maxage);
+                if (!err && outfp && es_write (outfp, data, datalen, NULL))
+                  err = gpg_error_from_syserror ();
+                xfree (data);
+              }
+          }
         es_fclose (outfp);
         if (ctrl->server_local)
           ctrl->server_local->inhibit_data_logging = 0;
@@ -1083,7 +1135,8 @@ proc_wkd_get (ctrl_t ctrl, assuan_context_t ctx, char *line)
                 /* Mark that and schedule a check.  */
                 domaininfo_set_wkd_not_found (domain_orig);
                 workqueue_add_task (task_check_wkd_support, domain_orig,
-                                    ctrl->server_local->session_id, 1);
+                                    ctrl->server_local->session_id, 1,
+                                    WQ_PRIO_LOW);
               }
             else if (opt_policy_flags) /* No policy file - no support.  */
               domaininfo_set_wkd_not_supported (domain_orig);
@@ -1122,6 +1175,69 @@ cmd_wkd_get (assuan_context_t ctx, char *line)
 }
 
 
+static const char hlp_akl_result[] =
+  "AKL_RESULT [--put] <mechanism> <mbox> [<fpr>|- <errcode>]\n"
+  "\n"
+  "Return the cached outcome of the auto-key-locate <mechanism> for\n"
+  "the mail address <mbox>.  The result is returned as a status line\n"
+  "\n"
+  "  AKL_RESULT <fpr>\n"
+  "or\n"
+  "  AKL_RESULT - <errcode>\n"
+  "\n"
+  "where <errcode> is the error of a former lookup.  If nothing is\n"
+  "cached the error NOT_FOUND is returned.  With option --put the\n"
+  "outcome of a lookup as given by the last arguments is stored.";
+static gpg_error_t
+cmd_akl_result (assuan_context_t ctx, char *line)
+{
+  gpg_error_t err = 0;
+  const char *fields[5];
+  int nfields, opt_put;
+  char *mbox;
+  char fpr[64+1];  /* See AKL_CACHE_MAX_FPRLEN in domaininfo.c.  */
+  gpg_error_t result;
+
+  opt_put = has_option (line, "--put");
+  line = skip_options (line);
+
+  nfields = split_fields (line, fields, DIM (fields));
+  if (nfields < (opt_put? 3 : 2) || nfields > (opt_put? 4 : 2)
+      || (opt_put && *fields[2] == '-' && !fields[2][1] && nfields != 4))
+    {
+      err = set_error (GPG_ERR_ASS_SYNTAX, "wrong number of arguments");
+      goto leave;
+    }
+  mbox = (char *)fields[1];
+  ascii_strlwr (mbox);
+
+  if (opt_put)
+    {
+      if (*fields[2] == '-' && !fields[2][1])
+        {
+          result = strtoul (fields[3], NULL, 10);
+          if (!result)
+            result = gpg_error (GPG_ERR_GENERAL);
+          domaininfo_put_akl_result (fields[0], mbox, NULL, result);
+        }
+      else
+        domaininfo_put_akl_result (fields[0], mbox, fields[2], 0);
+    }
+  else if (!domaininfo_get_akl_result (fields[0], mbox, fpr, &result))
+    err = gpg_error (GPG_ERR_NOT_FOUND);
+  else if (result)
+    {
+      snprintf (fpr, sizeof fpr, "- %u", result);
+      err = assuan_write_status (ctx, "AKL_RESULT", fpr);
+    }
+  else
+    err = assuan_write_status (ctx, "AKL_RESULT", fpr);
+
+ leave:
+  return leave_cmd (ctx, err);
+}
+
+
 /* A task to check whether DOMAIN supports WKD.  This is done by
  * checking whether the policy flags file can be read.  */
 static const char *
@@ -1492,6 +1608,101 @@ cmd_checkcrl (assuan_context_t ctx, char *line)
 }
 
 
+static const char hlp_ocspprefetch[] =
+  "OCSPPREFETCH [--force-default-responder] <fingerprints>\n"
+  "\n"
+  "Ask the OCSP responders for the status of all certificates given\n"
+  "by the space separated list of FINGERPRINTS (SHA-1 hash of the\n"
+  "entire X.509 certificate blob) using one request per responder.\n"
+  "The results are cached so that following CHECKOCSP or ISVALID\n"
+  "commands for these certificates are answered without asking the\n"
+  "responder again.  Certificates which are not yet known are\n"
+  "inquired using\n"
+  "\n"
+  "   INQUIRE SENDCERT <fingerprint>\n"
+  "\n"
+  "Errors for single certificates are not returned because the\n"
+  "following check will report them anyway.";
+static gpg_error_t
+cmd_ocspprefetch (assuan_context_t ctx, char *line)
+{
+  ctrl_t ctrl = assuan_get_pointer (ctx);
+  gpg_error_t err = 0;
+  unsigned char fprbuffer[20];
+  char hexfpr[2*20+19+1];
+  ksba_cert_t *certs = NULL;
+  int ncerts, i;
+  int force_default_responder;
+  char *p;
+  size_t n;
+
+  force_default_responder = has_option (line, "--force-default-responder");
+  line = skip_options (line);
+
+  if (!opt.allow_ocsp)
+    {
+      err = gpg_error (GPG_ERR_NOT_SUPPORTED);
+      goto leave;
+    }
+
+  /* Count the fingerprints to allocate the array.  */
+  for (ncerts=0, p=line; *p; ncerts++)
+    {
+      p += strcspn (p, " \t");
+      p += strspn (p, " \t");
+    }
+  if (!ncerts)
+    {
+      err = set_error (GPG_ERR_ASS_PARAMETER, "no fingerprint given");
+      goto leave;
+    }
+  certs = xtrycalloc (ncerts, sizeof *certs);
+  if (!certs)
+    {
+      err = gpg_error_from_syserror ();
+      goto leave;
+    }
+
+  for (i=0, p=line; *p && i < ncerts; )
+    {
+      n = strcspn (p, " \t");
+      if (n >= sizeof hexfpr)
+        {
+          err = set_error (GPG_ERR_ASS_PARAMETER, "invalid fingerprint");
+          goto leave;
+        }
+      memcpy (hexfpr, p, n);
+      hexfpr[n] = 0;
+      p += n;
+      p += strspn (p, " \t");
+
+      if (!get_fingerprint_from_line (hexfpr, fprbuffer))
+        {
+          err = set_error (GPG_ERR_ASS_PARAMETER, "invalid fingerprint");
+          goto leave;
+        }
+      certs[i] = get_cert_byfpr (fprbuffer);
+      if (!certs[i])
+        certs[i] = get_cert_local (ctrl, hexfpr);
+      if (certs[i])
+        i++;
+      else if (opt.verbose)
+        log_info ("certificate %s not available\n", hexfpr);
+    }
+
+  err = ocsp_prefetch (ctrl, certs, i, force_default_responder);
+
+ leave:
+  if (certs)
+    {
+      for (i=0; i < ncerts; i++)
+        ksba_cert_release (certs[i]);
+      xfree (certs);
+    }
+  return leave_cmd (ctx, err);
+}
+
+
 static const char hlp_checkocsp[] =
   "CHECKOCSP [--force-default-responder] [<fingerprint>]\n"
   "\n"
@@ -2397,10 +2608,11 @@ cmd_keyserver (assuan_context_t ctx, char *line)
 
 
 static const char hlp_ks_search[] =
-  "KS_SEARCH {<pattern>}\n"
+  "KS_SEARCH [--quick] [--limit=N] {<pattern>}\n"
   "\n"
   "Search the configured OpenPGP keyservers (see command KEYSERVER)\n"
-  "for keys matching PATTERN";
+  "for keys matching PATTERN.  With --limit only the first N keys\n"
+  "are returned.";
 static gpg_error_t
 cmd_ks_search (assuan_context_t ctx, char *line)
 {
@@ -2408,10 +2620,14 @@ cmd_ks_search (assuan_context_t ctx, char *line)
   gpg_error_t err;
   strlist_t list, sl;
   char *p;
+  const char *s;
+  unsigned int limit = 0;
   estream_t outfp;
 
   if (has_option (line, "--quick"))
     ctrl->timeout = opt.connect_quick_timeout;
+  if ((s = option_value (line, "--limit")))
+    limit = strtoul (s, NULL, 10);
   line = skip_options (line);
 
   /* Break the line down into an strlist.  Each pattern is
@@ -2449,7 +2665,7 @@ cmd_ks_search (assuan_context_t ctx, char *line)
   else
     {
       err = ks_action_search (ctrl, ctrl->server_local->keyservers,
-			      list, outfp);
+			      list, limit, outfp);
       es_fclose (outfp);
     }
 
@@ -2619,7 +2835,7 @@ cmd_ks_fetch (assuan_context_t ctx, char *line)
       ctrl->server_local->inhibit_data_logging = 1;
       ctrl->server_local->inhibit_data_logging_now = 0;
       ctrl->server_local->inhibit_data_logging_count = 0;
-      err = ks_action_fetch (ctrl, line, outfp);
+      err = ks_action_fetch (ctrl, line, outfp, NULL);
       es_fclose (outfp);
       ctrl->server_local->inhibit_data_logging = 0;
     }
@@ -2820,7 +3036,7 @@ static const char hlp_getinfo[] =
   "socket_name - Return the name of the socket\n"
   "session_id  - Return the current session_id\n"
   "workqueue   - Inspect the work queue\n"
-  "stats       - Print stats\n"
+  "stats       - Print stats and return command statistics\n"
   "getenv NAME - Return value of envvar NAME\n";
 static gpg_error_t
 cmd_getinfo (assuan_context_t ctx, char *line)
@@ -2891,9 +3107,18 @@ cmd_getinfo (assuan_context_t ctx, char *line)
     }
   else if (!strcmp (line, "stats"))
     {
+      char *string;
+
       cert_cache_print_stats (ctrl);
       domaininfo_print_stats (ctrl);
-      err = 0;
+      string = opstats_format ("dirmngr");
+      if (!string)
+        err = gpg_error_from_syserror ();
+      else
+        {
+          err = assuan_send_data (ctx, string, strlen (string));
+          xfree (string);
+        }
     }
   else if (!strncmp (line, "getenv", 6)
            && (line[6] == ' ' || line[6] == '\t' || !line[6]))
@@ -2980,10 +3205,12 @@ register_commands (assuan_context_t ctx)
   } table[] = {
     { "DNS_CERT",   cmd_dns_cert,   hlp_dns_cert },
     { "WKD_GET",    cmd_wkd_get,    hlp_wkd_get },
+    { "AKL_RESULT", cmd_akl_result, hlp_akl_result },
     { "LDAPSERVER", cmd_ldapserver, hlp_ldapserver },
     { "ISVALID",    cmd_isvalid,    hlp_isvalid },
     { "CHECKCRL",   cmd_checkcrl,   hlp_checkcrl },
     { "CHECKOCSP",  cmd_checkocsp,  hlp_checkocsp },
+    { "OCSPPREFETCH", cmd_ocspprefetch, hlp_ocspprefetch },
     { "LOOKUP",     cmd_lookup,     hlp_lookup },
     { "LOADCRL",    cmd_loadcrl,    hlp_loadcrl },
     { "LISTCRLS",   cmd_listcrls,   hlp_listcrls },
@@ -3015,6 +3242,30 @@ register_commands (assuan_context_t ctx)
 }
 
 
+/* This function is called by libassuan before a command is run.  */
+static gpg_error_t
+pre_cmd_notify (assuan_context_t ctx, const char *cmd)
+{
+  ctrl_t ctrl = assuan_get_pointer (ctx);
+
+  (void)cmd;
+
+  ctrl->server_local->cmd_start = opstats_now ();
+  return 0;
+}
+
+
+/* This function is called by libassuan after a command has been run.  */
+static void
+post_cmd_notify (assuan_context_t ctx, gpg_error_t err)
+{
+  ctrl_t ctrl = assuan_get_pointer (ctx);
+
+  opstats_record (assuan_get_command_name (ctx),
+                  ctrl->server_local->cmd_start, err);
+}
+
+
 /* Note that we do not reset the list of configured keyservers.  */
 static gpg_error_t
 reset_notify (assuan_context_t ctx, char *line)
@@ -3076,6 +3327,14 @@ start_command_handler (assuan_fd_t fd, unsigned int session_id)
       xfree (ctrl);
       return;
     }
+  rc = npth_mutex_init (&ctrl->server_local->status_lock, NULL);
+  if (rc)
+    {
+      log_error ("error initializing mutex: %s\n", strerror (rc));
+      xfree (ctrl->server_local);
+      xfree (ctrl);
+      return;
+    }
 
   dirmngr_init_default_ctrl (ctrl);
 
@@ -3134,6 +3393,8 @@ start_command_handler (assuan_fd_t fd, unsigned int session_id)
   assuan_set_hello_line (ctx, hello_line);
   assuan_register_option_handler (ctx, option_handler);
   assuan_register_reset_notify (ctx, reset_notify);
+  assuan_register_pre_cmd_notify (ctx, pre_cmd_notify);
+  assuan_register_post_cmd_notify (ctx, post_cmd_notify);
 
   ctrl->server_local->session_id = session_id;
 
@@ -3194,6 +3455,7 @@ start_command_handler (assuan_fd_t fd, unsigned int session_id)
       ctrl->ks_get_state = NULL;
 #endif
       release_ctrl_ocsp_certs (ctrl);
+      npth_mutex_destroy (&ctrl->server_local->status_lock);
       xfree (ctrl->server_local);
       dirmngr_deinit_default_ctrl (ctrl);
       xfree (ctrl);
@@ -3215,7 +3477,11 @@ dirmngr_status (ctrl_t ctrl, const char *keyword, ...)
 
   if (ctrl->server_local && (ctx = ctrl->server_local->assuan_ctx))
     {
+      if (npth_mutex_lock (&ctrl->server_local->status_lock))
+        log_fatal ("failed to acquire mutex\n");
       err = vprint_assuan_status_strings (ctx, keyword, arg_ptr);
+      if (npth_mutex_unlock (&ctrl->server_local->status_lock))
+        log_fatal ("failed to release mutex\n");
     }
 
   va_end (arg_ptr);
@@ -3235,6 +3501,8 @@ dirmngr_status_help (ctrl_t ctrl, const char *text)
       char buf[950], *p;
       size_t n;
 
+      if (npth_mutex_lock (&ctrl->server_local->status_lock))
+        log_fatal ("failed to acquire mutex\n");
       do
         {
           p = buf;
@@ -3247,6 +3515,8 @@ dirmngr_status_help (ctrl_t ctrl, const char *text)
           err = assuan_write_status (ctx, "#", buf);
         }
       while (!err && *text);
+      if (npth_mutex_unlock (&ctrl->server_local->status_lock))
+        log_fatal ("failed to release mutex\n");
     }
 
   return err;
@@ -3295,9 +3565,13 @@ dirmngr_status_printf (ctrl_t ctrl, const char *keyword,
   if (!ctrl || !ctrl->server_local || !(ctx = ctrl->server_local->assuan_ctx))
     return 0;
 
+  if (npth_mutex_lock (&ctrl->server_local->status_lock))
+    log_fatal ("failed to acquire mutex\n");
   va_start (arg_ptr, format);
   err = vprint_assuan_status (ctx, keyword, format, arg_ptr);
   va_end (arg_ptr);
+  if (npth_mutex_unlock (&ctrl->server_local->status_lock))
+    log_fatal ("failed to release mutex\n");
   return err;
 }
 
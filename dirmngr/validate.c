@@ -61,6 +61,42 @@ struct chain_item_s
 typedef struct chain_item_s *chain_item_t;
 
 
+/* The number of slots in the cache of good certificate signatures.  */
+#define SIG_CACHE_SIZE 1024
+
+/* The number of slots in the cache of validated chains.  */
+#define CHAIN_CACHE_SIZE 256
+
+/* The maximum time in seconds a cached chain validation is used.  */
+#define CHAIN_CACHE_TTL (30*60)
+
+/* An item of the cache of good certificate signatures.  Only good
+ * signatures are cached and they don't expire because a signature
+ * over a certificate is either good or not.  The cache is direct
+ * mapped using the first bytes of the fingerprint of the signed
+ * certificate.  Note that there is no need for locking as long as no
+ * npth function is called while accessing the cache.  */
+struct sig_cache_item_s
+{
+  unsigned char fpr[20];         /* The fingerprint of the certificate.  */
+  unsigned char issuer_fpr[20];  /* The fingerprint of its issuer.  */
+  unsigned int valid:1;          /* The item is in use.  */
+};
+static struct sig_cache_item_s sig_cache[SIG_CACHE_SIZE];
+
+/* An item of the cache of successful chain validations.  Items are
+ * direct mapped using the first byte of the fingerprint of the
+ * target certificate.  */
+struct chain_cache_item_s
+{
+  unsigned char fpr[20];  /* The fingerprint of the target certificate.  */
+  unsigned int flags;     /* The flags used for validate_cert_chain.  */
+  time_t expires;         /* The item is valid until this time; 0 for
+                           * an unused item.  */
+};
+static struct chain_cache_item_s chain_cache[CHAIN_CACHE_SIZE];
+
+
 /* A couple of constants with Object Identifiers.  */
 static const char oid_kp_serverAuth[]     = "1.3.6.1.5.5.7.3.1";
 static const char oid_kp_clientAuth[]     = "1.3.6.1.5.5.7.3.2";
@@ -329,6 +365,97 @@ check_revocations (ctrl_t ctrl, chain_item_t chain)
 }
 
 
+/* Return the sig_cache slot for the certificate with fingerprint FPR.  */
+static struct sig_cache_item_s *
+sig_cache_slot (const unsigned char *fpr)
+{
+  return sig_cache + (((fpr[0] << 8) | fpr[1]) % SIG_CACHE_SIZE);
+}
+
+
+/* Check the signature on CERT using the ISSUER_CERT like
+ * check_cert_sig but use the cache of good signatures.  */
+static gpg_error_t
+check_cert_sig_cached (ksba_cert_t issuer_cert, ksba_cert_t cert)
+{
+  gpg_error_t err;
+  unsigned char fpr[20], issuer_fpr[20];
+  struct sig_cache_item_s *item;
+
+  cert_compute_fpr (cert, fpr);
+  cert_compute_fpr (issuer_cert, issuer_fpr);
+  item = sig_cache_slot (fpr);
+  if (item->valid
+      && !memcmp (item->fpr, fpr, 20)
+      && !memcmp (item->issuer_fpr, issuer_fpr, 20))
+    {
+      if (DBG_X509)
+        log_debug ("certificate signature is good (cached)\n");
+      return 0;
+    }
+
+  err = check_cert_sig (issuer_cert, cert);
+  if (!err)
+    {
+      memcpy (item->fpr, fpr, 20);
+      memcpy (item->issuer_fpr, issuer_fpr, 20);
+      item->valid = 1;
+    }
+  return err;
+}
+
+
+/* Return true if the certificate with fingerprint FPR has been
+ * successfully validated with FLAGS not too long ago.  */
+static int
+chain_cache_lookup (const unsigned char *fpr, unsigned int flags)
+{
+  struct chain_cache_item_s *item = chain_cache + *fpr;
+
+  if (!item->expires || memcmp (item->fpr, fpr, 20) || item->flags != flags)
+    return 0;
+  if (item->expires <= gnupg_get_time ())
+    {
+      item->expires = 0;
+      return 0;
+    }
+  return 1;
+}
+
+
+/* Store the successful validation of the certificate with
+ * fingerprint FPR using FLAGS.  The result is kept at most until
+ * EXPTIME, the nearest expiration time in the chain.  */
+static void
+chain_cache_put (const unsigned char *fpr, unsigned int flags,
+                 const ksba_isotime_t exptime)
+{
+  struct chain_cache_item_s *item = chain_cache + *fpr;
+  time_t expires, tmp;
+
+  expires = gnupg_get_time () + CHAIN_CACHE_TTL;
+  if (*exptime && (tmp = isotime2epoch (exptime)) != (time_t)(-1)
+      && tmp < expires)
+    expires = tmp;
+
+  memcpy (item->fpr, fpr, 20);
+  item->flags = flags;
+  item->expires = expires;
+}
+
+
+/* Flush the cache of validated chains.  This needs to be called
+ * whenever new revocation information is available.  */
+void
+validate_flush_chain_cache (void)
+{
+  int i;
+
+  for (i=0; i < CHAIN_CACHE_SIZE; i++)
+    chain_cache[i].expires = 0;
+}
+
+
 /* Check whether CERT is a root certificate.  ISSUERDN and SUBJECTDN
    are the DNs already extracted by the caller from CERT.  Returns
    True if this is the case. */
@@ -426,6 +553,7 @@ validate_cert_chain (ctrl_t ctrl, ksba_cert_t cert, ksba_isotime_t r_exptime,
   int any_expired = 0;
   int any_no_policy_match = 0;
   chain_item_t chain;
+  unsigned char target_fpr[20];
 
   check_header_constants ();
 
@@ -461,7 +589,7 @@ validate_cert_chain (ctrl_t ctrl, ksba_cert_t cert, ksba_isotime_t r_exptime,
       else
         {
           /* If the validation is not older than 30 minutes we are ready. */
-          if (validated_at < gnupg_get_time () + (30*60))
+          if (validated_at + CHAIN_CACHE_TTL > gnupg_get_time ())
             {
               if (opt.verbose)
                 log_info ("certificate is good (cached)\n");
@@ -472,6 +600,16 @@ validate_cert_chain (ctrl_t ctrl, ksba_cert_t cert, ksba_isotime_t r_exptime,
         }
     }
 
+  /* The above works only if we get the same certificate object.
+   * Thus also look it up by fingerprint.  */
+  cert_compute_fpr (cert, target_fpr);
+  if (!r_exptime && chain_cache_lookup (target_fpr, flags))
+    {
+      if (opt.verbose)
+        log_info ("certificate is good (cached)\n");
+      return 0;
+    }
+
   /* Get the current time. */
   gnupg_get_isotime (current_time);
 
@@ -673,7 +811,7 @@ validate_cert_chain (ctrl_t ctrl, ksba_cert_t cert, ksba_isotime_t r_exptime,
       /* Now check the signature of the certificate.  FIXME: we should
        * delay this until later so that faked certificates can't be
        * turned into a DoS easily.  */
-      err = check_cert_sig (issuer_cert, subject_cert);
+      err = check_cert_sig_cached (issuer_cert, subject_cert);
       if (err)
         {
           log_error (_("certificate has a BAD signature"));
@@ -839,6 +977,8 @@ validate_cert_chain (ctrl_t ctrl, ksba_cert_t cert, ksba_isotime_t r_exptime,
               err = 0;
             }
         }
+
+      chain_cache_put (target_fpr, flags, exptime);
     }
 
   if (r_exptime)
@@ -57,6 +57,9 @@ gpg_error_t validate_cert_chain (ctrl_t ctrl,
                                  ksba_cert_t cert, ksba_isotime_t r_exptime,
                                  unsigned int flags, char **r_trust_anchor);
 
+/* Flush the cache of validated chains.  */
+void validate_flush_chain_cache (void);
+
 /* Return 0 if the certificate CERT is usable for certification.  */
 gpg_error_t check_cert_use_cert (ksba_cert_t cert);
 
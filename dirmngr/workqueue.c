@@ -22,10 +22,15 @@
 #include <config.h>
 #include <stdlib.h>
 #include <string.h>
+#include <npth.h>
 
 #include "dirmngr.h"
 
 
+/* The maximum number of worker threads running tasks.  */
+#define MAX_WORKERS 2
+
+
 /* An object for one item in the workqueue.  */
 struct wqitem_s
 {
@@ -34,6 +39,13 @@ struct wqitem_s
   /* This flag is set if the task requires network access.  */
   unsigned int need_network:1;
 
+  /* This flag is set if the session which created this task has
+   * terminated and thus the task may run.  */
+  unsigned int session_done:1;
+
+  /* The priority of the task; see WQ_PRIO_*.  */
+  int priority;
+
   /* The id of the session which created this task.  If this is 0 the
    * task is not associated with a specific session.  */
   unsigned int session_id;
@@ -47,53 +59,239 @@ struct wqitem_s
 typedef struct wqitem_s *wqitem_t;
 
 
-/* The workque is a simple linked list.  */
+/* The workque is a simple linked list sorted by priority.  Tasks
+ * with the same priority are kept in the order they were added.  Note
+ * that we don't need a lock as long as no npth function is called
+ * while walking or modifying the list.  */
 static wqitem_t workqueue;
 
+/* The list of tasks currently run by a worker.  */
+static wqitem_t running_tasks;
+
+/* The number of active worker threads.  */
+static unsigned int active_workers;
+
+/* Set if global tasks requiring the network may be run.  This is
+ * updated by workqueue_run_global_tasks.  */
+static int network_allowed;
+
+/* Some statistics.  */
+static struct {
+  unsigned int max_depth;   /* Maximum number of queued tasks seen.  */
+  unsigned long added;      /* Number of tasks added.  */
+  unsigned long duplicates; /* Number of tasks not added as duplicates.  */
+  unsigned long completed;  /* Number of tasks run.  */
+} wqstats;
+
+
+/* Insert ITEM into the WORKQUEUE according to its priority.  */
+static void
+insert_item (wqitem_t item)
+{
+  wqitem_t *itemptr;
+
+  for (itemptr = &workqueue; *itemptr; itemptr = &(*itemptr)->next)
+    if ((*itemptr)->priority > item->priority)
+      break;
+  item->next = *itemptr;
+  *itemptr = item;
+}
+
+
+/* Return true if the task (FUNC,ARGS) for SESSION_ID is found in the
+ * list LIST.  */
+static int
+find_task (wqitem_t list, wqtask_t func, const char *args,
+           unsigned int session_id)
+{
+  for (; list; list = list->next)
+    if (list->func == func && list->session_id == session_id
+        && !strcmp (list->args, args))
+      return 1;
+  return 0;
+}
+
 
 /* Dump the queue using Assuan status comments.  */
 void
 workqueue_dump_queue (ctrl_t ctrl)
 {
-  wqitem_t saved_workqueue;
-  wqitem_t item;
-  unsigned int count;
+  wqitem_t saved_workqueue, saved_running;
+  wqitem_t item, next;
+  unsigned int count, nrunning;
 
   /* Temporarily detach the entire workqueue so that other threads don't
    * get into our way.  */
   saved_workqueue = workqueue;
   workqueue = NULL;
+  saved_running = running_tasks;
 
   for (count=0, item = saved_workqueue; item; item = item->next)
     count++;
+  for (nrunning=0, item = saved_running; item; item = item->next)
+    nrunning++;
 
   dirmngr_status_helpf (ctrl, "wq: number of entries: %u", count);
+  dirmngr_status_helpf (ctrl, "wq: running: %u  workers: %u/%u",
+                        nrunning, active_workers, MAX_WORKERS);
+  dirmngr_status_helpf (ctrl, "wq: max entries: %u  added: %lu"
+                        "  duplicates: %lu  completed: %lu",
+                        wqstats.max_depth, wqstats.added,
+                        wqstats.duplicates, wqstats.completed);
   for (item = saved_workqueue; item; item = item->next)
-    dirmngr_status_helpf (ctrl, "wq: sess=%u net=%d %s(\"%.100s%s\")",
-                          item->session_id, item->need_network,
+    dirmngr_status_helpf (ctrl, "wq: prio=%d sess=%u%s net=%d %s(\"%.100s%s\")",
+                          item->priority, item->session_id,
+                          item->session_done? "(done)":"",
+                          item->need_network,
                           item->func? item->func (NULL, NULL): "nop",
                           item->args, strlen (item->args) > 100? "[...]":"");
 
-  /* Restore the workqueue.  Actually we append the saved queue to
+  /* Restore the workqueue.  Actually we merge the saved queue to
    * handle a possibly updated workqueue.  */
-  if (!(item=workqueue))
-    workqueue = saved_workqueue;
-  else
+  for (item = saved_workqueue; item; item = next)
+    {
+      next = item->next;
+      insert_item (item);
+    }
+}
+
+
+/* Run the task described by ITEM.  ITEM must have been moved to
+ * RUNNING_TASKS; it is removed from there and released.  */
+static void
+run_a_task (ctrl_t ctrl, wqitem_t item)
+{
+  wqitem_t *itemptr;
+
+  if (opt.verbose)
+    log_info ("session %u: running %s(\"%s%s\")\n",
+              item->session_id,
+              item->func? item->func (NULL, NULL): "nop",
+              item->args, strlen (item->args) > 100? "[...]":"");
+  if (item->func)
+    item->func (ctrl, item->args);
+
+  for (itemptr = &running_tasks; *itemptr; itemptr = &(*itemptr)->next)
+    if (*itemptr == item)
+      {
+        *itemptr = item->next;
+        break;
+      }
+  wqstats.completed++;
+  xfree (item);
+}
+
+
+/* Detach and return the first task which may run now.  The task is
+ * moved to the list of running tasks.  Returns NULL if no task is
+ * ready.  */
+static wqitem_t
+get_next_task (void)
+{
+  wqitem_t *itemptr, item;
+
+  for (itemptr = &workqueue; (item = *itemptr); itemptr = &item->next)
+    {
+      if (item->session_id)
+        {
+          if (item->session_done)
+            break;
+        }
+      else if (!item->need_network || network_allowed)
+        break;
+    }
+  if (!item)
+    return NULL;
+
+  *itemptr = item->next;
+  item->next = running_tasks;
+  running_tasks = item;
+  return item;
+}
+
+
+/* The thread function of a worker.  A worker runs tasks until no more
+ * tasks are ready.  */
+static void *
+worker_thread (void *arg)
+{
+  struct server_control_s ctrlbuf;
+  wqitem_t item;
+
+  (void)arg;
+
+  memset (&ctrlbuf, 0, sizeof ctrlbuf);
+  dirmngr_init_default_ctrl (&ctrlbuf);
+
+  while ((item = get_next_task ()))
+    run_a_task (&ctrlbuf, item);
+
+  dirmngr_deinit_default_ctrl (&ctrlbuf);
+  active_workers--;
+  return NULL;
+}
+
+
+/* Start worker threads for tasks which are ready to run.  */
+static void
+start_workers (void)
+{
+  wqitem_t item;
+  unsigned int nready;
+  npth_attr_t tattr;
+  npth_t thread;
+  int err;
+
+  nready = 0;
+  for (item = workqueue; item; item = item->next)
+    if (item->session_id? item->session_done
+        /**/            : (!item->need_network || network_allowed))
+      nready++;
+
+  if (!nready || active_workers >= MAX_WORKERS || active_workers >= nready)
+    return;
+
+  err = npth_attr_init (&tattr);
+  if (err)
     {
-      while (item->next)
-        item = item->next;
-      item->next = saved_workqueue;
+      log_error ("error preparing worker thread: %s\n", strerror (err));
+      return;
     }
+  npth_attr_setdetachstate (&tattr, NPTH_CREATE_DETACHED);
+  while (active_workers < MAX_WORKERS && active_workers < nready)
+    {
+      /* Increment before creating the thread because the new thread
+       * may terminate before npth_create returns.  */
+      active_workers++;
+      err = npth_create (&thread, &tattr, worker_thread, NULL);
+      if (err)
+        {
+          active_workers--;
+          log_error ("error spawning worker thread: %s\n", strerror (err));
+          break;
+        }
+    }
+  npth_attr_destroy (&tattr);
 }
 
 
-/* Append the task (FUNC,ARGS) to the work queue.  FUNC shall return
- * its name when called with (NULL, NULL).  */
+/* Add the task (FUNC,ARGS) to the work queue.  FUNC shall return its
+ * name when called with (NULL, NULL).  PRIORITY is one of the
+ * WQ_PRIO_* values.  If the same task for the same session is already
+ * queued or running, the task is not added again.  */
 gpg_error_t
 workqueue_add_task (wqtask_t func, const char *args, unsigned int session_id,
-                    int need_network)
+                    int need_network, int priority)
 {
-  wqitem_t item, wi;
+  wqitem_t item;
+  unsigned int count;
+
+  if (find_task (workqueue, func, args, session_id)
+      || find_task (running_tasks, func, args, session_id))
+    {
+      wqstats.duplicates++;
+      return 0;
+    }
 
   item = xtrycalloc (1, sizeof *item + strlen (args));
   if (!item)
@@ -102,113 +300,52 @@ workqueue_add_task (wqtask_t func, const char *args, unsigned int session_id,
   item->func = func;
   item->session_id = session_id;
   item->need_network = !!need_network;
+  item->priority = priority;
 
-  if (!(wi=workqueue))
-    workqueue = item;
-  else
-    {
-      while (wi->next)
-        wi = wi->next;
-      wi->next = item;
-    }
-  return 0;
-}
-
+  insert_item (item);
 
-/* Run the task described by ITEM.  ITEM must have been detached from
- * the workqueue; its ownership is transferred to this function.  */
-static void
-run_a_task (ctrl_t ctrl, wqitem_t item)
-{
-  log_assert (!item->next);
-
-  if (opt.verbose)
-    log_info ("session %u: running %s(\"%s%s\")\n",
-              item->session_id,
-              item->func? item->func (NULL, NULL): "nop",
-              item->args, strlen (item->args) > 100? "[...]":"");
-  if (item->func)
-    item->func (ctrl, item->args);
+  wqstats.added++;
+  for (count=0, item = workqueue; item; item = item->next)
+    count++;
+  if (count > wqstats.max_depth)
+    wqstats.max_depth = count;
 
-  xfree (item);
+  return 0;
 }
 
 
 /* Run tasks not associated with a session.  This is called from the
  * ticker every few minutes.  If WITH_NETWORK is not set tasks which
- * require the network are not run.  */
+ * require the network are not run.  The tasks are run by worker
+ * threads; thus this function returns immediately.  */
 void
 workqueue_run_global_tasks (ctrl_t ctrl, int with_network)
 {
-  wqitem_t item, prev;
+  (void)ctrl;
 
-  with_network = !!with_network;
+  network_allowed = !!with_network;
 
   if (opt.verbose)
     log_info ("running scheduled tasks%s\n", with_network?" (with network)":"");
 
-  for (;;)
-    {
-      prev = NULL;
-      for (item = workqueue; item; prev = item, item = item->next)
-        if (!item->session_id
-            && (!item->need_network || (item->need_network && with_network)))
-          break;
-      if (!item)
-        break;  /* No more tasks to run.  */
-
-      /* Detach that item from the workqueue.  */
-      if (!prev)
-        workqueue = item->next;
-      else
-        prev->next = item->next;
-      item->next = NULL;
-
-      /* Run the task.  */
-      run_a_task (ctrl, item);
-    }
+  start_workers ();
 }
 
 
 /* Run tasks scheduled for running after a session.  Those tasks are
- * identified by the SESSION_ID.  */
+ * identified by the SESSION_ID.  They are handed over to the worker
+ * threads.  */
 void
 workqueue_run_post_session_tasks (unsigned int session_id)
 {
-  struct server_control_s ctrlbuf;
-  ctrl_t ctrl = NULL;
-  wqitem_t item, prev;
+  wqitem_t item;
 
   if (!session_id)
     return;
 
-  for (;;)
-    {
-      prev = NULL;
-      for (item = workqueue; item; prev = item, item = item->next)
-        if (item->session_id == session_id)
-          break;
-      if (!item)
-        break;  /* No more tasks for this session.  */
-
-      /* Detach that item from the workqueue.  */
-      if (!prev)
-        workqueue = item->next;
-      else
-        prev->next = item->next;
-      item->next = NULL;
-
-      /* Create a CTRL object the first time we need it.  */
-      if (!ctrl)
-        {
-          memset (&ctrlbuf, 0, sizeof ctrlbuf);
-          ctrl = &ctrlbuf;
-          dirmngr_init_default_ctrl (ctrl);
-        }
-
-      /* Run the task.  */
-      run_a_task (ctrl, item);
-    }
+  for (item = workqueue; item; item = item->next)
+    if (item->session_id == session_id)
+      item->session_done = 1;
 
-  dirmngr_deinit_default_ctrl (ctrl);
+  start_workers ();
 }
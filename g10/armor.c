@@ -37,6 +37,9 @@
 
 #define MAX_LINELEN 20000
 
+/* The number of complete lines encoded before writing them out.  */
+#define ARMOR_WRITE_LINES 64
+
 static const byte bintoasc[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZ"
                                "abcdefghijklmnopqrstuvwxyz"
                                "0123456789+/";
@@ -1163,11 +1166,10 @@ armor_output_buf_as_radix64 (armor_filter_context_t *afx, IOBUF a,
 			     byte *buf, size_t size)
 {
   byte radbuf[sizeof (afx->radbuf)];
-  byte outbuf[64 + sizeof (afx->eol)];
+  byte outbuf[4 + sizeof (afx->eol)];
   unsigned int eollen = strlen (afx->eol);
-  u32 in, in2;
+  u32 in;
   int idx, idx2;
-  int i;
 
   idx = afx->idx;
   idx2 = afx->idx2;
@@ -1206,39 +1208,25 @@ armor_output_buf_as_radix64 (armor_filter_context_t *afx, IOBUF a,
 
   if (size >= (64/4)*3)
     {
-      /* preload eol to outbuf buffer */
-      memcpy (outbuf + 64, afx->eol, sizeof(afx->eol));
+      byte lines[ARMOR_WRITE_LINES * (64 + sizeof (afx->eol))];
+      size_t nlines;
 
+      /* idx and idx2 == 0: Encode many complete lines at once and
+       * write them with one call.  Note that pgp doesn't like 72
+       * characters per line.  */
       do
 	{
-	  /* idx and idx2 == 0 */
-
-	  for (i = 0; i < (64/8); i++)
-	    {
-	      in = (u32)buf[0] << (2 * 8);
-	      in |= (u32)buf[1] << (1 * 8);
-	      in |= (u32)buf[2] << (0 * 8);
-	      in2 = (u32)buf[3] << (2 * 8);
-	      in2 |= (u32)buf[4] << (1 * 8);
-	      in2 |= (u32)buf[5] << (0 * 8);
-	      outbuf[i*8+0] = bintoasc[(in >> 18) & 077];
-	      outbuf[i*8+1] = bintoasc[(in >> 12) & 077];
-	      outbuf[i*8+2] = bintoasc[(in >> 6) & 077];
-	      outbuf[i*8+3] = bintoasc[(in >> 0) & 077];
-	      outbuf[i*8+4] = bintoasc[(in2 >> 18) & 077];
-	      outbuf[i*8+5] = bintoasc[(in2 >> 12) & 077];
-	      outbuf[i*8+6] = bintoasc[(in2 >> 6) & 077];
-	      outbuf[i*8+7] = bintoasc[(in2 >> 0) & 077];
-	      buf+=6;
-	      size-=6;
-	    }
-
-	  /* pgp doesn't like 72 here */
-	  iobuf_write (a, outbuf, 64 + eollen);
+	  nlines = size / ((64/4)*3);
+	  if (nlines > ARMOR_WRITE_LINES)
+	    nlines = ARMOR_WRITE_LINES;
+	  iobuf_write (a, lines, b64enc_lines (buf, nlines,
+					       (const char *)afx->eol, lines));
+	  buf += nlines * ((64/4)*3);
+	  size -= nlines * ((64/4)*3);
 	}
       while (size >= (64/4)*3);
 
-      /* restore eol for tail handling */
+      /* preload eol to outbuf buffer for tail handling */
       if (size)
 	memcpy (outbuf + 4, afx->eol, sizeof (afx->eol));
     }
@@ -1302,16 +1290,19 @@ armor_filter( void *opaque, int control,
 	n = 0;
 	if( afx->buffer_len ) {
             /* Copy the data from AFX->BUFFER to BUF.  */
-	    for(; n < size && afx->buffer_pos < afx->buffer_len; n++ )
-		buf[n++] = afx->buffer[afx->buffer_pos++];
+	    n = afx->buffer_len - afx->buffer_pos;
+	    if( n > size )
+		n = size;
+	    memcpy (buf, afx->buffer + afx->buffer_pos, n);
+	    afx->buffer_pos += n;
 	    if( afx->buffer_pos >= afx->buffer_len )
 		afx->buffer_len = 0;
 	}
         /* If there is still space in BUF, read directly into it.  */
-	for(; n < size; n++ ) {
-	    if( (c=iobuf_get(a)) == -1 )
-		break;
-	    buf[n] = c & 0xff;
+	if( n < size ) {
+	    int nread = iobuf_read (a, buf + n, size - n);
+	    if( nread > 0 )
+		n += nread;
 	}
 	if( !n )
             /* We didn't get any data.  EOF.  */
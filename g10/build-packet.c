@@ -79,20 +79,106 @@ ctb_pkttype (int ctb)
 }
 
 
+/* Return the number of bytes required to store the MPIs of the
+ * array A with N elements.  */
+static size_t
+estimate_mpis_size (gcry_mpi_t *a, int n)
+{
+  size_t size = 0;
+  int i;
+
+  for (i=0; i < n; i++)
+    if (a[i])
+      size += 2 + (gcry_mpi_get_nbits (a[i]) + 7) / 8;
+  return size;
+}
+
+
+/* Return an estimation of the size of the image which
+ * build_keyblock_image creates for KEYBLOCK.  The value is meant to
+ * allocate the buffer in one go; it is not required to be exact.  */
+static size_t
+estimate_keyblock_image_size (kbnode_t keyblock)
+{
+  kbnode_t node;
+  size_t size = 0;
+
+  for (node = keyblock; node; node = node->next)
+    {
+      /* Space for the header and the ring trust packet.  */
+      size += 16;
+      switch (node->pkt->pkttype)
+        {
+        case PKT_PUBLIC_KEY:
+        case PKT_PUBLIC_SUBKEY:
+          {
+            PKT_public_key *pk = node->pkt->pkt.public_key;
+
+            size += 16 + estimate_mpis_size
+              (pk->pkey, pubkey_get_npkey (pk->pubkey_algo));
+            if (pk->updateurl)
+              size += strlen (pk->updateurl);
+          }
+          break;
+        case PKT_SIGNATURE:
+          {
+            PKT_signature *sig = node->pkt->pkt.signature;
+
+            size += 16 + estimate_mpis_size
+              (sig->data, pubkey_get_nsig (sig->pubkey_algo));
+            if (sig->hashed)
+              size += sig->hashed->len;
+            if (sig->unhashed)
+              size += sig->unhashed->len;
+          }
+          break;
+        case PKT_USER_ID:
+        case PKT_ATTRIBUTE:
+          {
+            PKT_user_id *uid = node->pkt->pkt.user_id;
+
+            size += uid->attrib_data? uid->attrib_len : uid->len;
+            if (uid->updateurl)
+              size += strlen (uid->updateurl);
+          }
+          break;
+        default:
+          break;
+        }
+    }
+
+  return size;
+}
+
+
 /* Build a keyblock image from KEYBLOCK.  Returns 0 on success and
  * only then stores a new iobuf object at R_IOBUF; the returned iobuf
  * can be access with the iobuf_get_temp_buffer and
- * iobuf_get_temp_length macros.  */
+ * iobuf_get_temp_length macros.  If R_IOBUF already points to an
+ * iobuf created by a previous call, that iobuf is reset and reused;
+ * it is then not released on error.  The caller must initialize
+ * R_IOBUF to NULL to request a new iobuf.  */
 gpg_error_t
 build_keyblock_image (kbnode_t keyblock, iobuf_t *r_iobuf)
 {
   gpg_error_t err;
   iobuf_t iobuf;
   kbnode_t kbctx, node;
+  size_t size;
+
+  /* Allocate the buffer only once instead of growing it in steps of
+   * the iobuf buffer size for large keyblocks.  */
+  size = estimate_keyblock_image_size (keyblock);
+  if (size < 1024)
+    size = 1024;
+  if (*r_iobuf)
+    {
+      iobuf = *r_iobuf;
+      iobuf_temp_reset (iobuf, size);
+    }
+  else
+    iobuf = iobuf_alloc (IOBUF_OUTPUT_TEMP, size);
 
-  *r_iobuf = NULL;
-
-  iobuf = iobuf_temp ();
   for (kbctx = NULL; (node = walk_kbnode (keyblock, &kbctx, 0));)
     {
       /* Make sure to use only packets valid on a keyblock.  */
@@ -112,7 +198,8 @@ build_keyblock_image (kbnode_t keyblock, iobuf_t *r_iobuf)
       err = build_packet_and_meta (iobuf, node->pkt);
       if (err)
         {
-          iobuf_close (iobuf);
+          if (iobuf != *r_iobuf)
+            iobuf_close (iobuf);
           return err;
         }
     }
@@ -2260,6 +2260,63 @@ agent_probe_secret_key (ctrl_t ctrl, PKT_public_key *pk)
   return 1;
 }
 
+/* If we have not yet issued a "HAVEKEY --list" do that now and store
+ * the keygrips of all secret keys in CTRL.  We use a more or less
+ * arbitray limit of 1000 keys.  Errors are ignored; the caller needs
+ * to check whether CTRL->SECRET_KEYGRIPS is set.  The agent must
+ * already be running.  */
+static void
+load_secret_keygrips (ctrl_t ctrl)
+{
+  gpg_error_t err;
+  membuf_t data;
+
+  if (!ctrl || ctrl->secret_keygrips || ctrl->no_more_secret_keygrips)
+    return;
+
+  init_membuf (&data, 4096);
+  err = assuan_transact (agent_ctx, "HAVEKEY --list=1000",
+                         put_membuf_cb, &data,
+                         NULL, NULL, NULL, NULL);
+  if (err)
+    xfree (get_membuf (&data, NULL));
+  else
+    {
+      ctrl->secret_keygrips = get_membuf (&data,
+                                          &ctrl->secret_keygrips_len);
+      if (!ctrl->secret_keygrips)
+        err = gpg_error_from_syserror ();
+      if ((ctrl->secret_keygrips_len % 20))
+        {
+          err = gpg_error (GPG_ERR_INV_DATA);
+          xfree (ctrl->secret_keygrips);
+          ctrl->secret_keygrips = NULL;
+        }
+    }
+  if (err)
+    log_info ("problem with fast path key listing: %s - ignored\n",
+              gpg_strerror (err));
+  /* We want to do this only once.  */
+  ctrl->no_more_secret_keygrips = 1;
+}
+
+
+/* Return true if GRIP is in the list of secret keygrips in CTRL.  */
+static int
+have_secret_keygrip (ctrl_t ctrl, const unsigned char *grip)
+{
+  const unsigned char *s;
+  unsigned int n;
+
+  for (s=ctrl->secret_keygrips, n = 0;
+       n < ctrl->secret_keygrips_len;
+       s += 20, n += 20)
+    if (!memcmp (s, grip, 20))
+      return 1;
+  return 0;
+}
+
+
 /* Ask the agent whether a secret key is available for any of the
    keys (primary or sub) in KEYBLOCK.  Returns 0 if available.  */
 gpg_error_t
@@ -2271,47 +2328,12 @@ agent_probe_any_secret_key (ctrl_t ctrl, kbnode_t keyblock)
   kbnode_t kbctx, node;
   int nkeys;  /* (always zero in secret_keygrips mode)  */
   unsigned char grip[KEYGRIP_LEN];
-  const unsigned char *s;
-  unsigned int n;
 
   err = start_agent (ctrl, 0);
   if (err)
     return err;
 
-  /* If we have not yet issued a "HAVEKEY --list" do that now.  We use
-   * a more or less arbitray limit of 1000 keys.  */
-  if (ctrl && !ctrl->secret_keygrips && !ctrl->no_more_secret_keygrips)
-    {
-      membuf_t data;
-
-      init_membuf (&data, 4096);
-      err = assuan_transact (agent_ctx, "HAVEKEY --list=1000",
-                             put_membuf_cb, &data,
-                             NULL, NULL, NULL, NULL);
-      if (err)
-        xfree (get_membuf (&data, NULL));
-      else
-        {
-          ctrl->secret_keygrips = get_membuf (&data,
-                                              &ctrl->secret_keygrips_len);
-          if (!ctrl->secret_keygrips)
-            err = gpg_error_from_syserror ();
-          if ((ctrl->secret_keygrips_len % 20))
-            {
-              err = gpg_error (GPG_ERR_INV_DATA);
-              xfree (ctrl->secret_keygrips);
-              ctrl->secret_keygrips = NULL;
-            }
-        }
-      if (err)
-        {
-          log_info ("problem with fast path key listing: %s - ignored\n",
-                    gpg_strerror (err));
-          err = 0;
-        }
-      /* We want to do this only once.  */
-      ctrl->no_more_secret_keygrips = 1;
-    }
+  load_secret_keygrips (ctrl);
 
   err = gpg_error (GPG_ERR_NO_SECKEY); /* Just in case no key was
                                           found in KEYBLOCK.  */
@@ -2328,13 +2350,8 @@ agent_probe_any_secret_key (ctrl_t ctrl, kbnode_t keyblock)
             err = keygrip_from_pk (node->pkt->pkt.public_key, grip);
             if (err)
               return err;
-            for (s=ctrl->secret_keygrips, n = 0;
-                 n < ctrl->secret_keygrips_len;
-                 s += 20, n += 20)
-              {
-                if (!memcmp (s, grip, 20))
-                  return 0;
-              }
+            if (have_secret_keygrip (ctrl, grip))
+              return 0;
             err = gpg_error (GPG_ERR_NO_SECKEY);
             /* Keep on looping over the keyblock.  Never bump nkeys.  */
           }
@@ -2368,6 +2385,146 @@ agent_probe_any_secret_key (ctrl_t ctrl, kbnode_t keyblock)
 }
 
 
+/* Ask the agent which of the NPKS public keys in PKS have a secret
+ * key.  R_AVAIL is an array of NPKS elements which receives true for
+ * each available secret key.  NULL elements of PKS are skipped.  With
+ * a CTRL this uses a single "HAVEKEY --list" for all keys (and for
+ * later calls) instead of one round trip per key.  */
+gpg_error_t
+agent_probe_secret_keys (ctrl_t ctrl, PKT_public_key **pks, int npks,
+                         char *r_avail)
+{
+  gpg_error_t err;
+  char line[ASSUAN_LINELENGTH];
+  unsigned char grip[KEYGRIP_LEN];
+  int i;
+
+  memset (r_avail, 0, npks);
+
+  err = start_agent (ctrl, 0);
+  if (err)
+    return err;
+
+  load_secret_keygrips (ctrl);
+
+  for (i=0; i < npks; i++)
+    {
+      if (!pks[i])
+        continue;
+      err = keygrip_from_pk (pks[i], grip);
+      if (err)
+        return err;
+      if (ctrl && ctrl->secret_keygrips)
+        r_avail[i] = have_secret_keygrip (ctrl, grip);
+      else
+        {
+          strcpy (line, "HAVEKEY ");
+          bin2hex (grip, 20, line + 8);
+          r_avail[i] = !assuan_transact (agent_ctx, line, NULL, NULL,
+                                         NULL, NULL, NULL, NULL);
+        }
+    }
+
+  return 0;
+}
+
+
+
+/* Status callback for load_secret_keyinfo.  */
+static gpg_error_t
+keyinfo_list_status_cb (void *opaque, const char *line)
+{
+  membuf_t *data = opaque;
+  unsigned char item[KEYGRIP_LEN+1];
+  const char *fields[9];
+  char *s;
+
+  if ((s = has_leading_keyword (line, "KEYINFO"))
+      && split_fields (s, fields, DIM (fields)) == 9
+      && hex2bin (fields[0], item, KEYGRIP_LEN) == 2*KEYGRIP_LEN)
+    {
+      /* See agent_secret_key_rank for the values.  */
+      if (fields[1][0] == 'T')
+        item[KEYGRIP_LEN] = fields[8][0] == 'A'? 3 : 1;
+      else if (fields[5][0] == 'C')
+        item[KEYGRIP_LEN] = 5;
+      else if (fields[4][0] == '1')
+        item[KEYGRIP_LEN] = 4;
+      else
+        item[KEYGRIP_LEN] = 2;
+      put_membuf (data, item, sizeof item);
+    }
+  return 0;
+}
+
+
+/* If we have not yet issued a "KEYINFO --list" do that now and store
+ * the keygrips of all secret keys along with their rank in CTRL.
+ * Errors are ignored; the caller needs to check whether
+ * CTRL->SECRET_KEYINFO is set.  The agent must already be running.  */
+static void
+load_secret_keyinfo (ctrl_t ctrl)
+{
+  gpg_error_t err;
+  membuf_t data;
+
+  if (!ctrl || ctrl->secret_keyinfo || ctrl->no_more_secret_keyinfo)
+    return;
+
+  init_membuf (&data, 4096);
+  err = assuan_transact (agent_ctx, "KEYINFO --list",
+                         NULL, NULL, NULL, NULL,
+                         keyinfo_list_status_cb, &data);
+  if (err)
+    xfree (get_membuf (&data, NULL));
+  else
+    {
+      ctrl->secret_keyinfo = get_membuf (&data, &ctrl->secret_keyinfo_len);
+      if (!ctrl->secret_keyinfo)
+        err = gpg_error_from_syserror ();
+    }
+  if (err)
+    log_info ("problem with fast path key listing: %s - ignored\n",
+              gpg_strerror (err));
+  /* We want to do this only once.  */
+  ctrl->no_more_secret_keyinfo = 1;
+}
+
+
+/* Return a rank telling how likely the secret key for PK can be used
+ * without user interaction; a higher value is better:
+ *
+ *   5 = On-disk key without protection.
+ *   4 = On-disk key with a cached passphrase.
+ *   3 = On-card key of an available card.
+ *   2 = On-disk key with protection.
+ *   1 = On-card key of a card which is not available.
+ *   0 = No secret key or an error.
+ *
+ * All secret keys are retrieved from the agent with the first call;
+ * later calls do not need a round trip.  */
+int
+agent_secret_key_rank (ctrl_t ctrl, PKT_public_key *pk)
+{
+  unsigned char grip[KEYGRIP_LEN];
+  const unsigned char *s;
+  size_t n;
+
+  if (!ctrl || start_agent (ctrl, 0))
+    return 0;
+  load_secret_keyinfo (ctrl);
+  if (!ctrl->secret_keyinfo || keygrip_from_pk (pk, grip))
+    return 0;
+
+  for (s=ctrl->secret_keyinfo, n = 0;
+       n + KEYGRIP_LEN + 1 <= ctrl->secret_keyinfo_len;
+       s += KEYGRIP_LEN + 1, n += KEYGRIP_LEN + 1)
+    if (!memcmp (s, grip, KEYGRIP_LEN))
+      return s[KEYGRIP_LEN];
+  return 0;
+}
+
+
 
 /* Return the serial number for a secret key.  If the returned serial
    number is NULL, the key is not stored on a smartcard.  Caller needs
@@ -190,6 +190,14 @@ int agent_probe_secret_key (ctrl_t ctrl, PKT_public_key *pk);
    keys (primary or sub) in KEYBLOCK.  Returns 0 if available.  */
 gpg_error_t agent_probe_any_secret_key (ctrl_t ctrl, kbnode_t keyblock);
 
+/* Check which of the given public keys have a secret key.  */
+gpg_error_t agent_probe_secret_keys (ctrl_t ctrl, PKT_public_key **pks,
+                                     int npks, char *r_avail);
+
+/* Return how likely the secret key for PK can be used without user
+   interaction.  */
+int agent_secret_key_rank (ctrl_t ctrl, PKT_public_key *pk);
+
 
 /* Return infos about the secret key with HEXKEYGRIP.  */
 gpg_error_t agent_get_keyinfo (ctrl_t ctrl, const char *hexkeygrip,
@@ -28,6 +28,7 @@
 #ifdef HAVE_LOCALE_H
 # include <locale.h>
 #endif
+#include <npth.h>
 
 #include "gpg.h"
 #include <assuan.h>
@@ -120,6 +121,28 @@ struct dirmngr_local_s
 };
 
 
+/* A Dirmngr command started in advance by one of the
+ * gpg_dirmngr_prefetch_* functions.  The command is run by its own
+ * thread over a private connection and its data and status lines
+ * are recorded.  The next regular function running the same command
+ * takes this result instead of asking the Dirmngr again.  The
+ * objects are linked to CTRL->DIRMNGR_PREFETCH.  */
+struct dirmngr_prefetch_s
+{
+  struct dirmngr_prefetch_s *next;
+  npth_mutex_t lock;
+  npth_cond_t cond;
+  unsigned int done:1;       /* The command has been run.            */
+  unsigned int abandoned:1;  /* Nobody will take the result.         */
+  ctrl_t ctrl;
+  char *keyserver;           /* The override keyserver or NULL.      */
+  gpg_error_t err;           /* The result of the command.           */
+  membuf_t data;             /* The received data.                   */
+  strlist_t status;          /* The received status lines.           */
+  char line[1];              /* The command.                         */
+};
+
+
 
 /* Deinitialize all session data of dirmngr pertaining to CTRL.  */
 void
@@ -127,6 +150,7 @@ gpg_dirmngr_deinit_session_data (ctrl_t ctrl)
 {
   dirmngr_local_t dml;
 
+  gpg_dirmngr_prefetch_release (ctrl);
   while ((dml = ctrl->dirmngr_local))
     {
       ctrl->dirmngr_local = dml->next;
@@ -228,6 +252,37 @@ create_context (ctrl_t ctrl, assuan_context_t *r_ctx)
 }
 
 
+/* Set all configured keyservers for the session CTX.  We clear
+ * existing keyservers so that any keyserver configured in GPG
+ * overrides keyservers possibly still configured in Dirmngr for the
+ * session (Note that the keyserver list of a session in Dirmngr
+ * survives a RESET.  */
+static gpg_error_t
+send_keyservers (assuan_context_t ctx)
+{
+  gpg_error_t err;
+  keyserver_spec_t ksi;
+  char *line;
+
+  for (ksi = opt.keyserver; ksi; ksi = ksi->next)
+    {
+      line = xtryasprintf ("KEYSERVER%s %s",
+                           ksi == opt.keyserver? " --clear":"", ksi->uri);
+      if (!line)
+        err = gpg_error_from_syserror ();
+      else
+        {
+          err = assuan_transact (ctx, line, NULL, NULL, NULL,
+                                 NULL, NULL, NULL);
+          xfree (line);
+        }
+      if (err)
+        return err;
+    }
+  return 0;
+}
+
+
 /* Get a context for accessing dirmngr.  If no context is available a
    new one is created and - if required - dirmngr started.  On success
    an assuan context is stored at R_CTX.  This context may only be
@@ -252,33 +307,9 @@ open_context (ctrl_t ctrl, assuan_context_t *r_ctx)
           /* But first do the per session init if not yet done.  */
           if (!dml->set_keyservers_done)
             {
-              keyserver_spec_t ksi;
-
-              /* Set all configured keyservers.  We clear existing
-                 keyservers so that any keyserver configured in GPG
-                 overrides keyservers possibly still configured in Dirmngr
-                 for the session (Note that the keyserver list of a
-                 session in Dirmngr survives a RESET. */
-              for (ksi = opt.keyserver; ksi; ksi = ksi->next)
-                {
-                  char *line;
-
-                  line = xtryasprintf
-                    ("KEYSERVER%s %s",
-                     ksi == opt.keyserver? " --clear":"", ksi->uri);
-                  if (!line)
-                    err = gpg_error_from_syserror ();
-                  else
-                    {
-                      err = assuan_transact (dml->ctx, line, NULL, NULL, NULL,
-                                             NULL, NULL, NULL);
-                      xfree (line);
-                    }
-
-                  if (err)
-                    return err;
-                }
-
+              err = send_keyservers (dml->ctx);
+              if (err)
+                return err;
               dml->set_keyservers_done = 1;
             }
 
@@ -332,6 +363,213 @@ close_context (ctrl_t ctrl, assuan_context_t ctx)
 }
 
 
+/* Release the prefetch object PF.  */
+static void
+release_prefetch (struct dirmngr_prefetch_s *pf)
+{
+  if (!pf)
+    return;
+  npth_cond_destroy (&pf->cond);
+  npth_mutex_destroy (&pf->lock);
+  xfree (get_membuf (&pf->data, NULL));
+  free_strlist (pf->status);
+  xfree (pf->keyserver);
+  xfree (pf);
+}
+
+
+/* Data callback used by prefetch_thread.  */
+static gpg_error_t
+prefetch_data_cb (void *opaque, const void *data, size_t datalen)
+{
+  struct dirmngr_prefetch_s *pf = opaque;
+
+  if (data)
+    put_membuf (&pf->data, data, datalen);
+  return 0;
+}
+
+
+/* Status callback used by prefetch_thread.  */
+static gpg_error_t
+prefetch_status_cb (void *opaque, const char *line)
+{
+  struct dirmngr_prefetch_s *pf = opaque;
+
+  if (!append_to_strlist_try (&pf->status, line))
+    return gpg_error_from_syserror ();
+  return 0;
+}
+
+
+/* The thread running a prefetched command.  */
+static void *
+prefetch_thread (void *opaque)
+{
+  struct dirmngr_prefetch_s *pf = opaque;
+  assuan_context_t ctx;
+  gpg_error_t err;
+  char *line;
+  int abandoned;
+
+  err = create_context (pf->ctrl, &ctx);
+  if (!err)
+    {
+      if (!pf->keyserver)
+        err = send_keyservers (ctx);
+      else if (!(line = xtryasprintf ("KEYSERVER --clear %s", pf->keyserver)))
+        err = gpg_error_from_syserror ();
+      else
+        {
+          err = assuan_transact (ctx, line, NULL, NULL, NULL,
+                                 NULL, NULL, NULL);
+          xfree (line);
+        }
+      if (!err)
+        err = assuan_transact (ctx, pf->line, prefetch_data_cb, pf,
+                               NULL, NULL, prefetch_status_cb, pf);
+      assuan_release (ctx);
+    }
+
+  npth_mutex_lock (&pf->lock);
+  pf->err = err;
+  pf->done = 1;
+  abandoned = pf->abandoned;
+  npth_cond_signal (&pf->cond);
+  npth_mutex_unlock (&pf->lock);
+  if (abandoned)
+    release_prefetch (pf);
+  return NULL;
+}
+
+
+/* Start the command LINE in a new thread.  KEYSERVER is the optional
+ * override keyserver to be used for LINE.  LINE is always
+ * released.  */
+static gpg_error_t
+start_prefetch (ctrl_t ctrl, char *line, const char *keyserver)
+{
+  gpg_error_t err;
+  struct dirmngr_prefetch_s *pf;
+  npth_attr_t tattr;
+  npth_t thread;
+
+  if (!line)
+    return gpg_error_from_syserror ();
+  if (strlen (line) + 2 >= ASSUAN_LINELENGTH)
+    {
+      xfree (line);
+      return gpg_error (GPG_ERR_TOO_LARGE);
+    }
+
+  pf = xtrycalloc (1, sizeof *pf + strlen (line));
+  if (!pf)
+    {
+      err = gpg_error_from_syserror ();
+      xfree (line);
+      return err;
+    }
+  strcpy (pf->line, line);
+  xfree (line);
+  pf->ctrl = ctrl;
+  if (keyserver && !(pf->keyserver = xtrystrdup (keyserver)))
+    {
+      err = gpg_error_from_syserror ();
+      xfree (pf);
+      return err;
+    }
+  init_membuf (&pf->data, 4096);
+  npth_mutex_init (&pf->lock, NULL);
+  npth_cond_init (&pf->cond, NULL);
+
+  npth_attr_init (&tattr);
+  npth_attr_setdetachstate (&tattr, NPTH_CREATE_DETACHED);
+  err = npth_create (&thread, &tattr, prefetch_thread, pf);
+  npth_attr_destroy (&tattr);
+  if (err)
+    {
+      err = gpg_error_from_errno (err);
+      release_prefetch (pf);
+      return err;
+    }
+
+  pf->next = ctrl->dirmngr_prefetch;
+  ctrl->dirmngr_prefetch = pf;
+  return 0;
+}
+
+
+/* Forget about all prefetched commands of CTRL.  Commands which are
+ * still running are not waited for; their threads drop the result
+ * and close their connection, which also stops the Dirmngr from
+ * working on them.  */
+void
+gpg_dirmngr_prefetch_release (ctrl_t ctrl)
+{
+  struct dirmngr_prefetch_s *pf;
+  int done;
+
+  while ((pf = ctrl->dirmngr_prefetch))
+    {
+      ctrl->dirmngr_prefetch = pf->next;
+      npth_mutex_lock (&pf->lock);
+      done = pf->done;
+      pf->abandoned = 1;
+      npth_mutex_unlock (&pf->lock);
+      if (done)
+        release_prefetch (pf);
+    }
+}
+
+
+/* Run LINE on CTX like assuan_transact.  However, if the same command
+ * with the same override KEYSERVER has been prefetched, its recorded
+ * data and status lines are passed to the callbacks instead.  */
+static gpg_error_t
+dirmngr_transact (ctrl_t ctrl, assuan_context_t ctx, const char *keyserver,
+                  const char *line,
+                  gpg_error_t (*data_cb)(void *, const void *, size_t),
+                  void *data_cb_arg,
+                  gpg_error_t (*status_cb)(void *, const char *),
+                  void *status_cb_arg)
+{
+  gpg_error_t err = 0;
+  struct dirmngr_prefetch_s *pf, **pfp;
+  strlist_t sl;
+  char *data;
+  size_t datalen;
+
+  for (pfp = &ctrl->dirmngr_prefetch; (pf = *pfp); pfp = &pf->next)
+    if (!strcmp (pf->line, line)
+        && !(pf->keyserver? (!keyserver || strcmp (pf->keyserver, keyserver))
+             /**/         : !!keyserver))
+      break;
+  if (!pf)
+    return assuan_transact (ctx, line, data_cb, data_cb_arg,
+                            NULL, NULL, status_cb, status_cb_arg);
+  *pfp = pf->next;
+
+  npth_mutex_lock (&pf->lock);
+  while (!pf->done)
+    npth_cond_wait (&pf->cond, &pf->lock);
+  npth_mutex_unlock (&pf->lock);
+
+  data = get_membuf (&pf->data, &datalen);
+  if (!data)
+    err = gpg_error_from_syserror ();
+  else if (datalen && data_cb)
+    err = data_cb (data_cb_arg, data, datalen);
+  xfree (data);
+  for (sl = pf->status; !err && sl && status_cb; sl = sl->next)
+    err = status_cb (status_cb_arg, sl->d);
+  if (!err)
+    err = pf->err;
+
+  release_prefetch (pf);
+  return err;
+}
+
+
 /* Clear the set_keyservers_done flag on context CTX.  */
 static void
 clear_context_flags (ctrl_t ctrl, assuan_context_t ctx)
@@ -496,7 +734,7 @@ ks_search_data_cb (void *opaque, const void *data, size_t datalen)
   gpg_error_t err = 0;
   struct ks_search_parm_s *parm = opaque;
   const char *line, *s;
-  size_t rawlen, linelen;
+  size_t rawlen, linelen, used;
   char fixedbuf[256];
 
   if (parm->lasterr)
@@ -523,20 +761,23 @@ ks_search_data_cb (void *opaque, const void *data, size_t datalen)
 
   put_membuf (&parm->saveddata, data, datalen);
 
- again:
   line = peek_membuf (&parm->saveddata, &rawlen);
   if (!line)
     {
       parm->lasterr = gpg_error_from_syserror ();
       return parm->lasterr; /* Tell the server about our problem.  */
     }
-  if ((s = memchr (line, '\n', rawlen)))
+
+  /* Process all complete lines and remove them from the buffer in
+   * one go; a data chunk usually carries several lines.  */
+  used = 0;
+  while (!err && (s = memchr (line + used, '\n', rawlen - used)))
     {
-      linelen = s - line;  /* That is the length excluding the LF.  */
+      linelen = s - (line + used);  /* That is the length excluding the LF.  */
       if (linelen + 1 < sizeof fixedbuf)
         {
           /* We can use the static buffer.  */
-          memcpy (fixedbuf, line, linelen);
+          memcpy (fixedbuf, line + used, linelen);
           fixedbuf[linelen] = 0;
           if (linelen && fixedbuf[linelen-1] == '\r')
             fixedbuf[linelen-1] = 0;
@@ -555,7 +796,7 @@ ks_search_data_cb (void *opaque, const void *data, size_t datalen)
                   return parm->lasterr;
                 }
             }
-          memcpy (parm->helpbuf, line, linelen);
+          memcpy (parm->helpbuf, line + used, linelen);
           parm->helpbuf[linelen] = 0;
           if (linelen && parm->helpbuf[linelen-1] == '\r')
             parm->helpbuf[linelen-1] = 0;
@@ -563,12 +804,10 @@ ks_search_data_cb (void *opaque, const void *data, size_t datalen)
         }
       if (err)
         parm->lasterr = err;
-      else
-        {
-          clear_membuf (&parm->saveddata, linelen+1);
-          goto again;  /* There might be another complete line.  */
-        }
+      used += linelen + 1;
     }
+  if (used)
+    clear_membuf (&parm->saveddata, used);
 
   return err;
 }
@@ -580,9 +819,11 @@ ks_search_data_cb (void *opaque, const void *data, size_t datalen)
    the decoded data line as third argument.  The callback function may
    modify the data line and it is guaranteed that this data line is a
    complete line with a terminating 0 character but without the
-   linefeed.  NULL is passed to the callback to indicate EOF.  */
+   linefeed.  NULL is passed to the callback to indicate EOF.  If
+   LIMIT is not 0 the dirmngr is asked to return at most LIMIT
+   keys.  */
 gpg_error_t
-gpg_dirmngr_ks_search (ctrl_t ctrl, const char *searchstr,
+gpg_dirmngr_ks_search (ctrl_t ctrl, const char *searchstr, unsigned int limit,
                        gpg_error_t (*cb)(void*, int, char *), void *cb_value)
 {
   gpg_error_t err;
@@ -603,7 +844,11 @@ gpg_dirmngr_ks_search (ctrl_t ctrl, const char *searchstr,
         close_context (ctrl, ctx);
         return err;
       }
-    snprintf (line, sizeof line, "KS_SEARCH -- %s", escsearchstr);
+    if (limit)
+      snprintf (line, sizeof line, "KS_SEARCH --limit=%u -- %s",
+                limit, escsearchstr);
+    else
+      snprintf (line, sizeof line, "KS_SEARCH -- %s", escsearchstr);
     xfree (escsearchstr);
   }
 
@@ -653,6 +898,44 @@ ks_get_data_cb (void *opaque, const void *data, size_t datalen)
 }
 
 
+/* Return the malloced KS_GET command for PATTERN and FLAGS or NULL
+ * on error.  */
+static char *
+ks_get_line (char **pattern, unsigned int flags)
+{
+  membuf_t mb;
+  int idx;
+
+  /* Lump all patterns into one string.  */
+  init_membuf (&mb, 1024);
+  put_membuf_str (&mb, "KS_GET");
+  if ((flags & KEYSERVER_IMPORT_FLAG_QUICK))
+    put_membuf_str (&mb, " --quick");
+  if ((flags & KEYSERVER_IMPORT_FLAG_LDAP))
+    put_membuf_str (&mb, " --ldap");
+  put_membuf_str (&mb, " --");
+  for (idx=0; pattern[idx]; idx++)
+    {
+      put_membuf (&mb, " ", 1); /* Append Delimiter.  */
+      put_membuf_str (&mb, pattern[idx]);
+    }
+  put_membuf (&mb, "", 1); /* Append Nul.  */
+  return get_membuf (&mb, NULL);
+}
+
+
+/* Start the KS_GET command for PATTERN, OVERRIDE_KEYSERVER and FLAGS
+ * in the background; see gpg_dirmngr_ks_get.  */
+gpg_error_t
+gpg_dirmngr_prefetch_ks_get (ctrl_t ctrl, char **pattern,
+                             keyserver_spec_t override_keyserver,
+                             unsigned int flags)
+{
+  return start_prefetch (ctrl, ks_get_line (pattern, flags),
+                         override_keyserver? override_keyserver->uri : NULL);
+}
+
+
 /* Run the KS_GET command using the patterns in the array PATTERN.  On
    success an estream object is returned to retrieve the keys.  On
    error an error code is returned and NULL stored at R_FP.
@@ -685,9 +968,6 @@ gpg_dirmngr_ks_get (ctrl_t ctrl, char **pattern,
   struct ks_status_parm_s stparm;
   struct ks_get_parm_s parm;
   char *line = NULL;
-  size_t linelen;
-  membuf_t mb;
-  int idx;
 
   memset (&stparm, 0, sizeof stparm);
   memset (&parm, 0, sizeof parm);
@@ -721,27 +1001,13 @@ gpg_dirmngr_ks_get (ctrl_t ctrl, char **pattern,
       line = NULL;
     }
 
-  /* Lump all patterns into one string.  */
-  init_membuf (&mb, 1024);
-  put_membuf_str (&mb, "KS_GET");
-  if ((flags & KEYSERVER_IMPORT_FLAG_QUICK))
-    put_membuf_str (&mb, " --quick");
-  if ((flags & KEYSERVER_IMPORT_FLAG_LDAP))
-    put_membuf_str (&mb, " --ldap");
-  put_membuf_str (&mb, " --");
-  for (idx=0; pattern[idx]; idx++)
-    {
-      put_membuf (&mb, " ", 1); /* Append Delimiter.  */
-      put_membuf_str (&mb, pattern[idx]);
-    }
-  put_membuf (&mb, "", 1); /* Append Nul.  */
-  line = get_membuf (&mb, &linelen);
+  line = ks_get_line (pattern, flags);
   if (!line)
     {
       err = gpg_error_from_syserror ();
       goto leave;
     }
-  if (linelen + 2 >= ASSUAN_LINELENGTH)
+  if (strlen (line) + 2 >= ASSUAN_LINELENGTH)
     {
       err = gpg_error (GPG_ERR_TOO_MANY);
       goto leave;
@@ -753,8 +1019,10 @@ gpg_dirmngr_ks_get (ctrl_t ctrl, char **pattern,
       err = gpg_error_from_syserror ();
       goto leave;
     }
-  err = assuan_transact (ctx, line, ks_get_data_cb, &parm,
-                         NULL, NULL, ks_status_cb, &stparm);
+  err = dirmngr_transact (ctrl, ctx,
+                          override_keyserver? override_keyserver->uri : NULL,
+                          line, ks_get_data_cb, &parm,
+                          ks_status_cb, &stparm);
   if (err)
     goto leave;
 
@@ -1131,6 +1399,25 @@ dns_cert_status_cb (void *opaque, const char *line)
   return err;
 }
 
+/* Return the malloced DNS_CERT command for NAME and CERTTYPE or NULL
+ * on error.  */
+static char *
+dns_cert_line (const char *name, const char *certtype)
+{
+  return es_bsprintf ("DNS_CERT %s %s", certtype? certtype : "--dane", name);
+}
+
+
+/* Start the DNS_CERT command for NAME and CERTTYPE in the background;
+ * see gpg_dirmngr_dns_cert.  */
+gpg_error_t
+gpg_dirmngr_prefetch_dns_cert (ctrl_t ctrl,
+                               const char *name, const char *certtype)
+{
+  return start_prefetch (ctrl, dns_cert_line (name, certtype), NULL);
+}
+
+
 /* Ask the dirmngr for a DNS CERT record.  Depending on the found
    subtypes different return values are set:
 
@@ -1174,7 +1461,7 @@ gpg_dirmngr_dns_cert (ctrl_t ctrl, const char *name, const char *certtype,
   if (err)
     return err;
 
-  line = es_bsprintf ("DNS_CERT %s %s", certtype? certtype : "--dane", name);
+  line = dns_cert_line (name, certtype);
   if (!line)
     {
       err = gpg_error_from_syserror ();
@@ -1192,8 +1479,8 @@ gpg_dirmngr_dns_cert (ctrl_t ctrl, const char *name, const char *certtype,
       err = gpg_error_from_syserror ();
       goto leave;
     }
-  err = assuan_transact (ctx, line, dns_cert_data_cb, &parm,
-                         NULL, NULL, dns_cert_status_cb, &parm);
+  err = dirmngr_transact (ctrl, ctx, NULL, line, dns_cert_data_cb, &parm,
+                          dns_cert_status_cb, &parm);
   if (err)
     goto leave;
 
@@ -1229,6 +1516,23 @@ gpg_dirmngr_dns_cert (ctrl_t ctrl, const char *name, const char *certtype,
 
 
 
+/* Return the malloced WKD_GET command for NAME or NULL on error.  */
+static char *
+wkd_get_line (const char *name, int quick)
+{
+  return es_bsprintf ("WKD_GET%s -- %s", quick?" --quick":"", name);
+}
+
+
+/* Start the WKD_GET command for NAME in the background; see
+ * gpg_dirmngr_wkd_get.  */
+gpg_error_t
+gpg_dirmngr_prefetch_wkd_get (ctrl_t ctrl, const char *name, int quick)
+{
+  return start_prefetch (ctrl, wkd_get_line (name, quick), NULL);
+}
+
+
 /* Ask the dirmngr to retrieve a key via the Web Key Directory
  * protocol.  If QUICK is set the dirmngr is advised to use a shorter
  * timeout.  On success a new estream with the key stored at R_KEY and the
@@ -1254,7 +1558,7 @@ gpg_dirmngr_wkd_get (ctrl_t ctrl, const char *name, int quick,
   if (err)
     return err;
 
-  line = es_bsprintf ("WKD_GET%s -- %s", quick?" --quick":"", name);
+  line = wkd_get_line (name, quick);
   if (!line)
     {
       err = gpg_error_from_syserror ();
@@ -1272,8 +1576,8 @@ gpg_dirmngr_wkd_get (ctrl_t ctrl, const char *name, int quick,
       err = gpg_error_from_syserror ();
       goto leave;
     }
-  err = assuan_transact (ctx, line, dns_cert_data_cb, &parm,
-                         NULL, NULL, ks_status_cb, &stparm);
+  err = dirmngr_transact (ctrl, ctx, NULL, line, dns_cert_data_cb, &parm,
+                          ks_status_cb, &stparm);
   if (gpg_err_code (err) == GPG_ERR_ENOSPC)
     err = gpg_error (GPG_ERR_TOO_LARGE);
   if (err)
@@ -1301,3 +1605,126 @@ gpg_dirmngr_wkd_get (ctrl_t ctrl, const char *name, int quick,
   close_context (ctrl, ctx);
   return err;
 }
+
+
+
+/* Parameter structure used with the AKL_RESULT command.  */
+struct akl_result_parm_s
+{
+  char *fpr;
+  gpg_error_t result;
+};
+
+
+/* Status callback for the AKL_RESULT command.  */
+static gpg_error_t
+akl_result_status_cb (void *opaque, const char *line)
+{
+  struct akl_result_parm_s *parm = opaque;
+  const char *s;
+
+  if ((s = has_leading_keyword (line, "AKL_RESULT")))
+    {
+      if (*s == '-' && s[1] == ' ')
+        {
+          parm->result = gpg_error (strtoul (s+2, NULL, 10));
+          if (!parm->result)
+            parm->result = gpg_error (GPG_ERR_GENERAL);
+        }
+      else if (!parm->fpr && !(parm->fpr = xtrystrdup (s)))
+        return gpg_error_from_syserror ();
+    }
+
+  return 0;
+}
+
+
+/* Ask the dirmngr for the cached outcome of the auto-key-locate
+ * MECHANISM for the mail address MBOX.  On success either the
+ * malloced hex encoded fingerprint of the key found by that
+ * mechanism is stored at R_FPR or, if the former lookup failed, its
+ * error code at R_RESULT.  GPG_ERR_NOT_FOUND is returned if nothing
+ * is cached.  */
+gpg_error_t
+gpg_dirmngr_get_akl_result (ctrl_t ctrl, const char *mechanism,
+                            const char *mbox,
+                            char **r_fpr, gpg_error_t *r_result)
+{
+  gpg_error_t err;
+  assuan_context_t ctx;
+  struct akl_result_parm_s parm = { NULL };
+  char *line = NULL;
+
+  *r_fpr = NULL;
+  *r_result = 0;
+
+  err = open_context (ctrl, &ctx);
+  if (err)
+    return err;
+
+  line = es_bsprintf ("AKL_RESULT -- %s %s", mechanism, mbox);
+  if (!line)
+    {
+      err = gpg_error_from_syserror ();
+      goto leave;
+    }
+  if (strlen (line) + 2 >= ASSUAN_LINELENGTH)
+    {
+      err = gpg_error (GPG_ERR_TOO_LARGE);
+      goto leave;
+    }
+
+  err = assuan_transact (ctx, line, NULL, NULL, NULL, NULL,
+                         akl_result_status_cb, &parm);
+  if (err)
+    goto leave;
+  if (parm.result)
+    *r_result = parm.result;
+  else if (parm.fpr)
+    {
+      *r_fpr = parm.fpr;
+      parm.fpr = NULL;
+    }
+  else
+    err = gpg_error (GPG_ERR_NOT_FOUND);
+
+ leave:
+  xfree (parm.fpr);
+  xfree (line);
+  close_context (ctrl, ctx);
+  return err;
+}
+
+
+/* Tell the dirmngr the outcome of the auto-key-locate MECHANISM for
+ * the mail address MBOX.  If RESULT is 0 FPR is the hex encoded
+ * fingerprint of the found key.  */
+gpg_error_t
+gpg_dirmngr_put_akl_result (ctrl_t ctrl, const char *mechanism,
+                            const char *mbox,
+                            const char *fpr, gpg_error_t result)
+{
+  gpg_error_t err;
+  assuan_context_t ctx;
+  char *line;
+
+  err = open_context (ctrl, &ctx);
+  if (err)
+    return err;
+
+  if (result)
+    line = es_bsprintf ("AKL_RESULT --put -- %s %s - %u",
+                        mechanism, mbox, gpg_err_code (result));
+  else
+    line = es_bsprintf ("AKL_RESULT --put -- %s %s %s", mechanism, mbox, fpr);
+  if (!line)
+    err = gpg_error_from_syserror ();
+  else if (strlen (line) + 2 >= ASSUAN_LINELENGTH)
+    err = gpg_error (GPG_ERR_TOO_LARGE);
+  else
+    err = assuan_transact (ctx, line, NULL, NULL, NULL, NULL, NULL, NULL);
+
+  xfree (line);
+  close_context (ctrl, ctx);
+  return err;
+}
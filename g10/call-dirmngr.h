@@ -23,6 +23,7 @@ void gpg_dirmngr_deinit_session_data (ctrl_t ctrl);
 
 gpg_error_t gpg_dirmngr_ks_list (ctrl_t ctrl, char **r_keyserver);
 gpg_error_t gpg_dirmngr_ks_search (ctrl_t ctrl, const char *searchstr,
+                                   unsigned int limit,
                                    gpg_error_t (*cb)(void*, int, char *),
                                    void *cb_value);
 gpg_error_t gpg_dirmngr_ks_get (ctrl_t ctrl, char *pattern[],
@@ -40,6 +41,20 @@ gpg_error_t gpg_dirmngr_dns_cert (ctrl_t ctrl,
                                   char **r_url);
 gpg_error_t gpg_dirmngr_wkd_get (ctrl_t ctrl, const char *name, int quick,
                                  estream_t *r_key, char **r_url);
+gpg_error_t gpg_dirmngr_prefetch_ks_get (ctrl_t ctrl, char *pattern[],
+                                         keyserver_spec_t override_keyserver,
+                                         unsigned int flags);
+gpg_error_t gpg_dirmngr_prefetch_dns_cert (ctrl_t ctrl, const char *name,
+                                           const char *certtype);
+gpg_error_t gpg_dirmngr_prefetch_wkd_get (ctrl_t ctrl, const char *name,
+                                          int quick);
+void gpg_dirmngr_prefetch_release (ctrl_t ctrl);
+gpg_error_t gpg_dirmngr_get_akl_result (ctrl_t ctrl, const char *mechanism,
+                                        const char *mbox,
+                                        char **r_fpr, gpg_error_t *r_result);
+gpg_error_t gpg_dirmngr_put_akl_result (ctrl_t ctrl, const char *mechanism,
+                                        const char *mbox,
+                                        const char *fpr, gpg_error_t result);
 
 
 #endif /*GNUPG_G10_CALL_DIRMNGR_H*/
@@ -40,12 +40,41 @@
 #include "../common/host2net.h"
 #include "../common/exechelp.h"
 #include "../common/status.h"
+#include "../common/bloom.h"
 #include "../kbx/kbx-client-util.h"
 #include "keydb.h"
+#include "objcache.h"
 
 #include "keydb-private.h"  /* For struct keydb_handle_s */
 
 
+/* The results of a NEXT --count which have not yet been returned by
+ * keydb_search.  */
+struct next_batch_s
+{
+  char *buffer;         /* The keyblocks as returned by the keyboxd.  */
+  size_t buflen;        /* The length of BUFFER.  */
+  size_t off;           /* The offset of the next keyblock in BUFFER.  */
+  unsigned int count;   /* The number of results we asked for.  */
+  unsigned int nitems;  /* The number of results received.  */
+  unsigned int idx;     /* The index of the next result to return.  */
+  struct
+  {
+    size_t len;
+    unsigned char ubid[UBID_LEN];
+    int uid_no;
+    int pk_no;
+  } items[1];
+};
+
+/* The number of results asked for with the first NEXT of a search
+ * and the maximum to which this is doubled with each further NEXT.
+ * Short searches thus do not fetch keyblocks nobody is interested
+ * in.  */
+#define NEXT_BATCH_MIN 4
+#define NEXT_BATCH_MAX 128
+
+
 /* Data used to keep track of keybox daemon sessions.  This allows us
  * to use several sessions with the keyboxd and also to re-use already
  * established sessions.  Note that gpg.h defines the type
@@ -65,21 +94,81 @@ struct keyboxd_local_s
    * D-lines are used to convey the keyblocks. */
   iobuf_t search_result;
 
+  /* The results of the last NEXT --count not yet returned or NULL.  */
+  struct next_batch_s *next_batch;
+
+  /* The number of results to ask for with the next NEXT command.  */
+  unsigned int next_count;
+
   /* This flag set while an operation is running on this context.  */
   unsigned int is_active : 1;
 
   /* Flag indicating that a search reset is required.  */
   unsigned int need_search_reset : 1;
 
+  /* Flag indicating that the keyboxd does not support SEARCH --multi.  */
+  unsigned int no_multi_search : 1;
+
+  /* Flag indicating that the keyboxd does not support NEXT --count.  */
+  unsigned int no_next_batch : 1;
+
 };
 
 
 /* Flag indicating that for example bulk import is enabled.  */
 static unsigned int in_transaction;
 
+/* The last database generation announced by the keyboxd.  */
+static struct
+{
+  u32 epoch;
+  unsigned long counter;
+  unsigned int valid : 1;
+} last_generation;
+
+/* The number of misses in a row after which we fetch the Bloom filter.
+ * Fetching it requires a scan of the database by the keyboxd and
+ * thus we don't do this for the occasional miss.  */
+#define BLOOM_FETCH_THRESHOLD 4
+
+/* The Bloom filter over all fingerprints and keyids as returned by
+ * the keyboxd.  It is valid for the generation of the database seen
+ * when it was fetched.  */
+static struct
+{
+  bloom_filter_t filter;
+  unsigned int not_supported : 1;  /* Don't try to fetch a filter.  */
+  unsigned int misses;             /* # of misses since the last drop.  */
+  unsigned int fetched;            /* # of times fetched.  */
+  unsigned int rejected;           /* # of searches skipped.  */
+  unsigned int passed;             /* # of searches not skipped.  */
+  unsigned int false_positives;    /* # of passed but not found.  */
+} bloom;
+
+/* Release the Bloom filter; it will be fetched again on demand.  */
+static void
+drop_bloom_filter (void)
+{
+  bloom_release (bloom.filter);
+  bloom.filter = NULL;
+  bloom.misses = 0;
+}
+
 
 
 
+/* Release the pending results of a NEXT --count of KBL.  */
+static void
+release_next_batch (keyboxd_local_t kbl)
+{
+  if (!kbl->next_batch)
+    return;
+  xfree (kbl->next_batch->buffer);
+  xfree (kbl->next_batch);
+  kbl->next_batch = NULL;
+}
+
+
 /* Deinitialize all session resources pertaining to the keyboxd.  */
 void
 gpg_keyboxd_deinit_session_data (ctrl_t ctrl)
@@ -96,6 +185,7 @@ gpg_keyboxd_deinit_session_data (ctrl_t ctrl)
         {
           kbx_client_data_release (kbl->kcd);
           kbl->kcd = NULL;
+          release_next_batch (kbl);
           if (kbl->ctx && in_transaction)
             {
               /* This is our hack to commit the changes done during a
@@ -159,6 +249,13 @@ create_new_context (ctrl_t ctrl, assuan_context_t *r_ctx)
     {
       /* Place to emit global options.  */
 
+      /* Ask to be told about changes of the database so that we can
+       * keep our caches across operations.  Older versions of
+       * keyboxd do not know this option; we can't keep caches then
+       * but they are anyway not long living.  */
+      assuan_transact (ctx, "OPTION notify-generation",
+                       NULL, NULL, NULL, NULL, NULL, NULL);
+
       if ((opt.import_options & IMPORT_BULK) && !in_transaction)
         {
           err = assuan_transact (ctx, "TRANSACTION begin",
@@ -206,6 +303,7 @@ open_context (ctrl_t ctrl, keyboxd_local_t *r_kbl)
 
           kbl->is_active = 1;
           kbl->need_search_reset = 1;
+          release_next_batch (kbl);
 
           *r_kbl = kbl;
           return 0;
@@ -315,6 +413,7 @@ keydb_release (KEYDB_HANDLE hd)
       hd->kbl = NULL;
       hd->ctrl = NULL;
     }
+  iobuf_close (hd->kbimage);
   xfree (hd);
 }
 
@@ -344,10 +443,26 @@ keydb_lock (KEYDB_HANDLE hd)
  * for the user ID node.  */
 gpg_error_t
 keydb_get_keyblock (KEYDB_HANDLE hd, kbnode_t *ret_kb)
+{
+  return keydb_get_keyblock_and_image (hd, ret_kb, NULL, NULL);
+}
+
+
+/* Same as keydb_get_keyblock but if R_IMAGE is not NULL also return
+ * a malloced copy of the keyblock's image as stored in the database
+ * at R_IMAGE and its length at R_IMAGELEN.  The image is only
+ * returned if it has exactly the packets of the keyblock; if it is
+ * not available NULL is stored at R_IMAGE.  This allows to write
+ * out a keyblock without rebuilding its packets.  */
+gpg_error_t
+keydb_get_keyblock_and_image (KEYDB_HANDLE hd, kbnode_t *ret_kb,
+                              void **r_image, size_t *r_imagelen)
 {
   gpg_error_t err;
 
   *ret_kb = NULL;
+  if (r_image)
+    *r_image = NULL;
 
   if (!hd)
     return gpg_error (GPG_ERR_INV_ARG);
@@ -357,7 +472,7 @@ keydb_get_keyblock (KEYDB_HANDLE hd, kbnode_t *ret_kb)
 
   if (!hd->use_keyboxd)
     {
-      err = internal_keydb_get_keyblock (hd, ret_kb);
+      err = internal_keydb_get_keyblock (hd, ret_kb, r_image, r_imagelen);
       goto leave;
     }
 
@@ -366,7 +481,7 @@ keydb_get_keyblock (KEYDB_HANDLE hd, kbnode_t *ret_kb)
       err = keydb_parse_keyblock (hd->kbl->search_result,
                                   hd->last_ubid_valid? hd->last_pk_no  : 0,
                                   hd->last_ubid_valid? hd->last_uid_no : 0,
-                                  ret_kb);
+                                  ret_kb, r_image, r_imagelen);
       /* In contrast to the old code we close the iobuf here and thus
        * this function may be called only once to get a keyblock.  */
       iobuf_close (hd->kbl->search_result);
@@ -414,6 +529,41 @@ store_inq_cb (void *opaque, const char *line)
 }
 
 
+/* Build the STORE command for the keyblock KB into LINE of size
+ * LINESIZE.  MODE is "--update" or "--insert".  The self-signatures of
+ * KB are merged so that the primary user id, the usage, expiration and
+ * revocation state of the primary key can be passed to the keyboxd
+ * with the --keyinfo option.  */
+static void
+format_store_line (ctrl_t ctrl, kbnode_t kb, const char *mode,
+                   char *line, size_t linesize)
+{
+  PKT_public_key *pk;
+  kbnode_t node;
+  int uidno, primary_uidno;
+
+  merge_keys_and_selfsig (ctrl, kb);
+
+  pk = kb->pkt->pkt.public_key;
+  uidno = primary_uidno = 0;
+  for (node = kb; node; node = node->next)
+    if (node->pkt->pkttype == PKT_USER_ID)
+      {
+        uidno++;
+        if (node->pkt->pkt.user_id->flags.primary
+            && !node->pkt->pkt.user_id->attrib_data)
+          {
+            primary_uidno = uidno;
+            break;
+          }
+      }
+
+  snprintf (line, linesize, "STORE %s --keyinfo=%d:%u:%lu:%d",
+            mode, primary_uidno, pk->pubkey_usage,
+            (unsigned long)pk->expiredate, !!pk->flags.revoked);
+}
+
+
 /* Update the keyblock KB (i.e., extract the fingerprint and find the
  * corresponding keyblock in the keyring).
  *
@@ -433,8 +583,8 @@ gpg_error_t
 keydb_update_keyblock (ctrl_t ctrl, KEYDB_HANDLE hd, kbnode_t kb)
 {
   gpg_error_t err;
-  iobuf_t iobuf = NULL;
   struct store_parm_s parm = {NULL};
+  char line[ASSUAN_LINELENGTH];
 
   log_assert (kb);
   log_assert (kb->pkt->pkttype == PKT_PUBLIC_KEY);
@@ -442,6 +592,9 @@ keydb_update_keyblock (ctrl_t ctrl, KEYDB_HANDLE hd, kbnode_t kb)
   if (!hd)
     return gpg_error (GPG_ERR_INV_ARG);
 
+  getkey_flush_nokey_cache ();  /* The update may add a subkey.  */
+  getkey_flush_best_key_cache ();
+
   if (!hd->use_keyboxd)
     {
       err = internal_keydb_update_keyblock (ctrl, hd, kb);
@@ -454,20 +607,21 @@ keydb_update_keyblock (ctrl_t ctrl, KEYDB_HANDLE hd, kbnode_t kb)
       goto leave;
     }
 
-  err = build_keyblock_image (kb, &iobuf);
+  err = build_keyblock_image (kb, &hd->kbimage);
   if (err)
     goto leave;
 
+  format_store_line (ctrl, kb, "--update", line, sizeof line);
   parm.ctx = hd->kbl->ctx;
-  parm.data = iobuf_get_temp_buffer (iobuf);
-  parm.datalen = iobuf_get_temp_length (iobuf);
-  err = assuan_transact (hd->kbl->ctx, "STORE --update",
+  parm.data = iobuf_get_temp_buffer (hd->kbimage);
+  parm.datalen = iobuf_get_temp_length (hd->kbimage);
+  drop_bloom_filter ();
+  err = assuan_transact (hd->kbl->ctx, line,
                          NULL, NULL,
                          store_inq_cb, &parm,
                          NULL, NULL);
 
  leave:
-  iobuf_close (iobuf);
   return err;
 }
 
@@ -487,12 +641,15 @@ gpg_error_t
 keydb_insert_keyblock (KEYDB_HANDLE hd, kbnode_t kb)
 {
   gpg_error_t err;
-  iobuf_t iobuf = NULL;
   struct store_parm_s parm = {NULL};
+  char line[ASSUAN_LINELENGTH];
 
   if (!hd)
     return gpg_error (GPG_ERR_INV_ARG);
 
+  getkey_flush_nokey_cache ();
+  getkey_flush_best_key_cache ();
+
   if (!hd->use_keyboxd)
     {
       err = internal_keydb_insert_keyblock (hd, kb);
@@ -505,20 +662,21 @@ keydb_insert_keyblock (KEYDB_HANDLE hd, kbnode_t kb)
       goto leave;
     }
 
-  err = build_keyblock_image (kb, &iobuf);
+  err = build_keyblock_image (kb, &hd->kbimage);
   if (err)
     goto leave;
 
+  format_store_line (hd->ctrl, kb, "--insert", line, sizeof line);
   parm.ctx = hd->kbl->ctx;
-  parm.data = iobuf_get_temp_buffer (iobuf);
-  parm.datalen = iobuf_get_temp_length (iobuf);
-  err = assuan_transact (hd->kbl->ctx, "STORE --insert",
+  parm.data = iobuf_get_temp_buffer (hd->kbimage);
+  parm.datalen = iobuf_get_temp_length (hd->kbimage);
+  drop_bloom_filter ();
+  err = assuan_transact (hd->kbl->ctx, line,
                          NULL, NULL,
                          store_inq_cb, &parm,
                          NULL, NULL);
 
  leave:
-  iobuf_close (iobuf);
   return err;
 }
 
@@ -597,6 +755,7 @@ keydb_search_reset (KEYDB_HANDLE hd)
    * ubid flag so that after a reset a delete can't be performed.  */
   hd->kbl->need_search_reset = 1;
   hd->last_ubid_valid = 0;
+  release_next_batch (hd->kbl);
   err = 0;
 
  leave:
@@ -605,6 +764,41 @@ keydb_search_reset (KEYDB_HANDLE hd)
 
 
 
+/* Take note of the GENERATION status line with the args at S.  If the
+ * database has been changed since the last status line, our caches
+ * may have become stale and are flushed.  */
+static void
+note_generation (const char *s)
+{
+  u32 epoch;
+  unsigned long counter;
+  char *endp;
+
+  epoch = strtoul (s, &endp, 10);
+  counter = strtoul (endp, NULL, 10);
+  if (last_generation.valid
+      && last_generation.epoch == epoch
+      && last_generation.counter == counter)
+    return;
+
+  if (last_generation.valid)
+    {
+      if (DBG_CACHE)
+        log_debug ("keyboxd database changed (%lu,%lu -> %lu,%lu)"
+                   " - flushing caches\n",
+                   (unsigned long)last_generation.epoch,
+                   last_generation.counter,
+                   (unsigned long)epoch, counter);
+      getkey_flush_caches ();
+      objcache_flush ();
+      drop_bloom_filter ();
+    }
+  last_generation.epoch = epoch;
+  last_generation.counter = counter;
+  last_generation.valid = 1;
+}
+
+
 /* Status callback for SEARCH and NEXT operaions.  */
 static gpg_error_t
 search_status_cb (void *opaque, const char *line)
@@ -614,7 +808,9 @@ search_status_cb (void *opaque, const char *line)
   const char *s;
   unsigned int n;
 
-  if ((s = has_leading_keyword (line, "PUBKEY_INFO")))
+  if ((s = has_leading_keyword (line, "GENERATION")))
+    note_generation (s);
+  else if ((s = has_leading_keyword (line, "PUBKEY_INFO")))
     {
       if (atoi (s) != PUBKEY_TYPE_OPGP)
         err = gpg_error (GPG_ERR_WRONG_BLOB_TYPE);
@@ -653,6 +849,332 @@ search_status_cb (void *opaque, const char *line)
 }
 
 
+/* Helper for keydb_search and keydb_search_multi to build the
+ * SEARCH command for DESC into the buffer LINE of size LINESIZE.
+ * MORE are the options to be passed to SEARCH.  */
+static gpg_error_t
+build_search_line (char *line, size_t linesize, KEYDB_SEARCH_DESC *desc,
+                   const char *more)
+{
+  switch (desc->mode)
+    {
+    case KEYDB_SEARCH_MODE_EXACT:
+      snprintf (line, linesize, "SEARCH %s -- =%s", more, desc->u.name);
+      break;
+
+    case KEYDB_SEARCH_MODE_SUBSTR:
+      snprintf (line, linesize, "SEARCH %s -- *%s", more, desc->u.name);
+      break;
+
+    case KEYDB_SEARCH_MODE_MAIL:
+      snprintf (line, linesize, "SEARCH %s -- <%s",
+                more, desc->u.name+(desc->u.name[0] == '<') );
+      break;
+
+    case KEYDB_SEARCH_MODE_MAILSUB:
+      snprintf (line, linesize, "SEARCH %s -- @%s", more, desc->u.name);
+      break;
+
+    case KEYDB_SEARCH_MODE_MAILEND:
+      snprintf (line, linesize, "SEARCH %s -- .%s", more, desc->u.name);
+      break;
+
+    case KEYDB_SEARCH_MODE_WORDS:
+      snprintf (line, linesize, "SEARCH %s -- +%s", more, desc->u.name);
+      break;
+
+    case KEYDB_SEARCH_MODE_SHORT_KID:
+      snprintf (line, linesize, "SEARCH %s -- 0x%08lX", more,
+                (ulong)desc->u.kid[1]);
+      break;
+
+    case KEYDB_SEARCH_MODE_LONG_KID:
+      snprintf (line, linesize, "SEARCH %s -- 0x%08lX%08lX", more,
+                (ulong)desc->u.kid[0], (ulong)desc->u.kid[1]);
+      break;
+
+    case KEYDB_SEARCH_MODE_FPR:
+      {
+        unsigned char hexfpr[MAX_FINGERPRINT_LEN * 2 + 1];
+        log_assert (desc->fprlen <= MAX_FINGERPRINT_LEN);
+        bin2hex (desc->u.fpr, desc->fprlen, hexfpr);
+        snprintf (line, linesize, "SEARCH %s -- 0x%s", more, hexfpr);
+      }
+      break;
+
+    case KEYDB_SEARCH_MODE_ISSUER:
+      snprintf (line, linesize, "SEARCH %s -- #/%s", more, desc->u.name);
+      break;
+
+    case KEYDB_SEARCH_MODE_ISSUER_SN:
+    case KEYDB_SEARCH_MODE_SN:
+      snprintf (line, linesize, "SEARCH %s -- #%s", more, desc->u.name);
+      break;
+
+    case KEYDB_SEARCH_MODE_SUBJECT:
+      snprintf (line, linesize, "SEARCH %s -- /%s", more, desc->u.name);
+      break;
+
+    case KEYDB_SEARCH_MODE_KEYGRIP:
+      {
+        unsigned char hexgrip[KEYGRIP_LEN * 2 + 1];
+        bin2hex (desc->u.grip, KEYGRIP_LEN, hexgrip);
+        snprintf (line, linesize, "SEARCH %s -- &%s", more, hexgrip);
+      }
+      break;
+
+    case KEYDB_SEARCH_MODE_UBID:
+      {
+        unsigned char hexubid[UBID_LEN * 2 + 1];
+        bin2hex (desc->u.ubid, UBID_LEN, hexubid);
+        snprintf (line, linesize, "SEARCH %s -- ^%s", more, hexubid);
+      }
+      break;
+
+    case KEYDB_SEARCH_MODE_NEXT:
+      log_debug ("%s: mode next - we should not get to here!\n", __func__);
+      snprintf (line, linesize, "NEXT");
+      break;
+
+    case KEYDB_SEARCH_MODE_FIRST:
+      log_debug ("%s: mode first - we should not get to here!\n", __func__);
+      /*fallthru*/
+    default:
+      return gpg_error (GPG_ERR_INV_ARG);
+    }
+
+  return 0;
+}
+
+
+/* Fetch the Bloom filter from the keyboxd using the context of HD.
+ * Errors are not fatal; we then simply don't use a filter.  */
+static void
+fetch_bloom_filter (KEYDB_HANDLE hd)
+{
+  gpg_error_t err;
+  char *buffer;
+  size_t len;
+
+  drop_bloom_filter ();
+  err = kbx_client_data_cmd (hd->kbl->kcd, "BLOOM", search_status_cb, hd);
+  if (!err && !(err = kbx_client_data_wait (hd->kbl->kcd, &buffer, &len)))
+    {
+      err = bloom_from_buffer (&bloom.filter, buffer, len);
+      xfree (buffer);
+    }
+  if (err)
+    {
+      /* Old keyboxd versions and the keybox backend do not support
+       * the filter; don't ask again.  */
+      if (opt.verbose
+          && gpg_err_code (err) != GPG_ERR_NOT_SUPPORTED
+          && gpg_err_code (err) != GPG_ERR_ASS_UNKNOWN_CMD)
+        log_info ("error fetching Bloom filter from keyboxd: %s\n",
+                  gpg_strerror (err));
+      bloom.not_supported = 1;
+      return;
+    }
+  bloom.fetched++;
+  if (DBG_CACHE)
+    log_debug ("keyboxd: fetched Bloom filter with %u items\n",
+               bloom_count (bloom.filter));
+}
+
+
+/* Return true if the Bloom filter tells us that none of the NDESC
+ * search descriptions in DESC can match.  Only long keyid and
+ * fingerprint searches are considered.  */
+static int
+bloom_rejects (KEYDB_SEARCH_DESC *desc, size_t ndesc)
+{
+  unsigned char kid[8];
+  size_t n;
+
+  if (!bloom.filter || !ndesc)
+    return 0;
+
+  for (n=0; n < ndesc; n++)
+    {
+      if (desc[n].mode == KEYDB_SEARCH_MODE_LONG_KID)
+        {
+          ulongtobuf (kid, desc[n].u.kid[0]);
+          ulongtobuf (kid+4, desc[n].u.kid[1]);
+          if (bloom_test (bloom.filter, BLOOM_ITEM_KID, kid, 8))
+            break;
+        }
+      else if (desc[n].mode == KEYDB_SEARCH_MODE_FPR)
+        {
+          if (bloom_test (bloom.filter, BLOOM_ITEM_FPR,
+                          desc[n].u.fpr, desc[n].fprlen))
+            break;
+        }
+      else
+        break;
+    }
+  if (n < ndesc)
+    {
+      bloom.passed++;
+      return 0;
+    }
+  bloom.rejected++;
+  return 1;
+}
+
+
+/* Return true if DESC is a search which may be answered by the Bloom
+ * filter.  */
+static int
+bloom_search_p (KEYDB_SEARCH_DESC *desc, size_t ndesc)
+{
+  size_t n;
+
+  for (n=0; n < ndesc; n++)
+    if (desc[n].mode != KEYDB_SEARCH_MODE_LONG_KID
+        && desc[n].mode != KEYDB_SEARCH_MODE_FPR)
+      return 0;
+  return !!ndesc;
+}
+
+
+/* Print statistics about the Bloom filter.  */
+void
+keydb_bloom_dump_stats (void)
+{
+  if (!bloom.fetched)
+    return;
+  log_info ("bloom: items=%u fetched=%u rejected=%u passed=%u fp=%u\n",
+            bloom_count (bloom.filter), bloom.fetched,
+            bloom.rejected, bloom.passed, bloom.false_positives);
+}
+
+
+/* Status callback for fetch_next_batch.  */
+static gpg_error_t
+next_batch_status_cb (void *opaque, const char *line)
+{
+  KEYDB_HANDLE hd = opaque;
+  struct next_batch_s *batch = hd->kbl->next_batch;
+  const char *s;
+  char *endp;
+  unsigned long idx, len;
+
+  if ((s = has_leading_keyword (line, "SEARCH_RESULT")))
+    {
+      idx = strtoul (s, &endp, 10);
+      len = strtoul (endp, NULL, 10);
+      if (endp == s || idx != batch->nitems || idx >= batch->count || !len
+          || !hd->last_ubid_valid)
+        return gpg_error (GPG_ERR_INV_RESPONSE);
+      batch->items[idx].len = len;
+      memcpy (batch->items[idx].ubid, hd->last_ubid, UBID_LEN);
+      batch->items[idx].uid_no = hd->last_uid_no;
+      batch->items[idx].pk_no = hd->last_pk_no;
+      batch->nitems++;
+      hd->last_ubid_valid = 0;
+      return 0;
+    }
+
+  return search_status_cb (hd, line);
+}
+
+
+/* Return the next result of the last NEXT --count as the current
+ * search result of HD.  Returns GPG_ERR_NO_DATA if no result is
+ * pending and GPG_ERR_NOT_FOUND if the search has ended.  */
+static gpg_error_t
+take_next_batch_item (KEYDB_HANDLE hd)
+{
+  struct next_batch_s *batch = hd->kbl->next_batch;
+  int eof;
+
+  if (!batch)
+    return gpg_error (GPG_ERR_NO_DATA);
+  if (batch->idx == batch->nitems)
+    {
+      /* Fewer results than requested indicate the end of the
+       * search; no need to ask the keyboxd again.  */
+      eof = batch->nitems < batch->count;
+      release_next_batch (hd->kbl);
+      return gpg_error (eof? GPG_ERR_NOT_FOUND : GPG_ERR_NO_DATA);
+    }
+
+  hd->kbl->search_result
+    = iobuf_temp_with_content (batch->buffer + batch->off,
+                               batch->items[batch->idx].len);
+  batch->off += batch->items[batch->idx].len;
+  memcpy (hd->last_ubid, batch->items[batch->idx].ubid, UBID_LEN);
+  hd->last_uid_no = batch->items[batch->idx].uid_no;
+  hd->last_pk_no = batch->items[batch->idx].pk_no;
+  hd->last_ubid_valid = 1;
+  batch->idx++;
+  return 0;
+}
+
+
+/* Ask the keyboxd for the next results of the current search of HD
+ * and make the first of them the current search result.  Returns
+ * GPG_ERR_NOT_FOUND if there are no more results.  */
+static gpg_error_t
+fetch_next_batch (KEYDB_HANDLE hd)
+{
+  gpg_error_t err;
+  struct next_batch_s *batch;
+  unsigned int count = hd->kbl->next_count;
+  char line[ASSUAN_LINELENGTH];
+  char *buffer;
+  size_t len, off;
+  unsigned int i;
+
+  if (count < NEXT_BATCH_MIN)
+    count = NEXT_BATCH_MIN;
+  batch = xtrycalloc (1, (sizeof *batch
+                          + (count - 1) * sizeof batch->items[0]));
+  if (!batch)
+    return gpg_error_from_syserror ();
+  batch->count = count;
+  hd->kbl->next_batch = batch;
+
+  snprintf (line, sizeof line, "NEXT --count=%u", count);
+  err = kbx_client_data_cmd (hd->kbl->kcd, line, next_batch_status_cb, hd);
+  if (!err)
+    err = kbx_client_data_wait (hd->kbl->kcd, &buffer, &len);
+  if (err)
+    {
+      release_next_batch (hd->kbl);
+      return err;
+    }
+
+  if (!batch->nitems)
+    {
+      /* An old keyboxd which ignored --count and returned a single
+       * result.  Remember that and use plain NEXT from now on.  */
+      release_next_batch (hd->kbl);
+      hd->kbl->no_next_batch = 1;
+      hd->kbl->search_result = iobuf_temp_with_content (buffer, len);
+      xfree (buffer);
+      return 0;
+    }
+
+  for (off = i = 0; i < batch->nitems; i++)
+    {
+      if (batch->items[i].len > len - off)
+        {
+          xfree (buffer);
+          release_next_batch (hd->kbl);
+          return gpg_error (GPG_ERR_INV_RESPONSE);
+        }
+      off += batch->items[i].len;
+    }
+  batch->buffer = buffer;
+  batch->buflen = len;
+
+  if (count < NEXT_BATCH_MAX)
+    hd->kbl->next_count = count * 2;
+  return take_next_batch_item (hd);
+}
+
+
 /* Search the database for keys matching the search description.  If
  * the DB contains any legacy keys, these are silently ignored.
  *
@@ -680,6 +1202,7 @@ keydb_search (KEYDB_HANDLE hd, KEYDB_SEARCH_DESC *desc,
   char line[ASSUAN_LINELENGTH];
   char *buffer;
   size_t len;
+  int bloom_candidate = 0;
 
   if (!hd)
     return gpg_error (GPG_ERR_INV_ARG);
@@ -723,18 +1246,42 @@ keydb_search (KEYDB_HANDLE hd, KEYDB_SEARCH_DESC *desc,
        * keydb.c functions.  In theory we were able to modify the
        * search pattern between searches but that is not anymore
        * supported by keyboxd and a cursory check does not show that
-       * we actually made used of that misfeature.  */
+       * we actually made used of that misfeature.  To save round
+       * trips for long listings we ask for several results at once
+       * and return them one by one.  */
+      hd->last_ubid_valid = 0;
+      err = take_next_batch_item (hd);
+      if (gpg_err_code (err) != GPG_ERR_NO_DATA)
+        goto leave;
+      if (!hd->kbl->no_next_batch)
+        {
+          err = fetch_next_batch (hd);
+          goto leave;
+        }
       snprintf (line, sizeof line, "NEXT");
       goto do_search;
     }
 
-  hd->kbl->need_search_reset = 0;
-
   if (!ndesc)
     {
+      hd->kbl->need_search_reset = 0;
       err = gpg_error (GPG_ERR_INV_ARG);
       goto leave;
     }
+
+  /* Skip the search if the Bloom filter tells that the key is not in
+   * the database.  The reset flag is kept so that the next search
+   * won't continue an old search.  */
+  if (bloom_rejects (desc, ndesc))
+    {
+      hd->last_ubid_valid = 0;
+      err = gpg_error (GPG_ERR_NOT_FOUND);
+      goto leave;
+    }
+
+  hd->kbl->need_search_reset = 0;
+  hd->kbl->next_count = NEXT_BATCH_MIN;
+  bloom_candidate = bloom_search_p (desc, ndesc);
   for (i = 0; i < ndesc; i++)
     if (desc->mode == KEYDB_SEARCH_MODE_FIRST)
       {
@@ -748,93 +1295,9 @@ keydb_search (KEYDB_HANDLE hd, KEYDB_SEARCH_DESC *desc,
     {
       const char *more = ndesc > 1 ? "--openpgp --more" : "--openpgp";
 
-      switch (desc->mode)
-        {
-        case KEYDB_SEARCH_MODE_EXACT:
-          snprintf (line, sizeof line, "SEARCH %s -- =%s", more, desc->u.name);
-          break;
-
-        case KEYDB_SEARCH_MODE_SUBSTR:
-          snprintf (line, sizeof line, "SEARCH %s -- *%s", more, desc->u.name);
-          break;
-
-        case KEYDB_SEARCH_MODE_MAIL:
-          snprintf (line, sizeof line, "SEARCH %s -- <%s",
-                    more, desc->u.name+(desc->u.name[0] == '<') );
-          break;
-
-        case KEYDB_SEARCH_MODE_MAILSUB:
-          snprintf (line, sizeof line, "SEARCH %s -- @%s", more, desc->u.name);
-          break;
-
-        case KEYDB_SEARCH_MODE_MAILEND:
-          snprintf (line, sizeof line, "SEARCH %s -- .%s", more, desc->u.name);
-          break;
-
-        case KEYDB_SEARCH_MODE_WORDS:
-          snprintf (line, sizeof line, "SEARCH %s -- +%s", more, desc->u.name);
-          break;
-
-        case KEYDB_SEARCH_MODE_SHORT_KID:
-          snprintf (line, sizeof line, "SEARCH %s -- 0x%08lX", more,
-                    (ulong)desc->u.kid[1]);
-          break;
-
-        case KEYDB_SEARCH_MODE_LONG_KID:
-          snprintf (line, sizeof line, "SEARCH %s -- 0x%08lX%08lX", more,
-                    (ulong)desc->u.kid[0], (ulong)desc->u.kid[1]);
-          break;
-
-        case KEYDB_SEARCH_MODE_FPR:
-          {
-            unsigned char hexfpr[MAX_FINGERPRINT_LEN * 2 + 1];
-            log_assert (desc->fprlen <= MAX_FINGERPRINT_LEN);
-            bin2hex (desc->u.fpr, desc->fprlen, hexfpr);
-            snprintf (line, sizeof line, "SEARCH %s -- 0x%s", more, hexfpr);
-          }
-          break;
-
-        case KEYDB_SEARCH_MODE_ISSUER:
-          snprintf (line, sizeof line, "SEARCH %s -- #/%s", more, desc->u.name);
-          break;
-
-        case KEYDB_SEARCH_MODE_ISSUER_SN:
-        case KEYDB_SEARCH_MODE_SN:
-          snprintf (line, sizeof line, "SEARCH %s -- #%s", more, desc->u.name);
-          break;
-
-        case KEYDB_SEARCH_MODE_SUBJECT:
-          snprintf (line, sizeof line, "SEARCH %s -- /%s", more, desc->u.name);
-          break;
-
-        case KEYDB_SEARCH_MODE_KEYGRIP:
-          {
-            unsigned char hexgrip[KEYGRIP_LEN * 2 + 1];
-            bin2hex (desc->u.grip, KEYGRIP_LEN, hexgrip);
-            snprintf (line, sizeof line, "SEARCH %s -- &%s", more, hexgrip);
-          }
-          break;
-
-        case KEYDB_SEARCH_MODE_UBID:
-          {
-            unsigned char hexubid[UBID_LEN * 2 + 1];
-            bin2hex (desc->u.ubid, UBID_LEN, hexubid);
-            snprintf (line, sizeof line, "SEARCH %s -- ^%s", more, hexubid);
-          }
-          break;
-
-        case KEYDB_SEARCH_MODE_NEXT:
-          log_debug ("%s: mode next - we should not get to here!\n", __func__);
-          snprintf (line, sizeof line, "NEXT");
-          break;
-
-        case KEYDB_SEARCH_MODE_FIRST:
-          log_debug ("%s: mode first - we should not get to here!\n", __func__);
-          /*fallthru*/
-        default:
-          err = gpg_error (GPG_ERR_INV_ARG);
-          goto leave;
-        }
+      err = build_search_line (line, sizeof line, desc, more);
+      if (err)
+        goto leave;
 
       if (ndesc > 1)
         {
@@ -857,9 +1320,439 @@ keydb_search (KEYDB_HANDLE hd, KEYDB_SEARCH_DESC *desc,
         log_printhex (hd->last_ubid, 20, "found UBID (%d,%d):",
                       hd->last_uid_no, hd->last_pk_no);
     }
+  else if (bloom_candidate && gpg_err_code (err) == GPG_ERR_NOT_FOUND)
+    {
+      /* A key we were able to check with the filter was not found.
+       * After several such misses fetch the filter to answer further
+       * misses locally.  Not during a bulk import, though, because
+       * each stored key invalidates the filter.  */
+      if (bloom.filter)
+        bloom.false_positives++;
+      else if (!bloom.not_supported && !in_transaction
+               && ++bloom.misses >= BLOOM_FETCH_THRESHOLD)
+        fetch_bloom_filter (hd);
+    }
+
+ leave:
+  if (DBG_CLOCK)
+    log_clock ("%s leave (%sfound)", __func__, err? "not ":"");
+  return err;
+}
+
+
+
+/* Communication object for SEARCH --multi.  */
+struct search_multi_parm_s
+{
+  KEYDB_HANDLE hd;
+  size_t ndesc;
+  size_t *lengths;  /* Per pattern the length of the keyblock or 0.  */
+  int *uid_nos;     /* Per pattern the uid_no from PUBKEY_INFO.  */
+  int *pk_nos;      /* Per pattern the pk_no from PUBKEY_INFO.  */
+  size_t nextidx;   /* The lowest index allowed for the next result.  */
+  unsigned int any_result : 1;  /* At least one SEARCH_RESULT seen.  */
+};
+
+
+/* Status callback for keydb_search_multi.  */
+static gpg_error_t
+search_multi_status_cb (void *opaque, const char *line)
+{
+  struct search_multi_parm_s *parm = opaque;
+  gpg_error_t err;
+  const char *s;
+  char *endp;
+  unsigned long idx, len;
+
+  if ((s = has_leading_keyword (line, "SEARCH_RESULT")))
+    {
+      idx = strtoul (s, &endp, 10);
+      len = strtoul (endp, NULL, 10);
+      if (endp == s || idx < parm->nextidx || idx >= parm->ndesc || !len
+          || !parm->hd->last_ubid_valid)
+        return gpg_error (GPG_ERR_INV_RESPONSE);
+      parm->lengths[idx] = len;
+      parm->uid_nos[idx] = parm->hd->last_uid_no;
+      parm->pk_nos[idx] = parm->hd->last_pk_no;
+      parm->nextidx = idx + 1;
+      parm->any_result = 1;
+      parm->hd->last_ubid_valid = 0;
+      err = 0;
+    }
+  else
+    err = search_status_cb (parm->hd, line);
+
+  return err;
+}
+
+
+/* Search separately for each of the NDESC search descriptions in DESC
+ * and store the first keyblock matching DESC[i] at R_KEYBLOCKS[i] or
+ * NULL if there is no such keyblock.  The caller must provide an
+ * array of NDESC elements at R_KEYBLOCKS and release the returned
+ * keyblocks.  With the keyboxd this takes only a single round trip
+ * instead of one per search description.
+ *
+ * Returns 0 if at least one keyblock was found, GPG_ERR_NOT_FOUND if
+ * nothing was found, or another error code; on error all elements of
+ * R_KEYBLOCKS are set to NULL.  The search position of HD is reset by
+ * this function.  */
+gpg_error_t
+keydb_search_multi (KEYDB_HANDLE hd, KEYDB_SEARCH_DESC *desc, size_t ndesc,
+                    kbnode_t *r_keyblocks)
+{
+  gpg_error_t err;
+  struct search_multi_parm_s parm = { NULL };
+  char line[ASSUAN_LINELENGTH];
+  char *buffer = NULL;
+  size_t len, i, off;
+  int any = 0;
+
+  for (i = 0; i < ndesc; i++)
+    r_keyblocks[i] = NULL;
+
+  if (!hd || !ndesc)
+    return gpg_error (GPG_ERR_INV_ARG);
+
+  if (DBG_CLOCK)
+    log_clock ("%s enter", __func__);
+
+  if (!hd->use_keyboxd || hd->kbl->no_multi_search)
+    goto fallback;
+  for (i = 0; i < ndesc; i++)
+    if (desc[i].mode == KEYDB_SEARCH_MODE_FIRST
+        || desc[i].mode == KEYDB_SEARCH_MODE_NEXT)
+      goto fallback;
+
+  /* Send all patterns but the last with --more and the last one with
+   * --multi so that the keyboxd searches each pattern for itself.  */
+  err = keydb_search_reset (hd);
+  if (err)
+    goto leave;
+  if (hd->kbl->search_result)
+    {
+      iobuf_close (hd->kbl->search_result);
+      hd->kbl->search_result = NULL;
+    }
+
+  for (i = 0; i < ndesc; i++)
+    {
+      const char *more = i + 1 < ndesc? "--openpgp --more"
+                                      : "--openpgp --multi";
+
+      err = build_search_line (line, sizeof line, desc + i, more);
+      if (err)
+        goto leave;
+      if (i + 1 < ndesc)
+        {
+          err = kbx_client_data_simple (hd->kbl->kcd, line);
+          if (err)
+            goto leave;
+        }
+    }
+
+  parm.hd = hd;
+  parm.ndesc = ndesc;
+  parm.lengths = xtrycalloc (ndesc, sizeof *parm.lengths);
+  parm.uid_nos = xtrycalloc (ndesc, sizeof *parm.uid_nos);
+  parm.pk_nos  = xtrycalloc (ndesc, sizeof *parm.pk_nos);
+  if (!parm.lengths || !parm.uid_nos || !parm.pk_nos)
+    {
+      err = gpg_error_from_syserror ();
+      goto leave;
+    }
+
+  err = kbx_client_data_cmd (hd->kbl->kcd, line, search_multi_status_cb, &parm);
+  if (!err)
+    err = kbx_client_data_wait (hd->kbl->kcd, &buffer, &len);
+  hd->last_ubid_valid = 0;
+  if (err)
+    goto leave;
+
+  if (!parm.any_result)
+    {
+      /* An old keyboxd which does not know --multi and took it for
+       * an or-ed search.  Remember that and do it the slow way.  */
+      log_info ("keyboxd does not support %s - falling back\n",
+                "SEARCH --multi");
+      hd->kbl->no_multi_search = 1;
+      xfree (buffer);
+      buffer = NULL;
+      goto fallback;
+    }
+
+  for (off = i = 0; i < ndesc; i++)
+    {
+      iobuf_t iobuf;
+
+      if (!parm.lengths[i])
+        continue;
+      if (parm.lengths[i] > len - off)
+        {
+          err = gpg_error (GPG_ERR_INV_RESPONSE);
+          goto leave;
+        }
+      iobuf = iobuf_temp_with_content (buffer + off, parm.lengths[i]);
+      off += parm.lengths[i];
+      err = keydb_parse_keyblock (iobuf, parm.pk_nos[i], parm.uid_nos[i],
+                                  &r_keyblocks[i], NULL, NULL);
+      iobuf_close (iobuf);
+      if (err)
+        goto leave;
+      any = 1;
+    }
+  goto leave;
+
+ fallback:
+  /* Either we do not use the keyboxd or it can't do a multi search.  */
+  for (i = 0; i < ndesc; i++)
+    {
+      err = keydb_search_reset (hd);
+      if (!err)
+        err = keydb_search (hd, desc + i, 1, NULL);
+      if (gpg_err_code (err) == GPG_ERR_NOT_FOUND)
+        continue;
+      if (!err)
+        err = keydb_get_keyblock (hd, &r_keyblocks[i]);
+      if (err)
+        goto leave;
+      any = 1;
+    }
+  err = 0;
 
  leave:
+  if (!err && !any)
+    err = gpg_error (GPG_ERR_NOT_FOUND);
+  else if (err && gpg_err_code (err) != GPG_ERR_NOT_FOUND)
+    {
+      for (i = 0; i < ndesc; i++)
+        {
+          release_kbnode (r_keyblocks[i]);
+          r_keyblocks[i] = NULL;
+        }
+    }
+  xfree (buffer);
+  xfree (parm.lengths);
+  xfree (parm.uid_nos);
+  xfree (parm.pk_nos);
   if (DBG_CLOCK)
     log_clock ("%s leave (%sfound)", __func__, err? "not ":"");
   return err;
 }
+
+
+
+/* Status callback for keydb_sigcache_get.  */
+static gpg_error_t
+sigcache_status_cb (void *opaque, const char *line)
+{
+  int *r_result = opaque;
+  const char *s;
+
+  if ((s = has_leading_keyword (line, "SIGCACHE")))
+    *r_result = atoi (s);
+
+  return 0;
+}
+
+
+/* Send a SIGCACHE command with the hex encoded KEY to the keyboxd.
+ * If STORE is set RESULT is stored, else the cached result is
+ * returned at R_RESULT.  */
+static gpg_error_t
+sigcache_transact (ctrl_t ctrl, const unsigned char *key,
+                   int store, int result, int *r_result)
+{
+  static int not_supported;
+  gpg_error_t err;
+  keyboxd_local_t kbl;
+  char hexkey[KEYDB_SIGCACHE_KEYLEN * 2 + 1];
+  char line[ASSUAN_LINELENGTH];
+
+  if (!opt.use_keyboxd || not_supported)
+    return gpg_error (GPG_ERR_NOT_SUPPORTED);
+
+  err = open_context (ctrl, &kbl);
+  if (err)
+    return err;
+
+  bin2hex (key, KEYDB_SIGCACHE_KEYLEN, hexkey);
+  if (store)
+    snprintf (line, sizeof line, "SIGCACHE --store=%d %s", result, hexkey);
+  else
+    snprintf (line, sizeof line, "SIGCACHE %s", hexkey);
+  err = assuan_transact (kbl->ctx, line,
+                         NULL, NULL,
+                         NULL, NULL,
+                         store? NULL : sigcache_status_cb, r_result);
+  kbl->is_active = 0;
+
+  /* Old keyboxd versions and the keybox backend do not support the
+   * cache; don't ask again.  */
+  if (gpg_err_code (err) == GPG_ERR_NOT_SUPPORTED
+      || gpg_err_code (err) == GPG_ERR_ASS_UNKNOWN_CMD)
+    {
+      not_supported = 1;
+      err = gpg_error (GPG_ERR_NOT_SUPPORTED);
+    }
+  return err;
+}
+
+
+/* Look up the signature verification cache of the keyboxd for KEY,
+ * which is a KEYDB_SIGCACHE_KEYLEN byte long hash computed by the
+ * caller.  On success the cached result is stored at R_RESULT.
+ * Returns GPG_ERR_NOT_FOUND if there is no such entry and
+ * GPG_ERR_NOT_SUPPORTED if no keyboxd is used.  */
+gpg_error_t
+keydb_sigcache_get (ctrl_t ctrl, const unsigned char *key, int *r_result)
+{
+  gpg_error_t err;
+
+  *r_result = -1;
+  err = sigcache_transact (ctrl, key, 0, 0, r_result);
+  if (!err && *r_result == -1)
+    err = gpg_error (GPG_ERR_NOT_FOUND);
+  return err;
+}
+
+
+/* Store RESULT for KEY in the signature verification cache of the
+ * keyboxd.  */
+gpg_error_t
+keydb_sigcache_put (ctrl_t ctrl, const unsigned char *key, int result)
+{
+  return sigcache_transact (ctrl, key, 1, result, NULL);
+}
+
+
+/* Status callback for keydb_kshash_get.  */
+static gpg_error_t
+kshash_status_cb (void *opaque, const char *line)
+{
+  unsigned char *r_hash = opaque;
+  const char *s;
+
+  if ((s = has_leading_keyword (line, "KSHASH")))
+    {
+      if (hex2bin (s, r_hash, KEYDB_KSHASH_LEN) < 0)
+        return gpg_error (GPG_ERR_INV_RESPONSE);
+    }
+
+  return 0;
+}
+
+
+/* Send a KSHASH command for the key with fingerprint FPR to the
+ * keyboxd.  If STORE is set HASH is stored, else the stored hash is
+ * returned at HASH.  */
+static gpg_error_t
+kshash_transact (ctrl_t ctrl, const byte *fpr, size_t fprlen,
+                 int store, unsigned char *hash)
+{
+  static int not_supported;
+  gpg_error_t err;
+  keyboxd_local_t kbl;
+  char hexubid[UBID_LEN * 2 + 1];
+  char hexhash[KEYDB_KSHASH_LEN * 2 + 1];
+  char line[ASSUAN_LINELENGTH];
+
+  if (!opt.use_keyboxd || not_supported)
+    return gpg_error (GPG_ERR_NOT_SUPPORTED);
+  if (fprlen < UBID_LEN)
+    return gpg_error (GPG_ERR_INV_ARG);
+
+  err = open_context (ctrl, &kbl);
+  if (err)
+    return err;
+
+  /* The UBID of an OpenPGP key is its truncated fingerprint.  */
+  bin2hex (fpr, UBID_LEN, hexubid);
+  if (store)
+    {
+      bin2hex (hash, KEYDB_KSHASH_LEN, hexhash);
+      snprintf (line, sizeof line, "KSHASH --store=%s %s", hexhash, hexubid);
+    }
+  else
+    {
+      memset (hash, 0, KEYDB_KSHASH_LEN);
+      snprintf (line, sizeof line, "KSHASH %s", hexubid);
+    }
+  err = assuan_transact (kbl->ctx, line,
+                         NULL, NULL,
+                         NULL, NULL,
+                         store? NULL : kshash_status_cb, hash);
+  kbl->is_active = 0;
+
+  if (gpg_err_code (err) == GPG_ERR_NOT_SUPPORTED
+      || gpg_err_code (err) == GPG_ERR_ASS_UNKNOWN_CMD)
+    {
+      not_supported = 1;
+      err = gpg_error (GPG_ERR_NOT_SUPPORTED);
+    }
+  return err;
+}
+
+
+/* Look up the hash over the keyblock last received from a keyserver
+ * for the key with fingerprint (FPR,FPRLEN) and store it at R_HASH
+ * which must have room for KEYDB_KSHASH_LEN bytes.  Returns
+ * GPG_ERR_NOT_FOUND if there is no such hash and GPG_ERR_NOT_SUPPORTED
+ * if no keyboxd is used.  */
+gpg_error_t
+keydb_kshash_get (ctrl_t ctrl, const byte *fpr, size_t fprlen,
+                  unsigned char *r_hash)
+{
+  return kshash_transact (ctrl, fpr, fprlen, 0, r_hash);
+}
+
+
+/* Store HASH as the hash over the keyblock received from a keyserver
+ * for the key with fingerprint (FPR,FPRLEN).  */
+gpg_error_t
+keydb_kshash_put (ctrl_t ctrl, const byte *fpr, size_t fprlen,
+                  const unsigned char *hash)
+{
+  return kshash_transact (ctrl, fpr, fprlen, 1, (unsigned char *)hash);
+}
+
+
+
+/* Commit the changes done so far during a bulk import and start a
+ * new transaction.  This limits the size of the keyboxd's journal
+ * and the loss on a crash.  Does nothing if no bulk import
+ * transaction is active.  */
+gpg_error_t
+keydb_bulk_checkpoint (ctrl_t ctrl)
+{
+  gpg_error_t err;
+  keyboxd_local_t kbl;
+
+  if (!opt.use_keyboxd || !in_transaction)
+    return 0;
+
+  err = open_context (ctrl, &kbl);
+  if (err)
+    return err;
+
+  err = assuan_transact (kbl->ctx, "TRANSACTION commit",
+                         NULL, NULL, NULL, NULL, NULL, NULL);
+  if (err)
+    {
+      log_error ("error committing transaction: %s\n", gpg_strerror (err));
+      in_transaction = 0;
+    }
+  else
+    {
+      err = assuan_transact (kbl->ctx, "TRANSACTION begin",
+                             NULL, NULL, NULL, NULL, NULL, NULL);
+      if (err)
+        {
+          log_error ("error enabling bulk import option: %s\n",
+                     gpg_strerror (err));
+          in_transaction = 0;
+        }
+    }
+  kbl->is_active = 0;
+  return err;
+}
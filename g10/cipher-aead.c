@@ -23,6 +23,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include <errno.h>
+#include <npth.h>
 
 #include "gpg.h"
 #include "../common/status.h"
@@ -38,6 +39,24 @@
  * be a multiple of the OCB blocksize (16 byte).  */
 #define AEAD_ENC_BUFFER_SIZE (64*1024)
 
+/* The largest chunk size for which we use worker threads.  Each
+ * worker needs a buffer for an entire chunk and thus we limit this to
+ * the default chunk size of 4 MiB.  */
+#define AEAD_MAX_THREADED_CHUNKSIZE (4*1024*1024)
+
+
+/* A chunk processed by a worker thread.  */
+struct aead_chunk_job_s
+{
+  cipher_filter_context_t *cfx;
+  gcry_cipher_hd_t cipher_hd;  /* Private cipher handle of the job.  */
+  uint64_t chunkindex;         /* The index of this chunk.           */
+  byte *buffer;                /* Buffer of CFX->CHUNKSIZE bytes.    */
+  size_t buflen;               /* Used length of BUFFER.             */
+  byte tag[16];                /* The computed authentication tag.   */
+  gpg_error_t err;             /* The result of the job.             */
+};
+
 
 /* Wrapper around iobuf_write to make sure that a proper error code is
  * always returned.  */
@@ -55,12 +74,13 @@ my_iobuf_write (iobuf_t a, const void *buffer, size_t buflen)
 }
 
 
-/* Set the nonce and the additional data for the current chunk.  If
- * FINAL is set the final AEAD chunk is processed.  This also reset
- * the encryption machinery so that the handle can be used for a new
- * chunk.  */
+/* Set the nonce and the additional data for the chunk CHUNKINDEX
+ * using the cipher handle HD.  If FINAL is set the final AEAD chunk
+ * is processed.  This also reset the encryption machinery so that the
+ * handle can be used for a new chunk.  */
 static gpg_error_t
-set_nonce_and_ad (cipher_filter_context_t *cfx, int final)
+set_nonce_and_ad (cipher_filter_context_t *cfx, gcry_cipher_hd_t hd,
+                  uint64_t chunkindex, int final)
 {
   gpg_error_t err;
   unsigned char nonce[16];
@@ -83,18 +103,18 @@ set_nonce_and_ad (cipher_filter_context_t *cfx, int final)
       BUG ();
     }
 
-  nonce[i++] ^= cfx->chunkindex >> 56;
-  nonce[i++] ^= cfx->chunkindex >> 48;
-  nonce[i++] ^= cfx->chunkindex >> 40;
-  nonce[i++] ^= cfx->chunkindex >> 32;
-  nonce[i++] ^= cfx->chunkindex >> 24;
-  nonce[i++] ^= cfx->chunkindex >> 16;
-  nonce[i++] ^= cfx->chunkindex >>  8;
-  nonce[i++] ^= cfx->chunkindex;
+  nonce[i++] ^= chunkindex >> 56;
+  nonce[i++] ^= chunkindex >> 48;
+  nonce[i++] ^= chunkindex >> 40;
+  nonce[i++] ^= chunkindex >> 32;
+  nonce[i++] ^= chunkindex >> 24;
+  nonce[i++] ^= chunkindex >> 16;
+  nonce[i++] ^= chunkindex >>  8;
+  nonce[i++] ^= chunkindex;
 
   if (DBG_CRYPTO)
     log_printhex (nonce, 15, "nonce:");
-  err = gcry_cipher_setiv (cfx->cipher_hd, nonce, i);
+  err = gcry_cipher_setiv (hd, nonce, i);
   if (err)
     return err;
 
@@ -103,14 +123,14 @@ set_nonce_and_ad (cipher_filter_context_t *cfx, int final)
   ad[2] = cfx->dek->algo;
   ad[3] = cfx->dek->use_aead;
   ad[4] = cfx->chunkbyte;
-  ad[5] = cfx->chunkindex >> 56;
-  ad[6] = cfx->chunkindex >> 48;
-  ad[7] = cfx->chunkindex >> 40;
-  ad[8] = cfx->chunkindex >> 32;
-  ad[9] = cfx->chunkindex >> 24;
-  ad[10]= cfx->chunkindex >> 16;
-  ad[11]= cfx->chunkindex >>  8;
-  ad[12]= cfx->chunkindex;
+  ad[5] = chunkindex >> 56;
+  ad[6] = chunkindex >> 48;
+  ad[7] = chunkindex >> 40;
+  ad[8] = chunkindex >> 32;
+  ad[9] = chunkindex >> 24;
+  ad[10]= chunkindex >> 16;
+  ad[11]= chunkindex >>  8;
+  ad[12]= chunkindex;
   if (final)
     {
       ad[13] = cfx->total >> 56;
@@ -124,7 +144,202 @@ set_nonce_and_ad (cipher_filter_context_t *cfx, int final)
     }
   if (DBG_CRYPTO)
     log_printhex (ad, final? 21 : 13, "authdata:");
-  return gcry_cipher_authenticate (cfx->cipher_hd, ad, final? 21 : 13);
+  return gcry_cipher_authenticate (hd, ad, final? 21 : 13);
+}
+
+
+/* Release the worker jobs of CFX.  */
+static void
+release_chunk_jobs (cipher_filter_context_t *cfx)
+{
+  int i;
+
+  if (!cfx->jobs)
+    return;
+  for (i=0; i < cfx->njobs; i++)
+    {
+      gcry_cipher_close (cfx->jobs[i].cipher_hd);
+      xfree (cfx->jobs[i].buffer);
+    }
+  xfree (cfx->jobs);
+  cfx->jobs = NULL;
+  cfx->njobs = 0;
+  cfx->curjob = 0;
+}
+
+
+/* Prepare CFX for the use of worker threads if this has been
+ * requested.  Each job gets its own cipher handle so that the chunks
+ * can be encrypted independently of each other.  If the secure memory
+ * does not allow for the requested number of handles we use fewer
+ * jobs or fall back to the sequential code.  */
+static gpg_error_t
+setup_chunk_jobs (cipher_filter_context_t *cfx,
+                  enum gcry_cipher_modes ciphermode)
+{
+  gpg_error_t err = 0;
+  struct aead_chunk_job_s *job;
+  int i;
+
+  if (opt.aead_threads < 2 || cfx->chunksize > AEAD_MAX_THREADED_CHUNKSIZE)
+    return 0;
+
+  cfx->jobs = xtrycalloc (opt.aead_threads, sizeof *cfx->jobs);
+  if (!cfx->jobs)
+    return gpg_error_from_syserror ();
+  cfx->curjob = 0;
+
+  for (i=0; i < opt.aead_threads; i++)
+    {
+      job = cfx->jobs + i;
+      job->cfx = cfx;
+      err = openpgp_cipher_open (&job->cipher_hd,
+                                 cfx->dek->algo,
+                                 ciphermode,
+                                 GCRY_CIPHER_SECURE);
+      if (gpg_err_code (err) == GPG_ERR_ENOMEM)
+        {
+          err = 0;
+          break;
+        }
+      if (!err)
+        err = gcry_cipher_setkey (job->cipher_hd,
+                                  cfx->dek->key, cfx->dek->keylen);
+      if (!err)
+        {
+          job->buffer = xtrymalloc (cfx->chunksize);
+          if (!job->buffer)
+            err = gpg_error_from_syserror ();
+        }
+      cfx->njobs++;
+      if (err)
+        goto leave;
+    }
+
+  if (cfx->njobs < 2)
+    release_chunk_jobs (cfx);
+  else if (DBG_FILTER)
+    log_debug ("using %d threads for AEAD encryption\n", cfx->njobs);
+
+ leave:
+  if (err)
+    release_chunk_jobs (cfx);
+  return err;
+}
+
+
+/* Encrypt the chunk described by JOB and compute its tag.  The actual
+ * encryption is done outside of the nPth lock so that several jobs
+ * run concurrently.  */
+static void *
+chunk_job_thread (void *opaque)
+{
+  struct aead_chunk_job_s *job = opaque;
+  gpg_error_t err;
+
+  err = set_nonce_and_ad (job->cfx, job->cipher_hd, job->chunkindex, 0);
+  if (!err)
+    {
+      npth_unprotect ();
+      gcry_cipher_final (job->cipher_hd);
+      err = gcry_cipher_encrypt (job->cipher_hd, job->buffer, job->buflen,
+                                 NULL, 0);
+      if (!err)
+        err = gcry_cipher_gettag (job->cipher_hd, job->tag, 16);
+      npth_protect ();
+    }
+  job->err = err;
+  return NULL;
+}
+
+
+/* Encrypt the first COUNT jobs of CFX in parallel and write them in
+ * order to stream A.  */
+static gpg_error_t
+run_chunk_jobs (cipher_filter_context_t *cfx, iobuf_t a, int count)
+{
+  gpg_error_t err = 0;
+  npth_attr_t tattr;
+  npth_t threads[MAX_AEAD_THREADS];
+  int started[MAX_AEAD_THREADS];
+  struct aead_chunk_job_s *job;
+  int i;
+
+  log_assert (count <= cfx->njobs);
+
+  npth_attr_init (&tattr);
+  npth_attr_setdetachstate (&tattr, NPTH_CREATE_JOINABLE);
+  for (i=0; i < count; i++)
+    {
+      job = cfx->jobs + i;
+      job->chunkindex = cfx->chunkindex + i;
+      job->err = 0;
+      started[i] = !npth_create (&threads[i], &tattr, chunk_job_thread, job);
+      if (!started[i])
+        chunk_job_thread (job);  /* Fallback to the current thread.  */
+    }
+  npth_attr_destroy (&tattr);
+
+  for (i=0; i < count; i++)
+    if (started[i])
+      npth_join (threads[i], NULL);
+
+  for (i=0; i < count; i++)
+    {
+      job = cfx->jobs + i;
+      if (!err)
+        err = job->err;
+      if (!err)
+        err = my_iobuf_write (a, job->buffer, job->buflen);
+      if (!err)
+        err = my_iobuf_write (a, job->tag, 16);
+      if (!err)
+        {
+          if (DBG_FILTER)
+            log_debug ("wrote chunk %ju: chunklen=%zu\n",
+                       (uintmax_t)job->chunkindex, job->buflen);
+          cfx->total += job->buflen;
+          cfx->chunkindex++;
+        }
+      job->buflen = 0;
+    }
+  cfx->curjob = 0;
+
+  return err;
+}
+
+
+/* The threaded variant of do_flush: The data is collected into entire
+ * chunks which are encrypted by worker threads as soon as all job
+ * buffers are filled.  */
+static gpg_error_t
+do_flush_threaded (cipher_filter_context_t *cfx, iobuf_t a,
+                   byte *buf, size_t size)
+{
+  gpg_error_t err = 0;
+  struct aead_chunk_job_s *job;
+  size_t n;
+
+  while (size)
+    {
+      job = cfx->jobs + cfx->curjob;
+      n = cfx->chunksize - job->buflen;
+      if (n > size)
+        n = size;
+      memcpy (job->buffer + job->buflen, buf, n);
+      job->buflen += n;
+      buf  += n;
+      size -= n;
+
+      if (job->buflen == cfx->chunksize && ++cfx->curjob == cfx->njobs)
+        {
+          err = run_chunk_jobs (cfx, a, cfx->njobs);
+          if (err)
+            break;
+        }
+    }
+
+  return err;
 }
 
 
@@ -200,6 +415,10 @@ write_header (cipher_filter_context_t *cfx, iobuf_t a)
   if (err)
     return err;
 
+  err = setup_chunk_jobs (cfx, ciphermode);
+  if (err)
+    goto leave;
+
   cfx->wrote_header = 1;
 
  leave:
@@ -235,7 +454,7 @@ write_final_chunk (cipher_filter_context_t *cfx, iobuf_t a)
   gpg_error_t err;
   char dummy[1];
 
-  err = set_nonce_and_ad (cfx, 1);
+  err = set_nonce_and_ad (cfx, cfx->cipher_hd, cfx->chunkindex, 1);
   if (err)
     goto leave;
 
@@ -261,6 +480,9 @@ do_flush (cipher_filter_context_t *cfx, iobuf_t a, byte *buf, size_t size)
   int finalize = 0;
   size_t n;
 
+  if (cfx->jobs)
+    return do_flush_threaded (cfx, a, buf, size);
+
   /* Put the data into a buffer, flush and encrypt as needed.  */
   if (DBG_FILTER)
     log_debug ("flushing %zu bytes (cur buflen=%zu)\n", size, cfx->buflen);
@@ -343,7 +565,8 @@ do_flush (cipher_filter_context_t *cfx, iobuf_t a, byte *buf, size_t size)
             {
               if (DBG_FILTER)
                 log_debug ("start encrypting a new chunk\n");
-              err = set_nonce_and_ad (cfx, 0);
+              err = set_nonce_and_ad (cfx, cfx->cipher_hd,
+                                      cfx->chunkindex, 0);
               if (err)
                 goto leave;
             }
@@ -407,7 +630,19 @@ do_free (cipher_filter_context_t *cfx, iobuf_t a)
   if (DBG_FILTER)
     log_debug ("do_free: buflen=%zu\n", cfx->buflen);
 
-  if (cfx->chunklen || cfx->buflen)
+  if (cfx->jobs)
+    {
+      /* Encrypt the pending chunks including a partial last one.  */
+      int count = cfx->curjob + !!cfx->jobs[cfx->curjob].buflen;
+
+      if (count)
+        {
+          err = run_chunk_jobs (cfx, a, count);
+          if (err)
+            goto leave;
+        }
+    }
+  else if (cfx->chunklen || cfx->buflen)
     {
       if (DBG_FILTER)
         log_debug ("encrypting last %zu bytes of the last chunk\n",cfx->buflen);
@@ -416,7 +651,8 @@ do_free (cipher_filter_context_t *cfx, iobuf_t a)
         {
           if (DBG_FILTER)
             log_debug ("start encrypting a new chunk\n");
-          err = set_nonce_and_ad (cfx, 0);
+          err = set_nonce_and_ad (cfx, cfx->cipher_hd,
+                                  cfx->chunkindex, 0);
           if (err)
             goto leave;
         }
@@ -450,6 +686,7 @@ do_free (cipher_filter_context_t *cfx, iobuf_t a)
   err = write_final_chunk (cfx, a);
 
  leave:
+  release_chunk_jobs (cfx);
   xfree (cfx->buffer);
   cfx->buffer = NULL;
   gcry_cipher_close (cfx->cipher_hd);
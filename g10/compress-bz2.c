@@ -36,6 +36,10 @@
    do ZIP, ZLIB, and BZIP2, but it became dangerously unreadable with
    #ifdefs and if(algo) -dshaw */
 
+/* See compress.c for the rationale of these sizes.  */
+#define COMPRESS_BUFSIZE   (64*1024)
+#define UNCOMPRESS_BUFSIZE (32*1024)
+
 static void
 init_compress( compress_filter_context_t *zfx, bz_stream *bzs )
 {
@@ -55,7 +59,7 @@ init_compress( compress_filter_context_t *zfx, bz_stream *bzs )
   if((rc=BZ2_bzCompressInit(bzs,level,0,0))!=BZ_OK)
     log_fatal("bz2lib problem: %d\n",rc);
 
-  zfx->outbufsize = 8192;
+  zfx->outbufsize = COMPRESS_BUFSIZE;
   zfx->outbuf = xmalloc( zfx->outbufsize );
 }
 
@@ -108,7 +112,7 @@ init_uncompress( compress_filter_context_t *zfx, bz_stream *bzs )
   if((rc=BZ2_bzDecompressInit(bzs,0,opt.bz2_decompress_lowmem))!=BZ_OK)
     log_fatal("bz2lib problem: %d\n",rc);
 
-  zfx->inbufsize = 2048;
+  zfx->inbufsize = UNCOMPRESS_BUFSIZE;
   zfx->inbuf = xmalloc( zfx->inbufsize );
   bzs->avail_in = 0;
 }
@@ -48,6 +48,16 @@
 #define BYTEF_CAST(a) (a)
 #endif
 
+/* Size of the buffers used to feed the compressor and to collect its
+ * output.  Larger buffers mean fewer calls into zlib and iobuf.  */
+#define COMPRESS_BUFSIZE   (64*1024)
+#define UNCOMPRESS_BUFSIZE (32*1024)
+
+/* After this many input bytes the compression ratio is checked.  If
+ * deflate did not save at least 10% we switch to level 0 for the rest
+ * of the data; it is most likely already compressed.  */
+#define COMPRESS_SAMPLE_SIZE (1024*1024)
+
 
 
 int compress_filter_bz2( void *opaque, int control,
@@ -79,7 +89,7 @@ init_compress( compress_filter_context_t *zfx, z_stream *zs )
 						       "unknown error" );
     }
 
-    zfx->outbufsize = 8192;
+    zfx->outbufsize = COMPRESS_BUFSIZE;
     zfx->outbuf = xmalloc( zfx->outbufsize );
 }
 
@@ -123,6 +133,41 @@ do_compress( compress_filter_context_t *zfx, z_stream *zs, int flush, IOBUF a )
     return 0;
 }
 
+
+/* Check the compression ratio after the first COMPRESS_SAMPLE_SIZE
+ * bytes and switch off compression if the data looks incompressible.
+ * This keeps a valid deflate stream; the remaining data is written
+ * as stored blocks.  */
+static int
+check_compress_ratio (compress_filter_context_t *zfx, z_stream *zs, IOBUF a)
+{
+    int rc;
+    int zrc;
+    unsigned n;
+
+    if (zfx->sampled || zs->total_in < COMPRESS_SAMPLE_SIZE)
+      return 0;
+    zfx->sampled = 1;
+
+    if (zs->total_out < zs->total_in / 10 * 9)
+      return 0;  /* Compression pays off.  */
+
+    if (opt.verbose)
+      log_info ("data does not compress well - switching off compression\n");
+
+    do {
+	zs->next_out = BYTEF_CAST (zfx->outbuf);
+	zs->avail_out = zfx->outbufsize;
+	zrc = deflateParams (zs, Z_NO_COMPRESSION, Z_DEFAULT_STRATEGY);
+	n = zfx->outbufsize - zs->avail_out;
+	if (n && (rc=iobuf_write (a, zfx->outbuf, n))) {
+	    log_debug("deflate: iobuf_write failed\n");
+	    return rc;
+	}
+    } while (zrc == Z_BUF_ERROR && n);
+    return 0;
+}
+
 static void
 init_uncompress( compress_filter_context_t *zfx, z_stream *zs )
 {
@@ -146,7 +191,7 @@ init_uncompress( compress_filter_context_t *zfx, z_stream *zs )
 						       "unknown error" );
     }
 
-    zfx->inbufsize = 2048;
+    zfx->inbufsize = UNCOMPRESS_BUFSIZE;
     zfx->inbuf = xmalloc( zfx->inbufsize );
     zs->avail_in = 0;
 }
@@ -259,6 +304,8 @@ compress_filter( void *opaque, int control,
 	zs->next_in = BYTEF_CAST (buf);
 	zs->avail_in = size;
 	rc = do_compress( zfx, zs, Z_NO_FLUSH, a );
+	if (!rc)
+	    rc = check_compress_ratio (zfx, zs, a);
     }
     else if( control == IOBUFCTRL_FREE ) {
 	if( zfx->status == 1 ) {
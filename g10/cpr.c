@@ -43,6 +43,73 @@
    this is NULL.  */
 static estream_t statusfp;
 
+/* The time of the last flush of STATUSFP; only used with
+   --status-buffered.  */
+static u32 status_last_flush;
+
+
+/* Return true if the status line NO must be flushed immediately even
+   with --status-buffered.  These are the prompts where the other end
+   is waiting for us and the status lines marking the end of an
+   operation.  */
+static int
+status_needs_flush (int no)
+{
+  switch (no)
+    {
+    case STATUS_GET_BOOL:
+    case STATUS_GET_LINE:
+    case STATUS_GET_HIDDEN:
+    case STATUS_GOT_IT:
+    case STATUS_NEED_PASSPHRASE:
+    case STATUS_NEED_PASSPHRASE_SYM:
+    case STATUS_NEED_PASSPHRASE_PIN:
+    case STATUS_PINENTRY_LAUNCHED:
+    case STATUS_INQUIRE_MAXLEN:
+    case STATUS_IMPORT_RES:
+    case STATUS_EXPORT_RES:
+    case STATUS_END_DECRYPTION:
+    case STATUS_END_ENCRYPTION:
+    case STATUS_SIG_CREATED:
+    case STATUS_KEY_CREATED:
+    case STATUS_SUCCESS:
+    case STATUS_FAILURE:
+      return 1;
+    default:
+      break;
+    }
+  return 0;
+}
+
+
+/* Flush the status line NO just written to STATUSFP.  With
+   --status-buffered the flush is deferred until a line which needs to
+   be seen right away is written or at least a second has passed.  */
+static void
+flush_status (int no)
+{
+  if (opt.status_buffered && !status_needs_flush (no))
+    {
+      u32 now = make_timestamp ();
+
+      if (now == status_last_flush)
+        return;
+      status_last_flush = now;
+    }
+
+  if (es_fflush (statusfp) && opt.exit_on_status_write_error)
+    g10_exit (0);
+}
+
+
+/* Flush all pending status output.  This is called before exiting.  */
+void
+flush_status_fd (void)
+{
+  if (statusfp)
+    es_fflush (statusfp);
+}
+
 
 static void
 progress_cb (void *ctx, const char *what, int printchar,
@@ -52,6 +119,19 @@ progress_cb (void *ctx, const char *what, int printchar,
 
   (void)ctx;
 
+  /* With buffered status output there is no point in emitting each
+     of the many spinner characters; only one per second and the
+     final line are written.  */
+  if (opt.status_buffered && printchar != '\n')
+    {
+      static u32 last_time;
+      u32 now = make_timestamp ();
+
+      if (now == last_time)
+        return;
+      last_time = now;
+    }
+
   if ( printchar == '\n' && !strcmp (what, "primegen") )
     snprintf (buf, sizeof buf, "%.20s X 100 100", what );
   else
@@ -176,8 +256,7 @@ write_status_strings (int no, const char *text, ...)
       va_end (arg_ptr);
     }
   es_putc ('\n', statusfp);
-  if (es_fflush (statusfp) && opt.exit_on_status_write_error)
-    g10_exit (0);
+  flush_status (no);
 }
 
 
@@ -218,8 +297,7 @@ write_status_strings2 (ctrl_t dummy, int no, ...)
 
   va_end (arg_ptr);
 
-  if (es_fflush (statusfp) && opt.exit_on_status_write_error)
-    g10_exit (0);
+  flush_status (no);
 
   return 0;
 }
@@ -276,8 +354,7 @@ write_status_printf (int no, const char *format, ...)
       va_end (arg_ptr);
     }
   es_putc ('\n', statusfp);
-  if (es_fflush (statusfp) && opt.exit_on_status_write_error)
-    g10_exit (0);
+  flush_status (no);
 }
 
 
@@ -290,8 +367,7 @@ write_status_error (const char *where, gpg_error_t err)
 
   es_fprintf (statusfp, "[GNUPG:] %s %s %u\n",
               get_status_string (STATUS_ERROR), where, err);
-  if (es_fflush (statusfp) && opt.exit_on_status_write_error)
-    g10_exit (0);
+  flush_status (STATUS_ERROR);
 }
 
 
@@ -304,8 +380,7 @@ write_status_errcode (const char *where, int errcode)
 
   es_fprintf (statusfp, "[GNUPG:] %s %s %u\n",
               get_status_string (STATUS_ERROR), where, gpg_err_code (errcode));
-  if (es_fflush (statusfp) && opt.exit_on_status_write_error)
-    g10_exit (0);
+  flush_status (STATUS_ERROR);
 }
 
 
@@ -322,8 +397,7 @@ write_status_failure (const char *where, gpg_error_t err)
   any_failure_printed = 1;
   es_fprintf (statusfp, "[GNUPG:] %s %s %u\n",
               get_status_string (STATUS_FAILURE), where, err);
-  if (es_fflush (statusfp) && opt.exit_on_status_write_error)
-    g10_exit (0);
+  flush_status (STATUS_FAILURE);
 }
 
 
@@ -397,8 +471,7 @@ write_status_text_and_buffer (int no, const char *string,
   while (len);
 
   es_putc ('\n',statusfp);
-  if (es_fflush (statusfp) && opt.exit_on_status_write_error)
-    g10_exit (0);
+  flush_status (no);
 }
 
 
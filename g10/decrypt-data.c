@@ -23,6 +23,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <npth.h>
 
 #include "gpg.h"
 #include "../common/util.h"
@@ -40,6 +41,14 @@ static int mdc_decode_filter ( void *opaque, int control, IOBUF a,
 static int decode_filter ( void *opaque, int control, IOBUF a,
 					byte *buf, size_t *ret_len);
 
+/* The largest chunk size for which we use worker threads.  Each
+ * worker needs a buffer for an entire chunk and thus we limit this to
+ * the default chunk size of 4 MiB.  */
+#define AEAD_MAX_THREADED_CHUNKSIZE (4*1024*1024)
+
+/* A chunk decrypted by a worker thread.  */
+struct aead_decode_job_s;
+
 /* Our context object.  */
 struct decode_filter_context_s
 {
@@ -96,10 +105,53 @@ struct decode_filter_context_s
   /* Remaining bytes in the packet according to the packet header.
    * Not used if PARTIAL is true.  */
   size_t length;
+
+  /* If not NULL the AEAD chunks are decrypted by worker threads.
+   * This is an array of NJOBS chunk buffers.  The plaintext of the
+   * first OUTCOUNT jobs has been authenticated and is returned
+   * starting at job OUTJOB and offset OUTPOS.  */
+  struct aead_decode_job_s *jobs;
+  int njobs;
+  int outjob;
+  int outcount;
+  size_t outpos;
 };
 typedef struct decode_filter_context_s *decode_filter_ctx_t;
 
 
+struct aead_decode_job_s
+{
+  decode_filter_ctx_t dfx;
+  gcry_cipher_hd_t cipher_hd;  /* Private cipher handle of the job.  */
+  uint64_t chunkindex;         /* The index of this chunk.           */
+  byte *buffer;                /* Buffer of DFX->CHUNKSIZE+32 bytes. */
+  size_t buflen;               /* Length of the chunk's data.        */
+  gpg_error_t err;             /* The result of the job.             */
+};
+
+
+/* Release the worker jobs of DFX.  */
+static void
+release_decode_jobs (decode_filter_ctx_t dfx)
+{
+  int i;
+
+  if (!dfx->jobs)
+    return;
+  for (i=0; i < dfx->njobs; i++)
+    {
+      gcry_cipher_close (dfx->jobs[i].cipher_hd);
+      if (dfx->jobs[i].buffer)
+        wipememory (dfx->jobs[i].buffer, dfx->chunksize + 32);
+      xfree (dfx->jobs[i].buffer);
+    }
+  xfree (dfx->jobs);
+  dfx->jobs = NULL;
+  dfx->njobs = 0;
+  dfx->outjob = dfx->outcount = 0;
+}
+
+
 /* Helper to release the decode context.  */
 static void
 release_dfx_context (decode_filter_ctx_t dfx)
@@ -110,6 +162,7 @@ release_dfx_context (decode_filter_ctx_t dfx)
   log_assert (dfx->refcount);
   if ( !--dfx->refcount )
     {
+      release_decode_jobs (dfx);
       gcry_cipher_close (dfx->cipher_hd);
       dfx->cipher_hd = NULL;
       gcry_md_close (dfx->mdc_hash);
@@ -119,12 +172,13 @@ release_dfx_context (decode_filter_ctx_t dfx)
 }
 
 
-/* Set the nonce and the additional data for the current chunk.  This
- * also reset the decryption machinery so that the handle can be
- * used for a new chunk.  If FINAL is set the final AEAD chunk is
- * processed.  */
+/* Set the nonce and the additional data for the chunk CHUNKINDEX
+ * using the cipher handle HD.  This also reset the decryption
+ * machinery so that the handle can be used for a new chunk.  If FINAL
+ * is set the final AEAD chunk is processed.  */
 static gpg_error_t
-aead_set_nonce_and_ad (decode_filter_ctx_t dfx, int final)
+aead_set_nonce_and_ad (decode_filter_ctx_t dfx, gcry_cipher_hd_t hd,
+                       uint64_t chunkindex, int final)
 {
   gpg_error_t err;
   unsigned char ad[21];
@@ -146,18 +200,18 @@ aead_set_nonce_and_ad (decode_filter_ctx_t dfx, int final)
     default:
       BUG ();
     }
-  nonce[i++] ^= dfx->chunkindex >> 56;
-  nonce[i++] ^= dfx->chunkindex >> 48;
-  nonce[i++] ^= dfx->chunkindex >> 40;
-  nonce[i++] ^= dfx->chunkindex >> 32;
-  nonce[i++] ^= dfx->chunkindex >> 24;
-  nonce[i++] ^= dfx->chunkindex >> 16;
-  nonce[i++] ^= dfx->chunkindex >>  8;
-  nonce[i++] ^= dfx->chunkindex;
+  nonce[i++] ^= chunkindex >> 56;
+  nonce[i++] ^= chunkindex >> 48;
+  nonce[i++] ^= chunkindex >> 40;
+  nonce[i++] ^= chunkindex >> 32;
+  nonce[i++] ^= chunkindex >> 24;
+  nonce[i++] ^= chunkindex >> 16;
+  nonce[i++] ^= chunkindex >>  8;
+  nonce[i++] ^= chunkindex;
 
   if (DBG_CRYPTO)
     log_printhex (nonce, i, "nonce:");
-  err = gcry_cipher_setiv (dfx->cipher_hd, nonce, i);
+  err = gcry_cipher_setiv (hd, nonce, i);
   if (err)
     return err;
 
@@ -166,14 +220,14 @@ aead_set_nonce_and_ad (decode_filter_ctx_t dfx, int final)
   ad[2] = dfx->cipher_algo;
   ad[3] = dfx->aead_algo;
   ad[4] = dfx->chunkbyte;
-  ad[5] = dfx->chunkindex >> 56;
-  ad[6] = dfx->chunkindex >> 48;
-  ad[7] = dfx->chunkindex >> 40;
-  ad[8] = dfx->chunkindex >> 32;
-  ad[9] = dfx->chunkindex >> 24;
-  ad[10]= dfx->chunkindex >> 16;
-  ad[11]= dfx->chunkindex >>  8;
-  ad[12]= dfx->chunkindex;
+  ad[5] = chunkindex >> 56;
+  ad[6] = chunkindex >> 48;
+  ad[7] = chunkindex >> 40;
+  ad[8] = chunkindex >> 32;
+  ad[9] = chunkindex >> 24;
+  ad[10]= chunkindex >> 16;
+  ad[11]= chunkindex >>  8;
+  ad[12]= chunkindex;
   if (final)
     {
       ad[13] = dfx->total >> 56;
@@ -187,20 +241,20 @@ aead_set_nonce_and_ad (decode_filter_ctx_t dfx, int final)
     }
   if (DBG_CRYPTO)
     log_printhex (ad, final? 21 : 13, "authdata:");
-  return gcry_cipher_authenticate (dfx->cipher_hd, ad, final? 21 : 13);
+  return gcry_cipher_authenticate (hd, ad, final? 21 : 13);
 }
 
 
-/* Helper to check the 16 byte tag in TAGBUF.  The FINAL flag is only
- * for debug messages.  */
+/* Helper to check the 16 byte tag in TAGBUF using the cipher handle
+ * HD.  The FINAL flag is only for debug messages.  */
 static gpg_error_t
-aead_checktag (decode_filter_ctx_t dfx, int final, const void *tagbuf)
+aead_checktag (gcry_cipher_hd_t hd, int final, const void *tagbuf)
 {
   gpg_error_t err;
 
   if (DBG_FILTER)
     log_printhex (tagbuf, 16, "tag:");
-  err = gcry_cipher_checktag (dfx->cipher_hd, tagbuf, 16);
+  err = gcry_cipher_checktag (hd, tagbuf, 16);
   if (err)
     {
       log_error ("gcry_cipher_checktag%s failed: %s\n",
@@ -213,6 +267,69 @@ aead_checktag (decode_filter_ctx_t dfx, int final, const void *tagbuf)
 }
 
 
+/* Prepare DFX for the use of worker threads if this has been
+ * requested.  Each job gets its own cipher handle with the key from
+ * DEK so that the chunks can be decrypted independently of each
+ * other.  If the secure memory does not allow for the requested
+ * number of handles we use fewer jobs or fall back to the sequential
+ * code.  */
+static gpg_error_t
+setup_decode_jobs (decode_filter_ctx_t dfx, DEK *dek,
+                   enum gcry_cipher_modes ciphermode)
+{
+  gpg_error_t err = 0;
+  struct aead_decode_job_s *job;
+  int i;
+
+  if (opt.aead_threads < 2 || dfx->chunksize > AEAD_MAX_THREADED_CHUNKSIZE)
+    return 0;
+
+  dfx->jobs = xtrycalloc (opt.aead_threads, sizeof *dfx->jobs);
+  if (!dfx->jobs)
+    return gpg_error_from_syserror ();
+
+  for (i=0; i < opt.aead_threads; i++)
+    {
+      job = dfx->jobs + i;
+      job->dfx = dfx;
+      err = openpgp_cipher_open (&job->cipher_hd,
+                                 dfx->cipher_algo,
+                                 ciphermode,
+                                 GCRY_CIPHER_SECURE);
+      if (gpg_err_code (err) == GPG_ERR_ENOMEM)
+        {
+          err = 0;
+          break;
+        }
+      if (!err)
+        {
+          err = gcry_cipher_setkey (job->cipher_hd, dek->key, dek->keylen);
+          if (gpg_err_code (err) == GPG_ERR_WEAK_KEY)
+            err = 0;  /* Already reported for the main handle.  */
+        }
+      if (!err)
+        {
+          job->buffer = xtrymalloc (dfx->chunksize + 32);
+          if (!job->buffer)
+            err = gpg_error_from_syserror ();
+        }
+      dfx->njobs++;
+      if (err)
+        goto leave;
+    }
+
+  if (dfx->njobs < 2)
+    release_decode_jobs (dfx);
+  else if (DBG_FILTER)
+    log_debug ("using %d threads for AEAD decryption\n", dfx->njobs);
+
+ leave:
+  if (err)
+    release_decode_jobs (dfx);
+  return err;
+}
+
+
 /****************
  * Decrypt the data, specified by ED with the key DEK.  On return
  * COMPLIANCE_ERROR is set to true iff the decryption can claim that
@@ -384,6 +501,9 @@ decrypt_data (ctrl_t ctrl, void *procctx, PKT_encrypted *ed, DEK *dek,
           goto leave;
         }
 
+      rc = setup_decode_jobs (dfx, dek, ciphermode);
+      if (rc)
+        goto leave;
     }
   else /* CFB encryption.  */
     {
@@ -692,7 +812,8 @@ aead_underflow (decode_filter_ctx_t dfx, iobuf_t a, byte *buf, size_t *ret_len)
       if (!dfx->chunklen)
         {
           /* First data for this chunk - prepare.  */
-          err = aead_set_nonce_and_ad (dfx, 0);
+          err = aead_set_nonce_and_ad (dfx, dfx->cipher_hd,
+                                       dfx->chunkindex, 0);
           if (err)
             goto leave;
         }
@@ -759,7 +880,7 @@ aead_underflow (decode_filter_ctx_t dfx, iobuf_t a, byte *buf, size_t *ret_len)
           memmove (buf + off, buf + off + 16, len - 16);
           len -= 16;
         }
-      err = aead_checktag (dfx, 0, tagbuf);
+      err = aead_checktag (dfx->cipher_hd, 0, tagbuf);
       if (err)
         goto leave;
       dfx->chunklen = 0;
@@ -774,7 +895,8 @@ aead_underflow (decode_filter_ctx_t dfx, iobuf_t a, byte *buf, size_t *ret_len)
       if (!dfx->chunklen)
         {
           /* First data for this chunk - prepare.  */
-          err = aead_set_nonce_and_ad (dfx, 0);
+          err = aead_set_nonce_and_ad (dfx, dfx->cipher_hd,
+                                       dfx->chunkindex, 0);
           if (err)
             goto leave;
         }
@@ -808,7 +930,7 @@ aead_underflow (decode_filter_ctx_t dfx, iobuf_t a, byte *buf, size_t *ret_len)
           if (DBG_FILTER)
             log_debug ("eof seen: holdback has the last and final tag\n");
           log_assert (dfx->holdbacklen >= 32);
-          err = aead_checktag (dfx, 0, dfx->holdback);
+          err = aead_checktag (dfx->cipher_hd, 0, dfx->holdback);
           if (err)
             goto leave;
           dfx->chunklen = 0;
@@ -824,7 +946,7 @@ aead_underflow (decode_filter_ctx_t dfx, iobuf_t a, byte *buf, size_t *ret_len)
         }
 
       /* Check the final chunk.  */
-      err = aead_set_nonce_and_ad (dfx, 1);
+      err = aead_set_nonce_and_ad (dfx, dfx->cipher_hd, dfx->chunkindex, 1);
       if (err)
         goto leave;
       gcry_cipher_final (dfx->cipher_hd);
@@ -836,7 +958,7 @@ aead_underflow (decode_filter_ctx_t dfx, iobuf_t a, byte *buf, size_t *ret_len)
                      gpg_strerror (err));
           goto leave;
         }
-      err = aead_checktag (dfx, 1, dfx->holdback+off);
+      err = aead_checktag (dfx->cipher_hd, 1, dfx->holdback+off);
       if (err)
         goto leave;
       err = gpg_error (GPG_ERR_EOF);
@@ -863,6 +985,207 @@ aead_underflow (decode_filter_ctx_t dfx, iobuf_t a, byte *buf, size_t *ret_len)
 }
 
 
+/* Decrypt the chunk described by JOB and check its tag which is
+ * stored right after the data.  The actual decryption is done outside
+ * of the nPth lock so that several jobs run concurrently.  */
+static void *
+decode_job_thread (void *opaque)
+{
+  struct aead_decode_job_s *job = opaque;
+  gpg_error_t err;
+
+  err = aead_set_nonce_and_ad (job->dfx, job->cipher_hd, job->chunkindex, 0);
+  if (!err)
+    {
+      npth_unprotect ();
+      gcry_cipher_final (job->cipher_hd);
+      err = gcry_cipher_decrypt (job->cipher_hd, job->buffer, job->buflen,
+                                 NULL, 0);
+      if (!err)
+        err = gcry_cipher_checktag (job->cipher_hd,
+                                    job->buffer + job->buflen, 16);
+      npth_protect ();
+      if (err)
+        log_error ("decrypting chunk %llu failed: %s\n",
+                   (unsigned long long)job->chunkindex, gpg_strerror (err));
+    }
+  job->err = err;
+  return NULL;
+}
+
+
+/* Read up to DFX->NJOBS chunks and decrypt them in parallel.  On
+ * success the authenticated plaintext is made available for
+ * aead_underflow_threaded.  Each job buffer receives the ciphertext
+ * of the chunk, its tag and 16 bytes of lookahead which are either
+ * the start of the next chunk or the final tag.  */
+static gpg_error_t
+decode_chunk_jobs (decode_filter_ctx_t dfx, iobuf_t a)
+{
+  gpg_error_t err = 0;
+  npth_attr_t tattr;
+  npth_t threads[MAX_AEAD_THREADS];
+  int started[MAX_AEAD_THREADS];
+  struct aead_decode_job_s *job;
+  byte finaltag[16];
+  size_t n;
+  int count, i;
+
+  /* Read the chunks.  The lookahead of the last read is kept in the
+   * holdback buffer.   */
+  for (count=0; count < dfx->njobs && !dfx->eof_seen; count++)
+    {
+      job = dfx->jobs + count;
+      memcpy (job->buffer, dfx->holdback, dfx->holdbacklen);
+      n = fill_buffer (dfx, a, job->buffer, dfx->chunksize + 32,
+                       dfx->holdbacklen);
+      if (n < 16 || (dfx->eof_seen && n > 16 && n < 32))
+        return gpg_error (GPG_ERR_TRUNCATED);
+      if (dfx->eof_seen)
+        {
+          /* The last 16 bytes are the final tag.  */
+          memcpy (finaltag, job->buffer + n - 16, 16);
+          n -= 16;
+          dfx->holdbacklen = 0;
+        }
+      else
+        {
+          memcpy (dfx->holdback, job->buffer + n - 16, 16);
+          dfx->holdbacklen = 16;
+          n -= 16;
+        }
+      if (!n)
+        break;  /* Only the final tag was left.  */
+      job->buflen = n - 16;
+      job->chunkindex = dfx->chunkindex + count;
+      job->err = 0;
+    }
+
+  if (DBG_FILTER)
+    log_debug ("decrypting %d chunks starting at %llu%s\n", count,
+               (unsigned long long)dfx->chunkindex,
+               dfx->eof_seen? " eof":"");
+
+  npth_attr_init (&tattr);
+  npth_attr_setdetachstate (&tattr, NPTH_CREATE_JOINABLE);
+  for (i=0; i < count; i++)
+    {
+      started[i] = !npth_create (&threads[i], &tattr, decode_job_thread,
+                                 dfx->jobs + i);
+      if (!started[i])
+        decode_job_thread (dfx->jobs + i);  /* Run in the current thread.  */
+    }
+  npth_attr_destroy (&tattr);
+  for (i=0; i < count; i++)
+    if (started[i])
+      npth_join (threads[i], NULL);
+
+  for (i=0; i < count; i++)
+    {
+      job = dfx->jobs + i;
+      if (job->err)
+        return job->err;
+      dfx->total += job->buflen;
+      dfx->chunkindex++;
+    }
+
+  if (dfx->eof_seen)
+    {
+      /* Check the final chunk before releasing any plaintext of the
+       * last chunks.  */
+      err = aead_set_nonce_and_ad (dfx, dfx->cipher_hd, dfx->chunkindex, 1);
+      if (err)
+        return err;
+      gcry_cipher_final (dfx->cipher_hd);
+      /* Decrypt an empty string (using FINALTAG as a dummy).  */
+      err = gcry_cipher_decrypt (dfx->cipher_hd, finaltag, 0, NULL, 0);
+      if (err)
+        {
+          log_error ("gcry_cipher_decrypt failed (final): %s\n",
+                     gpg_strerror (err));
+          return err;
+        }
+      err = aead_checktag (dfx->cipher_hd, 1, finaltag);
+      if (err)
+        return err;
+    }
+
+  dfx->outjob = 0;
+  dfx->outcount = count;
+  dfx->outpos = 0;
+  return 0;
+}
+
+
+/* The threaded variant of aead_underflow: Return already
+ * authenticated plaintext or decode the next set of chunks.  */
+static gpg_error_t
+aead_underflow_threaded (decode_filter_ctx_t dfx, iobuf_t a,
+                         byte *buf, size_t *ret_len)
+{
+  const size_t size = *ret_len; /* The allocated size of BUF.  */
+  gpg_error_t err = 0;
+  size_t totallen = 0;
+  struct aead_decode_job_s *job;
+  size_t n;
+
+  while (totallen < size)
+    {
+      if (dfx->outjob == dfx->outcount)
+        {
+          if (dfx->eof_seen)
+            {
+              err = gpg_error (GPG_ERR_EOF);
+              break;
+            }
+          if (totallen)
+            break;  /* Return what we have so far.  */
+          err = decode_chunk_jobs (dfx, a);
+          if (err)
+            goto leave;
+          continue;
+        }
+
+      job = dfx->jobs + dfx->outjob;
+      n = job->buflen - dfx->outpos;
+      if (n > size - totallen)
+        n = size - totallen;
+      memcpy (buf + totallen, job->buffer + dfx->outpos, n);
+      totallen += n;
+      dfx->outpos += n;
+      if (dfx->outpos == job->buflen)
+        {
+          dfx->outjob++;
+          dfx->outpos = 0;
+        }
+    }
+
+  if (dfx->eof_seen && dfx->outjob == dfx->outcount)
+    err = gpg_error (GPG_ERR_EOF);
+
+ leave:
+  if (DBG_FILTER)
+    log_debug ("aead_underflow_threaded: returning %zu (%s)\n",
+               totallen, gpg_strerror (err));
+
+  /* In case of an auth error we map the error code to the same as
+   * used by the MDC decryption.  */
+  if (gpg_err_code (err) == GPG_ERR_CHECKSUM)
+    err = gpg_error (GPG_ERR_BAD_SIGNATURE);
+
+  if (err && gpg_err_code (err) != GPG_ERR_EOF)
+    {
+      memset (buf, 0, size);
+      totallen = 0;
+      dfx->outjob = dfx->outcount = 0;
+    }
+
+  *ret_len = totallen;
+
+  return err;
+}
+
+
 /* The IOBUF filter used to decrypt AEAD encrypted data.  */
 static int
 aead_decode_filter (void *opaque, int control, IOBUF a,
@@ -871,7 +1194,8 @@ aead_decode_filter (void *opaque, int control, IOBUF a,
   decode_filter_ctx_t dfx = opaque;
   int rc = 0;
 
-  if ( control == IOBUFCTRL_UNDERFLOW && dfx->eof_seen )
+  if ( control == IOBUFCTRL_UNDERFLOW && dfx->eof_seen
+       && dfx->outjob == dfx->outcount)
     {
       *ret_len = 0;
       rc = -1;
@@ -880,7 +1204,10 @@ aead_decode_filter (void *opaque, int control, IOBUF a,
     {
       log_assert (a);
 
-      rc = aead_underflow (dfx, a, buf, ret_len);
+      if (dfx->jobs)
+        rc = aead_underflow_threaded (dfx, a, buf, ret_len);
+      else
+        rc = aead_underflow (dfx, a, buf, ret_len);
       if (gpg_err_code (rc) == GPG_ERR_EOF)
         rc = -1; /* We need to use the old convention in the filter.  */
 
@@ -898,6 +1225,119 @@ aead_decode_filter (void *opaque, int control, IOBUF a,
 }
 
 
+/* The size of the segments used by mdc_decrypt_pipelined.  */
+#define MDC_PIPELINE_SEGMENT (16*1024)
+
+/* The state shared by mdc_decrypt_pipelined and its hash thread.  */
+struct mdc_pipeline_s
+{
+  gcry_md_hd_t md;
+  const byte *buf;
+  size_t buflen;
+  size_t ready;       /* Number of decrypted bytes; protected by LOCK.  */
+  size_t hashed;      /* Number of hashed bytes.  */
+  npth_mutex_t lock;
+  npth_cond_t cond;
+};
+
+
+/* The thread of mdc_decrypt_pipelined which hashes the decrypted
+ * data as soon as it is available.  */
+static void *
+mdc_hash_thread (void *opaque)
+{
+  struct mdc_pipeline_s *pl = opaque;
+  size_t end;
+
+  npth_mutex_lock (&pl->lock);
+  while (pl->hashed < pl->buflen)
+    {
+      while (pl->ready == pl->hashed)
+        npth_cond_wait (&pl->cond, &pl->lock);
+      end = pl->ready;
+      npth_mutex_unlock (&pl->lock);
+      npth_unprotect ();
+      gcry_md_write (pl->md, pl->buf + pl->hashed, end - pl->hashed);
+      npth_protect ();
+      pl->hashed = end;
+      npth_mutex_lock (&pl->lock);
+    }
+  npth_mutex_unlock (&pl->lock);
+  return NULL;
+}
+
+
+/* Decrypt the N bytes at BUF and hash the plaintext for the MDC.
+ * With --aead-threads and a large enough buffer the SHA-1 of one
+ * segment is computed by a second thread while the next segment is
+ * being decrypted; the result is the same as with the simple code.  */
+static void
+mdc_decrypt_pipelined (decode_filter_ctx_t dfx, byte *buf, size_t n)
+{
+  struct mdc_pipeline_s pl;
+  npth_attr_t tattr;
+  npth_t thread;
+  size_t off, len;
+  int started;
+
+  if (opt.aead_threads < 2 || !dfx->cipher_hd || !dfx->mdc_hash
+      || n < 2 * MDC_PIPELINE_SEGMENT)
+    {
+      if (dfx->cipher_hd)
+        gcry_cipher_decrypt (dfx->cipher_hd, buf, n, NULL, 0);
+      if (dfx->mdc_hash)
+        gcry_md_write (dfx->mdc_hash, buf, n);
+      return;
+    }
+
+  memset (&pl, 0, sizeof pl);
+  pl.md = dfx->mdc_hash;
+  pl.buf = buf;
+  pl.buflen = n;
+  started = 0;
+  if (!npth_mutex_init (&pl.lock, NULL))
+    {
+      if (!npth_cond_init (&pl.cond, NULL))
+        {
+          npth_attr_init (&tattr);
+          npth_attr_setdetachstate (&tattr, NPTH_CREATE_JOINABLE);
+          started = !npth_create (&thread, &tattr, mdc_hash_thread, &pl);
+          npth_attr_destroy (&tattr);
+          if (!started)
+            npth_cond_destroy (&pl.cond);
+        }
+      if (!started)
+        npth_mutex_destroy (&pl.lock);
+    }
+
+  for (off=0; off < n; off += len)
+    {
+      len = n - off;
+      if (len > MDC_PIPELINE_SEGMENT)
+        len = MDC_PIPELINE_SEGMENT;
+      npth_unprotect ();
+      gcry_cipher_decrypt (dfx->cipher_hd, buf + off, len, NULL, 0);
+      npth_protect ();
+      if (started)
+        {
+          npth_mutex_lock (&pl.lock);
+          pl.ready = off + len;
+          npth_cond_signal (&pl.cond);
+          npth_mutex_unlock (&pl.lock);
+        }
+    }
+
+  if (started)
+    {
+      npth_join (thread, NULL);
+      npth_cond_destroy (&pl.cond);
+      npth_mutex_destroy (&pl.lock);
+    }
+  else
+    gcry_md_write (dfx->mdc_hash, buf, n);
+}
+
+
 static int
 mdc_decode_filter (void *opaque, int control, IOBUF a,
                    byte *buf, size_t *ret_len)
@@ -964,12 +1404,7 @@ mdc_decode_filter (void *opaque, int control, IOBUF a,
 	}
 
       if ( n )
-        {
-          if ( dfx->cipher_hd )
-            gcry_cipher_decrypt (dfx->cipher_hd, buf, n, NULL, 0);
-          if ( dfx->mdc_hash )
-            gcry_md_write (dfx->mdc_hash, buf, n);
-	}
+        mdc_decrypt_pipelined (dfx, buf, n);
       else
         {
           log_assert ( dfx->eof_seen );
@@ -25,6 +25,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include <errno.h>
+#include <npth.h>
 
 #include "gpg.h"
 #include "options.h"
@@ -174,18 +175,14 @@ check_encryption_compliance (DEK *dek, pk_list_t pk_list)
   for (pkr = pk_list; pkr; pkr = pkr->next)
     {
       PKT_public_key *pk = pkr->pk;
-      unsigned int nbits = nbits_from_pk (pk);
 
-      if (!gnupg_pk_is_compliant (opt.compliance, pk->pubkey_algo, 0,
-                                  pk->pkey, nbits, NULL))
+      if (!pk_is_compliant (pk, opt.compliance))
         log_info (_("WARNING: key %s is not suitable for encryption"
                     " in %s mode\n"),
                   keystr_from_pk (pk),
                   gnupg_compliance_option_string (opt.compliance));
 
-      if (compliant
-          && !gnupg_pk_is_compliant (CO_DE_VS, pk->pubkey_algo, 0, pk->pkey,
-                                     nbits, NULL))
+      if (compliant && !pk_is_compliant (pk, CO_DE_VS))
         compliant = 0; /* Not compliant - reset flag.  */
     }
 
@@ -1130,6 +1127,108 @@ encrypt_filter (void *opaque, int control,
 }
 
 
+/* The maximum number of public keys in the cache used by
+ * get_encrypt_key and the number of its hash buckets.  */
+#define ENCRYPT_KEY_CACHE_MAX     4096
+#define ENCRYPT_KEY_CACHE_BUCKETS  256
+
+/* An item of the encryption key cache.  */
+struct encrypt_key_cache_s
+{
+  struct encrypt_key_cache_s *next;
+  gcry_sexp_t s_pkey;          /* See pk_encrypt_build_key.  */
+  int algo;
+  size_t fprlen;
+  byte fpr[MAX_FINGERPRINT_LEN];
+};
+static struct encrypt_key_cache_s *encrypt_key_cache[ENCRYPT_KEY_CACHE_BUCKETS];
+static unsigned int encrypt_key_cache_count;
+
+
+/* Return the S-expression of the public key PK to be used with
+ * pk_encrypt_with_key.  Services which encrypt to the same recipients
+ * again and again don't need to build it for each message.  If the
+ * cache is full a new object is returned and R_OWNED is set; the
+ * caller must then release it.  The fingerprint of PK is stored at
+ * FPR.  */
+static gpg_error_t
+get_encrypt_key (PKT_public_key *pk, byte fpr[MAX_FINGERPRINT_LEN],
+                 gcry_sexp_t *r_s_pkey, int *r_owned)
+{
+  gpg_error_t err;
+  struct encrypt_key_cache_s *item;
+  size_t fprlen;
+  unsigned int hash;
+
+  *r_owned = 0;
+  fingerprint_from_pk (pk, fpr, &fprlen);
+  hash = fpr[fprlen-1] % ENCRYPT_KEY_CACHE_BUCKETS;
+  for (item = encrypt_key_cache[hash]; item; item = item->next)
+    if (item->algo == pk->pubkey_algo && item->fprlen == fprlen
+        && !memcmp (item->fpr, fpr, fprlen))
+      {
+        *r_s_pkey = item->s_pkey;
+        return 0;
+      }
+
+  err = pk_encrypt_build_key (pk->pubkey_algo, pk->pkey, r_s_pkey);
+  if (err)
+    return err;
+
+  if (encrypt_key_cache_count < ENCRYPT_KEY_CACHE_MAX
+      && (item = xtrycalloc (1, sizeof *item)))
+    {
+      item->s_pkey = *r_s_pkey;
+      item->algo = pk->pubkey_algo;
+      item->fprlen = fprlen;
+      memcpy (item->fpr, fpr, fprlen);
+      item->next = encrypt_key_cache[hash];
+      encrypt_key_cache[hash] = item;
+      encrypt_key_cache_count++;
+    }
+  else
+    *r_owned = 1;
+  return 0;
+}
+
+
+/* Write the encrypted session key ENC for the key PK to OUT.  RC is
+ * the result of the encryption.  ENC is released.  */
+static int
+write_pubkey_enc_packet (ctrl_t ctrl, PKT_pubkey_enc *enc, DEK *dek,
+                         int rc, iobuf_t out)
+{
+  PACKET pkt;
+
+  if (rc)
+    log_error ("pubkey_encrypt failed: %s\n", gpg_strerror (rc) );
+  else
+    {
+      if ( opt.verbose )
+        {
+          char *ustr = get_user_id_string_native (ctrl, enc->keyid);
+          log_info (_("%s/%s.%s encrypted for: \"%s\"\n"),
+                    openpgp_pk_algo_name (enc->pubkey_algo),
+                    openpgp_cipher_algo_name (dek->algo),
+                    dek->use_aead? openpgp_aead_algo_name (dek->use_aead)
+                    /**/         : "CFB",
+                    ustr );
+          xfree (ustr);
+        }
+      /* And write it. */
+      init_packet (&pkt);
+      pkt.pkttype = PKT_PUBKEY_ENC;
+      pkt.pkt.pubkey_enc = enc;
+      rc = build_packet (out, &pkt);
+      if (rc)
+        log_error ("build_packet(pubkey_enc) failed: %s\n",
+                   gpg_strerror (rc));
+    }
+  free_pubkey_enc(enc);
+  return rc;
+}
+
+
 /*
  * Write a pubkey-enc packet for the public key PK to OUT.
  */
@@ -1137,10 +1236,12 @@ int
 write_pubkey_enc (ctrl_t ctrl,
                   PKT_public_key *pk, int throw_keyid, DEK *dek, iobuf_t out)
 {
-  PACKET pkt;
   PKT_pubkey_enc *enc;
   int rc;
   gcry_mpi_t frame;
+  gcry_sexp_t s_pkey;
+  byte fpr[MAX_FINGERPRINT_LEN];
+  int owned;
 
   print_pubkey_algo_note ( pk->pubkey_algo );
   enc = xmalloc_clear ( sizeof *enc );
@@ -1162,33 +1263,129 @@ write_pubkey_enc (ctrl_t ctrl,
    * build_packet().  */
   frame = encode_session_key (pk->pubkey_algo, dek,
                               pubkey_nbits (pk->pubkey_algo, pk->pkey));
-  rc = pk_encrypt (pk->pubkey_algo, enc->data, frame, pk, pk->pkey);
+  rc = get_encrypt_key (pk, fpr, &s_pkey, &owned);
+  if (!rc)
+    {
+      rc = pk_encrypt_with_key (pk->pubkey_algo, enc->data, frame, fpr,
+                                pk->pkey, s_pkey);
+      if (owned)
+        gcry_sexp_release (s_pkey);
+    }
   gcry_mpi_release (frame);
-  if (rc)
-    log_error ("pubkey_encrypt failed: %s\n", gpg_strerror (rc) );
-  else
+  return write_pubkey_enc_packet (ctrl, enc, dek, rc, out);
+}
+
+
+/* A job for write_pubkey_enc_threaded.  */
+struct pkenc_job_s
+{
+  PKT_pubkey_enc *enc;      /* The packet to be filled.  */
+  PKT_public_key *pk;       /* The recipient's key.  */
+  gcry_sexp_t s_pkey;       /* Its S-expression.  */
+  int owned;                /* S_PKEY needs to be released.  */
+  byte fpr[MAX_FINGERPRINT_LEN];
+  gcry_mpi_t frame;         /* The encoded session key.  */
+  gpg_error_t err;
+};
+
+/* The jobs shared by the threads of write_pubkey_enc_threaded.  */
+struct pkenc_ctx_s
+{
+  struct pkenc_job_s *jobs;
+  int njobs;
+  int next;     /* Index of the next job to run.  */
+};
+
+
+/* Worker thread for write_pubkey_enc_threaded.  The public key
+ * operation is done outside of the nPth lock.  */
+static void *
+pkenc_thread (void *opaque)
+{
+  struct pkenc_ctx_s *pctx = opaque;
+  struct pkenc_job_s *job;
+
+  while (pctx->next < pctx->njobs)
     {
-      if ( opt.verbose )
-        {
-          char *ustr = get_user_id_string_native (ctrl, enc->keyid);
-          log_info (_("%s/%s.%s encrypted for: \"%s\"\n"),
-                    openpgp_pk_algo_name (enc->pubkey_algo),
-                    openpgp_cipher_algo_name (dek->algo),
-                    dek->use_aead? openpgp_aead_algo_name (dek->use_aead)
-                    /**/         : "CFB",
-                    ustr );
-          xfree (ustr);
-        }
-      /* And write it. */
-      init_packet (&pkt);
-      pkt.pkttype = PKT_PUBKEY_ENC;
-      pkt.pkt.pubkey_enc = enc;
-      rc = build_packet (out, &pkt);
-      if (rc)
-        log_error ("build_packet(pubkey_enc) failed: %s\n",
-                   gpg_strerror (rc));
+      job = pctx->jobs + pctx->next++;
+      if (job->err)
+        continue;
+      npth_unprotect ();
+      job->err = pk_encrypt_with_key (job->pk->pubkey_algo, job->enc->data,
+                                      job->frame, job->fpr,
+                                      job->pk->pkey, job->s_pkey);
+      npth_protect ();
     }
-  free_pubkey_enc(enc);
+  return NULL;
+}
+
+
+/* Same as calling write_pubkey_enc for the NJOBS keys of PK_LIST but
+ * the session key is encrypted to up to opt.encrypt_threads keys in
+ * parallel.  The packets are written in the order of PK_LIST.  */
+static int
+write_pubkey_enc_threaded (ctrl_t ctrl, PK_LIST pk_list, int njobs,
+                           DEK *dek, iobuf_t out)
+{
+  struct pkenc_ctx_s pctx;
+  struct pkenc_job_s *job;
+  npth_attr_t tattr;
+  npth_t threads[MAX_IMPORT_THREADS];
+  int started[MAX_IMPORT_THREADS];
+  PKT_public_key *pk;
+  int i, nthreads;
+  int rc = 0;
+
+  memset (&pctx, 0, sizeof pctx);
+  pctx.jobs = xcalloc (njobs, sizeof *pctx.jobs);
+  pctx.njobs = njobs;
+
+  /* Everything which may access shared objects is done here.  */
+  for (i=0; i < njobs && pk_list; i++, pk_list = pk_list->next)
+    {
+      job = pctx.jobs + i;
+      pk = job->pk = pk_list->pk;
+      print_pubkey_algo_note (pk->pubkey_algo);
+      job->enc = xmalloc_clear (sizeof *job->enc);
+      job->enc->pubkey_algo = pk->pubkey_algo;
+      keyid_from_pk (pk, job->enc->keyid);
+      job->enc->throw_keyid = (opt.throw_keyids || (pk_list->flags&1));
+      job->frame = encode_session_key (pk->pubkey_algo, dek,
+                                       pubkey_nbits (pk->pubkey_algo,
+                                                     pk->pkey));
+      job->err = get_encrypt_key (pk, job->fpr, &job->s_pkey, &job->owned);
+    }
+  log_assert (i == njobs);
+
+  nthreads = opt.encrypt_threads;
+  if (nthreads > njobs)
+    nthreads = njobs;
+  if (nthreads > MAX_IMPORT_THREADS)
+    nthreads = MAX_IMPORT_THREADS;
+
+  npth_attr_init (&tattr);
+  npth_attr_setdetachstate (&tattr, NPTH_CREATE_JOINABLE);
+  /* The current thread is the first worker.  */
+  for (i=1; i < nthreads; i++)
+    started[i] = !npth_create (&threads[i], &tattr, pkenc_thread, &pctx);
+  npth_attr_destroy (&tattr);
+  pkenc_thread (&pctx);
+  for (i=1; i < nthreads; i++)
+    if (started[i])
+      npth_join (threads[i], NULL);
+
+  for (i=0; i < njobs; i++)
+    {
+      job = pctx.jobs + i;
+      if (!rc)
+        rc = write_pubkey_enc_packet (ctrl, job->enc, dek, job->err, out);
+      else
+        free_pubkey_enc (job->enc);
+      gcry_mpi_release (job->frame);
+      if (job->owned)
+        gcry_sexp_release (job->s_pkey);
+    }
+  xfree (pctx.jobs);
   return rc;
 }
 
@@ -1199,6 +1396,9 @@ write_pubkey_enc (ctrl_t ctrl,
 static int
 write_pubkey_enc_from_list (ctrl_t ctrl, PK_LIST pk_list, DEK *dek, iobuf_t out)
 {
+  PK_LIST r;
+  int n;
+
   if (opt.throw_keyids && (PGP7 || PGP8))
     {
       log_info(_("option '%s' may not be used in %s mode\n"),
@@ -1207,6 +1407,11 @@ write_pubkey_enc_from_list (ctrl_t ctrl, PK_LIST pk_list, DEK *dek, iobuf_t out)
       compliance_failure();
     }
 
+  for (n=0, r = pk_list; r; r = r->next)
+    n++;
+  if (opt.encrypt_threads > 1 && n > 1)
+    return write_pubkey_enc_threaded (ctrl, pk_list, n, dek, out);
+
   for ( ; pk_list; pk_list = pk_list->next )
     {
       PKT_public_key *pk = pk_list->pk;
@@ -1223,6 +1428,7 @@ void
 encrypt_crypt_files (ctrl_t ctrl, int nfiles, char **files, strlist_t remusr)
 {
   int rc = 0;
+  pk_list_t pk_list = NULL;
 
   if (opt.outfile)
     {
@@ -1230,6 +1436,15 @@ encrypt_crypt_files (ctrl_t ctrl, int nfiles, char **files, strlist_t remusr)
       return;
     }
 
+  /* The recipients are the same for all files; thus we resolve them
+   * only once instead of doing the key lookups and validity checks
+   * again for each file.  Each file still gets its own session key.  */
+  if ((rc = build_pk_list (ctrl, remusr, &pk_list)))
+    {
+      log_error ("building recipient list failed: %s\n", gpg_strerror (rc));
+      return;
+    }
+
   if (!nfiles)
     {
       char line[2048];
@@ -1240,11 +1455,11 @@ encrypt_crypt_files (ctrl_t ctrl, int nfiles, char **files, strlist_t remusr)
           if (!*line || line[strlen(line)-1] != '\n')
             {
               log_error("input line %u too long or missing LF\n", lno);
-              return;
+              goto leave;
             }
           line[strlen(line)-1] = '\0';
           print_file_status(STATUS_FILE_START, line, 2);
-          rc = encrypt_crypt (ctrl, -1, line, remusr, 0, NULL, -1);
+          rc = encrypt_crypt (ctrl, -1, line, remusr, 0, pk_list, -1);
           if (rc)
             log_error ("encryption of '%s' failed: %s\n",
                        print_fname_stdin(line), gpg_strerror (rc) );
@@ -1256,11 +1471,14 @@ encrypt_crypt_files (ctrl_t ctrl, int nfiles, char **files, strlist_t remusr)
       while (nfiles--)
         {
           print_file_status(STATUS_FILE_START, *files, 2);
-          if ( (rc = encrypt_crypt (ctrl, -1, *files, remusr, 0, NULL, -1)) )
+          if ( (rc = encrypt_crypt (ctrl, -1, *files, remusr, 0, pk_list, -1)) )
             log_error("encryption of '%s' failed: %s\n",
                       print_fname_stdin(*files), gpg_strerror (rc) );
           write_status( STATUS_FILE_DONE );
           files++;
         }
     }
+
+ leave:
+  release_pk_list (pk_list);
 }
@@ -1804,6 +1804,79 @@ print_dane_records (iobuf_t out, kbnode_t keyblock, PKT_public_key *pk,
 }
 
 
+/* Return true if do_export_one_keyblock would write all packets of
+ * KEYBLOCK unchanged for a public key export with OPTIONS and the
+ * search description DESC.  */
+static int
+keyblock_exports_unchanged (kbnode_t keyblock, unsigned int options,
+                            KEYDB_SEARCH_DESC *desc)
+{
+  kbnode_t node;
+  PKT_signature *sig;
+  int i;
+
+  if (desc->exact)
+    return 0;
+
+  for (node = keyblock; node; node = node->next)
+    {
+      if (is_deleted_kbnode (node))
+        return 0;
+
+      switch (node->pkt->pkttype)
+        {
+        case PKT_PUBLIC_KEY:
+        case PKT_PUBLIC_SUBKEY:
+          break;
+
+        case PKT_USER_ID:
+          if (!(options & EXPORT_ATTRIBUTES)
+              && node->pkt->pkt.user_id->attrib_data)
+            return 0;
+          break;
+
+        case PKT_SIGNATURE:
+          sig = node->pkt->pkt.signature;
+          if (!(options & EXPORT_LOCAL_SIGS) && !sig->flags.exportable)
+            return 0;
+          if (!(options & EXPORT_SENSITIVE_REVKEYS) && sig->revkey)
+            for (i = 0; i < sig->numrevkeys; i++)
+              if ((sig->revkey[i].class & 0x40))
+                return 0;
+          break;
+
+        default:
+          return 0;  /* Comment, ring trust or secret key packets.  */
+        }
+    }
+
+  return 1;
+}
+
+
+/* Helper for do_export_stream which writes the stored IMAGE of
+ * KEYBLOCK with length IMAGELEN to OUT.  */
+static gpg_error_t
+do_export_keyblock_image (kbnode_t keyblock, const void *image,
+                          size_t imagelen, iobuf_t out,
+                          export_stats_t stats, int *any)
+{
+  gpg_error_t err;
+
+  err = iobuf_write (out, image, imagelen);
+  if (err)
+    {
+      log_error ("error writing keyblock: %s\n", gpg_strerror (err));
+      return err;
+    }
+
+  stats->exported++;
+  print_status_exported (keyblock->pkt->pkt.public_key);
+  *any = 1;
+  return 0;
+}
+
+
 /* Helper for do_export_stream which writes one keyblock to OUT.  */
 static gpg_error_t
 do_export_one_keyblock (ctrl_t ctrl, kbnode_t keyblock, u32 *keyid,
@@ -2248,6 +2321,9 @@ do_export_stream (ctrl_t ctrl, iobuf_t out, strlist_t users, int secret,
   gcry_cipher_hd_t cipherhd = NULL;
   struct export_stats_s dummystats;
   iobuf_t out_help = NULL;
+  int use_image;
+  void *image = NULL;
+  size_t imagelen = 0;
 
   if (!stats)
     stats = &dummystats;
@@ -2300,6 +2376,15 @@ do_export_stream (ctrl_t ctrl, iobuf_t out, strlist_t users, int secret,
   if (secret && (err = get_keywrap_key (ctrl, &cipherhd)))
     goto leave;
 
+  /* If the keyblocks are exported as stored we can write the stored
+   * images instead of rebuilding all packets.  */
+  use_image = (!secret && !keyblock_out
+               && !(options & (EXPORT_MINIMAL | EXPORT_CLEAN
+                               | EXPORT_DANE_FORMAT | EXPORT_BACKUP
+                               | EXPORT_REVOCS))
+               && !export_keep_uid && !export_drop_subkey
+               && !export_select_filter);
+
   for (;;)
     {
       u32 keyid[2];
@@ -2314,7 +2399,11 @@ do_export_stream (ctrl_t ctrl, iobuf_t out, strlist_t users, int secret,
       /* Read the keyblock. */
       release_kbnode (keyblock);
       keyblock = NULL;
-      err = keydb_get_keyblock (kdbhd, &keyblock);
+      xfree (image);
+      image = NULL;
+      err = keydb_get_keyblock_and_image (kdbhd, &keyblock,
+                                          use_image? &image : NULL,
+                                          &imagelen);
       if (err)
         {
           log_error (_("error reading keyblock: %s\n"), gpg_strerror (err));
@@ -2416,7 +2505,11 @@ do_export_stream (ctrl_t ctrl, iobuf_t out, strlist_t users, int secret,
         }
 
       /* And write it. */
-      if ((options & EXPORT_REVOCS))
+      if (image
+          && keyblock_exports_unchanged (keyblock, options, desc+descindex))
+        err = do_export_keyblock_image (keyblock, image, imagelen,
+                                        out, stats, any);
+      else if ((options & EXPORT_REVOCS))
         err = do_export_revocs (ctrl, keyblock, keyid,
                                 out_help? out_help : out,
                                 options, any);
@@ -2460,6 +2553,7 @@ do_export_stream (ctrl_t ctrl, iobuf_t out, strlist_t users, int secret,
  leave:
   iobuf_cancel (out_help);
   gcry_cipher_close (cipherhd);
+  xfree (image);
   xfree(desc);
   keydb_release (kdbhd);
   if (err || !keyblock_out)
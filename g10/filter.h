@@ -27,6 +27,10 @@ typedef struct {
     gcry_md_hd_t md;      /* catch all */
     gcry_md_hd_t md2;     /* if we want to calculate an alternate hash */
     size_t maxbuf_size;
+    int nxmd;             /* Number of handles in XMD or -1 if not used.  */
+    gcry_md_hd_t xmd[MAX_HASH_THREADS]; /* Single algorithm handles which
+                                         * are hashed in parallel instead
+                                         * of MD (see md_filter_enable). */
 } md_filter_context_t;
 
 typedef struct {
@@ -83,6 +87,7 @@ struct compress_filter_context_s {
     int algo;	 /* compress algo */
     int algo1hack;
     int new_ctb;
+    int sampled;   /* The compression ratio has been checked.  */
     void (*release)(struct compress_filter_context_s*);
 };
 typedef struct compress_filter_context_s compress_filter_context_t;
@@ -134,6 +139,13 @@ typedef struct
   size_t bufsize;  /* Allocated length.  */
   size_t buflen;   /* Used length.       */
 
+  /* If not NULL the AEAD chunks are encrypted by worker threads.
+   * This is an array of NJOBS chunk buffers which are filled in
+   * order; CURJOB is the index of the one currently filled.  */
+  struct aead_chunk_job_s *jobs;
+  int njobs;
+  int curjob;
+
 } cipher_filter_context_t;
 
 
@@ -166,6 +178,10 @@ typedef struct {
 /*-- mdfilter.c --*/
 int md_filter( void *opaque, int control, iobuf_t a, byte *buf, size_t *ret_len);
 void free_md_filter_context( md_filter_context_t *mfx );
+void md_filter_enable (md_filter_context_t *mfx, int algo);
+void md_filter_write (md_filter_context_t *mfx, const void *buf, size_t len);
+gpg_error_t md_filter_copy_md (md_filter_context_t *mfx, int algo,
+                               gcry_md_hd_t *r_md);
 
 /*-- armor.c --*/
 armor_filter_context_t *new_armor_context (void);
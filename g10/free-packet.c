@@ -28,6 +28,102 @@
 #include "packet.h"
 #include "../common/iobuf.h"
 #include "options.h"
+#include "../common/init.h"
+
+
+/* Released signatures and public keys are kept for reuse by
+ * alloc_signature and alloc_public_key.  Keyblocks are parsed and
+ * released as a whole; thus a release of one is usually followed by
+ * the allocation of about the same number of these objects for the
+ * next one.  The lists are limited to MAX_UNUSED_OBJECTS items.  */
+#define MAX_UNUSED_OBJECTS 8192
+
+struct unused_object_s
+{
+  struct unused_object_s *next;
+};
+
+static struct unused_object_s *unused_sigs;
+static unsigned int n_unused_sigs;
+static struct unused_object_s *unused_pks;
+static unsigned int n_unused_pks;
+static int cleanup_registered;
+
+
+static void
+release_unused_objects (void)
+{
+  struct unused_object_s *obj;
+
+  while ((obj = unused_sigs))
+    {
+      unused_sigs = obj->next;
+      xfree (obj);
+    }
+  n_unused_sigs = 0;
+  while ((obj = unused_pks))
+    {
+      unused_pks = obj->next;
+      xfree (obj);
+    }
+  n_unused_pks = 0;
+}
+
+
+/* Put the object OBJ on the list LIST with the length at NITEMS or
+ * free it if the list is full.  */
+static void
+recycle_object (void *obj, struct unused_object_s **list,
+                unsigned int *nitems)
+{
+  struct unused_object_s *item = obj;
+
+  if (*nitems >= MAX_UNUSED_OBJECTS)
+    {
+      xfree (obj);
+      return;
+    }
+  if (!cleanup_registered)
+    {
+      cleanup_registered = 1;
+      register_mem_cleanup_func (release_unused_objects);
+    }
+  item->next = *list;
+  *list = item;
+  ++*nitems;
+}
+
+
+/* Return a cleared signature object.  It may be released with
+ * free_seckey_enc or xfree.  */
+PKT_signature *
+alloc_signature (void)
+{
+  struct unused_object_s *obj = unused_sigs;
+
+  if (!obj)
+    return xmalloc_clear (sizeof (PKT_signature));
+  unused_sigs = obj->next;
+  n_unused_sigs--;
+  memset (obj, 0, sizeof (PKT_signature));
+  return (PKT_signature *)obj;
+}
+
+
+/* Return a cleared public key object.  It may be released with
+ * free_public_key or xfree.  */
+PKT_public_key *
+alloc_public_key (void)
+{
+  struct unused_object_s *obj = unused_pks;
+
+  if (!obj)
+    return xmalloc_clear (sizeof (PKT_public_key));
+  unused_pks = obj->next;
+  n_unused_pks--;
+  memset (obj, 0, sizeof (PKT_public_key));
+  return (PKT_public_key *)obj;
+}
 
 
 /* Run time check to see whether mpi_copy does not copy the flags
@@ -106,7 +202,62 @@ free_seckey_enc( PKT_signature *sig )
 
   xfree (sig->signers_uid);
 
-  xfree(sig);
+  recycle_object (sig, &unused_sigs, &n_unused_sigs);
+}
+
+
+/* The parts of a public key which are not modified after the key has
+ * been put into a cache.  Copies of such a key reference these parts
+ * instead of copying them.  */
+struct pk_shared_parts_s
+{
+  unsigned int refcount;
+  int npkey;                       /* Number of used items in PKEY.  */
+  gcry_mpi_t pkey[PUBKEY_MAX_NPKEY];
+  prefitem_t *prefs;
+  struct revocation_key *revkey;
+};
+
+
+/* Return the number of public parameters of PK as stored in PKEY.  */
+static int
+pk_npkey (PKT_public_key *pk)
+{
+  int n = pubkey_get_npkey (pk->pubkey_algo);
+
+  return n? n : 1;  /* Unknown algos have one opaque MPI.  */
+}
+
+
+/* Detach PK from its shared parts.  The parts still used by PK are
+ * cleared in PK; they are released with the last reference.  */
+static void
+release_shared_parts (PKT_public_key *pk)
+{
+  struct pk_shared_parts_s *sh = pk->shared;
+  int i;
+
+  for (i=0; i < sh->npkey; i++)
+    if (pk->pkey[i] == sh->pkey[i])
+      pk->pkey[i] = NULL;
+  if (pk->prefs == sh->prefs)
+    pk->prefs = NULL;
+  if (pk->revkey == sh->revkey)
+    {
+      pk->revkey = NULL;
+      pk->numrevkeys = 0;
+    }
+  pk->shared = NULL;
+
+  log_assert (sh->refcount);
+  if (--sh->refcount)
+    return;
+
+  for (i=0; i < sh->npkey; i++)
+    mpi_release (sh->pkey[i]);
+  xfree (sh->prefs);
+  xfree (sh->revkey);
+  xfree (sh);
 }
 
 
@@ -115,6 +266,9 @@ release_public_key_parts (PKT_public_key *pk)
 {
   int n, i;
 
+  if (pk->shared)
+    release_shared_parts (pk);
+
   if (pk->seckey_info)
     n = pubkey_get_nskey (pk->pubkey_algo);
   else
@@ -126,6 +280,7 @@ release_public_key_parts (PKT_public_key *pk)
       mpi_release (pk->pkey[i]);
       pk->pkey[i] = NULL;
     }
+  pk->flags.grip_valid = 0;
   if (pk->seckey_info)
     {
       xfree (pk->seckey_info);
@@ -165,7 +320,7 @@ free_public_key (PKT_public_key *pk)
   if (pk)
     {
       release_public_key_parts (pk);
-      xfree(pk);
+      recycle_object (pk, &unused_pks, &n_unused_pks);
     }
 }
 
@@ -210,6 +365,48 @@ copy_prefs (const prefitem_t *prefs)
 }
 
 
+/* Turn PK, which must not be modified anymore, into a key whose
+ * public parameters, preferences and revocation keys are shared by
+ * all copies made with copy_public_key.  This is used for keys kept
+ * in a cache.  */
+void
+share_public_key (PKT_public_key *pk)
+{
+  struct pk_shared_parts_s *sh;
+  int i;
+
+  if (pk->shared || pk->seckey_info)
+    return;
+
+  sh = xtrycalloc (1, sizeof *sh);
+  if (!sh)
+    return;  /* Not fatal; copies are then deep copies.  */
+  sh->refcount = 1;
+  sh->npkey = pk_npkey (pk);
+  for (i=0; i < sh->npkey; i++)
+    sh->pkey[i] = pk->pkey[i];
+  sh->prefs = pk->prefs;
+  sh->revkey = pk->revkey;
+  pk->shared = sh;
+}
+
+
+/* Return true if the public parameters of PK are those from its
+ * shared parts.  */
+static int
+pkey_is_shared (PKT_public_key *pk)
+{
+  int i;
+
+  if (!pk->shared || pk->shared->npkey != pk_npkey (pk))
+    return 0;
+  for (i=0; i < pk->shared->npkey; i++)
+    if (pk->pkey[i] != pk->shared->pkey[i])
+      return 0;
+  return 1;
+}
+
+
 /* Copy the public key S to D.  If D is NULL allocate a new public key
  * structure.  Only the basic stuff is copied; not any ancillary
  * data.  */
@@ -219,15 +416,23 @@ copy_public_key_basics (PKT_public_key *d, PKT_public_key *s)
   int n, i;
 
   if (!d)
-    d = xmalloc (sizeof *d);
+    d = alloc_public_key ();
   memcpy (d, s, sizeof *d);
   d->seckey_info = NULL;
   d->user_id = NULL;
   d->prefs = NULL;
+  d->shared = NULL;
 
   n = pubkey_get_npkey (s->pubkey_algo);
   i = 0;
-  if (!n)
+  if (pkey_is_shared (s))
+    {
+      /* Only a reference is required.  */
+      d->shared = s->shared;
+      d->shared->refcount++;
+      i = d->shared->npkey;
+    }
+  else if (!n)
     d->pkey[i++] = my_mpi_copy (s->pkey[0]);
   else
     {
@@ -253,11 +458,16 @@ copy_public_key (PKT_public_key *d, PKT_public_key *s)
 {
   d = copy_public_key_basics (d, s);
   d->user_id = scopy_user_id (s->user_id);
-  d->prefs = copy_prefs (s->prefs);
+  if (d->shared && s->prefs == d->shared->prefs)
+    d->prefs = s->prefs;
+  else
+    d->prefs = copy_prefs (s->prefs);
 
   if (!s->revkey && s->numrevkeys)
     BUG();
-  if (s->numrevkeys)
+  if (d->shared && s->revkey == d->shared->revkey)
+    d->revkey = s->revkey;
+  else if (s->numrevkeys)
     {
       d->revkey = xmalloc(sizeof(struct revocation_key)*s->numrevkeys);
       memcpy(d->revkey,s->revkey,sizeof(struct revocation_key)*s->numrevkeys);
@@ -279,7 +489,7 @@ copy_signature( PKT_signature *d, PKT_signature *s )
     int n, i;
 
     if( !d )
-	d = xmalloc(sizeof *d);
+	d = alloc_signature ();
     memcpy( d, s, sizeof *d );
     n = pubkey_get_nsig( s->pubkey_algo );
     if( !n )
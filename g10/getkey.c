@@ -36,6 +36,7 @@
 #include "../common/i18n.h"
 #include "keyserver-internal.h"
 #include "call-agent.h"
+#include "call-dirmngr.h"
 #include "objcache.h"
 #include "../common/host2net.h"
 #include "../common/mbox-util.h"
@@ -122,19 +123,59 @@ typedef struct keyid_list
 #if MAX_PK_CACHE_ENTRIES
 typedef struct pk_cache_entry
 {
-  struct pk_cache_entry *next;
+  struct pk_cache_entry *next;      /* Next item in the bucket.  */
+  struct pk_cache_entry *lru_prev;  /* Previous (more recently used).  */
+  struct pk_cache_entry *lru_next;  /* Next (less recently used).  */
   u32 keyid[2];
   PKT_public_key *pk;
 } *pk_cache_entry_t;
-static pk_cache_entry_t pk_cache;
-static int pk_cache_entries;	/* Number of entries in pk cache.  */
+static pk_cache_entry_t *pk_cache;  /* Hash table with the keys.  */
+static unsigned int pk_cache_size;  /* Number of buckets (power of 2).  */
+static unsigned int pk_cache_max;   /* Max. # of items in the cache.  */
+static unsigned int pk_cache_entries; /* Number of entries in pk cache. */
+static pk_cache_entry_t pk_cache_lru_head; /* Most recently used.  */
+static pk_cache_entry_t pk_cache_lru_tail; /* Least recently used.  */
 static int pk_cache_disabled;
+static struct
+{
+  unsigned long hits;
+  unsigned long misses;
+  unsigned long added;
+  unsigned long evicted;
+} pk_cache_stats;
 #endif
 
 #if MAX_UID_CACHE_ENTRIES < 5
 #error we really need the userid cache
 #endif
 
+/* A direct mapped table of key ids for which get_pubkey did not find
+ * a key.  This is used by the user id printing helpers so that
+ * listing the signatures of many keys does not search the database
+ * again and again for the same unknown signers.  */
+#define NOKEY_CACHE_SIZE 1024
+static struct
+{
+  int valid;
+  u32 keyid[2];
+} nokey_cache[NOKEY_CACHE_SIZE];
+
+/* A direct mapped table with the keys selected by the ranking in
+ * get_best_pubkey_byname.  It is indexed by the mail address so that
+ * encrypting many messages to the same recipients does not need to
+ * rank all candidate keys again.  The table is flushed along with the
+ * other caches and whenever the trustdb needs a revalidation.  */
+#define BEST_KEY_CACHE_SIZE 256
+static struct
+{
+  char *mbox;                  /* The mail address or NULL if unused. */
+  enum get_pubkey_modes mode;  /* The lookup parameters.  */
+  unsigned int req_usage;
+  int include_unusable;
+  PKT_public_key *pk;          /* The selected key.  */
+} best_key_cache[BEST_KEY_CACHE_SIZE];
+static int best_key_cache_disabled;
+
 static void merge_selfsigs (ctrl_t ctrl, kbnode_t keyblock);
 static int lookup (ctrl_t ctrl, getkey_ctx_t ctx, int want_secret,
 		   kbnode_t *ret_keyblock, kbnode_t *ret_found_key);
@@ -162,6 +203,141 @@ print_stats ()
 #endif
 
 
+#if MAX_PK_CACHE_ENTRIES
+/* Run time allocation of the public key cache.  The size is taken
+ * from --key-cache-size.  */
+static void
+pk_cache_init (void)
+{
+  if (pk_cache)
+    return;
+  if (opt.key_cache_size)
+    pk_cache_max = opt.key_cache_size;
+  else
+    pk_cache_max = MAX_PK_CACHE_ENTRIES;
+  if (pk_cache_max < 2)
+    pk_cache_max = 2;  /* We need the cache for key creation.  */
+  /* Use about two items per bucket.  */
+  for (pk_cache_size = 16; pk_cache_size < pk_cache_max / 2
+         && pk_cache_size < (1u << 20); pk_cache_size <<= 1)
+    ;
+  pk_cache = xcalloc (pk_cache_size, sizeof *pk_cache);
+}
+
+
+/* The hash function for the public key cache.  */
+static inline unsigned int
+pk_cache_hasher (const u32 *keyid)
+{
+  return keyid[1] & (pk_cache_size - 1);
+}
+
+
+/* Return the cache entry for KEYID or NULL if there is none.  This
+ * does not count as a use of the entry.  */
+static pk_cache_entry_t
+pk_cache_find (const u32 *keyid)
+{
+  pk_cache_entry_t ce;
+
+  if (!pk_cache)
+    return NULL;
+  for (ce = pk_cache[pk_cache_hasher (keyid)]; ce; ce = ce->next)
+    if (ce->keyid[0] == keyid[0] && ce->keyid[1] == keyid[1])
+      return ce;
+  return NULL;
+}
+
+
+/* Remove CE from the LRU list.  */
+static void
+pk_cache_lru_remove (pk_cache_entry_t ce)
+{
+  if (ce->lru_prev)
+    ce->lru_prev->lru_next = ce->lru_next;
+  else
+    pk_cache_lru_head = ce->lru_next;
+  if (ce->lru_next)
+    ce->lru_next->lru_prev = ce->lru_prev;
+  else
+    pk_cache_lru_tail = ce->lru_prev;
+  ce->lru_prev = ce->lru_next = NULL;
+}
+
+
+/* Insert CE at the head of the LRU list.  */
+static void
+pk_cache_lru_insert (pk_cache_entry_t ce)
+{
+  ce->lru_prev = NULL;
+  ce->lru_next = pk_cache_lru_head;
+  if (pk_cache_lru_head)
+    pk_cache_lru_head->lru_prev = ce;
+  else
+    pk_cache_lru_tail = ce;
+  pk_cache_lru_head = ce;
+}
+
+
+/* Look up the key with KEYID in the cache.  If FPR is not NULL the
+ * fingerprint of the cached key must also match (FPR,FPRLEN).  If
+ * PRIMARY_ONLY is set only a primary key is returned.  A found entry
+ * is marked as the most recently used one.  */
+static pk_cache_entry_t
+pk_cache_lookup (const u32 *keyid, const byte *fpr, size_t fprlen,
+                 int primary_only)
+{
+  pk_cache_entry_t ce;
+
+  ce = pk_cache_find (keyid);
+  if (ce && fpr
+      && !(ce->pk->fprlen == fprlen && !memcmp (ce->pk->fpr, fpr, fprlen)))
+    ce = NULL;
+  if (ce && primary_only
+      && !(ce->pk->keyid[0] == ce->pk->main_keyid[0]
+           && ce->pk->keyid[1] == ce->pk->main_keyid[1]))
+    ce = NULL;
+
+  if (!ce)
+    {
+      pk_cache_stats.misses++;
+      return NULL;
+    }
+
+  pk_cache_stats.hits++;
+  if (ce != pk_cache_lru_head)
+    {
+      pk_cache_lru_remove (ce);
+      pk_cache_lru_insert (ce);
+    }
+  return ce;
+}
+
+
+/* Remove the least recently used entry from the cache.  */
+static void
+pk_cache_evict (void)
+{
+  pk_cache_entry_t ce, *cep;
+
+  ce = pk_cache_lru_tail;
+  if (!ce)
+    return;
+  pk_cache_lru_remove (ce);
+  for (cep = &pk_cache[pk_cache_hasher (ce->keyid)]; *cep; cep = &(*cep)->next)
+    if (*cep == ce)
+      {
+        *cep = ce->next;
+        break;
+      }
+  pk_cache_entries--;
+  pk_cache_stats.evicted++;
+  free_public_key (ce->pk);
+  xfree (ce);
+}
+#endif /*MAX_PK_CACHE_ENTRIES*/
+
+
 /* Cache a copy of a public key in the public key cache.  PK is not
  * cached if caching is disabled (via getkey_disable_caches), if
  * PK->FLAGS.DONT_CACHE is set, we don't know how to derive a key id
@@ -178,8 +354,9 @@ void
 cache_public_key (PKT_public_key * pk)
 {
 #if MAX_PK_CACHE_ENTRIES
-  pk_cache_entry_t ce, ce2;
+  pk_cache_entry_t ce;
   u32 keyid[2];
+  unsigned int hash;
 
   if (pk_cache_disabled)
     return;
@@ -199,43 +376,30 @@ cache_public_key (PKT_public_key * pk)
   else
     return; /* Don't know how to get the keyid.  */
 
-  for (ce = pk_cache; ce; ce = ce->next)
-    if (ce->keyid[0] == keyid[0] && ce->keyid[1] == keyid[1])
-      {
-	if (DBG_CACHE)
-	  log_debug ("cache_public_key: already in cache\n");
-	return;
-      }
-
-  if (pk_cache_entries >= MAX_PK_CACHE_ENTRIES)
+  pk_cache_init ();
+  if (pk_cache_find (keyid))
     {
-      int n;
-
-      /* Remove the last 50% of the entries.  */
-      for (ce = pk_cache, n = 0; ce && n < pk_cache_entries/2; n++)
-        ce = ce->next;
-      if (ce && ce != pk_cache && ce->next)
-        {
-          ce2 = ce->next;
-          ce->next = NULL;
-          ce = ce2;
-          for (; ce; ce = ce2)
-            {
-              ce2 = ce->next;
-              free_public_key (ce->pk);
-              xfree (ce);
-              pk_cache_entries--;
-            }
-        }
-      log_assert (pk_cache_entries < MAX_PK_CACHE_ENTRIES);
+      if (DBG_CACHE)
+        log_debug ("cache_public_key: already in cache\n");
+      return;
     }
-  pk_cache_entries++;
-  ce = xmalloc (sizeof *ce);
-  ce->next = pk_cache;
-  pk_cache = ce;
+
+  /* Make room by dropping the least recently used entries.  */
+  while (pk_cache_entries >= pk_cache_max)
+    pk_cache_evict ();
+
+  ce = xmalloc_clear (sizeof *ce);
   ce->pk = copy_public_key (NULL, pk);
+  /* Cache hits then only need to take a reference.  */
+  share_public_key (ce->pk);
   ce->keyid[0] = keyid[0];
   ce->keyid[1] = keyid[1];
+  hash = pk_cache_hasher (keyid);
+  ce->next = pk_cache[hash];
+  pk_cache[hash] = ce;
+  pk_cache_lru_insert (ce);
+  pk_cache_entries++;
+  pk_cache_stats.added++;
 #endif
 }
 
@@ -256,27 +420,87 @@ user_id_not_found_utf8 (void)
 
 
 
-/* Disable and drop the public key cache (which is filled by
-   cache_public_key and get_pubkey).  Note: there is currently no way
-   to re-enable this cache.  */
+/* Drop all entries from the public key cache (which is filled by
+   cache_public_key and get_pubkey).  This is used if the database has
+   been modified by another process.  */
 void
-getkey_disable_caches (void)
+getkey_flush_caches (void)
 {
+  getkey_flush_nokey_cache ();
+  getkey_flush_best_key_cache ();
 #if MAX_PK_CACHE_ENTRIES
   {
     pk_cache_entry_t ce, ce2;
 
-    for (ce = pk_cache; ce; ce = ce2)
+    ce = pk_cache_lru_head;
+    pk_cache_lru_head = pk_cache_lru_tail = NULL;
+    if (pk_cache)
+      memset (pk_cache, 0, pk_cache_size * sizeof *pk_cache);
+    pk_cache_entries = 0;
+    for (; ce; ce = ce2)
       {
-	ce2 = ce->next;
+	ce2 = ce->lru_next;
 	free_public_key (ce->pk);
 	xfree (ce);
       }
-    pk_cache_disabled = 1;
-    pk_cache_entries = 0;
-    pk_cache = NULL;
   }
 #endif
+}
+
+
+/* Forget about all key ids for which we did not find a key.  This
+ * needs to be called whenever a key has been added to the
+ * database.  */
+void
+getkey_flush_nokey_cache (void)
+{
+  memset (nokey_cache, 0, sizeof nokey_cache);
+}
+
+
+/* Forget about the keys selected by get_best_pubkey_byname.  This
+ * needs to be called whenever a key has been changed or the validity
+ * of keys may have changed.  */
+void
+getkey_flush_best_key_cache (void)
+{
+  int i;
+
+  for (i=0; i < BEST_KEY_CACHE_SIZE; i++)
+    {
+      xfree (best_key_cache[i].mbox);
+      best_key_cache[i].mbox = NULL;
+      free_public_key (best_key_cache[i].pk);
+      best_key_cache[i].pk = NULL;
+    }
+}
+
+
+/* Print statistics about the public key cache.  */
+void
+getkey_dump_stats (void)
+{
+#if MAX_PK_CACHE_ENTRIES
+  log_info ("pk_cache: items=%u/%u buckets=%u"
+            " added=%lu hits=%lu misses=%lu evicted=%lu\n",
+            pk_cache_entries, pk_cache_max, pk_cache_size,
+            pk_cache_stats.added, pk_cache_stats.hits,
+            pk_cache_stats.misses, pk_cache_stats.evicted);
+#endif
+}
+
+
+/* Disable and drop the public key cache (which is filled by
+   cache_public_key and get_pubkey).  Note: there is currently no way
+   to re-enable this cache.  */
+void
+getkey_disable_caches (void)
+{
+#if MAX_PK_CACHE_ENTRIES
+  pk_cache_disabled = 1;
+#endif
+  best_key_cache_disabled = 1;
+  getkey_flush_caches ();
   /* fixme: disable user id cache ? */
 }
 
@@ -326,8 +550,25 @@ get_pubkey_for_sig (ctrl_t ctrl, PKT_public_key *pk, PKT_signature *sig,
 
   /* First try the ISSUER_FPR info.  */
   fpr = issuer_fpr_raw (sig, &fprlen);
+#if MAX_PK_CACHE_ENTRIES
+  if (fpr)
+    {
+      /* The cache is keyed by the keyid but the fingerprint is stored
+       * along with the key.  */
+      pk_cache_entry_t ce;
+
+      if ((ce = pk_cache_lookup (sig->keyid, fpr, fprlen, 0)))
+        {
+          copy_public_key (pk, ce->pk);
+          return 0;
+        }
+    }
+#endif
   if (fpr && !get_pubkey_byfprint (ctrl, pk, NULL, fpr, fprlen))
-    return 0;
+    {
+      cache_public_key (pk);
+      return 0;
+    }
 
   /* Fallback to use the ISSUER_KEYID.  */
   return get_pubkey (ctrl, pk, sig->keyid);
@@ -360,6 +601,7 @@ get_pubkey (ctrl_t ctrl, PKT_public_key * pk, u32 * keyid)
 {
   int internal = 0;
   int rc = 0;
+  unsigned long long tstart;
 
 #if MAX_PK_CACHE_ENTRIES
   if (pk)
@@ -368,18 +610,19 @@ get_pubkey (ctrl_t ctrl, PKT_public_key * pk, u32 * keyid)
          NULL as it does not guarantee that the user IDs are
          cached. */
       pk_cache_entry_t ce;
-      for (ce = pk_cache; ce; ce = ce->next)
-	{
-	  if (ce->keyid[0] == keyid[0] && ce->keyid[1] == keyid[1])
-	    /* XXX: We don't check PK->REQ_USAGE here, but if we don't
-	       read from the cache, we do check it!  */
-	    {
-	      copy_public_key (pk, ce->pk);
-	      return 0;
-	    }
-	}
+
+      /* XXX: We don't check PK->REQ_USAGE here, but if we don't
+         read from the cache, we do check it!  */
+      if ((ce = pk_cache_lookup (keyid, NULL, 0, 0)))
+        {
+          copy_public_key (pk, ce->pk);
+          return 0;
+        }
     }
 #endif
+  /* Only the database lookups are traced.  */
+  tstart = trace_begin ();
+
   /* More init stuff.  */
   if (!pk)
     {
@@ -441,10 +684,109 @@ leave:
     cache_public_key (pk);
   if (internal)
     free_public_key (pk);
+  trace_end ("get_pubkey", tstart);
   return rc;
 }
 
 
+/* Make sure that the public keys with the NKEYIDS key ids at KEYIDS
+ * are in the public key cache so that later calls to get_pubkey or
+ * get_pubkey_for_sig do not need to access the database.  All keys
+ * not yet cached are fetched with a single keydb_search_multi which
+ * saves a round trip per key with the keyboxd; without the keyboxd
+ * nothing is done because there is nothing to gain.  REQ_USAGE is
+ * used as in get_pubkey.  Errors are ignored; keys not found here
+ * are looked up again by get_pubkey.  */
+void
+prefetch_pubkeys (ctrl_t ctrl, u32 (*keyids)[2], int nkeyids,
+                  unsigned int req_usage)
+{
+#if MAX_PK_CACHE_ENTRIES
+  gpg_error_t err;
+  KEYDB_SEARCH_DESC *desc = NULL;
+  kbnode_t *keyblocks = NULL;
+  struct getkey_ctx_s ctx;
+  int i, j, n;
+
+  if (!opt.use_keyboxd || pk_cache_disabled || nkeyids < 2)
+    return;
+  /* Don't fetch more than what fits into the cache.  */
+  pk_cache_init ();
+  if (nkeyids > pk_cache_max / 2)
+    nkeyids = pk_cache_max / 2;
+
+  desc = xtrycalloc (nkeyids, sizeof *desc);
+  keyblocks = xtrycalloc (nkeyids, sizeof *keyblocks);
+  if (!desc || !keyblocks)
+    goto leave;
+
+  for (n = i = 0; i < nkeyids; i++)
+    {
+      if (pk_cache_find (keyids[i]))
+        continue;  /* Already cached.  */
+      for (j = 0; j < n; j++)
+        if (desc[j].u.kid[0] == keyids[i][0]
+            && desc[j].u.kid[1] == keyids[i][1])
+          break;
+      if (j < n)
+        continue;  /* Duplicate.  */
+      desc[n].mode = KEYDB_SEARCH_MODE_LONG_KID;
+      desc[n].u.kid[0] = keyids[i][0];
+      desc[n].u.kid[1] = keyids[i][1];
+      n++;
+    }
+  if (n < 2)
+    goto leave;  /* A plain get_pubkey is as good.  */
+
+  memset (&ctx, 0, sizeof ctx);
+  ctx.not_allocated = 1;
+  if (ctrl && ctrl->cached_getkey_kdb)
+    {
+      ctx.kr_handle = ctrl->cached_getkey_kdb;
+      ctrl->cached_getkey_kdb = NULL;
+    }
+  else
+    {
+      ctx.kr_handle = keydb_new (ctrl);
+      if (!ctx.kr_handle)
+        goto leave;
+    }
+
+  err = keydb_search_multi (ctx.kr_handle, desc, n, keyblocks);
+  if (err && gpg_err_code (err) != GPG_ERR_NOT_FOUND)
+    log_info ("prefetching %d keys failed: %s\n", n, gpg_strerror (err));
+  for (i = 0; i < n; i++)
+    {
+      kbnode_t found_key;
+      unsigned int infoflags;
+      PKT_public_key *pk;
+
+      if (!keyblocks[i])
+        continue;
+      merge_selfsigs (ctrl, keyblocks[i]);
+      found_key = finish_lookup (keyblocks[i], req_usage, 1, 0, &infoflags);
+      if (found_key && (pk = xtrycalloc (1, sizeof *pk)))
+        {
+          pk_from_block (pk, keyblocks[i], found_key);
+          cache_public_key (pk);
+          free_public_key (pk);
+        }
+      release_kbnode (keyblocks[i]);
+    }
+  getkey_end (ctrl, &ctx);
+
+ leave:
+  xfree (keyblocks);
+  xfree (desc);
+#else
+  (void)ctrl;
+  (void)keyids;
+  (void)nkeyids;
+  (void)req_usage;
+#endif
+}
+
+
 /* Same as get_pubkey but if the key was not found the function tries
  * to import it from LDAP.  FIXME: We should not need this but swicth
  * to a fingerprint lookup.  */
@@ -502,20 +844,14 @@ get_pubkey_fast (ctrl_t ctrl, PKT_public_key * pk, u32 * keyid)
   log_assert (pk);
 #if MAX_PK_CACHE_ENTRIES
   {
-    /* Try to get it from the cache */
+    /* Try to get it from the cache; only consider primary keys.  */
     pk_cache_entry_t ce;
 
-    for (ce = pk_cache; ce; ce = ce->next)
+    if ((ce = pk_cache_lookup (keyid, NULL, 0, 1)))
       {
-	if (ce->keyid[0] == keyid[0] && ce->keyid[1] == keyid[1]
-	    /* Only consider primary keys.  */
-	    && ce->pk->keyid[0] == ce->pk->main_keyid[0]
-	    && ce->pk->keyid[1] == ce->pk->main_keyid[1])
-	  {
-	    if (pk)
-	      copy_public_key (pk, ce->pk);
-	    return 0;
-	  }
+        if (pk)
+          copy_public_key (pk, ce->pk);
+        return 0;
       }
   }
 #endif
@@ -897,6 +1233,156 @@ key_byname (ctrl_t ctrl, GETKEY_CTX *retctx, strlist_t namelist,
 }
 
 
+/* Return the name of the auto-key-locate mechanism AKL as used for
+ * the Dirmngr's cache of lookup results or NULL if the results of
+ * that mechanism shall not be cached.  */
+static const char *
+akl_cache_name (ctrl_t ctrl, struct akl *akl)
+{
+  switch (akl->type)
+    {
+    case AKL_CERT:  return "cert";
+    case AKL_DANE:  return "dane";
+    case AKL_WKD:   return "wkd";
+    case AKL_LDAP:  return "ldap";
+    case AKL_NTDS:  return "ntds";
+    case AKL_KEYSERVER:
+      return keyserver_any_configured (ctrl)? "keyserver" : NULL;
+    case AKL_SPEC:
+      return strpbrk (akl->spec->uri, " \t")? NULL : akl->spec->uri;
+    default:
+      return NULL;
+    }
+}
+
+
+/* Ask the Dirmngr for a former result of the auto-key-locate
+ * mechanism NAME for the mail address MBOX.  Returns true if a
+ * result is available.  For a failed lookup its error code is stored
+ * at R_RC.  For a successful lookup 0 is stored at R_RC and the
+ * fingerprint at (R_FPR,R_FPRLEN); however, this is only done if the
+ * key is still in the local keyring.  */
+static int
+akl_cache_lookup (ctrl_t ctrl, const char *name, const char *mbox,
+                  unsigned char **r_fpr, size_t *r_fprlen, int *r_rc)
+{
+  gpg_error_t result;
+  char *hexfpr;
+  unsigned char *fpr;
+  size_t fprlen;
+
+  if (gpg_dirmngr_get_akl_result (ctrl, name, mbox, &hexfpr, &result))
+    return 0;  /* Not cached or an older Dirmngr.  */
+
+  if (result)
+    {
+      if (opt.verbose)
+        log_info ("auto-key-locate: %s failed for '%s' recently: %s\n",
+                  name, mbox, gpg_strerror (result));
+      *r_rc = result;
+      return 1;
+    }
+
+  fprlen = strlen (hexfpr) / 2;
+  fpr = xtrymalloc (fprlen + 1);
+  if (!fpr || !fprlen || fprlen > MAX_FINGERPRINT_LEN
+      || hex2bin (hexfpr, fpr, fprlen) < 0
+      || get_pubkey_byfprint_fast (ctrl, NULL, fpr, fprlen))
+    {
+      /* Bad value or the key has been deleted - do a new lookup.  */
+      xfree (fpr);
+      xfree (hexfpr);
+      return 0;
+    }
+  if (opt.verbose)
+    log_info ("auto-key-locate: %s found %s for '%s' recently\n",
+              name, hexfpr, mbox);
+  xfree (hexfpr);
+  *r_fpr = fpr;
+  *r_fprlen = fprlen;
+  *r_rc = 0;
+  return 1;
+}
+
+
+/* Tell the Dirmngr the outcome RC of the auto-key-locate mechanism
+ * NAME for the mail address MBOX.  HEXFPR is the fingerprint of the
+ * found key.  */
+static void
+akl_cache_store (ctrl_t ctrl, const char *name, const char *mbox,
+                 const char *hexfpr, int rc)
+{
+  /* A cancelled lookup says nothing about the mail address.  */
+  if (gpg_err_code (rc) == GPG_ERR_CANCELED
+      || gpg_err_code (rc) == GPG_ERR_FULLY_CANCELED)
+    return;
+  if (!rc && !*hexfpr)
+    return;
+
+  gpg_dirmngr_put_akl_result (ctrl, name, mbox, rc? NULL : hexfpr,
+                              rc? gpg_error (gpg_err_code (rc)) : 0);
+}
+
+
+/* Start the lookups of the network based auto-key-locate mechanisms
+ * from AKL on for the mail address NAME in the background so that
+ * they run in parallel.  get_pubkey_byname then takes the results in
+ * the configured order.  MBOX is the plain mail address.  */
+static void
+akl_prefetch (ctrl_t ctrl, enum get_pubkey_modes mode,
+              struct akl *akl, const char *name, const char *mbox)
+{
+  gpg_error_t err;
+  const char *akl_name;
+  unsigned char *fpr;
+  size_t fprlen;
+  int rc;
+
+  for (; akl; akl = akl->next)
+    {
+      if (akl->type == AKL_LOCAL)
+        break;  /* Don't leak a possibly local address.  */
+      if (!(akl_name = akl_cache_name (ctrl, akl)))
+        continue;
+      fpr = NULL;
+      if (mode != GET_PUBKEY_NO_LOCAL
+          && akl_cache_lookup (ctrl, akl_name, mbox, &fpr, &fprlen, &rc))
+        {
+          xfree (fpr);
+          if (!rc)
+            break;  /* We will stop at this mechanism.  */
+          continue;
+        }
+
+      switch (akl->type)
+        {
+        case AKL_CERT:
+          err = keyserver_prefetch_cert (ctrl, name, 0);
+          break;
+        case AKL_DANE:
+          err = keyserver_prefetch_cert (ctrl, name, 1);
+          break;
+        case AKL_WKD:
+          err = keyserver_prefetch_wkd (ctrl, name, 0);
+          break;
+        case AKL_KEYSERVER:
+          err = keyserver_prefetch_mbox (ctrl, name, opt.keyserver);
+          break;
+        case AKL_SPEC:
+          err = keyserver_prefetch_mbox (ctrl, name,
+                                         keyserver_match (akl->spec));
+          break;
+        default:
+          err = 0;  /* Not supported; will be done in sequence.  */
+          break;
+        }
+      if (err && opt.verbose)
+        log_info ("auto-key-locate: starting %s failed: %s\n",
+                  akl_name, gpg_strerror (err));
+    }
+}
+
+
 /* Find a public key identified by NAME.
  *
  * If name appears to be a valid RFC822 mailbox (i.e., email address)
@@ -966,6 +1452,9 @@ get_pubkey_byname (ctrl_t ctrl, enum get_pubkey_modes mode,
   int nodefault = 0;
   int anylocalfirst = 0;
   int mechanism_type = AKL_NODEFAULT;
+  char *akl_mbox = NULL;
+  int akl_prefetched = 0;
+  int akl_racing = 0;
 
 
   /* If RETCTX is not NULL, then RET_KDBHD must be NULL.  */
@@ -1082,7 +1571,11 @@ get_pubkey_byname (ctrl_t ctrl, enum get_pubkey_modes mode,
       /* NAME wasn't present in the local keyring (or we didn't try
        * the local keyring).  Since the auto key locate feature is
        * enabled and NAME appears to be an email address, try the auto
-       * locate feature.  */
+       * locate feature.  The outcome of the network based mechanisms
+       * is cached by the Dirmngr so that we don't need to wait again
+       * for a failing lookup.  */
+      if (is_mbox)
+        akl_mbox = mailbox_from_userid (name, 0);
       for (akl = opt.auto_key_locate; akl; akl = akl->next)
 	{
 	  unsigned char *fpr = NULL;
@@ -1090,8 +1583,32 @@ get_pubkey_byname (ctrl_t ctrl, enum get_pubkey_modes mode,
 	  int did_akl_local = 0;
 	  int no_fingerprint = 0;
 	  const char *mechanism_string = "?";
+	  const char *akl_name = NULL;
+	  int akl_cached = 0;
+	  char fpr_string[MAX_FINGERPRINT_LEN * 2 + 1];
 
+          *fpr_string = 0;
           mechanism_type = akl->type;
+          if (akl_mbox)
+            akl_name = akl_cache_name (ctrl, akl);
+          if (mechanism_type == AKL_LOCAL)
+            akl_racing = 0;
+          else if (akl_name && opt.flags.akl_parallel && !akl_racing)
+            {
+              /* Start this and all following network lookups up to
+               * the next "local".  */
+              akl_prefetch (ctrl, mode, akl, name, akl_mbox);
+              akl_prefetched = akl_racing = 1;
+            }
+          if (akl_name && mode != GET_PUBKEY_NO_LOCAL
+              && akl_cache_lookup (ctrl, akl_name, akl_mbox,
+                                   &fpr, &fpr_len, &rc))
+            {
+              mechanism_string = akl_name;
+              akl_cached = 1;
+              goto have_result;
+            }
+
 	  switch (mechanism_type)
 	    {
 	    case AKL_NODEFAULT:
@@ -1264,6 +1781,7 @@ get_pubkey_byname (ctrl_t ctrl, enum get_pubkey_modes mode,
 	      break;
 	    }
 
+	have_result:
 	  /* Use the fingerprint of the key that we actually fetched.
 	   * This helps prevent problems where the key that we fetched
 	   * doesn't have the same name that we used to fetch it.  In
@@ -1273,8 +1791,6 @@ get_pubkey_byname (ctrl_t ctrl, enum get_pubkey_modes mode,
 	   * won't use the attacker's key here. */
 	  if (!rc && (fpr || is_fpr))
 	    {
-	      char fpr_string[MAX_FINGERPRINT_LEN * 2 + 1];
-
               if (is_fpr)
                 {
                   log_assert (fprbuf.fprlen <= MAX_FINGERPRINT_LEN);
@@ -1317,6 +1833,8 @@ get_pubkey_byname (ctrl_t ctrl, enum get_pubkey_modes mode,
 			       namelist, pk, 0,
 			       include_unusable, ret_keyblock, ret_kdbhd);
 	    }
+	  if (akl_name && !akl_cached)
+            akl_cache_store (ctrl, akl_name, akl_mbox, fpr_string, rc);
 	  if (!rc)
 	    {
 	      /* Key found.  */
@@ -1357,6 +1875,10 @@ get_pubkey_byname (ctrl_t ctrl, enum get_pubkey_modes mode,
   else
     free_strlist (namelist);
 
+  /* Results of lookups not yet finished are not needed anymore.  */
+  if (akl_prefetched)
+    gpg_dirmngr_prefetch_release (ctrl);
+  xfree (akl_mbox);
   return rc;
 }
 
@@ -1500,9 +2022,116 @@ pubkey_cmp (ctrl_t ctrl, const char *name, struct pubkey_cmp_cookie *old,
 }
 
 
+/* Return the slot of the best key cache for the mail address MBOX.  */
+static unsigned int
+best_key_cache_slot (const char *mbox)
+{
+  unsigned int hash = 0;
+
+  for (; *mbox; mbox++)
+    hash = hash * 31 + *(const unsigned char *)mbox;
+  return hash % BEST_KEY_CACHE_SIZE;
+}
+
+
+/* Return the key cached for MBOX and the lookup parameters or NULL if
+ * there is no usable entry.  The returned key is owned by the
+ * cache.  */
+static PKT_public_key *
+best_key_cache_get (const char *mbox, enum get_pubkey_modes mode,
+                    unsigned int req_usage, int include_unusable)
+{
+  unsigned int idx = best_key_cache_slot (mbox);
+  PKT_public_key *pk = best_key_cache[idx].pk;
+
+  if (!pk
+      || strcmp (best_key_cache[idx].mbox, mbox)
+      || best_key_cache[idx].mode != mode
+      || best_key_cache[idx].req_usage != req_usage
+      || best_key_cache[idx].include_unusable != include_unusable)
+    return NULL;
+
+  /* The ranking depends on the expiration and thus we need to rank
+   * again once the cached key has expired.  */
+  if (pk->expiredate && pk->expiredate <= make_timestamp ())
+    return NULL;
+
+  return pk;
+}
+
+
+/* Store a copy of PK as the best key for MBOX and the lookup
+ * parameters.  If PK is NULL the entry for MBOX is removed.  */
+static void
+best_key_cache_put (const char *mbox, enum get_pubkey_modes mode,
+                    unsigned int req_usage, int include_unusable,
+                    PKT_public_key *pk)
+{
+  unsigned int idx = best_key_cache_slot (mbox);
+  char *mboxcopy = NULL;
+
+  if (pk)
+    {
+      mboxcopy = xtrystrdup (mbox);
+      if (!mboxcopy)
+        return;  /* Caching is optional; thus ignore the error.  */
+    }
+
+  xfree (best_key_cache[idx].mbox);
+  best_key_cache[idx].mbox = mboxcopy;
+  free_public_key (best_key_cache[idx].pk);
+  best_key_cache[idx].pk = pk? copy_public_key (NULL, pk) : NULL;
+  if (best_key_cache[idx].pk)
+    share_public_key (best_key_cache[idx].pk);
+  best_key_cache[idx].mode = mode;
+  best_key_cache[idx].req_usage = req_usage;
+  best_key_cache[idx].include_unusable = include_unusable;
+}
+
+
+/* Helper for get_best_pubkey_byname to create a context for the key
+ * BESTPK and to store its keyblock at RET_KEYBLOCK.  The context is
+ * stored at R_CTX even if an error is returned.  */
+static gpg_error_t
+get_best_pubkey_ctx (ctrl_t ctrl, PKT_public_key *bestpk,
+                     getkey_ctx_t *r_ctx, kbnode_t *ret_keyblock)
+{
+  gpg_error_t err;
+  getkey_ctx_t ctx;
+  u32 *keyid;
+
+  *r_ctx = NULL;
+
+  ctx = xtrycalloc (1, sizeof *ctx);
+  if (!ctx)
+    return gpg_error_from_syserror ();
+  ctx->kr_handle = keydb_new (ctrl);
+  if (!ctx->kr_handle)
+    {
+      err = gpg_error_from_syserror ();
+      xfree (ctx);
+      return err;
+    }
+
+  keyid = pk_keyid (bestpk);
+  ctx->exact = 1;
+  ctx->nitems = 1;
+  ctx->items[0].mode = KEYDB_SEARCH_MODE_LONG_KID;
+  ctx->items[0].u.kid[0] = keyid[0];
+  ctx->items[0].u.kid[1] = keyid[1];
+
+  release_kbnode (*ret_keyblock);
+  *ret_keyblock = NULL;
+  err = getkey_next (ctrl, ctx, NULL, ret_keyblock);
+  *r_ctx = ctx;
+  return err;
+}
+
+
 /* This function works like get_pubkey_byname, but if the name
  * resembles a mail address, the results are ranked and only the best
- * result is returned.  */
+ * result is returned.  The selected key is cached per mail address
+ * as long as it has been found in the local database.  */
 gpg_error_t
 get_best_pubkey_byname (ctrl_t ctrl, enum get_pubkey_modes mode,
                         GETKEY_CTX *retctx, PKT_public_key *pk,
@@ -1514,6 +2143,9 @@ get_best_pubkey_byname (ctrl_t ctrl, enum get_pubkey_modes mode,
   int is_mbox;
   int wkd_tried = 0;
   PKT_public_key pk0;
+  unsigned int req_usage;
+  char *mbox = NULL;
+  int cacheable = 0;
 
   log_assert (ret_keyblock != NULL);
 
@@ -1521,7 +2153,7 @@ get_best_pubkey_byname (ctrl_t ctrl, enum get_pubkey_modes mode,
     *retctx = NULL;
 
   memset (&pk0, 0, sizeof pk0);
-  pk0.req_usage = pk? pk->req_usage : 0;
+  pk0.req_usage = req_usage = pk? pk->req_usage : 0;
 
   is_mbox = is_valid_mailbox (name);
   if (!is_mbox && *name == '<' && name[1] && name[strlen(name)-1]=='>'
@@ -1535,6 +2167,31 @@ get_best_pubkey_byname (ctrl_t ctrl, enum get_pubkey_modes mode,
       is_mbox = 1;
     }
 
+  if (is_mbox && !best_key_cache_disabled)
+    mbox = mailbox_from_userid (name, 0);
+  if (mbox)
+    {
+      PKT_public_key *cachedpk;
+
+      cachedpk = best_key_cache_get (mbox, mode, req_usage, include_unusable);
+      if (cachedpk)
+        {
+          err = get_best_pubkey_ctx (ctrl, cachedpk, &ctx, ret_keyblock);
+          if (!err)
+            {
+              if (pk)
+                copy_public_key (pk, cachedpk);
+              goto ready;
+            }
+          /* The key is gone; do a full lookup.  */
+          best_key_cache_put (mbox, mode, req_usage, include_unusable, NULL);
+          getkey_end (ctrl, ctx);
+          ctx = NULL;
+          release_kbnode (*ret_keyblock);
+          *ret_keyblock = NULL;
+        }
+    }
+
  start_over:
   if (ctx)  /* Clear  in case of a start over.  */
     {
@@ -1559,6 +2216,12 @@ get_best_pubkey_byname (ctrl_t ctrl, enum get_pubkey_modes mode,
       u32 now = make_timestamp ();
       int found;
 
+      /* Do not cache a key which is a candidate for a WKD refresh so
+       * that the check below is not skipped on the next lookup.  */
+      cacheable = !(pk0.keyorg == KEYORG_WKD
+                    && (pk0.has_expired
+                        || only_expired_enc_subkeys (*ret_keyblock)));
+
       /* If the key has expired and its origin was the WKD then try to
        * get a fresh key from the WKD.  We also try this if the key
        * has any only expired encryption subkeys.  In case we checked
@@ -1635,34 +2298,10 @@ get_best_pubkey_byname (ctrl_t ctrl, enum get_pubkey_modes mode,
 
       if (best.valid)
         {
-          ctx = xtrycalloc (1, sizeof **retctx);
-          if (! ctx)
-            err = gpg_error_from_syserror ();
-          else
-            {
-              ctx->kr_handle = keydb_new (ctrl);
-              if (! ctx->kr_handle)
-                {
-                  err = gpg_error_from_syserror ();
-                  xfree (ctx);
-                  ctx = NULL;
-                  if (retctx)
-                    *retctx = NULL;
-                }
-              else
-                {
-                  u32 *keyid = pk_keyid (&best.key);
-                  ctx->exact = 1;
-                  ctx->nitems = 1;
-                  ctx->items[0].mode = KEYDB_SEARCH_MODE_LONG_KID;
-                  ctx->items[0].u.kid[0] = keyid[0];
-                  ctx->items[0].u.kid[1] = keyid[1];
-
-                  release_kbnode (*ret_keyblock);
-                  *ret_keyblock = NULL;
-                  err = getkey_next (ctrl, ctx, NULL, ret_keyblock);
-                }
-            }
+          err = get_best_pubkey_ctx (ctrl, &best.key, &ctx, ret_keyblock);
+          if (!err && mbox && cacheable)
+            best_key_cache_put (mbox, mode, req_usage, include_unusable,
+                                &best.key);
 
           if (pk)
             *pk = best.key;
@@ -1686,6 +2325,7 @@ get_best_pubkey_byname (ctrl_t ctrl, enum get_pubkey_modes mode,
         release_public_key_parts (&pk0);
     }
 
+ ready:
   if (err && ctx)
     {
       getkey_end (ctrl, ctx);
@@ -1700,6 +2340,7 @@ get_best_pubkey_byname (ctrl_t ctrl, enum get_pubkey_modes mode,
 
  leave:
   getkey_end (ctrl, ctx);
+  xfree (mbox);
   return err;
 }
 
@@ -2645,6 +3286,83 @@ sig_to_revoke_info (PKT_signature * sig, struct revoke_info *rinfo)
 }
 
 
+/* The nodes of a keyblock relevant for merge_selfsigs.  A keyblock of
+ * a flooded key may carry a huge number of third-party signatures
+ * which are not used for the merging; by collecting the other nodes
+ * once the several passes over the keyblock need to look only at the
+ * nodes they care about.  */
+struct merge_nodes_s
+{
+  u32 kid[2];          /* The keyid of the primary key.  */
+  kbnode_t *nodes;     /* All key and user id nodes and the self-
+                        * signatures in keyblock order.  */
+  size_t nnodes;
+  kbnode_t *keyrevs;   /* Key revocations not issued by the key.  */
+  size_t nkeyrevs;
+};
+
+
+/* Classify the nodes of KEYBLOCK and store them at MN.  The caller
+ * must release the arrays using release_merge_nodes.  */
+static void
+classify_merge_nodes (kbnode_t keyblock, struct merge_nodes_s *mn)
+{
+  kbnode_t k;
+  PKT_signature *sig;
+  size_t n;
+  int in_uids;
+
+  keyid_from_pk (keyblock->pkt->pkt.public_key, mn->kid);
+
+  for (n = 0, k = keyblock; k; k = k->next)
+    n++;
+  mn->nodes = xmalloc (n * sizeof *mn->nodes);
+  mn->nnodes = 0;
+  mn->keyrevs = NULL;
+  mn->nkeyrevs = 0;
+
+  in_uids = 0;
+  for (k = keyblock; k; k = k->next)
+    {
+      if (k->pkt->pkttype == PKT_USER_ID)
+        in_uids = 1;
+
+      if (k->pkt->pkttype != PKT_SIGNATURE)
+        {
+          mn->nodes[mn->nnodes++] = k;
+          continue;
+        }
+
+      sig = k->pkt->pkt.signature;
+      if (sig->keyid[0] == mn->kid[0] && sig->keyid[1] == mn->kid[1])
+        mn->nodes[mn->nnodes++] = k;
+      else if (!in_uids && IS_KEY_REV (sig))
+        {
+          if (!mn->keyrevs)
+            mn->keyrevs = xmalloc (n * sizeof *mn->keyrevs);
+          mn->keyrevs[mn->nkeyrevs++] = k;
+        }
+    }
+}
+
+
+static void
+release_merge_nodes (struct merge_nodes_s *mn)
+{
+  xfree (mn->nodes);
+  xfree (mn->keyrevs);
+}
+
+
+/* Return the node at index IDX of MN or NULL if IDX is out of
+ * range.  */
+static kbnode_t
+merge_node (struct merge_nodes_s *mn, size_t idx)
+{
+  return idx < mn->nnodes? mn->nodes[idx] : NULL;
+}
+
+
 /* Given a keyblock, parse the key block and extract various pieces of
  * information and save them with the primary key packet and the user
  * id packets.  For instance, some information is stored in signature
@@ -2673,11 +3391,12 @@ sig_to_revoke_info (PKT_signature * sig, struct revoke_info *rinfo)
  * field is set to 1 and the other user id's is_primary are set to 0.
  */
 static void
-merge_selfsigs_main (ctrl_t ctrl, kbnode_t keyblock, int *r_revoked,
-		     struct revoke_info *rinfo)
+merge_selfsigs_main (ctrl_t ctrl, kbnode_t keyblock, struct merge_nodes_s *mn,
+                     int *r_revoked, struct revoke_info *rinfo)
 {
   PKT_public_key *pk = NULL;
   KBNODE k;
+  size_t i;
   u32 kid[2];
   u32 sigdate, uiddate, uiddate2;
   KBNODE signode, uidnode, uidnode2;
@@ -2706,7 +3425,8 @@ merge_selfsigs_main (ctrl_t ctrl, kbnode_t keyblock, int *r_revoked,
   pk = keyblock->pkt->pkt.public_key;
   keytimestamp = pk->timestamp;
 
-  keyid_from_pk (pk, kid);
+  kid[0] = mn->kid[0];
+  kid[1] = mn->kid[1];
   pk->main_keyid[0] = kid[0];
   pk->main_keyid[1] = kid[1];
 
@@ -2745,11 +3465,11 @@ merge_selfsigs_main (ctrl_t ctrl, kbnode_t keyblock, int *r_revoked,
   /* According to Section 11.1 of RFC 4880, the public key comes first
    * and is immediately followed by any signature packets that modify
    * it.  */
-  for (k = keyblock;
-       k && k->pkt->pkttype != PKT_USER_ID
+  for (i = 0;
+       (k = merge_node (mn, i)) && k->pkt->pkttype != PKT_USER_ID
 	 && k->pkt->pkttype != PKT_ATTRIBUTE
 	 && k->pkt->pkttype != PKT_PUBLIC_SUBKEY;
-       k = k->next)
+       i++)
     {
       if (k->pkt->pkttype == PKT_SIGNATURE)
 	{
@@ -2885,37 +3605,30 @@ merge_selfsigs_main (ctrl_t ctrl, kbnode_t keyblock, int *r_revoked,
    * first place and we're not revoked already.  */
 
   if (!*r_revoked && pk->revkey)
-    for (k = keyblock; k && k->pkt->pkttype != PKT_USER_ID; k = k->next)
+    for (i = 0; i < mn->nkeyrevs; i++)
       {
-	if (k->pkt->pkttype == PKT_SIGNATURE)
-	  {
-	    PKT_signature *sig = k->pkt->pkt.signature;
+        PKT_signature *sig = mn->keyrevs[i]->pkt->pkt.signature;
+        int rc = check_revocation_keys (ctrl, pk, sig);
 
-	    if (IS_KEY_REV (sig) &&
-		(sig->keyid[0] != kid[0] || sig->keyid[1] != kid[1]))
-	      {
-		int rc = check_revocation_keys (ctrl, pk, sig);
-		if (rc == 0)
-		  {
-		    *r_revoked = 2;
-		    sig_to_revoke_info (sig, rinfo);
-		    /* Don't continue checking since we can't be any
-		     * more revoked than this.  */
-		    break;
-		  }
-		else if (gpg_err_code (rc) == GPG_ERR_NO_PUBKEY)
-		  pk->flags.maybe_revoked = 1;
+        if (rc == 0)
+          {
+            *r_revoked = 2;
+            sig_to_revoke_info (sig, rinfo);
+            /* Don't continue checking since we can't be any
+             * more revoked than this.  */
+            break;
+          }
+        else if (gpg_err_code (rc) == GPG_ERR_NO_PUBKEY)
+          pk->flags.maybe_revoked = 1;
 
-		/* A failure here means the sig did not verify, was
-		 * not issued by a revocation key, or a revocation
-		 * key loop was broken.  If a revocation key isn't
-		 * findable, however, the key might be revoked and
-		 * we don't know it.  */
+        /* A failure here means the sig did not verify, was
+         * not issued by a revocation key, or a revocation
+         * key loop was broken.  If a revocation key isn't
+         * findable, however, the key might be revoked and
+         * we don't know it.  */
 
-		/* Fixme: In the future handle subkey and cert
-		 * revocations?  PGP doesn't, but it's in 2440.  */
-	      }
-	  }
+        /* Fixme: In the future handle subkey and cert
+         * revocations?  PGP doesn't, but it's in 2440.  */
       }
 
   /* Second pass: Look at the self-signature of all user IDs.  */
@@ -2925,7 +3638,8 @@ merge_selfsigs_main (ctrl_t ctrl, kbnode_t keyblock, int *r_revoked,
    * the subkey packets.  */
   signode = uidnode = NULL;
   sigdate = 0; /* Helper variable to find the latest signature in one UID. */
-  for (k = keyblock; k && k->pkt->pkttype != PKT_PUBLIC_SUBKEY; k = k->next)
+  for (i = 0; (k = merge_node (mn, i)) && k->pkt->pkttype != PKT_PUBLIC_SUBKEY;
+       i++)
     {
       if (k->pkt->pkttype == PKT_USER_ID || k->pkt->pkttype == PKT_ATTRIBUTE)
 	{ /* New user id packet.  */
@@ -3051,8 +3765,9 @@ merge_selfsigs_main (ctrl_t ctrl, kbnode_t keyblock, int *r_revoked,
     {
       /* Find the latest user ID with key flags set. */
       uiddate = 0; /* Helper to find the latest user ID.  */
-      for (k = keyblock; k && k->pkt->pkttype != PKT_PUBLIC_SUBKEY;
-	   k = k->next)
+      for (i = 0;
+           (k = merge_node (mn, i)) && k->pkt->pkttype != PKT_PUBLIC_SUBKEY;
+	   i++)
 	{
 	  if (k->pkt->pkttype == PKT_USER_ID)
 	    {
@@ -3090,8 +3805,9 @@ merge_selfsigs_main (ctrl_t ctrl, kbnode_t keyblock, int *r_revoked,
        * This may be a different one than from usage computation above
        * because some user IDs may have no expiration date set.  */
       uiddate = 0;
-      for (k = keyblock; k && k->pkt->pkttype != PKT_PUBLIC_SUBKEY;
-	   k = k->next)
+      for (i = 0;
+           (k = merge_node (mn, i)) && k->pkt->pkttype != PKT_PUBLIC_SUBKEY;
+	   i++)
 	{
 	  if (k->pkt->pkttype == PKT_USER_ID)
 	    {
@@ -3121,7 +3837,8 @@ merge_selfsigs_main (ctrl_t ctrl, kbnode_t keyblock, int *r_revoked,
   /* And now find the real primary user ID and delete all others.  */
   uiddate = uiddate2 = 0;
   uidnode = uidnode2 = NULL;
-  for (k = keyblock; k && k->pkt->pkttype != PKT_PUBLIC_SUBKEY; k = k->next)
+  for (i = 0; (k = merge_node (mn, i)) && k->pkt->pkttype != PKT_PUBLIC_SUBKEY;
+       i++)
     {
       if (k->pkt->pkttype == PKT_USER_ID && !k->pkt->pkt.user_id->attrib_data)
 	{
@@ -3161,8 +3878,9 @@ merge_selfsigs_main (ctrl_t ctrl, kbnode_t keyblock, int *r_revoked,
     }
   if (uidnode)
     {
-      for (k = keyblock; k && k->pkt->pkttype != PKT_PUBLIC_SUBKEY;
-	   k = k->next)
+      for (i = 0;
+           (k = merge_node (mn, i)) && k->pkt->pkttype != PKT_PUBLIC_SUBKEY;
+	   i++)
 	{
 	  if (k->pkt->pkttype == PKT_USER_ID &&
 	      !k->pkt->pkt.user_id->attrib_data)
@@ -3187,8 +3905,9 @@ merge_selfsigs_main (ctrl_t ctrl, kbnode_t keyblock, int *r_revoked,
 
       uidnode = NULL;
 
-      for (k = keyblock; k && k->pkt->pkttype != PKT_PUBLIC_SUBKEY;
-	   k = k->next)
+      for (i = 0;
+           (k = merge_node (mn, i)) && k->pkt->pkttype != PKT_PUBLIC_SUBKEY;
+	   i++)
 	{
 	  if (k->pkt->pkttype == PKT_USER_ID
 	      && !k->pkt->pkt.user_id->attrib_data)
@@ -3262,11 +3981,14 @@ buf_to_sig (const byte * buf, size_t len)
  *   flags.chosen_selfsig
  */
 static void
-merge_selfsigs_subkey (ctrl_t ctrl, kbnode_t keyblock, kbnode_t subnode)
+merge_selfsigs_subkey (ctrl_t ctrl, kbnode_t keyblock,
+                       struct merge_nodes_s *mn, size_t subidx)
 {
   PKT_public_key *mainpk = NULL, *subpk = NULL;
   PKT_signature *sig;
   KBNODE k;
+  kbnode_t subnode = mn->nodes[subidx];
+  size_t i;
   u32 mainkid[2];
   u32 sigdate = 0;
   KBNODE signode;
@@ -3281,7 +4003,8 @@ merge_selfsigs_subkey (ctrl_t ctrl, kbnode_t keyblock, kbnode_t subnode)
   mainpk = keyblock->pkt->pkt.public_key;
   if (mainpk->version < 4)
     return;/* (actually this should never happen) */
-  keyid_from_pk (mainpk, mainkid);
+  mainkid[0] = mn->kid[0];
+  mainkid[1] = mn->kid[1];
   subpk = subnode->pkt->pkt.public_key;
   keytimestamp = subpk->timestamp;
 
@@ -3293,8 +4016,9 @@ merge_selfsigs_subkey (ctrl_t ctrl, kbnode_t keyblock, kbnode_t subnode)
   /* Find the latest key binding self-signature.  */
   signode = NULL;
   sigdate = 0; /* Helper to find the latest signature.  */
-  for (k = subnode->next; k && k->pkt->pkttype != PKT_PUBLIC_SUBKEY;
-       k = k->next)
+  for (i = subidx + 1;
+       (k = merge_node (mn, i)) && k->pkt->pkttype != PKT_PUBLIC_SUBKEY;
+       i++)
     {
       if (k->pkt->pkttype == PKT_SIGNATURE)
 	{
@@ -3464,6 +4188,8 @@ merge_selfsigs (ctrl_t ctrl, kbnode_t keyblock)
   prefitem_t *prefs;
   unsigned int mdc_feature;
   unsigned int aead_feature;
+  struct merge_nodes_s mn;
+  size_t i;
 
   if (keyblock->pkt->pkttype != PKT_PUBLIC_KEY)
     {
@@ -3479,14 +4205,16 @@ merge_selfsigs (ctrl_t ctrl, kbnode_t keyblock)
       BUG ();
     }
 
-  merge_selfsigs_main (ctrl, keyblock, &revoked, &rinfo);
+  classify_merge_nodes (keyblock, &mn);
+
+  merge_selfsigs_main (ctrl, keyblock, &mn, &revoked, &rinfo);
 
   /* Now merge in the data from each of the subkeys.  */
-  for (k = keyblock; k; k = k->next)
+  for (i = 0; i < mn.nnodes; i++)
     {
-      if (k->pkt->pkttype == PKT_PUBLIC_SUBKEY)
+      if (mn.nodes[i]->pkt->pkttype == PKT_PUBLIC_SUBKEY)
 	{
-	  merge_selfsigs_subkey (ctrl, keyblock, k);
+	  merge_selfsigs_subkey (ctrl, keyblock, &mn, i);
 	}
     }
 
@@ -3496,8 +4224,9 @@ merge_selfsigs (ctrl_t ctrl, kbnode_t keyblock)
       /* If the primary key is revoked, expired, or invalid we
        * better set the appropriate flags on that key and all
        * subkeys.  */
-      for (k = keyblock; k; k = k->next)
+      for (i = 0; i < mn.nnodes; i++)
 	{
+          k = mn.nodes[i];
 	  if (k->pkt->pkttype == PKT_PUBLIC_KEY
 	      || k->pkt->pkttype == PKT_PUBLIC_SUBKEY)
 	    {
@@ -3517,6 +4246,7 @@ merge_selfsigs (ctrl_t ctrl, kbnode_t keyblock)
 		}
 	    }
 	}
+      release_merge_nodes (&mn);
       return;
     }
 
@@ -3530,7 +4260,9 @@ merge_selfsigs (ctrl_t ctrl, kbnode_t keyblock)
    * Do a similar thing for the MDC feature flag.  */
   prefs = NULL;
   mdc_feature = aead_feature = 0;
-  for (k = keyblock; k && k->pkt->pkttype != PKT_PUBLIC_SUBKEY; k = k->next)
+  for (i = 0;
+       (k = merge_node (&mn, i)) && k->pkt->pkttype != PKT_PUBLIC_SUBKEY;
+       i++)
     {
       if (k->pkt->pkttype == PKT_USER_ID
 	  && !k->pkt->pkt.user_id->attrib_data
@@ -3542,8 +4274,9 @@ merge_selfsigs (ctrl_t ctrl, kbnode_t keyblock)
 	  break;
 	}
     }
-  for (k = keyblock; k; k = k->next)
+  for (i = 0; i < mn.nnodes; i++)
     {
+      k = mn.nodes[i];
       if (k->pkt->pkttype == PKT_PUBLIC_KEY
 	  || k->pkt->pkttype == PKT_PUBLIC_SUBKEY)
 	{
@@ -3555,6 +4288,8 @@ merge_selfsigs (ctrl_t ctrl, kbnode_t keyblock)
 	  pk->flags.aead = aead_feature;
 	}
     }
+
+  release_merge_nodes (&mn);
 }
 
 
@@ -4103,6 +4838,42 @@ get_seckey_default_or_card (ctrl_t ctrl, PKT_public_key *pk,
  ***********  User ID printing helpers *******
  *********************************************/
 
+/* Return the user id for KEYID from the user id cache.  If it is not
+ * yet cached the key is looked up to fill the cache.  Key ids which
+ * are not in the database are remembered so that we do not search
+ * for them again.  Returns NULL if no user id was found.  */
+static char *
+get_cached_uid_bykid (ctrl_t ctrl, u32 *keyid, unsigned int *r_namelen)
+{
+  char *name;
+  unsigned int idx;
+  gpg_error_t err;
+
+  name = cache_get_uid_bykid (keyid, r_namelen);
+  if (name)
+    return name;
+
+  idx = (keyid[0] ^ keyid[1]) % NOKEY_CACHE_SIZE;
+  if (nokey_cache[idx].valid
+      && nokey_cache[idx].keyid[0] == keyid[0]
+      && nokey_cache[idx].keyid[1] == keyid[1])
+    return NULL;
+
+  /* Get it so that the cache will be filled.  */
+  err = get_pubkey (ctrl, NULL, keyid);
+  if (!err)
+    return cache_get_uid_bykid (keyid, r_namelen);
+
+  if (gpg_err_code (err) == GPG_ERR_NO_PUBKEY)
+    {
+      nokey_cache[idx].valid = 1;
+      nokey_cache[idx].keyid[0] = keyid[0];
+      nokey_cache[idx].keyid[1] = keyid[1];
+    }
+  return NULL;
+}
+
+
 /* Return a string with a printable representation of the user_id.
  * this string must be freed by xfree.  If R_NOUID is not NULL it is
  * set to true if a user id was not found; otherwise to false.  */
@@ -4115,13 +4886,7 @@ get_user_id_string (ctrl_t ctrl, u32 * keyid, int mode)
 
   log_assert (mode != 2);
 
-  name = cache_get_uid_bykid (keyid, &namelen);
-  if (!name)
-    {
-      /* Get it so that the cache will be filled.  */
-      if (!get_pubkey (ctrl, NULL, keyid))
-        name = cache_get_uid_bykid (keyid, &namelen);
-    }
+  name = get_cached_uid_bykid (ctrl, keyid, &namelen);
 
   if (name)
     {
@@ -4172,13 +4937,7 @@ get_user_id (ctrl_t ctrl, u32 *keyid, size_t *rn, int *r_nouid)
   if (r_nouid)
     *r_nouid = 0;
 
-  name = cache_get_uid_bykid (keyid, &namelen);
-  if (!name)
-    {
-      /* Get it so that the cache will be filled.  */
-      if (!get_pubkey (ctrl, NULL, keyid))
-        name = cache_get_uid_bykid (keyid, &namelen);
-    }
+  name = get_cached_uid_bykid (ctrl, keyid, &namelen);
 
   if (!name)
     {
@@ -4509,3 +5268,43 @@ have_secret_key_with_kid (ctrl_t ctrl, u32 *keyid)
   keydb_release (kdbhd);
   return result;
 }
+
+
+/* Returns true if a key or subkey with key id KEYID is in the
+ * database.  This is a cheap check which does not parse the keyblock.
+ * Key ids not found are remembered in the nokey cache so that
+ * checking many signatures from the same unknown key does not search
+ * the database again.  */
+int
+have_pubkey_with_kid (ctrl_t ctrl, u32 *keyid)
+{
+  gpg_error_t err;
+  KEYDB_HANDLE kdbhd;
+  unsigned int idx;
+
+#if MAX_PK_CACHE_ENTRIES
+  if (pk_cache_lookup (keyid, NULL, 0, 0))
+    return 1;
+#endif
+
+  idx = (keyid[0] ^ keyid[1]) % NOKEY_CACHE_SIZE;
+  if (nokey_cache[idx].valid
+      && nokey_cache[idx].keyid[0] == keyid[0]
+      && nokey_cache[idx].keyid[1] == keyid[1])
+    return 0;
+
+  kdbhd = keydb_new (ctrl);
+  if (!kdbhd)
+    return 1;  /* Let the caller do the full check.  */
+  err = keydb_search_kid (kdbhd, keyid);
+  keydb_release (kdbhd);
+
+  if (gpg_err_code (err) == GPG_ERR_NOT_FOUND)
+    {
+      nokey_cache[idx].valid = 1;
+      nokey_cache[idx].keyid[0] = keyid[0];
+      nokey_cache[idx].keyid[1] = keyid[1];
+      return 0;
+    }
+  return 1;
+}
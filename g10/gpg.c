@@ -107,6 +107,7 @@ enum cmd_and_opt_values
     oMaxOutput,
     oInputSizeHint,
     oChunkSize,
+    oAEADThreads,
     oSigNotation,
     oCertNotation,
     oShowNotation,
@@ -133,6 +134,7 @@ enum cmd_and_opt_values
     aQuickAddADSK,
     aQuickRevUid,
     aQuickSetExpire,
+    aQuickBatchEdit,
     aQuickSetPrimaryUid,
     aQuickUpdatePref,
     aListConfig,
@@ -148,6 +150,7 @@ enum cmd_and_opt_values
     aFastImport,
     aVerify,
     aVerifyFiles,
+    aVerifyFilesBatch,
     aListSigs,
     aSendKeys,
     aRecvKeys,
@@ -199,6 +202,7 @@ enum cmd_and_opt_values
     oNoAskCertExpire,
     oDefCertLevel,
     oMinCertLevel,
+    oMaxUidSigs,
     oAskCertLevel,
     oNoAskCertLevel,
     oFingerprint,
@@ -325,6 +329,11 @@ enum cmd_and_opt_values
     oKeyServerOptions,
     oImportOptions,
     oImportFilter,
+    oImportThreads,
+    oTrustDBThreads,
+    oCheckSigsThreads,
+    oEncryptThreads,
+    oTrustDBCacheSize,
     oExportOptions,
     oExportFilter,
     oListOptions,
@@ -407,6 +416,8 @@ enum cmd_and_opt_values
     oMultifile,
     oKeyidFormat,
     oExitOnStatusWriteError,
+    oStatusBuffered,
+    oTraceFile,
     oLimitCardInsertTries,
     oReaderPort,
     octapiDriver,
@@ -416,6 +427,8 @@ enum cmd_and_opt_values
     oNoRequireCrossCert,
     oAutoKeyLocate,
     oNoAutoKeyLocate,
+    oAutoKeyLocateParallel,
+    oNoAutoKeyLocateParallel,
     oEnableLargeRSA,
     oDisableLargeRSA,
     oEnableDSA2,
@@ -436,6 +449,7 @@ enum cmd_and_opt_values
     oKeyOrigin,
     oRequestOrigin,
     oNoSymkeyCache,
+    oKeyCacheSize,
     oUseOnlyOpenPGPCard,
     oFullTimestrings,
     oIncludeKeyBlock,
@@ -468,6 +482,7 @@ static gpgrt_opt_t opts[] = {
   ARGPARSE_c (aDecryptFiles, "decrypt-files", "@"),
   ARGPARSE_c (aVerify, "verify"   , N_("verify a signature")),
   ARGPARSE_c (aVerifyFiles, "verify-files" , "@" ),
+  ARGPARSE_c (aVerifyFilesBatch, "verify-files-batch" , "@" ),
   ARGPARSE_c (aListKeys, "list-keys", N_("list keys")),
   ARGPARSE_c (aListKeys, "list-public-keys", "@" ),
   ARGPARSE_c (aListSigs, "list-signatures", N_("list keys and signatures")),
@@ -494,6 +509,7 @@ static gpgrt_opt_t opts[] = {
   ARGPARSE_c (aQuickRevUid,  "quick-revuid", "@"),
   ARGPARSE_c (aQuickSetExpire,  "quick-set-expire",
               N_("quickly set a new expiration date")),
+  ARGPARSE_c (aQuickBatchEdit,  "quick-batch-edit", "@"),
   ARGPARSE_c (aQuickSetPrimaryUid,  "quick-set-primary-uid", "@"),
   ARGPARSE_c (aQuickUpdatePref,  "quick-update-pref", "@"),
   ARGPARSE_c (aFullKeygen,  "full-generate-key" ,
@@ -651,6 +667,8 @@ static gpgrt_opt_t opts[] = {
   ARGPARSE_s_s (oKeyboxdProgram, "keyboxd-program", "@"),
   ARGPARSE_s_s (oDirmngrProgram, "dirmngr-program", "@"),
   ARGPARSE_s_n (oExitOnStatusWriteError, "exit-on-status-write-error", "@"),
+  ARGPARSE_s_n (oStatusBuffered, "status-buffered", "@"),
+  ARGPARSE_s_s (oTraceFile, "trace-file", "@"),
   ARGPARSE_s_i (oLimitCardInsertTries, "limit-card-insert-tries", "@"),
   ARGPARSE_s_n (oEnableProgressFilter, "enable-progress-filter", "@"),
   ARGPARSE_s_s (oTempDir,  "temp-directory", "@"),
@@ -671,6 +689,7 @@ static gpgrt_opt_t opts[] = {
   ARGPARSE_s_n (oNoAskCertExpire, "no-ask-cert-expire", "@"),
   ARGPARSE_s_i (oDefCertLevel, "default-cert-level", "@"),
   ARGPARSE_s_i (oMinCertLevel, "min-cert-level", "@"),
+  ARGPARSE_s_i (oMaxUidSigs, "max-uid-sigs", "@"),
   ARGPARSE_s_n (oAskCertLevel,      "ask-cert-level", "@"),
   ARGPARSE_s_n (oNoAskCertLevel, "no-ask-cert-level", "@"),
   ARGPARSE_s_n (oOnlySignTextIDs, "only-sign-text-ids", "@"),
@@ -762,7 +781,9 @@ static gpgrt_opt_t opts[] = {
   ARGPARSE_s_n (oMangleDosFilenames,      "mangle-dos-filenames", "@"),
   ARGPARSE_s_n (oNoMangleDosFilenames, "no-mangle-dos-filenames", "@"),
   ARGPARSE_s_i (oChunkSize, "chunk-size", "@"),
+  ARGPARSE_s_i (oAEADThreads, "aead-threads", "@"),
   ARGPARSE_s_n (oNoSymkeyCache, "no-symkey-cache", "@"),
+  ARGPARSE_s_u (oKeyCacheSize, "key-cache-size", "@"),
   ARGPARSE_s_n (oSkipVerify, "skip-verify", "@"),
   ARGPARSE_s_n (oListOnly, "list-only", "@"),
   ARGPARSE_s_i (oCompress, NULL,
@@ -777,6 +798,8 @@ static gpgrt_opt_t opts[] = {
   ARGPARSE_s_s (oAutoKeyLocate, "auto-key-locate",
               N_("|MECHANISMS|use MECHANISMS to locate keys by mail address")),
   ARGPARSE_s_n (oNoAutoKeyLocate, "no-auto-key-locate", "@"),
+  ARGPARSE_s_n (oAutoKeyLocateParallel, "auto-key-locate-parallel", "@"),
+  ARGPARSE_s_n (oNoAutoKeyLocateParallel, "no-auto-key-locate-parallel", "@"),
   ARGPARSE_s_n (oAutoKeyImport,   "auto-key-import",
                 N_("import missing key from a signature")),
   ARGPARSE_s_n (oNoAutoKeyImport, "no-auto-key-import", "@"),
@@ -792,6 +815,11 @@ static gpgrt_opt_t opts[] = {
   ARGPARSE_s_s (oKeyOrigin, "key-origin", "@"),
   ARGPARSE_s_s (oImportOptions, "import-options", "@"),
   ARGPARSE_s_s (oImportFilter,  "import-filter", "@"),
+  ARGPARSE_s_i (oImportThreads, "import-threads", "@"),
+  ARGPARSE_s_i (oTrustDBThreads, "trustdb-threads", "@"),
+  ARGPARSE_s_i (oCheckSigsThreads, "check-sigs-threads", "@"),
+  ARGPARSE_s_i (oEncryptThreads, "encrypt-threads", "@"),
+  ARGPARSE_s_i (oTrustDBCacheSize, "trustdb-cache-size", "@"),
   ARGPARSE_s_s (oExportOptions, "export-options", "@"),
   ARGPARSE_s_s (oExportFilter,  "export-filter", "@"),
   ARGPARSE_s_n (oMergeOnly,	  "merge-only", "@" ),
@@ -1013,6 +1041,7 @@ static struct debug_flags_s debug_flags [] =
     { DBG_CLOCK_VALUE  , "clock"   },
     { DBG_LOOKUP_VALUE , "lookup"  },
     { DBG_EXTPROG_VALUE, "extprog" },
+    { DBG_TRACE_VALUE  , "trace"   },
     { 0, NULL }
   };
 
@@ -2335,6 +2364,8 @@ gpg_deinit_default_ctrl (ctrl_t ctrl)
   gpg_keyboxd_deinit_session_data (ctrl);
   xfree (ctrl->secret_keygrips);
   ctrl->secret_keygrips = NULL;
+  xfree (ctrl->secret_keyinfo);
+  ctrl->secret_keyinfo = NULL;
 }
 
 
@@ -2701,6 +2732,7 @@ main (int argc, char **argv)
 	  case aQuickAddADSK:
 	  case aQuickRevUid:
 	  case aQuickSetExpire:
+	  case aQuickBatchEdit:
 	  case aQuickSetPrimaryUid:
 	  case aQuickUpdatePref:
 	  case aExportOwnerTrust:
@@ -2741,6 +2773,7 @@ main (int argc, char **argv)
 
 	  case aVerifyFiles: multifile=1; /* fall through */
 	  case aVerify: set_cmd( &cmd, aVerify); break;
+	  case aVerifyFilesBatch: set_cmd (&cmd, aVerifyFilesBatch); break;
 
           case aServer:
             set_cmd (&cmd, pargs.r_opt);
@@ -2764,6 +2797,30 @@ main (int argc, char **argv)
             opt.chunk_size = pargs.r.ret_int;
             break;
 
+          case oAEADThreads:
+            opt.aead_threads = pargs.r.ret_int;
+            break;
+
+          case oImportThreads:
+            opt.import_threads = pargs.r.ret_int;
+            break;
+
+          case oTrustDBThreads:
+            opt.trustdb_threads = pargs.r.ret_int;
+            break;
+
+          case oCheckSigsThreads:
+            opt.check_sigs_threads = pargs.r.ret_int;
+            break;
+
+          case oEncryptThreads:
+            opt.encrypt_threads = pargs.r.ret_int;
+            break;
+
+          case oTrustDBCacheSize:
+            opt.trustdb_cache_size = pargs.r.ret_int;
+            break;
+
 	  case oQuiet: opt.quiet = 1; break;
 	  case oNoTTY: tty_no_terminal(1); break;
 	  case oDryRun: opt.dry_run = 1; break;
@@ -3203,6 +3260,11 @@ main (int argc, char **argv)
 	  case oNoAskCertExpire: opt.ask_cert_expire = 0; break;
           case oDefCertLevel: opt.def_cert_level=pargs.r.ret_int; break;
           case oMinCertLevel: opt.min_cert_level=pargs.r.ret_int; break;
+          case oMaxUidSigs:
+            opt.max_uid_sigs = pargs.r.ret_int;
+            if (opt.max_uid_sigs < 0)
+              opt.max_uid_sigs = 0;
+            break;
 	  case oAskCertLevel: opt.ask_cert_level = 1; break;
 	  case oNoAskCertLevel: opt.ask_cert_level = 0; break;
 	  case oLocalUser: /* store the local users */
@@ -3625,6 +3687,14 @@ main (int argc, char **argv)
             opt.exit_on_status_write_error = 1;
             break;
 
+          case oStatusBuffered:
+            opt.status_buffered = 1;
+            break;
+
+          case oTraceFile:
+            opt.trace_file = pargs.r.ret_str;
+            break;
+
 	  case oLimitCardInsertTries:
             opt.limit_card_insert_tries = pargs.r.ret_int;
             break;
@@ -3652,6 +3722,8 @@ main (int argc, char **argv)
 	  case oNoAutoKeyLocate:
 	    release_akl();
 	    break;
+	  case oAutoKeyLocateParallel: opt.flags.akl_parallel = 1; break;
+	  case oNoAutoKeyLocateParallel: opt.flags.akl_parallel = 0; break;
 
 	  case oKeyOrigin:
 	    if(!parse_key_origin (pargs.r.ret_str))
@@ -3711,6 +3783,7 @@ main (int argc, char **argv)
 
           case oNoAutostart: opt.autostart = 0; break;
           case oNoSymkeyCache: opt.no_symkey_cache = 1; break;
+          case oKeyCacheSize: opt.key_cache_size = pargs.r.ret_ulong; break;
 
 	  case oDefaultNewKeyAlgo:
             opt.def_new_key_algo = pargs.r.ret_str;
@@ -4024,6 +4097,48 @@ main (int argc, char **argv)
         log_info (_("chunk size invalid - using %d\n"), opt.chunk_size);
       }
 
+    /* Values of 0 and 1 both select the single threaded code.  */
+    if (opt.aead_threads < 0)
+      opt.aead_threads = 0;
+    else if (opt.aead_threads > MAX_AEAD_THREADS)
+      {
+        opt.aead_threads = MAX_AEAD_THREADS;
+        log_info (_("number of AEAD threads limited to %d\n"),
+                  opt.aead_threads);
+      }
+    if (opt.import_threads < 0)
+      opt.import_threads = 0;
+    else if (opt.import_threads > MAX_IMPORT_THREADS)
+      {
+        opt.import_threads = MAX_IMPORT_THREADS;
+        log_info (_("number of import threads limited to %d\n"),
+                  opt.import_threads);
+      }
+    if (opt.trustdb_threads < 0)
+      opt.trustdb_threads = 0;
+    else if (opt.trustdb_threads > MAX_IMPORT_THREADS)
+      {
+        opt.trustdb_threads = MAX_IMPORT_THREADS;
+        log_info (_("number of trustdb threads limited to %d\n"),
+                  opt.trustdb_threads);
+      }
+    if (opt.check_sigs_threads < 0)
+      opt.check_sigs_threads = 0;
+    else if (opt.check_sigs_threads > MAX_IMPORT_THREADS)
+      {
+        opt.check_sigs_threads = MAX_IMPORT_THREADS;
+        log_info (_("number of threads limited to %d\n"),
+                  opt.check_sigs_threads);
+      }
+    if (opt.encrypt_threads < 0)
+      opt.encrypt_threads = 0;
+    else if (opt.encrypt_threads > MAX_IMPORT_THREADS)
+      {
+        opt.encrypt_threads = MAX_IMPORT_THREADS;
+        log_info (_("number of threads limited to %d\n"),
+                  opt.encrypt_threads);
+      }
+
     /* We don't support all possible commands with multifile yet */
     if(multifile)
       {
@@ -4327,6 +4442,7 @@ main (int argc, char **argv)
       case aQuickAddKey:
       case aQuickAddADSK:
       case aQuickRevUid:
+      case aQuickBatchEdit:
       case aQuickSetPrimaryUid:
       case aQuickUpdatePref:
       case aFullKeygen:
@@ -4525,6 +4641,14 @@ main (int argc, char **argv)
           write_status_failure ("verify", rc);
 	break;
 
+      case aVerifyFilesBatch:
+        if ((rc = verify_files_batch (ctrl, argc, argv)))
+          {
+            log_error ("verify files failed: %s\n", gpg_strerror (rc));
+            write_status_failure ("verify", rc);
+          }
+	break;
+
       case aDecrypt:
         if (multifile)
 	  decrypt_messages (ctrl, argc, argv);
@@ -4828,6 +4952,12 @@ main (int argc, char **argv)
         }
 	break;
 
+      case aQuickBatchEdit:
+        if (argc > 1)
+          wrong_args ("--quick-batch-edit [FILE]");
+        keyedit_quick_batch (ctrl, argc? *argv : NULL, locusr);
+	break;
+
       case aQuickSetPrimaryUid:
         {
           const char *uid, *primaryuid;
@@ -5447,6 +5577,7 @@ g10_exit( int rc )
   if ( (opt.debug & DBG_MEMSTAT_VALUE) )
     {
       keydb_dump_stats ();
+      getkey_dump_stats ();
       sig_check_dump_stats ();
       objcache_dump_stats ();
       gcry_control (GCRYCTL_DUMP_MEMORY_STATS);
@@ -5455,6 +5586,8 @@ g10_exit( int rc )
   if (opt.debug)
     gcry_control (GCRYCTL_DUMP_SECMEM_STATS );
 
+  flush_status_fd ();
+  trace_close ();
   gnupg_block_all_signals ();
   emergency_cleanup ();
 
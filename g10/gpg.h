@@ -52,6 +52,15 @@
  * format_hexfingerprint().  */
 #define MAX_FORMATTED_FINGERPRINT_LEN 60
 
+/* The maximum number of threads used to process AEAD chunks.  */
+#define MAX_AEAD_THREADS 16
+
+/* The maximum number of digest algorithms hashed in parallel.  */
+#define MAX_HASH_THREADS 8
+
+/* The maximum number of threads used to verify signatures on import. */
+#define MAX_IMPORT_THREADS 16
+
 
 /*
    Forward declarations.
@@ -98,6 +107,7 @@ struct server_control_s
 
   /* Local data for call-dirmngr.c  */
   dirmngr_local_t dirmngr_local;
+  struct dirmngr_prefetch_s *dirmngr_prefetch;
 
   /* Local data for call-keyboxd.c  */
   keyboxd_local_t keyboxd_local;
@@ -111,6 +121,11 @@ struct server_control_s
   /* This is used to cache a key data base handle.  */
   KEYDB_HANDLE cached_getkey_kdb;
 
+  /* If set a bad signature does not terminate the process in batch
+   * mode.  This is used to continue with the next signature of
+   * --verify-files-batch.  */
+  int no_exit_on_bad_sig;
+
   /* Cached results from HAVEKEY --list.  They are used if the pointer
    * is not NULL.  The length gives the length in bytes and is a
    * multiple of 20.  If the no_more flag is set the list shall not
@@ -118,6 +133,13 @@ struct server_control_s
   unsigned char *secret_keygrips;
   size_t secret_keygrips_len;
   int no_more_secret_keygrips;
+
+  /* Cached results from KEYINFO --list.  Each item is 21 bytes: the
+   * keygrip followed by the rank as returned by
+   * agent_secret_key_rank.  The no_more flag is used as above.  */
+  unsigned char *secret_keyinfo;
+  size_t secret_keyinfo_len;
+  int no_more_secret_keyinfo;
 };
 
 
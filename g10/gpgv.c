@@ -27,6 +27,7 @@
 #include <string.h>
 #include <ctype.h>
 #include <unistd.h>
+#include <sys/stat.h>
 #ifdef HAVE_DOSISH_SYSTEM
 #include <fcntl.h> /* for setmode() */
 #endif
@@ -50,6 +51,7 @@
 #include "../common/sysutils.h"
 #include "../common/status.h"
 #include "call-agent.h"
+#include "call-dirmngr.h"
 #include "../common/init.h"
 
 
@@ -68,6 +70,7 @@ enum cmd_and_opt_values {
   oWeakDigest,
   oEnableSpecialFilenames,
   oDebug,
+  oKeyringImage,
   aTest
 };
 
@@ -79,6 +82,8 @@ static gpgrt_opt_t opts[] = {
   ARGPARSE_s_n (oQuiet,   "quiet",   N_("be somewhat more quiet")),
   ARGPARSE_s_s (oKeyring, "keyring",
                 N_("|FILE|take the keys from the keyring FILE")),
+  ARGPARSE_s_s (oKeyringImage, "keyring-image",
+                N_("|FILE|use FILE as a prebuilt image of the keyrings")),
   ARGPARSE_s_s (oOutput, "output", N_("|FILE|write output to FILE")),
   ARGPARSE_s_n (oIgnoreTimeConflict, "ignore-time-conflict",
                 N_("make timestamp conflicts only a warning")),
@@ -169,6 +174,185 @@ my_strusage( int level )
 
 
 
+/* Return the file name used by keydb_add_resource for the resource
+ * NAME.  Caller must free the result.  */
+static char *
+resource_filename (const char *name)
+{
+  if (!strncmp (name, "gnupg-ring:", 11))
+    name += 11;
+  else if (!strncmp (name, "gnupg-kbx:", 10))
+    name += 10;
+
+  if (strchr (name, DIRSEP_C)
+#ifdef HAVE_DRIVE_LETTERS
+      || strchr (name, ':')
+#endif
+      )
+    return make_filename (name, NULL);
+  return make_filename (gnupg_homedir (), name, NULL);
+}
+
+
+/* Return true if the keyring image IMAGE is not older than any of the
+ * keyrings in RINGS.  If RINGS is NULL the default keyrings are
+ * checked.  */
+static int
+keyring_image_fresh_p (const char *image, strlist_t rings)
+{
+  struct stat st;
+  time_t imgtime;
+  strlist_t sl;
+  char *fname;
+  int okay = 1;
+  int nfound = 0;
+
+  if (gnupg_stat (image, &st))
+    return 0;
+  imgtime = st.st_mtime;
+
+  if (!rings)
+    {
+      fname = resource_filename ("trustedkeys" EXTSEP_S "kbx");
+      if (!gnupg_stat (fname, &st))
+        {
+          nfound++;
+          if (st.st_mtime >= imgtime)
+            okay = 0;
+        }
+      xfree (fname);
+      fname = resource_filename ("trustedkeys" EXTSEP_S "gpg");
+      if (!gnupg_stat (fname, &st))
+        {
+          nfound++;
+          if (st.st_mtime >= imgtime)
+            okay = 0;
+        }
+      xfree (fname);
+    }
+  for (sl = rings; sl && okay; sl = sl->next)
+    {
+      fname = resource_filename (sl->d);
+      if (gnupg_stat (fname, &st) || st.st_mtime >= imgtime)
+        okay = 0;
+      else
+        nfound++;
+      xfree (fname);
+    }
+
+  return okay && nfound;
+}
+
+
+/* Write all keys of the current key database to the keyring image
+ * IMAGE.  Only the parts needed to verify signatures are kept; in
+ * particular third-party key signatures are dropped.  The image is
+ * written to a temporary file which is then renamed so that a
+ * concurrent gpgv never sees a partial image.  */
+static gpg_error_t
+write_keyring_image (ctrl_t ctrl, const char *image)
+{
+  gpg_error_t err;
+  KEYDB_HANDLE hd;
+  kbnode_t keyblock = NULL;
+  kbnode_t node;
+  u32 keyid[2];
+  char *tmpname;
+  iobuf_t out = NULL;
+  mode_t oldmask;
+  int nkeys = 0;
+
+  tmpname = xstrconcat (image, EXTSEP_S "tmp", NULL);
+
+  hd = keydb_new (ctrl);
+  if (!hd)
+    {
+      err = gpg_error_from_syserror ();
+      goto leave;
+    }
+
+  oldmask = umask (022);
+  if (is_secured_filename (tmpname))
+    {
+      out = NULL;
+      gpg_err_set_errno (EPERM);
+    }
+  else
+    out = iobuf_create (tmpname, 1);
+  umask (oldmask);
+  if (!out)
+    {
+      err = gpg_error_from_syserror ();
+      log_info (_("can't create '%s': %s\n"), tmpname, gpg_strerror (err));
+      goto leave;
+    }
+
+  for (err = keydb_search_first (hd); !err; err = keydb_search_next (hd))
+    {
+      err = keydb_get_keyblock (hd, &keyblock);
+      if (err)
+        break;
+      keyid_from_pk (keyblock->pkt->pkt.public_key, keyid);
+      for (node = keyblock; node && !err; node = node->next)
+        {
+          if (node->pkt->pkttype == PKT_RING_TRUST)
+            continue;
+          if (node->pkt->pkttype == PKT_SIGNATURE
+              && (node->pkt->pkt.signature->keyid[0] != keyid[0]
+                  || node->pkt->pkt.signature->keyid[1] != keyid[1]))
+            continue;
+          err = build_packet (out, node->pkt);
+        }
+      release_kbnode (keyblock);
+      keyblock = NULL;
+      if (err)
+        break;
+      nkeys++;
+    }
+  if (gpg_err_code (err) == GPG_ERR_NOT_FOUND
+      || gpg_err_code (err) == GPG_ERR_EOF)
+    err = 0;
+  if (err)
+    {
+      log_info ("error writing keyring image '%s': %s\n",
+                tmpname, gpg_strerror (err));
+      goto leave;
+    }
+
+  if (iobuf_close (out))
+    {
+      err = gpg_error_from_syserror ();
+      out = NULL;
+      log_info ("error closing '%s': %s\n", tmpname, gpg_strerror (err));
+      goto leave;
+    }
+  out = NULL;
+  iobuf_ioctl (NULL, IOBUF_IOCTL_INVALIDATE_CACHE, 0, (char*)tmpname);
+
+  err = gnupg_rename_file (tmpname, image, NULL);
+  if (err)
+    {
+      log_info (_("renaming '%s' to '%s' failed: %s\n"),
+                tmpname, image, gpg_strerror (err));
+      goto leave;
+    }
+  if (opt.verbose)
+    log_info ("keyring image '%s' written with %d keys\n", image, nkeys);
+
+ leave:
+  if (out)
+    {
+      iobuf_cancel (out);
+      gnupg_remove (tmpname);
+    }
+  release_kbnode (keyblock);
+  keydb_release (hd);
+  xfree (tmpname);
+  return err;
+}
+
+
+
 int
 main( int argc, char **argv )
 {
@@ -176,6 +360,9 @@ main( int argc, char **argv )
   int rc=0;
   strlist_t sl;
   strlist_t nrings = NULL;
+  const char *keyring_image = NULL;
+  char *image = NULL;
+  int rebuild_image = 0;
   ctrl_t ctrl;
 
   early_system_init ();
@@ -230,6 +417,7 @@ main( int argc, char **argv )
             }
           break;
         case oKeyring: append_to_strlist( &nrings, pargs.r.ret_str); break;
+        case oKeyringImage: keyring_image = pargs.r.ret_str; break;
         case oOutput: opt.outfile = pargs.r.ret_str; break;
         case oStatusFD:
           set_status_fd (translate_sys2libc_fd_int (pargs.r.ret_int, 1));
@@ -263,6 +451,23 @@ main( int argc, char **argv )
   if (opt.verbose > 1)
     set_packet_list_mode(1);
 
+  /* If a keyring image is up to date we use only that one; it
+   * replaces the actual keyrings.  */
+  if (keyring_image)
+    {
+      image = resource_filename (keyring_image);
+      if (keyring_image_fresh_p (image, nrings))
+        {
+          if (opt.verbose)
+            log_info ("using keyring image '%s'\n", image);
+          FREE_STRLIST (nrings);
+          if (keydb_add_resource (image, KEYDB_RESOURCE_FLAG_READONLY))
+            g10_exit (2);
+          goto keydb_ready;
+        }
+      rebuild_image = 1;
+    }
+
   /* Note: We open all keyrings in read-only mode.  */
   if (!nrings)  /* No keyring given: use default one. */
     keydb_add_resource ("trustedkeys" EXTSEP_S "kbx",
@@ -273,8 +478,15 @@ main( int argc, char **argv )
 
   FREE_STRLIST (nrings);
 
+ keydb_ready:
   ctrl = xcalloc (1, sizeof *ctrl);
 
+  /* A failure to write the image is not fatal; we then simply use the
+   * keyrings directly.  */
+  if (rebuild_image)
+    write_keyring_image (ctrl, image);
+  xfree (image);
+
   if ((rc = verify_signatures (ctrl, argc, argv)))
     log_error("verify signatures failed: %s\n", gpg_strerror (rc) );
 
@@ -498,6 +710,66 @@ keyserver_import_ldap (const char *name)
   return -1;
 }
 
+gpg_error_t
+gpg_dirmngr_get_akl_result (ctrl_t ctrl, const char *mechanism,
+                            const char *mbox,
+                            char **r_fpr, gpg_error_t *r_result)
+{
+  (void)ctrl;
+  (void)mechanism;
+  (void)mbox;
+  (void)r_fpr;
+  (void)r_result;
+  return gpg_error (GPG_ERR_NOT_FOUND);
+}
+
+gpg_error_t
+gpg_dirmngr_put_akl_result (ctrl_t ctrl, const char *mechanism,
+                            const char *mbox,
+                            const char *fpr, gpg_error_t result)
+{
+  (void)ctrl;
+  (void)mechanism;
+  (void)mbox;
+  (void)fpr;
+  (void)result;
+  return 0;
+}
+
+void
+gpg_dirmngr_prefetch_release (ctrl_t ctrl)
+{
+  (void)ctrl;
+}
+
+gpg_error_t
+keyserver_prefetch_cert (ctrl_t ctrl, const char *name, int dane_mode)
+{
+  (void)ctrl;
+  (void)name;
+  (void)dane_mode;
+  return gpg_error (GPG_ERR_NOT_SUPPORTED);
+}
+
+gpg_error_t
+keyserver_prefetch_wkd (ctrl_t ctrl, const char *name, unsigned int flags)
+{
+  (void)ctrl;
+  (void)name;
+  (void)flags;
+  return gpg_error (GPG_ERR_NOT_SUPPORTED);
+}
+
+gpg_error_t
+keyserver_prefetch_mbox (ctrl_t ctrl, const char *mbox,
+                         struct keyserver_spec *keyserver)
+{
+  (void)ctrl;
+  (void)mbox;
+  (void)keyserver;
+  return gpg_error (GPG_ERR_NOT_SUPPORTED);
+}
+
 
 gpg_error_t
 read_key_from_file_or_buffer (ctrl_t ctrl, const char *fname,
@@ -97,13 +97,40 @@ struct import_filter_s
 struct import_filter_s import_filter;
 
 
+/* The number of keys after which a bulk import commits its
+ * transaction.  */
+#define IMPORT_BULK_COMMIT_INTERVAL 1000
+
+/* The number of keyblocks read ahead with --import-threads.  */
+#define READ_QUEUE_SIZE 64
+
+/* An object to read keyblocks ahead so that their self-signatures
+ * can be verified in parallel.  */
+struct read_queue_s
+{
+  kbnode_t keyblocks[READ_QUEUE_SIZE];
+  int v3keys[READ_QUEUE_SIZE];
+  int nitems;      /* Number of keyblocks in the queue.  */
+  int head;        /* Index of the next keyblock to return.  */
+  int err;         /* The read_block result after the queued items.  */
+  int err_v3keys;  /* And its v3keys value.  */
+};
+
+
 static int import (ctrl_t ctrl,
                    IOBUF inp, const char* fname, struct import_stats_s *stats,
 		   unsigned char **fpr, size_t *fpr_len, unsigned int options,
 		   import_screener_t screener, void *screener_arg,
                    int origin, const char *url);
-static int read_block (IOBUF a, unsigned int options,
+static int read_block (ctrl_t ctrl, IOBUF a, unsigned int options,
                        PACKET **pending_pkt, kbnode_t *ret_root, int *r_v3keys);
+static int read_block_queued (ctrl_t ctrl, struct read_queue_s *queue,
+                              IOBUF a, unsigned int options,
+                              PACKET **pending_pkt, kbnode_t *ret_root,
+                              int *r_v3keys);
+static void release_read_queue (struct read_queue_s *queue);
+static int drop_sig_filter_match (ctrl_t ctrl, PACKET *pkt,
+                                  u32 *main_keyid, recsel_expr_t selector);
 static void revocation_present (ctrl_t ctrl, kbnode_t keyblock);
 static gpg_error_t import_one (ctrl_t ctrl,
                        kbnode_t keyblock,
@@ -401,7 +428,7 @@ read_key_from_file_or_buffer (ctrl_t ctrl, const char *fname,
     }
 
   /* Read the first non-v3 keyblock.  */
-  while (!(err = read_block (inp, 0, &pending_pkt, &keyblock, &v3keys)))
+  while (!(err = read_block (ctrl, inp, 0, &pending_pkt, &keyblock, &v3keys)))
     {
       if (keyblock->pkt->pkttype == PKT_PUBLIC_KEY)
         break;
@@ -651,11 +678,15 @@ import (ctrl_t ctrl, IOBUF inp, const char* fname,struct import_stats_s *stats,
                                 grasp the return semantics of
                                 read_block. */
   kbnode_t secattic = NULL;  /* Kludge for PGP desktop percularity */
+  struct read_queue_s *queue = NULL;
   int rc = 0;
   int v3keys;
 
   getkey_disable_caches ();
 
+  if (opt.import_threads > 1)
+    queue = xtrycalloc (1, sizeof *queue);
+
   if (!opt.no_armor) /* Armored reading is not disabled.  */
     {
       armor_filter_context_t *afx;
@@ -666,7 +697,8 @@ import (ctrl_t ctrl, IOBUF inp, const char* fname,struct import_stats_s *stats,
       release_armor_context (afx);
     }
 
-  while (!(rc = read_block (inp, options, &pending_pkt, &keyblock, &v3keys)))
+  while (!(rc = read_block_queued (ctrl, queue, inp, options,
+                                   &pending_pkt, &keyblock, &v3keys)))
     {
       stats->v3keys += v3keys;
       if (keyblock->pkt->pkttype == PKT_PUBLIC_KEY)
@@ -746,6 +778,11 @@ import (ctrl_t ctrl, IOBUF inp, const char* fname,struct import_stats_s *stats,
       if (!(++stats->count % 100) && !opt.quiet)
         log_info (_("%lu keys processed so far\n"), stats->count );
 
+      if ((options & IMPORT_BULK)
+          && !(stats->count % IMPORT_BULK_COMMIT_INTERVAL)
+          && (rc = keydb_bulk_checkpoint (ctrl)))
+        break;
+
       if (origin == KEYORG_WKD && stats->count >= 5)
         {
           /* We limit the number of keys _received_ from the WKD to 5.
@@ -765,6 +802,7 @@ import (ctrl_t ctrl, IOBUF inp, const char* fname,struct import_stats_s *stats,
     log_error (_("error reading '%s': %s\n"), fname, gpg_strerror (rc));
 
   release_kbnode (secattic);
+  release_read_queue (queue);
 
   /* When read_block loop was stopped by error, we have PENDING_PKT left.  */
   if (pending_pkt)
@@ -805,7 +843,7 @@ import_old_secring (ctrl_t ctrl, const char *fname)
 
   getkey_disable_caches();
   stats = import_new_stats_handle ();
-  while (!(err = read_block (inp, 0, &pending_pkt, &keyblock, &v3keys)))
+  while (!(err = read_block (ctrl, inp, 0, &pending_pkt, &keyblock, &v3keys)))
     {
       if (keyblock->pkt->pkttype == PKT_SECRET_KEY)
         {
@@ -921,6 +959,68 @@ valid_keyblock_packet (int pkttype)
 }
 
 
+/* A wrapper around read_block which reads up to READ_QUEUE_SIZE
+ * keyblocks ahead into QUEUE and verifies their self-signatures using
+ * --import-threads threads.  The keyblocks are then returned one by
+ * one in the same order as read_block would do.  If QUEUE is NULL
+ * read_block is called directly.  */
+static int
+read_block_queued (ctrl_t ctrl, struct read_queue_s *queue,
+                   IOBUF a, unsigned int options,
+                   PACKET **pending_pkt, kbnode_t *ret_root, int *r_v3keys)
+{
+  int rc;
+
+  if (!queue)
+    return read_block (ctrl, a, options, pending_pkt, ret_root, r_v3keys);
+
+  if (queue->head == queue->nitems)
+    {
+      queue->head = queue->nitems = 0;
+      while (!queue->err && queue->nitems < READ_QUEUE_SIZE)
+        {
+          rc = read_block (ctrl, a, options, pending_pkt,
+                           queue->keyblocks + queue->nitems,
+                           queue->v3keys + queue->nitems);
+          if (rc)
+            {
+              queue->err = rc;
+              queue->err_v3keys = queue->v3keys[queue->nitems];
+            }
+          else
+            queue->nitems++;
+        }
+      if (queue->nitems)
+        sig_check_prefetch (ctrl, queue->keyblocks, queue->nitems,
+                            NULL, 0, opt.import_threads);
+    }
+
+  if (queue->head == queue->nitems)
+    {
+      *r_v3keys = queue->err_v3keys;
+      return queue->err;
+    }
+
+  *ret_root = queue->keyblocks[queue->head];
+  *r_v3keys = queue->v3keys[queue->head];
+  queue->keyblocks[queue->head++] = NULL;
+  return 0;
+}
+
+
+/* Release QUEUE and the keyblocks not yet returned.  */
+static void
+release_read_queue (struct read_queue_s *queue)
+{
+  if (!queue)
+    return;
+  for (; queue->head < queue->nitems; queue->head++)
+    release_kbnode (queue->keyblocks[queue->head]);
+  xfree (queue);
+  sig_check_prefetch_release ();
+}
+
+
 /* Read the next keyblock from stream A.  Meta data (ring trust
  * packets) are only considered if OPTIONS has the IMPORT_RESTORE flag
  * set.  PENDING_PKT should be initialized to NULL and not changed by
@@ -930,7 +1030,7 @@ valid_keyblock_packet (int pkttype)
  * integer at R_V3KEY counts the number of unsupported v3 keyblocks.
  */
 static int
-read_block( IOBUF a, unsigned int options,
+read_block (ctrl_t ctrl, IOBUF a, unsigned int options,
             PACKET **pending_pkt, kbnode_t *ret_root, int *r_v3keys)
 {
   int rc;
@@ -938,10 +1038,11 @@ read_block( IOBUF a, unsigned int options,
   PACKET *pkt;
   kbnode_t root = NULL;
   kbnode_t lastnode = NULL;
-  int in_cert, in_v3key, skip_sigs;
+  int in_cert, in_v3key, skip_sigs, in_uids;
   u32 keyid[2];
   int got_keyid = 0;
   unsigned int dropped_nonselfsigs = 0;
+  unsigned int dropped_filtersigs = 0;
 
   *r_v3keys = 0;
 
@@ -965,6 +1066,7 @@ read_block( IOBUF a, unsigned int options,
     parsectx.skip_meta = 1;
   in_v3key = 0;
   skip_sigs = 0;
+  in_uids = 0;
   while ((rc=parse_packet (&parsectx, pkt)) != -1)
     {
       if (rc && (gpg_err_code (rc) == GPG_ERR_LEGACY_KEY
@@ -1071,6 +1173,19 @@ read_block( IOBUF a, unsigned int options,
         case PKT_SIGNATURE:
           if (!in_cert)
             goto x_default;
+          if (in_uids > 0 && (options & IMPORT_BULK) && import_filter.drop_sig
+              && root && root->pkt->pkttype == PKT_PUBLIC_KEY
+              && drop_sig_filter_match (ctrl, pkt, keyid,
+                                        import_filter.drop_sig))
+            {
+              /* In bulk mode we apply the drop-sig filter right
+               * away so that flooded keys don't need to be kept in
+               * memory.  */
+              dropped_filtersigs++;
+              free_packet (pkt, &parsectx);
+              init_packet(pkt);
+              break;
+            }
           if (!(options & IMPORT_SELF_SIGS_ONLY))
             goto x_default;
           log_assert (got_keyid);
@@ -1110,6 +1225,17 @@ read_block( IOBUF a, unsigned int options,
           in_cert = 1;
           goto x_default;
 
+        case PKT_USER_ID:
+        case PKT_ATTRIBUTE:
+          if (!in_uids)
+            in_uids = 1;
+          goto x_default;
+
+        case PKT_PUBLIC_SUBKEY:
+        case PKT_SECRET_SUBKEY:
+          in_uids = -1;  /* Same as apply_drop_sig_filter.  */
+          goto x_default;
+
         default:
         x_default:
           if (in_cert && valid_keyblock_packet (pkt->pkttype))
@@ -1144,6 +1270,9 @@ read_block( IOBUF a, unsigned int options,
   if (!rc && dropped_nonselfsigs && opt.verbose)
     log_info ("key %s: number of dropped non-self-signatures: %u\n",
               keystr (keyid), dropped_nonselfsigs);
+  if (!rc && dropped_filtersigs && opt.verbose)
+    log_info ("key %s: number of signatures dropped by filter: %u\n",
+              keystr (keyid), dropped_filtersigs);
 
   return rc;
 }
@@ -1662,6 +1791,35 @@ apply_keep_uid_filter (ctrl_t ctrl, kbnode_t keyblock, recsel_expr_t selector)
 }
 
 
+/* Return true if the signature packet PKT of the key with MAIN_KEYID
+ * shall be dropped according to the drop-sig filter SELECTOR.  Only
+ * user id signatures which are not self-signatures are considered.  */
+static int
+drop_sig_filter_match (ctrl_t ctrl, PACKET *pkt, u32 *main_keyid,
+                       recsel_expr_t selector)
+{
+  struct kbnode_struct node;
+  struct impex_filter_parm_s parm;
+  PKT_signature *sig;
+
+  if (pkt->pkttype != PKT_SIGNATURE)
+    return 0;
+
+  sig = pkt->pkt.signature;
+  if (main_keyid[0] == sig->keyid[0] || main_keyid[1] == sig->keyid[1])
+    return 0;  /* Skip self-signatures.  */
+
+  if (!IS_UID_SIG(sig) && !IS_UID_REV(sig))
+    return 0;
+
+  memset (&node, 0, sizeof node);
+  node.pkt = pkt;
+  parm.ctrl = ctrl;
+  parm.node = &node;
+  return !!recsel_select (selector, impex_filter_getval, &parm);
+}
+
+
 /*
  * Apply the drop-sig filter to the keyblock.  The deleted nodes are
  * marked and thus the caller should call commit_kbnode afterwards.
@@ -1673,10 +1831,6 @@ apply_drop_sig_filter (ctrl_t ctrl, kbnode_t keyblock, recsel_expr_t selector)
   kbnode_t node;
   int active = 0;
   u32 main_keyid[2];
-  PKT_signature *sig;
-  struct impex_filter_parm_s parm;
-
-  parm.ctrl = ctrl;
 
   keyid_from_pk (keyblock->pkt->pkt.public_key, main_keyid);
 
@@ -1695,16 +1849,8 @@ apply_drop_sig_filter (ctrl_t ctrl, kbnode_t keyblock, recsel_expr_t selector)
       if (node->pkt->pkttype != PKT_SIGNATURE)
         continue;
 
-      sig = node->pkt->pkt.signature;
-      if (main_keyid[0] == sig->keyid[0] || main_keyid[1] == sig->keyid[1])
-        continue;  /* Skip self-signatures.  */
-
-      if (IS_UID_SIG(sig) || IS_UID_REV(sig))
-        {
-          parm.node = node;
-          if (recsel_select (selector, impex_filter_getval, &parm))
-            delete_kbnode (node);
-        }
+      if (drop_sig_filter_match (ctrl, node->pkt, main_keyid, selector))
+        delete_kbnode (node);
     }
 }
 
@@ -1919,6 +2065,94 @@ update_key_origin (kbnode_t keyblock, u32 curtime, int origin, const char *url)
 }
 
 
+/* Write the packets of KEYBLOCK to the temp IOBUF.  Ring trust
+ * packets are skipped because they carry only local information.  */
+static gpg_error_t
+write_plain_image (iobuf_t iobuf, kbnode_t keyblock)
+{
+  gpg_error_t err;
+  kbnode_t node;
+
+  for (node = keyblock; node; node = node->next)
+    {
+      if (node->pkt->pkttype == PKT_RING_TRUST)
+        continue;
+      err = build_packet (iobuf, node->pkt);
+      if (err)
+        return err;
+    }
+  return 0;
+}
+
+
+/* Compute the hash used to detect keyblocks which have been received
+ * unchanged from a keyserver.  The hash covers the packets of
+ * KEYBLOCK as received and the import OPTIONS.  It is stored at
+ * R_HASH which must have room for KEYDB_KSHASH_LEN bytes.  */
+static gpg_error_t
+compute_ks_hash (kbnode_t keyblock, unsigned int options,
+                 unsigned char *r_hash)
+{
+  gpg_error_t err = 0;
+  iobuf_t iobuf;
+  gcry_buffer_t iov[2];
+  unsigned char optbuf[4];
+
+  iobuf = iobuf_temp ();
+  err = write_plain_image (iobuf, keyblock);
+  if (err)
+    goto leave;
+
+  optbuf[0] = options >> 24;
+  optbuf[1] = options >> 16;
+  optbuf[2] = options >> 8;
+  optbuf[3] = options;
+  memset (iov, 0, sizeof iov);
+  iov[0].data = optbuf;
+  iov[0].len = sizeof optbuf;
+  iov[1].data = iobuf_get_temp_buffer (iobuf);
+  iov[1].len = iobuf_get_temp_length (iobuf);
+  err = gcry_md_hash_buffers (GCRY_MD_SHA256, 0, r_hash, iov, 2);
+
+ leave:
+  iobuf_close (iobuf);
+  return err;
+}
+
+
+/* Return true if the stored keyblock for the key with fingerprint
+ * (FPR,FPRLEN) has the same packets as KEYBLOCK.  Such a keyblock
+ * can't add anything and thus there is no need to check its
+ * signatures and to merge it.  */
+static int
+keyblock_is_stored (ctrl_t ctrl, kbnode_t keyblock,
+                    const byte *fpr, size_t fprlen)
+{
+  kbnode_t stored;
+  iobuf_t a = NULL;
+  iobuf_t b = NULL;
+  int result = 0;
+
+  if (get_keyblock_byfprint_fast (ctrl, &stored, NULL, fpr, fprlen, 0))
+    return 0;
+
+  a = iobuf_temp ();
+  b = iobuf_temp ();
+  if (write_plain_image (a, keyblock) || write_plain_image (b, stored))
+    goto leave;
+
+  result = (iobuf_get_temp_length (a) == iobuf_get_temp_length (b)
+            && !memcmp (iobuf_get_temp_buffer (a), iobuf_get_temp_buffer (b),
+                        iobuf_get_temp_length (a)));
+
+ leave:
+  iobuf_close (a);
+  iobuf_close (b);
+  release_kbnode (stored);
+  return result;
+}
+
+
 /*
  * Try to import one keyblock. Return an error only in serious cases,
  * but never for an invalid keyblock.  It uses log_error to increase
@@ -1956,6 +2190,8 @@ import_one_real (ctrl_t ctrl,
   int merge_keys_done = 0;
   int any_filter = 0;
   KEYDB_HANDLE hd = NULL;
+  unsigned char kshash[KEYDB_KSHASH_LEN];
+  int have_kshash = 0;
 
   if (r_valid)
     *r_valid = 0;
@@ -2006,6 +2242,54 @@ import_one_real (ctrl_t ctrl,
       return 0;
     }
 
+  /* A keyblock which we received from a keyserver exactly as the
+   * last time needs not to be merged again.  The keyboxd stores the
+   * hash of the last received keyblock for each key.  */
+  if (origin == KEYORG_KS && !from_sk && !opt.dry_run
+      && !(options & (IMPORT_SHOW | IMPORT_DRY_RUN))
+      && !compute_ks_hash (keyblock, options, kshash))
+    {
+      unsigned char oldhash[KEYDB_KSHASH_LEN];
+
+      have_kshash = 1;
+      if (!keydb_kshash_get (ctrl, fpr2, fpr2len, oldhash)
+          && !memcmp (oldhash, kshash, KEYDB_KSHASH_LEN))
+        {
+          have_kshash = 0;  /* No need to store it again.  */
+          same_key = 1;
+        }
+    }
+
+  /* Re-imports of the very same keyblock are common (e.g. a keyring
+   * distributed by a configuration management system).  Detect this
+   * before the signatures are checked.  Options which may change the
+   * stored keyblock disable this shortcut.  */
+  if (!same_key && !from_sk && !opt.interactive && !opt.dry_run
+      && !(options & (IMPORT_SHOW | IMPORT_DRY_RUN | IMPORT_EXPORT
+                      | IMPORT_RESTORE | IMPORT_CLEAN | IMPORT_REPAIR_KEYS
+                      | IMPORT_REPAIR_PKS_SUBKEY_BUG
+                      | IMPORT_COLLAPSE_UIDS | IMPORT_COLLAPSE_SUBKEYS))
+      && keyblock_is_stored (ctrl, keyblock, fpr2, fpr2len))
+    same_key = 1;
+
+  if (same_key)
+    {
+      if (r_valid)
+        *r_valid = 1;
+      if (is_status_enabled ())
+        print_import_ok (pk, 0);
+
+      if (!opt.quiet && !silent)
+        {
+          char *p = get_user_id_byfpr_native (ctrl, fpr2, fpr2len);
+          log_info( _("key %s: \"%s\" not changed\n"),keystr(keyid),p);
+          xfree(p);
+        }
+
+      stats->unchanged++;
+      goto leave;
+    }
+
   if (opt.interactive && !silent)
     {
       if (is_status_enabled())
@@ -2405,6 +2689,8 @@ import_one_real (ctrl_t ctrl,
 
  leave:
   keydb_release (hd);
+  if (have_kshash && !err && (mod_key || new_key || same_key))
+    keydb_kshash_put (ctrl, fpr2, fpr2len, kshash);
   if (mod_key || new_key || same_key)
     {
       /* A little explanation for this: we fill in the fingerprint
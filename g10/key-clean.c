@@ -70,6 +70,8 @@ mark_usable_uid_certs (ctrl_t ctrl, kbnode_t keyblock, kbnode_t uidnode,
         break; /* ready */
       if (node->pkt->pkttype != PKT_SIGNATURE)
         continue;
+      if (is_deleted_kbnode (node))
+        continue; /* Removed by prune_uid_sigs.  */
       sig = node->pkt->pkt.signature;
       if (main_kid
 	  && sig->keyid[0] == main_kid[0] && sig->keyid[1] == main_kid[1])
@@ -215,6 +217,103 @@ mark_usable_uid_certs (ctrl_t ctrl, kbnode_t keyblock, kbnode_t uidnode,
 }
 
 
+/* qsort helper to sort signature nodes by descending timestamp.  */
+static int
+cmp_sig_nodes_newest_first (const void *a_arg, const void *b_arg)
+{
+  const kbnode_t a = *(const kbnode_t *)a_arg;
+  const kbnode_t b = *(const kbnode_t *)b_arg;
+  u32 ta = a->pkt->pkt.signature->timestamp;
+  u32 tb = b->pkt->pkt.signature->timestamp;
+
+  return ta > tb? -1 : ta < tb? 1 : 0;
+}
+
+
+/* Remove third-party signatures from UIDNODE which clean_sigs_from_uid
+ * would remove anyway, but without verifying them: With SELF_ONLY all
+ * of them, otherwise those from keys not in the database.  Then if
+ * more than opt.max_uid_sigs remain, only that many of the newest
+ * are kept.  KEYID is the key id of the primary key.  This makes
+ * cleaning of keys flooded with signatures cheap because only the
+ * survivors need to be verified.  Returns the number of removed
+ * signatures.  */
+static int
+prune_uid_sigs (ctrl_t ctrl, kbnode_t uidnode, u32 *keyid,
+                int noisy, int self_only)
+{
+  int deleted = 0;
+  kbnode_t node;
+  kbnode_t *list = NULL;
+  int nlist = 0;
+  int i;
+  PKT_signature *sig;
+  const char *reason;
+
+  for (node=uidnode->next;
+       node && node->pkt->pkttype == PKT_SIGNATURE;
+       node=node->next)
+    {
+      if (is_deleted_kbnode (node))
+        continue;
+      sig = node->pkt->pkt.signature;
+      if (sig->keyid[0] == keyid[0] && sig->keyid[1] == keyid[1])
+        continue;  /* Self-signature.  */
+
+      if (self_only)
+        reason = "not a self-signature";
+      else if (!have_pubkey_with_kid (ctrl, sig->keyid))
+        reason = "key unavailable";
+      else
+        {
+          nlist++;
+          continue;
+        }
+
+      if (noisy)
+        log_info ("removing signature from key %s on user ID \"%s\": %s\n",
+                  keystr (sig->keyid), uidnode->pkt->pkt.user_id->name,
+                  reason);
+      delete_kbnode (node);
+      deleted++;
+    }
+
+  if (!opt.max_uid_sigs || nlist <= opt.max_uid_sigs)
+    return deleted;
+
+  list = xtrycalloc (nlist, sizeof *list);
+  if (!list)
+    return deleted;  /* Out of core - skip the limit.  */
+  for (i=0, node=uidnode->next;
+       node && node->pkt->pkttype == PKT_SIGNATURE && i < nlist;
+       node=node->next)
+    {
+      if (is_deleted_kbnode (node))
+        continue;
+      sig = node->pkt->pkt.signature;
+      if (sig->keyid[0] == keyid[0] && sig->keyid[1] == keyid[1])
+        continue;
+      list[i++] = node;
+    }
+  nlist = i;
+
+  qsort (list, nlist, sizeof *list, cmp_sig_nodes_newest_first);
+  for (i=opt.max_uid_sigs; i < nlist; i++)
+    {
+      if (noisy)
+        log_info ("removing signature from key %s on user ID \"%s\": %s\n",
+                  keystr (list[i]->pkt->pkt.signature->keyid),
+                  uidnode->pkt->pkt.user_id->name,
+                  "too many signatures");
+      delete_kbnode (list[i]);
+      deleted++;
+    }
+
+  xfree (list);
+  return deleted;
+}
+
+
 static int
 clean_sigs_from_uid (ctrl_t ctrl, kbnode_t keyblock, kbnode_t uidnode,
                      int noisy, int self_only)
@@ -228,6 +327,10 @@ clean_sigs_from_uid (ctrl_t ctrl, kbnode_t keyblock, kbnode_t uidnode,
 
   keyid_from_pk (keyblock->pkt->pkt.public_key, keyid);
 
+  /* Cheap first pass so that only the remaining signatures need to be
+     verified.  */
+  deleted += prune_uid_sigs (ctrl, uidnode, keyid, noisy, self_only);
+
   /* Passing in a 0 for current time here means that we'll never weed
      out an expired sig.  This is correct behavior since we want to
      keep the most recent expired sig in a series. */
@@ -256,6 +359,9 @@ clean_sigs_from_uid (ctrl_t ctrl, kbnode_t keyblock, kbnode_t uidnode,
     {
       int keep;
 
+      if (is_deleted_kbnode (node))
+        continue; /* Already removed by prune_uid_sigs.  */
+
       keep = self_only? (node->pkt->pkt.signature->keyid[0] == keyid[0]
                          && node->pkt->pkt.signature->keyid[1] == keyid[1]) : 1;
 
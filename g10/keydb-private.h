@@ -86,6 +86,10 @@ struct keydb_handle_s
   /* Flag set if this handles pertains to call-keyboxd.c.  */
   int use_keyboxd;
 
+  /* A temp iobuf reused by build_keyblock_image to serialize the
+   * keyblocks for inserts and updates.  NULL if not yet used.  */
+  iobuf_t kbimage;
+
   /* BEGIN USE_KEYBOXD */
   /* (These fields are only valid if USE_KEYBOXD is set.) */
 
@@ -161,7 +165,8 @@ struct keydb_handle_s
 
 
 gpg_error_t keydb_parse_keyblock (iobuf_t iobuf, int pk_no, int uid_no,
-                                  kbnode_t *r_keyblock);
+                                  kbnode_t *r_keyblock,
+                                  void **r_image, size_t *r_imagelen);
 
 /* These are the functions call-keyboxd diverts to if the keyboxd is
  * not used.  */
@@ -170,7 +175,8 @@ gpg_error_t internal_keydb_init (KEYDB_HANDLE hd);
 void internal_keydb_deinit (KEYDB_HANDLE hd);
 gpg_error_t internal_keydb_lock (KEYDB_HANDLE hd);
 
-gpg_error_t internal_keydb_get_keyblock (KEYDB_HANDLE hd, KBNODE *ret_kb);
+gpg_error_t internal_keydb_get_keyblock (KEYDB_HANDLE hd, KBNODE *ret_kb,
+                                         void **r_image, size_t *r_imagelen);
 gpg_error_t internal_keydb_update_keyblock (ctrl_t ctrl,
                                             KEYDB_HANDLE hd, kbnode_t kb);
 gpg_error_t internal_keydb_insert_keyblock (KEYDB_HANDLE hd, kbnode_t kb);
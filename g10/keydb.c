@@ -69,6 +69,11 @@ static int any_registered;
    whole cache whenever a key is inserted or updated.  */
 
 #define KID_NOT_FOUND_CACHE_BUCKETS 256
+
+/* Keyblock images larger than this are not kept in the keyblock
+ * cache.  Such keyblocks usually carry photo IDs and holding their
+ * image in addition to the parsed keyblock doubles the memory.  */
+#define KEYBLOCK_CACHE_MAX_IMAGE (256*1024)
 static struct kid_not_found_cache_bucket *
   kid_not_found_cache[KID_NOT_FOUND_CACHE_BUCKETS];
 
@@ -825,6 +830,7 @@ keydb_dump_stats (void)
             keydb_stats.notfound,
             keydb_stats.found_cached,
             keydb_stats.notfound_cached);
+  keydb_bloom_dump_stats ();
   log_info ("kid_not_found_cache: count=%u peak=%u flushes=%u\n",
             kid_not_found_stats.count,
             kid_not_found_stats.peak,
@@ -1155,10 +1161,16 @@ keydb_pop_found_state (KEYDB_HANDLE hd)
 
 
 
-/* Parse the keyblock in IOBUF and return at R_KEYBLOCK.  */
+/* Parse the keyblock in IOBUF and return at R_KEYBLOCK.  If R_IMAGE
+ * is not NULL and IOBUF is a temp iobuf, a malloced copy of the
+ * entire image is stored at R_IMAGE and its length at R_IMAGELEN.
+ * This is only done if no packet of the image was skipped, so that
+ * the image has exactly the packets of the returned keyblock;
+ * otherwise NULL is stored at R_IMAGE.  */
 gpg_error_t
 keydb_parse_keyblock (iobuf_t iobuf, int pk_no, int uid_no,
-                      kbnode_t *r_keyblock)
+                      kbnode_t *r_keyblock,
+                      void **r_image, size_t *r_imagelen)
 {
   gpg_error_t err;
   struct parse_packet_ctx_s parsectx;
@@ -1167,8 +1179,14 @@ keydb_parse_keyblock (iobuf_t iobuf, int pk_no, int uid_no,
   kbnode_t node, *tail;
   int in_cert, save_mode;
   int pk_count, uid_count;
+  int skipped = 0;
 
   *r_keyblock = NULL;
+  if (r_image)
+    {
+      *r_image = NULL;
+      *r_imagelen = 0;
+    }
 
   pkt = xtrymalloc (sizeof *pkt);
   if (!pkt)
@@ -1183,6 +1201,7 @@ keydb_parse_keyblock (iobuf_t iobuf, int pk_no, int uid_no,
     {
       if (gpg_err_code (err) == GPG_ERR_UNKNOWN_PACKET)
         {
+          skipped++;
           free_packet (pkt, &parsectx);
           init_packet (pkt);
           continue;
@@ -1194,6 +1213,7 @@ keydb_parse_keyblock (iobuf_t iobuf, int pk_no, int uid_no,
                      gpg_strerror (err));
           if (gpg_err_code (err) == GPG_ERR_INV_PACKET)
             {
+              skipped++;
               free_packet (pkt, &parsectx);
               init_packet (pkt);
               continue;
@@ -1217,6 +1237,7 @@ keydb_parse_keyblock (iobuf_t iobuf, int pk_no, int uid_no,
 
         default:
           log_info ("skipped packet of type %d in keybox\n", (int)pkt->pkttype);
+          skipped++;
           free_packet(pkt, &parsectx);
           init_packet(pkt);
           continue;
@@ -1279,6 +1300,18 @@ keydb_parse_keyblock (iobuf_t iobuf, int pk_no, int uid_no,
   if (err == -1 && keyblock)
     err = 0; /* Got the entire keyblock.  */
 
+  if (!err && r_image && !skipped && iobuf->use == IOBUF_INPUT_TEMP)
+    {
+      *r_image = xtrymalloc (iobuf_get_temp_length (iobuf));
+      if (!*r_image)
+        err = gpg_error_from_syserror ();
+      else
+        {
+          *r_imagelen = iobuf_get_temp_length (iobuf);
+          memcpy (*r_image, iobuf_get_temp_buffer (iobuf), *r_imagelen);
+        }
+    }
+
   if (err)
     release_kbnode (keyblock);
   else
@@ -1302,14 +1335,20 @@ keydb_parse_keyblock (iobuf_t iobuf, int pk_no, int uid_no,
  *
  * The returned keyblock has the kbnode flag bit 0 set for the node
  * with the public key used to locate the keyblock or flag bit 1 set
- * for the user ID node.  */
+ * for the user ID node.  If R_IMAGE is not NULL the stored image of
+ * the keyblock is also returned if available (see
+ * keydb_parse_keyblock).  */
 gpg_error_t
-internal_keydb_get_keyblock (KEYDB_HANDLE hd, KBNODE *ret_kb)
+internal_keydb_get_keyblock (KEYDB_HANDLE hd, KBNODE *ret_kb,
+                             void **r_image, size_t *r_imagelen)
 {
   gpg_error_t err = 0;
 
   log_assert (!hd->use_keyboxd);
 
+  if (r_image)
+    *r_image = NULL;
+
   if (hd->keyblock_cache.state == KEYBLOCK_CACHE_FILLED)
     {
       err = iobuf_seek (hd->keyblock_cache.iobuf, 0);
@@ -1323,7 +1362,7 @@ internal_keydb_get_keyblock (KEYDB_HANDLE hd, KBNODE *ret_kb)
 	  err = keydb_parse_keyblock (hd->keyblock_cache.iobuf,
 				      hd->keyblock_cache.pk_no,
 				      hd->keyblock_cache.uid_no,
-				      ret_kb);
+				      ret_kb, r_image, r_imagelen);
 	  if (err)
 	    keyblock_cache_clear (hd);
 	  if (DBG_CLOCK)
@@ -1352,8 +1391,10 @@ internal_keydb_get_keyblock (KEYDB_HANDLE hd, KBNODE *ret_kb)
                                    &iobuf, &pk_no, &uid_no);
         if (!err)
           {
-            err = keydb_parse_keyblock (iobuf, pk_no, uid_no, ret_kb);
-            if (!err && hd->keyblock_cache.state == KEYBLOCK_CACHE_PREPARED)
+            err = keydb_parse_keyblock (iobuf, pk_no, uid_no, ret_kb,
+                                        r_image, r_imagelen);
+            if (!err && hd->keyblock_cache.state == KEYBLOCK_CACHE_PREPARED
+                && iobuf_get_temp_length (iobuf) <= KEYBLOCK_CACHE_MAX_IMAGE)
               {
                 hd->keyblock_cache.state     = KEYBLOCK_CACHE_FILLED;
                 hd->keyblock_cache.iobuf     = iobuf;
@@ -1446,16 +1487,13 @@ internal_keydb_update_keyblock (ctrl_t ctrl, KEYDB_HANDLE hd, kbnode_t kb)
       break;
     case KEYDB_RESOURCE_TYPE_KEYBOX:
       {
-        iobuf_t iobuf;
-
-        err = build_keyblock_image (kb, &iobuf);
+        err = build_keyblock_image (kb, &hd->kbimage);
         if (!err)
           {
             keydb_stats.build_keyblocks++;
             err = keybox_update_keyblock (hd->active[hd->found].u.kb,
-                                          iobuf_get_temp_buffer (iobuf),
-                                          iobuf_get_temp_length (iobuf));
-            iobuf_close (iobuf);
+                                          iobuf_get_temp_buffer (hd->kbimage),
+                                          iobuf_get_temp_length (hd->kbimage));
           }
       }
       break;
@@ -1517,16 +1555,13 @@ internal_keydb_insert_keyblock (KEYDB_HANDLE hd, kbnode_t kb)
            keyblock first.  This is required by the OpenPGP key parser
            included in the keybox code.  Eventually we can change this
            kludge to have the caller pass the image.  */
-        iobuf_t iobuf;
-
-        err = build_keyblock_image (kb, &iobuf);
+        err = build_keyblock_image (kb, &hd->kbimage);
         if (!err)
           {
             keydb_stats.build_keyblocks++;
             err = keybox_insert_keyblock (hd->active[idx].u.kb,
-                                          iobuf_get_temp_buffer (iobuf),
-                                          iobuf_get_temp_length (iobuf));
-            iobuf_close (iobuf);
+                                          iobuf_get_temp_buffer (hd->kbimage),
+                                          iobuf_get_temp_length (hd->kbimage));
           }
       }
       break;
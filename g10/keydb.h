@@ -187,6 +187,8 @@ gpg_error_t keydb_lock (KEYDB_HANDLE hd);
 
 /* Return the keyblock last found by keydb_search.  */
 gpg_error_t keydb_get_keyblock (KEYDB_HANDLE hd, kbnode_t *ret_kb);
+gpg_error_t keydb_get_keyblock_and_image (KEYDB_HANDLE hd, kbnode_t *ret_kb,
+                                          void **r_image, size_t *r_imagelen);
 
 /* Update the keyblock KB.  */
 gpg_error_t keydb_update_keyblock (ctrl_t ctrl, KEYDB_HANDLE hd, kbnode_t kb);
@@ -204,6 +206,38 @@ gpg_error_t keydb_search_reset (KEYDB_HANDLE hd);
 gpg_error_t keydb_search (KEYDB_HANDLE hd, KEYDB_SEARCH_DESC *desc,
                           size_t ndesc, size_t *descindex);
 
+/* Search separately for each of the search descriptions.  */
+gpg_error_t keydb_search_multi (KEYDB_HANDLE hd, KEYDB_SEARCH_DESC *desc,
+                                size_t ndesc, kbnode_t *r_keyblocks);
+
+/* Print statistics about the Bloom filter of the keyboxd.  */
+void keydb_bloom_dump_stats (void);
+
+/* Commit the current bulk import transaction and start a new one.  */
+gpg_error_t keydb_bulk_checkpoint (ctrl_t ctrl);
+
+/* The length of the keys used for the signature cache.  */
+#define KEYDB_SIGCACHE_KEYLEN 32
+
+/* Look up a result in the keyboxd's signature cache.  */
+gpg_error_t keydb_sigcache_get (ctrl_t ctrl, const unsigned char *key,
+                                int *r_result);
+
+/* Store a result in the keyboxd's signature cache.  */
+gpg_error_t keydb_sigcache_put (ctrl_t ctrl, const unsigned char *key,
+                                int result);
+
+/* The length of the hash over a keyblock received from a keyserver.  */
+#define KEYDB_KSHASH_LEN 32
+
+/* Look up the keyserver hash for the key with fingerprint FPR.  */
+gpg_error_t keydb_kshash_get (ctrl_t ctrl, const byte *fpr, size_t fprlen,
+                              unsigned char *r_hash);
+
+/* Store the keyserver hash for the key with fingerprint FPR.  */
+gpg_error_t keydb_kshash_put (ctrl_t ctrl, const byte *fpr, size_t fprlen,
+                              const unsigned char *hash);
+
 
 
 /*-- keydb.c --*/
@@ -326,6 +360,18 @@ char *gpg_format_keydesc (ctrl_t ctrl,
 /* Cache a copy of a public key in the public key cache.  */
 void cache_public_key( PKT_public_key *pk );
 
+/* Drop all entries from the public key cache.  */
+void getkey_flush_caches (void);
+
+/* Forget about key ids which were not found.  */
+void getkey_flush_nokey_cache (void);
+
+/* Forget about the keys selected for mail addresses.  */
+void getkey_flush_best_key_cache (void);
+
+/* Print statistics about the public key cache.  */
+void getkey_dump_stats (void);
+
 /* Disable and drop the public key cache.  */
 void getkey_disable_caches(void);
 
@@ -337,6 +383,10 @@ gpg_error_t get_pubkey_for_sig (ctrl_t ctrl,
 /* Return the public key with the key id KEYID and store it at PK.  */
 int get_pubkey (ctrl_t ctrl, PKT_public_key *pk, u32 *keyid);
 
+/* Fetch several public keys into the cache.  */
+void prefetch_pubkeys (ctrl_t ctrl, u32 (*keyids)[2], int nkeyids,
+                       unsigned int req_usage);
+
 /* Same as get_pubkey but with auto LDAP fetch.  */
 gpg_error_t get_pubkey_with_ldap_fallback (ctrl_t ctrl,
                                            PKT_public_key *pk, u32 * keyid);
@@ -427,6 +477,9 @@ gpg_error_t get_keyblock_byfprint_fast (ctrl_t ctrl,
    key id KEYID.  */
 int have_secret_key_with_kid (ctrl_t ctrl, u32 *keyid);
 
+/* Returns true if a public key with key id KEYID is available.  */
+int have_pubkey_with_kid (ctrl_t ctrl, u32 *keyid);
+
 /* Parse the --default-key parameter.  Returns the last key (in terms
    of when the option is given) that is available.  */
 const char *parse_def_secret_key (ctrl_t ctrl);
@@ -550,6 +603,7 @@ u32 keyid_from_fingerprint (ctrl_t ctrl, const byte *fprint, size_t fprint_len,
                             u32 *keyid);
 byte *namehash_from_uid(PKT_user_id *uid);
 unsigned nbits_from_pk( PKT_public_key *pk );
+int pk_is_compliant (PKT_public_key *pk, enum gnupg_compliance_mode compliance);
 
 /* Convert an UTC TIMESTAMP into an UTC yyyy-mm-dd string.  Return
  * that string.  The caller should pass a buffer with at least a size
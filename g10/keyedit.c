@@ -2799,39 +2799,17 @@ find_by_primary_fpr (ctrl_t ctrl, const char *fpr,
 }
 
 
-/* Unattended key signing function.  If the key specifified by FPR is
-   available and FPR is the primary fingerprint all user ids of the
-   key are signed using the default signing key.  If UIDS is an empty
-   list all usable UIDs are signed, if it is not empty, only those
-   user ids matching one of the entries of the list are signed.  With
-   LOCAL being true the signatures are marked as non-exportable.  */
-void
-keyedit_quick_sign (ctrl_t ctrl, const char *fpr, strlist_t uids,
-                    strlist_t locusr, int local)
+/* The core of keyedit_quick_sign which works on KEYBLOCK.  On a
+ * change R_MODIFIED is set to true.  */
+static gpg_error_t
+quick_sign_core (ctrl_t ctrl, kbnode_t keyblock, strlist_t uids,
+                 strlist_t locusr, int local, int *r_modified)
 {
-  gpg_error_t err;
-  kbnode_t keyblock = NULL;
-  KEYDB_HANDLE kdbhd = NULL;
-  int modified = 0;
   PKT_public_key *pk;
   kbnode_t node;
   strlist_t sl;
   int any;
 
-#ifdef HAVE_W32_SYSTEM
-  /* See keyedit_menu for why we need this.  */
-  check_trustdb_stale (ctrl);
-#endif
-
-  /* We require a fingerprint because only this uniquely identifies a
-     key and may thus be used to select a key for unattended key
-     signing.  */
-  if (find_by_primary_fpr (ctrl, fpr, &keyblock, &kdbhd))
-    goto leave;
-
-  if (fix_keyblock (ctrl, &keyblock))
-    modified++;
-
   /* Give some info in verbose.  */
   if (opt.verbose)
     {
@@ -2847,7 +2825,7 @@ keyedit_quick_sign (ctrl_t ctrl, const char *fpr, strlist_t uids,
       if (!opt.verbose)
         show_key_with_all_names (ctrl, es_stdout, keyblock, 0, 0, 0, 0, 0, 1);
       log_error ("%s%s", _("Key is revoked."), _("  Unable to sign.\n"));
-      goto leave;
+      return gpg_error (GPG_ERR_CERT_REVOKED);
     }
 
   /* Set the flags according to the UIDS list.  Fixme: We may want to
@@ -2924,11 +2902,46 @@ keyedit_quick_sign (ctrl_t ctrl, const char *fpr, strlist_t uids,
                       sl->d, gpg_strerror (GPG_ERR_NOT_FOUND));
         }
       log_error ("%s  %s", _("No matching user IDs."), _("Nothing to sign.\n"));
-      goto leave;
+      return gpg_error (GPG_ERR_NO_USER_ID);
     }
 
   /* Sign. */
-  sign_uids (ctrl, es_stdout, keyblock, locusr, &modified, local, 0, 0, 0, 1);
+  sign_uids (ctrl, es_stdout, keyblock, locusr, r_modified, local, 0, 0, 0, 1);
+  return 0;
+}
+
+
+/* Unattended key signing function.  If the key specifified by FPR is
+   available and FPR is the primary fingerprint all user ids of the
+   key are signed using the default signing key.  If UIDS is an empty
+   list all usable UIDs are signed, if it is not empty, only those
+   user ids matching one of the entries of the list are signed.  With
+   LOCAL being true the signatures are marked as non-exportable.  */
+void
+keyedit_quick_sign (ctrl_t ctrl, const char *fpr, strlist_t uids,
+                    strlist_t locusr, int local)
+{
+  gpg_error_t err;
+  kbnode_t keyblock = NULL;
+  KEYDB_HANDLE kdbhd = NULL;
+  int modified = 0;
+
+#ifdef HAVE_W32_SYSTEM
+  /* See keyedit_menu for why we need this.  */
+  check_trustdb_stale (ctrl);
+#endif
+
+  /* We require a fingerprint because only this uniquely identifies a
+     key and may thus be used to select a key for unattended key
+     signing.  */
+  if (find_by_primary_fpr (ctrl, fpr, &keyblock, &kdbhd))
+    goto leave;
+
+  if (fix_keyblock (ctrl, &keyblock))
+    modified++;
+
+  if (quick_sign_core (ctrl, keyblock, uids, locusr, local, &modified))
+    goto leave;
   es_fflush (es_stdout);
 
   if (modified)
@@ -3311,40 +3324,19 @@ keyedit_quick_addadsk (ctrl_t ctrl, const char *fpr, const char *adskfpr)
 }
 
 
-/* Unattended expiration setting function for the main key.  If
- * SUBKEYFPRS is not NULL and SUBKEYSFPRS[0] is neither NULL, it is
- * expected to be an array of fingerprints for subkeys to change. It
- * may also be an array which just one item "*" to indicate that all
- * keys shall be set to that expiration date.
- */
-void
-keyedit_quick_set_expire (ctrl_t ctrl, const char *fpr, const char *expirestr,
-                          char **subkeyfprs)
+/* The core of keyedit_quick_set_expire which works on KEYBLOCK.  On
+ * a change R_MODIFIED is set to true.  */
+static gpg_error_t
+quick_set_expire_core (ctrl_t ctrl, kbnode_t keyblock, const char *expirestr,
+                       char **subkeyfprs, int *r_modified)
 {
   gpg_error_t err;
-  kbnode_t keyblock, node;
-  KEYDB_HANDLE kdbhd;
-  int modified = 0;
+  kbnode_t node;
   PKT_public_key *pk;
   u32 expire;
   int primary_only = 0;
   int idx;
 
-#ifdef HAVE_W32_SYSTEM
-  /* See keyedit_menu for why we need this.  */
-  check_trustdb_stale (ctrl);
-#endif
-
-  /* We require a fingerprint because only this uniquely identifies a
-   * key and may thus be used to select a key for unattended
-   * expiration setting.  */
-  err = find_by_primary_fpr (ctrl, fpr, &keyblock, &kdbhd);
-  if (err)
-    goto leave;
-
-  if (fix_keyblock (ctrl, &keyblock))
-    modified++;
-
   pk = keyblock->pkt->pkt.public_key;
   if (pk->flags.revoked)
     {
@@ -3437,8 +3429,49 @@ keyedit_quick_set_expire (ctrl_t ctrl, const char *fpr, const char *expirestr,
   /* Set the new expiration date.  */
   err = menu_expire (ctrl, keyblock, primary_only? 1 : 2, expire);
   if (gpg_err_code (err) == GPG_ERR_TRUE)
-    modified = 1;
-  else if (err)
+    {
+      *r_modified = 1;
+      err = 0;
+    }
+
+ leave:
+  return err;
+}
+
+
+/* Unattended expiration setting function for the main key.  If
+ * SUBKEYFPRS is not NULL and SUBKEYSFPRS[0] is neither NULL, it is
+ * expected to be an array of fingerprints for subkeys to change. It
+ * may also be an array which just one item "*" to indicate that all
+ * keys shall be set to that expiration date.
+ */
+void
+keyedit_quick_set_expire (ctrl_t ctrl, const char *fpr, const char *expirestr,
+                          char **subkeyfprs)
+{
+  gpg_error_t err;
+  kbnode_t keyblock;
+  KEYDB_HANDLE kdbhd;
+  int modified = 0;
+
+#ifdef HAVE_W32_SYSTEM
+  /* See keyedit_menu for why we need this.  */
+  check_trustdb_stale (ctrl);
+#endif
+
+  /* We require a fingerprint because only this uniquely identifies a
+   * key and may thus be used to select a key for unattended
+   * expiration setting.  */
+  err = find_by_primary_fpr (ctrl, fpr, &keyblock, &kdbhd);
+  if (err)
+    goto leave;
+
+  if (fix_keyblock (ctrl, &keyblock))
+    modified++;
+
+  err = quick_set_expire_core (ctrl, keyblock, expirestr, subkeyfprs,
+                               &modified);
+  if (err)
     goto leave;
   es_fflush (es_stdout);
 
@@ -3465,6 +3498,234 @@ keyedit_quick_set_expire (ctrl_t ctrl, const char *fpr, const char *expirestr,
 }
 
 
+
+/* Object to collect the operations of keyedit_quick_batch for one
+ * key.  */
+struct batch_edit_key_s
+{
+  struct batch_edit_key_s *next;
+  strlist_t ops;   /* The operations; the flags hold the line number.  */
+  char fpr[1];     /* The fingerprint as given.  */
+};
+typedef struct batch_edit_key_s *batch_edit_key_t;
+
+
+/* Apply the operation OP of a batch edit to KEYBLOCK.  LOCUSR is the
+ * list of signing keys.  On a change R_MODIFIED is set to true.  */
+static gpg_error_t
+batch_edit_apply (ctrl_t ctrl, kbnode_t keyblock, char *op,
+                  strlist_t locusr, int *r_modified)
+{
+  gpg_error_t err;
+  const char *fields[65];
+  char *cmd, *args;
+  strlist_t uids = NULL;
+  kbnode_t node;
+  int nfields, i;
+
+  cmd = op;
+  for (args = op; *args && !spacep (args); args++)
+    ;
+  if (*args)
+    *args++ = 0;
+  trim_spaces (args);
+
+  /* Start without any selected user ids or subkeys.  */
+  for (node = keyblock; node; node = node->next)
+    node->flag &= ~(NODFLG_SELUID | NODFLG_SELKEY);
+
+  if (!strcmp (cmd, "set-expire"))
+    {
+      nfields = split_fields (args, fields, DIM (fields) - 1);
+      if (nfields < 1)
+        return gpg_error (GPG_ERR_MISSING_VALUE);
+      fields[nfields] = NULL;
+      err = quick_set_expire_core (ctrl, keyblock, fields[0],
+                                   (char **)fields + 1, r_modified);
+    }
+  else if (!strcmp (cmd, "add-uid"))
+    {
+      if (!*args)
+        return gpg_error (GPG_ERR_INV_USER_ID);
+      if (menu_adduid (ctrl, keyblock, 0, NULL, args))
+        {
+          *r_modified = 1;
+          err = 0;
+        }
+      else
+        err = gpg_error (GPG_ERR_GENERAL);
+    }
+  else if (!strcmp (cmd, "sign") || !strcmp (cmd, "lsign"))
+    {
+      nfields = split_fields (args, fields, DIM (fields));
+      for (i=0; i < nfields; i++)
+        append_to_strlist (&uids, fields[i]);
+      err = quick_sign_core (ctrl, keyblock, uids, locusr, *cmd == 'l',
+                             r_modified);
+      free_strlist (uids);
+    }
+  else
+    {
+      log_error ("unknown batch edit command '%s'\n", cmd);
+      err = gpg_error (GPG_ERR_UNKNOWN_COMMAND);
+    }
+
+  if (!err && *r_modified)
+    merge_keys_and_selfsig (ctrl, keyblock);
+  es_fflush (es_stdout);
+  return err;
+}
+
+
+/* Unattended editing of many keys.  FNAME is a file (or stdin if
+ * NULL or "-") with one operation per line:
+ *
+ *   FPR set-expire EXPIRE [SUBKEY-FPRS|*]
+ *   FPR add-uid USER-ID
+ *   FPR sign [NAMES]
+ *   FPR lsign [NAMES]
+ *
+ * FPR is the primary fingerprint of the key to edit and the
+ * operations work like the corresponding --quick commands.  The
+ * operations are grouped by key so that each keyblock is read and
+ * written only once; if one operation on a key fails no changes are
+ * written for this key.  LOCUSR is the list of signing keys for the
+ * sign operations.  */
+void
+keyedit_quick_batch (ctrl_t ctrl, const char *fname, strlist_t locusr)
+{
+  gpg_error_t err;
+  estream_t fp;
+  char *line = NULL;
+  size_t linelen = 0;
+  size_t maxlen = 2048;
+  unsigned int lnr = 0;
+  char *p;
+  batch_edit_key_t keys = NULL;
+  batch_edit_key_t *keys_tail = &keys;
+  batch_edit_key_t bk;
+  strlist_t sl;
+  kbnode_t keyblock;
+  KEYDB_HANDLE kdbhd;
+  int modified, any_modified = 0;
+
+#ifdef HAVE_W32_SYSTEM
+  /* See keyedit_menu for why we need this.  */
+  check_trustdb_stale (ctrl);
+#endif
+
+  if (!fname || !strcmp (fname, "-"))
+    {
+      fname = "[stdin]";
+      fp = es_stdin;
+    }
+  else
+    fp = es_fopen (fname, "r");
+  if (!fp)
+    {
+      err = gpg_error_from_syserror ();
+      log_error (_("can't open '%s': %s\n"), fname, gpg_strerror (err));
+      return;
+    }
+
+  /* Read all operations and group them by key.  */
+  while (es_read_line (fp, &line, &linelen, &maxlen) > 0)
+    {
+      lnr++;
+      if (!maxlen)
+        {
+          log_error ("%s:%u: %s\n", fname, lnr,
+                     gpg_strerror (GPG_ERR_LINE_TOO_LONG));
+          goto leave;
+        }
+      trim_spaces (line);
+      if (!*line || *line == '#')
+        continue;
+      for (p = line; *p && !spacep (p); p++)
+        ;
+      if (!*p)
+        {
+          log_error ("%s:%u: %s\n", fname, lnr,
+                     gpg_strerror (GPG_ERR_SYNTAX));
+          goto leave;
+        }
+      *p++ = 0;
+      while (spacep (p))
+        p++;
+
+      for (bk = keys; bk; bk = bk->next)
+        if (!ascii_strcasecmp (bk->fpr, line))
+          break;
+      if (!bk)
+        {
+          bk = xcalloc (1, sizeof *bk + strlen (line));
+          strcpy (bk->fpr, line);
+          *keys_tail = bk;
+          keys_tail = &bk->next;
+        }
+      sl = append_to_strlist (&bk->ops, p);
+      sl->flags = lnr;
+    }
+  if (es_ferror (fp))
+    {
+      err = gpg_error_from_syserror ();
+      log_error (_("error reading '%s': %s\n"), fname, gpg_strerror (err));
+      goto leave;
+    }
+
+  /* Process them.  */
+  for (bk = keys; bk; bk = bk->next)
+    {
+      /* We require a fingerprint because only this uniquely
+       * identifies a key.  */
+      err = find_by_primary_fpr (ctrl, bk->fpr, &keyblock, &kdbhd);
+      if (err)
+        {
+          write_status_error ("batch_edit", err);
+          continue;
+        }
+
+      modified = fix_keyblock (ctrl, &keyblock);
+      for (sl = bk->ops; sl && !err; sl = sl->next)
+        {
+          err = batch_edit_apply (ctrl, keyblock, sl->d, locusr, &modified);
+          if (err)
+            log_error ("%s:%u: %s\n", fname, sl->flags, gpg_strerror (err));
+        }
+
+      if (err)
+        log_info ("key %s not changed due to errors\n", bk->fpr);
+      else if (modified)
+        {
+          err = keydb_update_keyblock (ctrl, kdbhd, keyblock);
+          if (err)
+            log_error (_("update failed: %s\n"), gpg_strerror (err));
+          else
+            any_modified = 1;
+        }
+      if (err)
+        write_status_error ("batch_edit", err);
+
+      release_kbnode (keyblock);
+      keydb_release (kdbhd);
+    }
+
+  if (any_modified && update_trust)
+    revalidation_mark (ctrl);
+
+ leave:
+  while ((bk = keys))
+    {
+      keys = bk->next;
+      free_strlist (bk->ops);
+      xfree (bk);
+    }
+  es_free (line);
+  if (fp != es_stdin)
+    es_fclose (fp);
+}
+
+
 
 static void
 tty_print_notations (int indent, PKT_signature * sig)
@@ -54,6 +54,7 @@ void keyedit_quick_revsig (ctrl_t ctrl, const char *username,
 void keyedit_quick_set_expire (ctrl_t ctrl,
                                const char *fpr, const char *expirestr,
                                char **subkeyfprs);
+void keyedit_quick_batch (ctrl_t ctrl, const char *fname, strlist_t locusr);
 void keyedit_quick_set_primary (ctrl_t ctrl, const char *username,
                                 const char *primaryuid);
 void keyedit_quick_update_pref (ctrl_t ctrl, const char *username);
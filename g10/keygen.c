@@ -127,6 +127,8 @@ struct output_control_s
     IOBUF stream;
     armor_filter_context_t *afx;
   } pub;
+  int reuse_keydb;     /* Keep the keydb handle for all keys.  */
+  KEYDB_HANDLE pub_hd; /* The kept keydb handle or NULL.  */
 };
 
 
@@ -4381,6 +4383,9 @@ read_parameter_file (ctrl_t ctrl, const char *fname )
 
     memset( &outctrl, 0, sizeof( outctrl ) );
     outctrl.pub.afx = new_armor_context ();
+    /* A parameter file may create many keys; there is no need to
+       open the key database again for each of them.  */
+    outctrl.reuse_keydb = 1;
 
     if( !fname || !*fname)
       fname = "-";
@@ -4553,6 +4558,7 @@ read_parameter_file (ctrl_t ctrl, const char *fname )
     release_parameter_list( para );
     iobuf_close (fp);
     release_armor_context (outctrl.pub.afx);
+    keydb_release (outctrl.pub_hd);
 }
 
 
@@ -5659,7 +5665,13 @@ do_generate_keypair (ctrl_t ctrl, struct para_data_s *para,
     {
       KEYDB_HANDLE pub_hd;
 
-      pub_hd = keydb_new (ctrl);
+      pub_hd = outctrl->pub_hd;
+      if (!pub_hd)
+        {
+          pub_hd = keydb_new (ctrl);
+          if (pub_hd && outctrl->reuse_keydb)
+            outctrl->pub_hd = pub_hd;
+        }
       if (!pub_hd)
         err = gpg_error_from_syserror ();
       else
@@ -5684,7 +5696,8 @@ do_generate_keypair (ctrl_t ctrl, struct para_data_s *para,
                        keydb_get_resource_name (pub_hd), gpg_strerror (err));
         }
 
-      keydb_release (pub_hd);
+      if (pub_hd != outctrl->pub_hd)
+        keydb_release (pub_hd);
 
       if (!err)
         {
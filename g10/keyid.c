@@ -678,6 +678,28 @@ nbits_from_pk (PKT_public_key *pk)
 }
 
 
+/* Return true if PK is compliant with COMPLIANCE.  This is a wrapper
+ * around gnupg_pk_is_compliant which memorizes the result for the
+ * only mode with real checks in PK.  Listings and the encryption and
+ * verification code ask this for the same keys many times.  */
+int
+pk_is_compliant (PKT_public_key *pk, enum gnupg_compliance_mode compliance)
+{
+  if (compliance != CO_DE_VS)
+    return gnupg_pk_is_compliant (compliance, pk->pubkey_algo, 0, pk->pkey,
+                                  nbits_from_pk (pk), NULL);
+
+  if (!pk->flags.de_vs_valid)
+    {
+      pk->flags.de_vs = !!gnupg_pk_is_compliant (CO_DE_VS, pk->pubkey_algo,
+                                                 0, pk->pkey,
+                                                 nbits_from_pk (pk), NULL);
+      pk->flags.de_vs_valid = 1;
+    }
+  return pk->flags.de_vs;
+}
+
+
 /* Convert an UTC TIMESTAMP into an UTC yyyy-mm-dd string.  Return
  * that string.  The caller should pass a buffer with at least a size
  * of MK_DATESTR_SIZE.  */
@@ -1031,13 +1053,20 @@ format_hexfingerprint (const char *fingerprint, char *buffer, size_t buflen)
 
 /* Return the so called KEYGRIP which is the SHA-1 hash of the public
    key parameters expressed as an canonical encoded S-Exp.  ARRAY must
-   be 20 bytes long.  Returns 0 on success or an error code.  */
+   be 20 bytes long.  Returns 0 on success or an error code.  The
+   keygrip is cached in PK.  */
 gpg_error_t
 keygrip_from_pk (PKT_public_key *pk, unsigned char *array)
 {
   gpg_error_t err;
   gcry_sexp_t s_pkey;
 
+  if (pk->flags.grip_valid)
+    {
+      memcpy (array, pk->grip, KEYGRIP_LEN);
+      return 0;
+    }
+
   if (DBG_PACKET)
     log_debug ("get_keygrip for public key\n");
 
@@ -1110,7 +1139,8 @@ keygrip_from_pk (PKT_public_key *pk, unsigned char *array)
     {
       if (DBG_PACKET)
         log_printhex (array, 20, "keygrip=");
-      /* FIXME: Save the keygrip in PK.  */
+      memcpy (pk->grip, array, KEYGRIP_LEN);
+      pk->flags.grip_valid = 1;
     }
   gcry_sexp_release (s_pkey);
 
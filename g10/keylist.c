@@ -33,6 +33,7 @@
 #include "packet.h"
 #include "../common/status.h"
 #include "keydb.h"
+#include "objcache.h"
 #include "photoid.h"
 #include "../common/util.h"
 #include "../common/ttyio.h"
@@ -50,6 +51,9 @@
 #include "../common/pkscreening.h"
 
 
+/* The size of the stdout buffer used for a colon listing.  */
+#define COLON_LISTING_BUFSIZE 65536
+
 static void list_all (ctrl_t, int, int);
 static void list_one (ctrl_t ctrl,
                       strlist_t names, int secret, int mark_secret);
@@ -750,6 +754,11 @@ list_all (ctrl_t ctrl, int secret, int mark_secret)
   if (opt.check_sigs)
     listctx.check_sigs = 1;
 
+  /* The colon listing of a large keyring is often piped to another
+   * tool; use a larger buffer to reduce the number of writes.  */
+  if (opt.with_colons)
+    es_setvbuf (es_stdout, NULL, _IOFBF, COLON_LISTING_BUFSIZE);
+
   hd = keydb_new (ctrl);
   if (!hd)
     rc = gpg_error_from_syserror ();
@@ -1713,26 +1722,18 @@ print_revokers (estream_t fp, PKT_public_key * pk)
 }
 
 
-/* Print the compliance flags to field 18.  PK is the public key.
- * KEYLENGTH is the length of the key in bits and CURVENAME is either
- * NULL or the name of the curve.  The latter two args are here
- * merely because the caller has already computed them.  */
+/* Print the compliance flags to field 18.  PK is the public key.  */
 static void
-print_compliance_flags (PKT_public_key *pk,
-                        unsigned int keylength, const char *curvename)
+print_compliance_flags (PKT_public_key *pk)
 {
   int any = 0;
 
-  if (!keylength)
-    keylength = nbits_from_pk (pk);
-
   if (pk->version == 5)
     {
       es_fputs (gnupg_status_compliance_flag (CO_GNUPG), es_stdout);
       any++;
     }
-  if (gnupg_pk_is_compliant (CO_DE_VS, pk->pubkey_algo, 0, pk->pkey,
-			     keylength, curvename))
+  if (pk_is_compliant (pk, CO_DE_VS))
     {
       es_fprintf (es_stdout, any ? " %s" : "%s",
 		  gnupg_status_compliance_flag (CO_DE_VS));
@@ -1779,6 +1780,12 @@ list_keyblock_colon (ctrl_t ctrl, kbnode_t keyblock,
     }
 
   pk = node->pkt->pkt.public_key;
+
+  /* Put the user id of this key into the cache so that listing the
+   * self-signatures does not need another database lookup.  */
+  if (opt.list_sigs && !opt.fast_list_mode)
+    cache_put_keyblock (keyblock);
+
   if (secret || has_secret || opt.with_keygrip || opt.with_key_data)
     {
       rc = hexkeygrip_from_pk (pk, &hexgrip_buffer);
@@ -1858,7 +1865,7 @@ list_keyblock_colon (ctrl_t ctrl, kbnode_t keyblock,
       es_fputs (curvename, es_stdout);
     }
   es_putc (':', es_stdout);		/* End of field 17. */
-  print_compliance_flags (pk, keylength, curvename);
+  print_compliance_flags (pk);
   es_putc (':', es_stdout);		/* End of field 18 (compliance). */
   if (pk->keyupdate)
     es_fputs (colon_strtime (pk->keyupdate), es_stdout);
@@ -2009,7 +2016,7 @@ list_keyblock_colon (ctrl_t ctrl, kbnode_t keyblock,
               es_fputs (curvename, es_stdout);
             }
           es_putc (':', es_stdout);	/* End of field 17. */
-          print_compliance_flags (pk2, keylength, curvename);
+          print_compliance_flags (pk2);
           es_putc (':', es_stdout);	/* End of field 18. */
 	  es_putc ('\n', es_stdout);
           print_fingerprint (ctrl, NULL, pk2, 0);
@@ -2232,11 +2239,111 @@ reorder_keyblock (KBNODE keyblock)
 }
 
 
+/* Prepare the check of the key signatures of KEYBLOCK for
+ * --check-signatures.  The keys of all signers are fetched in one
+ * go; with --check-sigs-threads the certifications are also verified
+ * in parallel.  The found signer keys are stored at R_SIGNERS and
+ * their number is returned; the caller must release them with
+ * check_sigs_release.  */
+static int
+check_sigs_prepare (ctrl_t ctrl, kbnode_t keyblock,
+                    PKT_public_key ***r_signers)
+{
+  kbnode_t node;
+  PKT_signature *sig;
+  PKT_public_key **signers;
+  u32 (*keyids)[2];
+  u32 *mainkid;
+  int i, n, nkeyids, nsigners;
+
+  *r_signers = NULL;
+  if (keyblock->pkt->pkttype != PKT_PUBLIC_KEY)
+    return 0;
+  mainkid = pk_keyid (keyblock->pkt->pkt.public_key);
+
+  for (n=0, node=keyblock; node; node = node->next)
+    if (node->pkt->pkttype == PKT_SIGNATURE)
+      n++;
+  if (n < 2)
+    return 0;
+  keyids = xtrycalloc (n, sizeof *keyids);
+  if (!keyids)
+    return 0;
+
+  for (nkeyids=0, node=keyblock; node; node = node->next)
+    {
+      if (node->pkt->pkttype != PKT_SIGNATURE)
+        continue;
+      sig = node->pkt->pkt.signature;
+      if (keyid_cmp (sig->keyid, mainkid) == 0)
+        continue;  /* Self-signatures are checked using KEYBLOCK.  */
+      if (!IS_UID_SIG (sig) && !IS_UID_REV (sig))
+        continue;
+      if (!opt.no_sig_cache && sig->flags.checked)
+        continue;
+      for (i=0; i < nkeyids; i++)
+        if (keyid_cmp (keyids[i], sig->keyid) == 0)
+          break;
+      if (i < nkeyids)
+        continue;  /* Duplicate.  */
+      keyids[nkeyids][0] = sig->keyid[0];
+      keyids[nkeyids][1] = sig->keyid[1];
+      nkeyids++;
+    }
+
+  prefetch_pubkeys (ctrl, keyids, nkeyids, PUBKEY_USAGE_CERT);
+
+  nsigners = 0;
+  if (opt.check_sigs_threads > 1 && nkeyids
+      && (signers = xtrycalloc (nkeyids, sizeof *signers)))
+    {
+      /* The keys are now in the cache and thus cheap to get.  */
+      for (i=0; i < nkeyids; i++)
+        {
+          signers[nsigners] = xtrycalloc (1, sizeof **signers);
+          if (!signers[nsigners])
+            break;
+          if (get_pubkey (ctrl, signers[nsigners], keyids[i]))
+            {
+              free_public_key (signers[nsigners]);
+              signers[nsigners] = NULL;
+              continue;
+            }
+          nsigners++;
+        }
+      sig_check_prefetch (ctrl, &keyblock, 1, signers, nsigners,
+                          opt.check_sigs_threads);
+      *r_signers = signers;
+    }
+
+  xfree (keyids);
+  return nsigners;
+}
+
+
+/* Release the results of check_sigs_prepare.  */
+static void
+check_sigs_release (PKT_public_key **signers, int nsigners)
+{
+  int i;
+
+  if (!signers)
+    return;
+  sig_check_prefetch_release ();
+  for (i=0; i < nsigners; i++)
+    free_public_key (signers[i]);
+  xfree (signers);
+}
+
+
 static void
 list_keyblock (ctrl_t ctrl,
                KBNODE keyblock, int secret, int has_secret, int fpr,
                struct keylist_context *listctx)
 {
+  PKT_public_key **signers = NULL;
+  int nsigners = 0;
+
   reorder_keyblock (keyblock);
 
   if (list_filter.selkey)
@@ -2257,6 +2364,9 @@ list_keyblock (ctrl_t ctrl,
         return;  /* Skip this one.  */
     }
 
+  if (opt.check_sigs)
+    nsigners = check_sigs_prepare (ctrl, keyblock, &signers);
+
   if (opt.with_colons)
     list_keyblock_colon (ctrl, keyblock, secret, has_secret);
   else if ((opt.list_options & LIST_SHOW_ONLY_FPR_MBOX))
@@ -2268,6 +2378,8 @@ list_keyblock (ctrl_t ctrl,
   else
     list_keyblock_print (ctrl, keyblock, secret, fpr, listctx);
 
+  check_sigs_release (signers, nsigners);
+
   if (secret)
     es_fflush (es_stdout);
 }
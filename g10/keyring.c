@@ -35,9 +35,29 @@
 #include "options.h"
 #include "main.h" /*for check_key_signature()*/
 #include "../common/i18n.h"
+#include "../common/host2net.h"
 #include "../kbx/keybox.h"
 
 
+/* The keyid index of a keyring.  It maps the long keyids of all
+ * primary keys and subkeys, and the hashes of the lowercased mail
+ * addresses of all user ids, to the offset of their keyblock.  The
+ * index is stored in a file next to the keyring and is only valid as
+ * long as size and modification time of the keyring match.  */
+struct keyring_index_entry
+{
+  u32 kid[2];
+  off_t offset;
+};
+struct keyring_index
+{
+  off_t filesize;   /* Size of the keyring at the time of indexing.  */
+  time_t mtime;     /* and its modification time.  */
+  size_t nentries;
+  size_t nallocated;
+  struct keyring_index_entry *entries;  /* Sorted by kid and offset.  */
+};
+
 typedef struct keyring_resource *KR_RESOURCE;
 struct keyring_resource
 {
@@ -46,6 +66,9 @@ struct keyring_resource
   dotlock_t lockhd;
   int is_locked;
   int did_full_scan;
+  struct keyring_index *index;  /* The loaded index or NULL.  */
+  off_t noindex_filesize;  /* Size and mtime of the keyring when we  */
+  time_t noindex_mtime;    /* failed to create an index.             */
   char fname[1];
 };
 typedef struct keyring_resource const * CONST_KR_RESOURCE;
@@ -79,6 +102,7 @@ static int active_handles;
 
 static int do_copy (int mode, const char *fname, KBNODE root,
                     off_t start_offset, unsigned int n_packets );
+static int write_keyblock (IOBUF fp, KBNODE keyblock);
 
 
 
@@ -108,6 +132,16 @@ static int key_present_hash_ready;
 
 #define KEY_PRESENT_HASH_BUCKETS 2048
 
+/* The suffix and the magic of the keyring index files.  The header
+ * consists of the 8 byte magic, the 8 byte size and 8 byte mtime of
+ * the keyring, and the 4 byte number of entries.  Each entry
+ * consists of the 8 byte keyid and the 8 byte offset.  All numbers
+ * are big endian.  */
+#define KEYRING_INDEX_SUFFIX ".kidx"
+#define KEYRING_INDEX_MAGIC  "GPGkidx2"
+#define KEYRING_INDEX_HDRLEN 28
+#define KEYRING_INDEX_ENTLEN 16
+
 /* Allocate a new value for a key present hash table.  */
 static struct key_present *
 key_present_value_new (void)
@@ -177,6 +211,555 @@ key_present_hash_update_from_kb (key_present_hash_t tbl, KBNODE node)
     }
 }
 
+/* Return the keyring resource object for KR.  */
+static KR_RESOURCE
+get_resource (CONST_KR_RESOURCE kr)
+{
+  KR_RESOURCE r;
+
+  for (r = kr_resources; r; r = r->next)
+    if (r == kr)
+      return r;
+  return NULL;
+}
+
+
+static void
+u64_to_buf (byte *p, uint64_t a)
+{
+  ulongtobuf (p,   (u32)(a >> 32));
+  ulongtobuf (p+4, (u32)a);
+}
+
+static uint64_t
+buf_to_u64 (const byte *p)
+{
+  return (((uint64_t)buf32_to_u32 (p) << 32) | buf32_to_u32 (p+4));
+}
+
+
+/* Return the addr-spec of the user id UID of length UIDLEN in the
+ * same way as compare_name does for KEYDB_SEARCH_MODE_MAIL and store
+ * its length at R_LEN.  Returns NULL if there is none.  */
+static const char *
+uid_mail_part (const char *uid, size_t uidlen, size_t *r_len)
+{
+  const char *s, *se;
+  size_t i;
+
+  for (i=0, s=uid; i < uidlen && *s != '<'; s++, i++)
+    ;
+  if (i == uidlen)
+    {
+      /* The UID is a plain addr-spec (cf. RFC2822 section 4.3).  */
+      if (!uidlen)
+        return NULL;
+      *r_len = uidlen;
+      return uid;
+    }
+
+  /* Skip opening delim and one char and look for the closing one.  */
+  s++; i++;
+  for (se=s+1, i++; i < uidlen && *se != '>'; se++, i++)
+    ;
+  if (i >= uidlen)
+    return NULL;
+  *r_len = se - s;
+  return s;
+}
+
+
+/* Store the index key for the mail address MAIL of length LEN at
+ * R_KEY.  This is the FNV-1a hash of the lowercased address folded
+ * into the space of the long keyids; a collision only yields a false
+ * candidate.  */
+static void
+mail_index_key (const char *mail, size_t len, u32 *r_key)
+{
+  const byte *p = (const byte *)mail;
+  uint64_t h = 0xcbf29ce484222325ULL;
+
+  for (; len; len--, p++)
+    h = (h ^ ascii_tolower (*p)) * 0x100000001b3ULL;
+  r_key[0] = (u32)(h >> 32);
+  r_key[1] = (u32)h;
+}
+
+
+/* qsort compare function for index entries.  */
+static int
+cmp_index_entries (const void *a_arg, const void *b_arg)
+{
+  const struct keyring_index_entry *a = a_arg;
+  const struct keyring_index_entry *b = b_arg;
+
+  if (a->kid[0] != b->kid[0])
+    return a->kid[0] < b->kid[0]? -1 : 1;
+  if (a->kid[1] != b->kid[1])
+    return a->kid[1] < b->kid[1]? -1 : 1;
+  if (a->offset != b->offset)
+    return a->offset < b->offset? -1 : 1;
+  return 0;
+}
+
+
+static void
+index_release (struct keyring_index *idx)
+{
+  if (!idx)
+    return;
+  xfree (idx->entries);
+  xfree (idx);
+}
+
+
+/* Add an entry for KID at OFFSET to IDX.  The caller needs to sort
+ * the index eventually.  */
+static gpg_error_t
+index_add (struct keyring_index *idx, u32 *kid, off_t offset)
+{
+  struct keyring_index_entry *tmp;
+
+  if (idx->nentries == idx->nallocated)
+    {
+      idx->nallocated = idx->nallocated? 2 * idx->nallocated : 256;
+      tmp = xtryrealloc (idx->entries, idx->nallocated * sizeof *tmp);
+      if (!tmp)
+        return gpg_error_from_syserror ();
+      idx->entries = tmp;
+    }
+  idx->entries[idx->nentries].kid[0] = kid[0];
+  idx->entries[idx->nentries].kid[1] = kid[1];
+  idx->entries[idx->nentries].offset = offset;
+  idx->nentries++;
+  return 0;
+}
+
+
+/* Add an entry for the mail address of the user id UID to IDX.  */
+static gpg_error_t
+index_add_uid (struct keyring_index *idx, PKT_user_id *uid, off_t offset)
+{
+  const char *mail;
+  size_t len;
+  u32 key[2];
+
+  mail = uid_mail_part (uid->name, uid->len, &len);
+  if (!mail)
+    return 0;
+  mail_index_key (mail, len, key);
+  return index_add (idx, key, offset);
+}
+
+
+/* Get size and modification time of the keyring FNAME.  */
+static gpg_error_t
+stat_keyring (const char *fname, off_t *r_size, time_t *r_mtime)
+{
+  struct stat st;
+
+  if (gnupg_stat (fname, &st))
+    return gpg_error_from_syserror ();
+  *r_size = st.st_size;
+  *r_mtime = st.st_mtime;
+  return 0;
+}
+
+
+/* Read the index file of the keyring FNAME.  Returns NULL if there
+ * is no usable index file.  */
+static struct keyring_index *
+index_read (const char *fname)
+{
+  char *idxfname;
+  estream_t fp;
+  struct keyring_index *idx = NULL;
+  byte hdr[KEYRING_INDEX_HDRLEN];
+  byte ent[KEYRING_INDEX_ENTLEN];
+  size_t n, nentries;
+
+  idxfname = xstrconcat (fname, KEYRING_INDEX_SUFFIX, NULL);
+  fp = es_fopen (idxfname, "rb");
+  xfree (idxfname);
+  if (!fp)
+    return NULL;
+
+  if (es_read (fp, hdr, sizeof hdr, &n) || n != sizeof hdr
+      || memcmp (hdr, KEYRING_INDEX_MAGIC, 8))
+    goto leave;
+  nentries = buf32_to_size_t (hdr + 24);
+
+  idx = xtrycalloc (1, sizeof *idx);
+  if (!idx)
+    goto leave;
+  idx->filesize = buf_to_u64 (hdr + 8);
+  idx->mtime = buf_to_u64 (hdr + 16);
+  idx->entries = xtrycalloc (nentries? nentries : 1, sizeof *idx->entries);
+  if (!idx->entries)
+    goto fail;
+  idx->nallocated = nentries? nentries : 1;
+
+  for (; idx->nentries < nentries; idx->nentries++)
+    {
+      if (es_read (fp, ent, sizeof ent, &n) || n != sizeof ent)
+        goto fail;
+      idx->entries[idx->nentries].kid[0] = buf32_to_u32 (ent);
+      idx->entries[idx->nentries].kid[1] = buf32_to_u32 (ent + 4);
+      idx->entries[idx->nentries].offset = buf_to_u64 (ent + 8);
+    }
+  goto leave;
+
+ fail:
+  index_release (idx);
+  idx = NULL;
+ leave:
+  es_fclose (fp);
+  return idx;
+}
+
+
+/* Write IDX as index file for the keyring FNAME.  */
+static gpg_error_t
+index_write (const char *fname, struct keyring_index *idx)
+{
+  gpg_error_t err = 0;
+  char *idxfname, *tmpfname;
+  estream_t fp;
+  byte hdr[KEYRING_INDEX_HDRLEN];
+  byte ent[KEYRING_INDEX_ENTLEN];
+  size_t i;
+
+  idxfname = xstrconcat (fname, KEYRING_INDEX_SUFFIX, NULL);
+  tmpfname = xstrconcat (idxfname, ".tmp", NULL);
+  fp = es_fopen (tmpfname, "wb,mode=-rw");
+  if (!fp)
+    {
+      err = gpg_error_from_syserror ();
+      goto leave;
+    }
+
+  memcpy (hdr, KEYRING_INDEX_MAGIC, 8);
+  u64_to_buf (hdr + 8, idx->filesize);
+  u64_to_buf (hdr + 16, idx->mtime);
+  ulongtobuf (hdr + 24, (u32)idx->nentries);
+  if (es_write (fp, hdr, sizeof hdr, NULL))
+    err = gpg_error_from_syserror ();
+  for (i=0; !err && i < idx->nentries; i++)
+    {
+      ulongtobuf (ent, idx->entries[i].kid[0]);
+      ulongtobuf (ent + 4, idx->entries[i].kid[1]);
+      u64_to_buf (ent + 8, idx->entries[i].offset);
+      if (es_write (fp, ent, sizeof ent, NULL))
+        err = gpg_error_from_syserror ();
+    }
+  if (es_fclose (fp) && !err)
+    err = gpg_error_from_syserror ();
+  if (!err)
+    err = gnupg_rename_file (tmpfname, idxfname, NULL);
+  if (err)
+    gnupg_remove (tmpfname);
+
+ leave:
+  if (err && DBG_LOOKUP)
+    log_debug ("%s: error writing '%s': %s\n",
+               __func__, idxfname, gpg_strerror (err));
+  xfree (tmpfname);
+  xfree (idxfname);
+  return err;
+}
+
+
+/* Create an index for the keyring FNAME by scanning the entire file.
+ * Returns NULL on error or if the keyring has keys which we can't
+ * index.  */
+static struct keyring_index *
+index_build (const char *fname)
+{
+  struct keyring_index *idx;
+  struct parse_packet_ctx_s parsectx;
+  PACKET pkt;
+  IOBUF a;
+  off_t offset, main_offset;
+  u32 kid[2];
+  int save_mode;
+  int rc;
+
+  idx = xtrycalloc (1, sizeof *idx);
+  if (!idx)
+    return NULL;
+  if (stat_keyring (fname, &idx->filesize, &idx->mtime))
+    {
+      index_release (idx);
+      return NULL;
+    }
+
+  a = iobuf_open (fname);
+  if (!a)
+    {
+      index_release (idx);
+      return NULL;
+    }
+
+  init_packet (&pkt);
+  save_mode = set_packet_list_mode (0);
+  init_parse_packet (&parsectx, a);
+  main_offset = -1;
+  while (!(rc = search_packet (&parsectx, &pkt, &offset, 1)))
+    {
+      if (pkt.pkttype == PKT_PUBLIC_KEY || pkt.pkttype == PKT_SECRET_KEY)
+        main_offset = offset;
+      if (main_offset != -1
+          && (pkt.pkttype == PKT_PUBLIC_KEY
+              || pkt.pkttype == PKT_PUBLIC_SUBKEY
+              || pkt.pkttype == PKT_SECRET_KEY
+              || pkt.pkttype == PKT_SECRET_SUBKEY))
+        {
+          keyid_from_pk (pkt.pkt.public_key, kid);
+          if ((rc = index_add (idx, kid, main_offset)))
+            break;
+        }
+      else if (main_offset != -1 && pkt.pkttype == PKT_USER_ID)
+        {
+          if ((rc = index_add_uid (idx, pkt.pkt.user_id, main_offset)))
+            break;
+        }
+      free_packet (&pkt, &parsectx);
+    }
+  free_packet (&pkt, &parsectx);
+  deinit_parse_packet (&parsectx);
+  set_packet_list_mode (save_mode);
+  iobuf_close (a);
+
+  if (rc != -1)
+    {
+      /* We do not index keyrings with legacy keys or errors.  */
+      if (DBG_LOOKUP)
+        log_debug ("%s: not indexing '%s': %s\n",
+                   __func__, fname, gpg_strerror (rc));
+      index_release (idx);
+      return NULL;
+    }
+
+  qsort (idx->entries, idx->nentries, sizeof *idx->entries,
+         cmp_index_entries);
+  return idx;
+}
+
+
+/* Return the valid index of the keyring KR or NULL if there is
+ * none.  If BUILD is set the index is read from its file or created
+ * if needed.  */
+static struct keyring_index *
+get_index (KR_RESOURCE kr, int build)
+{
+  off_t filesize;
+  time_t mtime;
+
+  if (!kr || stat_keyring (kr->fname, &filesize, &mtime))
+    return NULL;
+
+  if (kr->index
+      && (kr->index->filesize != filesize || kr->index->mtime != mtime))
+    {
+      index_release (kr->index);
+      kr->index = NULL;
+    }
+  if (kr->index || !build)
+    return kr->index;
+
+  if (kr->noindex_filesize == filesize && kr->noindex_mtime == mtime)
+    return NULL;  /* We already failed for this version.  */
+
+  kr->index = index_read (kr->fname);
+  if (kr->index
+      && (kr->index->filesize != filesize || kr->index->mtime != mtime))
+    {
+      index_release (kr->index);
+      kr->index = NULL;
+    }
+  if (!kr->index)
+    {
+      kr->index = index_build (kr->fname);
+      if (kr->index
+          && (kr->index->filesize != filesize || kr->index->mtime != mtime))
+        {
+          /* Modified while we were scanning it.  */
+          index_release (kr->index);
+          kr->index = NULL;
+        }
+      if (kr->index && !kr->read_only)
+        index_write (kr->fname, kr->index);
+    }
+  if (!kr->index)
+    {
+      kr->noindex_filesize = filesize;
+      kr->noindex_mtime = mtime;
+    }
+  else if (DBG_LOOKUP)
+    log_debug ("%s: using index for '%s' with %zu entries\n",
+               __func__, kr->fname, kr->index->nentries);
+  return kr->index;
+}
+
+
+/* Forget the index of KR and remove its file so that it will be
+ * rebuilt on the next use.  */
+static void
+index_drop (KR_RESOURCE kr)
+{
+  char *idxfname;
+
+  if (!kr)
+    return;
+  index_release (kr->index);
+  kr->index = NULL;
+  if (kr->read_only)
+    return;
+  idxfname = xstrconcat (kr->fname, KEYRING_INDEX_SUFFIX, NULL);
+  gnupg_remove (idxfname);
+  xfree (idxfname);
+}
+
+
+/* Look up the long keyid KID in IDX and store a malloced array with
+ * the sorted offsets of the keyblocks at R_OFFSETS and their number
+ * at R_NOFFSETS.  */
+static gpg_error_t
+index_lookup (struct keyring_index *idx, u32 *kid,
+              off_t **r_offsets, size_t *r_noffsets)
+{
+  size_t lo, hi, mid;
+  off_t *offsets;
+  size_t n;
+
+  *r_offsets = NULL;
+  *r_noffsets = 0;
+
+  /* Find the first entry with KID.  */
+  lo = 0;
+  hi = idx->nentries;
+  while (lo < hi)
+    {
+      mid = lo + (hi - lo) / 2;
+      if (idx->entries[mid].kid[0] < kid[0]
+          || (idx->entries[mid].kid[0] == kid[0]
+              && idx->entries[mid].kid[1] < kid[1]))
+        lo = mid + 1;
+      else
+        hi = mid;
+    }
+
+  for (n=0, hi=lo; hi < idx->nentries; hi++, n++)
+    if (idx->entries[hi].kid[0] != kid[0] || idx->entries[hi].kid[1] != kid[1])
+      break;
+  if (!n)
+    return 0;
+
+  offsets = xtrycalloc (n, sizeof *offsets);
+  if (!offsets)
+    return gpg_error_from_syserror ();
+  for (n=0; lo < hi; lo++)
+    if (!n || offsets[n-1] != idx->entries[lo].offset)
+      offsets[n++] = idx->entries[lo].offset;
+
+  *r_offsets = offsets;
+  *r_noffsets = n;
+  return 0;
+}
+
+
+/* Update the index of the keyring KR after a successful do_copy.
+ * MODE is the mode of do_copy, START_OFFSET the offset of the deleted
+ * or updated keyblock, and KB the inserted or updated keyblock.  IDX
+ * is the index which was valid before the modification.  If the
+ * offsets can't be computed exactly the index is removed.  */
+static void
+index_update (KR_RESOURCE kr, struct keyring_index *idx, int mode,
+              off_t start_offset, kbnode_t kb)
+{
+  off_t oldlen = 0;
+  off_t newlen = 0;
+  off_t filesize;
+  time_t mtime;
+  size_t i, n;
+  kbnode_t node;
+  iobuf_t tmp;
+  u32 kid[2];
+
+  if (!idx || idx != kr->index)
+    goto drop;
+
+  if (mode == 1)
+    start_offset = idx->filesize;
+  else
+    {
+      /* The length of the old keyblock is the distance to the next
+       * keyblock in the keyring.  */
+      oldlen = idx->filesize - start_offset;
+      for (i=0; i < idx->nentries; i++)
+        if (idx->entries[i].offset > start_offset
+            && idx->entries[i].offset - start_offset < oldlen)
+          oldlen = idx->entries[i].offset - start_offset;
+    }
+
+  if (mode == 1 || mode == 3)
+    {
+      tmp = iobuf_temp ();
+      if (write_keyblock (tmp, kb))
+        {
+          iobuf_close (tmp);
+          goto drop;
+        }
+      newlen = iobuf_get_temp_length (tmp);
+      iobuf_close (tmp);
+    }
+
+  /* Copying the undisturbed keyblocks may have removed garbage from
+   * the keyring; we detect this by comparing the sizes.  */
+  if (stat_keyring (kr->fname, &filesize, &mtime)
+      || filesize != idx->filesize - oldlen + newlen)
+    goto drop;
+
+  for (i=n=0; i < idx->nentries; i++)
+    {
+      if (mode != 1 && idx->entries[i].offset == start_offset)
+        continue;  /* Remove.  */
+      idx->entries[n] = idx->entries[i];
+      if (idx->entries[n].offset > start_offset)
+        idx->entries[n].offset += newlen - oldlen;
+      n++;
+    }
+  idx->nentries = n;
+
+  if (mode == 1 || mode == 3)
+    for (node = kb; node; node = node->next)
+      if (node->pkt->pkttype == PKT_PUBLIC_KEY
+          || node->pkt->pkttype == PKT_PUBLIC_SUBKEY
+          || node->pkt->pkttype == PKT_SECRET_KEY
+          || node->pkt->pkttype == PKT_SECRET_SUBKEY)
+        {
+          keyid_from_pk (node->pkt->pkt.public_key, kid);
+          if (index_add (idx, kid, start_offset))
+            goto drop;
+        }
+      else if (node->pkt->pkttype == PKT_USER_ID)
+        {
+          if (index_add_uid (idx, node->pkt->pkt.user_id, start_offset))
+            goto drop;
+        }
+
+  qsort (idx->entries, idx->nentries, sizeof *idx->entries,
+         cmp_index_entries);
+  idx->filesize = filesize;
+  idx->mtime = mtime;
+  if (!index_write (kr->fname, idx))
+    return;
+
+ drop:
+  index_drop (kr);
+}
+
+
 /*
  * Register a filename for plain keyring files.  ptr is set to a
  * pointer to be used to create a handles etc, or the already-issued
@@ -210,6 +793,9 @@ keyring_register_filename (const char *fname, int read_only, void **ptr)
     kr->lockhd = NULL;
     kr->is_locked = 0;
     kr->did_full_scan = 0;
+    kr->index = NULL;
+    kr->noindex_filesize = 0;
+    kr->noindex_mtime = 0;
     /* keep a list of all issued pointers */
     kr->next = kr_resources;
     kr_resources = kr;
@@ -531,6 +1117,8 @@ int
 keyring_update_keyblock (KEYRING_HANDLE hd, KBNODE kb)
 {
     int rc;
+    KR_RESOURCE kr;
+    struct keyring_index *idx;
 
     if (!hd->found.kr)
         return -1; /* no successful prior search */
@@ -555,10 +1143,15 @@ keyring_update_keyblock (KEYRING_HANDLE hd, KBNODE kb)
     iobuf_close(hd->current.iobuf);
     hd->current.iobuf = NULL;
 
+    kr = get_resource (hd->found.kr);
+    idx = get_index (kr, 1);
+
     /* do the update */
     rc = do_copy (3, hd->found.kr->fname, kb,
                   hd->found.offset, hd->found.n_packets );
     if (!rc) {
+      if (kr)
+        index_update (kr, idx, 3, hd->found.offset, kb);
       if (key_present_hash)
         {
           key_present_hash_update_from_kb (key_present_hash, kb);
@@ -575,6 +1168,8 @@ keyring_insert_keyblock (KEYRING_HANDLE hd, KBNODE kb)
 {
     int rc;
     const char *fname;
+    KR_RESOURCE kr = NULL;
+    struct keyring_index *idx;
 
     if (!hd)
         fname = NULL;
@@ -583,15 +1178,20 @@ keyring_insert_keyblock (KEYRING_HANDLE hd, KBNODE kb)
         fname = hd->found.kr->fname;
         if (hd->found.kr->read_only)
           return gpg_error (GPG_ERR_EACCES);
+        kr = get_resource (hd->found.kr);
       }
     else if (hd->current.kr)
       {
         fname = hd->current.kr->fname;
         if (hd->current.kr->read_only)
           return gpg_error (GPG_ERR_EACCES);
+        kr = get_resource (hd->current.kr);
       }
     else
+      {
         fname = hd->resource? hd->resource->fname:NULL;
+        kr = get_resource (hd->resource);
+      }
 
     if (!fname)
         return GPG_ERR_GENERAL;
@@ -603,8 +1203,12 @@ keyring_insert_keyblock (KEYRING_HANDLE hd, KBNODE kb)
     iobuf_close (hd->current.iobuf);
     hd->current.iobuf = NULL;
 
+    idx = get_index (kr, 1);
+
     /* do the insert */
     rc = do_copy (1, fname, kb, 0, 0 );
+    if (!rc && kr)
+      index_update (kr, idx, 1, 0, kb);
     if (!rc && key_present_hash)
       {
         key_present_hash_update_from_kb (key_present_hash, kb);
@@ -618,6 +1222,8 @@ int
 keyring_delete_keyblock (KEYRING_HANDLE hd)
 {
     int rc;
+    KR_RESOURCE kr;
+    struct keyring_index *idx;
 
     if (!hd->found.kr)
         return -1; /* no successful prior search */
@@ -643,10 +1249,15 @@ keyring_delete_keyblock (KEYRING_HANDLE hd)
     iobuf_close (hd->current.iobuf);
     hd->current.iobuf = NULL;
 
+    kr = get_resource (hd->found.kr);
+    idx = get_index (kr, 1);
+
     /* do the delete */
     rc = do_copy (2, hd->found.kr->fname, NULL,
                   hd->found.offset, hd->found.n_packets );
     if (!rc) {
+        if (kr)
+          index_update (kr, idx, 2, hd->found.offset, NULL);
         /* better reset the found info */
         hd->found.kr = NULL;
         hd->found.offset = 0;
@@ -891,7 +1502,7 @@ static int
 compare_name (int mode, const char *name, const char *uid, size_t uidlen)
 {
     int i;
-    const char *s, *se;
+    const char *s;
 
     if (mode == KEYDB_SEARCH_MODE_EXACT) {
 	for (i=0; name[i] && uidlen; i++, uidlen--)
@@ -907,41 +1518,21 @@ compare_name (int mode, const char *name, const char *uid, size_t uidlen)
     else if (   mode == KEYDB_SEARCH_MODE_MAIL
              || mode == KEYDB_SEARCH_MODE_MAILSUB
              || mode == KEYDB_SEARCH_MODE_MAILEND) {
-        int have_angles = 1;
-	for (i=0, s= uid; i < uidlen && *s != '<'; s++, i++)
-	    ;
-	if (i == uidlen)
-	  {
-	    /* The UID is a plain addr-spec (cf. RFC2822 section 4.3).  */
-	    have_angles = 0;
-	    s = uid;
-	    i = 0;
-	  }
-	if (i < uidlen)  {
-	    if (have_angles)
-	      {
-		/* skip opening delim and one char and look for the closing one*/
-		s++; i++;
-		for (se=s+1, i++; i < uidlen && *se != '>'; se++, i++)
-		  ;
-	      }
-	    else
-	      se = s + uidlen;
-
-	    if (i < uidlen) {
-		i = se - s;
-		if (mode == KEYDB_SEARCH_MODE_MAIL) {
-		    if( strlen(name)-2 == i
-                        && !ascii_memcasecmp( s, name+1, i) )
-			return 0;
-		}
-		else if (mode == KEYDB_SEARCH_MODE_MAILSUB) {
-		    if( ascii_memistr( s, i, name ) )
-			return 0;
-		}
-		else { /* email from end */
-		    /* nyi */
-		}
+	size_t len;
+
+	s = uid_mail_part (uid, uidlen, &len);
+	if (s) {
+	    if (mode == KEYDB_SEARCH_MODE_MAIL) {
+		if( strlen(name)-2 == len
+		    && !ascii_memcasecmp( s, name+1, len) )
+		    return 0;
+	    }
+	    else if (mode == KEYDB_SEARCH_MODE_MAILSUB) {
+		if( ascii_memistr( s, len, name ) )
+		    return 0;
+	    }
+	    else { /* email from end */
+		/* nyi */
 	    }
 	}
     }
@@ -977,6 +1568,11 @@ keyring_search (KEYRING_HANDLE hd, KEYDB_SEARCH_DESC *desc,
   PKT_public_key *pk = NULL;
   u32 aki[2];
   unsigned char grip[KEYGRIP_LEN];
+  struct keyring_index *idx;
+  off_t *idx_offsets = NULL;  /* Candidate keyblocks from the index.  */
+  size_t idx_n = 0;
+  size_t idx_i = 0;
+  int use_index = 0;
 
   /* figure out what information we need */
   need_uid = need_words = need_keyid = need_fpr = any_skip = need_grip = 0;
@@ -1102,7 +1698,56 @@ keyring_search (KEYRING_HANDLE hd, KEYDB_SEARCH_DESC *desc,
   if (DBG_LOOKUP)
     log_debug ("%s: %ssearching from start of resource.\n",
                __func__, scanned_from_start ? "" : "not ");
+
+  /* For a fresh search by keyid, fingerprint, or mail address we use
+   * the index to look only at the keyblocks which may match.  The
+   * skip function used for mail addresses is run on the candidates
+   * as usual.  */
+  if (scanned_from_start && ndesc == 1
+      && ((!desc[0].skipfnc
+           && (desc[0].mode == KEYDB_SEARCH_MODE_LONG_KID
+               || (desc[0].mode == KEYDB_SEARCH_MODE_FPR
+                   && (desc[0].fprlen == 20 || desc[0].fprlen == 32))))
+          || (desc[0].mode == KEYDB_SEARCH_MODE_MAIL
+              && strlen (desc[0].u.name) >= 2))
+      && (idx = get_index (get_resource (hd->current.kr), 1)))
+    {
+      u32 kid[2];
+
+      if (desc[0].mode == KEYDB_SEARCH_MODE_MAIL)
+        mail_index_key (desc[0].u.name + 1, strlen (desc[0].u.name) - 2, kid);
+      else if (desc[0].mode == KEYDB_SEARCH_MODE_LONG_KID)
+        {
+          kid[0] = desc[0].u.kid[0];
+          kid[1] = desc[0].u.kid[1];
+        }
+      else if (desc[0].fprlen == 20)
+        {
+          kid[0] = buf32_to_u32 (desc[0].u.fpr+12);
+          kid[1] = buf32_to_u32 (desc[0].u.fpr+16);
+        }
+      else
+        {
+          kid[0] = buf32_to_u32 (desc[0].u.fpr);
+          kid[1] = buf32_to_u32 (desc[0].u.fpr+4);
+        }
+      if (!index_lookup (idx, kid, &idx_offsets, &idx_n))
+        {
+          use_index = 1;
+          scanned_from_start = 0;
+          if (DBG_LOOKUP)
+            log_debug ("%s: index has %zu candidates\n", __func__, idx_n);
+        }
+    }
+
   init_parse_packet (&parsectx, hd->current.iobuf);
+  if (use_index && !idx_n)
+    {
+      rc = -1;  /* Not in this keyring.  */
+      goto real_found;
+    }
+  if (use_index && iobuf_seek (hd->current.iobuf, idx_offsets[0]))
+    use_index = 0;
   while (1)
     {
       byte afp[MAX_FINGERPRINT_LEN];
@@ -1114,6 +1759,65 @@ keyring_search (KEYRING_HANDLE hd, KEYDB_SEARCH_DESC *desc,
           free_packet (&pkt, &parsectx);
           continue;
         }
+      if (use_index)
+        {
+          int next = 0;
+
+          if (rc == -1)
+            next = 1;  /* End of keyring; should not happen.  */
+          else if (rc)
+            ;
+          else if (offset == idx_offsets[idx_i])
+            {
+              if (pkt.pkttype != PKT_PUBLIC_KEY
+                  && pkt.pkttype != PKT_SECRET_KEY)
+                rc = gpg_error (GPG_ERR_INV_KEYRING);
+            }
+          else if (pkt.pkttype == PKT_PUBLIC_KEY
+                   || pkt.pkttype == PKT_SECRET_KEY)
+            next = 1;  /* End of the candidate keyblock.  */
+
+          if (next)
+            {
+              free_packet (&pkt, &parsectx);
+              if (++idx_i == idx_n)
+                {
+                  rc = -1;
+                  break;
+                }
+              if (!iobuf_seek (hd->current.iobuf, idx_offsets[idx_i]))
+                {
+                  initial_skip = 1;
+                  continue;
+                }
+              rc = gpg_error (GPG_ERR_INV_KEYRING);
+            }
+
+          if (rc)
+            {
+              /* The index does not match the keyring - fall back to
+               * a sequential search.  */
+              if (DBG_LOOKUP)
+                log_debug ("%s: index mismatch: %s\n",
+                           __func__, gpg_strerror (rc));
+              free_packet (&pkt, &parsectx);
+              deinit_parse_packet (&parsectx);
+              index_drop (get_resource (hd->current.kr));
+              use_index = 0;
+              iobuf_close (hd->current.iobuf);
+              hd->current.iobuf = iobuf_open (hd->current.kr->fname);
+              if (!hd->current.iobuf)
+                {
+                  rc = gpg_error_from_syserror ();
+                  log_error (_("can't open '%s'\n"), hd->current.kr->fname);
+                  init_parse_packet (&parsectx, NULL);
+                  break;
+                }
+              init_parse_packet (&parsectx, hd->current.iobuf);
+              initial_skip = 1;
+              continue;
+            }
+        }
       if (rc)
         break;
 
@@ -1296,6 +2000,7 @@ keyring_search (KEYRING_HANDLE hd, KEYDB_SEARCH_DESC *desc,
   free_packet (&pkt, &parsectx);
   deinit_parse_packet (&parsectx);
   set_packet_list_mode(save_mode);
+  xfree (idx_offsets);
   return rc;
 }
 
@@ -1413,6 +2118,82 @@ write_keyblock (IOBUF fp, KBNODE keyblock)
   return 0;
 }
 
+
+/* The number of keyblocks collected by keyring_rebuild_cache before
+ * their signatures are checked and they are written out.  */
+#define REBUILD_BATCH_SIZE 64
+
+/* Check the signatures of the NKEYBLOCKS keyblocks at KEYBLOCKS to
+ * set their cache flags and write them to TMPFP.  With
+ * --import-threads the self-signatures of the entire batch are first
+ * verified in parallel.  The keyblocks are released and the counters
+ * at COUNT and SIGCOUNT updated.  */
+static int
+rebuild_cache_flush (ctrl_t ctrl, IOBUF tmpfp,
+                     kbnode_t *keyblocks, int nkeyblocks,
+                     ulong *count, ulong *sigcount, int noisy)
+{
+  kbnode_t node;
+  int i, rc = 0;
+
+  if (opt.import_threads && nkeyblocks)
+    sig_check_prefetch (ctrl, keyblocks, nkeyblocks, NULL, 0,
+                        opt.import_threads);
+
+  for (i=0; i < nkeyblocks; i++)
+    {
+      if (rc)
+        {
+          release_kbnode (keyblocks[i]);
+          keyblocks[i] = NULL;
+          continue;
+        }
+
+      /* Check all signature to set the signature's cache flags. */
+      for (node=keyblocks[i]; node; node=node->next)
+        {
+          /* Note that this doesn't cache the result of a
+             revocation issued by a designated revoker.  This is
+             because the pk in question does not carry the revkeys
+             as we haven't merged the key and selfsigs.  It is
+             questionable whether this matters very much since
+             there are very very few designated revoker revocation
+             packets out there. */
+          if (node->pkt->pkttype == PKT_SIGNATURE)
+            {
+              PKT_signature *sig=node->pkt->pkt.signature;
+
+              if(!opt.no_sig_cache && sig->flags.checked && sig->flags.valid
+                 && (openpgp_md_test_algo(sig->digest_algo)
+                     || openpgp_pk_test_algo(sig->pubkey_algo)))
+                sig->flags.checked=sig->flags.valid=0;
+              else
+                check_key_signature (ctrl, keyblocks[i], node, NULL);
+
+              ++*sigcount;
+            }
+        }
+
+      /* Write the keyblock to the temporary file.  */
+      rc = write_keyblock (tmpfp, keyblocks[i]);
+      release_kbnode (keyblocks[i]);
+      keyblocks[i] = NULL;
+      if (rc)
+        continue;
+
+      if ( !(++*count % 50) && noisy && !opt.quiet)
+        log_info (ngettext("%lu keys cached so far (%lu signature)\n",
+                           "%lu keys cached so far (%lu signatures)\n",
+                           *sigcount),
+                  *count, *sigcount);
+    }
+
+  if (opt.import_threads && nkeyblocks)
+    sig_check_prefetch_release ();
+  return rc;
+}
+
+
 /*
  * Walk over all public keyrings, check the signatures and replace the
  * keyring with a new one where the signature cache is then updated.
@@ -1423,7 +2204,9 @@ keyring_rebuild_cache (ctrl_t ctrl, void *token, int noisy)
 {
   KEYRING_HANDLE hd;
   KEYDB_SEARCH_DESC desc;
-  KBNODE keyblock = NULL, node;
+  KBNODE keyblock = NULL;
+  kbnode_t batch[REBUILD_BATCH_SIZE];
+  int nbatch = 0;
   const char *lastresname = NULL, *resname;
   IOBUF tmpfp = NULL;
   char *tmpfilename = NULL;
@@ -1453,6 +2236,11 @@ keyring_rebuild_cache (ctrl_t ctrl, void *token, int noisy)
         { /* we have switched to a new keyring - commit changes */
           if (tmpfp)
             {
+              rc = rebuild_cache_flush (ctrl, tmpfp, batch, nbatch,
+                                        &count, &sigcount, noisy);
+              nbatch = 0;
+              if (rc)
+                goto leave;
               if (iobuf_close (tmpfp))
                 {
                   rc = gpg_error_from_syserror ();
@@ -1517,41 +2305,18 @@ keyring_rebuild_cache (ctrl_t ctrl, void *token, int noisy)
         }
       else
         {
-          /* Check all signature to set the signature's cache flags. */
-          for (node=keyblock; node; node=node->next)
+          /* Collect the keyblock; the signatures are checked and the
+             keyblocks are written in batches.  */
+          batch[nbatch++] = keyblock;
+          keyblock = NULL;
+          if (nbatch == REBUILD_BATCH_SIZE)
             {
-              /* Note that this doesn't cache the result of a
-                 revocation issued by a designated revoker.  This is
-                 because the pk in question does not carry the revkeys
-                 as we haven't merged the key and selfsigs.  It is
-                 questionable whether this matters very much since
-                 there are very very few designated revoker revocation
-                 packets out there. */
-              if (node->pkt->pkttype == PKT_SIGNATURE)
-                {
-                  PKT_signature *sig=node->pkt->pkt.signature;
-
-                  if(!opt.no_sig_cache && sig->flags.checked && sig->flags.valid
-                     && (openpgp_md_test_algo(sig->digest_algo)
-                         || openpgp_pk_test_algo(sig->pubkey_algo)))
-                    sig->flags.checked=sig->flags.valid=0;
-                  else
-                    check_key_signature (ctrl, keyblock, node, NULL);
-
-                  sigcount++;
-                }
+              rc = rebuild_cache_flush (ctrl, tmpfp, batch, nbatch,
+                                        &count, &sigcount, noisy);
+              nbatch = 0;
+              if (rc)
+                goto leave;
             }
-
-          /* Write the keyblock to the temporary file.  */
-          rc = write_keyblock (tmpfp, keyblock);
-          if (rc)
-            goto leave;
-
-          if ( !(++count % 50) && noisy && !opt.quiet)
-            log_info (ngettext("%lu keys cached so far (%lu signature)\n",
-                               "%lu keys cached so far (%lu signatures)\n",
-                               sigcount),
-                      count, sigcount);
         }
     } /* end main loop */
   if (rc == -1)
@@ -1562,6 +2327,15 @@ keyring_rebuild_cache (ctrl_t ctrl, void *token, int noisy)
       goto leave;
     }
 
+  if (tmpfp)
+    {
+      rc = rebuild_cache_flush (ctrl, tmpfp, batch, nbatch,
+                                &count, &sigcount, noisy);
+      nbatch = 0;
+      if (rc)
+        goto leave;
+    }
+
   if (noisy || opt.verbose)
     {
       log_info (ngettext("%lu key cached",
@@ -1594,6 +2368,8 @@ keyring_rebuild_cache (ctrl_t ctrl, void *token, int noisy)
   xfree (tmpfilename);
   xfree (bakfilename);
   release_kbnode (keyblock);
+  while (nbatch)
+    release_kbnode (batch[--nbatch]);
   keyring_lock (hd, 0);
   keyring_release (hd);
   return rc;
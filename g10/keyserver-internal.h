@@ -60,5 +60,11 @@ int keyserver_import_mbox (ctrl_t ctrl, const char *mbox,
                            struct keyserver_spec *keyserver);
 int keyserver_import_ldap (ctrl_t ctrl, const char *name,
                            unsigned char **fpr,size_t *fpr_len);
+gpg_error_t keyserver_prefetch_cert (ctrl_t ctrl, const char *name,
+                                     int dane_mode);
+gpg_error_t keyserver_prefetch_wkd (ctrl_t ctrl, const char *name,
+                                    unsigned int flags);
+gpg_error_t keyserver_prefetch_mbox (ctrl_t ctrl, const char *mbox,
+                                     struct keyserver_spec *keyserver);
 
 #endif /* !_KEYSERVER_INTERNAL_H_ */
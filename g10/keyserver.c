@@ -88,6 +88,8 @@ static struct parse_options keyserver_opts[]=
     {"max-cert-size",0,NULL,NULL},  /* MUST be the first in this array! */
     {"http-proxy", KEYSERVER_HTTP_PROXY, NULL, /* MUST be the second!  */
      N_("override proxy options set for dirmngr")},
+    {"max-results", 0, NULL,                   /* MUST be the third!  */
+     N_("limit the number of keys shown by a search")},
 
     {"include-revoked",0,NULL,N_("include revoked keys in search results")},
     {"include-subkeys",0,NULL,N_("include subkeys when searching by key ID")},
@@ -116,6 +118,9 @@ static gpg_error_t keyserver_put (ctrl_t ctrl, strlist_t keyspecs);
 
 static size_t max_cert_size=DEFAULT_MAX_CERT_SIZE;
 
+/* The maximum number of keys requested by a search; 0 for no limit.  */
+static unsigned int max_search_results;
+
 
 static void
 warn_kshelper_option(char *option, int noisy)
@@ -144,9 +149,11 @@ parse_keyserver_options(char *options)
   int ret=1;
   char *tok;
   char *max_cert=NULL;
+  char *max_results=NULL;
 
   keyserver_opts[0].value=&max_cert;
   keyserver_opts[1].value=&opt.keyserver_options.http_proxy;
+  keyserver_opts[2].value=&max_results;
 
   while((tok=optsep(&options)))
     {
@@ -175,6 +182,9 @@ parse_keyserver_options(char *options)
 	max_cert_size=DEFAULT_MAX_CERT_SIZE;
     }
 
+  if(max_results)
+    max_search_results=strtoul(max_results,(char **)NULL,10);
+
   return ret;
 }
 
@@ -945,6 +955,30 @@ keyserver_any_configured (ctrl_t ctrl)
 }
 
 
+/* Start the keyserver lookup done by keyserver_import_mbox for MBOX
+ * and KEYSERVER in the background.  */
+gpg_error_t
+keyserver_prefetch_mbox (ctrl_t ctrl, const char *mbox,
+                         struct keyserver_spec *keyserver)
+{
+  gpg_error_t err;
+  char *pattern[2];
+
+  /* See keyserver_get_chunk for the pattern.  */
+  if (*mbox == '<')
+    pattern[0] = xtrystrdup (mbox);
+  else
+    pattern[0] = strconcat ("<", mbox, ">", NULL);
+  if (!pattern[0])
+    return gpg_error_from_syserror ();
+  pattern[1] = NULL;
+
+  err = gpg_dirmngr_prefetch_ks_get (ctrl, pattern, keyserver, 0);
+  xfree (pattern[0]);
+  return err;
+}
+
+
 /* Import all keys that exactly match MBOX */
 int
 keyserver_import_mbox (ctrl_t ctrl, const char *mbox,
@@ -1280,6 +1314,7 @@ keyserver_search (ctrl_t ctrl, strlist_t tokens)
   gpg_error_t err;
   char *searchstr;
   struct search_line_handler_parm_s parm;
+  unsigned long long tstart;
 
   memset (&parm, 0, sizeof parm);
 
@@ -1310,7 +1345,10 @@ keyserver_search (ctrl_t ctrl, strlist_t tokens)
   if (searchstr)
     parm.searchstr_disp = utf8_to_native (searchstr, strlen (searchstr), 0);
 
-  err = gpg_dirmngr_ks_search (ctrl, searchstr, search_line_handler, &parm);
+  tstart = trace_begin ();
+  err = gpg_dirmngr_ks_search (ctrl, searchstr, max_search_results,
+                               search_line_handler, &parm);
+  trace_end ("ks_search", tstart);
 
   if (parm.not_found || gpg_err_code (err) == GPG_ERR_NO_DATA)
     {
@@ -1355,6 +1393,7 @@ keyserver_get_chunk (ctrl_t ctrl, KEYDB_SEARCH_DESC *desc, int ndesc,
   size_t linelen;  /* Estimated linelen for KS_GET.  */
   size_t n;
   int only_fprs;
+  unsigned long long tstart;
 
 #define MAX_KS_GET_LINELEN 950  /* Somewhat lower than the real limit.  */
 
@@ -1491,8 +1530,10 @@ keyserver_get_chunk (ctrl_t ctrl, KEYDB_SEARCH_DESC *desc, int ndesc,
 
   only_fprs = (npat && npat == npat_fpr);
 
+  tstart = trace_begin ();
   err = gpg_dirmngr_ks_get (ctrl, pattern, override_keyserver, flags,
                             &datastream, &source);
+  trace_end ("ks_get", tstart);
   for (idx=0; idx < npat; idx++)
     xfree (pattern[idx]);
   xfree (pattern);
@@ -1705,6 +1746,39 @@ keyserver_fetch (ctrl_t ctrl, strlist_t urilist, int origin)
 }
 
 
+/* Return the name used for the DNS CERT lookup of the mail address
+ * NAME.  */
+static char *
+cert_lookup_name (const char *name, int dane_mode)
+{
+  char *look, *domain;
+
+  look = xstrdup (name);
+  if (!dane_mode)
+    {
+      domain = strrchr (look, '@');
+      if (domain)
+        *domain = '.';
+    }
+  return look;
+}
+
+
+/* Start the lookup done by keyserver_import_cert in the
+ * background.  */
+gpg_error_t
+keyserver_prefetch_cert (ctrl_t ctrl, const char *name, int dane_mode)
+{
+  gpg_error_t err;
+  char *look;
+
+  look = cert_lookup_name (name, dane_mode);
+  err = gpg_dirmngr_prefetch_dns_cert (ctrl, look, dane_mode? NULL : "*");
+  xfree (look);
+  return err;
+}
+
+
 /* Import key in a CERT or pointed to by a CERT.  In DANE_MODE fetch
    the certificate using the DANE method.  */
 int
@@ -1714,18 +1788,14 @@ keyserver_import_cert (ctrl_t ctrl, const char *name, int dane_mode,
   gpg_error_t err;
   char *look,*url;
   estream_t key;
+  unsigned long long tstart;
 
-  look = xstrdup(name);
-
-  if (!dane_mode)
-    {
-      char *domain = strrchr (look,'@');
-      if (domain)
-        *domain='.';
-    }
+  look = cert_lookup_name (name, dane_mode);
 
+  tstart = trace_begin ();
   err = gpg_dirmngr_dns_cert (ctrl, look, dane_mode? NULL : "*",
                               &key, fpr, fpr_len, &url);
+  trace_end ("dns_cert", tstart);
   if (err)
     ;
   else if (key)
@@ -1807,6 +1877,27 @@ keyserver_import_cert (ctrl_t ctrl, const char *name, int dane_mode,
 }
 
 
+/* Start the lookup done by keyserver_import_wkd in the background.  */
+gpg_error_t
+keyserver_prefetch_wkd (ctrl_t ctrl, const char *name, unsigned int flags)
+{
+  gpg_error_t err;
+  char *mbox;
+
+  mbox = mailbox_from_userid (name, 0);
+  if (!mbox)
+    {
+      err = gpg_error_from_syserror ();
+      if (gpg_err_code (err) == GPG_ERR_EINVAL)
+        err = gpg_error (GPG_ERR_INV_USER_ID);
+      return err;
+    }
+  err = gpg_dirmngr_prefetch_wkd_get (ctrl, mbox, flags);
+  xfree (mbox);
+  return err;
+}
+
+
 /* Import a key using the Web Key Directory protocol.  */
 gpg_error_t
 keyserver_import_wkd (ctrl_t ctrl, const char *name, unsigned int flags,
@@ -1816,6 +1907,7 @@ keyserver_import_wkd (ctrl_t ctrl, const char *name, unsigned int flags,
   char *mbox;
   estream_t key;
   char *url = NULL;
+  unsigned long long tstart;
 
   /* We want to work on the mbox.  That is what dirmngr will do anyway
    * and we need the mbox for the import filter anyway.  */
@@ -1828,7 +1920,9 @@ keyserver_import_wkd (ctrl_t ctrl, const char *name, unsigned int flags,
       return err;
     }
 
+  tstart = trace_begin ();
   err = gpg_dirmngr_wkd_get (ctrl, mbox, flags, &key, &url);
+  trace_end ("wkd_get", tstart);
   if (err)
     ;
   else if (key)
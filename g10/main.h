@@ -100,6 +100,11 @@ void print_further_info (const char *format, ...) GPGRT_ATTR_PRINTF(1,2);
 void additional_weak_digest (const char* digestname);
 int  is_weak_digest (digest_algo_t algo);
 
+/*-- trace.c --*/
+unsigned long long trace_begin (void);
+void trace_end (const char *name, unsigned long long start);
+void trace_close (void);
+
 /*-- armor.c --*/
 char *make_radix64_string( const byte *data, size_t len );
 
@@ -200,6 +205,7 @@ unsigned int ecdsa_qbits_from_Q (unsigned int qbits);
 /*-- cpr.c --*/
 void set_status_fd ( int fd );
 int  is_status_enabled ( void );
+void flush_status_fd (void);
 void write_status ( int no );
 void write_status_error (const char *where, gpg_error_t err);
 void write_status_errcode (const char *where, int errcode);
@@ -256,12 +262,18 @@ int write_pubkey_enc (ctrl_t ctrl, PKT_public_key *pk, int throw_keyid,
 /*-- sign.c --*/
 int sign_file (ctrl_t ctrl, strlist_t filenames, int detached, strlist_t locusr,
 	       int do_encrypt, strlist_t remusr, const char *outfile );
+int sign_file_fd (ctrl_t ctrl, int inp_fd, int out_fd, int detached,
+                  strlist_t locusr);
 int clearsign_file (ctrl_t ctrl,
                     const char *fname, strlist_t locusr, const char *outfile);
 int sign_symencrypt_file (ctrl_t ctrl, const char *fname, strlist_t locusr);
 
 /*-- sig-check.c --*/
 void sig_check_dump_stats (void);
+void sig_check_prefetch (ctrl_t ctrl, kbnode_t *keyblocks, int nkeyblocks,
+                         PKT_public_key **signers, int nsigners,
+                         int nthreads);
+void sig_check_prefetch_release (void);
 
 /* SIG is a revocation signature.  Check if any of PK's designated
    revokers generated it.  If so, return 0.  Note: this function
@@ -492,6 +504,7 @@ void print_key_line (ctrl_t ctrl, estream_t fp, PKT_public_key *pk, int secret);
 void print_file_status( int status, const char *name, int what );
 int verify_signatures (ctrl_t ctrl, int nfiles, char **files );
 int verify_files (ctrl_t ctrl, int nfiles, char **files );
+int verify_files_batch (ctrl_t ctrl, int nfiles, char **files);
 int gpg_verify (ctrl_t ctrl, int sig_fd, int data_fd, estream_t out_fp);
 void check_assert_signer_list (const char *mainpkhex, const char *pkhex);
 
@@ -501,9 +514,9 @@ gpg_error_t decrypt_message_fd (ctrl_t ctrl, int input_fd, int output_fd);
 void decrypt_messages (ctrl_t ctrl, int nfiles, char *files[]);
 
 /*-- plaintext.c --*/
-int hash_datafiles( gcry_md_hd_t md, gcry_md_hd_t md2,
+int hash_datafiles( md_filter_context_t *mfx,
 		    strlist_t files, const char *sigfilename, int textmode);
-int hash_datafile_by_fd ( gcry_md_hd_t md, gcry_md_hd_t md2, int data_fd,
+int hash_datafile_by_fd ( md_filter_context_t *mfx, int data_fd,
                           int textmode );
 PKT_plaintext *setup_plaintext_name(const char *filename,IOBUF iobuf);
 
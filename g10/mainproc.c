@@ -760,8 +760,7 @@ proc_encrypted (CTX c, PACKET *pkt)
           memset (pk, 0, sizeof *pk);
           pk->pubkey_algo = i->pubkey_algo;
           if (!get_pubkey (c->ctrl, pk, i->keyid)
-              && !gnupg_pk_is_compliant (CO_DE_VS, pk->pubkey_algo, 0,
-                                         pk->pkey, nbits_from_pk (pk), NULL))
+              && !pk_is_compliant (pk, CO_DE_VS))
             compliant = 0;
           release_public_key_parts (pk);
         }
@@ -1180,7 +1179,7 @@ do_check_sig (CTX c, kbnode_t node, const void *extrahash, size_t extrahashlen,
     {
       if (c->mfx.md)
         {
-          if (gcry_md_copy (&md, c->mfx.md ))
+          if (md_filter_copy_md (&c->mfx, map_md_openpgp_to_gcry (algo), &md))
             BUG ();
         }
       else /* detached signature */
@@ -1196,7 +1195,7 @@ do_check_sig (CTX c, kbnode_t node, const void *extrahash, size_t extrahashlen,
          in canonical mode ??? (calculating both modes???) */
       if (c->mfx.md)
         {
-          if (gcry_md_copy (&md, c->mfx.md ))
+          if (md_filter_copy_md (&c->mfx, map_md_openpgp_to_gcry (algo), &md))
             BUG ();
           if (c->mfx.md2 && gcry_md_copy (&md2, c->mfx.md2))
             BUG ();
@@ -1494,12 +1493,14 @@ proc_packets (ctrl_t ctrl, void *anchor, iobuf_t a )
 {
   int rc;
   CTX c = xmalloc_clear (sizeof *c);
+  unsigned long long tstart = trace_begin ();
 
   c->ctrl = ctrl;
   c->anchor = anchor;
   rc = do_proc_packets (c, a);
   xfree (c);
 
+  trace_end ("proc_packets", tstart);
   return rc;
 }
 
@@ -2436,8 +2437,7 @@ check_sig_and_print (CTX c, kbnode_t node)
 
       /* Print compliance warning for Good signatures.  */
       if (!rc && pk && !opt.quiet
-          && !gnupg_pk_is_compliant (opt.compliance, pk->pubkey_algo, 0,
-                                     pk->pkey, nbits_from_pk (pk), NULL))
+          && !pk_is_compliant (pk, opt.compliance))
         {
           log_info (_("WARNING: This key is not suitable for signing"
                       " in %s mode\n"),
@@ -2521,8 +2521,7 @@ check_sig_and_print (CTX c, kbnode_t node)
       /* Compute compliance with CO_DE_VS.  */
       if (pk
           && gnupg_gcrypt_is_compliant (CO_DE_VS)
-          && gnupg_pk_is_compliant (CO_DE_VS, pk->pubkey_algo, 0, pk->pkey,
-                                    nbits_from_pk (pk), NULL)
+          && pk_is_compliant (pk, CO_DE_VS)
           && gnupg_digest_is_compliant (CO_DE_VS, sig->digest_algo))
         write_status_strings (STATUS_VERIFICATION_COMPLIANCE_MODE,
                               gnupg_status_compliance_flag (CO_DE_VS),
@@ -2542,7 +2541,7 @@ check_sig_and_print (CTX c, kbnode_t node)
       release_kbnode( keyblock );
       if (rc)
         g10_errors_seen = 1;
-      if (opt.batch && rc)
+      if (opt.batch && rc && !c->ctrl->no_exit_on_bad_sig)
         g10_exit (1);
     }
   else  /* Error checking the signature. (neither Good nor Bad).  */
@@ -2621,7 +2620,7 @@ proc_tree (CTX c, kbnode_t node)
           /* Fixme: why looking for the signature packet and not the
              one-pass packet?  */
           for (n1 = node; (n1 = find_next_kbnode (n1, PKT_SIGNATURE));)
-            gcry_md_enable (c->mfx.md, n1->pkt->pkt.signature->digest_algo);
+            md_filter_enable (&c->mfx, n1->pkt->pkt.signature->digest_algo);
 
           if (n1 && n1->pkt->pkt.onepass_sig->sig_class == 0x01)
             use_textmode = 1;
@@ -2630,18 +2629,18 @@ proc_tree (CTX c, kbnode_t node)
           if (c->sigs_only)
             {
               if (c->signed_data.used && c->signed_data.data_fd != -1)
-                rc = hash_datafile_by_fd (c->mfx.md, NULL,
+                rc = hash_datafile_by_fd (&c->mfx,
                                           c->signed_data.data_fd,
                                           use_textmode);
               else
-                rc = hash_datafiles (c->mfx.md, NULL,
+                rc = hash_datafiles (&c->mfx,
                                      c->signed_data.data_names,
                                      c->sigfilename,
                                      use_textmode);
 	    }
           else
             {
-              rc = ask_for_detached_datafile (c->mfx.md, NULL,
+              rc = ask_for_detached_datafile (&c->mfx,
                                               iobuf_get_real_fname (c->iobuf),
                                               use_textmode);
 	    }
@@ -2723,9 +2722,10 @@ proc_tree (CTX c, kbnode_t node)
         {
           /* Detached signature */
           free_md_filter_context (&c->mfx);
-          rc = gcry_md_open (&c->mfx.md, sig->digest_algo, 0);
+          rc = gcry_md_open (&c->mfx.md, 0, 0);
           if (rc)
             goto detached_hash_err;
+          md_filter_enable (&c->mfx, sig->digest_algo);
 
           if (multiple_ok)
             {
@@ -2733,9 +2733,9 @@ proc_tree (CTX c, kbnode_t node)
                * need to enable all hash algorithms for the context.  */
               for (n1 = node; (n1 = find_next_kbnode (n1, PKT_SIGNATURE)); )
                 if (!openpgp_md_test_algo (n1->pkt->pkt.signature->digest_algo))
-                  gcry_md_enable (c->mfx.md,
-                                  map_md_openpgp_to_gcry
-                                  (n1->pkt->pkt.signature->digest_algo));
+                  md_filter_enable (&c->mfx,
+                                    map_md_openpgp_to_gcry
+                                    (n1->pkt->pkt.signature->digest_algo));
             }
 
           if (RFC2440 || RFC4880)
@@ -2773,18 +2773,18 @@ proc_tree (CTX c, kbnode_t node)
           if (c->sigs_only)
             {
               if (c->signed_data.used && c->signed_data.data_fd != -1)
-                rc = hash_datafile_by_fd (c->mfx.md, c->mfx.md2,
+                rc = hash_datafile_by_fd (&c->mfx,
                                           c->signed_data.data_fd,
                                           (sig->sig_class == 0x01));
               else
-                rc = hash_datafiles (c->mfx.md, c->mfx.md2,
+                rc = hash_datafiles (&c->mfx,
                                      c->signed_data.data_names,
                                      c->sigfilename,
                                      (sig->sig_class == 0x01));
 	    }
           else
             {
-              rc = ask_for_detached_datafile (c->mfx.md, c->mfx.md2,
+              rc = ask_for_detached_datafile (&c->mfx,
                                               iobuf_get_real_fname(c->iobuf),
                                               (sig->sig_class == 0x01));
 	    }
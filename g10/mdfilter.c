@@ -22,14 +22,29 @@
 #include <stdlib.h>
 #include <string.h>
 #include <errno.h>
+#include <npth.h>
 
 #include "gpg.h"
 #include "../common/status.h"
 #include "../common/iobuf.h"
 #include "../common/util.h"
+#include "options.h"
 #include "filter.h"
 
 
+/* Buffers shorter than this are hashed sequentially because starting
+ * the threads would cost more than we gain.  */
+#define HASH_THREAD_MINLEN 16384
+
+/* A job for hash_job_thread.  */
+struct hash_job_s
+{
+  gcry_md_hd_t md;
+  const void *buf;
+  size_t len;
+};
+
+
 
 /****************
  * This filter is used to collect a message digest
@@ -48,7 +63,7 @@ md_filter( void *opaque, int control,
 	i = iobuf_read( a, buf, size );
 	if( i == -1 ) i = 0;
 	if( i ) {
-	    gcry_md_write(mfx->md, buf, i );
+	    md_filter_write (mfx, buf, i);
 	    if( mfx->md2 )
 		gcry_md_write(mfx->md2, buf, i );
 	}
@@ -65,9 +80,121 @@ md_filter( void *opaque, int control,
 void
 free_md_filter_context( md_filter_context_t *mfx )
 {
+    int i;
+
     gcry_md_close(mfx->md);
     gcry_md_close(mfx->md2);
+    for (i=0; i < mfx->nxmd; i++)
+        gcry_md_close (mfx->xmd[i]);
     mfx->md = NULL;
     mfx->md2 = NULL;
+    mfx->nxmd = 0;
     mfx->maxbuf_size = 0;
 }
+
+
+/* Enable the digest algorithm ALGO for MFX->MD.  In addition a
+ * separate hash context for ALGO is opened.  If more than one
+ * algorithm is enabled this way, md_filter_write hashes the data with
+ * one thread per algorithm into these contexts and MD itself is not
+ * updated.  The contexts must thus be retrieved with
+ * md_filter_copy_md.  Do not mix this with direct calls to
+ * gcry_md_enable or gcry_md_write for MD.  */
+void
+md_filter_enable (md_filter_context_t *mfx, int algo)
+{
+  int i;
+
+  if (gcry_md_is_enabled (mfx->md, algo))
+    return;
+  gcry_md_enable (mfx->md, algo);
+
+  /* Debug output is only available for MD.  */
+  if (mfx->nxmd < 0 || DBG_HASHING)
+    goto fallback;
+  if (mfx->nxmd >= MAX_HASH_THREADS
+      || gcry_md_open (&mfx->xmd[mfx->nxmd], algo, 0))
+    goto fallback;
+  mfx->nxmd++;
+  return;
+
+ fallback:
+  /* We can't provide a separate context for all algorithms.  */
+  for (i=0; i < mfx->nxmd; i++)
+    gcry_md_close (mfx->xmd[i]);
+  mfx->nxmd = -1;
+}
+
+
+/* Hash one buffer in its own thread.  The actual hashing is done
+ * outside of the nPth lock so that several jobs run concurrently.  */
+static void *
+hash_job_thread (void *opaque)
+{
+  struct hash_job_s *job = opaque;
+
+  npth_unprotect ();
+  gcry_md_write (job->md, job->buf, job->len);
+  npth_protect ();
+  return NULL;
+}
+
+
+/* Hash (BUF,LEN) into the context of MFX.  Note that MFX->MD2 is not
+ * updated.  */
+void
+md_filter_write (md_filter_context_t *mfx, const void *buf, size_t len)
+{
+  struct hash_job_s jobs[MAX_HASH_THREADS];
+  npth_t threads[MAX_HASH_THREADS];
+  int started[MAX_HASH_THREADS];
+  npth_attr_t tattr;
+  int i;
+
+  if (mfx->nxmd < 2)
+    {
+      if (mfx->md)
+        gcry_md_write (mfx->md, buf, len);
+      return;
+    }
+
+  if (len < HASH_THREAD_MINLEN)
+    {
+      for (i=0; i < mfx->nxmd; i++)
+        gcry_md_write (mfx->xmd[i], buf, len);
+      return;
+    }
+
+  npth_attr_init (&tattr);
+  npth_attr_setdetachstate (&tattr, NPTH_CREATE_JOINABLE);
+  for (i=0; i < mfx->nxmd; i++)
+    {
+      jobs[i].md = mfx->xmd[i];
+      jobs[i].buf = buf;
+      jobs[i].len = len;
+      started[i] = !npth_create (&threads[i], &tattr,
+                                 hash_job_thread, jobs + i);
+      if (!started[i])
+        hash_job_thread (jobs + i);  /* Fallback to the current thread.  */
+    }
+  npth_attr_destroy (&tattr);
+
+  for (i=0; i < mfx->nxmd; i++)
+    if (started[i])
+      npth_join (threads[i], NULL);
+}
+
+
+/* Store a copy of the hash context used for ALGO at R_MD.  */
+gpg_error_t
+md_filter_copy_md (md_filter_context_t *mfx, int algo, gcry_md_hd_t *r_md)
+{
+  int i;
+
+  if (mfx->nxmd > 1)
+    for (i=0; i < mfx->nxmd; i++)
+      if (gcry_md_is_enabled (mfx->xmd[i], algo))
+        return gcry_md_copy (r_md, mfx->xmd[i]);
+
+  return gcry_md_copy (r_md, mfx->md);
+}
@@ -25,6 +25,7 @@
 
 #include "gpg.h"
 #include "../common/util.h"
+#include "../common/host2net.h"
 #include "packet.h"
 #include "keydb.h"
 #include "options.h"
@@ -38,6 +39,15 @@
 #define NO_OF_KEY_ITEM_BUCKETS    383
 #define MAX_KEY_ITEMS_PER_BUCKET  20
 
+/* The tables are grown if the average number of items per bucket
+ * exceeds the load factor.  The tables are never grown beyond the
+ * given maximum number of buckets; if that limit has been reached
+ * the above thresholds are used to purge items.  */
+#define UID_TABLE_LOAD_FACTOR     4
+#define MAX_UID_ITEM_BUCKETS      (1024*1024)
+#define KEY_TABLE_LOAD_FACTOR     4
+#define MAX_KEY_ITEM_BUCKETS      (1024*1024)
+
 
 /* An object to store a user id.  This describes an item in the linked
  * lists of a bucket in hash table.  The reference count will
@@ -55,6 +65,8 @@ static size_t uid_table_size; /* Number of allocated buckets.   */
 static unsigned int uid_table_max;    /* Max. # of items in a bucket.  */
 static unsigned int uid_table_added;  /* # of items added.   */
 static unsigned int uid_table_dropped;/* # of items dropped.  */
+static unsigned int uid_table_count;  /* # of items in the table.  */
+static unsigned int uid_table_grown;  /* # of times the table grew.  */
 
 
 /* An object to store properties of a key.  Note that this can be used
@@ -63,6 +75,7 @@ static unsigned int uid_table_dropped;/* # of items dropped.  */
 typedef struct key_item_s
 {
   struct key_item_s *next;
+  struct key_item_s *fpr_next;  /* Next item in the FPR_TABLE bucket.  */
   unsigned int usecount;
   byte fprlen;
   char fpr[MAX_FINGERPRINT_LEN];
@@ -71,10 +84,13 @@ typedef struct key_item_s
 } *key_item_t;
 
 static key_item_t *key_table; /* Hash table with the keys.      */
+static key_item_t *fpr_table; /* Same items indexed by the fpr.  */
 static size_t key_table_size; /* Number of allocated buckents.  */
 static unsigned int key_table_max;    /* Max. # of items in a bucket.  */
 static unsigned int key_table_added;  /* # of items added.   */
 static unsigned int key_table_dropped;/* # of items dropped.  */
+static unsigned int key_table_count;  /* # of items in the table.  */
+static unsigned int key_table_grown;  /* # of times the table grew.  */
 static key_item_t key_item_attic;     /* List of freed items.  */
 
 
@@ -113,10 +129,10 @@ objcache_dump_stats (void)
   for (attic=0, ki = key_item_attic; ki; ki = ki->next)
     attic++;
   log_info ("objcache: keys=%u/%u/%u chains=%u,%d..%d buckets=%zu/%u"
-            " attic=%u\n",
+            " grown=%u attic=%u\n",
             count, key_table_added, key_table_dropped,
             empty, minlen > 0? minlen : 0, maxlen,
-            key_table_size, key_table_max, attic);
+            key_table_size, key_table_max, key_table_grown, attic);
 
   count = empty = 0;
   minlen = -1;
@@ -139,18 +155,20 @@ objcache_dump_stats (void)
       else if (minlen == -1 || len < minlen)
         minlen = len;
     }
-  log_info ("objcache: uids=%u/%u/%u chains=%u,%d..%d buckets=%zu/%u\n",
+  log_info ("objcache: uids=%u/%u/%u chains=%u,%d..%d buckets=%zu/%u"
+            " grown=%u\n",
             count, uid_table_added, uid_table_dropped,
             empty, minlen > 0? minlen : 0, maxlen,
-            uid_table_size, uid_table_max);
+            uid_table_size, uid_table_max, uid_table_grown);
 }
 
 
 
-/* The hash function we use for the uid_table.  Must not call a system
- * function.  */
+/* The hash function we use for the uid_table.  Returns the hash
+ * value which needs to be reduced to the table size.  Must not call a
+ * system function.  */
 static inline unsigned int
-uid_table_hasher (const char *name, unsigned namelen)
+uid_hash_value (const char *name, unsigned namelen)
 {
   const unsigned char *s = (const unsigned char*)name;
   unsigned int hashval = 0;
@@ -166,7 +184,15 @@ uid_table_hasher (const char *name, unsigned namelen)
         }
     }
 
-  return hashval % uid_table_size;
+  return hashval;
+}
+
+
+/* Return the bucket of the uid_table for (NAME,NAMELEN).  */
+static inline unsigned int
+uid_table_hasher (const char *name, unsigned namelen)
+{
+  return uid_hash_value (name, namelen) % uid_table_size;
 }
 
 
@@ -183,6 +209,50 @@ uid_table_init (void)
 }
 
 
+/* Grow the uid table if its load factor has been exceeded.  On
+ * malloc failure the table is kept; after all it is just a cache.  */
+static void
+uid_table_grow (void)
+{
+  uid_item_t *newtable, *oldtable, ui, ui_next;
+  size_t newsize, oldsize, idx;
+  unsigned int hash;
+
+  oldsize = uid_table_size;
+  if (oldsize >= MAX_UID_ITEM_BUCKETS
+      || uid_table_count < oldsize * UID_TABLE_LOAD_FACTOR)
+    return;
+
+  newsize = 2 * oldsize + 1;
+  newtable = xtrycalloc (newsize, sizeof *newtable);
+  if (!newtable)
+    return;
+  if (uid_table_size != oldsize)
+    {
+      /* Another thread grew the table during the malloc.  */
+      xfree (newtable);
+      return;
+    }
+
+  /* No syscalls from here .. */
+  oldtable = uid_table;
+  for (idx = 0; idx < oldsize; idx++)
+    for (ui = oldtable[idx]; ui; ui = ui_next)
+      {
+        ui_next = ui->next;
+        hash = uid_hash_value (ui->name, ui->namelen) % newsize;
+        ui->next = newtable[hash];
+        newtable[hash] = ui;
+      }
+  uid_table = newtable;
+  uid_table_size = newsize;
+  uid_table_grown++;
+  /* ... to here */
+
+  xfree (oldtable);
+}
+
+
 static uid_item_t
 uid_item_ref (uid_item_t ui)
 {
@@ -220,6 +290,8 @@ uid_table_put (const char *name, unsigned int namelen)
 
   if (!uid_table)
     uid_table_init ();
+  else
+    uid_table_grow ();
 
   hash = uid_table_hasher (name, namelen);
   for (ui = uid_table[hash], count = 0; ui; ui = ui->next, count++)
@@ -262,6 +334,7 @@ uid_table_put (const char *name, unsigned int namelen)
           ui_next = ui->next;
           xfree (ui);
           uid_table_dropped++;
+          uid_table_count--;
         }
     }
 
@@ -291,6 +364,7 @@ uid_table_put (const char *name, unsigned int namelen)
   ui->next = uid_table[hash];
   uid_table[hash] = ui;
   uid_table_added++;
+  uid_table_count++;
   return ui;
 }
 
@@ -310,6 +384,18 @@ key_table_hasher (u32 *keyid)
 }
 
 
+/* The hash function we use for the fpr_table which has the same size
+ * as the key_table.  Must not call a system function.  */
+static inline unsigned int
+fpr_table_hasher (const byte *fpr, size_t size)
+{
+  /* The keyid is taken from the end of a v4 fingerprint and from the
+   * start of a v5 fingerprint.  We use the first 4 bytes which are
+   * for v4 distinct from keyid[0] used for the key_table.  */
+  return buf32_to_uint (fpr) % size;
+}
+
+
 /* Run time allocation of the key table.  This allows us to eventually
  * add an option to gpg to control the size.  */
 static void
@@ -320,6 +406,89 @@ key_table_init (void)
   key_table_size = NO_OF_KEY_ITEM_BUCKETS;
   key_table_max  = MAX_KEY_ITEMS_PER_BUCKET;
   key_table = xcalloc (key_table_size, sizeof *key_table);
+  fpr_table = xcalloc (key_table_size, sizeof *fpr_table);
+}
+
+
+/* Grow the key table and the fpr table if the load factor has been
+ * exceeded.  On malloc failure the tables are kept.  */
+static void
+key_table_grow (void)
+{
+  key_item_t *newtable, *newfprtable, *oldtable, *oldfprtable;
+  key_item_t ki, ki_next;
+  size_t newsize, oldsize, idx;
+  unsigned int hash;
+
+  oldsize = key_table_size;
+  if (oldsize >= MAX_KEY_ITEM_BUCKETS
+      || key_table_count < oldsize * KEY_TABLE_LOAD_FACTOR)
+    return;
+
+  newsize = 2 * oldsize + 1;
+  newtable = xtrycalloc (newsize, sizeof *newtable);
+  newfprtable = newtable? xtrycalloc (newsize, sizeof *newfprtable) : NULL;
+  if (!newtable || !newfprtable || key_table_size != oldsize)
+    {
+      /* Out of core or another thread grew the tables meanwhile.  */
+      xfree (newtable);
+      xfree (newfprtable);
+      return;
+    }
+
+  /* No syscalls from here .. */
+  oldtable = key_table;
+  oldfprtable = fpr_table;
+  for (idx = 0; idx < oldsize; idx++)
+    for (ki = oldtable[idx]; ki; ki = ki_next)
+      {
+        ki_next = ki->next;
+        hash = ki->keyid[0] % newsize;
+        ki->next = newtable[hash];
+        newtable[hash] = ki;
+        hash = fpr_table_hasher (ki->fpr, newsize);
+        ki->fpr_next = newfprtable[hash];
+        newfprtable[hash] = ki;
+      }
+  key_table = newtable;
+  fpr_table = newfprtable;
+  key_table_size = newsize;
+  key_table_grown++;
+  /* ... to here */
+
+  xfree (oldtable);
+  xfree (oldfprtable);
+}
+
+
+/* Remove KI from the fpr_table.  */
+static void
+fpr_table_remove (key_item_t ki)
+{
+  key_item_t *kip;
+
+  for (kip = &fpr_table[fpr_table_hasher (ki->fpr, key_table_size)];
+       *kip; kip = &(*kip)->fpr_next)
+    if (*kip == ki)
+      {
+        *kip = ki->fpr_next;
+        break;
+      }
+  ki->fpr_next = NULL;
+}
+
+
+/* Return the key item for (FPR,FPRLEN) or NULL.  */
+static key_item_t
+fpr_table_get (const byte *fpr, size_t fprlen)
+{
+  key_item_t ki;
+
+  for (ki = fpr_table[fpr_table_hasher (fpr, key_table_size)];
+       ki; ki = ki->fpr_next)
+    if (ki->fprlen == fprlen && !memcmp (ki->fpr, fpr, fprlen))
+      return ki;
+  return NULL;
 }
 
 
@@ -328,6 +497,8 @@ key_item_free (key_item_t ki)
 {
   if (!ki)
     return;
+  fpr_table_remove (ki);
+  key_table_count--;
   uid_item_unref (ki->ui);
   ki->ui = NULL;
   ki->next = key_item_attic;
@@ -351,14 +522,9 @@ key_table_get (PKT_public_key *pk, u32 *keyid)
     {
       byte fpr[MAX_FINGERPRINT_LEN];
       size_t fprlen;
-      u32 tmpkeyid[2];
 
       fingerprint_from_pk (pk, fpr, &fprlen);
-      keyid_from_pk (pk, tmpkeyid);
-      hash = key_table_hasher (tmpkeyid);
-      for (ki = key_table[hash]; ki; ki = ki->next)
-        if (ki->fprlen == fprlen && !memcmp (ki->fpr, fpr, fprlen))
-          return ki; /* Found */
+      return fpr_table_get (fpr, fprlen);
     }
   else if (keyid)
     {
@@ -411,13 +577,16 @@ key_table_put (PKT_public_key *pk, uid_item_t ui)
 
   if (!key_table)
     key_table_init ();
+  else
+    key_table_grow ();
 
   fingerprint_from_pk (pk, fpr, &fprlen);
+  if ((ki = fpr_table_get (fpr, fprlen)))
+    return ki;  /* Found  */
   keyid_from_pk (pk, keyid);
   hash = key_table_hasher (keyid);
-  for (ki = key_table[hash], count=0; ki; ki = ki->next, count++)
-    if (ki->fprlen == fprlen && !memcmp (ki->fpr, fpr, fprlen))
-      return ki;  /* Found  */
+  for (ki = key_table[hash], count=0; ki; ki = ki->next)
+    count++;
 
   /* If the bucket is full remove a couple of items. */
   if (count >= key_table_max)
@@ -504,9 +673,9 @@ key_table_put (PKT_public_key *pk, uid_item_t ui)
 
       /* During the malloc another thread may have changed the bucket.
        * Thus we need to check again.  */
-      for (ki = key_table[hash]; ki; ki = ki->next)
-        if (ki->fprlen == fprlen && !memcmp (ki->fpr, fpr, fprlen))
-          return ki;  /* Found  */
+      if ((ki = fpr_table_get (fpr, fprlen)))
+        return ki;  /* Found  */
+      hash = key_table_hasher (keyid);
     }
 
   /* We now know that there is an item in the attic.  */
@@ -522,7 +691,11 @@ key_table_put (PKT_public_key *pk, uid_item_t ui)
   ki->usecount = 0;
   ki->next = key_table[hash];
   key_table[hash] = ki;
+  hash = fpr_table_hasher (fpr, key_table_size);
+  ki->fpr_next = fpr_table[hash];
+  fpr_table[hash] = ki;
   key_table_added++;
+  key_table_count++;
   return ki;
 }
 
@@ -605,6 +778,53 @@ cache_put_keyblock (kbnode_t keyblock)
 }
 
 
+/* Drop all items from the caches.  This is used if the database has
+ * been modified by another process and the cached data may thus be
+ * stale.  */
+void
+objcache_flush (void)
+{
+  unsigned int idx;
+  key_item_t ki, ki_next;
+  uid_item_t ui, ui_next, ui_prev;
+
+  for (idx = 0; idx < key_table_size; idx++)
+    {
+      ki = key_table[idx];
+      key_table[idx] = NULL;
+      fpr_table[idx] = NULL;
+      for (; ki; ki = ki_next)
+        {
+          ki_next = ki->next;
+          key_item_free (ki);
+          key_table_dropped++;
+        }
+    }
+
+  /* Now all user ids not used elsewhere are unrefed.  */
+  for (idx = 0; idx < uid_table_size; idx++)
+    {
+      ui_prev = NULL;
+      for (ui = uid_table[idx]; ui; ui = ui_next)
+        {
+          ui_next = ui->next;
+          if (ui->refcount)
+            {
+              ui_prev = ui;
+              continue;
+            }
+          if (ui_prev)
+            ui_prev->next = ui_next;
+          else
+            uid_table[idx] = ui_next;
+          xfree (ui);
+          uid_table_dropped++;
+          uid_table_count--;
+        }
+    }
+}
+
+
 /* Return the user id string for KEYID.  If a user id is not found (or
  * on malloc error) NULL is returned.  If R_LENGTH is not NULL the
  * length of the user id is stored there; this does not included the
@@ -652,8 +872,6 @@ char *
 cache_get_uid_byfpr (const byte *fpr, size_t fprlen, size_t *r_length)
 {
   char *p;
-  unsigned int hash;
-  u32 keyid[2];
   key_item_t ki;
 
   if (r_length)
@@ -662,12 +880,7 @@ cache_get_uid_byfpr (const byte *fpr, size_t fprlen, size_t *r_length)
   if (!key_table)
     return NULL;
 
-  keyid_from_fingerprint (NULL, fpr, fprlen, keyid);
-  hash = key_table_hasher (keyid);
-  for (ki = key_table[hash]; ki; ki = ki->next)
-    if (ki->fprlen == fprlen && !memcmp (ki->fpr, fpr, fprlen))
-      break; /* Found */
-
+  ki = fpr_table_get (fpr, fprlen);
   if (!ki)
     return NULL; /* Not found.  */
 
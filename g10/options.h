@@ -62,6 +62,32 @@ struct
   /* The AEAD chunk size expressed as a power of 2.  */
   int chunk_size;
 
+  /* The number of threads used to process AEAD chunks.  0 or 1
+   * selects the standard sequential code.  */
+  int aead_threads;
+
+  /* The number of threads used to verify the self-signatures on
+   * import.  0 or 1 selects the standard sequential code.  */
+  int import_threads;
+
+  /* The number of threads used to verify the certifications while
+   * checking the trustdb.  0 or 1 selects the standard sequential
+   * code.  */
+  int trustdb_threads;
+
+  /* The number of threads used to verify the key signatures of a
+   * keyblock for --check-signatures.  0 or 1 selects the standard
+   * sequential code.  */
+  int check_sigs_threads;
+
+  /* The number of threads used to encrypt the session key to the
+   * recipients.  0 or 1 selects the standard sequential code.  */
+  int encrypt_threads;
+
+  /* The maximum number of trustdb records kept in the cache.  0
+   * selects the default.  */
+  int trustdb_cache_size;
+
   int dry_run;
   int autostart;
   int list_only;
@@ -116,6 +142,8 @@ struct
 
   int def_cert_level;
   int min_cert_level;
+  int max_uid_sigs;       /* Max. number of third-party sigs kept per
+                             user ID when cleaning; 0 = no limit.  */
   int ask_cert_level;
   int emit_version;       /* 0 = none,
                              1 = major only,
@@ -231,6 +259,12 @@ struct
   /* If true, let write failures on the status-fd exit the process. */
   int exit_on_status_write_error;
 
+  /* If true, do not flush the status-fd after each line.  */
+  int status_buffered;
+
+  /* File to write the --debug trace events to.  */
+  const char *trace_file;
+
   /* If > 0, limit the number of card insertion prompts to this
      value. */
   int limit_card_insert_tries;
@@ -256,6 +290,8 @@ struct
     unsigned int disable_signer_uid:1;
     unsigned int include_key_block:1;
     unsigned int auto_key_import:1;
+    /* Run the auto-key-locate network mechanisms in parallel.  */
+    unsigned int akl_parallel:1;
     /* Flag to enable experimental features from RFC4880bis.  */
     unsigned int rfc4880bis:1;
     /* Hack: --output is not given but OUTFILE was temporary set to "-".  */
@@ -312,6 +348,8 @@ struct
 
   int no_symkey_cache;   /* Disable the cache used for --symmetric.  */
 
+  unsigned int key_cache_size; /* Max. # of keys in the pk cache or 0.  */
+
   int use_keyboxd;       /* Use the external keyboxd as storage backend.  */
 
   /* Compatibility flags (COMPAT_FLAG_xxxx).  */
@@ -350,6 +388,7 @@ struct {
 #define DBG_CLOCK_VALUE   4096
 #define DBG_LOOKUP_VALUE  8192	/* debug the key lookup */
 #define DBG_EXTPROG_VALUE 16384 /* debug external program calls */
+#define DBG_TRACE_VALUE   32768 /* write timing spans */
 
 /* Tests for the debugging flags.  */
 #define DBG_PACKET (opt.debug & DBG_PACKET_VALUE)
@@ -363,6 +402,7 @@ struct {
 #define DBG_CLOCK   (opt.debug & DBG_CLOCK_VALUE)
 #define DBG_LOOKUP  (opt.debug & DBG_LOOKUP_VALUE)
 #define DBG_EXTPROG (opt.debug & DBG_EXTPROG_VALUE)
+#define DBG_TRACE   (opt.debug & DBG_TRACE_VALUE)
 
 /* FIXME: We need to check why we did not put this into opt. */
 #define DBG_MEMORY    memory_debug_mode
@@ -406,6 +406,8 @@ typedef struct
   u32     keyid[2];
   /* Fingerprint of the key.  Only valid if FPRLEN is not 0.  */
   byte    fpr[MAX_FINGERPRINT_LEN];
+  /* Keygrip of the key.  Only valid if FLAGS.GRIP_VALID is set.  */
+  byte    grip[KEYGRIP_LEN];
   prefitem_t *prefs;      /* list of preferences (may be NULL) */
   struct
   {
@@ -425,6 +427,9 @@ typedef struct
     unsigned int backsig:2;       /* 0=none, 1=bad, 2=good.  */
     unsigned int serialno_valid:1;/* SERIALNO below is valid.  */
     unsigned int exact:1;         /* Found via exact (!) search.  */
+    unsigned int grip_valid:1;    /* GRIP above is valid.  */
+    unsigned int de_vs_valid:1;   /* The next flag is valid.  */
+    unsigned int de_vs:1;         /* Key is compliant with CO_DE_VS.  */
   } flags;
   PKT_user_id *user_id;   /* If != NULL: found by that uid. */
   struct revocation_key *revkey;
@@ -442,6 +447,10 @@ typedef struct
   /* If not NULL this malloced structure describes a secret key.
      (Serialized.)  */
   struct seckey_info *seckey_info;
+  /* If not NULL the public parameters, the preferences and the
+     revocation keys may be shared with other copies of this key.  See
+     share_public_key.  */
+  struct pk_shared_parts_s *shared;
   /* The public key.  Contains pubkey_get_npkey (pubkey_algo) +
      pubkey_get_nskey (pubkey_algo) MPIs.  (If pubkey_get_npkey
      returns 0, then the algorithm is not understood and the PKEY
@@ -880,6 +889,8 @@ struct notation *sig_to_notation(PKT_signature *sig);
 void free_notation(struct notation *notation);
 
 /*-- free-packet.c --*/
+PKT_signature *alloc_signature (void);
+PKT_public_key *alloc_public_key (void);
 void free_symkey_enc( PKT_symkey_enc *enc );
 void free_pubkey_enc( PKT_pubkey_enc *enc );
 void free_seckey_enc( PKT_signature *enc );
@@ -892,6 +903,7 @@ void free_packet (PACKET *pkt, parse_packet_ctx_t parsectx);
 prefitem_t *copy_prefs (const prefitem_t *prefs);
 PKT_public_key *copy_public_key_basics (PKT_public_key *d, PKT_public_key *s);
 PKT_public_key *copy_public_key( PKT_public_key *d, PKT_public_key *s );
+void share_public_key (PKT_public_key *pk);
 PKT_signature *copy_signature( PKT_signature *d, PKT_signature *s );
 PKT_user_id *scopy_user_id (PKT_user_id *sd );
 int cmp_public_keys( PKT_public_key *a, PKT_public_key *b );
@@ -934,7 +946,7 @@ gpg_error_t get_output_file (const byte *embedded_name, int embedded_namelen,
                              iobuf_t data, char **fnamep, estream_t *fpp);
 int handle_plaintext( PKT_plaintext *pt, md_filter_context_t *mfx,
 					int nooutput, int clearsig );
-int ask_for_detached_datafile( gcry_md_hd_t md, gcry_md_hd_t md2,
+int ask_for_detached_datafile( md_filter_context_t *mfx,
 			       const char *inname, int textmode );
 
 /*-- sign.c --*/
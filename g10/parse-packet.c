@@ -36,6 +36,7 @@
 #include "../common/i18n.h"
 #include "../common/host2net.h"
 #include "../common/mbox-util.h"
+#include "../common/hotpath.h"
 
 
 static int mpi_print_mode;
@@ -383,7 +384,8 @@ parse_packet (parse_packet_ctx_t ctx, PACKET *pkt)
 
   do
     {
-      rc = parse (ctx, pkt, 0, NULL, &skip, NULL, 0);
+      HOTPATH_COUNT ("parse_packet",
+                     rc = parse (ctx, pkt, 0, NULL, &skip, NULL, 0));
     }
   while (skip && ! rc);
   return rc;
@@ -876,7 +878,7 @@ parse (parse_packet_ctx_t ctx, PACKET *pkt, int onlykeypkts, off_t * retpos,
     case PKT_PUBLIC_SUBKEY:
     case PKT_SECRET_KEY:
     case PKT_SECRET_SUBKEY:
-      pkt->pkt.public_key = xmalloc_clear (sizeof *pkt->pkt.public_key);
+      pkt->pkt.public_key = alloc_public_key ();
       rc = parse_key (inp, pkttype, pktlen, hdr, hdrlen, pkt);
       break;
     case PKT_SYMKEY_ENC:
@@ -886,7 +888,7 @@ parse (parse_packet_ctx_t ctx, PACKET *pkt, int onlykeypkts, off_t * retpos,
       rc = parse_pubkeyenc (inp, pkttype, pktlen, pkt);
       break;
     case PKT_SIGNATURE:
-      pkt->pkt.signature = xmalloc_clear (sizeof *pkt->pkt.signature);
+      pkt->pkt.signature = alloc_signature ();
       rc = parse_signature (inp, pkttype, pktlen, pkt->pkt.signature);
       break;
     case PKT_ONEPASS_SIG:
@@ -2034,6 +2036,150 @@ parse_sig_subpkt2 (PKT_signature *sig, sigsubpkttype_t reqtype)
 }
 
 
+/* An index of a subpacket area.  For each type the offset of the
+ * data of the first subpacket with that type is recorded.  This is
+ * used by parse_signature to walk an area only once instead of once
+ * for each subpacket it looks at.  */
+struct subpkt_index_s
+{
+  const subpktarea_t *area;
+  unsigned int off[128];   /* Offset of the data or 0 if not seen.  */
+  size_t len[128];         /* Length of the data or -1 if invalid.  */
+  int bad_critical;        /* A critical subpacket we can't handle or
+                            * a corrupt area has been seen.  */
+};
+
+
+/* Build the index IDX for AREA.  The same checks as done by
+ * enum_sig_subpkt are applied.  */
+static void
+index_sig_subpkts (const subpktarea_t *area, struct subpkt_index_s *idx)
+{
+  const byte *buffer;
+  int buflen;
+  int type, critical;
+  size_t n = 0;
+
+  memset (idx, 0, sizeof *idx);
+  idx->area = area;
+  if (!area)
+    return;
+
+  buffer = area->data;
+  buflen = area->len;
+  while (buflen)
+    {
+      n = *buffer++;
+      buflen--;
+      if (n == 255) /* 4 byte length header.  */
+	{
+	  if (buflen < 4)
+	    goto too_short;
+	  n = buf32_to_size_t (buffer);
+	  buffer += 4;
+	  buflen -= 4;
+	}
+      else if (n >= 192) /* 4 byte special encoded length header.  */
+	{
+	  if (buflen < 2)
+	    goto too_short;
+	  n = ((n - 192) << 8) + *buffer + 192;
+	  buffer++;
+	  buflen--;
+	}
+      if (buflen < n)
+	goto too_short;
+      if (!buflen)
+        {
+          if (opt.verbose && !glo_ctrl.silence_parse_warnings)
+            log_info ("type octet missing in subpacket\n");
+          idx->bad_critical = 1;
+          return;
+        }
+      type = *buffer;
+      critical = !!(type & 0x80);
+      type &= 0x7f;
+
+      if (critical && !idx->bad_critical)
+        {
+          if (n - 1 > buflen + 1)
+            goto too_short;
+          if (!can_handle_critical (buffer + 1, n - 1, type))
+            {
+              if (opt.verbose && !glo_ctrl.silence_parse_warnings)
+                log_info (_("subpacket of type %d has "
+                            "critical bit set\n"), type);
+              idx->bad_critical = 1;
+            }
+        }
+
+      if (!idx->off[type])
+        {
+          idx->off[type] = buffer + 1 - area->data;
+          idx->len[type] = n? n - 1 : (size_t)(-1);
+        }
+      buffer += n;
+      buflen -= n;
+    }
+  return;
+
+ too_short:
+  if (opt.debug && !glo_ctrl.silence_parse_warnings)
+    {
+      es_fflush (es_stdout);
+      log_printhex (area->data, area->len > 16? 16 : area->len,
+                    "buffer shorter than subpacket (%zu/%d/%zu); dump:",
+                    area->len, buflen, n);
+    }
+  idx->bad_critical = 1;
+}
+
+
+/* Same as parse_sig_subpkt but using the index IDX.  */
+static const byte *
+indexed_sig_subpkt (struct subpkt_index_s *idx, sigsubpkttype_t reqtype,
+                    size_t *ret_n)
+{
+  const byte *buffer;
+  size_t n;
+  int offset;
+
+  if (!idx->off[reqtype] || idx->len[reqtype] == (size_t)(-1))
+    return NULL;
+
+  buffer = idx->area->data + idx->off[reqtype];
+  n = idx->len[reqtype];
+  if (ret_n)
+    *ret_n = n;
+  offset = parse_one_sig_subpkt (buffer, n, reqtype);
+  switch (offset)
+    {
+    case -2:
+      log_error ("subpacket of type %d too short\n", reqtype);
+      return NULL;
+    case -1:
+      return NULL;
+    default:
+      break;
+    }
+  return buffer + offset;
+}
+
+
+/* Same as parse_sig_subpkt2 but using the indices HIDX and UIDX.  */
+static const byte *
+indexed_sig_subpkt2 (struct subpkt_index_s *hidx,
+                     struct subpkt_index_s *uidx, sigsubpkttype_t reqtype)
+{
+  const byte *p;
+
+  p = indexed_sig_subpkt (hidx, reqtype, NULL);
+  if (!p)
+    p = indexed_sig_subpkt (uidx, reqtype, NULL);
+  return p;
+}
+
+
 /* Find all revocation keys.  Look in hashed area only.  */
 void
 parse_revkeys (PKT_signature * sig)
@@ -2207,14 +2353,20 @@ parse_signature (IOBUF inp, int pkttype, unsigned long pktlen,
     {
       const byte *p;
       size_t len;
+      struct subpkt_index_s subpkt_index[2];
+      struct subpkt_index_s *hidx = &subpkt_index[0];
+      struct subpkt_index_s *uidx = &subpkt_index[1];
+
+      /* Walk both areas only once.  */
+      index_sig_subpkts (sig->hashed, hidx);
+      index_sig_subpkts (sig->unhashed, uidx);
 
       /* Set sig->flags.unknown_critical if there is a critical bit
        * set for packets which we do not understand.  */
-      if (!parse_sig_subpkt (sig, 1, SIGSUBPKT_TEST_CRITICAL, NULL)
-	  || !parse_sig_subpkt (sig, 0, SIGSUBPKT_TEST_CRITICAL, NULL))
+      if (hidx->bad_critical || uidx->bad_critical)
 	sig->flags.unknown_critical = 1;
 
-      p = parse_sig_subpkt (sig, 1, SIGSUBPKT_SIG_CREATED, NULL);
+      p = indexed_sig_subpkt (hidx, SIGSUBPKT_SIG_CREATED, NULL);
       if (p)
 	sig->timestamp = buf32_to_u32 (p);
       else if (!(sig->pubkey_algo >= 100 && sig->pubkey_algo <= 110)
@@ -2224,7 +2376,7 @@ parse_signature (IOBUF inp, int pkttype, unsigned long pktlen,
       /* Set the key id.  We first try the issuer fingerprint and if
        * it is a v4 signature the fallback to the issuer.  Note that
        * only the issuer packet is also searched in the unhashed area.  */
-      p = parse_sig_subpkt (sig, 1, SIGSUBPKT_ISSUER_FPR, &len);
+      p = indexed_sig_subpkt (hidx, SIGSUBPKT_ISSUER_FPR, &len);
       if (p && len == 21 && p[0] == 4)
         {
           sig->keyid[0] = buf32_to_u32 (p + 1 + 12);
@@ -2235,7 +2387,7 @@ parse_signature (IOBUF inp, int pkttype, unsigned long pktlen,
           sig->keyid[0] = buf32_to_u32 (p + 1 );
 	  sig->keyid[1] = buf32_to_u32 (p + 1 + 4);
 	}
-      else if ((p = parse_sig_subpkt2 (sig, SIGSUBPKT_ISSUER)))
+      else if ((p = indexed_sig_subpkt2 (hidx, uidx, SIGSUBPKT_ISSUER)))
         {
           sig->keyid[0] = buf32_to_u32 (p);
 	  sig->keyid[1] = buf32_to_u32 (p + 4);
@@ -2244,21 +2396,21 @@ parse_signature (IOBUF inp, int pkttype, unsigned long pktlen,
 	       && opt.verbose > 1 && !glo_ctrl.silence_parse_warnings)
 	log_info ("signature packet without keyid\n");
 
-      p = parse_sig_subpkt (sig, 1, SIGSUBPKT_SIG_EXPIRE, NULL);
+      p = indexed_sig_subpkt (hidx, SIGSUBPKT_SIG_EXPIRE, NULL);
       if (p && buf32_to_u32 (p))
 	sig->expiredate = sig->timestamp + buf32_to_u32 (p);
       if (sig->expiredate && sig->expiredate <= make_timestamp ())
 	sig->flags.expired = 1;
 
-      p = parse_sig_subpkt (sig, 1, SIGSUBPKT_POLICY, NULL);
+      p = indexed_sig_subpkt (hidx, SIGSUBPKT_POLICY, NULL);
       if (p)
 	sig->flags.policy_url = 1;
 
-      p = parse_sig_subpkt (sig, 1, SIGSUBPKT_PREF_KS, NULL);
+      p = indexed_sig_subpkt (hidx, SIGSUBPKT_PREF_KS, NULL);
       if (p)
 	sig->flags.pref_ks = 1;
 
-      p = parse_sig_subpkt (sig, 1, SIGSUBPKT_SIGNERS_UID, &len);
+      p = indexed_sig_subpkt (hidx, SIGSUBPKT_SIGNERS_UID, &len);
       if (p && len)
         {
           char *mbox;
@@ -2277,19 +2429,19 @@ parse_signature (IOBUF inp, int pkttype, unsigned long pktlen,
             }
         }
 
-      p = parse_sig_subpkt (sig, 1, SIGSUBPKT_KEY_BLOCK, NULL);
+      p = indexed_sig_subpkt (hidx, SIGSUBPKT_KEY_BLOCK, NULL);
       if (p)
         sig->flags.key_block = 1;
 
-      p = parse_sig_subpkt (sig, 1, SIGSUBPKT_NOTATION, NULL);
+      p = indexed_sig_subpkt (hidx, SIGSUBPKT_NOTATION, NULL);
       if (p)
 	sig->flags.notation = 1;
 
-      p = parse_sig_subpkt (sig, 1, SIGSUBPKT_REVOCABLE, NULL);
+      p = indexed_sig_subpkt (hidx, SIGSUBPKT_REVOCABLE, NULL);
       if (p && *p == 0)
 	sig->flags.revocable = 0;
 
-      p = parse_sig_subpkt (sig, 1, SIGSUBPKT_TRUST, &len);
+      p = indexed_sig_subpkt (hidx, SIGSUBPKT_TRUST, &len);
       if (p && len == 2)
 	{
 	  sig->trust_depth = p[0];
@@ -2298,7 +2450,7 @@ parse_signature (IOBUF inp, int pkttype, unsigned long pktlen,
 	  /* Only look for a regexp if there is also a trust
 	     subpacket. */
 	  sig->trust_regexp =
-	    parse_sig_subpkt (sig, 1, SIGSUBPKT_REGEXP, &len);
+	    indexed_sig_subpkt (hidx, SIGSUBPKT_REGEXP, &len);
 
 	  /* If the regular expression is of 0 length, there is no
 	     regular expression. */
@@ -2311,7 +2463,7 @@ parse_signature (IOBUF inp, int pkttype, unsigned long pktlen,
          unhashed area.  In theory, anyway, we should never see this
          packet off of a local keyring. */
 
-      p = parse_sig_subpkt2 (sig, SIGSUBPKT_EXPORTABLE);
+      p = indexed_sig_subpkt2 (hidx, uidx, SIGSUBPKT_EXPORTABLE);
       if (p && *p == 0)
 	sig->flags.exportable = 0;
 
@@ -3167,8 +3319,6 @@ static int
 parse_attribute (IOBUF inp, int pkttype, unsigned long pktlen,
 		 PACKET * packet)
 {
-  byte *p;
-
   (void) pkttype;
 
   /* We better cap the size of an attribute packet to make DoS not too
@@ -3190,9 +3340,15 @@ parse_attribute (IOBUF inp, int pkttype, unsigned long pktlen,
   packet->pkt.user_id->attrib_data = xmalloc (pktlen? pktlen:1);
   packet->pkt.user_id->attrib_len = pktlen;
 
-  p = packet->pkt.user_id->attrib_data;
-  for (; pktlen; pktlen--, p++)
-    *p = iobuf_get_noeof (inp);
+  /* Photo IDs may be several megabytes; thus read them in one go.  */
+  if (pktlen && iobuf_read (inp, packet->pkt.user_id->attrib_data,
+                            pktlen) != pktlen)
+    {
+      log_error ("premature eof while reading attribute packet\n");
+      if (list_mode)
+        es_fputs (":attribute packet: [premature eof]\n", listfp);
+      return -1;
+    }
 
   /* Now parse out the individual attribute subpackets.  This is
      somewhat pointless since there is only one currently defined
@@ -417,6 +417,51 @@ pk_verify (pubkey_algo_t pkalgo, gcry_mpi_t hash,
 
 
 
+/* Build the S-expression of the public key PKEY of type ALGO as used
+ * by pk_encrypt_with_key and store it at R_S_PKEY.  The result does
+ * not depend on the data and may thus be used for any number of
+ * encryptions with that key.  */
+gpg_error_t
+pk_encrypt_build_key (pubkey_algo_t algo, gcry_mpi_t *pkey,
+                      gcry_sexp_t *r_s_pkey)
+{
+  gpg_error_t rc;
+
+  *r_s_pkey = NULL;
+  if (algo == PUBKEY_ALGO_ELGAMAL || algo == PUBKEY_ALGO_ELGAMAL_E)
+    rc = gcry_sexp_build (r_s_pkey, NULL,
+                          "(public-key(elg(p%m)(g%m)(y%m)))",
+                          pkey[0], pkey[1], pkey[2]);
+  else if (algo == PUBKEY_ALGO_RSA || algo == PUBKEY_ALGO_RSA_E)
+    rc = gcry_sexp_build (r_s_pkey, NULL,
+                          "(public-key(rsa(n%m)(e%m)))",
+                          pkey[0], pkey[1]);
+  else if (algo == PUBKEY_ALGO_ECDH)
+    {
+      char *curve;
+
+      curve = openpgp_oid_to_str (pkey[0]);
+      if (!curve)
+        rc = gpg_error_from_syserror ();
+      else
+        {
+          int with_djb_tweak_flag = openpgp_oid_is_cv25519 (pkey[0]);
+
+          rc = gcry_sexp_build (r_s_pkey, NULL,
+                                with_djb_tweak_flag ?
+                                "(public-key(ecdh(curve%s)(flags djb-tweak)(q%m)))"
+                                : "(public-key(ecdh(curve%s)(q%m)))",
+                                curve, pkey[1]);
+          xfree (curve);
+        }
+    }
+  else
+    rc = gpg_error (GPG_ERR_PUBKEY_ALGO);
+
+  return rc;
+}
+
+
 /****************
  * Emulate our old PK interface here - sometime in the future we might
  * change the internal design to directly fit to libgcrypt.
@@ -425,58 +470,51 @@ pk_verify (pubkey_algo_t pkalgo, gcry_mpi_t hash,
 int
 pk_encrypt (pubkey_algo_t algo, gcry_mpi_t *resarr, gcry_mpi_t data,
             PKT_public_key *pk, gcry_mpi_t *pkey)
+{
+  gcry_sexp_t s_pkey;
+  byte fp[MAX_FINGERPRINT_LEN];
+  int rc;
+
+  rc = pk_encrypt_build_key (algo, pkey, &s_pkey);
+  if (rc)
+    return rc;
+  if (algo == PUBKEY_ALGO_ECDH)
+    fingerprint_from_pk (pk, fp, NULL);
+  rc = pk_encrypt_with_key (algo, resarr, data, fp, pkey, s_pkey);
+  gcry_sexp_release (s_pkey);
+  return rc;
+}
+
+
+/* Same as pk_encrypt but uses the key S_PKEY as created by
+ * pk_encrypt_build_key.  FP is the fingerprint of the key which is
+ * only used for ECDH.  This function does not modify any shared
+ * object and may thus be called from several threads.  */
+gpg_error_t
+pk_encrypt_with_key (pubkey_algo_t algo, gcry_mpi_t *resarr, gcry_mpi_t data,
+                     const byte fp[MAX_FINGERPRINT_LEN],
+                     gcry_mpi_t *pkey, gcry_sexp_t s_pkey)
 {
   gcry_sexp_t s_ciph = NULL;
   gcry_sexp_t s_data = NULL;
-  gcry_sexp_t s_pkey = NULL;
   int rc;
 
-  /* Make a sexp from pkey.  */
-  if (algo == PUBKEY_ALGO_ELGAMAL || algo == PUBKEY_ALGO_ELGAMAL_E)
+  if (algo == PUBKEY_ALGO_ELGAMAL || algo == PUBKEY_ALGO_ELGAMAL_E
+      || algo == PUBKEY_ALGO_RSA || algo == PUBKEY_ALGO_RSA_E)
     {
-      rc = gcry_sexp_build (&s_pkey, NULL,
-			    "(public-key(elg(p%m)(g%m)(y%m)))",
-			    pkey[0], pkey[1], pkey[2]);
       /* Put DATA into a simplified S-expression.  */
-      if (!rc)
-        rc = gcry_sexp_build (&s_data, NULL, "%m", data);
-    }
-  else if (algo == PUBKEY_ALGO_RSA || algo == PUBKEY_ALGO_RSA_E)
-    {
-      rc = gcry_sexp_build (&s_pkey, NULL,
-			    "(public-key(rsa(n%m)(e%m)))",
-			    pkey[0], pkey[1]);
-      /* Put DATA into a simplified S-expression.  */
-      if (!rc)
-        rc = gcry_sexp_build (&s_data, NULL, "%m", data);
+      rc = gcry_sexp_build (&s_data, NULL, "%m", data);
     }
   else if (algo == PUBKEY_ALGO_ECDH)
     {
       gcry_mpi_t k;
 
+      /* The ephemeral secret is used to compute the shared point.  */
       rc = pk_ecdh_generate_ephemeral_key (pkey, &k);
       if (!rc)
         {
-          char *curve;
-
-          curve = openpgp_oid_to_str (pkey[0]);
-          if (!curve)
-            rc = gpg_error_from_syserror ();
-          else
-            {
-              int with_djb_tweak_flag = openpgp_oid_is_cv25519 (pkey[0]);
-
-              /* Now use the ephemeral secret to compute the shared point.  */
-              rc = gcry_sexp_build (&s_pkey, NULL,
-                                    with_djb_tweak_flag ?
-                                    "(public-key(ecdh(curve%s)(flags djb-tweak)(q%m)))"
-                                    : "(public-key(ecdh(curve%s)(q%m)))",
-                                    curve, pkey[1]);
-              xfree (curve);
-              /* Put K into a simplified S-expression.  */
-              if (!rc)
-                rc = gcry_sexp_build (&s_data, NULL, "%m", k);
-            }
+          /* Put K into a simplified S-expression.  */
+          rc = gcry_sexp_build (&s_data, NULL, "%m", k);
           gcry_mpi_release (k);
         }
     }
@@ -488,14 +526,12 @@ pk_encrypt (pubkey_algo_t algo, gcry_mpi_t *resarr, gcry_mpi_t data,
     rc = gcry_pk_encrypt (&s_ciph, s_data, s_pkey);
 
   gcry_sexp_release (s_data);
-  gcry_sexp_release (s_pkey);
 
   if (rc)
     ;
   else if (algo == PUBKEY_ALGO_ECDH)
     {
       gcry_mpi_t public, result;
-      byte fp[MAX_FINGERPRINT_LEN];
       byte *shared;
       size_t nshared;
 
@@ -517,7 +553,6 @@ pk_encrypt (pubkey_algo_t algo, gcry_mpi_t *resarr, gcry_mpi_t data,
         }
 
       result = NULL;
-      fingerprint_from_pk (pk, fp, NULL);
 
       if (!rc)
         {
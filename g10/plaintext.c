@@ -182,6 +182,46 @@ get_output_file (const byte *embedded_name, int embedded_namelen,
   return 0;
 }
 
+/* Parameter for write_literal_cb.  */
+struct write_literal_parm_s
+{
+  gcry_md_hd_t md;    /* If not NULL hash the data.  */
+  estream_t fp;       /* If not NULL write the data to this stream.  */
+  const char *fname;  /* The name of FP for diagnostics.  */
+  off_t *count;       /* Counter for the --max-output check.  */
+};
+
+
+/* The writer function used with iobuf_read_direct to process binary
+ * literal data.  */
+static gpg_error_t
+write_literal_cb (void *opaque, const void *buf, size_t buflen)
+{
+  struct write_literal_parm_s *parm = opaque;
+  gpg_error_t err;
+
+  if (parm->md)
+    gcry_md_write (parm->md, buf, buflen);
+  if (parm->fp)
+    {
+      if (opt.max_output && (*parm->count += buflen) > opt.max_output)
+        {
+          log_error ("error writing to '%s': %s\n",
+                     parm->fname, "exceeded --max-output limit\n");
+          return gpg_error (GPG_ERR_TOO_LARGE);
+        }
+      else if (es_fwrite (buf, 1, buflen, parm->fp) != buflen)
+        {
+          err = gpg_error_from_syserror ();
+          log_error ("error writing to '%s': %s\n",
+                     parm->fname, gpg_strerror (err));
+          return err;
+        }
+    }
+  return 0;
+}
+
+
 /* Handle a plaintext packet.  If MFX is not NULL, update the MDs
  * Note: We should have used the filter stuff here, but we have to add
  * some easy mimic to set a read limit, so we calculate only the bytes
@@ -291,8 +331,8 @@ handle_plaintext (PKT_plaintext * pt, md_filter_context_t * mfx,
 	}
       else  /* Binary mode.  */
 	{
-	  size_t temp_size = iobuf_set_buffer_size(0) * 1024;
-	  byte *buffer;
+          struct write_literal_parm_s parm;
+          uint64_t nread;
 
 	  if (fp)
 	    {
@@ -301,49 +341,26 @@ handle_plaintext (PKT_plaintext * pt, md_filter_context_t * mfx,
 	      es_setbuf (fp, NULL);
 	    }
 
-	  buffer = xmalloc (temp_size);
-          if (!buffer)
+          parm.md = mfx->md;
+          parm.fp = fp;
+          parm.fname = fname;
+          parm.count = &count;
+          if (pt->len)
             {
-              err = gpg_error_from_syserror ();
-              goto leave;
+              /* The data is directly written from the iobuf's buffer.  */
+              err = iobuf_read_direct (pt->buf, pt->len,
+                                       write_literal_cb, &parm, &nread);
+              if (err)
+                goto leave;
+              if (nread < pt->len)
+                {
+                  err = gpg_error_from_syserror ();
+                  log_error ("problem reading source (%u bytes remaining)\n",
+                             (unsigned) (pt->len - nread));
+                  goto leave;
+                }
+              pt->len = 0;
             }
-
-	  while (pt->len)
-	    {
-	      int len = pt->len > temp_size ? temp_size : pt->len;
-	      len = iobuf_read (pt->buf, buffer, len);
-	      if (len == -1)
-		{
-		  err = gpg_error_from_syserror ();
-		  log_error ("problem reading source (%u bytes remaining)\n",
-			     (unsigned) pt->len);
-		  xfree (buffer);
-		  goto leave;
-		}
-	      if (mfx->md)
-		gcry_md_write (mfx->md, buffer, len);
-	      if (fp)
-		{
-		  if (opt.max_output && (count += len) > opt.max_output)
-		    {
-		      log_error ("error writing to '%s': %s\n",
-				 fname, "exceeded --max-output limit\n");
-		      err = gpg_error (GPG_ERR_TOO_LARGE);
-		      xfree (buffer);
-		      goto leave;
-		    }
-		  else if (es_fwrite (buffer, 1, len, fp) != len)
-		    {
-		      err = gpg_error_from_syserror ();
-		      log_error ("error writing to '%s': %s\n",
-				 fname, gpg_strerror (err));
-		      xfree (buffer);
-		      goto leave;
-		    }
-		}
-	      pt->len -= len;
-	    }
-	  xfree (buffer);
 	}
     }
   else if (!clearsig)
@@ -382,9 +399,8 @@ handle_plaintext (PKT_plaintext * pt, md_filter_context_t * mfx,
 	}
       else
 	{			/* binary mode */
-	  size_t temp_size = iobuf_set_buffer_size(0) * 1024;
-	  byte *buffer;
-	  int eof_seen = 0;
+          struct write_literal_parm_s parm;
+          uint64_t nread;
 
 	  if (fp)
 	    {
@@ -393,49 +409,17 @@ handle_plaintext (PKT_plaintext * pt, md_filter_context_t * mfx,
 	      es_setbuf (fp, NULL);
 	    }
 
-          buffer = xtrymalloc (temp_size);
-          if (!buffer)
-            {
-              err = gpg_error_from_syserror ();
-              goto leave;
-            }
-
-	  while (!eof_seen)
-	    {
-	      /* Why do we check for len < temp_size:
-	       * If we won't, we would practically read 2 EOFs but
-	       * the first one has already popped the block_filter
-	       * off and therefore we don't catch the boundary.
-	       * So, always assume EOF if iobuf_read returns less bytes
-	       * then requested */
-	      int len = iobuf_read (pt->buf, buffer, temp_size);
-	      if (len == -1)
-		break;
-	      if (len < temp_size)
-		eof_seen = 1;
-	      if (mfx->md)
-		gcry_md_write (mfx->md, buffer, len);
-	      if (fp)
-		{
-		  if (opt.max_output && (count += len) > opt.max_output)
-		    {
-		      log_error ("error writing to '%s': %s\n",
-				 fname, "exceeded --max-output limit\n");
-		      err = gpg_error (GPG_ERR_TOO_LARGE);
-		      xfree (buffer);
-		      goto leave;
-		    }
-		  else if (es_fwrite (buffer, 1, len, fp) != len)
-		    {
-		      err = gpg_error_from_syserror ();
-		      log_error ("error writing to '%s': %s\n",
-				 fname, gpg_strerror (err));
-		      xfree (buffer);
-		      goto leave;
-		    }
-		}
-	    }
-	  xfree (buffer);
+          /* Note that iobuf_read_direct stops at the first EOF which
+           * is the end of the partial length packet; a second EOF
+           * would already come from the next filter in the chain.  */
+          parm.md = mfx->md;
+          parm.fp = fp;
+          parm.fname = fname;
+          parm.count = &count;
+          err = iobuf_read_direct (pt->buf, 0, write_literal_cb, &parm,
+                                   &nread);
+          if (err)
+            goto leave;
 	}
       pt->buf = NULL;
     }
@@ -531,56 +515,51 @@ handle_plaintext (PKT_plaintext * pt, md_filter_context_t * mfx,
 
 
 static void
-do_hash (gcry_md_hd_t md, gcry_md_hd_t md2, IOBUF fp, int textmode)
+do_hash (md_filter_context_t *mfx, IOBUF fp, int textmode)
 {
   text_filter_context_t tfx;
-  int c;
+  size_t temp_size = iobuf_set_buffer_size(0) * 1024;
+  byte *buffer;
+  int ret, i, c;
+  int lc = -1;
 
   if (textmode)
     {
       memset (&tfx, 0, sizeof tfx);
       iobuf_push_filter (fp, text_filter, &tfx);
     }
-  if (md2)
-    {				/* work around a strange behaviour in pgp2 */
+
+  buffer = xmalloc (temp_size);
+  while ((ret = iobuf_read (fp, buffer, temp_size)) != -1)
+    {
+      md_filter_write (mfx, buffer, ret);
+      if (!mfx->md2)
+        continue;
+
+      /* work around a strange behaviour in pgp2 */
       /* It seems that at least PGP5 converts a single CR to a CR,LF too */
-      int lc = -1;
-      while ((c = iobuf_get (fp)) != -1)
+      for (i=0; i < ret; i++)
 	{
+	  c = buffer[i];
 	  if (c == '\n' && lc == '\r')
-	    gcry_md_putc (md2, c);
+	    gcry_md_putc (mfx->md2, c);
 	  else if (c == '\n')
 	    {
-	      gcry_md_putc (md2, '\r');
-	      gcry_md_putc (md2, c);
+	      gcry_md_putc (mfx->md2, '\r');
+	      gcry_md_putc (mfx->md2, c);
 	    }
 	  else if (c != '\n' && lc == '\r')
 	    {
-	      gcry_md_putc (md2, '\n');
-	      gcry_md_putc (md2, c);
+	      gcry_md_putc (mfx->md2, '\n');
+	      gcry_md_putc (mfx->md2, c);
 	    }
 	  else
-	    gcry_md_putc (md2, c);
-
-	  if (md)
-	    gcry_md_putc (md, c);
+	    gcry_md_putc (mfx->md2, c);
 	  lc = c;
 	}
     }
-  else
-    {
-      size_t temp_size = iobuf_set_buffer_size(0) * 1024;
-      byte *buffer = xmalloc (temp_size);
-      int ret;
 
-      while ((ret = iobuf_read (fp, buffer, temp_size)) != -1)
-	{
-	  if (md)
-	    gcry_md_write (md, buffer, ret);
-	}
-
-      xfree (buffer);
-    }
+  xfree (buffer);
 }
 
 
@@ -589,7 +568,7 @@ do_hash (gcry_md_hd_t md, gcry_md_hd_t md2, IOBUF fp, int textmode)
  * INFILE is the name of the input file.
  */
 int
-ask_for_detached_datafile (gcry_md_hd_t md, gcry_md_hd_t md2,
+ask_for_detached_datafile (md_filter_context_t *mfx,
 			   const char *inname, int textmode)
 {
   progress_filter_context_t *pfx;
@@ -652,7 +631,7 @@ ask_for_detached_datafile (gcry_md_hd_t md, gcry_md_hd_t md2,
       fp = iobuf_open (NULL);
       log_assert (fp);
     }
-  do_hash (md, md2, fp, textmode);
+  do_hash (mfx, fp, textmode);
   iobuf_close (fp);
 
 leave:
@@ -663,10 +642,10 @@ leave:
 
 
 
-/* Hash the given files and append the hash to hash contexts MD and
- * MD2.  If FILES is NULL, stdin is hashed.  */
+/* Hash the given files and append the hash to the hash contexts
+ * of MFX.  If FILES is NULL, stdin is hashed.  */
 int
-hash_datafiles (gcry_md_hd_t md, gcry_md_hd_t md2, strlist_t files,
+hash_datafiles (md_filter_context_t *mfx, strlist_t files,
 		const char *sigfilename, int textmode)
 {
   progress_filter_context_t *pfx;
@@ -687,7 +666,7 @@ hash_datafiles (gcry_md_hd_t md, gcry_md_hd_t md2, strlist_t files,
           fp = open_sigfile (sigfilename, pfx);
           if (fp)
             {
-              do_hash (md, md2, fp, textmode);
+              do_hash (mfx, fp, textmode);
               iobuf_close (fp);
               release_progress_context (pfx);
               return 0;
@@ -716,8 +695,9 @@ hash_datafiles (gcry_md_hd_t md, gcry_md_hd_t md2, strlist_t files,
 	  release_progress_context (pfx);
 	  return rc;
 	}
+      iobuf_ioctl (fp, IOBUF_IOCTL_MMAP, 1, NULL);
       handle_progress (pfx, fp, sl->d);
-      do_hash (md, md2, fp, textmode);
+      do_hash (mfx, fp, textmode);
       iobuf_close (fp);
     }
 
@@ -726,10 +706,10 @@ hash_datafiles (gcry_md_hd_t md, gcry_md_hd_t md2, strlist_t files,
 }
 
 
-/* Hash the data from file descriptor DATA_FD and append the hash to hash
-   contexts MD and MD2.  */
+/* Hash the data from file descriptor DATA_FD and append the hash to the
+   hash contexts of MFX.  */
 int
-hash_datafile_by_fd (gcry_md_hd_t md, gcry_md_hd_t md2, int data_fd,
+hash_datafile_by_fd (md_filter_context_t *mfx, int data_fd,
 		     int textmode)
 {
   progress_filter_context_t *pfx = new_progress_context ();
@@ -754,7 +734,7 @@ hash_datafile_by_fd (gcry_md_hd_t md, gcry_md_hd_t md2, int data_fd,
 
   handle_progress (pfx, fp, NULL);
 
-  do_hash (md, md2, fp, textmode);
+  do_hash (mfx, fp, textmode);
 
   iobuf_close (fp);
 
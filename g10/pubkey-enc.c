@@ -67,6 +67,220 @@ is_algo_in_prefs (kbnode_t keyblock, preftype_t type, int algo)
 }
 
 
+/* Return true if the PKESK K uses an algorithm we can decrypt.  */
+static int
+usable_pkesk_algo (struct pubkey_enc_list *k)
+{
+  if (!(k->pubkey_algo == PUBKEY_ALGO_ELGAMAL_E
+        || k->pubkey_algo == PUBKEY_ALGO_ECDH
+        || k->pubkey_algo == PUBKEY_ALGO_RSA
+        || k->pubkey_algo == PUBKEY_ALGO_RSA_E
+        || k->pubkey_algo == PUBKEY_ALGO_ELGAMAL))
+    return 0;
+
+  if (openpgp_pk_test_algo2 (k->pubkey_algo, PUBKEY_USAGE_ENC))
+    return 0;
+
+  return 1;
+}
+
+
+/* Try to get the session key using the keys with the key ids given in
+ * the PKESKs of LIST.  The public keys are looked up directly and the
+ * agent is asked only once for all of them which of them have a
+ * secret key.  Only those are then tried.  Returns GPG_ERR_NO_SECKEY
+ * if none of the keys could be used; the caller then falls back to
+ * enumerating all secret keys.  Each tried PKESK gets its RESULT
+ * set.  */
+static gpg_error_t
+get_session_key_direct (ctrl_t ctrl, struct pubkey_enc_list *list, DEK *dek)
+{
+  gpg_error_t err = gpg_error (GPG_ERR_NO_SECKEY);
+  struct pubkey_enc_list *k;
+  struct pubkey_enc_list **ks = NULL;
+  PKT_public_key **pks = NULL;
+  char *avail = NULL;
+  u32 (*keyids)[2] = NULL;
+  u32 keyid[2];
+  int i, n;
+
+  for (n=0, k = list; k; k = k->next)
+    if ((k->keyid[0] || k->keyid[1]) && usable_pkesk_algo (k))
+      n++;
+  if (!n)
+    return err;
+
+  ks = xtrycalloc (n, sizeof *ks);
+  pks = xtrycalloc (n, sizeof *pks);
+  avail = xtrycalloc (n, 1);
+  keyids = xtrycalloc (n, sizeof *keyids);
+  if (!ks || !pks || !avail || !keyids)
+    {
+      err = gpg_error_from_syserror ();
+      goto leave;
+    }
+
+  /* Fetch all public keys with one database request.  */
+  for (i=0, k = list; k && i < n; k = k->next)
+    if ((k->keyid[0] || k->keyid[1]) && usable_pkesk_algo (k))
+      {
+        keyids[i][0] = k->keyid[0];
+        keyids[i][1] = k->keyid[1];
+        i++;
+      }
+  prefetch_pubkeys (ctrl, keyids, i, PUBKEY_USAGE_ENC);
+
+  for (i=0, k = list; k && i < n; k = k->next)
+    {
+      if (!(k->keyid[0] || k->keyid[1]) || !usable_pkesk_algo (k))
+        continue;
+      ks[i] = k;
+      pks[i] = xmalloc_clear (sizeof *pks[i]);
+      pks[i]->req_usage = PUBKEY_USAGE_ENC;
+      if (get_pubkey (ctrl, pks[i], k->keyid)
+          || pks[i]->pubkey_algo != k->pubkey_algo)
+        {
+          free_public_key (pks[i]);
+          pks[i] = NULL;
+        }
+      i++;
+    }
+
+  if (agent_probe_secret_keys (ctrl, pks, n, avail))
+    goto leave;  /* Fallback to the slow path.  */
+
+  for (i=0; i < n; i++)
+    {
+      if (!avail[i])
+        continue;
+      k = ks[i];
+
+      if (! gnupg_pk_is_allowed (opt.compliance, PK_USE_DECRYPTION,
+                                 pks[i]->pubkey_algo, 0, pks[i]->pkey,
+                                 nbits_from_pk (pks[i]), NULL))
+        {
+          log_info (_("key %s is not suitable for decryption"
+                      " in %s mode\n"),
+                    keystr_from_pk (pks[i]),
+                    gnupg_compliance_option_string (opt.compliance));
+          continue;
+        }
+
+      keyid_from_pk (pks[i], keyid);
+      err = get_it (ctrl, k, dek, pks[i], keyid);
+      k->result = err;
+      if (!err || gpg_err_code (err) == GPG_ERR_FULLY_CANCELED)
+        break;
+    }
+  if (err && gpg_err_code (err) != GPG_ERR_FULLY_CANCELED)
+    err = gpg_error (GPG_ERR_NO_SECKEY);
+
+ leave:
+  if (pks)
+    for (i=0; i < n; i++)
+      free_public_key (pks[i]);
+  xfree (pks);
+  xfree (ks);
+  xfree (avail);
+  xfree (keyids);
+  return err;
+}
+
+
+/* An item of the list of secret keys sorted by next_secret_key.  */
+struct sorted_sk_s
+{
+  PKT_public_key *sk;
+  int rank;     /* See agent_secret_key_rank.  */
+  int seqno;    /* The position as returned by enum_secret_keys.  */
+};
+
+/* The state of next_secret_key.  */
+struct sk_order_s
+{
+  void *enum_context;         /* The context for enum_secret_keys.  */
+  int sorted;                 /* Return the keys in the sorted order.  */
+  struct sorted_sk_s *items;  /* The sorted list or NULL.  */
+  int nitems;
+  int next;
+};
+
+
+/* qsort compare function for the items of struct sk_order_s.  */
+static int
+cmp_sorted_sk (const void *a_arg, const void *b_arg)
+{
+  const struct sorted_sk_s *a = a_arg;
+  const struct sorted_sk_s *b = b_arg;
+
+  if (a->rank != b->rank)
+    return b->rank - a->rank;
+  return a->seqno - b->seqno;
+}
+
+
+/* Store the next secret key at R_SK.  If SO->SORTED is set the keys
+ * which can most likely be used without user interaction are returned
+ * first; for this all secret keys are enumerated with the first call.
+ * The keys are owned by the enumeration context which is released by
+ * calling this function with R_SK set to NULL.  */
+static gpg_error_t
+next_secret_key (ctrl_t ctrl, struct sk_order_s *so, PKT_public_key **r_sk)
+{
+  gpg_error_t err;
+  PKT_public_key *sk;
+  struct sorted_sk_s *tmp;
+  int size = 0;
+
+  if (!r_sk)
+    {
+      enum_secret_keys (ctrl, &so->enum_context, NULL);
+      xfree (so->items);
+      so->items = NULL;
+      return 0;
+    }
+
+  if (!so->sorted)
+    {
+      *r_sk = sk = xmalloc_clear (sizeof *sk);
+      return enum_secret_keys (ctrl, &so->enum_context, sk);
+    }
+
+  if (!so->items)
+    {
+      while (!(err = enum_secret_keys (ctrl, &so->enum_context,
+                                       (sk = xmalloc_clear (sizeof *sk)))))
+        {
+          if (so->nitems == size)
+            {
+              size += 32;
+              tmp = xtryrealloc (so->items, size * sizeof *so->items);
+              if (!tmp)
+                {
+                  err = gpg_error_from_syserror ();
+                  break;
+                }
+              so->items = tmp;
+            }
+          so->items[so->nitems].sk = sk;
+          so->items[so->nitems].rank = agent_secret_key_rank (ctrl, sk);
+          so->items[so->nitems].seqno = so->nitems;
+          so->nitems++;
+        }
+      if (gpg_err_code (err) != GPG_ERR_EOF)
+        return err;
+      if (!so->items)
+        return gpg_error (GPG_ERR_EOF);
+      qsort (so->items, so->nitems, sizeof *so->items, cmp_sorted_sk);
+    }
+
+  if (so->next >= so->nitems)
+    return gpg_error (GPG_ERR_EOF);
+  *r_sk = so->items[so->next++].sk;
+  return 0;
+}
+
+
 /*
  * Get the session key from a pubkey enc packet and return it in DEK,
  * which should have been allocated in secure memory by the caller.
@@ -76,7 +290,7 @@ get_session_key (ctrl_t ctrl, struct pubkey_enc_list *list, DEK *dek)
 {
   PKT_public_key *sk = NULL;
   gpg_error_t err;
-  void *enum_context = NULL;
+  struct sk_order_s sk_order;
   u32 keyid[2];
   int search_for_secret_keys = 1;
   struct pubkey_enc_list *k;
@@ -84,10 +298,34 @@ get_session_key (ctrl_t ctrl, struct pubkey_enc_list *list, DEK *dek)
   if (DBG_CLOCK)
     log_clock ("get_session_key enter");
 
+  /* First try the keys named in the PKESKs.  This avoids asking the
+   * agent for each key of the keyring.  */
+  if (!opt.try_all_secrets)
+    {
+      err = get_session_key_direct (ctrl, list, dek);
+      if (gpg_err_code (err) != GPG_ERR_NO_SECKEY)
+        goto leave;
+    }
+
+  /* For anonymous recipients all secret keys may need to be tried.
+   * We then try them in an order so that the keys which can be used
+   * without user interaction come first:
+   * - On-disk keys w/o protection
+   * - On-disk keys with a cached passphrase
+   * - On-card keys of an active card
+   * - On-disk keys with protection
+   * - On-card keys from cards which are not plugged in.
+   * Without any anonymous keys the sorting is skipped.
+   */
+  memset (&sk_order, 0, sizeof sk_order);
+  if (!opt.skip_hidden_recipients)
+    for (k = list; k; k = k->next)
+      if (!k->keyid[0] && !k->keyid[1] && usable_pkesk_algo (k))
+        sk_order.sorted = 1;
+
   while (search_for_secret_keys)
     {
-      sk = xmalloc_clear (sizeof *sk);
-      err = enum_secret_keys (ctrl, &enum_context, sk);
+      err = next_secret_key (ctrl, &sk_order, &sk);
       if (err)
         break;
 
@@ -103,26 +341,9 @@ get_session_key (ctrl_t ctrl, struct pubkey_enc_list *list, DEK *dek)
           continue;
         }
 
-      /* FIXME: The list needs to be sorted so that we try the keys in
-       * an appropriate order.  For example:
-       * - On-disk keys w/o protection
-       * - On-disk keys with a cached passphrase
-       * - On-card keys of an active card
-       * - On-disk keys with protection
-       * - On-card keys from cards which are not plugged it.  Here a
-       *   cancel-all button should stop asking for other cards.
-       * Without any anonymous keys the sorting can be skipped.
-       */
       for (k = list; k; k = k->next)
         {
-          if (!(k->pubkey_algo == PUBKEY_ALGO_ELGAMAL_E
-                || k->pubkey_algo == PUBKEY_ALGO_ECDH
-                || k->pubkey_algo == PUBKEY_ALGO_RSA
-                || k->pubkey_algo == PUBKEY_ALGO_RSA_E
-                || k->pubkey_algo == PUBKEY_ALGO_ELGAMAL))
-            continue;
-
-          if (openpgp_pk_test_algo2 (k->pubkey_algo, PUBKEY_USAGE_ENC))
+          if (!usable_pkesk_algo (k))
             continue;
 
           if (sk->pubkey_algo != k->pubkey_algo)
@@ -139,6 +360,8 @@ get_session_key (ctrl_t ctrl, struct pubkey_enc_list *list, DEK *dek)
                 log_info (_("anonymous recipient; trying secret key %s ...\n"),
                           keystr (keyid));
             }
+          else if (!opt.try_all_secrets && k->result != -1)
+            continue; /* Already tried by get_session_key_direct.  */
           else if (opt.try_all_secrets
                    || (k->keyid[0] == keyid[0] && k->keyid[1] == keyid[1]))
             {
@@ -169,7 +392,7 @@ get_session_key (ctrl_t ctrl, struct pubkey_enc_list *list, DEK *dek)
             }
         }
     }
-  enum_secret_keys (ctrl, &enum_context, NULL);  /* free context */
+  next_secret_key (ctrl, &sk_order, NULL);  /* free context */
 
   if (gpg_err_code (err) == GPG_ERR_EOF)
     {
@@ -181,6 +404,7 @@ get_session_key (ctrl_t ctrl, struct pubkey_enc_list *list, DEK *dek)
           err = k->result;
     }
 
+ leave:
   if (DBG_CLOCK)
     log_clock ("get_session_key leave");
   return err;
@@ -201,6 +425,7 @@ get_it (ctrl_t ctrl,
   char *desc;
   char *keygrip;
   byte fp[MAX_FINGERPRINT_LEN];
+  unsigned long long tstart;
 
   if (DBG_CLOCK)
     log_clock ("decryption start");
@@ -248,9 +473,11 @@ get_it (ctrl_t ctrl,
 
   /* Decrypt. */
   desc = gpg_format_keydesc (ctrl, sk, FORMAT_KEYDESC_NORMAL, 1);
+  tstart = trace_begin ();
   err = agent_pkdecrypt (NULL, keygrip,
                          desc, sk->keyid, sk->main_keyid, sk->pubkey_algo,
                          s_data, &frame, &nframe, &padding);
+  trace_end ("agent_pkdecrypt", tstart);
   xfree (desc);
   gcry_sexp_release (s_data);
   if (err)
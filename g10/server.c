@@ -51,6 +51,9 @@ struct server_local_s
   /* List of prepared recipients.  */
   pk_list_t recplist;
 
+  /* List of user ids of the prepared signers.  */
+  strlist_t signerlist;
+
   /* Set if pinentry notifications should be passed back to the
      client. */
   int allow_pinentry_notify;
@@ -126,6 +129,8 @@ reset_notify (assuan_context_t ctx, char *line)
 
   release_pk_list (ctrl->server_local->recplist);
   ctrl->server_local->recplist = NULL;
+  free_strlist (ctrl->server_local->signerlist);
+  ctrl->server_local->signerlist = NULL;
 
   close_message_fd (ctrl);
   assuan_close_input_fd (ctx);
@@ -234,9 +239,40 @@ cmd_recipient (assuan_context_t ctx, char *line)
 static gpg_error_t
 cmd_signer (assuan_context_t ctx, char *line)
 {
-  (void)ctx;
-  (void)line;
-  return gpg_error (GPG_ERR_NOT_SUPPORTED);
+  ctrl_t ctrl = assuan_get_pointer (ctx);
+  gpg_error_t err;
+  strlist_t locusr = NULL;
+  SK_LIST sk_list = NULL;
+
+  line = skip_options (line);
+  if (!*line)
+    return set_error (GPG_ERR_ASS_PARAMETER, "no user ID given");
+
+  /* Check the key now so that the client gets an early error.  */
+  if (!add_to_strlist_try (&locusr, line))
+    return gpg_error_from_syserror ();
+  err = build_sk_list (ctrl, locusr, &sk_list, PUBKEY_USAGE_SIG);
+  release_sk_list (sk_list);
+  if (!err)
+    {
+      /* Keep the list in the order of the SIGNER commands.  */
+      if (!ctrl->server_local->signerlist)
+        ctrl->server_local->signerlist = locusr;
+      else
+        {
+          strlist_t sl;
+
+          for (sl = ctrl->server_local->signerlist; sl->next; sl = sl->next)
+            ;
+          sl->next = locusr;
+        }
+      locusr = NULL;
+    }
+  free_strlist (locusr);
+
+  if (err)
+    log_error ("command '%s' failed: %s\n", "SIGNER", gpg_strerror (err));
+  return err;
 }
 
 
@@ -428,9 +464,44 @@ cmd_verify (assuan_context_t ctx, char *line)
 static gpg_error_t
 cmd_sign (assuan_context_t ctx, char *line)
 {
-  (void)ctx;
-  (void)line;
-  return gpg_error (GPG_ERR_NOT_SUPPORTED);
+  ctrl_t ctrl = assuan_get_pointer (ctx);
+  gpg_error_t err;
+  int inp_fd, out_fd;
+  int detached;
+
+  detached = has_option (line, "--detached");
+
+  if (!ctrl->server_local->signerlist)
+    {
+      err = set_error (GPG_ERR_NO_SECKEY, "no signer given");
+      goto leave;
+    }
+
+  inp_fd = translate_sys2libc_fd (assuan_get_input_fd (ctx), 0);
+  if (inp_fd == -1)
+    {
+      err = set_error (GPG_ERR_ASS_NO_INPUT, NULL);
+      goto leave;
+    }
+  out_fd = translate_sys2libc_fd (assuan_get_output_fd (ctx), 1);
+  if (out_fd == -1)
+    {
+      err = set_error (GPG_ERR_ASS_NO_OUTPUT, NULL);
+      goto leave;
+    }
+
+  err = sign_file_fd (ctrl, inp_fd, out_fd, detached,
+                      ctrl->server_local->signerlist);
+
+ leave:
+  /* Close and reset the fds. */
+  close_message_fd (ctrl);
+  assuan_close_input_fd (ctx);
+  assuan_close_output_fd (ctx);
+
+  if (err)
+    log_error ("command '%s' failed: %s\n", "SIGN", gpg_strerror (err));
+  return err;
 }
 
 
@@ -442,9 +513,42 @@ cmd_sign (assuan_context_t ctx, char *line)
 static gpg_error_t
 cmd_import (assuan_context_t ctx, char *line)
 {
-  (void)ctx;
+  ctrl_t ctrl = assuan_get_pointer (ctx);
+  gpg_error_t err;
+  gnupg_fd_t fd = assuan_get_input_fd (ctx);
+  estream_t fp = NULL;
+  es_syshd_t syshd;
+
   (void)line;
-  return gpg_error (GPG_ERR_NOT_SUPPORTED);
+
+  if (fd == GNUPG_INVALID_FD)
+    return set_error (GPG_ERR_ASS_NO_INPUT, NULL);
+
+#ifdef HAVE_W32_SYSTEM
+  syshd.type = ES_SYSHD_HANDLE;
+  syshd.u.handle = fd;
+#else
+  syshd.type = ES_SYSHD_FD;
+  syshd.u.fd = fd;
+#endif
+  fp = es_sysopen_nc (&syshd, "rb");
+  if (!fp)
+    {
+      err = set_error (gpg_err_code_from_syserror (), "fdopen() failed");
+      goto leave;
+    }
+
+  err = import_keys_es_stream (ctrl, fp, NULL, NULL, NULL,
+                               opt.import_options, NULL, NULL,
+                               KEYORG_UNKNOWN, NULL);
+
+ leave:
+  es_fclose (fp);
+  assuan_close_input_fd (ctx);
+
+  if (err)
+    log_error ("command '%s' failed: %s\n", "IMPORT", gpg_strerror (err));
+  return err;
 }
 
 
@@ -753,6 +857,7 @@ gpg_server (ctrl_t ctrl)
   if (ctrl->server_local)
     {
       release_pk_list (ctrl->server_local->recplist);
+      free_strlist (ctrl->server_local->signerlist);
 
       xfree (ctrl->server_local);
       ctrl->server_local = NULL;
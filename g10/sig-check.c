@@ -23,6 +23,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <npth.h>
 
 #include "gpg.h"
 #include "../common/util.h"
@@ -34,6 +35,7 @@
 #include "options.h"
 #include "pkglue.h"
 #include "../common/compliance.h"
+#include "../common/hotpath.h"
 
 static int check_signature_end (PKT_public_key *pk, PKT_signature *sig,
 				gcry_md_hd_t digest,
@@ -41,7 +43,12 @@ static int check_signature_end (PKT_public_key *pk, PKT_signature *sig,
 				int *r_expired, int *r_revoked,
 				PKT_public_key *ret_pk);
 
-static int check_signature_end_simple (PKT_public_key *pk, PKT_signature *sig,
+static void hash_sig_trailer (PKT_signature *sig, gcry_md_hd_t digest,
+                              const void *extrahash, size_t extrahashlen);
+static void hash_uid_packet (PKT_user_id *uid, gcry_md_hd_t md,
+                             PKT_signature *sig);
+static int check_signature_end_simple (ctrl_t ctrl,
+                                       PKT_public_key *pk, PKT_signature *sig,
                                        gcry_md_hd_t digest,
                                        const void *extrahash,
                                        size_t extrahashlen);
@@ -54,9 +61,40 @@ struct
   unsigned int cached; /* Number of seen cache entries.  */
   unsigned int goodsig;/* Number of good verifications from the cache.  */
   unsigned int badsig; /* Number of bad verifications from the cache.  */
+  unsigned int kbxhit; /* Number of hits in the keyboxd's cache.  */
+  unsigned int kbxmiss;/* Number of misses in the keyboxd's cache.  */
+  unsigned int kbxput; /* Number of results stored in the keyboxd.  */
+  unsigned int prefetched; /* Number of results from sig_check_prefetch. */
 } cache_stats;
 
 
+/* A job for sig_check_prefetch.  */
+struct prefetch_job_s
+{
+  PKT_public_key *pk;   /* The signing key.  */
+  PKT_signature *sig;   /* The signature.  */
+  gcry_mpi_t hash;      /* The encoded digest of the signed material.  */
+  unsigned char key[KEYDB_SIGCACHE_KEYLEN];  /* See sigcache_make_key.  */
+  gpg_error_t err;      /* The result of pk_verify.  */
+};
+
+/* The jobs shared by the worker threads of sig_check_prefetch.  */
+struct prefetch_ctx_s
+{
+  struct prefetch_job_s *jobs;
+  int njobs;
+  int next;     /* Index of the next job to run.  */
+};
+
+/* The sorted cache keys of the good signatures found by the last call
+ * to sig_check_prefetch.  */
+static struct
+{
+  unsigned char (*keys)[KEYDB_SIGCACHE_KEYLEN];
+  size_t nkeys;
+} prefetched;
+
+
 /* Dump verification stats.  */
 void
 sig_check_dump_stats (void)
@@ -64,6 +102,90 @@ sig_check_dump_stats (void)
   log_info ("sig_cache: total=%u cached=%u good=%u bad=%u\n",
             cache_stats.total, cache_stats.cached,
             cache_stats.goodsig, cache_stats.badsig);
+  if (opt.use_keyboxd)
+    log_info ("sig_cache: keyboxd hit=%u miss=%u stored=%u\n",
+              cache_stats.kbxhit, cache_stats.kbxmiss, cache_stats.kbxput);
+  if (cache_stats.prefetched)
+    log_info ("sig_cache: prefetched=%u\n", cache_stats.prefetched);
+}
+
+
+/* Compute the key for the keyboxd's signature cache and store it at
+ * KEY which must have a size of KEYDB_SIGCACHE_KEYLEN.  The key is a
+ * SHA-256 hash over the fingerprint of the signing key PK, the
+ * algorithms and values of the signature SIG, and the final DIGEST
+ * over the signed material.  Including the digest makes sure that a
+ * cached result can't be used for a different key binding or user
+ * id.  Returns 0 on success.  */
+static gpg_error_t
+sigcache_make_key (PKT_public_key *pk, PKT_signature *sig,
+                   gcry_md_hd_t digest, unsigned char *key)
+{
+  gpg_error_t err;
+  gcry_md_hd_t md;
+  byte fpr[MAX_FINGERPRINT_LEN];
+  size_t fprlen;
+  const void *dgst;
+  unsigned char *buf;
+  unsigned int nbits;
+  size_t n;
+  int i, nsig;
+  byte tmp[3];
+
+  dgst = gcry_md_read (digest, sig->digest_algo);
+  nsig = pubkey_get_nsig (sig->pubkey_algo);
+  if (!dgst || !nsig)
+    return gpg_error (GPG_ERR_NOT_SUPPORTED);
+
+  err = gcry_md_open (&md, GCRY_MD_SHA256, 0);
+  if (err)
+    return err;
+
+  fingerprint_from_pk (pk, fpr, &fprlen);
+  tmp[0] = fprlen;
+  tmp[1] = sig->pubkey_algo;
+  tmp[2] = sig->digest_algo;
+  gcry_md_write (md, tmp, 3);
+  gcry_md_write (md, fpr, fprlen);
+  gcry_md_write (md, dgst, gcry_md_get_algo_dlen (sig->digest_algo));
+
+  for (i = 0; i < nsig && !err; i++)
+    {
+      if (!sig->data[i])
+        err = gpg_error (GPG_ERR_BAD_MPI);
+      else if (gcry_mpi_get_flag (sig->data[i], GCRYMPI_FLAG_OPAQUE))
+        {
+          buf = gcry_mpi_get_opaque (sig->data[i], &nbits);
+          n = (nbits + 7) / 8;
+          tmp[0] = n >> 8;
+          tmp[1] = n;
+          gcry_md_write (md, tmp, 2);
+          if (buf)
+            gcry_md_write (md, buf, n);
+        }
+      else if (!(err = gcry_mpi_aprint (GCRYMPI_FMT_USG, &buf, &n,
+                                         sig->data[i])))
+        {
+          tmp[0] = n >> 8;
+          tmp[1] = n;
+          gcry_md_write (md, tmp, 2);
+          gcry_md_write (md, buf, n);
+          gcry_free (buf);
+        }
+    }
+
+  if (!err)
+    memcpy (key, gcry_md_read (md, GCRY_MD_SHA256), KEYDB_SIGCACHE_KEYLEN);
+  gcry_md_close (md);
+  return err;
+}
+
+
+/* qsort and bsearch compare function for cache keys.  */
+static int
+cmp_sigcache_keys (const void *a, const void *b)
+{
+  return memcmp (a, b, KEYDB_SIGCACHE_KEYLEN);
 }
 
 
@@ -143,13 +265,13 @@ check_signature (ctrl_t ctrl, PKT_signature *sig, gcry_md_hd_t digest)
  * was found; other wise NULL is stored.
  *
  * Returns 0 on success.  An error code otherwise.  */
-gpg_error_t
-check_signature2 (ctrl_t ctrl,
-                  PKT_signature *sig, gcry_md_hd_t digest,
-                  const void *extrahash, size_t extrahashlen,
-                  PKT_public_key *forced_pk,
-                  u32 *r_expiredate,
-		  int *r_expired, int *r_revoked, PKT_public_key **r_pk)
+static gpg_error_t
+do_check_signature2 (ctrl_t ctrl,
+                     PKT_signature *sig, gcry_md_hd_t digest,
+                     const void *extrahash, size_t extrahashlen,
+                     PKT_public_key *forced_pk,
+                     u32 *r_expiredate,
+                     int *r_expired, int *r_revoked, PKT_public_key **r_pk)
 {
   int rc=0;
   PKT_public_key *pk;
@@ -335,6 +457,25 @@ check_signature2 (ctrl_t ctrl,
 }
 
 
+gpg_error_t
+check_signature2 (ctrl_t ctrl,
+                  PKT_signature *sig, gcry_md_hd_t digest,
+                  const void *extrahash, size_t extrahashlen,
+                  PKT_public_key *forced_pk,
+                  u32 *r_expiredate,
+		  int *r_expired, int *r_revoked, PKT_public_key **r_pk)
+{
+  gpg_error_t err;
+
+  HOTPATH_COUNT ("check_signature",
+                 err = do_check_signature2 (ctrl, sig, digest,
+                                            extrahash, extrahashlen,
+                                            forced_pk, r_expiredate,
+                                            r_expired, r_revoked, r_pk));
+  return err;
+}
+
+
 /* The signature SIG was generated with the public key PK.  Check
  * whether the signature is valid in the following sense:
  *
@@ -481,7 +622,7 @@ check_signature_end (PKT_public_key *pk, PKT_signature *sig,
                                                r_expired, r_revoked)))
     return rc;
 
-  if ((rc = check_signature_end_simple (pk, sig, digest,
+  if ((rc = check_signature_end_simple (NULL, pk, sig, digest,
                                         extrahash, extrahashlen)))
     return rc;
 
@@ -494,14 +635,19 @@ check_signature_end (PKT_public_key *pk, PKT_signature *sig,
 
 /* This function is similar to check_signature_end, but it only checks
  * whether the signature was generated by PK.  It does not check
- * expiration, revocation, etc.  */
+ * expiration, revocation, etc.  If CTRL is not NULL and the keyboxd
+ * is used, its signature cache is consulted.  */
 static int
-check_signature_end_simple (PKT_public_key *pk, PKT_signature *sig,
+check_signature_end_simple (ctrl_t ctrl,
+                            PKT_public_key *pk, PKT_signature *sig,
                             gcry_md_hd_t digest,
                             const void *extrahash, size_t extrahashlen)
 {
   gcry_mpi_t result = NULL;
   int rc = 0;
+  unsigned char cachekey[KEYDB_SIGCACHE_KEYLEN];
+  int use_cache = 0;
+  int cached;
 
   if (!opt.flags.allow_weak_digest_algos)
     {
@@ -540,6 +686,69 @@ check_signature_end_simple (PKT_public_key *pk, PKT_signature *sig,
       return rc;
     }
 
+  hash_sig_trailer (sig, digest, extrahash, extrahashlen);
+    gcry_md_final( digest );
+
+    /* Look into the results of sig_check_prefetch and the keyboxd's
+     * cache.  Only good signatures are stored there; thus a hit lets
+     * us skip the public key operation.  */
+    if (ctrl && (prefetched.nkeys || (opt.use_keyboxd && !opt.no_sig_cache))
+        && !sigcache_make_key (pk, sig, digest, cachekey))
+      {
+        if (prefetched.nkeys
+            && bsearch (cachekey, prefetched.keys, prefetched.nkeys,
+                        sizeof *prefetched.keys, cmp_sigcache_keys))
+          {
+            cache_stats.prefetched++;
+            goto checked;
+          }
+        if (opt.use_keyboxd && !opt.no_sig_cache)
+          {
+            use_cache = 1;
+            if (!keydb_sigcache_get (ctrl, cachekey, &cached) && !cached)
+              {
+                cache_stats.kbxhit++;
+                goto checked;
+              }
+            cache_stats.kbxmiss++;
+          }
+      }
+
+    /* Convert the digest to an MPI.  */
+    result = encode_md_value (pk, digest, sig->digest_algo );
+    if (!result)
+        return GPG_ERR_GENERAL;
+
+    /* Verify the signature.  */
+    if (DBG_CLOCK && sig->sig_class <= 0x01)
+      log_clock ("enter pk_verify");
+    rc = pk_verify( pk->pubkey_algo, result, sig->data, pk->pkey );
+    if (DBG_CLOCK && sig->sig_class <= 0x01)
+      log_clock ("leave pk_verify");
+    gcry_mpi_release (result);
+
+    if (!rc && use_cache && !keydb_sigcache_put (ctrl, cachekey, 0))
+      cache_stats.kbxput++;
+
+ checked:
+
+  if (!rc && sig->flags.unknown_critical)
+    {
+      log_info(_("assuming bad signature from key %s"
+                 " due to an unknown critical bit\n"),keystr_from_pk(pk));
+      rc = GPG_ERR_BAD_SIGNATURE;
+    }
+
+  return rc;
+}
+
+
+/* Hash the trailer of the signature SIG to DIGEST.  EXTRAHASH and
+ * EXTRAHASHLEN are the literal data meta data for v5 signatures.  */
+static void
+hash_sig_trailer (PKT_signature *sig, gcry_md_hd_t digest,
+                  const void *extrahash, size_t extrahashlen)
+{
   /* Make sure the digest algo is enabled (in case of a detached
    * signature).  */
   gcry_md_enable (digest, sig->digest_algo);
@@ -620,29 +829,6 @@ check_signature_end_simple (PKT_public_key *pk, PKT_signature *sig,
       buf[i++] = n;
       gcry_md_write (digest, buf, i);
     }
-    gcry_md_final( digest );
-
-    /* Convert the digest to an MPI.  */
-    result = encode_md_value (pk, digest, sig->digest_algo );
-    if (!result)
-        return GPG_ERR_GENERAL;
-
-    /* Verify the signature.  */
-    if (DBG_CLOCK && sig->sig_class <= 0x01)
-      log_clock ("enter pk_verify");
-    rc = pk_verify( pk->pubkey_algo, result, sig->data, pk->pkey );
-    if (DBG_CLOCK && sig->sig_class <= 0x01)
-      log_clock ("leave pk_verify");
-    gcry_mpi_release (result);
-
-  if (!rc && sig->flags.unknown_critical)
-    {
-      log_info(_("assuming bad signature from key %s"
-                 " due to an unknown critical bit\n"),keystr_from_pk(pk));
-      rc = GPG_ERR_BAD_SIGNATURE;
-    }
-
-  return rc;
 }
 
 
@@ -1030,21 +1216,21 @@ check_signature_over_key_or_uid (ctrl_t ctrl, PKT_public_key *signer,
     {
       log_assert (packet->pkttype == PKT_PUBLIC_KEY);
       hash_public_key (md, packet->pkt.public_key);
-      rc = check_signature_end_simple (signer, sig, md, NULL, 0);
+      rc = check_signature_end_simple (ctrl, signer, sig, md, NULL, 0);
     }
   else if (IS_BACK_SIG (sig))
     {
       log_assert (packet->pkttype == PKT_PUBLIC_KEY);
       hash_public_key (md, packet->pkt.public_key);
       hash_public_key (md, signer);
-      rc = check_signature_end_simple (signer, sig, md, NULL, 0);
+      rc = check_signature_end_simple (ctrl, signer, sig, md, NULL, 0);
     }
   else if (IS_SUBKEY_SIG (sig) || IS_SUBKEY_REV (sig))
     {
       log_assert (packet->pkttype == PKT_PUBLIC_SUBKEY);
       hash_public_key (md, pripk);
       hash_public_key (md, packet->pkt.public_key);
-      rc = check_signature_end_simple (signer, sig, md, NULL, 0);
+      rc = check_signature_end_simple (ctrl, signer, sig, md, NULL, 0);
     }
   else if (IS_UID_SIG (sig) || IS_UID_REV (sig))
     {
@@ -1063,7 +1249,7 @@ check_signature_over_key_or_uid (ctrl_t ctrl, PKT_public_key *signer,
         {
           hash_public_key (md, pripk);
           hash_uid_packet (packet->pkt.user_id, md, sig);
-          rc = check_signature_end_simple (signer, sig, md, NULL, 0);
+          rc = check_signature_end_simple (ctrl, signer, sig, md, NULL, 0);
         }
     }
   else
@@ -1286,3 +1472,257 @@ check_key_signature2 (ctrl_t ctrl,
 
   return rc;
 }
+
+
+
+/* Prepare JOB for the signature SIG made by SIGNER over the primary
+ * key PK itself, the subkey SUBPK, or the user id UID.  For
+ * self-signatures SIGNER is PK.  Returns 0 if the job shall be run.  */
+static int
+prepare_prefetch_job (PKT_public_key *signer, PKT_public_key *pk,
+                      PKT_signature *sig,
+                      PKT_public_key *subpk, PKT_user_id *uid,
+                      struct prefetch_job_s *job)
+{
+  gcry_md_hd_t md;
+  int rc = 0;
+
+  if (sig->flags.checked
+      || sig->pubkey_algo != signer->pubkey_algo
+      || openpgp_pk_test_algo (sig->pubkey_algo)
+      || openpgp_md_test_algo (sig->digest_algo)
+      || (!opt.flags.allow_weak_digest_algos
+          && is_weak_digest (sig->digest_algo)))
+    return -1;
+
+  if (gcry_md_open (&md, sig->digest_algo, 0))
+    return -1;
+
+  hash_public_key (md, pk);
+  if (IS_SUBKEY_SIG (sig) || IS_SUBKEY_REV (sig))
+    {
+      if (!subpk)
+        rc = -1;
+      else
+        hash_public_key (md, subpk);
+    }
+  else if (IS_UID_SIG (sig) || IS_UID_REV (sig))
+    {
+      if (!uid)
+        rc = -1;
+      else
+        hash_uid_packet (uid, md, sig);
+    }
+  else if (!IS_KEY_SIG (sig) && !IS_KEY_REV (sig))
+    rc = -1;
+
+  if (!rc)
+    {
+      hash_sig_trailer (sig, md, NULL, 0);
+      gcry_md_final (md);
+      if (sigcache_make_key (signer, sig, md, job->key))
+        rc = -1;
+    }
+  if (!rc)
+    {
+      job->hash = encode_md_value (signer, md, sig->digest_algo);
+      if (!job->hash)
+        rc = -1;
+    }
+  gcry_md_close (md);
+
+  job->pk = signer;
+  job->sig = sig;
+  job->err = 0;
+  return rc;
+}
+
+
+/* Worker thread for sig_check_prefetch.  The public key operation
+ * is done outside of the nPth lock; the job index is only changed
+ * while holding it.  */
+static void *
+prefetch_thread (void *opaque)
+{
+  struct prefetch_ctx_s *pctx = opaque;
+  struct prefetch_job_s *job;
+
+  while (pctx->next < pctx->njobs)
+    {
+      job = pctx->jobs + pctx->next++;
+      npth_unprotect ();
+      job->err = pk_verify (job->pk->pubkey_algo, job->hash,
+                            job->sig->data, job->pk->pkey);
+      npth_protect ();
+    }
+  return NULL;
+}
+
+
+/* Release the results of sig_check_prefetch.  */
+void
+sig_check_prefetch_release (void)
+{
+  xfree (prefetched.keys);
+  prefetched.keys = NULL;
+  prefetched.nkeys = 0;
+}
+
+
+/* qsort and bsearch compare function for the signers of
+ * sig_check_prefetch.  The keyids must already have been computed.  */
+static int
+cmp_prefetch_signers (const void *a_arg, const void *b_arg)
+{
+  PKT_public_key *a = *(PKT_public_key **)a_arg;
+  PKT_public_key *b = *(PKT_public_key **)b_arg;
+
+  if (a->keyid[0] != b->keyid[0])
+    return a->keyid[0] < b->keyid[0]? -1 : 1;
+  if (a->keyid[1] != b->keyid[1])
+    return a->keyid[1] < b->keyid[1]? -1 : 1;
+  return 0;
+}
+
+
+/* Return the key from the sorted array SIGNERS with NSIGNERS items
+ * which has the keyid KEYID or NULL.  */
+static PKT_public_key *
+find_prefetch_signer (PKT_public_key **signers, int nsigners, u32 *keyid)
+{
+  PKT_public_key key, *keyp, **found;
+
+  memset (&key, 0, sizeof key);
+  key.keyid[0] = keyid[0];
+  key.keyid[1] = keyid[1];
+  keyp = &key;
+  found = bsearch (&keyp, signers, nsigners, sizeof *signers,
+                   cmp_prefetch_signers);
+  return found? *found : NULL;
+}
+
+
+/* Verify the self-signatures of the NKEYBLOCKS public keyblocks at
+ * KEYBLOCKS using up to NTHREADS threads.  If NSIGNERS keys are
+ * given at SIGNERS, the user id certifications made by them are also
+ * verified; the array is sorted by this function.  The results of the
+ * good signatures are remembered so that a later check_key_signature
+ * on the same material does not need to do the public key operation
+ * again; the results of a previous call are released.  Nothing is
+ * marked in the keyblocks themselves and thus all the usual checks
+ * are still done by the caller.  */
+void
+sig_check_prefetch (ctrl_t ctrl, kbnode_t *keyblocks, int nkeyblocks,
+                    PKT_public_key **signers, int nsigners, int nthreads)
+{
+  struct prefetch_ctx_s pctx;
+  struct prefetch_job_s *job;
+  npth_attr_t tattr;
+  npth_t threads[MAX_IMPORT_THREADS];
+  int started[MAX_IMPORT_THREADS];
+  PKT_public_key *pk, *subpk, *signer;
+  PKT_user_id *uid;
+  PKT_signature *sig;
+  u32 keyid[2];
+  kbnode_t n;
+  int i, count;
+
+  (void)ctrl;
+
+  sig_check_prefetch_release ();
+
+  for (i=0; i < nsigners; i++)
+    keyid_from_pk (signers[i], NULL);
+  if (nsigners)
+    qsort (signers, nsigners, sizeof *signers, cmp_prefetch_signers);
+
+  count = 0;
+  for (i=0; i < nkeyblocks; i++)
+    for (n = keyblocks[i]; n; n = n->next)
+      if (n->pkt->pkttype == PKT_SIGNATURE)
+        count++;
+  if (!count)
+    return;
+
+  memset (&pctx, 0, sizeof pctx);
+  pctx.jobs = xtrycalloc (count, sizeof *pctx.jobs);
+  if (!pctx.jobs)
+    return;
+
+  for (i=0; i < nkeyblocks; i++)
+    {
+      if (keyblocks[i]->pkt->pkttype != PKT_PUBLIC_KEY)
+        continue;
+      pk = keyblocks[i]->pkt->pkt.public_key;
+      keyid_from_pk (pk, keyid);
+      subpk = NULL;
+      uid = NULL;
+      for (n = keyblocks[i]->next; n; n = n->next)
+        {
+          if (n->pkt->pkttype == PKT_PUBLIC_SUBKEY)
+            {
+              subpk = n->pkt->pkt.public_key;
+              uid = NULL;
+            }
+          else if (n->pkt->pkttype == PKT_USER_ID)
+            uid = n->pkt->pkt.user_id;
+          else if (n->pkt->pkttype == PKT_SIGNATURE)
+            {
+              sig = n->pkt->pkt.signature;
+              if (sig->keyid[0] == keyid[0] && sig->keyid[1] == keyid[1])
+                signer = pk;
+              else if (nsigners && uid && !subpk
+                       && (IS_UID_SIG (sig) || IS_UID_REV (sig)))
+                signer = find_prefetch_signer (signers, nsigners,
+                                               sig->keyid);
+              else
+                signer = NULL;
+              if (signer
+                  && !prepare_prefetch_job (signer, pk, sig, subpk, uid,
+                                            pctx.jobs + pctx.njobs))
+                pctx.njobs++;
+            }
+        }
+    }
+
+  if (nthreads > pctx.njobs)
+    nthreads = pctx.njobs;
+  if (nthreads > MAX_IMPORT_THREADS)
+    nthreads = MAX_IMPORT_THREADS;
+
+  npth_attr_init (&tattr);
+  npth_attr_setdetachstate (&tattr, NPTH_CREATE_JOINABLE);
+  for (i=0; i < nthreads; i++)
+    started[i] = !npth_create (&threads[i], &tattr, prefetch_thread, &pctx);
+  npth_attr_destroy (&tattr);
+  prefetch_thread (&pctx);  /* Also run jobs in the current thread.  */
+  for (i=0; i < nthreads; i++)
+    if (started[i])
+      npth_join (threads[i], NULL);
+
+  count = 0;
+  for (i=0; i < pctx.njobs; i++)
+    if (!pctx.jobs[i].err)
+      count++;
+  if (count)
+    prefetched.keys = xtrycalloc (count, sizeof *prefetched.keys);
+  if (prefetched.keys)
+    {
+      for (i=0; i < pctx.njobs; i++)
+        {
+          job = pctx.jobs + i;
+          if (!job->err)
+            memcpy (prefetched.keys[prefetched.nkeys++], job->key,
+                    KEYDB_SIGCACHE_KEYLEN);
+        }
+      qsort (prefetched.keys, prefetched.nkeys, sizeof *prefetched.keys,
+             cmp_sigcache_keys);
+    }
+  if (DBG_CACHE)
+    log_debug ("%s: %d keyblocks, %d jobs, %zu good, %d threads\n",
+               __func__, nkeyblocks, pctx.njobs, prefetched.nkeys, nthreads);
+
+  for (i=0; i < pctx.njobs; i++)
+    gcry_mpi_release (pctx.jobs[i].hash);
+  xfree (pctx.jobs);
+}
@@ -491,12 +491,15 @@ do_sign (ctrl_t ctrl, PKT_public_key *pksk, PKT_signature *sig,
     {
       char *desc;
       gcry_sexp_t s_sigval;
+      unsigned long long tstart;
 
       desc = gpg_format_keydesc (ctrl, pksk, FORMAT_KEYDESC_NORMAL, 1);
+      tstart = trace_begin ();
       err = agent_pksign (NULL/*ctrl*/, cache_nonce, hexgrip, desc,
                           pksk->keyid, pksk->main_keyid, pksk->pubkey_algo,
                           dp, gcry_md_get_algo_dlen (mdalgo), mdalgo,
                           &s_sigval);
+      trace_end ("agent_pksign", tstart);
       xfree (desc);
 
       if (err)
@@ -915,13 +918,13 @@ write_plaintext_packet (iobuf_t out, iobuf_t inp,
 
 
 /*
- * Write the signatures from the SK_LIST to OUT. HASH must be a
+ * Write the signatures from the SK_LIST to OUT. MFX must hold a
  * non-finalized hash which will not be changes here.  EXTRAHASH is
  * either NULL or the extra data tro be hashed into v5 signatures.
  */
 static int
 write_signature_packets (ctrl_t ctrl,
-                         SK_LIST sk_list, IOBUF out, gcry_md_hd_t hash,
+                         SK_LIST sk_list, IOBUF out, md_filter_context_t *mfx,
                          pt_extra_hash_data_t extrahash,
                          int sigclass, u32 timestamp, u32 duration,
 			 int status_letter, const char *cache_nonce)
@@ -959,7 +962,7 @@ write_signature_packets (ctrl_t ctrl,
         sig->expiredate = sig->timestamp + duration;
       sig->sig_class = sigclass;
 
-      if (gcry_md_copy (&md, hash))
+      if (md_filter_copy_md (mfx, hash_for (pk), &md))
         BUG ();
 
       build_sig_subpkt_from_sig (sig, pk, 0);
@@ -1013,10 +1016,13 @@ write_signature_packets (ctrl_t ctrl,
  * If OUTFILE is not NULL; this file is used for output and the function
  * does not ask for overwrite permission; output is then always
  * uncompressed, non-armored and in binary mode.
+ * If INP_FD or OUT_FD are not -1 they are used instead of FILENAMES
+ * and OUTFILE; the descriptors are not closed.
  */
-int
-sign_file (ctrl_t ctrl, strlist_t filenames, int detached, strlist_t locusr,
-	   int encryptflag, strlist_t remusr, const char *outfile )
+static int
+do_sign_file (ctrl_t ctrl, strlist_t filenames, int inp_fd, int detached,
+              strlist_t locusr, int encryptflag, strlist_t remusr,
+              const char *outfile, int out_fd)
 {
   const char *fname;
   armor_filter_context_t *afx;
@@ -1081,7 +1087,10 @@ sign_file (ctrl_t ctrl, strlist_t filenames, int detached, strlist_t locusr,
     inp = NULL;     /* we do it later */
   else
     {
-      inp = iobuf_open(fname);
+      if (inp_fd != -1)
+        inp = iobuf_fdopen_nc (inp_fd, "rb");
+      else
+        inp = iobuf_open(fname);
       if (inp && is_secured_file (iobuf_get_fd (inp)))
         {
           iobuf_close (inp);
@@ -1104,6 +1113,10 @@ sign_file (ctrl_t ctrl, strlist_t filenames, int detached, strlist_t locusr,
             log_debug ("peeking at input failed\n");
         }
 
+      /* Large files which are only hashed are read via mmap.  */
+      if (detached)
+        iobuf_ioctl (inp, IOBUF_IOCTL_MMAP, 1, NULL);
+
       handle_progress (pfx, inp, fname);
     }
 
@@ -1125,7 +1138,7 @@ sign_file (ctrl_t ctrl, strlist_t filenames, int detached, strlist_t locusr,
       else if (opt.verbose)
         log_info (_("writing to '%s'\n"), outfile);
     }
-  else if ((rc = open_outfile (-1, fname,
+  else if ((rc = open_outfile (out_fd, fname,
                                opt.armor? 1 : detached? 2 : 0, 0, &out)))
     {
       goto leave;
@@ -1238,7 +1251,7 @@ sign_file (ctrl_t ctrl, strlist_t filenames, int detached, strlist_t locusr,
     }
 
   for (sk_rover = sk_list; sk_rover; sk_rover = sk_rover->next)
-    gcry_md_enable (mfx.md, hash_for (sk_rover->pk));
+    md_filter_enable (&mfx, hash_for (sk_rover->pk));
 
   if (!multifile)
     iobuf_push_filter (inp, md_filter, &mfx);
@@ -1336,6 +1349,7 @@ sign_file (ctrl_t ctrl, strlist_t filenames, int detached, strlist_t locusr,
                              sl->d, gpg_strerror (rc));
                   goto leave;
                 }
+              iobuf_ioctl (inp, IOBUF_IOCTL_MMAP, 1, NULL);
               handle_progress (pfx, inp, sl->d);
               if (opt.verbose)
                 log_printf (" '%s'", sl->d );
@@ -1373,7 +1387,7 @@ sign_file (ctrl_t ctrl, strlist_t filenames, int detached, strlist_t locusr,
     goto leave;
 
   /* Write the signatures. */
-  rc = write_signature_packets (ctrl, sk_list, out, mfx.md, extrahash,
+  rc = write_signature_packets (ctrl, sk_list, out, &mfx, extrahash,
                                 opt.textmode && !outfile? 0x01 : 0x00,
                                 0, duration, detached ? 'D':'S', NULL);
   if (rc)
@@ -1390,7 +1404,7 @@ sign_file (ctrl_t ctrl, strlist_t filenames, int detached, strlist_t locusr,
         write_status (STATUS_END_ENCRYPTION);
     }
   iobuf_close (inp);
-  gcry_md_close (mfx.md);
+  free_md_filter_context (&mfx);
   release_sk_list (sk_list);
   release_pk_list (pk_list);
   recipient_digest_algo = 0;
@@ -1401,6 +1415,29 @@ sign_file (ctrl_t ctrl, strlist_t filenames, int detached, strlist_t locusr,
 }
 
 
+/* Sign the files whose names are in FILENAMES.  See do_sign_file for
+ * a description of the arguments.  */
+int
+sign_file (ctrl_t ctrl, strlist_t filenames, int detached, strlist_t locusr,
+	   int encryptflag, strlist_t remusr, const char *outfile )
+{
+  return do_sign_file (ctrl, filenames, -1, detached, locusr,
+                       encryptflag, remusr, outfile, -1);
+}
+
+
+/* Sign the data read from INP_FD using all secret keys from LOCUSR
+ * and write the signature or the signed data to OUT_FD.  This is
+ * used by the server mode.  */
+int
+sign_file_fd (ctrl_t ctrl, int inp_fd, int out_fd, int detached,
+              strlist_t locusr)
+{
+  return do_sign_file (ctrl, NULL, inp_fd, detached, locusr,
+                       0, NULL, NULL, out_fd);
+}
+
+
 /*
  * Make a clear signature.  Note that opt.armor is not needed.
  */
@@ -1411,6 +1448,7 @@ clearsign_file (ctrl_t ctrl,
   armor_filter_context_t *afx;
   progress_filter_context_t *pfx;
   gcry_md_hd_t textmd = NULL;
+  md_filter_context_t mfx;
   iobuf_t inp = NULL;
   iobuf_t out = NULL;
   PACKET pkt;
@@ -1542,7 +1580,9 @@ clearsign_file (ctrl_t ctrl,
     }
 
   /* Write the signatures.  */
-  rc = write_signature_packets (ctrl, sk_list, out, textmd, extrahash,
+  memset (&mfx, 0, sizeof mfx);
+  mfx.md = textmd;
+  rc = write_signature_packets (ctrl, sk_list, out, &mfx, extrahash,
                                 0x01, 0, duration, 'C', NULL);
   if (rc)
     goto leave;
@@ -1662,7 +1702,7 @@ sign_symencrypt_file (ctrl_t ctrl, const char *fname, strlist_t locusr)
     gcry_md_debug (mfx.md, "symc-sign");
 
   for (sk_rover = sk_list; sk_rover; sk_rover = sk_rover->next)
-    gcry_md_enable (mfx.md, hash_for (sk_rover->pk));
+    md_filter_enable (&mfx, hash_for (sk_rover->pk));
 
   iobuf_push_filter (inp, md_filter, &mfx);
 
@@ -1718,7 +1758,7 @@ sign_symencrypt_file (ctrl_t ctrl, const char *fname, strlist_t locusr)
 
   /* Write the signatures.  */
   /* (current filters: zip - encrypt - armor) */
-  rc = write_signature_packets (ctrl, sk_list, out, mfx.md, extrahash,
+  rc = write_signature_packets (ctrl, sk_list, out, &mfx, extrahash,
                                 opt.textmode? 0x01 : 0x00,
                                 0, duration, 'S', NULL);
   if (rc)
@@ -1735,7 +1775,7 @@ sign_symencrypt_file (ctrl_t ctrl, const char *fname, strlist_t locusr)
     }
   iobuf_close (inp);
   release_sk_list (sk_list);
-  gcry_md_close (mfx.md);
+  free_md_filter_context (&mfx);
   xfree (cfx.dek);
   xfree (s2k);
   release_progress_context (pfx);
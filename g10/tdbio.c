@@ -27,6 +27,9 @@
 #include <sys/stat.h>
 #include <fcntl.h>
 #include <unistd.h>
+#ifdef HAVE_MMAP
+# include <sys/mman.h>
+#endif
 
 #include "gpg.h"
 #include "../common/status.h"
@@ -58,6 +61,7 @@ typedef struct cache_ctrl_struct *CACHE_CTRL;
 struct cache_ctrl_struct
 {
   CACHE_CTRL next;
+  CACHE_CTRL hnext;  /* Next used item in the same hash bucket.  */
   struct {
     unsigned used:1;
     unsigned dirty:1;
@@ -66,16 +70,24 @@ struct cache_ctrl_struct
   char data[TRUST_RECORD_LEN];
 };
 
-/* Size of the cache.  The SOFT value is the general one.  While in a
+/* Size of the cache.  The SOFT value is the default for the general
+   limit which may be changed with --trustdb-cache-size.  While in a
    transaction this may not be sufficient and thus we may increase it
    then up to the HARD limit.  */
-#define MAX_CACHE_ENTRIES_SOFT	200
-#define MAX_CACHE_ENTRIES_HARD	10000
+#define MAX_CACHE_ENTRIES_SOFT	4096
+#define MAX_CACHE_ENTRIES_HARD	100000
+
+/* The number of hash buckets used to look up cached records.  Must
+ * be a power of 2.  */
+#define CACHE_HASH_SIZE 1024
 
 
 /* The cache is controlled by these variables.  */
 static CACHE_CTRL cache_list;
+static CACHE_CTRL cache_hash[CACHE_HASH_SIZE];
+static CACHE_CTRL cache_unused;  /* Unused items linked via HNEXT.  */
 static int cache_entries;
+static int cache_dirty_entries;
 static int cache_is_dirty;
 
 
@@ -107,6 +119,16 @@ static unsigned int is_locked;
 /* The file descriptor of the trustdb.  */
 static int  db_fd = -1;
 
+#ifdef HAVE_MMAP
+/* A read-only shared mapping of the trustdb used to read records
+ * without a system call.  DB_MAPLEN is the length of the mapping
+ * rounded down to full records.  Records appended after the mapping
+ * was created are read with read(2) until the mapping is renewed.  */
+static const byte *db_map;
+static size_t db_maplen;
+static int db_map_failed;
+#endif /*HAVE_MMAP*/
+
 /* A flag indicating that a transaction is active.  */
 /* static int in_transaction;   Not yet used. */
 
@@ -181,6 +203,70 @@ release_write_lock (void)
  ************* record cache **********
  *************************************/
 
+/* Return the general limit for the number of cached records.  */
+static int
+cache_limit (void)
+{
+  if (opt.trustdb_cache_size <= 0)
+    return MAX_CACHE_ENTRIES_SOFT;
+  if (opt.trustdb_cache_size < 16)
+    return 16;
+  if (opt.trustdb_cache_size > MAX_CACHE_ENTRIES_HARD)
+    return MAX_CACHE_ENTRIES_HARD;
+  return opt.trustdb_cache_size;
+}
+
+
+/* Return the hash bucket for the record RECNO.  */
+static CACHE_CTRL *
+cache_bucket (ulong recno)
+{
+  return cache_hash + (recno & (CACHE_HASH_SIZE - 1));
+}
+
+
+/* Mark the cache item R as used for the record RECNO with DATA and
+ * insert it into the hash table.  */
+static void
+use_cache_item (CACHE_CTRL r, ulong recno, const char *data)
+{
+  CACHE_CTRL *bucket = cache_bucket (recno);
+
+  r->flags.used = 1;
+  r->recno = recno;
+  memcpy (r->data, data, TRUST_RECORD_LEN);
+  r->flags.dirty = 1;
+  r->hnext = *bucket;
+  *bucket = r;
+  cache_is_dirty = 1;
+  cache_entries++;
+  cache_dirty_entries++;
+}
+
+
+/* Remove the used cache item R from the hash table and put it on the
+ * list of unused items.  */
+static void
+drop_cache_item (CACHE_CTRL r)
+{
+  CACHE_CTRL *rp;
+
+  for (rp = cache_bucket (r->recno); *rp; rp = &(*rp)->hnext)
+    if (*rp == r)
+      {
+        *rp = r->hnext;
+        break;
+      }
+  if (r->flags.dirty)
+    cache_dirty_entries--;
+  r->flags.used = 0;
+  r->flags.dirty = 0;
+  r->hnext = cache_unused;
+  cache_unused = r;
+  cache_entries--;
+}
+
+
 /*
  * Get the data from the record cache and return a pointer into that
  * cache.  Caller should copy the returned data.  NULL is returned on
@@ -191,9 +277,9 @@ get_record_from_cache (ulong recno)
 {
   CACHE_CTRL r;
 
-  for (r = cache_list; r; r = r->next)
+  for (r = *cache_bucket (recno); r; r = r->hnext)
     {
-      if (r->flags.used && r->recno == recno)
+      if (r->recno == recno)
         return r->data;
     }
   return NULL;
@@ -201,21 +287,27 @@ get_record_from_cache (ulong recno)
 
 
 /*
- * Write a cached item back to the trustdb file.
+ * Write a cached item back to the trustdb file.  If R directly
+ * follows the record written last, the seek is omitted;
+ * R_NEXTPOS is then used to track the file position and must be
+ * initialized to (ulong)(-1).  Pass NULL for it to always seek.
  *
  * Returns: 0 on success or an error code.
  */
 static int
-write_cache_item (CACHE_CTRL r)
+write_cache_item (CACHE_CTRL r, ulong *r_nextpos)
 {
   gpg_error_t err;
   int n;
 
-  if (lseek (db_fd, r->recno * TRUST_RECORD_LEN, SEEK_SET) == -1)
+  if ((!r_nextpos || *r_nextpos != r->recno)
+      && lseek (db_fd, r->recno * TRUST_RECORD_LEN, SEEK_SET) == -1)
     {
       err = gpg_error_from_syserror ();
       log_error (_("trustdb rec %lu: lseek failed: %s\n"),
                  r->recno, strerror (errno));
+      if (r_nextpos)
+        *r_nextpos = (ulong)(-1);
       return err;
     }
   n = write (db_fd, r->data, TRUST_RECORD_LEN);
@@ -224,13 +316,78 @@ write_cache_item (CACHE_CTRL r)
       err = gpg_error_from_syserror ();
       log_error (_("trustdb rec %lu: write failed (n=%d): %s\n"),
                  r->recno, n, strerror (errno) );
+      if (r_nextpos)
+        *r_nextpos = (ulong)(-1);
       return err;
     }
+  if (r_nextpos)
+    *r_nextpos = r->recno + 1;
+  if (r->flags.dirty)
+    cache_dirty_entries--;
   r->flags.dirty = 0;
   return 0;
 }
 
 
+/* qsort compare function to sort cache items by record number.  */
+static int
+cmp_cache_items (const void *a_arg, const void *b_arg)
+{
+  CACHE_CTRL a = *(CACHE_CTRL *)a_arg;
+  CACHE_CTRL b = *(CACHE_CTRL *)b_arg;
+
+  return a->recno < b->recno? -1 : a->recno > b->recno? 1 : 0;
+}
+
+
+/*
+ * Write all dirty cache items back to the trustdb file.  The items
+ * are written in the order of their record numbers so that the file
+ * is updated mostly sequentially.  The caller must hold the write
+ * lock.
+ *
+ * Returns: 0 on success or an error code.
+ */
+static int
+write_dirty_items (void)
+{
+  CACHE_CTRL r, *items;
+  int i, n, rc;
+  ulong nextpos = (ulong)(-1);
+
+  for (n = 0, r = cache_list; r; r = r->next)
+    if (r->flags.used && r->flags.dirty)
+      n++;
+  if (!n)
+    return 0;
+
+  items = xtrymalloc (n * sizeof *items);
+  if (!items)
+    {
+      /* Write them in list order.  */
+      for (r = cache_list; r; r = r->next)
+        if (r->flags.used && r->flags.dirty)
+          {
+            rc = write_cache_item (r, NULL);
+            if (rc)
+              return rc;
+          }
+      return 0;
+    }
+
+  for (i = 0, r = cache_list; r; r = r->next)
+    if (r->flags.used && r->flags.dirty)
+      items[i++] = r;
+  qsort (items, n, sizeof *items, cmp_cache_items);
+
+  rc = 0;
+  for (i = 0; i < n && !rc; i++)
+    rc = write_cache_item (items[i], &nextpos);
+  xfree (items);
+  return rc;
+}
+
+
 /*
  * Put data into the cache.  This function may flush
  * some cache entries if the cache is filled up.
@@ -241,18 +398,12 @@ static int
 put_record_into_cache (ulong recno, const char *data)
 {
   CACHE_CTRL r, unused;
-  int dirty_count = 0;
-  int clean_count = 0;
+  int clean_count;
 
   /* See whether we already cached this one.  */
-  for (unused = NULL, r = cache_list; r; r = r->next)
+  for (r = *cache_bucket (recno); r; r = r->hnext)
     {
-      if (!r->flags.used)
-        {
-          if (!unused)
-            unused = r;
-	}
-      else if (r->recno == recno)
+      if (r->recno == recno)
         {
           if (!r->flags.dirty)
             {
@@ -261,88 +412,40 @@ put_record_into_cache (ulong recno, const char *data)
                 {
                   r->flags.dirty = 1;
                   cache_is_dirty = 1;
+                  cache_dirty_entries++;
 		}
 	    }
           memcpy (r->data, data, TRUST_RECORD_LEN);
           return 0;
 	}
-      if (r->flags.used)
-        {
-          if (r->flags.dirty)
-            dirty_count++;
-          else
-            clean_count++;
-	}
     }
 
   /* Not in the cache: add a new entry. */
-  if (unused)
+  if (cache_unused)
     {
       /* Reuse this entry. */
-      r = unused;
-      r->flags.used = 1;
-      r->recno = recno;
-      memcpy (r->data, data, TRUST_RECORD_LEN);
-      r->flags.dirty = 1;
-      cache_is_dirty = 1;
-      cache_entries++;
+      unused = cache_unused;
+      cache_unused = unused->hnext;
+      use_cache_item (unused, recno, data);
       return 0;
     }
 
   /* See whether we reached the limit. */
-  if (cache_entries < MAX_CACHE_ENTRIES_SOFT)
+  if (cache_entries < cache_limit ())
     {
       /* No: Put into cache.  */
       r = xmalloc (sizeof *r);
-      r->flags.used = 1;
-      r->recno = recno;
-      memcpy (r->data, data, TRUST_RECORD_LEN);
-      r->flags.dirty = 1;
       r->next = cache_list;
       cache_list = r;
-      cache_is_dirty = 1;
-      cache_entries++;
-      return 0;
-    }
-
-  /* Cache is full: discard some clean entries.  */
-  if (clean_count)
-    {
-      int n;
-
-      /* We discard a third of the clean entries.  */
-      n = clean_count / 3;
-      if (!n)
-        n = 1;
-
-      for (unused = NULL, r = cache_list; r; r = r->next)
-        {
-          if (r->flags.used && !r->flags.dirty)
-            {
-              if (!unused)
-                unused = r;
-              r->flags.used = 0;
-              cache_entries--;
-              if (!--n)
-                break;
-	    }
-	}
-
-      /* Now put into the cache.  */
-      log_assert (unused);
-      r = unused;
-      r->flags.used = 1;
-      r->recno = recno;
-      memcpy (r->data, data, TRUST_RECORD_LEN);
-      r->flags.dirty = 1;
-      cache_is_dirty = 1;
-      cache_entries++;
+      use_cache_item (r, recno, data);
       return 0;
     }
 
-  /* No clean entries: We have to flush some dirty entries.  */
+  /* The cache is full.  If there are no clean entries we have to
+   * flush the dirty entries.  */
+  clean_count = cache_entries - cache_dirty_entries;
 #if 0 /* Transactions are not yet used.  */
-  if (in_transaction)
+  if (!clean_count && in_transaction)
     {
       /* But we can't do this while in a transaction.  Thus we
        * increase the cache size instead.  */
@@ -351,14 +454,9 @@ put_record_into_cache (ulong recno, const char *data)
           if (opt.debug && !(cache_entries % 100))
             log_debug ("increasing tdbio cache size\n");
           r = xmalloc (sizeof *r);
-          r->flags.used = 1;
-          r->recno = recno;
-          memcpy (r->data, data, TRUST_RECORD_LEN);
-          r->flags.dirty = 1;
           r->next = cache_list;
           cache_list = r;
-          cache_is_dirty = 1;
-          cache_entries++;
+          use_cache_item (r, recno, data);
           return 0;
 	}
       /* Hard limit for the cache size reached.  */
@@ -367,44 +465,46 @@ put_record_into_cache (ulong recno, const char *data)
     }
 #endif
 
-  if (dirty_count)
+  if (!clean_count)
+    {
+      int rc;
+
+      /* Write back all dirty entries in one batch; this turns them
+       * into clean entries which can then be discarded.  */
+      take_write_lock ();
+      rc = write_dirty_items ();
+      release_write_lock ();
+      if (rc)
+        return rc;
+      cache_is_dirty = 0;
+      clean_count = cache_entries;
+    }
+
+  /* Cache is full: discard some clean entries.  */
+  if (clean_count)
     {
       int n;
 
-      /* Discard some dirty entries. */
-      n = dirty_count / 5;
+      /* We discard a third of the clean entries.  */
+      n = clean_count / 3;
       if (!n)
         n = 1;
 
-      take_write_lock ();
-      for (unused = NULL, r = cache_list; r; r = r->next)
+      for (r = cache_list; r; r = r->next)
         {
-          if (r->flags.used && r->flags.dirty)
+          if (r->flags.used && !r->flags.dirty)
             {
-              int rc;
-
-              rc = write_cache_item (r);
-              if (rc)
-                return rc;
-              if (!unused)
-                unused = r;
-              r->flags.used = 0;
-              cache_entries--;
+              drop_cache_item (r);
               if (!--n)
                 break;
 	    }
 	}
-      release_write_lock ();
 
       /* Now put into the cache.  */
-      log_assert (unused);
-      r = unused;
-      r->flags.used = 1;
-      r->recno = recno;
-      memcpy (r->data, data, TRUST_RECORD_LEN);
-      r->flags.dirty = 1;
-      cache_is_dirty = 1;
-      cache_entries++;
+      log_assert (cache_unused);
+      unused = cache_unused;
+      cache_unused = unused->hnext;
+      use_cache_item (unused, recno, data);
       return 0;
     }
 
@@ -421,14 +521,71 @@ tdbio_is_dirty (void)
 }
 
 
+#ifdef HAVE_MMAP
+/*
+ * Map the trustdb into memory or renew an existing mapping if the
+ * file has grown by at least an eighth; this avoids remapping for
+ * each appended record.  On error the mapping is not used anymore
+ * and the records are read with read(2) instead.
+ */
+static void
+map_db (void)
+{
+  struct stat st;
+  size_t len;
+  void *map;
+
+  if (db_map_failed || fstat (db_fd, &st))
+    return;
+  len = ((size_t)st.st_size / TRUST_RECORD_LEN) * TRUST_RECORD_LEN;
+  if (!len || len < db_maplen + db_maplen / 8 + TRUST_RECORD_LEN)
+    return;
+
+  map = mmap (NULL, len, PROT_READ, MAP_SHARED, db_fd, 0);
+  if (map == MAP_FAILED)
+    {
+      if (DBG_TRUST)
+        log_debug ("trustdb: mmap failed: %s\n", strerror (errno));
+      db_map_failed = 1;
+      return;
+    }
+  if (db_map)
+    munmap ((void *)db_map, db_maplen);
+  db_map = map;
+  db_maplen = len;
+}
+#endif /*HAVE_MMAP*/
+
+
+/*
+ * Return a pointer to the record RECNUM in the mapped trustdb or NULL
+ * if the record is not available via the mapping.  Because the
+ * mapping is shared, records written with write(2) are visible
+ * right away.
+ */
+static const byte *
+get_mapped_record (ulong recnum)
+{
+#ifdef HAVE_MMAP
+  if ((recnum + 1) * TRUST_RECORD_LEN > db_maplen)
+    map_db ();
+  if ((recnum + 1) * TRUST_RECORD_LEN <= db_maplen)
+    return db_map + recnum * TRUST_RECORD_LEN;
+#else
+  (void)recnum;
+#endif
+  return NULL;
+}
+
+
 /*
  * Flush the cache.  This cannot be used while in a transaction.
  */
 int
 tdbio_sync (void)
 {
-    CACHE_CTRL r;
     int did_lock = 0;
+    int rc;
 
     if( db_fd == -1 )
 	open_db();
@@ -443,13 +600,13 @@ tdbio_sync (void)
     if (!take_write_lock ())
         did_lock = 1;
 
-    for( r = cache_list; r; r = r->next ) {
-	if( r->flags.used && r->flags.dirty ) {
-	    int rc = write_cache_item( r );
-	    if( rc )
-		return rc;
-	}
-    }
+    rc = write_dirty_items ();
+    if (rc)
+      {
+        if (did_lock)
+          release_write_lock ();
+        return rc;
+      }
     cache_is_dirty = 0;
     if (did_lock)
         release_write_lock ();
@@ -513,10 +670,7 @@ tdbio_cancel_transaction () /* Not yet used.  */
       for (r = cache_list; r; r = r->next)
         {
           if (r->flags.used && r->flags.dirty)
-            {
-              r->flags.used = 0;
-              cache_entries--;
-	    }
+            drop_cache_item (r);
 	}
       cache_is_dirty = 0;
     }
@@ -1497,6 +1651,8 @@ tdbio_read_record (ulong recnum, TRUSTREC *rec, int expected)
     open_db ();
 
   buf = get_record_from_cache( recnum );
+  if (!buf)
+    buf = get_mapped_record (recnum);
   if (!buf)
     {
       if (lseek (db_fd, recnum * TRUST_RECORD_LEN, SEEK_SET) == -1)
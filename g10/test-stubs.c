@@ -41,6 +41,7 @@
 #include "../common/sysutils.h"
 #include "../common/status.h"
 #include "call-agent.h"
+#include "call-dirmngr.h"
 
 int g10_errors_seen;
 
@@ -260,6 +261,66 @@ keyserver_import_ldap (const char *name)
   return -1;
 }
 
+gpg_error_t
+gpg_dirmngr_get_akl_result (ctrl_t ctrl, const char *mechanism,
+                            const char *mbox,
+                            char **r_fpr, gpg_error_t *r_result)
+{
+  (void)ctrl;
+  (void)mechanism;
+  (void)mbox;
+  (void)r_fpr;
+  (void)r_result;
+  return gpg_error (GPG_ERR_NOT_FOUND);
+}
+
+gpg_error_t
+gpg_dirmngr_put_akl_result (ctrl_t ctrl, const char *mechanism,
+                            const char *mbox,
+                            const char *fpr, gpg_error_t result)
+{
+  (void)ctrl;
+  (void)mechanism;
+  (void)mbox;
+  (void)fpr;
+  (void)result;
+  return 0;
+}
+
+void
+gpg_dirmngr_prefetch_release (ctrl_t ctrl)
+{
+  (void)ctrl;
+}
+
+gpg_error_t
+keyserver_prefetch_cert (ctrl_t ctrl, const char *name, int dane_mode)
+{
+  (void)ctrl;
+  (void)name;
+  (void)dane_mode;
+  return gpg_error (GPG_ERR_NOT_SUPPORTED);
+}
+
+gpg_error_t
+keyserver_prefetch_wkd (ctrl_t ctrl, const char *name, unsigned int flags)
+{
+  (void)ctrl;
+  (void)name;
+  (void)flags;
+  return gpg_error (GPG_ERR_NOT_SUPPORTED);
+}
+
+gpg_error_t
+keyserver_prefetch_mbox (ctrl_t ctrl, const char *mbox,
+                         struct keyserver_spec *keyserver)
+{
+  (void)ctrl;
+  (void)mbox;
+  (void)keyserver;
+  return gpg_error (GPG_ERR_NOT_SUPPORTED);
+}
+
 gpg_error_t
 read_key_from_file_or_buffer (ctrl_t ctrl, const char *fname,
                               const void *buffer, size_t buflen,
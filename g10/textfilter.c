@@ -42,22 +42,54 @@
 			  /* to make sure that a warning is displayed while */
 			  /* creating a message */
 
+/* Size of the buffer used by copy_clearsig_text to collect the
+ * canonicalized lines before they are passed to the hash function.  */
+#define HASH_BUFSIZE 32768
+
+
+/* Return the length of the (LINE,LEN) without trailing CR, LF and
+ * Nul characters.  If TRIM_WS is set trailing spaces and tabs are
+ * also not counted.  This scans backwards from the end of the line
+ * and thus touches only the trailing characters.  Note that the Nul
+ * is included to be compatible with the strchr based
+ * trim_trailing_chars.  */
 static unsigned
-len_without_trailing_chars( byte *line, unsigned len, const char *trimchars )
+length_sans_line_end (const byte *line, unsigned len, int trim_ws)
 {
-    byte *p, *mark;
-    unsigned n;
+  while (len)
+    {
+      byte c = line[len-1];
 
-    for(mark=NULL, p=line, n=0; n < len; n++, p++ ) {
-	if( strchr( trimchars, *p ) ) {
-	    if( !mark )
-		mark = p;
-	}
-	else
-	    mark = NULL;
+      if (c == '\n' || c == '\r' || !c || (trim_ws && (c == ' ' || c == '\t')))
+        len--;
+      else
+        break;
     }
+  return len;
+}
+
 
-    return mark? (mark - line) : len;
+/* Add (DATA,N) to the hash context MD by means of the buffer HBUF of
+ * size HASH_BUFSIZE with *HLEN bytes already used.  This makes sure
+ * that the hash function is fed with large blocks and not line by
+ * line.  */
+static void
+hash_buffered (gcry_md_hd_t md, byte *hbuf, size_t *hlen,
+               const void *data, size_t n)
+{
+  if (*hlen + n > HASH_BUFSIZE)
+    {
+      if (*hlen)
+        gcry_md_write (md, hbuf, *hlen);
+      *hlen = 0;
+      if (n >= HASH_BUFSIZE)
+        {
+          gcry_md_write (md, data, n);
+          return;
+        }
+    }
+  memcpy (hbuf + *hlen, data, n);
+  *hlen += n;
 }
 
 
@@ -74,8 +106,15 @@ standard( text_filter_context_t *tfx, IOBUF a,
     while( !rc && len < size ) {
 	int lf_seen;
 
-	while( len < size && tfx->buffer_pos < tfx->buffer_len )
-	    buf[len++] = tfx->buffer[tfx->buffer_pos++];
+	if( tfx->buffer_pos < tfx->buffer_len ) {
+	    size_t n = tfx->buffer_len - tfx->buffer_pos;
+
+	    if( n > size - len )
+		n = size - len;
+	    memcpy( buf + len, tfx->buffer + tfx->buffer_pos, n );
+	    len += n;
+	    tfx->buffer_pos += n;
+	}
 	if( len >= size )
 	    continue;
 
@@ -109,12 +148,8 @@ standard( text_filter_context_t *tfx, IOBUF a,
 	   used the 2440bis-12 behavior (ignoring 2440 itself), so
 	   this actually makes us compatible with PGP textmode
 	   detached signatures for the first time. */
-	if(opt.rfc2440_text)
-	  tfx->buffer_len=trim_trailing_chars(tfx->buffer,tfx->buffer_len,
-					      " \t\r\n");
-	else
-	  tfx->buffer_len=trim_trailing_chars(tfx->buffer,tfx->buffer_len,
-					      "\r\n");
+	tfx->buffer_len = length_sans_line_end (tfx->buffer, tfx->buffer_len,
+						opt.rfc2440_text);
 
 	if( lf_seen ) {
 	    tfx->buffer[tfx->buffer_len++] = '\r';
@@ -168,10 +203,14 @@ copy_clearsig_text( IOBUF out, IOBUF inp, gcry_md_hd_t md,
     unsigned int n;
     int truncated = 0;
     int pending_lf = 0;
+    byte *hbuf;               /* buffer to collect the hashed data */
+    size_t hlen = 0;          /* and the used length of it */
 
    if( !escape_dash )
 	escape_from = 0;
 
+    hbuf = xmalloc (HASH_BUFSIZE);
+
     write_status_begin_signing (md);
 
     for(;;) {
@@ -185,15 +224,13 @@ copy_clearsig_text( IOBUF out, IOBUF inp, gcry_md_hd_t md,
 
 	/* update the message digest */
 	if( escape_dash ) {
-	    if( pending_lf ) {
-		gcry_md_putc ( md, '\r' );
-		gcry_md_putc ( md, '\n' );
-	    }
-	    gcry_md_write ( md, buffer,
-                            len_without_trailing_chars (buffer, n, " \t\r\n"));
+	    if( pending_lf )
+		hash_buffered (md, hbuf, &hlen, "\r\n", 2);
+	    hash_buffered (md, hbuf, &hlen, buffer,
+                           length_sans_line_end (buffer, n, 1));
 	}
 	else
-            gcry_md_write ( md, buffer, n );
+            hash_buffered (md, hbuf, &hlen, buffer, n);
 	pending_lf = buffer[n-1] == '\n';
 
 	/* write the output */
@@ -234,8 +271,12 @@ copy_clearsig_text( IOBUF out, IOBUF inp, gcry_md_hd_t md,
     if( !pending_lf ) { /* make sure that the file ends with a LF */
 	iobuf_writestr( out, LF );
 	if( !escape_dash )
-	    gcry_md_putc( md, '\n' );
+	    hash_buffered (md, hbuf, &hlen, "\n", 1);
     }
+    if( hlen )
+	gcry_md_write (md, hbuf, hlen);
+    wipememory (hbuf, HASH_BUFSIZE); /* burn buffer */
+    xfree (hbuf);
 
     if( truncated )
 	log_info(_("input line longer than %d characters\n"), MAX_LINELEN );
@@ -82,11 +82,44 @@ struct tofu_dbs_s
     sqlite3_stmt *register_already_seen;
     sqlite3_stmt *register_signature;
     sqlite3_stmt *register_encryption;
+    sqlite3_stmt *load_statistics_signatures;
+    sqlite3_stmt *load_statistics_encryptions;
   } s;
 
+  /* The statistics of all bindings of the key with the fingerprint
+   * STATS_FPR as loaded by load_statistics.  */
+  char *stats_fpr;
+  struct binding_stats *stats;
+
   int in_batch_transaction;
   int in_transaction;
   time_t batch_update_started;
+
+  /* Set while the signatures and encryptions recorded by this
+   * process are grouped into a batch transaction.  GROUP_RECORDS
+   * counts the records stored since GROUP_STARTED.  */
+  int group_commit;
+  unsigned int group_records;
+  time_t group_started;
+};
+
+
+/* The signature and encryption statistics of one binding.  */
+struct binding_stats
+{
+  struct binding_stats *next;
+
+  unsigned long signature_count;
+  unsigned long signature_first_seen;
+  unsigned long signature_most_recent;
+  unsigned long signature_days;
+  unsigned long encryption_count;
+  unsigned long encryption_first_done;
+  unsigned long encryption_most_recent;
+  unsigned long encryption_days;
+
+  /* The email address of the binding.  */
+  char email[1];
 };
 
 
@@ -108,9 +141,16 @@ struct tofu_dbs_s
 #define TIME_AGO_UNIT_LARGE (365 * 24 * 60 * 60)
 #define TIME_AGO_LARGE_THRESHOLD (2 * TIME_AGO_UNIT_LARGE)
 
+/* The recorded signatures and encryptions are committed after this
+   many records or seconds.  Other processes waiting for the database
+   are given a chance to run earlier; see begin_transaction.  */
+#define GROUP_COMMIT_RECORDS 64
+#define GROUP_COMMIT_SECONDS 1
+
 /* Local prototypes.  */
 static gpg_error_t end_transaction (ctrl_t ctrl, int only_batch);
 static char *email_from_user_id (const char *user_id);
+static void drop_statistics (tofu_dbs_t dbs);
 static int show_statistics (tofu_dbs_t dbs,
                             const char *fingerprint, const char *email,
                             enum tofu_policy policy,
@@ -374,6 +414,42 @@ tofu_end_batch_update (ctrl_t ctrl)
   end_transaction (ctrl, 1);
 }
 
+/* Group the coming inserts of signatures and encryptions with those
+   done before into a batch transaction unless the caller already
+   asked for a batch update.  */
+static void
+group_commit_begin (ctrl_t ctrl)
+{
+  tofu_dbs_t dbs = ctrl->tofu.dbs;
+
+  if (dbs->group_commit || ctrl->tofu.batch_updated_wanted)
+    return;
+
+  dbs->group_commit = 1;
+  dbs->group_records = 0;
+  dbs->group_started = gnupg_get_time ();
+  tofu_begin_batch_update (ctrl);
+}
+
+/* Note that NRECORDS have been stored and commit the group if it has
+   become large or old enough.  */
+static void
+group_commit_end (ctrl_t ctrl, unsigned int nrecords)
+{
+  tofu_dbs_t dbs = ctrl->tofu.dbs;
+
+  if (!dbs->group_commit)
+    return;
+
+  dbs->group_records += nrecords;
+  if (dbs->group_records < GROUP_COMMIT_RECORDS
+      && gnupg_get_time () - dbs->group_started < GROUP_COMMIT_SECONDS)
+    return;
+
+  dbs->group_commit = 0;
+  tofu_end_batch_update (ctrl);
+}
+
 /* Suspend any extant batch transaction (it is safe to call this even
    no batch transaction has been started).  Note: you cannot suspend a
    batch transaction if you are in a normal transaction.  The batch
@@ -973,6 +1049,17 @@ opendbs (ctrl_t ctrl)
           db = NULL;
         }
 
+      /* Use a write-ahead log and sync it only at checkpoints.  A
+       * crash may then lose the last transactions but does not
+       * corrupt the database, and a commit does not need an fsync.
+       * Errors are ignored; e.g. WAL does not work for a database on
+       * a network file system and sqlite keeps the old mode then.  */
+      if (db)
+        {
+          sqlite3_exec (db, "pragma journal_mode = wal;", NULL, NULL, NULL);
+          sqlite3_exec (db, "pragma synchronous = normal;", NULL, NULL, NULL);
+        }
+
       if (db)
         {
           ctrl->tofu.dbs = xmalloc_clear (sizeof *ctrl->tofu.dbs);
@@ -1010,6 +1097,7 @@ tofu_closedbs (ctrl_t ctrl)
        statements ++)
     sqlite3_finalize (*statements);
 
+  drop_statistics (dbs);
   sqlite3_close (dbs->db);
   xfree (dbs->want_lock_file);
   xfree (dbs);
@@ -2975,6 +3063,152 @@ write_stats_status (estream_t fp,
     }
 }
 
+/* Release the statistics loaded by load_statistics.  */
+static void
+drop_statistics (tofu_dbs_t dbs)
+{
+  struct binding_stats *stats;
+
+  while ((stats = dbs->stats))
+    {
+      dbs->stats = stats->next;
+      xfree (stats);
+    }
+  xfree (dbs->stats_fpr);
+  dbs->stats_fpr = NULL;
+}
+
+
+/* Object passed to load_statistics_cb.  */
+struct load_statistics_parm_s
+{
+  tofu_dbs_t dbs;
+  int encryptions;  /* The rows are for the encryptions table.  */
+};
+
+
+/* Process rows that contain the five columns:
+
+     <email, count, first time, most recent time, days>.  */
+static int
+load_statistics_cb (void *cookie, int argc, char **argv,
+                    char **azColName, sqlite3_stmt *stmt)
+{
+  struct load_statistics_parm_s *parm = cookie;
+  struct binding_stats *stats;
+  unsigned long values[4];
+  int i;
+
+  (void) azColName;
+  (void) stmt;
+
+  log_assert (argc == 5);
+  if (!argv[0])
+    return 0;
+  for (i = 0; i < 4; i++)
+    if (string_to_ulong (values + i, argv[i + 1], -1, __LINE__))
+      return 1; /* Abort.  */
+
+  for (stats = parm->dbs->stats; stats; stats = stats->next)
+    if (!strcmp (stats->email, argv[0]))
+      break;
+  if (!stats)
+    {
+      stats = xtrycalloc (1, sizeof *stats + strlen (argv[0]));
+      if (!stats)
+        return 1; /* Abort.  */
+      strcpy (stats->email, argv[0]);
+      stats->next = parm->dbs->stats;
+      parm->dbs->stats = stats;
+    }
+
+  if (parm->encryptions)
+    {
+      stats->encryption_count = values[0];
+      stats->encryption_first_done = values[1];
+      stats->encryption_most_recent = values[2];
+      stats->encryption_days = values[3];
+    }
+  else
+    {
+      stats->signature_count = values[0];
+      stats->signature_first_seen = values[1];
+      stats->signature_most_recent = values[2];
+      stats->signature_days = values[3];
+    }
+
+  return 0;
+}
+
+
+/* Load the signature and encryption statistics of all bindings of
+ * the key FINGERPRINT into DBS unless they are already there.  Doing
+ * this with one query per table for all user ids of a key instead of
+ * four queries per user id speeds up key listings a lot.  */
+static gpg_error_t
+load_statistics (tofu_dbs_t dbs, const char *fingerprint)
+{
+  struct load_statistics_parm_s parm;
+  char *err = NULL;
+  int rc;
+
+  if (dbs->stats_fpr && !strcmp (dbs->stats_fpr, fingerprint))
+    return 0;
+
+  drop_statistics (dbs);
+  dbs->stats_fpr = xtrystrdup (fingerprint);
+  if (!dbs->stats_fpr)
+    return gpg_error_from_syserror ();
+
+  parm.dbs = dbs;
+  parm.encryptions = 0;
+  rc = gpgsql_stepx
+    (dbs->db, &dbs->s.load_statistics_signatures,
+     load_statistics_cb, &parm, &err,
+     "select bindings.email, count (signatures.time),\n"
+     "  coalesce (min (signatures.time), 0),\n"
+     "  coalesce (max (signatures.time), 0),\n"
+     "  count (distinct round (signatures.time / (24 * 60 * 60)))\n"
+     " from bindings\n"
+     " left join signatures on signatures.binding = bindings.oid\n"
+     " where bindings.fingerprint = ?\n"
+     " group by bindings.email;",
+     GPGSQL_ARG_STRING, fingerprint, GPGSQL_ARG_END);
+  if (rc)
+    {
+      log_error (_("error reading TOFU database: %s\n"), err);
+      print_further_info ("getting signature statistics");
+      sqlite3_free (err);
+      drop_statistics (dbs);
+      return gpg_error (GPG_ERR_GENERAL);
+    }
+
+  parm.encryptions = 1;
+  rc = gpgsql_stepx
+    (dbs->db, &dbs->s.load_statistics_encryptions,
+     load_statistics_cb, &parm, &err,
+     "select bindings.email, count (encryptions.time),\n"
+     "  coalesce (min (encryptions.time), 0),\n"
+     "  coalesce (max (encryptions.time), 0),\n"
+     "  count (distinct round (encryptions.time / (24 * 60 * 60)))\n"
+     " from bindings\n"
+     " left join encryptions on encryptions.binding = bindings.oid\n"
+     " where bindings.fingerprint = ?\n"
+     " group by bindings.email;",
+     GPGSQL_ARG_STRING, fingerprint, GPGSQL_ARG_END);
+  if (rc)
+    {
+      log_error (_("error reading TOFU database: %s\n"), err);
+      print_further_info ("getting encryption statistics");
+      sqlite3_free (err);
+      drop_statistics (dbs);
+      return gpg_error (GPG_ERR_GENERAL);
+    }
+
+  return 0;
+}
+
+
 /* Note: If OUTFP is not NULL, this function merely prints a "tfs" record
  * to OUTFP.
  *
@@ -2992,8 +3226,7 @@ show_statistics (tofu_dbs_t dbs,
 {
   char *fingerprint_pp;
   int rc;
-  strlist_t strlist = NULL;
-  char *err = NULL;
+  struct binding_stats *stats;
 
   unsigned long signature_first_seen = 0;
   unsigned long signature_most_recent = 0;
@@ -3011,113 +3244,22 @@ show_statistics (tofu_dbs_t dbs,
 
   fingerprint_pp = format_hexfingerprint (fingerprint, NULL, 0);
 
-  /* Get the signature stats.  */
-  rc = gpgsql_exec_printf
-    (dbs->db, strings_collect_cb, &strlist, &err,
-     "select count (*), coalesce (min (signatures.time), 0),\n"
-     "  coalesce (max (signatures.time), 0)\n"
-     " from signatures\n"
-     " left join bindings on signatures.binding = bindings.oid\n"
-     " where fingerprint = %Q and email = %Q;",
-     fingerprint, email);
-  if (rc)
-    {
-      log_error (_("error reading TOFU database: %s\n"), err);
-      print_further_info ("getting signature statistics");
-      sqlite3_free (err);
-      rc = gpg_error (GPG_ERR_GENERAL);
-      goto out;
-    }
-  rc = gpgsql_exec_printf
-    (dbs->db, strings_collect_cb, &strlist, &err,
-     "select count (*) from\n"
-     "  (select round(signatures.time / (24 * 60 * 60)) day\n"
-     "    from signatures\n"
-     "    left join bindings on signatures.binding = bindings.oid\n"
-     "    where fingerprint = %Q and email = %Q\n"
-     "    group by day);",
-     fingerprint, email);
-  if (rc)
-    {
-      log_error (_("error reading TOFU database: %s\n"), err);
-      print_further_info ("getting signature statistics (by day)");
-      sqlite3_free (err);
-      rc = gpg_error (GPG_ERR_GENERAL);
-      goto out;
-    }
-
-  if (strlist)
-    {
-      /* We expect exactly 4 elements.  */
-      log_assert (strlist->next);
-      log_assert (strlist->next->next);
-      log_assert (strlist->next->next->next);
-      log_assert (! strlist->next->next->next->next);
-
-      string_to_ulong (&signature_days, strlist->d, -1, __LINE__);
-      string_to_ulong (&signature_count, strlist->next->d, -1, __LINE__);
-      string_to_ulong (&signature_first_seen,
-                       strlist->next->next->d, -1, __LINE__);
-      string_to_ulong (&signature_most_recent,
-                       strlist->next->next->next->d, -1, __LINE__);
-
-      free_strlist (strlist);
-      strlist = NULL;
-    }
-
-  /* Get the encryption stats.  */
-  rc = gpgsql_exec_printf
-    (dbs->db, strings_collect_cb, &strlist, &err,
-     "select count (*), coalesce (min (encryptions.time), 0),\n"
-     "  coalesce (max (encryptions.time), 0)\n"
-     " from encryptions\n"
-     " left join bindings on encryptions.binding = bindings.oid\n"
-     " where fingerprint = %Q and email = %Q;",
-     fingerprint, email);
-  if (rc)
-    {
-      log_error (_("error reading TOFU database: %s\n"), err);
-      print_further_info ("getting encryption statistics");
-      sqlite3_free (err);
-      rc = gpg_error (GPG_ERR_GENERAL);
-      goto out;
-    }
-  rc = gpgsql_exec_printf
-    (dbs->db, strings_collect_cb, &strlist, &err,
-     "select count (*) from\n"
-     "  (select round(encryptions.time / (24 * 60 * 60)) day\n"
-     "    from encryptions\n"
-     "    left join bindings on encryptions.binding = bindings.oid\n"
-     "    where fingerprint = %Q and email = %Q\n"
-     "    group by day);",
-     fingerprint, email);
+  rc = load_statistics (dbs, fingerprint);
   if (rc)
-    {
-      log_error (_("error reading TOFU database: %s\n"), err);
-      print_further_info ("getting encryption statistics (by day)");
-      sqlite3_free (err);
-      rc = gpg_error (GPG_ERR_GENERAL);
-      goto out;
-    }
-
-  if (strlist)
-    {
-      /* We expect exactly 4 elements.  */
-      log_assert (strlist->next);
-      log_assert (strlist->next->next);
-      log_assert (strlist->next->next->next);
-      log_assert (! strlist->next->next->next->next);
-
-      string_to_ulong (&encryption_days, strlist->d, -1, __LINE__);
-      string_to_ulong (&encryption_count, strlist->next->d, -1, __LINE__);
-      string_to_ulong (&encryption_first_done,
-                       strlist->next->next->d, -1, __LINE__);
-      string_to_ulong (&encryption_most_recent,
-                       strlist->next->next->next->d, -1, __LINE__);
-
-      free_strlist (strlist);
-      strlist = NULL;
-    }
+    goto out;
+  for (stats = dbs->stats; stats; stats = stats->next)
+    if (!strcmp (stats->email, email))
+      {
+        signature_count = stats->signature_count;
+        signature_first_seen = stats->signature_first_seen;
+        signature_most_recent = stats->signature_most_recent;
+        signature_days = stats->signature_days;
+        encryption_count = stats->encryption_count;
+        encryption_first_done = stats->encryption_first_done;
+        encryption_most_recent = stats->encryption_most_recent;
+        encryption_days = stats->encryption_days;
+        break;
+      }
 
   if (!outfp)
     write_status_text_and_buffer (STATUS_TOFU_USER, fingerprint,
@@ -3335,6 +3477,7 @@ tofu_register_signature (ctrl_t ctrl,
   char *sqlerr = NULL;
   char *sig_digest = NULL;
   unsigned long c;
+  unsigned int nrecords = 0;
 
   dbs = opendbs (ctrl);
   if (! dbs)
@@ -3347,6 +3490,7 @@ tofu_register_signature (ctrl_t ctrl,
 
   /* We do a query and then an insert.  Make sure they are atomic
      by wrapping them in a transaction.  */
+  group_commit_begin (ctrl);
   rc = begin_transaction (ctrl, 0);
   if (rc)
     return rc;
@@ -3457,6 +3601,7 @@ tofu_register_signature (ctrl_t ctrl,
              GPGSQL_ARG_LONG_LONG, (long long) sig_time,
              GPGSQL_ARG_LONG_LONG, (long long) now,
              GPGSQL_ARG_END);
+          drop_statistics (dbs);
           if (rc)
             {
               log_error (_("error updating TOFU database: %s\n"), sqlerr);
@@ -3464,6 +3609,8 @@ tofu_register_signature (ctrl_t ctrl,
               sqlite3_free (sqlerr);
               rc = gpg_error (GPG_ERR_GENERAL);
             }
+          else
+            nrecords++;
         }
 
       xfree (email);
@@ -3477,6 +3624,7 @@ tofu_register_signature (ctrl_t ctrl,
     rollback_transaction (ctrl);
   else
     rc = end_transaction (ctrl, 0);
+  group_commit_end (ctrl, nrecords);
 
   xfree (fingerprint);
   xfree (sig_digest);
@@ -3498,6 +3646,7 @@ tofu_register_encryption (ctrl_t ctrl,
   strlist_t user_id;
   char *sqlerr = NULL;
   int in_batch = 0;
+  unsigned int nrecords = 0;
 
   dbs = opendbs (ctrl);
   if (! dbs)
@@ -3548,6 +3697,7 @@ tofu_register_encryption (ctrl_t ctrl,
       goto leave;
     }
 
+  group_commit_begin (ctrl);
   tofu_begin_batch_update (ctrl);
   in_batch = 1;
   tofu_resume_batch_transaction (ctrl);
@@ -3603,6 +3753,7 @@ tofu_register_encryption (ctrl_t ctrl,
          GPGSQL_ARG_STRING, fingerprint, GPGSQL_ARG_STRING, email,
          GPGSQL_ARG_LONG_LONG, (long long) now,
          GPGSQL_ARG_END);
+      drop_statistics (dbs);
       if (rc)
         {
           log_error (_("error updating TOFU database: %s\n"), sqlerr);
@@ -3610,13 +3761,18 @@ tofu_register_encryption (ctrl_t ctrl,
           sqlite3_free (sqlerr);
           rc = gpg_error (GPG_ERR_GENERAL);
         }
+      else
+        nrecords++;
 
       xfree (email);
     }
 
  leave:
   if (in_batch)
-    tofu_end_batch_update (ctrl);
+    {
+      tofu_end_batch_update (ctrl);
+      group_commit_end (ctrl, nrecords);
+    }
 
   release_kbnode (kb);
   if (free_user_id_list)
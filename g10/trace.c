@@ -0,0 +1,140 @@
+/* trace.c - Timing spans for the main phases of an operation
+ * Copyright (C) 2026 g10 Code GmbH
+ *
+ * This file is part of GnuPG.
+ *
+ * GnuPG is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * GnuPG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see <https://www.gnu.org/licenses/>.
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+/* With "--debug trace" the functions below write one event in the
+ * Chrome trace-event format for each span:
+ *
+ *   {"name":"get_pubkey","cat":"gpg","ph":"X","ts":T,"dur":D,...}
+ *
+ * The events are written as a JSON array to the file given with
+ * --trace-file or, if that option is not used, as debug lines to the
+ * log.  The array can be loaded into chrome://tracing or Perfetto.
+ * Nested spans are shown as nested bars.  */
+
+#include <config.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#ifdef HAVE_SYS_TIME_H
+# include <sys/time.h>
+#endif
+
+#include "gpg.h"
+#include "../common/util.h"
+#include "../common/i18n.h"
+#include "options.h"
+#include "main.h"
+
+/* The stream for --trace-file; NULL if not yet opened.  */
+static estream_t tracefp;
+
+/* Set if opening the trace file failed.  */
+static int tracefp_failed;
+
+/* Number of events written to TRACEFP.  */
+static unsigned long trace_events;
+
+
+/* Return the current time in microseconds.  */
+static unsigned long long
+trace_now (void)
+{
+#if defined(HAVE_CLOCK_GETTIME) && defined(CLOCK_MONOTONIC)
+  struct timespec ts;
+
+  if (!clock_gettime (CLOCK_MONOTONIC, &ts))
+    return (unsigned long long)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+#endif
+  {
+    struct timeval tv;
+
+    gettimeofday (&tv, NULL);
+    return (unsigned long long)tv.tv_sec * 1000000 + tv.tv_usec;
+  }
+}
+
+
+/* Start a span.  Returns the start time to be passed to trace_end
+ * or 0 if tracing is not enabled.  */
+unsigned long long
+trace_begin (void)
+{
+  if (!DBG_TRACE)
+    return 0;
+  return trace_now ();
+}
+
+
+/* End the span NAME which was started at START.  */
+void
+trace_end (const char *name, unsigned long long start)
+{
+  unsigned long long now;
+  char line[256];
+
+  if (!start)
+    return;
+  now = trace_now ();
+
+  snprintf (line, sizeof line,
+            "{\"name\":\"%s\",\"cat\":\"gpg\",\"ph\":\"X\","
+            "\"ts\":%llu,\"dur\":%llu,\"pid\":%lu,\"tid\":1}",
+            name, start, now > start? now - start : 0,
+            (unsigned long)getpid ());
+
+  if (!opt.trace_file || tracefp_failed)
+    {
+      log_debug ("trace: %s\n", line);
+      return;
+    }
+
+  if (!tracefp)
+    {
+      tracefp = es_fopen (opt.trace_file, "w");
+      if (!tracefp)
+        {
+          log_error (_("can't create '%s': %s\n"),
+                     opt.trace_file, strerror (errno));
+          tracefp_failed = 1;
+          log_debug ("trace: %s\n", line);
+          return;
+        }
+      es_fputs ("[\n", tracefp);
+    }
+
+  es_fprintf (tracefp, "%s%s\n", trace_events? ",":"", line);
+  trace_events++;
+}
+
+
+/* Finish the trace file.  This is called at exit.  */
+void
+trace_close (void)
+{
+  if (!tracefp)
+    return;
+  es_fputs ("]\n", tracefp);
+  if (es_fclose (tracefp))
+    log_error (_("error writing '%s': %s\n"),
+               opt.trace_file, strerror (errno));
+  tracefp = NULL;
+}
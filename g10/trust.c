@@ -374,7 +374,13 @@ get_validity (ctrl_t ctrl, kbnode_t kb, PKT_public_key *pk, PKT_user_id *uid,
 #ifdef NO_TRUST_MODELS
   validity = TRUST_UNKNOWN;
 #else
-  validity = tdb_get_validity_core (ctrl, kb, pk, uid, main_pk, sig, may_ask);
+  {
+    unsigned long long tstart = trace_begin ();
+
+    validity = tdb_get_validity_core (ctrl, kb, pk, uid, main_pk,
+                                      sig, may_ask);
+    trace_end ("tdb_get_validity_core", tstart);
+  }
 #endif
 
  leave:
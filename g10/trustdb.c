@@ -101,6 +101,7 @@ struct key_array
 };
 
 
+
 /* Control information for the trust DB.  */
 static struct
 {
@@ -225,6 +226,110 @@ release_key_array ( struct key_array *keys )
     }
 }
 
+/*
+ * An index to find the keys certified by a given key.  It is built by
+ * a single pass over the keydb and allows validate_key_list to look
+ * only at the keys certified by a key of the current klist instead of
+ * scanning the entire keydb at each depth.
+ */
+#define SIGNER_TABLE_SIZE 16384
+
+struct signee_item
+{
+  u32 kid[2];                     /* Keyid of the certified primary key.  */
+  byte fpr[MAX_FINGERPRINT_LEN];  /* Its fingerprint.  */
+  byte fprlen;
+  int depth;                      /* Last depth it has been looked at.  */
+};
+
+struct signer_item
+{
+  struct signer_item *next;
+  u32 kid[2];                /* Keyid of the signer.  */
+  unsigned int nsignees;
+  unsigned int nallocated;
+  unsigned int *signees;     /* Indices into the signee array.  */
+};
+
+struct signee_index
+{
+  struct signee_item *items;
+  unsigned int nitems;
+  unsigned int nallocated;
+  unsigned int ncerts;       /* Number of distinct certifications.  */
+  struct signer_item *signers[SIGNER_TABLE_SIZE];
+};
+
+
+/*
+ * Release a signee index.
+ */
+static void
+release_signee_index (struct signee_index *idx)
+{
+  struct signer_item *si, *si2;
+  int i;
+
+  if (!idx)
+    return;
+  for (i=0; i < SIGNER_TABLE_SIZE; i++)
+    for (si = idx->signers[i]; si; si = si2)
+      {
+        si2 = si->next;
+        xfree (si->signees);
+        xfree (si);
+      }
+  xfree (idx->items);
+  xfree (idx);
+}
+
+/*
+ * Return the signer item for KID or NULL if KID did not certify any
+ * key.  If CREATE is set a new item is created instead.
+ */
+static struct signer_item *
+get_signer_item (struct signee_index *idx, u32 *kid, int create)
+{
+  int i = kid[1] % SIGNER_TABLE_SIZE;
+  struct signer_item *si;
+
+  for (si = idx->signers[i]; si; si = si->next)
+    if (si->kid[0] == kid[0] && si->kid[1] == kid[1])
+      return si;
+  if (!create)
+    return NULL;
+
+  si = xmalloc_clear (sizeof *si);
+  si->kid[0] = kid[0];
+  si->kid[1] = kid[1];
+  si->next = idx->signers[i];
+  idx->signers[i] = si;
+  return si;
+}
+
+/*
+ * Record that the key with keyid SIGNER certified the key with the
+ * signee index SIGNEE.
+ */
+static void
+add_signee_cert (struct signee_index *idx, u32 *signer, unsigned int signee)
+{
+  struct signer_item *si = get_signer_item (idx, signer, 1);
+
+  /* A keyblock is processed at once; thus a duplicate certification
+   * (e.g. on another user id) can only be the last one.  */
+  if (si->nsignees && si->signees[si->nsignees-1] == signee)
+    return;
+  if (si->nsignees == si->nallocated)
+    {
+      si->nallocated += 8;
+      si->signees = xrealloc (si->signees,
+                              si->nallocated * sizeof *si->signees);
+    }
+  si->signees[si->nsignees++] = signee;
+  idx->ncerts++;
+}
+
 
 /*********************************************
  **********  Initialization  *****************
@@ -707,6 +812,9 @@ tdb_revalidation_mark (ctrl_t ctrl)
   if (trustdb_args.no_trustdb && opt.trust_model == TM_ALWAYS)
     return;
 
+  /* The ranking of keys for a mail address depends on the validity.  */
+  getkey_flush_best_key_cache ();
+
   /* We simply set the time for the next check to 1 (far back in 1970)
      so that a --update-trustdb will be scheduled.  */
   if (tdbio_write_nextcheck (ctrl, 1))
@@ -1751,6 +1859,51 @@ check_regexp (const char *expr,const char *string)
 }
 
 
+/* Used by validate_one_keyblock to fetch the keys of all signers
+ * from KLIST which certified a user id of KB into the key cache in
+ * one go.  Otherwise each of them would be looked up separately
+ * while checking the signatures.  */
+static void
+prefetch_signers (ctrl_t ctrl, kbnode_t kb, u32 *main_kid,
+                  struct key_item *klist)
+{
+  kbnode_t node;
+  PKT_signature *sig;
+  u32 (*keyids)[2];
+  int n, nkeyids;
+
+  for (n=0, node=kb; node; node = node->next)
+    if (node->pkt->pkttype == PKT_SIGNATURE)
+      n++;
+  if (n < 2)
+    return;
+  keyids = xtrycalloc (n, sizeof *keyids);
+  if (!keyids)
+    return;
+
+  for (nkeyids=0, node=kb; node; node = node->next)
+    {
+      if (node->pkt->pkttype != PKT_SIGNATURE)
+        continue;
+      sig = node->pkt->pkt.signature;
+      if (sig->keyid[0] == main_kid[0] && sig->keyid[1] == main_kid[1])
+        continue; /* Self-signatures are checked using KB.  */
+      if (!IS_UID_SIG (sig) && !IS_UID_REV (sig))
+        continue;
+      if (!opt.no_sig_cache && sig->flags.checked)
+        continue; /* The key is not needed for a cached result.  */
+      if (!is_in_klist (klist, sig))
+        continue;
+      keyids[nkeyids][0] = sig->keyid[0];
+      keyids[nkeyids][1] = sig->keyid[1];
+      nkeyids++;
+    }
+
+  prefetch_pubkeys (ctrl, keyids, nkeyids, PUBKEY_USAGE_CERT);
+  xfree (keyids);
+}
+
+
 /*
  * Return true if the key is signed by one of the keys in the given
  * key ID list.  User IDs with a valid signature are marked by node
@@ -1775,6 +1928,7 @@ validate_one_keyblock (ctrl_t ctrl, kbnode_t kb, struct key_item *klist,
   int issigned=0, any_signed = 0;
 
   keyid_from_pk(pk, main_kid);
+  prefetch_signers (ctrl, kb, main_kid, klist);
   for (node=kb; node; node = node->next)
     {
       /* A bit of discussion here: is it better for the web of trust
@@ -1928,135 +2082,348 @@ validate_one_keyblock (ctrl_t ctrl, kbnode_t kb, struct key_item *klist,
 }
 
 
-static int
-search_skipfnc (void *opaque, u32 *kid, int dummy_uid_no)
-{
-  (void)dummy_uid_no;
-  return test_key_hash_table ((KeyHashTable)opaque, kid);
-}
-
-
 /*
- * Scan all keys and return a key_array of all suitable keys from
- * klist.  The caller has to pass keydb handle so that we don't use
- * to create our own.  Returns either a key_array or NULL in case of
- * an error.  No results found are indicated by an empty array.
- * Caller hast to release the returned array.
+ * Scan all keys and build an index of the certifications.  Only
+ * certifications by other keys on user ids are recorded.  The caller
+ * has to pass keydb handle so that we don't use to create our own.
+ * Returns the index or NULL in case of an error.
  */
-static struct key_array *
-validate_key_list (ctrl_t ctrl, KEYDB_HANDLE hd, KeyHashTable full_trust,
-                   struct key_item *klist, u32 curtime, u32 *next_expire)
+static struct signee_index *
+build_signee_index (ctrl_t ctrl, KEYDB_HANDLE hd)
 {
+  struct signee_index *idx;
   KBNODE keyblock = NULL;
-  struct key_array *keys = NULL;
-  size_t nkeys, maxkeys;
-  int rc;
+  KBNODE node;
   KEYDB_SEARCH_DESC desc;
+  PKT_signature *sig;
+  struct signee_item *item;
+  u32 kid[2];
+  int rc, any_uid;
 
-  maxkeys = 1000;
-  keys = xmalloc ((maxkeys+1) * sizeof *keys);
-  nkeys = 0;
+  idx = xmalloc_clear (sizeof *idx);
 
   rc = keydb_search_reset (hd);
   if (rc)
     {
       log_error ("keydb_search_reset failed: %s\n", gpg_strerror (rc));
-      xfree (keys);
-      return NULL;
+      goto die;
     }
 
   memset (&desc, 0, sizeof desc);
   desc.mode = KEYDB_SEARCH_MODE_FIRST;
-  desc.skipfnc = search_skipfnc;
-  desc.skipfncvalue = full_trust;
-  rc = keydb_search (hd, &desc, 1, NULL);
-  if (gpg_err_code (rc) == GPG_ERR_NOT_FOUND)
+  for (;;)
     {
-      keys[nkeys].keyblock = NULL;
-      return keys;
-    }
-  if (rc)
-    {
-      log_error ("keydb_search(first) failed: %s\n", gpg_strerror (rc));
-      goto die;
-    }
-
-  desc.mode = KEYDB_SEARCH_MODE_NEXT; /* change mode */
-  do
-    {
-      PKT_public_key *pk;
+      rc = keydb_search (hd, &desc, 1, NULL);
+      if (rc)
+        break;
+      desc.mode = KEYDB_SEARCH_MODE_NEXT;
 
       rc = keydb_get_keyblock (hd, &keyblock);
       if (rc)
         {
           log_error ("keydb_get_keyblock failed: %s\n", gpg_strerror (rc));
-	  goto die;
+          goto die;
         }
 
-      if ( keyblock->pkt->pkttype != PKT_PUBLIC_KEY)
+      if (keyblock->pkt->pkttype != PKT_PUBLIC_KEY)
         {
-          log_debug ("ooops: invalid pkttype %d encountered\n",
-                     keyblock->pkt->pkttype);
-          dump_kbnode (keyblock);
-          release_kbnode(keyblock);
+          release_kbnode (keyblock);
+          keyblock = NULL;
           continue;
         }
 
-      /* prepare the keyblock for further processing */
-      merge_keys_and_selfsig (ctrl, keyblock);
-      clear_kbnode_flags (keyblock);
-      pk = keyblock->pkt->pkt.public_key;
-      if (pk->has_expired || pk->flags.revoked)
+      keyid_from_pk (keyblock->pkt->pkt.public_key, kid);
+      item = NULL;
+      any_uid = 0;
+      for (node = keyblock; node; node = node->next)
         {
-          /* it does not make sense to look further at those keys */
-          mark_keyblock_seen (full_trust, keyblock);
+          if (node->pkt->pkttype == PKT_USER_ID)
+            any_uid = 1;
+          else if (node->pkt->pkttype == PKT_PUBLIC_SUBKEY)
+            break;  /* Only subkey bindings follow.  */
+          else if (any_uid && node->pkt->pkttype == PKT_SIGNATURE)
+            {
+              sig = node->pkt->pkt.signature;
+              if (sig->keyid[0] == kid[0] && sig->keyid[1] == kid[1])
+                continue;  /* A self-signature.  */
+              if (!item)
+                {
+                  if (idx->nitems == idx->nallocated)
+                    {
+                      idx->nallocated += 1024;
+                      idx->items = xrealloc (idx->items,
+                                             idx->nallocated
+                                             * sizeof *idx->items);
+                    }
+                  item = idx->items + idx->nitems;
+                  memset (item, 0, sizeof *item);
+                  item->kid[0] = kid[0];
+                  item->kid[1] = kid[1];
+                  fingerprint_from_pk (keyblock->pkt->pkt.public_key,
+                                       item->fpr, NULL);
+                  item->fprlen = keyblock->pkt->pkt.public_key->fprlen;
+                  item->depth = -1;
+                  idx->nitems++;
+                }
+              add_signee_cert (idx, sig->keyid, item - idx->items);
+            }
         }
-      else if (validate_one_keyblock (ctrl, keyblock, klist,
-                                      curtime, next_expire))
+
+      release_kbnode (keyblock);
+      keyblock = NULL;
+    }
+  if (gpg_err_code (rc) != GPG_ERR_NOT_FOUND)
+    {
+      log_error ("keydb_search failed: %s\n", gpg_strerror (rc));
+      goto die;
+    }
+
+  if (opt.verbose)
+    log_info ("%u keys with %u certifications indexed\n",
+              idx->nitems, idx->ncerts);
+  return idx;
+
+ die:
+  release_kbnode (keyblock);
+  release_signee_index (idx);
+  return NULL;
+}
+
+
+/* The number of candidate keyblocks collected by validate_key_list
+ * before their certifications are verified in parallel.  */
+#define VALIDATE_BATCH_SIZE 256
+
+/* State of validate_key_list.  */
+struct validate_batch
+{
+  kbnode_t keyblocks[VALIDATE_BATCH_SIZE];
+  int nkeyblocks;
+  PKT_public_key **signers;  /* The keys of the current KLIST.  */
+  int nsigners;
+  struct key_array *keys;    /* The result array.  */
+  size_t nkeys, maxkeys;
+};
+
+
+/* Return an array with the public keys of the keys in KLIST which
+ * have certified other keys.  The number of keys is stored at
+ * R_NSIGNERS.  Keys which can't be retrieved are skipped.  */
+static PKT_public_key **
+get_signer_keys (ctrl_t ctrl, struct signee_index *idx,
+                 struct key_item *klist, int *r_nsigners)
+{
+  PKT_public_key **signers;
+  struct key_item *k;
+  int n, nsigners;
+
+  *r_nsigners = 0;
+  for (n=0, k=klist; k; k = k->next)
+    n++;
+  signers = xtrycalloc (n? n : 1, sizeof *signers);
+  if (!signers)
+    return NULL;
+
+  nsigners = 0;
+  for (k=klist; k; k = k->next)
+    {
+      if (!get_signer_item (idx, k->kid, 0))
+        continue;
+      signers[nsigners] = xtrycalloc (1, sizeof **signers);
+      if (!signers[nsigners])
+        break;
+      if (get_pubkey (ctrl, signers[nsigners], k->kid))
         {
-	  KBNODE node;
+          free_public_key (signers[nsigners]);
+          continue;
+        }
+      nsigners++;
+    }
 
-          if (pk->expiredate && pk->expiredate >= curtime
-              && pk->expiredate < *next_expire)
-            *next_expire = pk->expiredate;
+  *r_nsigners = nsigners;
+  return signers;
+}
 
-          if (nkeys == maxkeys) {
-            maxkeys += 1000;
-            keys = xrealloc (keys, (maxkeys+1) * sizeof *keys);
-          }
-          keys[nkeys++].keyblock = keyblock;
 
-	  /* Optimization - if all uids are fully trusted, then we
-	     never need to consider this key as a candidate again. */
+/* Validate the keyblocks collected in BATCH and move the valid ones
+ * to the result array.  With --trustdb-threads the certifications
+ * made by the keys of KLIST are first verified in parallel.  */
+static void
+validate_batch_flush (ctrl_t ctrl, struct validate_batch *batch,
+                      KeyHashTable full_trust, struct key_item *klist,
+                      u32 curtime, u32 *next_expire)
+{
+  kbnode_t keyblock, node;
+  PKT_public_key *pk;
+  int i;
 
-	  for (node=keyblock; node; node = node->next)
-	    if (node->pkt->pkttype == PKT_USER_ID && !(node->flag & 4))
-	      break;
+  if (batch->nsigners && batch->nkeyblocks)
+    sig_check_prefetch (ctrl, batch->keyblocks, batch->nkeyblocks,
+                        batch->signers, batch->nsigners,
+                        opt.trustdb_threads);
 
-	  if(node==NULL)
-	    mark_keyblock_seen (full_trust, keyblock);
+  for (i=0; i < batch->nkeyblocks; i++)
+    {
+      keyblock = batch->keyblocks[i];
+      batch->keyblocks[i] = NULL;
+      pk = keyblock->pkt->pkt.public_key;
 
-          keyblock = NULL;
+      if (!validate_one_keyblock (ctrl, keyblock, klist,
+                                  curtime, next_expire))
+        {
+          release_kbnode (keyblock);
+          continue;
         }
 
-      release_kbnode (keyblock);
-      keyblock = NULL;
+      if (pk->expiredate && pk->expiredate >= curtime
+          && pk->expiredate < *next_expire)
+        *next_expire = pk->expiredate;
+
+      if (batch->nkeys == batch->maxkeys)
+        {
+          batch->maxkeys += 1000;
+          batch->keys = xrealloc (batch->keys,
+                                  (batch->maxkeys+1) * sizeof *batch->keys);
+        }
+      batch->keys[batch->nkeys++].keyblock = keyblock;
+
+      /* Optimization - if all uids are fully trusted, then we
+         never need to consider this key as a candidate again. */
+
+      for (node=keyblock; node; node = node->next)
+        if (node->pkt->pkttype == PKT_USER_ID && !(node->flag & 4))
+          break;
+
+      if(node==NULL)
+        mark_keyblock_seen (full_trust, keyblock);
     }
-  while (!(rc = keydb_search (hd, &desc, 1, NULL)));
+  batch->nkeyblocks = 0;
+
+  if (batch->nsigners)
+    sig_check_prefetch_release ();
+}
 
-  if (rc && gpg_err_code (rc) != GPG_ERR_NOT_FOUND)
+
+/*
+ * Return a key_array of all suitable keys certified by a key from
+ * klist.  The keys are taken from the signee index IDX; DEPTH is the
+ * current depth of the validation and used to process each key only
+ * once.  The caller has to pass keydb handle so that we don't use to
+ * create our own.  Returns either a key_array or NULL in case of an
+ * error.  No results found are indicated by an empty array.  Caller
+ * hast to release the returned array.
+ */
+static struct key_array *
+validate_key_list (ctrl_t ctrl, KEYDB_HANDLE hd, struct signee_index *idx,
+                   KeyHashTable full_trust, struct key_item *klist,
+                   int depth, u32 curtime, u32 *next_expire)
+{
+  KBNODE keyblock = NULL;
+  struct validate_batch *batch;
+  struct key_array *keys;
+  int rc, i;
+  KEYDB_SEARCH_DESC desc;
+  struct key_item *k;
+  struct signer_item *si;
+  struct signee_item *item;
+  unsigned int n;
+
+  batch = xcalloc (1, sizeof *batch);
+  batch->maxkeys = 1000;
+  batch->keys = xmalloc ((batch->maxkeys+1) * sizeof *batch->keys);
+
+  /* The signatures are verified in parallel only if the keys of the
+   * signers are at hand.  Without them the usual serial checks of
+   * validate_one_keyblock are done.  */
+  if (opt.trustdb_threads > 1)
+    batch->signers = get_signer_keys (ctrl, idx, klist, &batch->nsigners);
+
+  for (k=klist; k; k = k->next)
     {
-      log_error ("keydb_search_next failed: %s\n", gpg_strerror (rc));
-      goto die;
+      si = get_signer_item (idx, k->kid, 0);
+      if (!si)
+        continue;  /* This key did not certify any other key.  */
+
+      for (n=0; n < si->nsignees; n++)
+        {
+          PKT_public_key *pk;
+
+          item = idx->items + si->signees[n];
+          if (item->depth == depth)
+            continue;  /* Already done at this depth.  */
+          item->depth = depth;
+          if (test_key_hash_table (full_trust, item->kid))
+            continue;
+
+          rc = keydb_search_reset (hd);
+          if (!rc)
+            {
+              memset (&desc, 0, sizeof desc);
+              desc.mode = KEYDB_SEARCH_MODE_FPR;
+              memcpy (desc.u.fpr, item->fpr, item->fprlen);
+              desc.fprlen = item->fprlen;
+              rc = keydb_search (hd, &desc, 1, NULL);
+              if (gpg_err_code (rc) == GPG_ERR_NOT_FOUND)
+                continue;  /* Deleted meanwhile.  */
+            }
+          if (!rc)
+            rc = keydb_get_keyblock (hd, &keyblock);
+          if (rc)
+            {
+              log_error ("keydb_get_keyblock failed: %s\n",
+                         gpg_strerror (rc));
+              goto die;
+            }
+
+          if ( keyblock->pkt->pkttype != PKT_PUBLIC_KEY)
+            {
+              log_debug ("ooops: invalid pkttype %d encountered\n",
+                         keyblock->pkt->pkttype);
+              dump_kbnode (keyblock);
+              release_kbnode(keyblock);
+              keyblock = NULL;
+              continue;
+            }
+
+          /* prepare the keyblock for further processing */
+          merge_keys_and_selfsig (ctrl, keyblock);
+          clear_kbnode_flags (keyblock);
+          pk = keyblock->pkt->pkt.public_key;
+          if (pk->has_expired || pk->flags.revoked)
+            {
+              /* it does not make sense to look further at those keys */
+              mark_keyblock_seen (full_trust, keyblock);
+              release_kbnode (keyblock);
+            }
+          else
+            {
+              batch->keyblocks[batch->nkeyblocks++] = keyblock;
+              if (batch->nkeyblocks == VALIDATE_BATCH_SIZE)
+                validate_batch_flush (ctrl, batch, full_trust, klist,
+                                      curtime, next_expire);
+            }
+          keyblock = NULL;
+        }
     }
 
-  keys[nkeys].keyblock = NULL;
-  return keys;
+  validate_batch_flush (ctrl, batch, full_trust, klist, curtime, next_expire);
+  keys = batch->keys;
+  keys[batch->nkeys].keyblock = NULL;
+  goto leave;
 
  die:
-  keys[nkeys].keyblock = NULL;
-  release_key_array (keys);
-  return NULL;
+  batch->keys[batch->nkeys].keyblock = NULL;
+  release_key_array (batch->keys);
+  keys = NULL;
+  for (i=0; i < batch->nkeyblocks; i++)
+    release_kbnode (batch->keyblocks[i]);
+
+ leave:
+  for (i=0; i < batch->nsigners; i++)
+    free_public_key (batch->signers[i]);
+  xfree (batch->signers);
+  xfree (batch);
+  return keys;
 }
 
 /* Caller must sync */
@@ -2109,10 +2476,12 @@ reset_trust_records (ctrl_t ctrl)
  * This works this way:
  * Step 1: Find all ultimately trusted keys (UTK).
  *         mark them all as seen and put them into klist.
+ *         Scan the keyDB once to index which keys certified which keys.
  * Step 2: loop max_cert_times
  * Step 3:   if OWNERTRUST of any key in klist is undefined
  *             ask user to assign ownertrust
- * Step 4:   Loop over all keys in the keyDB which are not marked seen
+ * Step 4:   Loop over all keys certified by a key in klist which are
+ *           not marked seen
  * Step 5:     if key is revoked or expired
  *                mark key as seen
  *                continue loop at Step 4
@@ -2141,6 +2510,7 @@ validate_keys (ctrl_t ctrl, int interactive)
   int depth;
   int ot_unknown, ot_undefined, ot_never, ot_marginal, ot_full, ot_ultimate;
   KeyHashTable stored,used,full_trust;
+  struct signee_index *signees = NULL;
   u32 start_time, next_expire;
 
   /* Make sure we have all sigs cached.  TODO: This is going to
@@ -2208,6 +2578,16 @@ validate_keys (ctrl_t ctrl, int interactive)
        trusted keys.  */
     goto leave;
 
+  /* Instead of scanning all keys at each depth we scan them only once
+   * to find out which keys are certified by which keys.  */
+  signees = build_signee_index (ctrl, kdb);
+  if (!signees)
+    {
+      log_error ("build_signee_index failed\n");
+      rc = GPG_ERR_GENERAL;
+      goto leave;
+    }
+
   klist = utk_list;
 
   if (!opt.quiet)
@@ -2279,8 +2659,8 @@ validate_keys (ctrl_t ctrl, int interactive)
         }
 
       /* Find all keys which are signed by a key in kdlist */
-      keys = validate_key_list (ctrl, kdb, full_trust, klist,
-				start_time, &next_expire);
+      keys = validate_key_list (ctrl, kdb, signees, full_trust, klist,
+				depth, start_time, &next_expire);
       if (!keys)
         {
           log_error ("validate_key_list failed\n");
@@ -2363,6 +2743,7 @@ validate_keys (ctrl_t ctrl, int interactive)
   release_key_hash_table (full_trust);
   release_key_hash_table (used);
   release_key_hash_table (stored);
+  release_signee_index (signees);
   if (!rc && !quit) /* mark trustDB as checked */
     {
       int rc2;
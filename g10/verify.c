@@ -232,6 +232,168 @@ verify_files (ctrl_t ctrl, int nfiles, char **files )
 
 
 
+/* Verify the detached signature in SIGFILE over the data in
+ * DATAFILE.  This is a helper for verify_files_batch.  */
+static int
+verify_one_detached (ctrl_t ctrl, const char *sigfile, const char *datafile)
+{
+  iobuf_t fp;
+  armor_filter_context_t *afx = NULL;
+  progress_filter_context_t *pfx = new_progress_context ();
+  strlist_t sl = NULL;
+  int rc;
+
+  print_file_status (STATUS_FILE_START, sigfile, 1);
+  fp = iobuf_open (sigfile);
+  if (fp)
+    iobuf_ioctl (fp, IOBUF_IOCTL_NO_CACHE, 1, NULL);
+  if (fp && is_secured_file (iobuf_get_fd (fp)))
+    {
+      iobuf_close (fp);
+      fp = NULL;
+      gpg_err_set_errno (EPERM);
+    }
+  if (!fp)
+    {
+      rc = gpg_error_from_syserror ();
+      log_error (_("can't open '%s': %s\n"),
+                 print_fname_stdin (sigfile), gpg_strerror (rc));
+      print_file_status (STATUS_FILE_ERROR, sigfile, 1);
+      goto leave;
+    }
+  handle_progress (pfx, fp, sigfile);
+
+  if (!opt.no_armor && use_armor_filter (fp))
+    {
+      afx = new_armor_context ();
+      push_armor_filter (afx, fp);
+    }
+
+  add_to_strlist (&sl, datafile);
+  rc = proc_signature_packets (ctrl, NULL, fp, sl, sigfile);
+  free_strlist (sl);
+  iobuf_close (fp);
+  if ((afx && afx->no_openpgp_data && rc == -1)
+      || gpg_err_code (rc) == GPG_ERR_NO_DATA)
+    {
+      log_error (_("the signature could not be verified.\n"
+                   "Please remember that the signature file (.sig or .asc)\n"
+                   "should be the first file given on the command line.\n"));
+      rc = gpg_error (GPG_ERR_NO_DATA);
+    }
+  write_status (STATUS_FILE_DONE);
+
+  reset_literals_seen ();
+
+ leave:
+  release_armor_context (afx);
+  release_progress_context (pfx);
+  return rc;
+}
+
+
+/* Process one line of a manifest for verify_files_batch.  LINE is
+ * modified.  */
+static int
+verify_manifest_line (ctrl_t ctrl, char *line)
+{
+  char *datafile;
+  int rc;
+
+  datafile = strchr (line, '\t');
+  if (datafile)
+    {
+      *datafile++ = 0;
+      return verify_one_detached (ctrl, line, datafile);
+    }
+
+  datafile = get_matching_datafile (line);
+  if (!datafile)
+    {
+      log_error (_("no signed data\n"));
+      print_file_status (STATUS_FILE_ERROR, line, 1);
+      return gpg_error (GPG_ERR_NO_DATA);
+    }
+  rc = verify_one_detached (ctrl, line, datafile);
+  xfree (datafile);
+  return rc;
+}
+
+
+/* Verify detached signatures listed in the manifest files FILES or
+ * read the manifest from stdin if NFILES is 0.  Each line of a
+ * manifest gives the name of a signature file and, separated by a
+ * tab, the name of the signed data.  If there is no tab the name of
+ * the signed data is the name of the signature file with the suffix
+ * (".sig", ".sign" or ".asc") removed.  Empty lines are ignored.  All
+ * signatures are verified in the same process so that the key
+ * database, the key cache and the trustdb need to be set up only
+ * once.  Returns the first error.  */
+int
+verify_files_batch (ctrl_t ctrl, int nfiles, char **files)
+{
+  char line[2048];
+  unsigned int lno;
+  estream_t fp;
+  int i, rc;
+  int first_rc = 0;
+
+  ctrl->no_exit_on_bad_sig = 1;
+  for (i = 0; !i || i < nfiles; i++)
+    {
+      if (!nfiles || !strcmp (files[i], "-"))
+        fp = es_stdin;
+      else
+        {
+          fp = es_fopen (files[i], "r");
+          if (fp && is_secured_file (es_fileno (fp)))
+            {
+              es_fclose (fp);
+              fp = NULL;
+              gpg_err_set_errno (EPERM);
+            }
+          if (!fp)
+            {
+              rc = gpg_error_from_syserror ();
+              log_error (_("can't open '%s': %s\n"),
+                         files[i], gpg_strerror (rc));
+              if (!first_rc)
+                first_rc = rc;
+              continue;
+            }
+        }
+
+      lno = 0;
+      while (es_fgets (line, DIM(line), fp))
+        {
+          lno++;
+          if (!*line || line[strlen(line)-1] != '\n')
+            {
+              log_error (_("input line %u too long or missing LF\n"), lno);
+              rc = gpg_error (GPG_ERR_GENERAL);
+              if (!first_rc)
+                first_rc = rc;
+              break;
+            }
+          line[strlen(line)-1] = 0;
+          if (*line && line[strlen(line)-1] == '\r')
+            line[strlen(line)-1] = 0;
+          if (!*line)
+            continue;
+          rc = verify_manifest_line (ctrl, line);
+          if (!first_rc)
+            first_rc = rc;
+        }
+
+      if (fp != es_stdin)
+        es_fclose (fp);
+    }
+  ctrl->no_exit_on_bad_sig = 0;
+
+  return first_rc;
+}
+
+
 /* Perform a verify operation.  To verify detached signatures, DATA_FD
    shall be the descriptor of the signed data; for regular signatures
    it needs to be -1.  If OUT_FP is not NULL and DATA_FD is not -1 the
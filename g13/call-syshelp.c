@@ -42,6 +42,7 @@ struct call_syshelp_s
 {
   assuan_context_t assctx;  /* The Assuan context for the current
                                g13-syshep connection.  */
+  char *devicename;         /* The device last set by DEVICE or NULL.  */
 };
 
 
@@ -163,6 +164,7 @@ call_syshelp_release (ctrl_t ctrl)
     {
       assuan_release (ctrl->syshelp_local->assctx);
       ctrl->syshelp_local->assctx = NULL;
+      xfree (ctrl->syshelp_local->devicename);
       xfree (ctrl->syshelp_local);
       ctrl->syshelp_local = NULL;
     }
@@ -290,6 +292,14 @@ call_syshelp_set_device (ctrl_t ctrl, const char *fname)
   if (err)
     goto leave;
 
+  /* The syshelp keeps the device open until the next DEVICE command;
+   * thus there is no need to send it again for the same device.  */
+  if (ctrl->syshelp_local->devicename
+      && !strcmp (ctrl->syshelp_local->devicename, fname))
+    goto leave;
+  xfree (ctrl->syshelp_local->devicename);
+  ctrl->syshelp_local->devicename = NULL;
+
   line = xtryasprintf ("DEVICE %s", fname);
   if (!line)
     {
@@ -297,6 +307,8 @@ call_syshelp_set_device (ctrl_t ctrl, const char *fname)
       goto leave;
     }
   err = assuan_transact (ctx, line, NULL, NULL, NULL, NULL, NULL, NULL);
+  if (!err)
+    ctrl->syshelp_local->devicename = xtrystrdup (fname);
 
  leave:
   xfree (line);
@@ -25,6 +25,12 @@
 #include <errno.h>
 #include <assert.h>
 #include <limits.h>
+#ifdef __linux__
+# include <fcntl.h>
+# include <unistd.h>
+# include <sys/ioctl.h>
+# include <linux/fs.h>
+#endif
 
 #include "g13-syshelp.h"
 #include <assuan.h>
@@ -50,6 +56,27 @@ sh_blockdev_getsz (const char *name, unsigned long long *r_nblocks)
   char *result;
 
   *r_nblocks = 0;
+
+#if defined(__linux__) && defined(BLKGETSIZE64)
+  /* Ask the kernel directly to save running the blockdev tool.  */
+  {
+    int fd;
+    unsigned long long nbytes;
+
+    fd = open (name, O_RDONLY);
+    if (fd != -1)
+      {
+        if (!ioctl (fd, BLKGETSIZE64, &nbytes))
+          {
+            close (fd);
+            *r_nblocks = nbytes / 512;
+            return 0;
+          }
+        close (fd);
+      }
+  }
+#endif /*__linux__*/
+
   argv[0] = "--getsz";
   argv[1] = name;
   argv[2] = NULL;
@@ -110,6 +110,39 @@ check_blockdev (const char *devname, int expect_busy)
   devmajor = major (sb.st_rdev);
   devminor = minor (sb.st_rdev);
 
+  /* The kernel lists all device mapper targets using the device in
+   * its holders directory.  Looking there saves running dmsetup for
+   * each mount; if sysfs is not available we fall back to dmsetup.  */
+  {
+    char holders[64];
+    gnupg_dir_t dir;
+    gnupg_dirent_t dentry;
+    int busy = 0;
+
+    snprintf (holders, sizeof holders, "/sys/dev/block/%u:%u/holders",
+              devmajor, devminor);
+    dir = gnupg_opendir (holders);
+    if (dir)
+      {
+        while ((dentry = gnupg_readdir (dir)))
+          if (!strncmp (dentry->d_name, "dm-", 3))
+            {
+              busy = 1;
+              break;
+            }
+        gnupg_closedir (dir);
+        if (busy)
+          {
+            if (!expect_busy)
+              log_error ("device '%s' (%u:%u)"
+                         " already in use by device mapper\n",
+                         devname, devmajor, devminor);
+            return gpg_error (GPG_ERR_EBUSY);
+          }
+        return 0;
+      }
+  }
+
   {
     const char *argv[2];
 
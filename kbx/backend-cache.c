@@ -38,12 +38,16 @@
 #include "keybox-defs.h"
 
 
-/* Standard values for the number of buckets and the threshold we use
- * to flush items.  */
-#define NO_OF_KEY_ITEM_BUCKETS          383
-#define KEY_ITEMS_PER_BUCKET_THRESHOLD  40
-#define NO_OF_BLOB_BUCKETS              383
-#define BLOBS_PER_BUCKET_THRESHOLD      20
+/* Standard values for the initial number of buckets, the load factor
+ * at which the tables are grown and the limits we use to flush items.
+ * The number of buckets must be a power of two.  */
+#define NO_OF_KEY_ITEM_BUCKETS          512
+#define MAX_KEY_ITEM_BUCKETS            65536
+#define KEY_TABLE_LOAD_FACTOR           4
+#define KEY_ITEMS_PER_BUCKET_THRESHOLD  16
+#define NO_OF_BLOB_BUCKETS              512
+#define BLOB_TABLE_LOAD_FACTOR          2
+#define MAX_CACHED_BLOBS                16384
 
 
 /* Our definition of the backend handle.  */
@@ -58,6 +62,8 @@ struct backend_handle_s
 typedef struct blob_s
 {
   struct blob_s *next;
+  struct blob_s *lru_prev;    /* Next more recently used blob.  */
+  struct blob_s *lru_next;    /* Next less recently used blob.  */
   enum pubkey_types pktype;
   unsigned int refcount;
   unsigned int usecount;
@@ -69,9 +75,13 @@ typedef struct blob_s
 
 static blob_t *blob_table;                /* Hash table with the blobs.   */
 static size_t blob_table_size;            /* Number of allocated buckets. */
-static unsigned int blob_table_threshold; /* Max. # of items per bucket.  */
+static unsigned int blob_table_count;     /* Number of items in the table.*/
 static unsigned int blob_table_added;     /* Number of items added.       */
 static unsigned int blob_table_dropped;   /* Number of items dropped.     */
+static unsigned int blob_table_hits;      /* Number of cache hits.        */
+static unsigned int blob_table_misses;    /* Number of cache misses.      */
+static blob_t blob_lru_head;              /* Most recently used blob.     */
+static blob_t blob_lru_tail;              /* Least recently used blob.    */
 static blob_t blob_attic;                 /* List of freed blobs.         */
 
 
@@ -116,19 +126,23 @@ typedef struct key_item_s
 static key_item_t *key_table;            /* Hash table with the keys.    */
 static size_t key_table_size;            /* Number of allocated buckets. */
 static unsigned int key_table_threshold; /* Max. # of items per bucket.  */
+static unsigned int key_table_count;     /* Number of items in the table.*/
 static unsigned int key_table_added;     /* Number of items added.       */
 static unsigned int key_table_dropped;   /* Number of items dropped.     */
+static unsigned int key_table_hits;      /* Number of cache hits.        */
+static unsigned int key_table_misses;    /* Number of cache misses.      */
 static key_item_t key_item_attic;        /* List of freed items.         */
 
 
 
 
-/* The hash function we use for the key_table.  Must not call a system
- * function.  */
+/* The hash function we use for the blob_table.  Must not call a
+ * system function.  The UBID is a hash value and thus the first bytes
+ * are well distributed.  */
 static inline unsigned int
 blob_table_hasher (const unsigned char *ubid)
 {
-  return (ubid[0] << 16 | ubid[1]) % blob_table_size;
+  return buf32_to_u32 (ubid) & (blob_table_size - 1);
 }
 
 
@@ -140,13 +154,81 @@ blob_table_init (void)
   if (blob_table)
     return 0;
   blob_table_size = NO_OF_BLOB_BUCKETS;
-  blob_table_threshold  = BLOBS_PER_BUCKET_THRESHOLD;
   blob_table = xtrycalloc (blob_table_size, sizeof *blob_table);
   if (!blob_table)
     return gpg_error_from_syserror ();
   return 0;
 }
 
+
+/* Double the number of buckets of the blob table and rehash all
+ * items.  The caller needs to start over after a successful call
+ * because the table may have been changed during the allocation.  */
+static gpg_error_t
+blob_table_grow (void)
+{
+  gpg_error_t err;
+  blob_t *newtable, b, b_next;
+  size_t newsize, idx;
+  unsigned int hash;
+
+  newsize = blob_table_size * 2;
+  newtable = xtrycalloc (newsize, sizeof *newtable);
+  if (!newtable)
+    {
+      err = gpg_error_from_syserror ();
+      log_info ("Note: malloc failed while growing the blob cache: %s\n",
+                gpg_strerror (err));
+      return err;
+    }
+
+  /* Move all items to the new table.  Note that we may not use any
+   * system call here.  */
+  for (idx=0; idx < blob_table_size; idx++)
+    for (b = blob_table[idx]; b; b = b_next)
+      {
+        b_next = b->next;
+        hash = buf32_to_u32 (b->ubid) & (newsize - 1);
+        b->next = newtable[hash];
+        newtable[hash] = b;
+      }
+  xfree (blob_table);
+  blob_table = newtable;
+  blob_table_size = newsize;
+  return 0;
+}
+
+
+/* Remove the blob B from the LRU list.  */
+static void
+blob_lru_remove (blob_t b)
+{
+  if (b->lru_prev)
+    b->lru_prev->lru_next = b->lru_next;
+  else
+    blob_lru_head = b->lru_next;
+  if (b->lru_next)
+    b->lru_next->lru_prev = b->lru_prev;
+  else
+    blob_lru_tail = b->lru_prev;
+  b->lru_prev = b->lru_next = NULL;
+}
+
+
+/* Insert the blob B at the head of the LRU list.  */
+static void
+blob_lru_insert (blob_t b)
+{
+  b->lru_prev = NULL;
+  b->lru_next = blob_lru_head;
+  if (blob_lru_head)
+    blob_lru_head->lru_prev = b;
+  else
+    blob_lru_tail = b;
+  blob_lru_head = b;
+}
+
+
 /* Free a blob.  This is done by moving it to the attic list.  */
 static void
 blob_unref (blob_t blob)
@@ -167,57 +249,61 @@ blob_unref (blob_t blob)
 }
 
 
+/* Remove the least recently used blob from the cache.  Blobs still
+ * referenced by a caller are released when that caller calls
+ * blob_unref.  */
+static void
+blob_table_evict (void)
+{
+  blob_t b, *bp;
+
+  b = blob_lru_tail;
+  if (!b)
+    return;
+
+  for (bp = &blob_table[blob_table_hasher (b->ubid)]; *bp; bp = &(*bp)->next)
+    if (*bp == b)
+      {
+        *bp = b->next;
+        break;
+      }
+  b->next = NULL;
+  blob_lru_remove (b);
+  blob_table_count--;
+  blob_table_dropped++;
+  blob_unref (b);
+}
+
+
 /* Given the hash value and the ubid, find the blob in the bucket.
- * Returns NULL if not found or the blob item if found.  Always
- * returns the the number of items searched, which is in the case of a
- * not-found the length of the chain.  */
+ * Returns NULL if not found or the blob item if found.  */
 static blob_t
-find_blob (unsigned int hash, const unsigned char *ubid,
-           unsigned int *r_count)
+find_blob (unsigned int hash, const unsigned char *ubid)
 {
   blob_t b;
-  unsigned int count = 0;
 
-  for (b = blob_table[hash]; b; b = b->next, count++)
+  for (b = blob_table[hash]; b; b = b->next)
     if (!memcmp (b->ubid, ubid, UBID_LEN))
       break;
-  if (r_count)
-    *r_count = count;
   return b;
 }
 
 
-/* Helper for the qsort in key_table_put.  */
-static int
-compare_blobs (const void *arg_a, const void *arg_b)
-{
-  const blob_t a = *(const blob_t *)arg_a;
-  const blob_t b = *(const blob_t *)arg_b;
-
-  /* Reverse sort on the usecount.  */
-  if (a->usecount > b->usecount)
-    return -1;
-  else if (a->usecount == b->usecount)
-    return 0;
-  else
-    return 1;
-}
-
-
 /* Put the blob (BLOBDATA, BLOBDATALEN) into the cache using UBID as
- * the index.  If it is already in the cache nothing happens.  */
+ * the index.  If it is already in the cache nothing happens.  If the
+ * cache is full the least recently used blob is removed.  */
 static void
 blob_table_put (const unsigned char *ubid, enum pubkey_types pktype,
                 const void *blobdata, unsigned int blobdatalen)
 {
   unsigned int hash;
   blob_t b;
-  unsigned int count, n;
+  unsigned int n;
   void *blobdatacopy = NULL;
 
-  hash = blob_table_hasher (ubid);
  find_again:
-  b = find_blob (hash, ubid, &count);
+  hash = blob_table_hasher (ubid);
+  b = find_blob (hash, ubid);
   if (b)
     {
       xfree (blobdatacopy);
@@ -235,73 +321,18 @@ blob_table_put (const unsigned char *ubid, enum pubkey_types pktype,
           return;  /* Out of core - ignore.  */
         }
       memcpy (blobdatacopy, blobdata, blobdatalen);
+      goto find_again;
     }
 
-  /* If the bucket is full remove a couple of items. */
-  if (count >= blob_table_threshold)
-    {
-      blob_t list_head, *list_tailp, b_next;
-      blob_t *array;
-      int narray, idx;
-
-      /* Unlink from the global list so that other threads don't
-       * disturb us.  If another thread adds or removes something only
-       * one will be the winner.  Bad luck for the dropped cache items
-       * but after all it is just a cache.  */
-      list_head = blob_table[hash];
-      blob_table[hash] = NULL;
-
-      /* Put all items into an array for sorting.  */
-      array = xtrycalloc (count, sizeof *array);
-      if (!array)
-        {
-          /* That's bad; give up all  items of the bucket.  */
-          log_info ("Note: malloc failed while purging blobs from the "
-                    "cache: %s\n", gpg_strerror (gpg_error_from_syserror ()));
-          goto leave_drop;
-        }
-      narray = 0;
-      for (b = list_head; b; b = b_next)
-        {
-          b_next = b->next;
-          array[narray++] = b;
-          b->next = NULL;
-        }
-      log_assert (narray == count);
-
-      /* Sort the array and put half of it onto a new list.  */
-      qsort (array, narray, sizeof *array, compare_blobs);
-      list_head = NULL;
-      list_tailp = &list_head;
-      for (idx=0; idx < narray/2; idx++)
-        {
-          *list_tailp = array[idx];
-          list_tailp = &array[idx]->next;
-        }
-
-      /* Put the new list into the bucket.  */
-      b = blob_table[hash];
-      blob_table[hash] = list_head;
-      list_head = b;
+  /* Make room for the new item.  */
+  while (blob_table_count >= MAX_CACHED_BLOBS)
+    blob_table_evict ();
 
-      /* Free the remaining items and the array.  */
-      for (; idx < narray; idx++)
-        {
-          blob_unref (array[idx]);
-          blob_table_dropped++;
-        }
-      xfree (array);
-
-    leave_drop:
-      /* Free any items added in the meantime by other threads.  This
-       * is also used in case of a malloc problem (which won't update
-       * the counters, though). */
-      for ( ; list_head; list_head = b_next)
-        {
-          b_next = list_head->next;
-          blob_unref (list_head);
-        }
-    }
+  /* Grow the table if the load factor has been reached.  On error we
+   * simply keep on using the current table.  */
+  if (blob_table_count >= blob_table_size * BLOB_TABLE_LOAD_FACTOR
+      && !blob_table_grow ())
+    goto find_again;
 
   /* Add an item to the bucket.  We allocate a whole block of items
    * for cache performance reasons.  */
@@ -343,6 +374,8 @@ blob_table_put (const unsigned char *ubid, enum pubkey_types pktype,
   b->refcount = 1;
   b->next = blob_table[hash];
   blob_table[hash] = b;
+  blob_lru_insert (b);
+  blob_table_count++;
   blob_table_added++;
 }
 
@@ -356,14 +389,18 @@ blob_table_get (const unsigned char *ubid)
   blob_t b;
 
   hash = blob_table_hasher (ubid);
-  b = find_blob (hash, ubid, NULL);
+  b = find_blob (hash, ubid);
   if (b)
     {
       b->usecount++;
       b->refcount++;
+      blob_lru_remove (b);
+      blob_lru_insert (b);
+      blob_table_hits++;
       return b;  /* Found  */
     }
 
+  blob_table_misses++;
   return NULL;
 }
 
@@ -374,7 +411,7 @@ blob_table_get (const unsigned char *ubid)
 static inline unsigned int
 key_table_hasher (u32 kid_l)
 {
-  return kid_l % key_table_size;
+  return kid_l & (key_table_size - 1);
 }
 
 
@@ -393,6 +430,44 @@ key_table_init (void)
   return 0;
 }
 
+
+/* Double the number of buckets of the key table and rehash all
+ * items.  The caller needs to start over after a successful call
+ * because the table may have been changed during the allocation.  */
+static gpg_error_t
+key_table_grow (void)
+{
+  gpg_error_t err;
+  key_item_t *newtable, ki, ki_next;
+  size_t newsize, idx;
+  unsigned int hash;
+
+  newsize = key_table_size * 2;
+  newtable = xtrycalloc (newsize, sizeof *newtable);
+  if (!newtable)
+    {
+      err = gpg_error_from_syserror ();
+      log_info ("Note: malloc failed while growing the key cache: %s\n",
+                gpg_strerror (err));
+      return err;
+    }
+
+  /* Move all items to the new table.  Note that we may not use any
+   * system call here.  */
+  for (idx=0; idx < key_table_size; idx++)
+    for (ki = key_table[idx]; ki; ki = ki_next)
+      {
+        ki_next = ki->next;
+        hash = ki->kid_l & (newsize - 1);
+        ki->next = newtable[hash];
+        newtable[hash] = ki;
+      }
+  xfree (key_table);
+  key_table = newtable;
+  key_table_size = newsize;
+  return 0;
+}
+
 /* Free a key_item.  This is done by moving it to the attic list.  */
 static void
 key_item_unref (key_item_t ki)
@@ -606,6 +681,7 @@ maybe_flush_some_key_buckets (unsigned int hash, unsigned int count)
   for (; idx < narray; idx++)
     {
       key_item_unref (array[idx]);
+      key_table_count--;
       key_table_dropped++;
     }
   xfree (array);
@@ -619,6 +695,7 @@ maybe_flush_some_key_buckets (unsigned int hash, unsigned int count)
     {
       ki_next = list_head->next;
       key_item_unref (list_head);
+      key_table_count--;
     }
   return err;
 }
@@ -641,8 +718,8 @@ do_key_table_put (u32 kid_h, u32 kid_l,
   int do_find_again;
   int mark_not_found = !fpr;
 
-  hash = key_table_hasher (kid_l);
  find_again:
+  hash = key_table_hasher (kid_l);
   do_find_again = 0;
   ki = find_in_chain (hash, kid_h, kid_l, &count);
   if (ki)
@@ -677,6 +754,13 @@ do_key_table_put (u32 kid_h, u32 kid_l,
       return;
     }
 
+  /* Grow the table if the load factor has been reached.  On error we
+   * simply keep on using the current table.  */
+  if (key_table_count >= key_table_size * KEY_TABLE_LOAD_FACTOR
+      && key_table_size < MAX_KEY_ITEM_BUCKETS
+      && !key_table_grow ())
+    goto find_again;
+
   /* If the bucket is full remove a couple of items. */
   if (maybe_flush_some_key_buckets (hash, count))
     {
@@ -720,6 +804,7 @@ do_key_table_put (u32 kid_h, u32 kid_l,
 
   ki->next = key_table[hash];
   key_table[hash] = ki;
+  key_table_count++;
   key_table_added++;
 }
 
@@ -798,9 +883,11 @@ key_table_get (u32 kid_h, u32 kid_l)
     {
       ki->usecount++;
       ki->refcount++;
+      key_table_hits++;
       return ki;  /* Found  */
     }
 
+  key_table_misses++;
   return NULL;
 }
 
@@ -1199,3 +1286,31 @@ be_cache_not_found (ctrl_t ctrl, enum pubkey_types pubkey_type,
         }
     }
 }
+
+
+/* Send statistics about the cache as data lines to the client.  This
+ * is used to size the cache.  */
+gpg_error_t
+be_cache_print_stats (ctrl_t ctrl)
+{
+  gpg_error_t err;
+  char line[200];
+
+  snprintf (line, sizeof line,
+            "blobs items=%u max=%u buckets=%zu added=%u hits=%u misses=%u"
+            " evicted=%u\n",
+            blob_table_count, MAX_CACHED_BLOBS, blob_table_size,
+            blob_table_added, blob_table_hits, blob_table_misses,
+            blob_table_dropped);
+  err = kbxd_write_data_line (ctrl, line, strlen (line));
+  if (err)
+    return err;
+
+  snprintf (line, sizeof line,
+            "keys items=%u buckets=%zu added=%u hits=%u misses=%u"
+            " evicted=%u\n",
+            key_table_count, key_table_size,
+            key_table_added, key_table_hits, key_table_misses,
+            key_table_dropped);
+  return kbxd_write_data_line (ctrl, line, strlen (line));
+}
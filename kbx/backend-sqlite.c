@@ -29,6 +29,7 @@
 #include "keyboxd.h"
 #include "../common/i18n.h"
 #include "../common/mbox-util.h"
+#include "../common/bloom.h"
 #include "backend.h"
 #include "keybox-search-desc.h"
 #include "keybox-defs.h"  /* (for the openpgp parser) */
@@ -48,9 +49,19 @@ struct backend_handle_s
 /* Definition of local request data.  */
 struct be_sqlite_local_s
 {
-  /* The statement object of the current select command.  */
+  /* The statement object of the current select command.  This is
+   * one of the statements in STMT_CACHE.  */
   sqlite3_stmt *select_stmt;
 
+  /* The prepared select statements indexed by the search mode along
+   * with the filter flags used to prepare them and their connection.  */
+  sqlite3_stmt *stmt_cache[KEYDB_SEARCH_MODE_NEXT + 1];
+  unsigned char stmt_cache_filter[KEYDB_SEARCH_MODE_NEXT + 1];
+  sqlite3 *stmt_cache_db;
+
+  /* The read-only connection taken from the pool or NULL.  */
+  sqlite3 *reader_hd;
+
   /* The column numbers for UIDNO and SUBKEY or 0.  */
   int select_col_uidno;
   int select_col_subkey;
@@ -89,6 +100,75 @@ static sqlite3 *database_hd;
 /* A lockfile used make sure only we are accessing the database.  */
 static dotlock_t database_lock;
 
+/* The maximum number of read-only connections.  */
+#define MAX_READER_CONNECTIONS 16
+
+/* In WAL mode searches are run on read-only connections which are
+ * kept in a pool.  Each search request takes one connection and keeps
+ * it until the request is released; if none is available the
+ * database handle is used.  Only the database handle is used to
+ * modify the database.  Note that we rely on npth not to switch
+ * threads while we work on the pool and thus need no lock for it.  */
+static char *database_fname;
+static int database_wal;
+static sqlite3 *reader_pool[MAX_READER_CONNECTIONS];  /* Idle readers. */
+static unsigned int reader_pool_idle;  /* Number of idle readers.       */
+static unsigned int reader_pool_open;  /* Number of opened readers.     */
+/* True if SQLite may be used by several threads at the same time.  */
+static int sqlite_threadsafe;
+/* True if the full text index for substring searches is available.  */
+static int database_fts;
+
+/* The full text index for substring searches on user ids.  This
+ * requires the trigram tokenizer of FTS5 and is thus optional.  The
+ * index uses the userid table as external content and is kept up to
+ * date by triggers.  */
+static const char *fts_definitions[] =
+  {
+   "CREATE TRIGGER IF NOT EXISTS uidfts_ai AFTER INSERT ON userid BEGIN"
+   " INSERT INTO uidfts(rowid, uid) VALUES (new.rowid, new.uid);"
+   " END",
+
+   "CREATE TRIGGER IF NOT EXISTS uidfts_ad AFTER DELETE ON userid BEGIN"
+   " INSERT INTO uidfts(uidfts, rowid, uid)"
+   " VALUES ('delete', old.rowid, old.uid);"
+   " END",
+
+   "CREATE TRIGGER IF NOT EXISTS uidfts_au AFTER UPDATE ON userid BEGIN"
+   " INSERT INTO uidfts(uidfts, rowid, uid)"
+   " VALUES ('delete', old.rowid, old.uid);"
+   " INSERT INTO uidfts(rowid, uid) VALUES (new.rowid, new.uid);"
+   " END"
+  };
+
+/* The search indices which are dropped for a bulk transaction and
+ * re-created by its commit.  The indices on the ubid columns are kept
+ * because they are required to replace the rows of a keyblock.  */
+static const char *bulk_drop_statements[] =
+  {
+   "DROP INDEX IF EXISTS fingerprintidx1",
+   "DROP INDEX IF EXISTS fingerprintidx2",
+   "DROP INDEX IF EXISTS fingerprintidx3",
+   "DROP INDEX IF EXISTS fingerprintidx4",
+   "DROP INDEX IF EXISTS userididx1",
+   "DROP INDEX IF EXISTS userididx3",
+   "DROP INDEX IF EXISTS userididx4",
+   "DROP INDEX IF EXISTS issueridx1",
+   "DROP TRIGGER IF EXISTS uidfts_ai",
+   "DROP TRIGGER IF EXISTS uidfts_ad",
+   "DROP TRIGGER IF EXISTS uidfts_au"
+  };
+
+/* A cache for the prepared statements used to store keyblocks.  They
+ * are all run on DATABASE_HD and identified by the address of their
+ * SQL string which thus must be a string literal.  */
+#define MAX_WRITE_STMTS 16
+static struct
+{
+  const char *sqlstr;
+  sqlite3_stmt *stmt;
+} write_stmts[MAX_WRITE_STMTS];
+
 /* The version of our current database schema.  */
 #define DATABASE_VERSION 1
 
@@ -148,6 +228,11 @@ static struct
    { "CREATE INDEX IF NOT EXISTS fingerprintidx0 on fingerprint (ubid)"    },
    { "CREATE INDEX IF NOT EXISTS fingerprintidx1 on fingerprint (fpr)"     },
    { "CREATE INDEX IF NOT EXISTS fingerprintidx2 on fingerprint (keygrip)" },
+   /* Covering indices for the keyid searches.  */
+   { "CREATE INDEX IF NOT EXISTS fingerprintidx3"
+     " on fingerprint (kid, ubid, subkey)" },
+   { "CREATE INDEX IF NOT EXISTS fingerprintidx4"
+     " on fingerprint (substr(kid,5), ubid, subkey)" },
 
    /* Table to allow fast access via user ids or mail addresses.  */
    { "CREATE TABLE IF NOT EXISTS userid ("
@@ -170,6 +255,9 @@ static struct
    { "CREATE INDEX IF NOT EXISTS userididx0 on userid (ubid)"     },
    { "CREATE INDEX IF NOT EXISTS userididx1 on userid (uid)"      },
    { "CREATE INDEX IF NOT EXISTS userididx3 on userid (addrspec)" },
+   /* Covering index for the mail address search.  */
+   { "CREATE INDEX IF NOT EXISTS userididx4"
+     " on userid (addrspec, ubid, uidno)" },
 
    /* Table to allow fast access via s/n + issuer DN  (X.509 only).  */
    { "CREATE TABLE IF NOT EXISTS issuer ("
@@ -180,7 +268,52 @@ static struct
      /* The Unique Blob ID (usually the truncated fingerprint).  */
      "ubid BLOB NOT NULL REFERENCES pubkey"
      ")"  },
-   { "CREATE INDEX IF NOT EXISTS issueridx1 on issuer (dn)" }
+   { "CREATE INDEX IF NOT EXISTS issueridx1 on issuer (dn)" },
+
+   /* Table with information about OpenPGP keyblocks which the client
+    * derived from the self-signatures at STORE time.  Rows are
+    * replaced with each store of the keyblock.  */
+   { "CREATE TABLE IF NOT EXISTS keyinfo ("
+     /* The Unique Blob ID.  */
+     "ubid BLOB NOT NULL PRIMARY KEY REFERENCES pubkey,"
+     /* The order number of the primary user id or 0 for none.  */
+     "uidno INTEGER NOT NULL,"
+     /* The usage flags of the primary key as used by gpg.  */
+     "usage INTEGER NOT NULL,"
+     /* The expiration time of the primary key or 0 for none.  */
+     "expires INTEGER NOT NULL,"
+     /* Whether the primary key has been revoked.  Values: 0 or 1.  */
+     "revoked INTEGER NOT NULL"
+     ")"  },
+
+   /* Table to cache the results of signature verifications done by
+    * the clients.  */
+   { "CREATE TABLE IF NOT EXISTS sigcache ("
+     /* A hash over the signer's fingerprint, the digest of the signed
+      * material, and the signature values.  */
+     "key  BLOB NOT NULL PRIMARY KEY,"
+     /* The result of the verification as defined by the client.  */
+     "result INTEGER NOT NULL"
+     ")"  },
+
+   /* Table with a hash over the OpenPGP keyblock the client received
+    * the last time from a keyserver.  The client uses it to skip the
+    * import of unchanged keyblocks.  */
+   { "CREATE TABLE IF NOT EXISTS kshash ("
+     /* The Unique Blob ID.  */
+     "ubid BLOB NOT NULL PRIMARY KEY REFERENCES pubkey,"
+     /* The hash as computed by the client.  */
+     "hash BLOB NOT NULL"
+     ")"  },
+
+   /* Table with a Bloom filter over all fingerprints and keyids.  It
+    * has at most one row which is deleted by a store operation and
+    * re-created on demand.  */
+   { "CREATE TABLE IF NOT EXISTS bloomfilter ("
+     "id     INTEGER NOT NULL PRIMARY KEY,"
+     /* The filter as created by bloom_to_buffer.  */
+     "filter BLOB NOT NULL"
+     ")"  }
 
   };
 
@@ -315,12 +448,13 @@ run_sql_reset (sqlite3_stmt *stmt)
 }
 
 
-/* Run an SQL prepare for SQLSTR and return a statement at R_STMT.  If
- * EXTRA or EXTRA2 are not NULL these parts are appended to the SQL
- * statement.  */
+/* Run an SQL prepare for SQLSTR on the connection DB and return a
+ * statement at R_STMT.  If EXTRA or EXTRA2 are not NULL these parts
+ * are appended to the SQL statement.  */
 static gpg_error_t
-run_sql_prepare (const char *sqlstr, const char *extra, const char *extra2,
-                 sqlite3_stmt **r_stmt)
+run_sql_prepare_db (sqlite3 *db, const char *sqlstr,
+                    const char *extra, const char *extra2,
+                    sqlite3_stmt **r_stmt)
 {
   gpg_error_t err;
   int res;
@@ -334,7 +468,7 @@ run_sql_prepare (const char *sqlstr, const char *extra, const char *extra2,
       sqlstr = buffer;
     }
 
-  res = sqlite3_prepare_v2 (database_hd, sqlstr, -1, r_stmt, NULL);
+  res = sqlite3_prepare_v2 (db, sqlstr, -1, r_stmt, NULL);
   if (res)
     err = diag_prepare_err (res, sqlstr);
   else
@@ -344,6 +478,15 @@ run_sql_prepare (const char *sqlstr, const char *extra, const char *extra2,
 }
 
 
+/* Same as run_sql_prepare_db but always uses the database handle.  */
+static gpg_error_t
+run_sql_prepare (const char *sqlstr, const char *extra, const char *extra2,
+                 sqlite3_stmt **r_stmt)
+{
+  return run_sql_prepare_db (database_hd, sqlstr, extra, extra2, r_stmt);
+}
+
+
 /* Helper to bind a BLOB parameter to a statement.  */
 static gpg_error_t
 run_sql_bind_blob (sqlite3_stmt *stmt, int no,
@@ -377,6 +520,22 @@ run_sql_bind_int (sqlite3_stmt *stmt, int no, int value)
 }
 
 
+/* Helper to bind a 64 bit INTEGER parameter to a statement.  */
+static gpg_error_t
+run_sql_bind_int64 (sqlite3_stmt *stmt, int no, sqlite3_int64 value)
+{
+  gpg_error_t err;
+  int res;
+
+  res = sqlite3_bind_int64 (stmt, no, value);
+  if (res)
+    err = diag_bind_err (res, stmt);
+  else
+    err = 0;
+  return err;
+}
+
+
 /* Helper to bind a string parameter to a statement.  VALUE is allowed
  * to be NULL to bind NULL.  */
 static gpg_error_t
@@ -458,14 +617,23 @@ run_sql_step (sqlite3_stmt *stmt)
 
 /* Wrapper around sqlite3_step for use with select.  This version does
  * not print diags for SQLITE_DONE or SQLITE_ROW but returns them as
- * gpg error codes.  */
+ * gpg error codes.  If UNPROTECT is set other threads may run while
+ * SQLite works on STMT; this may only be used for statements of a
+ * connection not shared with other threads.  */
 static gpg_error_t
-run_sql_step_for_select (sqlite3_stmt *stmt)
+run_sql_step_for_select_ext (sqlite3_stmt *stmt, int unprotect)
 {
   gpg_error_t err;
   int res;
 
-  res = sqlite3_step (stmt);
+  if (unprotect && sqlite_threadsafe)
+    {
+      npth_unprotect ();
+      res = sqlite3_step (stmt);
+      npth_protect ();
+    }
+  else
+    res = sqlite3_step (stmt);
   if (res == SQLITE_DONE || res == SQLITE_ROW)
     err = gpg_error (gpg_err_code_from_sqlite (res));
   else
@@ -483,6 +651,14 @@ run_sql_step_for_select (sqlite3_stmt *stmt)
 }
 
 
+/* Same as run_sql_step_for_select_ext without UNPROTECT.  */
+static gpg_error_t
+run_sql_step_for_select (sqlite3_stmt *stmt)
+{
+  return run_sql_step_for_select_ext (stmt, 0);
+}
+
+
 /* Run the simple SQL statement in SQLSTR.  If UBID is not NULL this
  * will be bound to ?1 in SQLSTR.  This command may not be used for
  * select or other command which return rows.  */
@@ -521,6 +697,177 @@ run_sql_statement (const char *sqlstr)
 }
 
 
+/* Return the prepared statement for the string literal SQLSTR from
+ * the cache or prepare it.  The statement must be passed to
+ * put_write_stmt after use.  */
+static gpg_error_t
+get_write_stmt (const char *sqlstr, sqlite3_stmt **r_stmt)
+{
+  gpg_error_t err;
+  int idx;
+
+  for (idx=0; idx < MAX_WRITE_STMTS && write_stmts[idx].sqlstr; idx++)
+    if (write_stmts[idx].sqlstr == sqlstr)
+      {
+        *r_stmt = write_stmts[idx].stmt;
+        return 0;
+      }
+
+  err = run_sql_prepare (sqlstr, NULL, NULL, r_stmt);
+  if (!err && idx < MAX_WRITE_STMTS)
+    {
+      write_stmts[idx].sqlstr = sqlstr;
+      write_stmts[idx].stmt = *r_stmt;
+    }
+  return err;
+}
+
+
+/* Release STMT as returned by get_write_stmt.  */
+static void
+put_write_stmt (sqlite3_stmt *stmt)
+{
+  int idx;
+
+  if (!stmt)
+    return;
+  for (idx=0; idx < MAX_WRITE_STMTS && write_stmts[idx].sqlstr; idx++)
+    if (write_stmts[idx].stmt == stmt)
+      {
+        sqlite3_reset (stmt);
+        sqlite3_clear_bindings (stmt);
+        return;
+      }
+  sqlite3_finalize (stmt);
+}
+
+
+/* Same as run_sql_statement_bind_ubid but uses the cache of write
+ * statements.  SQLSTR must be a string literal.  */
+static gpg_error_t
+run_write_statement_bind_ubid (const char *sqlstr, const unsigned char *ubid)
+{
+  gpg_error_t err;
+  sqlite3_stmt *stmt;
+
+  err = get_write_stmt (sqlstr, &stmt);
+  if (err)
+    return err;
+  if (ubid)
+    err = run_sql_bind_blob (stmt, 1, ubid, UBID_LEN);
+  if (!err)
+    err = run_sql_step (stmt);
+  put_write_stmt (stmt);
+  return err;
+}
+
+
+/* Switch the database to WAL mode so that readers do not block the
+ * writer and vice versa.  The mode is persistent but SQLite may refuse
+ * it, for example if the file system does not support shared memory.
+ * In this case all searches use the database handle.  */
+static void
+enable_wal_mode (void)
+{
+  sqlite3_stmt *stmt;
+  const char *s;
+
+  database_wal = 0;
+  if (run_sql_prepare ("PRAGMA journal_mode = WAL", NULL, NULL, &stmt))
+    return;
+  if (gpg_err_code (run_sql_step_for_select (stmt)) == GPG_ERR_SQL_ROW)
+    {
+      s = sqlite3_column_text (stmt, 0);
+      database_wal = (s && !strcmp (s, "wal"));
+    }
+  sqlite3_finalize (stmt);
+  if (!database_wal)
+    log_info ("Note: database is not in WAL mode - searches are serialized\n");
+}
+
+
+/* Return true if the schema object NAME of TYPE exists.  */
+static int
+schema_object_exists (const char *type, const char *name)
+{
+  sqlite3_stmt *stmt;
+  int yes = 0;
+
+  if (run_sql_prepare ("SELECT 1 FROM sqlite_master"
+                       " WHERE type = ?1 AND name = ?2",
+                       NULL, NULL, &stmt))
+    return 0;
+  if (!run_sql_bind_text (stmt, 1, type)
+      && !run_sql_bind_text (stmt, 2, name)
+      && gpg_err_code (run_sql_step_for_select (stmt)) == GPG_ERR_SQL_ROW)
+    yes = 1;
+  sqlite3_finalize (stmt);
+  return yes;
+}
+
+
+/* Create or check the optional full text index for user ids.  On
+ * success DATABASE_FTS is set.  */
+static void
+create_fts_index (void)
+{
+  int idx;
+  int need_rebuild = 0;
+
+  database_fts = 0;
+  if (!schema_object_exists ("table", "uidfts"))
+    {
+      /* We do not use run_sql_statement here so that no error is
+       * printed if FTS5 or the trigram tokenizer is not available.  */
+      if (sqlite3_exec (database_hd,
+                        "CREATE VIRTUAL TABLE uidfts USING fts5"
+                        "(uid, content='userid', tokenize='trigram')",
+                        NULL, NULL, NULL))
+        {
+          if (opt.verbose)
+            log_info ("full text index not available: %s\n",
+                      sqlite3_errmsg (database_hd));
+          return;
+        }
+      need_rebuild = 1;
+    }
+  else if (sqlite3_exec (database_hd, "SELECT rowid FROM uidfts LIMIT 0",
+                         NULL, NULL, NULL))
+    {
+      /* The index can't be used with this version of SQLite.  Remove
+       * the triggers so that the userid table can still be updated;
+       * the index will be rebuilt when it can be used again.  */
+      log_info ("full text index not usable: %s\n",
+                sqlite3_errmsg (database_hd));
+      run_sql_statement ("DROP TRIGGER IF EXISTS uidfts_ai");
+      run_sql_statement ("DROP TRIGGER IF EXISTS uidfts_ad");
+      run_sql_statement ("DROP TRIGGER IF EXISTS uidfts_au");
+      return;
+    }
+  else if (!schema_object_exists ("trigger", "uidfts_ai")
+           || !schema_object_exists ("trigger", "uidfts_ad")
+           || !schema_object_exists ("trigger", "uidfts_au"))
+    need_rebuild = 1;
+  else if (sqlite3_exec (database_hd, "INSERT INTO uidfts(uidfts, rank)"
+                         " VALUES ('integrity-check', 1)", NULL, NULL, NULL))
+    {
+      /* The rowids of the userid table may for example have been
+       * changed by a VACUUM.  */
+      log_info ("full text index is not consistent - rebuilding\n");
+      need_rebuild = 1;
+    }
+
+  for (idx=0; idx < DIM (fts_definitions); idx++)
+    if (run_sql_statement (fts_definitions[idx]))
+      return;
+  if (need_rebuild
+      && run_sql_statement ("INSERT INTO uidfts(uidfts) VALUES ('rebuild')"))
+    return;
+
+  database_fts = 1;
+}
+
+
 /* Create and initialize a new SQL database file if it does not
  * exists; else open it and check that all required objects are
  * available.  */
@@ -638,6 +985,13 @@ create_or_open_database (const char *filename)
         err = set_config_value ("created", isotimestamp (gnupg_get_time ()));
     }
 
+  /* Prepare for the use of read-only connections.  */
+  sqlite_threadsafe = sqlite3_threadsafe ();
+  database_fname = xtrystrdup (filename);
+  if (database_fname)
+    enable_wal_mode ();
+
+  create_fts_index ();
 
   err = 0;
 
@@ -703,6 +1057,47 @@ be_sqlite_release_resource (ctrl_t ctrl, backend_handle_t hd)
 }
 
 
+/* Return a read-only connection from the pool or NULL if none is
+ * available.  The connection must be returned using put_reader.  */
+static sqlite3 *
+get_reader (void)
+{
+  sqlite3 *hd;
+  int res;
+
+  if (!database_wal)
+    return NULL;
+  if (reader_pool_idle)
+    return reader_pool[--reader_pool_idle];
+  if (reader_pool_open >= MAX_READER_CONNECTIONS)
+    return NULL;
+
+  res = sqlite3_open_v2 (database_fname, &hd,
+                         SQLITE_OPEN_READONLY | SQLITE_OPEN_NOMUTEX, NULL);
+  if (res)
+    {
+      log_error ("error opening '%s' for reading: %s\n",
+                 database_fname, sqlite3_errstr (res));
+      sqlite3_close (hd);
+      return NULL;
+    }
+  sqlite3_extended_result_codes (hd, 1);
+  reader_pool_open++;
+  return hd;
+}
+
+
+/* Put the read-only connection HD back into the pool.  */
+static void
+put_reader (sqlite3 *hd)
+{
+  if (!hd)
+    return;
+  log_assert (reader_pool_idle < reader_pool_open);
+  reader_pool[reader_pool_idle++] = hd;
+}
+
+
 /* Helper for be_find_request_part to initialize a sqlite request part.  */
 gpg_error_t
 be_sqlite_init_local (backend_handle_t backend_hd, db_request_part_t part)
@@ -716,20 +1111,96 @@ be_sqlite_init_local (backend_handle_t backend_hd, db_request_part_t part)
 }
 
 
+/* Finalize all cached statements of CTX.  */
+static void
+flush_stmt_cache (be_sqlite_local_t ctx)
+{
+  int idx;
+
+  for (idx=0; idx < DIM (ctx->stmt_cache); idx++)
+    if (ctx->stmt_cache[idx])
+      {
+        sqlite3_finalize (ctx->stmt_cache[idx]);
+        ctx->stmt_cache[idx] = NULL;
+      }
+  ctx->select_stmt = NULL;
+  ctx->stmt_cache_db = NULL;
+}
+
+
 /* Release local data of a sqlite request part.  */
 void
 be_sqlite_release_local (be_sqlite_local_t ctx)
 {
-  if (ctx->select_stmt)
-    sqlite3_finalize (ctx->select_stmt);
+  flush_stmt_cache (ctx);
+  put_reader (ctx->reader_hd);
   xfree (ctx);
 }
 
 
+/* Begin the global transaction.  For a bulk transaction the search
+ * indices are dropped; this is done within the transaction so that
+ * other connections still see them and a rollback restores them.  */
+static gpg_error_t
+begin_global_transaction (void)
+{
+  gpg_error_t err;
+  int idx;
+
+  err = run_sql_statement ("begin transaction");
+  if (err)
+    return err;
+
+  if (opt.bulk_transaction)
+    {
+      for (idx=0; idx < DIM (bulk_drop_statements); idx++)
+        if ((err = run_sql_statement (bulk_drop_statements[idx])))
+          break;
+      if (err)
+        {
+          if (run_sql_statement ("rollback"))
+            log_error ("Warning: database rollback failed"
+                       " - should not happen!\n");
+          return err;
+        }
+    }
+
+  opt.active_transaction = 1;
+  return 0;
+}
+
+
+/* Re-create the search indices dropped by begin_global_transaction.  */
+static gpg_error_t
+rebuild_search_indices (void)
+{
+  gpg_error_t err;
+  int idx;
+
+  for (idx=0; idx < DIM (table_definitions); idx++)
+    if (!strncmp (table_definitions[idx].sql, "CREATE INDEX ", 13)
+        && (err = run_sql_statement (table_definitions[idx].sql)))
+      return err;
+
+  if (database_fts)
+    {
+      for (idx=0; idx < DIM (fts_definitions); idx++)
+        if ((err = run_sql_statement (fts_definitions[idx])))
+          return err;
+      err = run_sql_statement ("INSERT INTO uidfts(uidfts) VALUES ('rebuild')");
+      if (err)
+        return err;
+    }
+
+  return 0;
+}
+
+
 gpg_error_t
 be_sqlite_rollback (void)
 {
   opt.in_transaction = 0;
+  opt.bulk_transaction = 0;
   if (!opt.active_transaction)
     return 0;  /* Nothing to do.  */
 
@@ -747,7 +1218,11 @@ be_sqlite_rollback (void)
 gpg_error_t
 be_sqlite_commit (void)
 {
+  gpg_error_t err;
+  int bulk = opt.bulk_transaction;
+
   opt.in_transaction = 0;
+  opt.bulk_transaction = 0;
   if (!opt.active_transaction)
     return 0;  /* Nothing to do.  */
 
@@ -758,6 +1233,19 @@ be_sqlite_commit (void)
     }
 
   opt.active_transaction = 0;
+  if (bulk)
+    {
+      err = rebuild_search_indices ();
+      if (err)
+        {
+          log_error ("error rebuilding the search indices: %s\n",
+                     gpg_strerror (err));
+          if (run_sql_statement ("rollback"))
+            log_error ("Warning: database rollback failed"
+                       " - should not happen!\n");
+          return err;
+        }
+    }
   return run_sql_statement ("commit");
 }
 
@@ -829,14 +1317,17 @@ set_config_value (const char *name, const char *value)
 }
 
 
-/* Run a select for the search given by (DESC,NDESC).  The data is not
- * returned but stored in the request item.  */
+/* Run a select for the search given by (DESC,NDESC) on the
+ * connection DB.  The data is not returned but stored in the request
+ * item.  */
 static gpg_error_t
-run_select_statement (ctrl_t ctrl, be_sqlite_local_t ctx,
+run_select_statement (ctrl_t ctrl, be_sqlite_local_t ctx, sqlite3 *db,
                       KEYDB_SEARCH_DESC *desc, unsigned int ndesc)
 {
   gpg_error_t err = 0;
   unsigned int descidx;
+  KeydbSearchMode mode;
+  unsigned char filter;
   const char *extra = NULL;
   unsigned char kidbuf[8];
   const char *s;
@@ -850,23 +1341,41 @@ run_select_statement (ctrl_t ctrl, be_sqlite_local_t ctx,
       goto leave;
     }
 
-  /* Check whether we can re-use the current select statement.  */
-  if (!ctx->select_stmt)
-    ;
-  else if (ctx->select_mode != desc[descidx].mode)
+  mode = desc[descidx].mode;
+  filter = (ctrl->filter_opgp? 1:0) | (ctrl->filter_x509? 2:0);
+  /* The full text index is not maintained during a bulk transaction;
+   * we use the filter flags to invalidate the cached statements.  */
+  if (opt.in_transaction && opt.bulk_transaction)
+    filter |= 4;
+
+  /* The cached statements can only be used with their connection.  */
+  if (ctx->stmt_cache_db != db)
     {
-      sqlite3_finalize (ctx->select_stmt);
-      ctx->select_stmt = NULL;
+      flush_stmt_cache (ctx);
+      ctx->stmt_cache_db = db;
     }
-  else if (ctx->filter_opgp != ctrl->filter_opgp
-           || ctx->filter_x509 != ctrl->filter_x509)
+
+  /* Reset the previous statement so that it does not keep a read
+   * transaction open while we use another one.  */
+  if (ctx->select_stmt && ctx->select_mode != mode)
+    sqlite3_reset (ctx->select_stmt);
+
+  /* Check whether we can re-use a cached statement.  */
+  ctx->select_stmt = NULL;
+  if (mode < DIM (ctx->stmt_cache) && ctx->stmt_cache[mode])
     {
-      /* The filter flags changed, thus we can't reuse the statement.  */
-      sqlite3_finalize (ctx->select_stmt);
-      ctx->select_stmt = NULL;
+      if (ctx->stmt_cache_filter[mode] != filter)
+        {
+          /* The filter flags changed, thus we can't reuse the
+           * statement.  */
+          sqlite3_finalize (ctx->stmt_cache[mode]);
+          ctx->stmt_cache[mode] = NULL;
+        }
+      else
+        ctx->select_stmt = ctx->stmt_cache[mode];
     }
 
-  ctx->select_mode = desc[descidx].mode;
+  ctx->select_mode = mode;
   ctx->filter_opgp = ctrl->filter_opgp;
   ctx->filter_x509 = ctrl->filter_x509;
 
@@ -901,22 +1410,24 @@ run_select_statement (ctrl_t ctrl, be_sqlite_local_t ctx,
     case KEYDB_SEARCH_MODE_EXACT:
       ctx->select_col_uidno = 5;
       if (!ctx->select_stmt)
-        err = run_sql_prepare ("SELECT p.ubid, p.type, p.ephemeral, p.revoked,"
-                               " p.keyblob, u.uidno"
-                               " FROM pubkey as p, userid as u"
-                               " WHERE p.ubid = u.ubid AND u.uid = ?1",
-                               extra, " ORDER BY p.ubid", &ctx->select_stmt);
+        err = run_sql_prepare_db
+          (db, "SELECT p.ubid, p.type, p.ephemeral, p.revoked,"
+           " p.keyblob, u.uidno"
+           " FROM pubkey as p, userid as u"
+           " WHERE p.ubid = u.ubid AND u.uid = ?1",
+           extra, " ORDER BY p.ubid", &ctx->select_stmt);
       if (!err)
         err = run_sql_bind_text (ctx->select_stmt, 1, desc[descidx].u.name);
       break;
     case KEYDB_SEARCH_MODE_MAIL:
       ctx->select_col_uidno = 5;
       if (!ctx->select_stmt)
-        err = run_sql_prepare ("SELECT p.ubid, p.type, p.ephemeral, p.revoked,"
-                               " p.keyblob, u.uidno"
-                               " FROM pubkey as p, userid as u"
-                               " WHERE p.ubid = u.ubid AND u.addrspec = ?1",
-                               extra, " ORDER BY p.ubid", &ctx->select_stmt);
+        err = run_sql_prepare_db
+          (db, "SELECT p.ubid, p.type, p.ephemeral, p.revoked,"
+           " p.keyblob, u.uidno"
+           " FROM pubkey as p, userid as u"
+           " WHERE p.ubid = u.ubid AND u.addrspec = ?1",
+           extra, " ORDER BY p.ubid", &ctx->select_stmt);
       if (!err)
         {
           s = desc[descidx].u.name;
@@ -937,11 +1448,12 @@ run_select_statement (ctrl_t ctrl, be_sqlite_local_t ctx,
     case KEYDB_SEARCH_MODE_MAILSUB:
       ctx->select_col_uidno = 5;
       if (!ctx->select_stmt)
-        err = run_sql_prepare ("SELECT p.ubid, p.type, p.ephemeral, p.revoked,"
-                               " p.keyblob, u.uidno"
-                               " FROM pubkey as p, userid as u"
-                               " WHERE p.ubid = u.ubid AND u.addrspec LIKE ?1",
-                               extra, " ORDER BY p.ubid", &ctx->select_stmt);
+        err = run_sql_prepare_db
+          (db, "SELECT p.ubid, p.type, p.ephemeral, p.revoked,"
+           " p.keyblob, u.uidno"
+           " FROM pubkey as p, userid as u"
+           " WHERE p.ubid = u.ubid AND u.addrspec LIKE ?1",
+           extra, " ORDER BY p.ubid", &ctx->select_stmt);
       if (!err)
         err = run_sql_bind_text_like (ctx->select_stmt, 1,
                                       desc[descidx].u.name);
@@ -949,12 +1461,21 @@ run_select_statement (ctrl_t ctrl, be_sqlite_local_t ctx,
 
     case KEYDB_SEARCH_MODE_SUBSTR:
       ctx->select_col_uidno = 5;
-      if (!ctx->select_stmt)
-        err = run_sql_prepare ("SELECT p.ubid, p.type, p.ephemeral, p.revoked,"
-                               " p.keyblob, u.uidno"
-                               " FROM pubkey as p, userid as u"
-                               " WHERE p.ubid = u.ubid AND u.uid LIKE ?1",
-                               extra, " ORDER BY p.ubid", &ctx->select_stmt);
+      if (!ctx->select_stmt && database_fts && !(filter & 4))
+        err = run_sql_prepare_db
+          (db, "SELECT p.ubid, p.type, p.ephemeral, p.revoked,"
+           " p.keyblob, u.uidno"
+           " FROM pubkey as p, userid as u"
+           " WHERE p.ubid = u.ubid AND u.uid LIKE ?1"
+           " AND u.rowid IN (SELECT rowid FROM uidfts WHERE uid LIKE ?1)",
+           extra, " ORDER BY p.ubid", &ctx->select_stmt);
+      else if (!ctx->select_stmt)
+        err = run_sql_prepare_db
+          (db, "SELECT p.ubid, p.type, p.ephemeral, p.revoked,"
+           " p.keyblob, u.uidno"
+           " FROM pubkey as p, userid as u"
+           " WHERE p.ubid = u.ubid AND u.uid LIKE ?1",
+           extra, " ORDER BY p.ubid", &ctx->select_stmt);
       if (!err)
         err = run_sql_bind_text_like (ctx->select_stmt, 1,
                                       desc[descidx].u.name);
@@ -967,12 +1488,13 @@ run_select_statement (ctrl_t ctrl, be_sqlite_local_t ctx,
 
     case KEYDB_SEARCH_MODE_ISSUER:
       if (!ctx->select_stmt)
-        err = run_sql_prepare ("SELECT p.ubid, p.type, p.ephemeral, p.revoked,"
-                               " p.keyblob"
-                               " FROM pubkey as p, issuer as i"
-                               " WHERE p.ubid = i.ubid"
-                               " AND i.dn = $1",
-                               extra, " ORDER BY p.ubid", &ctx->select_stmt);
+        err = run_sql_prepare_db
+          (db, "SELECT p.ubid, p.type, p.ephemeral, p.revoked,"
+           " p.keyblob"
+           " FROM pubkey as p, issuer as i"
+           " WHERE p.ubid = i.ubid"
+           " AND i.dn = $1",
+           extra, " ORDER BY p.ubid", &ctx->select_stmt);
       if (!err)
         err = run_sql_bind_text (ctx->select_stmt, 1,
                                  desc[descidx].u.name);
@@ -988,13 +1510,13 @@ run_select_statement (ctrl_t ctrl, be_sqlite_local_t ctx,
       else
         {
           if (!ctx->select_stmt)
-            err = run_sql_prepare ("SELECT p.ubid, p.type, p.ephemeral,"
-                                   " p.revoked, p.keyblob"
-                                   " FROM pubkey as p, issuer as i"
-                                   " WHERE p.ubid = i.ubid"
-                                   " AND i.sn = $1 AND i.dn = $2",
-                                   extra, " ORDER BY p.ubid",
-                                   &ctx->select_stmt);
+            err = run_sql_prepare_db
+              (db, "SELECT p.ubid, p.type, p.ephemeral,"
+               " p.revoked, p.keyblob"
+               " FROM pubkey as p, issuer as i"
+               " WHERE p.ubid = i.ubid"
+               " AND i.sn = $1 AND i.dn = $2",
+               extra, " ORDER BY p.ubid", &ctx->select_stmt);
           if (!err)
             err = run_sql_bind_ntext (ctx->select_stmt, 1,
                                       desc[descidx].sn, desc[descidx].snlen);
@@ -1014,12 +1536,13 @@ run_select_statement (ctrl_t ctrl, be_sqlite_local_t ctx,
     case KEYDB_SEARCH_MODE_SUBJECT:
       ctx->select_col_uidno = 5;
       if (!ctx->select_stmt)
-        err = run_sql_prepare ("SELECT p.ubid, p.type, p.ephemeral, p.revoked,"
-                               " p.keyblob, u.uidno"
-                               " FROM pubkey as p, userid as u"
-                               " WHERE p.ubid = u.ubid"
-                               " AND u.uid = $1",
-                               extra, " ORDER BY p.ubid", &ctx->select_stmt);
+        err = run_sql_prepare_db
+          (db, "SELECT p.ubid, p.type, p.ephemeral, p.revoked,"
+           " p.keyblob, u.uidno"
+           " FROM pubkey as p, userid as u"
+           " WHERE p.ubid = u.ubid"
+           " AND u.uid = $1",
+           extra, " ORDER BY p.ubid", &ctx->select_stmt);
       if (!err)
         err = run_sql_bind_text (ctx->select_stmt, 1,
                                  desc[descidx].u.name);
@@ -1028,12 +1551,13 @@ run_select_statement (ctrl_t ctrl, be_sqlite_local_t ctx,
     case KEYDB_SEARCH_MODE_SHORT_KID:
       ctx->select_col_subkey = 5;
       if (!ctx->select_stmt)
-        err = run_sql_prepare ("SELECT p.ubid, p.type, p.ephemeral,"
-                               " p.revoked, p.keyblob, f.subkey"
-                               " FROM pubkey as p, fingerprint as f"
-                               " WHERE p.ubid = f.ubid AND"
-                               " substr(f.kid,5) = ?1",
-                               extra, " ORDER BY p.ubid", &ctx->select_stmt);
+        err = run_sql_prepare_db
+          (db, "SELECT p.ubid, p.type, p.ephemeral,"
+           " p.revoked, p.keyblob, f.subkey"
+           " FROM pubkey as p, fingerprint as f"
+           " WHERE p.ubid = f.ubid AND"
+           " substr(f.kid,5) = ?1",
+           extra, " ORDER BY p.ubid", &ctx->select_stmt);
       if (!err)
         err = run_sql_bind_blob (ctx->select_stmt, 1,
                                  kid_from_u32 (desc[descidx].u.kid, kidbuf)+4,
@@ -1043,11 +1567,12 @@ run_select_statement (ctrl_t ctrl, be_sqlite_local_t ctx,
     case KEYDB_SEARCH_MODE_LONG_KID:
       ctx->select_col_subkey = 5;
       if (!ctx->select_stmt)
-        err = run_sql_prepare ("SELECT p.ubid, p.type, p.ephemeral,"
-                               " p.revoked, p.keyblob, f.subkey"
-                               " FROM pubkey as p, fingerprint as f"
-                               " WHERE p.ubid = f.ubid AND f.kid = ?1",
-                               extra, " ORDER BY p.ubid", &ctx->select_stmt);
+        err = run_sql_prepare_db
+          (db, "SELECT p.ubid, p.type, p.ephemeral,"
+           " p.revoked, p.keyblob, f.subkey"
+           " FROM pubkey as p, fingerprint as f"
+           " WHERE p.ubid = f.ubid AND f.kid = ?1",
+           extra, " ORDER BY p.ubid", &ctx->select_stmt);
       if (!err)
         err = run_sql_bind_blob (ctx->select_stmt, 1,
                                  kid_from_u32 (desc[descidx].u.kid, kidbuf),
@@ -1057,11 +1582,12 @@ run_select_statement (ctrl_t ctrl, be_sqlite_local_t ctx,
     case KEYDB_SEARCH_MODE_FPR:
       ctx->select_col_subkey = 5;
       if (!ctx->select_stmt)
-        err = run_sql_prepare ("SELECT p.ubid, p.type, p.ephemeral,"
-                               " p.revoked, p.keyblob, f.subkey"
-                               " FROM pubkey as p, fingerprint as f"
-                               " WHERE p.ubid = f.ubid AND f.fpr = ?1",
-                               extra, " ORDER BY p.ubid", &ctx->select_stmt);
+        err = run_sql_prepare_db
+          (db, "SELECT p.ubid, p.type, p.ephemeral,"
+           " p.revoked, p.keyblob, f.subkey"
+           " FROM pubkey as p, fingerprint as f"
+           " WHERE p.ubid = f.ubid AND f.fpr = ?1",
+           extra, " ORDER BY p.ubid", &ctx->select_stmt);
       if (!err)
         err = run_sql_bind_blob (ctx->select_stmt, 1,
                                  desc[descidx].u.fpr, desc[descidx].fprlen);
@@ -1070,11 +1596,12 @@ run_select_statement (ctrl_t ctrl, be_sqlite_local_t ctx,
     case KEYDB_SEARCH_MODE_KEYGRIP:
       ctx->select_col_subkey = 5;
       if (!ctx->select_stmt)
-        err = run_sql_prepare ("SELECT p.ubid, p.type, p.ephemeral, p.revoked,"
-                               " p.keyblob, f.subkey"
-                               " FROM pubkey as p, fingerprint as f"
-                               " WHERE p.ubid = f.ubid AND f.keygrip = ?1",
-                               extra, " ORDER BY p.ubid", &ctx->select_stmt);
+        err = run_sql_prepare_db
+          (db, "SELECT p.ubid, p.type, p.ephemeral, p.revoked,"
+           " p.keyblob, f.subkey"
+           " FROM pubkey as p, fingerprint as f"
+           " WHERE p.ubid = f.ubid AND f.keygrip = ?1",
+           extra, " ORDER BY p.ubid", &ctx->select_stmt);
       if (!err)
         err = run_sql_bind_blob (ctx->select_stmt, 1,
                                  desc[descidx].u.grip, KEYGRIP_LEN);
@@ -1082,10 +1609,11 @@ run_select_statement (ctrl_t ctrl, be_sqlite_local_t ctx,
 
     case KEYDB_SEARCH_MODE_UBID:
       if (!ctx->select_stmt)
-        err = run_sql_prepare ("SELECT ubid, type, ephemeral, revoked, keyblob"
-                               " FROM pubkey as p"
-                               " WHERE ubid = ?1",
-                               extra, NULL, &ctx->select_stmt);
+        err = run_sql_prepare_db
+          (db, "SELECT ubid, type, ephemeral, revoked, keyblob"
+           " FROM pubkey as p"
+           " WHERE ubid = ?1",
+           extra, NULL, &ctx->select_stmt);
       if (!err)
         err = run_sql_bind_blob (ctx->select_stmt, 1,
                                  desc[descidx].u.ubid, UBID_LEN);
@@ -1103,10 +1631,11 @@ run_select_statement (ctrl_t ctrl, be_sqlite_local_t ctx,
           else
             extra = " ORDER by ubid";
 
-          err = run_sql_prepare ("SELECT ubid, type, ephemeral, revoked,"
-                                 " keyblob"
-                                 " FROM pubkey as p",
-                                 extra, NULL, &ctx->select_stmt);
+          err = run_sql_prepare_db
+            (db, "SELECT ubid, type, ephemeral, revoked,"
+             " keyblob"
+             " FROM pubkey as p",
+             extra, NULL, &ctx->select_stmt);
         }
       break;
 
@@ -1119,6 +1648,13 @@ run_select_statement (ctrl_t ctrl, be_sqlite_local_t ctx,
       break;
     }
 
+  /* Keep the new statement for the next search in this mode.  */
+  if (ctx->select_stmt && mode < DIM (ctx->stmt_cache))
+    {
+      ctx->stmt_cache[mode] = ctx->select_stmt;
+      ctx->stmt_cache_filter[mode] = filter;
+    }
+
  leave:
   return err;
 }
@@ -1135,12 +1671,12 @@ be_sqlite_search (ctrl_t ctrl,
   gpg_error_t err;
   db_request_part_t part;
   be_sqlite_local_t ctx;
+  sqlite3 *db;
+  int got_mutex = 0;
 
   log_assert (backend_hd && backend_hd->db_type == DB_TYPE_SQLITE);
   log_assert (request);
 
-  acquire_mutex ();
-
   /* Find the specific request part or allocate it.  */
   err = be_find_request_part (backend_hd, request, &part);
   if (err)
@@ -1168,27 +1704,57 @@ be_sqlite_search (ctrl_t ctrl,
   /* Start a global transaction if needed.  */
   if (!opt.active_transaction && opt.in_transaction)
     {
-      err = run_sql_statement ("begin transaction");
+      acquire_mutex ();
+      got_mutex = 1;
+      err = begin_global_transaction ();
       if (err)
         goto leave;
-      opt.active_transaction = 1;
     }
 
 
  again:
   if (!ctx->select_done)
     {
-      /* Initial search - run the select.  */
-      err = run_select_statement (ctrl, ctx, desc, ndesc);
+      /* Initial search - select the connection and run the select.
+       * Within a transaction we need to see its changes and thus
+       * use the database handle.  On a read-only connection the
+       * statement keeps its read transaction open until the search
+       * ends; thus all NEXT steps see the same snapshot of the
+       * database without blocking the writer.  */
+      db = NULL;
+      if (!opt.in_transaction)
+        {
+          if (!ctx->reader_hd)
+            ctx->reader_hd = get_reader ();
+          db = ctx->reader_hd;
+        }
+      if (!db)
+        db = database_hd;
+      if (db == database_hd && !got_mutex)
+        {
+          acquire_mutex ();
+          got_mutex = 1;
+        }
+      err = run_select_statement (ctrl, ctx, db, desc, ndesc);
       if (err)
         goto leave;
       ctx->select_done = 1;
     }
+  else
+    {
+      db = sqlite3_db_handle (ctx->select_stmt);
+      if (db == database_hd && !got_mutex)
+        {
+          acquire_mutex ();
+          got_mutex = 1;
+        }
+    }
 
   show_sqlstmt (ctx->select_stmt);
 
-  /* SQL select succeeded - get the first or next row. */
-  err = run_sql_step_for_select (ctx->select_stmt);
+  /* SQL select succeeded - get the first or next row.  Other threads
+   * may run while we are using a read-only connection.  */
+  err = run_sql_step_for_select_ext (ctx->select_stmt, db != database_hd);
   if (gpg_err_code (err) == GPG_ERR_SQL_ROW)
     {
       int n;
@@ -1202,7 +1768,7 @@ be_sqlite_search (ctrl_t ctrl,
       n = sqlite3_column_bytes (ctx->select_stmt, 0);
       if (!ubid || n < 0)
         {
-          if (!ubid && sqlite3_errcode (database_hd) == SQLITE_NOMEM)
+          if (!ubid && sqlite3_errcode (db) == SQLITE_NOMEM)
             err = gpg_error (gpg_err_code_from_sqlite (SQLITE_NOMEM));
           else
             err = gpg_error (GPG_ERR_DB_CORRUPTED);
@@ -1235,7 +1801,7 @@ be_sqlite_search (ctrl_t ctrl,
       ctx->lastubid_valid = 1;
 
       n = sqlite3_column_int (ctx->select_stmt, 1);
-      if (!n && sqlite3_errcode (database_hd) == SQLITE_NOMEM)
+      if (!n && sqlite3_errcode (db) == SQLITE_NOMEM)
         {
           err = gpg_error (gpg_err_code_from_sqlite (SQLITE_NOMEM));
           show_sqlstmt (ctx->select_stmt);
@@ -1246,7 +1812,7 @@ be_sqlite_search (ctrl_t ctrl,
       pubkey_type = n;
 
       n = sqlite3_column_int (ctx->select_stmt, 2);
-      if (!n && sqlite3_errcode (database_hd) == SQLITE_NOMEM)
+      if (!n && sqlite3_errcode (db) == SQLITE_NOMEM)
         {
           err = gpg_error (gpg_err_code_from_sqlite (SQLITE_NOMEM));
           show_sqlstmt (ctx->select_stmt);
@@ -1257,7 +1823,7 @@ be_sqlite_search (ctrl_t ctrl,
       is_ephemeral = !!n;
 
       n = sqlite3_column_int (ctx->select_stmt, 3);
-      if (!n && sqlite3_errcode (database_hd) == SQLITE_NOMEM)
+      if (!n && sqlite3_errcode (db) == SQLITE_NOMEM)
         {
           err = gpg_error (gpg_err_code_from_sqlite (SQLITE_NOMEM));
           show_sqlstmt (ctx->select_stmt);
@@ -1271,7 +1837,7 @@ be_sqlite_search (ctrl_t ctrl,
       n = sqlite3_column_bytes (ctx->select_stmt, 4);
       if (!keyblob || n < 0)
         {
-          if (!keyblob && sqlite3_errcode (database_hd) == SQLITE_NOMEM)
+          if (!keyblob && sqlite3_errcode (db) == SQLITE_NOMEM)
             err = gpg_error (gpg_err_code_from_sqlite (SQLITE_NOMEM));
           else
             err = gpg_error (GPG_ERR_DB_CORRUPTED);
@@ -1285,7 +1851,7 @@ be_sqlite_search (ctrl_t ctrl,
       if (ctx->select_col_uidno)
         {
           n = sqlite3_column_int (ctx->select_stmt, ctx->select_col_uidno);
-          if (!n && sqlite3_errcode (database_hd) == SQLITE_NOMEM)
+          if (!n && sqlite3_errcode (db) == SQLITE_NOMEM)
             {
               err = gpg_error (gpg_err_code_from_sqlite (SQLITE_NOMEM));
               show_sqlstmt (ctx->select_stmt);
@@ -1304,7 +1870,7 @@ be_sqlite_search (ctrl_t ctrl,
       if (ctx->select_col_subkey)
         {
           n = sqlite3_column_int (ctx->select_stmt, ctx->select_col_subkey);
-          if (!n && sqlite3_errcode (database_hd) == SQLITE_NOMEM)
+          if (!n && sqlite3_errcode (db) == SQLITE_NOMEM)
             {
               err = gpg_error (gpg_err_code_from_sqlite (SQLITE_NOMEM));
               show_sqlstmt (ctx->select_stmt);
@@ -1341,7 +1907,8 @@ be_sqlite_search (ctrl_t ctrl,
     }
 
  leave:
-  release_mutex ();
+  if (got_mutex)
+    release_mutex ();
   return err;
 }
 
@@ -1365,7 +1932,7 @@ store_into_pubkey (enum kbxd_store_modes mode,
   else /* Auto */
     sqlstr = ("INSERT OR REPLACE INTO pubkey(ubid,type,keyblob)"
               " VALUES(?1,?2,?3)");
-  err = run_sql_prepare (sqlstr, NULL, NULL, &stmt);
+  err = get_write_stmt (sqlstr, &stmt);
   if (err)
     goto leave;
   err = run_sql_bind_blob (stmt, 1, ubid, UBID_LEN);
@@ -1381,8 +1948,45 @@ store_into_pubkey (enum kbxd_store_modes mode,
   err = run_sql_step (stmt);
 
  leave:
-  if (stmt)
-    sqlite3_finalize (stmt);
+  put_write_stmt (stmt);
+  return err;
+}
+
+
+/* Helper for be_sqlite_store to insert a row into the keyinfo
+ * table.  */
+static gpg_error_t
+store_into_keyinfo (const unsigned char *ubid,
+                    const struct kbxd_keyinfo_s *keyinfo)
+{
+  gpg_error_t err;
+  sqlite3_stmt *stmt = NULL;
+
+  err = get_write_stmt ("INSERT OR REPLACE INTO"
+                        " keyinfo(ubid,uidno,usage,expires,revoked)"
+                        " VALUES(?1,?2,?3,?4,?5)", &stmt);
+  if (err)
+    goto leave;
+  err = run_sql_bind_blob (stmt, 1, ubid, UBID_LEN);
+  if (err)
+    goto leave;
+  err = run_sql_bind_int (stmt, 2, keyinfo->uidno);
+  if (err)
+    goto leave;
+  err = run_sql_bind_int (stmt, 3, (int)keyinfo->usage);
+  if (err)
+    goto leave;
+  err = run_sql_bind_int64 (stmt, 4, (sqlite3_int64)keyinfo->expires);
+  if (err)
+    goto leave;
+  err = run_sql_bind_int (stmt, 5, !!keyinfo->revoked);
+  if (err)
+    goto leave;
+
+  err = run_sql_step (stmt);
+
+ leave:
+  put_write_stmt (stmt);
   return err;
 }
 
@@ -1401,7 +2005,7 @@ store_into_fingerprint (const unsigned char *ubid, int subkey,
 
   sqlstr = ("INSERT OR REPLACE INTO fingerprint(fpr,kid,keygrip,subkey,ubid)"
             " VALUES(?1,?2,?3,?4,?5)");
-  err = run_sql_prepare (sqlstr, NULL, NULL, &stmt);
+  err = get_write_stmt (sqlstr, &stmt);
   if (err)
     goto leave;
   err = run_sql_bind_blob (stmt, 1, fpr, fprlen);
@@ -1423,8 +2027,7 @@ store_into_fingerprint (const unsigned char *ubid, int subkey,
   err = run_sql_step (stmt);
 
  leave:
-  if (stmt)
-    sqlite3_finalize (stmt);
+  put_write_stmt (stmt);
   return err;
 }
 
@@ -1443,7 +2046,7 @@ store_into_userid (const unsigned char *ubid, enum pubkey_types pktype,
 
   sqlstr = ("INSERT OR REPLACE INTO userid(uid,addrspec,type,ubid,uidno)"
             " VALUES(?1,?2,?3,?4,?5)");
-  err = run_sql_prepare (sqlstr, NULL, NULL, &stmt);
+  err = get_write_stmt (sqlstr, &stmt);
   if (err)
     goto leave;
 
@@ -1474,8 +2077,7 @@ store_into_userid (const unsigned char *ubid, enum pubkey_types pktype,
   err = run_sql_step (stmt);
 
  leave:
-  if (stmt)
-    sqlite3_finalize (stmt);
+  put_write_stmt (stmt);
   xfree (addrspec);
   return err;
 }
@@ -1494,7 +2096,7 @@ store_into_issuer (const unsigned char *ubid,
 
   sqlstr = ("INSERT OR REPLACE INTO issuer(sn,dn,ubid)"
             " VALUES(?1,?2,?3)");
-  err = run_sql_prepare (sqlstr, NULL, NULL, &stmt);
+  err = get_write_stmt (sqlstr, &stmt);
   if (err)
     goto leave;
 
@@ -1511,8 +2113,7 @@ store_into_issuer (const unsigned char *ubid,
   err = run_sql_step (stmt);
 
  leave:
-  if (stmt)
-    sqlite3_finalize (stmt);
+  put_write_stmt (stmt);
   xfree (addrspec);
   return err;
 }
@@ -1526,7 +2127,8 @@ gpg_error_t
 be_sqlite_store (ctrl_t ctrl, backend_handle_t backend_hd,
                  db_request_t request, enum kbxd_store_modes mode,
                  enum pubkey_types pktype, const unsigned char *ubid,
-                 const void *blob, size_t bloblen)
+                 const void *blob, size_t bloblen,
+                 const struct kbxd_keyinfo_s *keyinfo)
 {
   gpg_error_t err;
   db_request_part_t part;
@@ -1586,13 +2188,19 @@ be_sqlite_store (ctrl_t ctrl, backend_handle_t backend_hd,
     goto leave;
   /* ctx = part->besqlite; */
 
-  if (!opt.active_transaction)
+  if (opt.active_transaction)
+    ;
+  else if (opt.in_transaction)
+    {
+      err = begin_global_transaction ();
+      if (err)
+        goto leave;
+    }
+  else
     {
       err = run_sql_statement ("begin transaction");
       if (err)
         goto leave;
-      if (opt.in_transaction)
-        opt.active_transaction = 1;
     }
   in_transaction = 1;
 
@@ -1600,19 +2208,30 @@ be_sqlite_store (ctrl_t ctrl, backend_handle_t backend_hd,
   if (err)
     goto leave;
 
+  /* The Bloom filter does not know about new keys; thus remove it.
+   * A delete operation does not need to do this because stale
+   * entries merely lead to false positives.  */
+  err = run_write_statement_bind_ubid ("DELETE FROM bloomfilter", NULL);
+  if (err)
+    goto leave;
+
   /* Delete all related rows so that we can freshly add possibly added
    * or changed user ids and subkeys.  */
-  err = run_sql_statement_bind_ubid
+  err = run_write_statement_bind_ubid
     ("DELETE FROM fingerprint WHERE ubid = ?1", ubid);
   if (err)
     goto leave;
-  err = run_sql_statement_bind_ubid
+  err = run_write_statement_bind_ubid
     ("DELETE FROM userid WHERE ubid = ?1", ubid);
   if (err)
     goto leave;
+  err = run_write_statement_bind_ubid
+    ("DELETE FROM keyinfo WHERE ubid = ?1", ubid);
+  if (err)
+    goto leave;
   if (cert)
     {
-      err = run_sql_statement_bind_ubid
+      err = run_write_statement_bind_ubid
         ("DELETE FROM issuer WHERE ubid = ?1", ubid);
       if (err)
         goto leave;
@@ -1733,6 +2352,13 @@ be_sqlite_store (ctrl_t ctrl, backend_handle_t backend_hd,
             }
           while (u);
         }
+
+      if (keyinfo)
+        {
+          err = store_into_keyinfo (ubid, keyinfo);
+          if (err)
+            goto leave;
+        }
     }
 
  leave:
@@ -1789,13 +2415,19 @@ be_sqlite_delete (ctrl_t ctrl, backend_handle_t backend_hd,
     goto leave;
   /* ctx = part->besqlite; */
 
-  if (!opt.active_transaction)
+  if (opt.active_transaction)
+    ;
+  else if (opt.in_transaction)
+    {
+      err = begin_global_transaction ();
+      if (err)
+        goto leave;
+    }
+  else
     {
       err = run_sql_statement ("begin transaction");
       if (err)
         goto leave;
-      if (opt.in_transaction)
-        opt.active_transaction = 1;
     }
   in_transaction = 1;
 
@@ -1807,6 +2439,12 @@ be_sqlite_delete (ctrl_t ctrl, backend_handle_t backend_hd,
   if (!err)
     err = run_sql_statement_bind_ubid
       ("DELETE from issuer WHERE ubid = ?1", ubid);
+  if (!err)
+    err = run_sql_statement_bind_ubid
+      ("DELETE from keyinfo WHERE ubid = ?1", ubid);
+  if (!err)
+    err = run_sql_statement_bind_ubid
+      ("DELETE from kshash WHERE ubid = ?1", ubid);
   if (!err)
     err = run_sql_statement_bind_ubid
       ("DELETE from pubkey WHERE ubid = ?1", ubid);
@@ -1833,3 +2471,277 @@ be_sqlite_delete (ctrl_t ctrl, backend_handle_t backend_hd,
   release_mutex ();
   return err;
 }
+
+
+/* Look up the signature cache entry for KEY of length KEYLEN and
+ * store its result at R_RESULT.  Returns GPG_ERR_NOT_FOUND if there
+ * is no such entry.  */
+gpg_error_t
+be_sqlite_sigcache_get (backend_handle_t backend_hd,
+                        const unsigned char *key, size_t keylen,
+                        int *r_result)
+{
+  gpg_error_t err;
+  sqlite3_stmt *stmt;
+
+  log_assert (backend_hd && backend_hd->db_type == DB_TYPE_SQLITE);
+  *r_result = 0;
+
+  acquire_mutex ();
+
+  err = run_sql_prepare ("SELECT result FROM sigcache WHERE key = ?1",
+                         NULL, NULL, &stmt);
+  if (err)
+    goto leave;
+
+  err = run_sql_bind_blob (stmt, 1, key, keylen);
+  if (!err)
+    {
+      err = run_sql_step_for_select (stmt);
+      if (gpg_err_code (err) == GPG_ERR_SQL_ROW)
+        {
+          *r_result = sqlite3_column_int (stmt, 0);
+          err = 0;
+        }
+      else if (gpg_err_code (err) == GPG_ERR_SQL_DONE)
+        err = gpg_error (GPG_ERR_NOT_FOUND);
+    }
+  sqlite3_finalize (stmt);
+
+ leave:
+  release_mutex ();
+  return err;
+}
+
+
+/* Insert or update the signature cache entry for KEY of length KEYLEN
+ * with RESULT.  */
+gpg_error_t
+be_sqlite_sigcache_put (backend_handle_t backend_hd,
+                        const unsigned char *key, size_t keylen, int result)
+{
+  gpg_error_t err;
+  sqlite3_stmt *stmt;
+
+  log_assert (backend_hd && backend_hd->db_type == DB_TYPE_SQLITE);
+
+  acquire_mutex ();
+
+  err = run_sql_prepare ("INSERT OR REPLACE INTO sigcache(key,result)"
+                         " VALUES(?1,?2)", NULL, NULL, &stmt);
+  if (err)
+    goto leave;
+
+  err = run_sql_bind_blob (stmt, 1, key, keylen);
+  if (!err)
+    err = run_sql_bind_int (stmt, 2, result);
+  if (!err)
+    err = run_sql_step (stmt);
+  sqlite3_finalize (stmt);
+
+ leave:
+  release_mutex ();
+  return err;
+}
+
+
+/* Look up the keyserver hash for the blob UBID and store it at
+ * R_HASH which has room for HASHLEN bytes.  Returns GPG_ERR_NOT_FOUND
+ * if there is no such hash.  */
+gpg_error_t
+be_sqlite_kshash_get (backend_handle_t backend_hd, const unsigned char *ubid,
+                      unsigned char *r_hash, size_t hashlen)
+{
+  gpg_error_t err;
+  sqlite3_stmt *stmt;
+  const void *blob;
+
+  log_assert (backend_hd && backend_hd->db_type == DB_TYPE_SQLITE);
+
+  acquire_mutex ();
+
+  err = run_sql_prepare ("SELECT hash FROM kshash WHERE ubid = ?1",
+                         NULL, NULL, &stmt);
+  if (err)
+    goto leave;
+
+  err = run_sql_bind_blob (stmt, 1, ubid, UBID_LEN);
+  if (!err)
+    {
+      err = run_sql_step_for_select (stmt);
+      if (gpg_err_code (err) == GPG_ERR_SQL_ROW)
+        {
+          blob = sqlite3_column_blob (stmt, 0);
+          if (!blob || sqlite3_column_bytes (stmt, 0) != hashlen)
+            err = gpg_error (GPG_ERR_NOT_FOUND);
+          else
+            {
+              memcpy (r_hash, blob, hashlen);
+              err = 0;
+            }
+        }
+      else if (gpg_err_code (err) == GPG_ERR_SQL_DONE)
+        err = gpg_error (GPG_ERR_NOT_FOUND);
+    }
+  sqlite3_finalize (stmt);
+
+ leave:
+  release_mutex ();
+  return err;
+}
+
+
+/* Store HASH of length HASHLEN as keyserver hash for the blob UBID.
+ * Fails if there is no such blob.  */
+gpg_error_t
+be_sqlite_kshash_put (backend_handle_t backend_hd, const unsigned char *ubid,
+                      const unsigned char *hash, size_t hashlen)
+{
+  gpg_error_t err;
+  sqlite3_stmt *stmt;
+
+  log_assert (backend_hd && backend_hd->db_type == DB_TYPE_SQLITE);
+
+  acquire_mutex ();
+
+  err = run_sql_prepare ("INSERT OR REPLACE INTO kshash(ubid,hash)"
+                         " VALUES(?1,?2)", NULL, NULL, &stmt);
+  if (err)
+    goto leave;
+
+  err = run_sql_bind_blob (stmt, 1, ubid, UBID_LEN);
+  if (!err)
+    err = run_sql_bind_blob (stmt, 2, hash, hashlen);
+  if (!err)
+    err = run_sql_step (stmt);
+  sqlite3_finalize (stmt);
+
+ leave:
+  release_mutex ();
+  return err;
+}
+
+
+/* Build a Bloom filter over all fingerprints and keyids of the
+ * database and store it serialized at R_BUFFER and R_BUFLEN.  Must be
+ * called with the mutex held.  */
+static gpg_error_t
+build_bloom_filter (void **r_buffer, size_t *r_buflen)
+{
+  gpg_error_t err;
+  sqlite3_stmt *stmt;
+  bloom_filter_t bf = NULL;
+  const void *data;
+  int n, count;
+
+  err = run_sql_prepare ("SELECT count(*) FROM fingerprint",
+                         NULL, NULL, &stmt);
+  if (err)
+    return err;
+  err = run_sql_step_for_select (stmt);
+  if (gpg_err_code (err) == GPG_ERR_SQL_ROW)
+    {
+      count = sqlite3_column_int (stmt, 0);
+      err = 0;
+    }
+  sqlite3_finalize (stmt);
+  if (err)
+    return err;
+
+  /* Each row has a fingerprint and a keyid.  */
+  err = bloom_new (&bf, count > 0? 2 * count : 0);
+  if (err)
+    return err;
+
+  err = run_sql_prepare ("SELECT fpr, kid FROM fingerprint",
+                         NULL, NULL, &stmt);
+  if (err)
+    goto leave;
+  while (gpg_err_code (err = run_sql_step_for_select (stmt))
+         == GPG_ERR_SQL_ROW)
+    {
+      data = sqlite3_column_blob (stmt, 0);
+      n = sqlite3_column_bytes (stmt, 0);
+      if (data && n > 0)
+        bloom_add (bf, BLOOM_ITEM_FPR, data, n);
+      data = sqlite3_column_blob (stmt, 1);
+      n = sqlite3_column_bytes (stmt, 1);
+      if (data && n > 0)
+        bloom_add (bf, BLOOM_ITEM_KID, data, n);
+    }
+  sqlite3_finalize (stmt);
+  if (gpg_err_code (err) != GPG_ERR_SQL_DONE)
+    goto leave;
+
+  err = bloom_to_buffer (bf, r_buffer, r_buflen);
+  if (!err && opt.verbose)
+    log_info ("built Bloom filter for %u items (%zu bytes)\n",
+              bloom_count (bf), *r_buflen);
+
+ leave:
+  bloom_release (bf);
+  return err;
+}
+
+
+/* Return the Bloom filter over all fingerprints and keyids of the
+ * database as created by bloom_to_buffer.  The filter is kept in the
+ * database and rebuilt after the database has been changed.  The
+ * caller must xfree the buffer stored at R_BUFFER.  */
+gpg_error_t
+be_sqlite_get_bloom (backend_handle_t backend_hd,
+                     void **r_buffer, size_t *r_buflen)
+{
+  gpg_error_t err;
+  sqlite3_stmt *stmt;
+  const void *data;
+  int n;
+
+  log_assert (backend_hd && backend_hd->db_type == DB_TYPE_SQLITE);
+  *r_buffer = NULL;
+  *r_buflen = 0;
+
+  acquire_mutex ();
+
+  err = run_sql_prepare ("SELECT filter FROM bloomfilter WHERE id = 1",
+                         NULL, NULL, &stmt);
+  if (err)
+    goto leave;
+  err = run_sql_step_for_select (stmt);
+  if (gpg_err_code (err) == GPG_ERR_SQL_ROW)
+    {
+      data = sqlite3_column_blob (stmt, 0);
+      n = sqlite3_column_bytes (stmt, 0);
+      if (!data || n <= 0)
+        err = gpg_error (GPG_ERR_SQL_DONE);  /* Rebuild.  */
+      else if (!(*r_buffer = xtrymalloc (n)))
+        err = gpg_error_from_syserror ();
+      else
+        {
+          memcpy (*r_buffer, data, n);
+          *r_buflen = n;
+          err = 0;
+        }
+    }
+  sqlite3_finalize (stmt);
+  if (gpg_err_code (err) != GPG_ERR_SQL_DONE)
+    goto leave;  /* Found or error.  */
+
+  err = build_bloom_filter (r_buffer, r_buflen);
+  if (err)
+    goto leave;
+
+  /* Store the filter for the next time.  An error here is not fatal;
+   * for example the database may be read-only.  */
+  if (!run_sql_prepare ("INSERT OR REPLACE INTO bloomfilter(id,filter)"
+                        " VALUES(1,?1)", NULL, NULL, &stmt))
+    {
+      if (!run_sql_bind_blob (stmt, 1, *r_buffer, *r_buflen))
+        run_sql_step (stmt);
+      sqlite3_finalize (stmt);
+    }
+
+ leave:
+  release_mutex ();
+  return err;
+}
@@ -133,6 +133,7 @@ void be_cache_pubkey (ctrl_t ctrl, const unsigned char *ubid,
                       enum pubkey_types pubkey_type);
 void be_cache_not_found (ctrl_t ctrl, enum pubkey_types pubkey_type,
                          KEYDB_SEARCH_DESC *desc, unsigned int ndesc);
+gpg_error_t be_cache_print_stats (ctrl_t ctrl);
 
 
 /*-- backend-kbx.c --*/
@@ -175,9 +176,24 @@ gpg_error_t be_sqlite_store (ctrl_t ctrl, backend_handle_t backend_hd,
                              db_request_t request, enum kbxd_store_modes mode,
                              enum pubkey_types pktype,
                              const unsigned char *ubid,
-                             const void *blob, size_t bloblen);
+                             const void *blob, size_t bloblen,
+                             const struct kbxd_keyinfo_s *keyinfo);
 gpg_error_t be_sqlite_delete (ctrl_t ctrl, backend_handle_t backend_hd,
                               db_request_t request, const unsigned char *ubid);
+gpg_error_t be_sqlite_sigcache_get (backend_handle_t backend_hd,
+                                    const unsigned char *key, size_t keylen,
+                                    int *r_result);
+gpg_error_t be_sqlite_sigcache_put (backend_handle_t backend_hd,
+                                    const unsigned char *key, size_t keylen,
+                                    int result);
+gpg_error_t be_sqlite_kshash_get (backend_handle_t backend_hd,
+                                  const unsigned char *ubid,
+                                  unsigned char *r_hash, size_t hashlen);
+gpg_error_t be_sqlite_kshash_put (backend_handle_t backend_hd,
+                                  const unsigned char *ubid,
+                                  const unsigned char *hash, size_t hashlen);
+gpg_error_t be_sqlite_get_bloom (backend_handle_t backend_hd,
+                                 void **r_buffer, size_t *r_buflen);
 
 
 #endif /*KBX_BACKEND_H*/
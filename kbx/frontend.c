@@ -40,6 +40,14 @@ struct
 } the_database;
 
 
+/* The generation of the database.  It is incremented with each
+ * change so that clients can tell whether their cached data is still
+ * valid.  The epoch is the time the database was set up and tells
+ * apart the counters of different keyboxd processes.  */
+static u32 generation_epoch;
+static unsigned long database_generation;
+
+
 
 /* Take a lock for reading the databases.  */
 static void
@@ -84,6 +92,9 @@ kbxd_set_database (ctrl_t ctrl, const char *filename_arg, int readonly)
   backend_handle_t handle = NULL;
   unsigned int n;
 
+  if (!generation_epoch)
+    generation_epoch = make_timestamp ();
+
   /* Do tilde expansion etc. */
   if (strchr (filename_arg, DIRSEP_C)
 #ifdef HAVE_W32_SYSTEM
@@ -176,6 +187,7 @@ kbxd_release_session_info (ctrl_t ctrl)
 gpg_error_t
 kbxd_rollback (void)
 {
+  database_generation++;
   return be_sqlite_rollback ();
 }
 
@@ -403,10 +415,12 @@ kbxd_search (ctrl_t ctrl, KEYDB_SEARCH_DESC *desc, unsigned int ndesc,
 
 
 /* Store; that is insert or update the key (BLOB,BLOBLEN).  MODE
- * controls whether only updates or only inserts are allowed.  */
+ * controls whether only updates or only inserts are allowed.  If
+ * KEYINFO is not NULL it carries the client's summary of an OpenPGP
+ * keyblock; it is only kept by the SQLite backend.  */
 gpg_error_t
 kbxd_store (ctrl_t ctrl, const void *blob, size_t bloblen,
-            enum kbxd_store_modes mode)
+            enum kbxd_store_modes mode, const struct kbxd_keyinfo_s *keyinfo)
 {
   gpg_error_t err;
   db_request_t request;
@@ -477,7 +491,7 @@ kbxd_store (ctrl_t ctrl, const void *blob, size_t bloblen,
   else if (the_database.db_type == DB_TYPE_SQLITE)
     {
       err = be_sqlite_store (ctrl, the_database.backend_handle, request,
-                             mode, pktype, ubid, blob, bloblen);
+                             mode, pktype, ubid, blob, bloblen, keyinfo);
     }
   else
     {
@@ -486,6 +500,8 @@ kbxd_store (ctrl_t ctrl, const void *blob, size_t bloblen,
       err = gpg_error (GPG_ERR_INTERNAL);
     }
 
+  if (!err)
+    database_generation++;
 
  leave:
   release_lock (ctrl);
@@ -557,6 +573,8 @@ kbxd_delete (ctrl_t ctrl, const unsigned char *ubid)
       err = gpg_error (GPG_ERR_INTERNAL);
     }
 
+  if (!err)
+    database_generation++;
 
  leave:
   release_lock (ctrl);
@@ -564,3 +582,161 @@ kbxd_delete (ctrl_t ctrl, const unsigned char *ubid)
     log_clock ("%s: leave", __func__);
   return err;
 }
+
+
+/* Look up KEY of length KEYLEN in the signature cache and store the
+ * cached result at R_RESULT.  The cache is only supported by the
+ * SQLite backend.  */
+gpg_error_t
+kbxd_sigcache_get (ctrl_t ctrl, const unsigned char *key, size_t keylen,
+                   int *r_result)
+{
+  gpg_error_t err;
+
+  *r_result = 0;
+  take_read_lock (ctrl);
+
+  if (!the_database.db_type)
+    {
+      log_error ("%s: error: no database configured\n", __func__);
+      err = gpg_error (GPG_ERR_NOT_INITIALIZED);
+    }
+  else if (the_database.db_type == DB_TYPE_SQLITE)
+    err = be_sqlite_sigcache_get (the_database.backend_handle,
+                                  key, keylen, r_result);
+  else
+    err = gpg_error (GPG_ERR_NOT_SUPPORTED);
+
+  release_lock (ctrl);
+  return err;
+}
+
+
+/* Store RESULT for KEY of length KEYLEN in the signature cache.  */
+gpg_error_t
+kbxd_sigcache_put (ctrl_t ctrl, const unsigned char *key, size_t keylen,
+                   int result)
+{
+  gpg_error_t err;
+
+  take_read_write_lock (ctrl);
+
+  if (!the_database.db_type)
+    {
+      log_error ("%s: error: no database configured\n", __func__);
+      err = gpg_error (GPG_ERR_NOT_INITIALIZED);
+    }
+  else if (the_database.db_type == DB_TYPE_SQLITE)
+    err = be_sqlite_sigcache_put (the_database.backend_handle,
+                                  key, keylen, result);
+  else
+    err = gpg_error (GPG_ERR_NOT_SUPPORTED);
+
+  release_lock (ctrl);
+  return err;
+}
+
+
+/* Look up the hash over the keyblock last received from a keyserver
+ * for the blob UBID.  The hash is only supported by the SQLite
+ * backend.  */
+gpg_error_t
+kbxd_kshash_get (ctrl_t ctrl, const unsigned char *ubid,
+                 unsigned char *r_hash, size_t hashlen)
+{
+  gpg_error_t err;
+
+  take_read_lock (ctrl);
+
+  if (!the_database.db_type)
+    {
+      log_error ("%s: error: no database configured\n", __func__);
+      err = gpg_error (GPG_ERR_NOT_INITIALIZED);
+    }
+  else if (the_database.db_type == DB_TYPE_SQLITE)
+    err = be_sqlite_kshash_get (the_database.backend_handle,
+                                ubid, r_hash, hashlen);
+  else
+    err = gpg_error (GPG_ERR_NOT_SUPPORTED);
+
+  release_lock (ctrl);
+  return err;
+}
+
+
+/* Store HASH as the hash over the keyblock received from a keyserver
+ * for the blob UBID.  */
+gpg_error_t
+kbxd_kshash_put (ctrl_t ctrl, const unsigned char *ubid,
+                 const unsigned char *hash, size_t hashlen)
+{
+  gpg_error_t err;
+
+  take_read_write_lock (ctrl);
+
+  if (!the_database.db_type)
+    {
+      log_error ("%s: error: no database configured\n", __func__);
+      err = gpg_error (GPG_ERR_NOT_INITIALIZED);
+    }
+  else if (the_database.db_type == DB_TYPE_SQLITE)
+    err = be_sqlite_kshash_put (the_database.backend_handle,
+                                ubid, hash, hashlen);
+  else
+    err = gpg_error (GPG_ERR_NOT_SUPPORTED);
+
+  release_lock (ctrl);
+  return err;
+}
+
+
+/* Return a Bloom filter over all fingerprints and keyids of the
+ * database at R_BUFFER and R_BUFLEN.  The filter is only supported by
+ * the SQLite backend.  */
+gpg_error_t
+kbxd_get_bloom (ctrl_t ctrl, void **r_buffer, size_t *r_buflen)
+{
+  gpg_error_t err;
+
+  *r_buffer = NULL;
+  *r_buflen = 0;
+  /* We need a write lock because the filter may be stored.  */
+  take_read_write_lock (ctrl);
+
+  if (!the_database.db_type)
+    {
+      log_error ("%s: error: no database configured\n", __func__);
+      err = gpg_error (GPG_ERR_NOT_INITIALIZED);
+    }
+  else if (the_database.db_type == DB_TYPE_SQLITE)
+    err = be_sqlite_get_bloom (the_database.backend_handle,
+                               r_buffer, r_buflen);
+  else
+    err = gpg_error (GPG_ERR_NOT_SUPPORTED);
+
+  release_lock (ctrl);
+  return err;
+}
+
+
+/* Return the epoch and the current generation of the database at
+ * R_EPOCH and R_GENERATION.  */
+void
+kbxd_get_generation (u32 *r_epoch, unsigned long *r_generation)
+{
+  *r_epoch = generation_epoch;
+  *r_generation = database_generation;
+}
+
+
+/* Send statistics about the in-memory key cache to the client.  */
+gpg_error_t
+kbxd_cache_stats (ctrl_t ctrl)
+{
+  gpg_error_t err;
+
+  take_read_lock (ctrl);
+  err = be_cache_print_stats (ctrl);
+  release_lock (ctrl);
+  return err;
+}
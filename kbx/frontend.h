@@ -34,8 +34,22 @@ gpg_error_t kbxd_search (ctrl_t ctrl,
                          KEYDB_SEARCH_DESC *desc, unsigned int ndesc,
                          int reset);
 gpg_error_t kbxd_store (ctrl_t ctrl, const void *blob, size_t bloblen,
-                        enum kbxd_store_modes mode);
+                        enum kbxd_store_modes mode,
+                        const struct kbxd_keyinfo_s *keyinfo);
 gpg_error_t kbxd_delete (ctrl_t ctrl, const unsigned char *ubid);
+gpg_error_t kbxd_sigcache_get (ctrl_t ctrl,
+                               const unsigned char *key, size_t keylen,
+                               int *r_result);
+gpg_error_t kbxd_sigcache_put (ctrl_t ctrl,
+                               const unsigned char *key, size_t keylen,
+                               int result);
+gpg_error_t kbxd_kshash_get (ctrl_t ctrl, const unsigned char *ubid,
+                             unsigned char *r_hash, size_t hashlen);
+gpg_error_t kbxd_kshash_put (ctrl_t ctrl, const unsigned char *ubid,
+                             const unsigned char *hash, size_t hashlen);
+gpg_error_t kbxd_get_bloom (ctrl_t ctrl, void **r_buffer, size_t *r_buflen);
+gpg_error_t kbxd_cache_stats (ctrl_t ctrl);
+void kbxd_get_generation (u32 *r_epoch, unsigned long *r_generation);
 
 
 #endif /*KBX_FRONTEND_H*/
@@ -23,6 +23,11 @@
 #include <stdlib.h>
 #include <stddef.h>
 #include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#ifdef HAVE_MMAP
+# include <sys/mman.h>
+#endif
 #include <npth.h>
 #include <assuan.h>
 
@@ -65,6 +70,20 @@ struct kbx_client_data_s
   char *dlinedata;
   size_t dlinedatalen;
   gpg_error_t dlineerr;
+
+  /* Set if the keyboxd may pass large data via a file descriptor
+   * instead of D-lines.  */
+  unsigned int data_via_fd : 1;
+};
+
+
+/* Parameter for the status callback used with D-lines.  */
+struct dline_status_parm_s
+{
+  kbx_client_data_t kcd;
+  membuf_t *mb;
+  gpg_error_t (*status_cb)(void *opaque, const char *line);
+  void *status_cb_value;
 };
 
 
@@ -287,7 +306,17 @@ kbx_client_data_new (kbx_client_data_t *r_kcd, assuan_context_t ctx,
   kcd->ctx = ctx;
 
   if (dlines)
-    goto leave;
+    {
+#if !defined(HAVE_W32_SYSTEM) && defined(HAVE_MMAP)
+      /* Ask the keyboxd to send large data via a memory file
+       * descriptor; this avoids the escaping and the line splitting
+       * of D-lines.  Older versions do not know this option.  */
+      if (!assuan_transact (ctx, "OPTION data-via-fd",
+                            NULL, NULL, NULL, NULL, NULL, NULL))
+        kcd->data_via_fd = 1;
+#endif
+      goto leave;
+    }
 
   rc = npth_mutex_init (&kcd->mutex, NULL);
   if (rc)
@@ -350,6 +379,75 @@ kbx_client_data_simple (kbx_client_data_t kcd, const char *command)
 }
 
 
+/* Read LENGTH bytes of data from the file descriptor FD received
+ * from the keyboxd and append them to MB.  */
+static gpg_error_t
+read_data_fd (int fd, size_t length, membuf_t *mb)
+{
+#if !defined(HAVE_W32_SYSTEM) && defined(HAVE_MMAP)
+  gpg_error_t err;
+  struct stat st;
+  void *p;
+
+  if (length > MAX_DATABLOB_SIZE)
+    return gpg_error (GPG_ERR_TOO_LARGE);
+  if (fstat (fd, &st))
+    return gpg_error_from_syserror ();
+  if (st.st_size < length)
+    return gpg_error (GPG_ERR_TOO_SHORT);  /* Avoid SIGBUS.  */
+
+  p = mmap (NULL, length, PROT_READ, MAP_PRIVATE, fd, 0);
+  if (p == MAP_FAILED)
+    {
+      err = gpg_error_from_syserror ();
+      log_error ("error mapping data from keyboxd: %s\n", gpg_strerror (err));
+      return err;
+    }
+  put_membuf (mb, p, length);
+  munmap (p, length);
+  return 0;
+#else
+  (void)fd;
+  (void)length;
+  (void)mb;
+  return gpg_error (GPG_ERR_NOT_SUPPORTED);
+#endif
+}
+
+
+/* Status callback used with D-lines to catch the DATA_FD status which
+ * indicates that the data is passed via a file descriptor.  All other
+ * status lines are passed on to the caller's status callback.  */
+static gpg_error_t
+dline_status_cb (void *opaque, const char *line)
+{
+  struct dline_status_parm_s *parm = opaque;
+  gpg_error_t err;
+  const char *s;
+  assuan_fd_t afd;
+  int fd;
+
+  if (parm->kcd->data_via_fd && (s = has_leading_keyword (line, "DATA_FD")))
+    {
+      err = assuan_receivefd (parm->kcd->ctx, &afd);
+      if (err)
+        {
+          log_error ("error receiving data fd from keyboxd: %s\n",
+                     gpg_strerror (err));
+          return err;
+        }
+      fd = FD2INT (afd);
+      err = read_data_fd (fd, strtoul (s, NULL, 10), parm->mb);
+      close (fd);
+      return err;
+    }
+
+  if (parm->status_cb)
+    return parm->status_cb (parm->status_cb_value, line);
+  return 0;
+}
+
+
 /* Send the COMMAND down to the keyboxd associated with KCD.
  * STATUS_CB and STATUS_CB_VALUE are the usual status callback as used
  * by assuan_transact.  After this function has returned success
@@ -389,14 +487,19 @@ kbx_client_data_cmd (kbx_client_data_t kcd, const char *command,
     {
       membuf_t mb;
       size_t len;
+      struct dline_status_parm_s parm;
 
       /* log_debug ("%s: sending command '%s' (no fd-passing)\n", */
       /*            __func__, command); */
       init_membuf (&mb, 8192);
+      parm.kcd = kcd;
+      parm.mb = &mb;
+      parm.status_cb = status_cb;
+      parm.status_cb_value = status_cb_value;
       err = assuan_transact (kcd->ctx, command,
                              put_membuf_cb, &mb,
                              NULL, NULL,
-                             status_cb, status_cb_value);
+                             dline_status_cb, &parm);
       if (err)
         {
           if (gpg_err_code (err) != GPG_ERR_NOT_FOUND
@@ -28,11 +28,15 @@
 #include <sys/stat.h>
 #include <unistd.h>
 #include <errno.h>
+#ifdef HAVE_MEMFD_CREATE
+# include <sys/mman.h>
+#endif
 
 #include "keyboxd.h"
 #include <assuan.h>
 #include "../common/i18n.h"
 #include "../common/server-help.h"
+#include "../common/opstats.h"
 #include "../common/userids.h"
 #include "../common/asshelp.h"
 #include "../common/host2net.h"
@@ -45,6 +49,14 @@
 #define set_error(e,t) (ctx ? assuan_set_error (ctx, gpg_error (e), (t)) \
                         /**/: gpg_error (e))
 
+/* Data of at least this size is sent via a memory file descriptor if
+ * the client asked for that.  For smaller data the additional system
+ * calls are more expensive than the escaping of the D lines.  */
+#define MIN_DATA_FD_SIZE 4096
+
+/* The maximum number of results returned by one NEXT --count.  */
+#define MAX_NEXT_COUNT 1000
+
 
 /* Helper to provide packing memory for search descriptions.  */
 struct search_backing_store_s
@@ -87,6 +99,14 @@ struct server_local_s
   /* This flag is set if the last search command was successful.  */
   unsigned int search_any_found : 1;
 
+  /* This flag is set if the client asked to receive large data via a
+   * passed file descriptor instead of D lines.  */
+  unsigned int data_via_fd : 1;
+
+  /* This flag is set if the client asked to be notified about the
+   * database generation.  */
+  unsigned int notify_generation : 1;
+
   /* The first is the current search description as parsed by the
    * cmd_search.  If more than one pattern is required, cmd_search
    * also allocates and sets multi_search_desc and
@@ -103,6 +123,14 @@ struct server_local_s
 
   /* If not NULL write output to this stream instead of using D lines.  */
   estream_t outstream;
+
+  /* If not NULL kbxd_write_data_line collects the data here.  This is
+   * used by SEARCH --multi and NEXT --count to return all keyblocks
+   * in one go.  */
+  membuf_t *multi_data;
+
+  /* Start time of the current command for the statistics.  */
+  unsigned long long cmd_start;
 };
 
 
@@ -191,6 +219,73 @@ kbxd_status_printf (ctrl_t ctrl, const char *keyword, const char *format, ...)
 }
 
 
+/* Send the data (BUFFER,SIZE) to the client by means of a memory
+ * file descriptor.  The file descriptor is followed by the status
+ * line "DATA_FD <size>" which tells the client to fetch it.  Returns
+ * GPG_ERR_NOT_SUPPORTED if this is not possible in which case the
+ * caller shall fall back to D lines.  */
+static gpg_error_t
+write_data_via_fd (ctrl_t ctrl, const void *buffer, size_t size)
+{
+#ifdef HAVE_MEMFD_CREATE
+  assuan_context_t ctx = get_assuan_ctx_from_ctrl (ctrl);
+  gpg_error_t err;
+  const char *p = buffer;
+  size_t nleft = size;
+  ssize_t n;
+  int fd;
+
+  fd = memfd_create ("keyboxd-data", MFD_CLOEXEC);
+  if (fd == -1)
+    {
+      err = gpg_error_from_syserror ();
+      log_error ("error creating memfd: %s\n", gpg_strerror (err));
+      return gpg_error (GPG_ERR_NOT_SUPPORTED);
+    }
+
+  while (nleft)
+    {
+      n = write (fd, p, nleft);
+      if (n < 0 && errno == EINTR)
+        continue;
+      if (n < 0)
+        {
+          err = gpg_error_from_syserror ();
+          log_error ("error writing to memfd: %s\n", gpg_strerror (err));
+          close (fd);
+          return gpg_error (GPG_ERR_NOT_SUPPORTED);
+        }
+      p += n;
+      nleft -= n;
+    }
+  /* The file offset is shared with the client's descriptor.  */
+  if (lseek (fd, 0, SEEK_SET))
+    {
+      err = gpg_error_from_syserror ();
+      log_error ("error seeking memfd: %s\n", gpg_strerror (err));
+      close (fd);
+      return gpg_error (GPG_ERR_NOT_SUPPORTED);
+    }
+
+  err = assuan_sendfd (ctx, INT2FD (fd));
+  close (fd);
+  if (err)
+    {
+      log_error ("error sending memfd: %s\n", gpg_strerror (err));
+      /* We can't fall back because the client may have received the
+       * descriptor.  */
+      return err;
+    }
+  return kbxd_status_printf (ctrl, "DATA_FD", "%zu", size);
+#else /*!HAVE_MEMFD_CREATE*/
+  (void)ctrl;
+  (void)buffer;
+  (void)size;
+  return gpg_error (GPG_ERR_NOT_SUPPORTED);
+#endif /*!HAVE_MEMFD_CREATE*/
+}
+
+
 /* A wrapper around assuan_send_data which makes debugging the output
  * in verbose mode easier.  It also takes CTRL as argument.  */
 gpg_error_t
@@ -203,6 +298,13 @@ kbxd_write_data_line (ctrl_t ctrl, const void *buffer_arg, size_t size)
   if (!ctx) /* Oops - no assuan context.  */
     return gpg_error (GPG_ERR_NOT_PROCESSED);
 
+  /* Collect the data for a multi search.  */
+  if (ctrl && ctrl->server_local && ctrl->server_local->multi_data)
+    {
+      put_membuf (ctrl->server_local->multi_data, buffer, size);
+      return 0;
+    }
+
   /* Write toa file descriptor if enabled.  */
   if (ctrl && ctrl->server_local && ctrl->server_local->outstream)
     {
@@ -221,6 +323,15 @@ kbxd_write_data_line (ctrl_t ctrl, const void *buffer_arg, size_t size)
       goto leave;
     }
 
+  /* Use a memory file descriptor for large data if requested.  */
+  if (ctrl && ctrl->server_local && ctrl->server_local->data_via_fd
+      && size >= MIN_DATA_FD_SIZE)
+    {
+      err = write_data_via_fd (ctrl, buffer, size);
+      if (gpg_err_code (err) != GPG_ERR_NOT_SUPPORTED)
+        goto leave;
+    }
+
   /* If we do not want logging, enable it here.  */
   if (ctrl && ctrl->server_local && ctrl->server_local->inhibit_data_logging)
     ctrl->server_local->inhibit_data_logging_now = 1;
@@ -252,7 +363,7 @@ kbxd_write_data_line (ctrl_t ctrl, const void *buffer_arg, size_t size)
     }
   else
     {
-      err = assuan_send_data (ctx, buffer, size);
+      err = write_assuan_data_lines (ctx, buffer, size);
       if (err)
         {
           gpg_err_set_errno (EIO);  /* For use by data_line_cookie_write.  */
@@ -308,6 +419,18 @@ option_handler (assuan_context_t ctx, const char *key, const char *value)
       if (!ctrl->lc_messages)
         return out_of_core ();
     }
+  else if (!strcmp (key, "notify-generation"))
+    {
+      ctrl->server_local->notify_generation = 1;
+    }
+  else if (!strcmp (key, "data-via-fd"))
+    {
+#ifdef HAVE_MEMFD_CREATE
+      ctrl->server_local->data_via_fd = 1;
+#else
+      err = gpg_error (GPG_ERR_NOT_SUPPORTED);
+#endif
+    }
   else
     err = gpg_error (GPG_ERR_UNKNOWN_OPTION);
 
@@ -316,30 +439,183 @@ option_handler (assuan_context_t ctx, const char *key, const char *value)
 
 
 
+/* If requested by the client emit the status line
+ *
+ *   GENERATION <epoch> <counter>
+ *
+ * with the current generation of the database.  The counter is
+ * incremented with each change of the database and the epoch changes
+ * if the keyboxd is restarted.  Thus a client may keep its caches as
+ * long as both values do not change.  */
+static gpg_error_t
+notify_generation (ctrl_t ctrl)
+{
+  u32 epoch;
+  unsigned long generation;
+
+  if (!ctrl->server_local->notify_generation)
+    return 0;
+
+  kbxd_get_generation (&epoch, &generation);
+  return kbxd_status_printf (ctrl, "GENERATION", "%lu %lu",
+                             (unsigned long)epoch, generation);
+}
+
+
+/* Run a separate search for each of the patterns collected by
+ * SEARCH --more and return the first match of each.  Each match is
+ * announced by a status line
+ *
+ *   SEARCH_RESULT <index> <length>
+ *
+ * which follows the PUBKEY_INFO status of that match.  INDEX is the
+ * zero based index of the pattern and LENGTH the number of bytes the
+ * keyblock occupies in the returned data.  All keyblocks are returned
+ * in one chunk of data in the order of the status lines.  Patterns
+ * without a match are silently skipped.  */
+static gpg_error_t
+do_multi_search (ctrl_t ctrl)
+{
+  gpg_error_t err = 0;
+  KEYBOX_SEARCH_DESC *desc = ctrl->server_local->multi_search_desc;
+  unsigned int ndesc = ctrl->server_local->multi_search_desc_len;
+  unsigned int idx;
+  membuf_t mb;
+  size_t lastlen, len;
+  int any = 0;
+  void *data;
+
+  init_membuf (&mb, 8192);
+  ctrl->server_local->multi_data = &mb;
+  lastlen = 0;
+  for (idx=0; idx < ndesc; idx++)
+    {
+      err = kbxd_search (ctrl, desc + idx, 1, 1);
+      if (gpg_err_code (err) == GPG_ERR_NOT_FOUND)
+        {
+          err = 0;
+          continue;
+        }
+      if (err)
+        break;
+      any = 1;
+      len = get_membuf_len (&mb);
+      err = kbxd_status_printf (ctrl, "SEARCH_RESULT", "%u %zu",
+                                idx, len - lastlen);
+      if (err)
+        break;
+      lastlen = len;
+    }
+  ctrl->server_local->multi_data = NULL;
+
+  data = get_membuf (&mb, &len);
+  if (!data)
+    {
+      if (!err)
+        err = gpg_error_from_syserror ();
+    }
+  else if (!err && !any)
+    err = gpg_error (GPG_ERR_NOT_FOUND);
+  else if (!err && len)
+    err = kbxd_write_data_line (ctrl, data, len);
+  xfree (data);
+
+  /* A following NEXT would continue with only the last pattern;
+   * better reject that.  */
+  ctrl->server_local->search_any_found = 0;
+  return err;
+}
+
+
+/* Continue the search for (DESC,NDESC) and return up to COUNT
+ * matches.  Each match is announced by a status line
+ *
+ *   SEARCH_RESULT <index> <length>
+ *
+ * which follows the PUBKEY_INFO status of that match.  INDEX is the
+ * zero based number of the match in this batch and LENGTH the number
+ * of bytes the keyblock occupies in the returned data.  All keyblocks
+ * are returned in one chunk of data.  Fewer than COUNT matches are
+ * only returned if the end of the search has been reached.  */
+static gpg_error_t
+do_next_batch (ctrl_t ctrl, KEYBOX_SEARCH_DESC *desc, unsigned int ndesc,
+               unsigned int count)
+{
+  gpg_error_t err = 0;
+  unsigned int idx;
+  membuf_t mb;
+  size_t lastlen, len;
+  void *data;
+
+  init_membuf (&mb, 8192);
+  ctrl->server_local->multi_data = &mb;
+  lastlen = 0;
+  for (idx=0; idx < count; idx++)
+    {
+      err = kbxd_search (ctrl, desc, ndesc, 0);
+      if (err)
+        break;
+      len = get_membuf_len (&mb);
+      err = kbxd_status_printf (ctrl, "SEARCH_RESULT", "%u %zu",
+                                idx, len - lastlen);
+      if (err)
+        break;
+      lastlen = len;
+    }
+  ctrl->server_local->multi_data = NULL;
+  if (idx && gpg_err_code (err) == GPG_ERR_NOT_FOUND)
+    err = 0;  /* End of the search - return what we have.  */
+
+  data = get_membuf (&mb, &len);
+  if (!data)
+    {
+      if (!err)
+        err = gpg_error_from_syserror ();
+    }
+  else if (!err && len)
+    err = kbxd_write_data_line (ctrl, data, len);
+  xfree (data);
+  return err;
+}
+
+
 static const char hlp_search[] =
-  "SEARCH [--no-data] [--openpgp|--x509] [[--more] PATTERN]\n"
+  "SEARCH [--no-data] [--openpgp|--x509] [[--more|--multi] PATTERN]\n"
   "\n"
   "Search for the keys identified by PATTERN.  With --more more\n"
   "patterns to be used for the search are expected with the next\n"
   "command.  With --no-data only the search status is returned but\n"
   "not the actual data.  With --openpgp or --x509 only the respective\n"
-  "keys are returned.  See also \"NEXT\".";
+  "keys are returned.  See also \"NEXT\".\n"
+  "\n"
+  "With --multi the patterns given with --more and PATTERN are not\n"
+  "or-ed but searched one by one and the first match of each is\n"
+  "returned.  Each match is announced by a status line\n"
+  "\"SEARCH_RESULT <index> <length>\" following the PUBKEY_INFO status\n"
+  "of that match.  NEXT may not be used after such a search.";
 static gpg_error_t
 cmd_search (assuan_context_t ctx, char *line)
 {
   ctrl_t ctrl = assuan_get_pointer (ctx);
-  int opt_more, opt_no_data, opt_openpgp, opt_x509;
+  int opt_more, opt_multi, opt_no_data, opt_openpgp, opt_x509;
   gpg_error_t err;
   unsigned int n, k;
 
   opt_no_data = has_option (line, "--no-data");
   opt_more = has_option (line, "--more");
+  opt_multi = has_option (line, "--multi");
   opt_openpgp = has_option (line, "--openpgp");
   opt_x509 = has_option (line, "--x509");
   line = skip_options (line);
 
   ctrl->server_local->search_any_found = 0;
 
+  if (opt_more && opt_multi)
+    {
+      err = set_error (GPG_ERR_CONFLICT, "--more and --multi");
+      goto leave;
+    }
+
   if (!*line)
     {
       if (opt_more)
@@ -347,6 +623,11 @@ cmd_search (assuan_context_t ctx, char *line)
           err = set_error (GPG_ERR_INV_ARG, "--more but no pattern");
           goto leave;
         }
+      else if (opt_multi)
+        {
+          err = set_error (GPG_ERR_INV_ARG, "--multi but no pattern");
+          goto leave;
+        }
       else if (!*line && ctrl->server_local->search_expecting_more)
         {
           /* It would be too surprising to first set a pattern but
@@ -368,7 +649,7 @@ cmd_search (assuan_context_t ctx, char *line)
         goto leave;
     }
 
-  if (opt_more || ctrl->server_local->search_expecting_more)
+  if (opt_more || opt_multi || ctrl->server_local->search_expecting_more)
     {
       /* More pattern are expected - store the current one and return
        * success.  */
@@ -479,8 +760,16 @@ cmd_search (assuan_context_t ctx, char *line)
   ctrl->filter_opgp = opt_openpgp;
   ctrl->filter_x509 = opt_x509;
   err = prepare_outstream (ctrl);
+  if (!err)
+    err = notify_generation (ctrl);
   if (err)
     ;
+  else if (opt_multi)
+    {
+      err = do_multi_search (ctrl);
+      ctrl->server_local->multi_search_desc_len = 0;
+      goto leave;
+    }
   else if (ctrl->server_local->multi_search_desc_len)
     err = kbxd_search (ctrl, ctrl->server_local->multi_search_desc,
                        ctrl->server_local->multi_search_desc_len, 1);
@@ -502,17 +791,38 @@ cmd_search (assuan_context_t ctx, char *line)
 
 
 static const char hlp_next[] =
-  "NEXT [--no-data]\n"
+  "NEXT [--no-data] [--count=N]\n"
+  "\n"
+  "Get the next search result from a previous search.  With --count\n"
+  "up to N results are returned at once; each is announced by a\n"
+  "status line \"SEARCH_RESULT <index> <length>\" following its\n"
+  "PUBKEY_INFO status and the keyblocks are returned in one chunk\n"
+  "of data.  Fewer than N results indicate the end of the search.\n"
   "\n"
-  "Get the next search result from a previous search.";
+  "If the database is in WAL mode the results of a SEARCH and the\n"
+  "following NEXT commands are taken from the same snapshot of the\n"
+  "database; changes done in the meantime are not seen and do not\n"
+  "have to wait for the listing to finish.";
 static gpg_error_t
 cmd_next (assuan_context_t ctx, char *line)
 {
   ctrl_t ctrl = assuan_get_pointer (ctx);
   int opt_no_data;
+  unsigned int count = 1;
+  const char *s;
   gpg_error_t err;
 
   opt_no_data = has_option (line, "--no-data");
+  if (has_option_name (line, "--count"))
+    {
+      s = option_value (line, "--count");
+      count = s? atoi (s) : 0;
+      if (count < 1 || count > MAX_NEXT_COUNT)
+        {
+          err = set_error (GPG_ERR_INV_ARG, "invalid value for --count");
+          goto leave;
+        }
+    }
   line = skip_options (line);
 
   if (*line)
@@ -532,6 +842,8 @@ cmd_next (assuan_context_t ctx, char *line)
   ctrl->server_local->inhibit_data_logging_count = 0;
   ctrl->no_data_return = opt_no_data;
   err = prepare_outstream (ctrl);
+  if (!err)
+    err = notify_generation (ctrl);
   if (err)
     ;
   else if (ctrl->server_local->multi_search_desc_len)
@@ -542,8 +854,13 @@ cmd_next (assuan_context_t ctx, char *line)
           == KEYDB_SEARCH_MODE_FIRST)
         ctrl->server_local->multi_search_desc[0].mode = KEYDB_SEARCH_MODE_NEXT;
 
-      err = kbxd_search (ctrl, ctrl->server_local->multi_search_desc,
-                         ctrl->server_local->multi_search_desc_len, 0);
+      if (count > 1)
+        err = do_next_batch (ctrl, ctrl->server_local->multi_search_desc,
+                             ctrl->server_local->multi_search_desc_len,
+                             count);
+      else
+        err = kbxd_search (ctrl, ctrl->server_local->multi_search_desc,
+                           ctrl->server_local->multi_search_desc_len, 0);
     }
   else
     {
@@ -551,7 +868,11 @@ cmd_next (assuan_context_t ctx, char *line)
       if (ctrl->server_local->search_desc.mode == KEYDB_SEARCH_MODE_FIRST)
         ctrl->server_local->search_desc.mode = KEYDB_SEARCH_MODE_NEXT;
 
-      err = kbxd_search (ctrl, &ctrl->server_local->search_desc, 1, 0);
+      if (count > 1)
+        err = do_next_batch (ctrl, &ctrl->server_local->search_desc, 1,
+                             count);
+      else
+        err = kbxd_search (ctrl, &ctrl->server_local->search_desc, 1, 0);
     }
   if (err)
     goto leave;
@@ -564,12 +885,16 @@ cmd_next (assuan_context_t ctx, char *line)
 
 
 static const char hlp_store[] =
-  "STORE [--update|--insert]\n"
+  "STORE [--update|--insert] [--keyinfo=<uidno>:<usage>:<expires>:<rev>]\n"
   "\n"
   "Insert a key into the database.  Whether to insert or update\n"
   "the key is decided by looking at the primary key's fingerprint.\n"
   "With option --update the key must already exist.\n"
   "With option --insert the key must not already exist.\n"
+  "With option --keyinfo the client passes the number of the primary\n"
+  "user id, the usage flags and the expiration time of the primary key\n"
+  "and whether it has been revoked, as derived from the self-signatures\n"
+  "of an OpenPGP key.\n"
   "The actual key material is requested by this function using\n"
   "  INQUIRE BLOB";
 static gpg_error_t
@@ -581,9 +906,25 @@ cmd_store (assuan_context_t ctx, char *line)
   gpg_error_t err;
   unsigned char *value = NULL;
   size_t valuelen;
+  const char *s;
+  struct kbxd_keyinfo_s keyinfo;
+  int have_keyinfo = 0;
 
   opt_update = has_option (line, "--update");
   opt_insert = has_option (line, "--insert");
+  s = option_value (line, "--keyinfo");
+  if (s)
+    {
+      memset (&keyinfo, 0, sizeof keyinfo);
+      if (sscanf (s, "%d:%u:%lu:%d", &keyinfo.uidno, &keyinfo.usage,
+                  &keyinfo.expires, &keyinfo.revoked) != 4
+          || keyinfo.uidno < 0)
+        {
+          err = set_error (GPG_ERR_INV_ARG, "invalid keyinfo");
+          goto leave;
+        }
+      have_keyinfo = 1;
+    }
   line = skip_options (line);
   if (*line)
     {
@@ -611,7 +952,10 @@ cmd_store (assuan_context_t ctx, char *line)
       goto leave;
     }
 
-  err = kbxd_store (ctrl, value, valuelen, mode);
+  err = kbxd_store (ctrl, value, valuelen, mode,
+                    have_keyinfo? &keyinfo : NULL);
+  if (!err)
+    err = notify_generation (ctrl);
 
 
  leave:
@@ -654,6 +998,8 @@ cmd_delete (assuan_context_t ctx, char *line)
     }
 
   err = kbxd_delete (ctrl, ubid);
+  if (!err)
+    err = notify_generation (ctrl);
 
 
  leave:
@@ -662,19 +1008,185 @@ cmd_delete (assuan_context_t ctx, char *line)
 
 
 
+static const char hlp_sigcache[] =
+  "SIGCACHE [--store=<result>] <hexkey>\n"
+  "\n"
+  "Look up the signature cache entry for HEXKEY.  If found the\n"
+  "status line\n"
+  "\n"
+  "  S SIGCACHE <result>\n"
+  "\n"
+  "is emitted; else the error NOT_FOUND is returned.  With option\n"
+  "--store the integer RESULT is stored for HEXKEY.  The key is\n"
+  "opaque to the keyboxd and must be 32 bytes long.";
+static gpg_error_t
+cmd_sigcache (assuan_context_t ctx, char *line)
+{
+  ctrl_t ctrl = assuan_get_pointer (ctx);
+  gpg_error_t err;
+  const char *s;
+  int n, opt_store, result;
+  unsigned char key[32];
+  char numbuf[35];
+
+  s = option_value (line, "--store");
+  opt_store = !!s;
+  result = s? atoi (s) : 0;
+  line = skip_options (line);
+  if (!*line)
+    {
+      err = set_error (GPG_ERR_INV_ARG, "key missing");
+      goto leave;
+    }
+
+  if ((n=hex2bin (line, key, sizeof key)) < 0)
+    {
+      err = set_error (GPG_ERR_INV_ARG, "invalid key");
+      goto leave;
+    }
+  if (line[n])
+    {
+      err = set_error (GPG_ERR_INV_ARG, "garbage after key");
+      goto leave;
+    }
+
+  if (opt_store)
+    err = kbxd_sigcache_put (ctrl, key, sizeof key, result);
+  else
+    {
+      err = kbxd_sigcache_get (ctrl, key, sizeof key, &result);
+      if (!err)
+        {
+          snprintf (numbuf, sizeof numbuf, "%d", result);
+          err = assuan_write_status (ctx, "SIGCACHE", numbuf);
+        }
+    }
+
+ leave:
+  return leave_cmd (ctx, err);
+}
+
+
+
+static const char hlp_kshash[] =
+  "KSHASH [--store=<hexhash>] <hexubid>\n"
+  "\n"
+  "Look up the hash over the keyblock which the client received the\n"
+  "last time from a keyserver for the blob HEXUBID.  If found the\n"
+  "status line\n"
+  "\n"
+  "  S KSHASH <hexhash>\n"
+  "\n"
+  "is emitted; else the error NOT_FOUND is returned.  With option\n"
+  "--store the 32 byte HEXHASH is stored for the blob; it is deleted\n"
+  "along with the blob.";
+static gpg_error_t
+cmd_kshash (assuan_context_t ctx, char *line)
+{
+  ctrl_t ctrl = assuan_get_pointer (ctx);
+  gpg_error_t err;
+  const char *s;
+  int n, opt_store;
+  unsigned char ubid[UBID_LEN];
+  unsigned char hash[32];
+  char hexhash[2 * sizeof hash + 1];
+
+  s = option_value (line, "--store");
+  opt_store = !!s;
+  if (opt_store && hex2bin (s, hash, sizeof hash) < 0)
+    {
+      err = set_error (GPG_ERR_INV_ARG, "invalid hash");
+      goto leave;
+    }
+  line = skip_options (line);
+  if (!*line)
+    {
+      err = set_error (GPG_ERR_INV_ARG, "UBID missing");
+      goto leave;
+    }
+
+  if ((n=hex2bin (line, ubid, sizeof ubid)) < 0)
+    {
+      err = set_error (GPG_ERR_INV_ARG, "invalid UBID");
+      goto leave;
+    }
+  if (line[n])
+    {
+      err = set_error (GPG_ERR_INV_ARG, "garbage after UBID");
+      goto leave;
+    }
+
+  if (opt_store)
+    err = kbxd_kshash_put (ctrl, ubid, hash, sizeof hash);
+  else
+    {
+      err = kbxd_kshash_get (ctrl, ubid, hash, sizeof hash);
+      if (!err)
+        {
+          bin2hex (hash, sizeof hash, hexhash);
+          err = assuan_write_status (ctx, "KSHASH", hexhash);
+        }
+    }
+
+ leave:
+  return leave_cmd (ctx, err);
+}
+
+
+
+static const char hlp_bloom[] =
+  "BLOOM\n"
+  "\n"
+  "Return a Bloom filter over the fingerprints and long keyids of\n"
+  "all keys in the database.  The filter is returned as data in\n"
+  "the format used by the bloom_to_buffer function of GnuPG.  A\n"
+  "client may use it to skip searches for keys which are not in\n"
+  "the database as long as the database generation does not change.\n"
+  "Returns NOT_SUPPORTED if the backend does not support filters.";
+static gpg_error_t
+cmd_bloom (assuan_context_t ctx, char *line)
+{
+  ctrl_t ctrl = assuan_get_pointer (ctx);
+  gpg_error_t err;
+  void *buffer;
+  size_t buflen;
+
+  (void)line;
+
+  err = kbxd_get_bloom (ctrl, &buffer, &buflen);
+  if (!err)
+    err = notify_generation (ctrl);
+  if (!err)
+    err = assuan_send_data (ctx, buffer, buflen);
+  if (!err)
+    err = assuan_send_data (ctx, NULL, 0);  /* Flush line.  */
+  xfree (buffer);
+
+  return leave_cmd (ctx, err);
+}
+
+
+
 static const char hlp_transaction[] =
-  "TRANSACTION [begin|commit|rollback]\n"
+  "TRANSACTION [--bulk] [begin|commit|rollback]\n"
   "\n"
   "For bulk import of data it is often useful to run everything\n"
   "in one transaction.  This can be achieved with this command.\n"
   "If the last connection of client is closed before a commit\n"
   "or rollback an implicit rollback is done.  With no argument\n"
-  "the status of the current transaction is returned.";
+  "the status of the current transaction is returned.\n"
+  "\n"
+  "With option --bulk given to \"begin\" the search indices are\n"
+  "not updated by the stores of the transaction but rebuilt by\n"
+  "the commit.  This is much faster for loading a large number of\n"
+  "keys but makes most searches slow until the commit.";
 static gpg_error_t
 cmd_transaction (assuan_context_t ctx, char *line)
 {
   gpg_error_t err = 0;
+  int opt_bulk;
 
+  opt_bulk = has_option (line, "--bulk");
   line = skip_options (line);
 
   if (!strcmp (line, "begin"))
@@ -686,6 +1198,7 @@ cmd_transaction (assuan_context_t ctx, char *line)
       else
         {
           opt.in_transaction = 1;
+          opt.bulk_transaction = opt_bulk;
           opt.transaction_pid = assuan_get_pid (ctx);
         }
     }
@@ -741,7 +1254,10 @@ static const char hlp_getinfo[] =
   "pid         - Return the process id of the server.\n"
   "socket_name - Return the name of the socket.\n"
   "session_id  - Return the current session_id.\n"
-  "getenv NAME - Return value of envvar NAME\n";
+  "getenv NAME - Return value of envvar NAME\n"
+  "cache_stats - Return statistics about the key cache.\n"
+  "stats       - Return command statistics in Prometheus format.\n"
+  "generation  - Return the epoch and generation of the database.\n";
 static gpg_error_t
 cmd_getinfo (assuan_context_t ctx, char *line)
 {
@@ -771,6 +1287,32 @@ cmd_getinfo (assuan_context_t ctx, char *line)
       snprintf (numbuf, sizeof numbuf, "%u", ctrl->server_local->session_id);
       err = assuan_send_data (ctx, numbuf, strlen (numbuf));
     }
+  else if (!strcmp (line, "cache_stats"))
+    {
+      err = kbxd_cache_stats (ctrl);
+    }
+  else if (!strcmp (line, "stats"))
+    {
+      char *string = opstats_format ("keyboxd");
+
+      if (!string)
+        err = gpg_error_from_syserror ();
+      else
+        {
+          err = assuan_send_data (ctx, string, strlen (string));
+          xfree (string);
+        }
+    }
+  else if (!strcmp (line, "generation"))
+    {
+      u32 epoch;
+      unsigned long generation;
+
+      kbxd_get_generation (&epoch, &generation);
+      snprintf (numbuf, sizeof numbuf, "%lu %lu",
+                (unsigned long)epoch, generation);
+      err = assuan_send_data (ctx, numbuf, strlen (numbuf));
+    }
   else if (!strncmp (line, "getenv", 6)
            && (line[6] == ' ' || line[6] == '\t' || !line[6]))
     {
@@ -851,6 +1393,9 @@ register_commands (assuan_context_t ctx)
     { "NEXT",       cmd_next,       hlp_next   },
     { "STORE",      cmd_store,      hlp_store  },
     { "DELETE",     cmd_delete,     hlp_delete  },
+    { "SIGCACHE",   cmd_sigcache,   hlp_sigcache },
+    { "KSHASH",     cmd_kshash,     hlp_kshash },
+    { "BLOOM",      cmd_bloom,      hlp_bloom },
     { "TRANSACTION",cmd_transaction,hlp_transaction },
     { "GETINFO",    cmd_getinfo,    hlp_getinfo },
     { "OUTPUT",     NULL,           hlp_output },
@@ -871,6 +1416,30 @@ register_commands (assuan_context_t ctx)
 }
 
 
+/* This function is called by libassuan before a command is run.  */
+static gpg_error_t
+pre_cmd_notify (assuan_context_t ctx, const char *cmd)
+{
+  ctrl_t ctrl = assuan_get_pointer (ctx);
+
+  (void)cmd;
+
+  ctrl->server_local->cmd_start = opstats_now ();
+  return 0;
+}
+
+
+/* This function is called by libassuan after a command has been run.  */
+static void
+post_cmd_notify (assuan_context_t ctx, gpg_error_t err)
+{
+  ctrl_t ctrl = assuan_get_pointer (ctx);
+
+  opstats_record (assuan_get_command_name (ctx),
+                  ctrl->server_local->cmd_start, err);
+}
+
+
 /* Note that we do not reset the list of configured keyservers.  */
 static gpg_error_t
 reset_notify (assuan_context_t ctx, char *line)
@@ -985,6 +1554,8 @@ kbxd_start_command_handler (ctrl_t ctrl, gnupg_fd_t fd, unsigned int session_id)
   assuan_set_hello_line (ctx, hello_line);
   assuan_register_option_handler (ctx, option_handler);
   assuan_register_reset_notify (ctx, reset_notify);
+  assuan_register_pre_cmd_notify (ctx, pre_cmd_notify);
+  assuan_register_post_cmd_notify (ctx, post_cmd_notify);
 
   ctrl->server_local->session_id = session_id;
 
@@ -227,6 +227,7 @@ struct keyboxblob {
   byte *blob;
   size_t bloblen;
   off_t fileoffset;
+  struct keybox_map_s *map;  /* If set BLOB points into this mapping.  */
 
   /* stuff used only by keybox_create_blob */
   unsigned char *serialbuf;
@@ -676,6 +677,44 @@ create_blob_header (KEYBOXBLOB blob, int blobtype, int as_ephemeral,
 
 
 
+/* Return the exact size of the blob which create_blob_header and the
+ * following functions will build for BLOB with a keyblock or
+ * certificate of DATALEN bytes.  This is used to allocate the buffer
+ * in one go.  Must be kept in sync with create_blob_header.  */
+static size_t
+compute_blob_size (KEYBOXBLOB blob, int blobtype, int want_fpr32,
+                   size_t datalen)
+{
+  size_t n;
+  int i;
+
+  n = 4 + 1 + 1 + 2 + 4 + 4;                  /* Fixed header.  */
+  n += 2 + 2 + blob->nkeys * (want_fpr32? (32 + 2 + 2 + 20)
+                                        : (20 + 4 + 2 + 2));
+  n += 2 + blob->seriallen;
+  n += 2 + 2 + blob->nuids * (4 + 4 + 2 + 1 + 1);
+  n += 2 + 2 + blob->nsigs * 4;
+  n += 1 + 1 + 2 + 4 + 4 + 4 + 4;             /* Trust and time stamps.  */
+
+  if (blobtype == KEYBOX_BLOBTYPE_PGP && !want_fpr32)
+    {
+      for (i=0; i < blob->nkeys; i++)
+        if (blob->keys[i].off_kid)
+          n += 8;
+    }
+  if (blobtype == KEYBOX_BLOBTYPE_X509)
+    {
+      for (i=0; i < blob->nuids; i++)
+        if (blob->uids[i].name)
+          n += blob->uids[i].len;
+    }
+
+  n += datalen;
+  n += 20;                                    /* Checksum.  */
+  return n;
+}
+
+
 static int
 create_blob_trailer (KEYBOXBLOB blob)
 {
@@ -690,10 +729,11 @@ create_blob_finish (KEYBOXBLOB blob)
   struct membuf *a = blob->buf;
   unsigned char *p;
   unsigned char *pp;
-  size_t n;
+  size_t n, slack;
 
   /* Write placeholders for the checksum.  */
   put_membuf (a, NULL, 20);
+  slack = a->size - a->len;
 
   /* get the memory area */
   n = 0; /* (Just to avoid compiler warning.) */
@@ -730,14 +770,22 @@ create_blob_finish (KEYBOXBLOB blob)
   /* Compute and store the SHA-1 checksum. */
   gcry_md_hash_buffer (GCRY_MD_SHA1, p + n - 20, p, n - 20);
 
-  pp = xtrymalloc (n);
-  if ( !pp )
+  /* If the buffer has been allocated with the exact size (see
+     compute_blob_size) we can take it as is; otherwise we copy it to
+     get rid of the slack.  */
+  if (slack <= 1)
+    pp = p;
+  else
     {
+      pp = xtrymalloc (n);
+      if ( !pp )
+        {
+          xfree (p);
+          return gpg_error_from_syserror ();
+        }
+      memcpy (pp , p, n);
       xfree (p);
-      return gpg_error_from_syserror ();
     }
-  memcpy (pp , p, n);
-  xfree (p);
   blob->blob = pp;
   blob->bloblen = n;
 
@@ -816,7 +864,10 @@ _keybox_create_openpgp_blob (KEYBOXBLOB *r_blob,
   pgp_create_uid_part (blob, info);
   pgp_create_sig_part (blob, NULL);
 
-  init_membuf (&blob->bufbuf, 1024);
+  /* Note that put_membuf requires one spare byte.  */
+  init_membuf (&blob->bufbuf,
+               compute_blob_size (blob, KEYBOX_BLOBTYPE_PGP,
+                                  need_fpr32, imagelen) + 1);
   blob->buf = &blob->bufbuf;
   err = create_blob_header (blob, KEYBOX_BLOBTYPE_PGP,
                             as_ephemeral, need_fpr32);
@@ -901,6 +952,8 @@ _keybox_create_x509_blob (KEYBOXBLOB *r_blob, ksba_cert_t cert,
   char *p;
   char **names = NULL;
   size_t max_names;
+  const unsigned char *image;
+  size_t imagelen;
 
   *r_blob = NULL;
   blob = xtrycalloc (1, sizeof *blob);
@@ -1003,7 +1056,10 @@ _keybox_create_x509_blob (KEYBOXBLOB *r_blob, ksba_cert_t cert,
   blob->sigs[0] = 0;	/* not yet checked */
 
   /* Create a temporary buffer for further processing */
-  init_membuf (&blob->bufbuf, 1024);
+  image = ksba_cert_get_image (cert, &imagelen);
+  init_membuf (&blob->bufbuf,
+               compute_blob_size (blob, KEYBOX_BLOBTYPE_X509, 0,
+                                  image? imagelen : 0) + 1);
   blob->buf = &blob->bufbuf;
   /* write out what we already have */
   rc = create_blob_header (blob, KEYBOX_BLOBTYPE_X509, as_ephemeral, 0);
@@ -1063,6 +1119,30 @@ _keybox_new_blob (KEYBOXBLOB *r_blob,
 }
 
 
+/* Create a blob for the IMAGELEN bytes at offset OFF of the keybox
+ * mapping MAP.  The image is not copied but a reference to MAP is
+ * kept by the blob.  */
+int
+_keybox_new_blob_view (KEYBOXBLOB *r_blob, struct keybox_map_s *map,
+                       size_t off, size_t imagelen)
+{
+  KEYBOXBLOB blob;
+
+  *r_blob = NULL;
+  blob = xtrycalloc (1, sizeof *blob);
+  if (!blob)
+    return gpg_error_from_syserror ();
+
+  blob->blob = map->base + off;
+  blob->bloblen = imagelen;
+  blob->fileoffset = off;
+  blob->map = map;
+  map->refcount++;
+  *r_blob = blob;
+  return 0;
+}
+
+
 void
 _keybox_release_blob (KEYBOXBLOB blob)
 {
@@ -1080,7 +1160,10 @@ _keybox_release_blob (KEYBOXBLOB blob)
     xfree (blob->uids[i].name);
   xfree (blob->uids );
   xfree (blob->sigs );
-  xfree (blob->blob );
+  if (blob->map)
+    _keybox_map_unref (blob->map);
+  else
+    xfree (blob->blob );
   xfree (blob );
 }
 
@@ -28,6 +28,7 @@
         map_assuan_err_with_source (GPG_ERR_SOURCE_DEFAULT, (a))
 
 #include <sys/types.h> /* off_t */
+#include <time.h>      /* time_t */
 
 #include "../common/util.h"
 #include "keybox.h"
@@ -61,11 +62,27 @@ struct keybox_name
   /* Not yet used.  */
   int did_full_scan;
 
+  /* The hash index of the file or NULL if not yet loaded.  The size
+     and mtime of the file when we failed to create an index.  */
+  struct keybox_index_s *index;
+  off_t noindex_filesize;
+  time_t noindex_mtime;
+
   /* The name of the resource file. */
   char fname[1];
 };
 
 
+/* A read-only mapping of a keybox file.  Blobs returned by a search
+   may point into it; thus it is reference counted.  */
+struct keybox_map_s
+{
+  unsigned int refcount;
+  unsigned char *base;
+  size_t length;
+};
+
+
 struct keybox_found_s
 {
   KEYBOXBLOB blob;
@@ -77,6 +94,8 @@ struct keybox_handle {
   KB_NAME kb;
   int secret;             /* this is for a secret keybox */
   estream_t fp;
+  struct keybox_map_s *map;  /* Used instead of FP if not NULL.  */
+  size_t mappos;             /* The read position in MAP.  */
   int eof;
   int error;
   int ephemeral;
@@ -155,6 +174,8 @@ int _keybox_create_x509_blob (KEYBOXBLOB *r_blob, ksba_cert_t cert,
 int  _keybox_new_blob (KEYBOXBLOB *r_blob,
                        unsigned char *image, size_t imagelen,
                        off_t off);
+int  _keybox_new_blob_view (KEYBOXBLOB *r_blob, struct keybox_map_s *map,
+                            size_t off, size_t imagelen);
 void _keybox_release_blob (KEYBOXBLOB blob);
 const unsigned char *_keybox_get_blob_image (KEYBOXBLOB blob, size_t *n);
 off_t _keybox_get_blob_fileoffset (KEYBOXBLOB blob);
@@ -169,6 +190,10 @@ void _keybox_destroy_openpgp_info (keybox_openpgp_info_t info);
 
 /*-- keybox-file.c --*/
 int _keybox_read_blob (KEYBOXBLOB *r_blob, estream_t fp, int *skipped_deleted);
+gpg_error_t _keybox_map_file (const char *fname, struct keybox_map_s **r_map);
+void _keybox_map_unref (struct keybox_map_s *map);
+int _keybox_read_blob_from_map (KEYBOXBLOB *r_blob, struct keybox_map_s *map,
+                                size_t *r_pos, int *skipped_deleted);
 int _keybox_write_blob (KEYBOXBLOB blob, estream_t fp, FILE *outfp);
 
 /*-- keybox-search.c --*/
@@ -176,6 +201,28 @@ gpg_err_code_t _keybox_get_flag_location (const unsigned char *buffer,
                                           size_t length,
                                           int what,
                                           size_t *flag_off, size_t *flag_size);
+int _keybox_get_blob_mail (KEYBOXBLOB blob, int idx,
+                           size_t *r_off, size_t *r_len);
+int _keybox_get_blob_serial (KEYBOXBLOB blob, size_t *r_off, size_t *r_len);
+int _keybox_get_blob_name (KEYBOXBLOB blob, int idx,
+                           size_t *r_off, size_t *r_len);
+#ifdef KEYBOX_WITH_X509
+int _keybox_get_x509_keygrip (KEYBOXBLOB blob, unsigned char *grip);
+#endif /*KEYBOX_WITH_X509*/
+
+/*-- keybox-index.c --*/
+void _keybox_index_release (struct keybox_index_s *idx);
+void _keybox_index_drop (KB_NAME kb);
+gpg_error_t _keybox_index_lookup (KB_NAME kb,
+                                  KEYBOX_SEARCH_DESC *desc, size_t ndesc,
+                                  off_t offset,
+                                  off_t **r_offsets, size_t *r_noffsets);
+int _keybox_index_check_blob (KEYBOX_SEARCH_DESC *desc, size_t ndesc,
+                              KEYBOXBLOB blob);
+void _keybox_index_prepare (KB_NAME kb);
+void _keybox_index_update (KB_NAME kb, off_t start_offset, off_t oldlen,
+                           KEYBOXBLOB blob);
+void _keybox_index_rebuild (KB_NAME kb);
 
 static inline int
 blob_get_type (KEYBOXBLOB blob)
@@ -23,8 +23,16 @@
 #include <string.h>
 #include <errno.h>
 #include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#ifdef HAVE_MMAP
+# include <sys/mman.h>
+#endif
 
 #include "keybox-defs.h"
+#include "../common/host2net.h"
 
 
 #define IMAGELEN_LIMIT (5*1024*1024)
@@ -128,6 +136,142 @@ _keybox_read_blob (KEYBOXBLOB *r_blob, estream_t fp, int *skipped_deleted)
 }
 
 
+/* Map the keybox file FNAME read-only into memory and store a new
+ * mapping with a reference count of 1 at R_MAP.  Returns
+ * GPG_ERR_NOT_SUPPORTED if mapping is not possible; the caller
+ * should then use the stream functions.  Note that the keybox is
+ * never truncated in place: updates are done by renaming a new file
+ * which leaves the mapped file intact.  */
+gpg_error_t
+_keybox_map_file (const char *fname, struct keybox_map_s **r_map)
+{
+#ifdef HAVE_MMAP
+  gpg_error_t err;
+  struct keybox_map_s *map;
+  struct stat st;
+  void *addr;
+  int fd;
+
+  *r_map = NULL;
+  fd = open (fname, O_RDONLY);
+  if (fd == -1)
+    return gpg_error_from_syserror ();
+  if (fstat (fd, &st) || !S_ISREG (st.st_mode) || !st.st_size
+      || (uint64_t)st.st_size > (size_t)(-1))
+    {
+      close (fd);
+      return gpg_error (GPG_ERR_NOT_SUPPORTED);
+    }
+  addr = mmap (NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close (fd);
+  if (addr == MAP_FAILED)
+    return gpg_error (GPG_ERR_NOT_SUPPORTED);
+
+  map = xtrymalloc (sizeof *map);
+  if (!map)
+    {
+      err = gpg_error_from_syserror ();
+      munmap (addr, st.st_size);
+      return err;
+    }
+  map->refcount = 1;
+  map->base = addr;
+  map->length = st.st_size;
+  *r_map = map;
+  return 0;
+#else /*!HAVE_MMAP*/
+  (void)fname;
+  *r_map = NULL;
+  return gpg_error (GPG_ERR_NOT_SUPPORTED);
+#endif /*!HAVE_MMAP*/
+}
+
+
+/* Release a reference to MAP.  */
+void
+_keybox_map_unref (struct keybox_map_s *map)
+{
+  if (!map)
+    return;
+  log_assert (map->refcount);
+  if (--map->refcount)
+    return;
+#ifdef HAVE_MMAP
+  munmap (map->base, map->length);
+#endif
+  xfree (map);
+}
+
+
+/* Same as _keybox_read_blob but read from MAP at the position *R_POS
+ * which is updated.  The returned blob is a view into MAP.  */
+int
+_keybox_read_blob_from_map (KEYBOXBLOB *r_blob, struct keybox_map_s *map,
+                            size_t *r_pos, int *skipped_deleted)
+{
+  const unsigned char *p;
+  size_t pos = *r_pos;
+  size_t imagelen;
+  int type;
+  int rc;
+
+  if (skipped_deleted)
+    *skipped_deleted = 0;
+ again:
+  if (r_blob)
+    *r_blob = NULL;
+  if (pos >= map->length)
+    {
+      *r_pos = map->length;
+      return -1; /* eof */
+    }
+  if (map->length - pos < 5)
+    {
+      *r_pos = map->length;
+      return gpg_error (GPG_ERR_TOO_SHORT);
+    }
+
+  p = map->base + pos;
+  imagelen = buf32_to_size_t (p);
+  type = p[4];
+  if (imagelen < 5)
+    {
+      *r_pos = pos + 5;
+      return gpg_error (GPG_ERR_TOO_SHORT);
+    }
+
+  /* Advancing beyond the end is the same as hitting EOF for the
+   * stream version.  */
+  if (!type)
+    {
+      /* Special treatment for empty blobs. */
+      pos = imagelen > map->length - pos? map->length : pos + imagelen;
+      if (skipped_deleted)
+        *skipped_deleted = 1;
+      goto again;
+    }
+
+  if (imagelen > IMAGELEN_LIMIT || !r_blob)
+    {
+      /* Too large blobs are skipped so that the caller may choose
+       * to ignore this record.  */
+      *r_pos = imagelen > map->length - pos? map->length : pos + imagelen;
+      return r_blob? gpg_error (GPG_ERR_TOO_LARGE) : 0;
+    }
+
+  if (imagelen > map->length - pos)
+    {
+      *r_pos = map->length;
+      return gpg_error (GPG_ERR_TOO_SHORT);
+    }
+
+  rc = _keybox_new_blob_view (r_blob, map, pos, imagelen);
+  if (!rc)
+    *r_pos = pos + imagelen;
+  return rc;
+}
+
+
 /* Write the block to the current file position */
 int
 _keybox_write_blob (KEYBOXBLOB blob, estream_t fp, FILE *outfp)
@@ -0,0 +1,944 @@
+/* keybox-index.c - Hash index for keybox files
+ * Copyright (C) 2023 g10 Code GmbH
+ *
+ * This file is part of GnuPG.
+ *
+ * GnuPG is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * GnuPG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see <https://www.gnu.org/licenses/>.
+ */
+
+/* The index maps hashes of the fingerprints, long keyids, keygrips,
+ * UBIDs, and lowercased mail addresses of all blobs, and of the
+ * issuer/serial pairs and subject names of X.509 blobs, to the
+ * offsets of these blobs.  It is stored in a file next to the keybox and is only
+ * used as long as size and modification time of the keybox match the
+ * values recorded in it.  The index may return false candidates due
+ * to hash collisions or deleted blobs; thus the caller needs to run
+ * the usual comparison on each candidate.
+ *
+ * The file consists of a 32 byte header:
+ *
+ *   byte 8  magic "KBXidx01"
+ *   u64     size of the keybox
+ *   u64     mtime of the keybox
+ *   u32     flags
+ *   u32     number of entries
+ *
+ * followed by the entries sorted by hash and offset:
+ *
+ *   u64     hash
+ *   u64     offset of the blob
+ *
+ * All numbers are stored in network byte order.
+ */
+
+#include <config.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include "keybox-defs.h"
+#include "../common/sysutils.h"
+#include "../common/host2net.h"
+
+#define INDEX_SUFFIX ".kidx"
+#define INDEX_MAGIC  "KBXidx01"
+#define INDEX_HDRLEN 32
+#define INDEX_ENTLEN 16
+
+/* The maximum number of search descriptions we look up in the index;
+ * for more descriptions a sequential scan is used.  */
+#define MAX_INDEXED_DESC 8
+
+/* Flag indicating that the index has been built by a version without
+ * X.509 support and thus lacks the keygrips of X.509 certificates.  */
+#define INDEX_FLAG_NO_X509_GRIPS 1
+
+/* Flag indicating that the index carries the issuer/serial and
+ * subject items of X.509 certificates.  Index files without this flag
+ * are rebuilt.  */
+#define INDEX_FLAG_X509_NAMES 2
+
+/* The types of indexed items; they are hashed along with the data.  */
+enum index_item_types
+  {
+    ITEM_FPR  = 1,
+    ITEM_KID  = 2,
+    ITEM_GRIP = 3,
+    ITEM_MAIL = 4,
+    ITEM_UBID = 5,
+    ITEM_ISSUER_SN = 6,
+    ITEM_SUBJECT = 7
+  };
+
+
+struct index_entry_s
+{
+  uint64_t hash;
+  off_t offset;
+};
+
+struct keybox_index_s
+{
+  off_t filesize;         /* Size of the keybox at indexing time.    */
+  time_t mtime;           /* and its modification time.              */
+  unsigned int flags;     /* INDEX_FLAG_ values.                     */
+  size_t nentries;
+  size_t nallocated;
+  struct index_entry_s *entries;  /* Sorted by hash and offset.      */
+  unsigned int nbits;     /* Number of bits used for the buckets.    */
+  size_t *buckets;        /* (1<<nbits)+1 start indices of buckets.  */
+};
+
+
+
+static void
+u64_to_buf (unsigned char *p, uint64_t a)
+{
+  ulongtobuf (p,   (u32)(a >> 32));
+  ulongtobuf (p+4, (u32)a);
+}
+
+static uint64_t
+buf_to_u64 (const unsigned char *p)
+{
+  return (((uint64_t)buf32_to_u32 (p) << 32) | buf32_to_u32 (p+4));
+}
+
+
+/* Return the FNV-1a hash of TYPE and the LENGTH bytes at DATA.  With
+ * LOWERCASE set ASCII letters are mapped to lowercase.  */
+static uint64_t
+item_hash (int type, const void *data, size_t length, int lowercase)
+{
+  const unsigned char *p = data;
+  uint64_t h = 0xcbf29ce484222325ULL;
+
+  h = (h ^ type) * 0x100000001b3ULL;
+  for (; length; length--, p++)
+    h = (h ^ (lowercase? ascii_tolower (*p) : *p)) * 0x100000001b3ULL;
+  return h;
+}
+
+
+/* Return the hash of an X.509 serial number SN of length SNLEN and
+ * the issuer NAME of length NAMELEN.  */
+static uint64_t
+issuer_sn_hash (const void *sn, size_t snlen,
+                const void *name, size_t namelen)
+{
+  const unsigned char *p = name;
+  uint64_t h;
+
+  h = item_hash (ITEM_ISSUER_SN, sn, snlen, 0);
+  h = (h ^ 0) * 0x100000001b3ULL;  /* Separator.  */
+  for (; namelen; namelen--, p++)
+    h = (h ^ *p) * 0x100000001b3ULL;
+  return h;
+}
+
+
+static int
+cmp_entries (const void *a_arg, const void *b_arg)
+{
+  const struct index_entry_s *a = a_arg;
+  const struct index_entry_s *b = b_arg;
+
+  if (a->hash != b->hash)
+    return a->hash < b->hash? -1 : 1;
+  if (a->offset != b->offset)
+    return a->offset < b->offset? -1 : 1;
+  return 0;
+}
+
+
+static int
+cmp_offsets (const void *a_arg, const void *b_arg)
+{
+  off_t a = *(const off_t *)a_arg;
+  off_t b = *(const off_t *)b_arg;
+
+  return a < b? -1 : a > b? 1 : 0;
+}
+
+
+void
+_keybox_index_release (struct keybox_index_s *idx)
+{
+  if (!idx)
+    return;
+  xfree (idx->entries);
+  xfree (idx->buckets);
+  xfree (idx);
+}
+
+
+static char *
+index_fname (KB_NAME kb)
+{
+  return strconcat (kb->fname, INDEX_SUFFIX, NULL);
+}
+
+
+static gpg_error_t
+add_entry (struct keybox_index_s *idx, uint64_t hash, off_t offset)
+{
+  if (idx->nentries == idx->nallocated)
+    {
+      size_t n = idx->nallocated? 2 * idx->nallocated : 256;
+      struct index_entry_s *tmp;
+
+      tmp = xtryrealloc (idx->entries, n * sizeof *tmp);
+      if (!tmp)
+        return gpg_error_from_syserror ();
+      idx->entries = tmp;
+      idx->nallocated = n;
+    }
+  idx->entries[idx->nentries].hash = hash;
+  idx->entries[idx->nentries].offset = offset;
+  idx->nentries++;
+  return 0;
+}
+
+
+/* Sort the entries of IDX, remove duplicates, and create the bucket
+ * table.  */
+static gpg_error_t
+finish_index (struct keybox_index_s *idx)
+{
+  size_t i, n, nbuckets;
+
+  qsort (idx->entries, idx->nentries, sizeof *idx->entries, cmp_entries);
+  for (i = n = 0; i < idx->nentries; i++)
+    if (!n || cmp_entries (idx->entries + n - 1, idx->entries + i))
+      idx->entries[n++] = idx->entries[i];
+  idx->nentries = n;
+
+  for (idx->nbits = 1;
+       idx->nbits < 24 && ((size_t)1 << idx->nbits) < idx->nentries;
+       idx->nbits++)
+    ;
+  nbuckets = (size_t)1 << idx->nbits;
+  xfree (idx->buckets);
+  idx->buckets = xtrycalloc (nbuckets + 1, sizeof *idx->buckets);
+  if (!idx->buckets)
+    return gpg_error_from_syserror ();
+  for (i = n = 0; i < nbuckets; i++)
+    {
+      idx->buckets[i] = n;
+      while (n < idx->nentries
+             && (idx->entries[n].hash >> (64 - idx->nbits)) == i)
+        n++;
+    }
+  idx->buckets[nbuckets] = n;
+  return 0;
+}
+
+
+/* Add the entries for all items of BLOB at OFFSET to IDX.  */
+static gpg_error_t
+add_blob_entries (struct keybox_index_s *idx, KEYBOXBLOB blob, off_t offset)
+{
+  gpg_error_t err;
+  const unsigned char *buffer;
+  size_t length, nkeys, keyinfolen, off, len;
+  int i, rc, fpr32, fprlen, kidoff;
+
+  buffer = _keybox_get_blob_image (blob, &length);
+  if (length < 40)
+    return 0;  /* The search would not find anything anyway.  */
+  fpr32 = buffer[5] == 2;
+
+  /* The keys.  The offset of the keyid is the same as used by
+   * has_long_kid.  */
+  nkeys = buf16_to_ulong (buffer + 16);
+  keyinfolen = buf16_to_ulong (buffer + 18);
+  if (keyinfolen < (fpr32?56:28)
+      || 20 + (uint64_t)keyinfolen*nkeys > (uint64_t)length)
+    nkeys = 0;  /* Invalid key table.  */
+  kidoff = (nkeys && fpr32
+            && (buf16_to_ulong (buffer + 20 + 32) & 0x80))? 0 : 12;
+  for (i=0; i < nkeys; i++)
+    {
+      off = 20 + i*keyinfolen;
+      if (fpr32)
+        fprlen = (buf16_to_ulong (buffer + off + 32) & 0x80)? 32:20;
+      else
+        fprlen = 20;
+      if (!i && (err = add_entry (idx, item_hash (ITEM_UBID, buffer + off,
+                                                  UBID_LEN, 0), offset)))
+        return err;
+      if ((err = add_entry (idx, item_hash (ITEM_FPR, buffer + off,
+                                            fprlen, 0), offset)))
+        return err;
+      if ((fpr32 || fprlen == 20)
+          && (err = add_entry (idx, item_hash (ITEM_KID,
+                                               buffer + off + kidoff, 8, 0),
+                               offset)))
+        return err;
+    }
+
+  /* The mail addresses.  */
+  for (i = (blob_get_type (blob) == KEYBOX_BLOBTYPE_X509);
+       (rc = _keybox_get_blob_mail (blob, i, &off, &len)) >= 0; i++)
+    if (rc && (err = add_entry (idx, item_hash (ITEM_MAIL, buffer + off,
+                                                len, 1), offset)))
+      return err;
+
+  /* The keygrips.  */
+  if (blob_get_type (blob) == KEYBOX_BLOBTYPE_PGP)
+    {
+      struct _keybox_openpgp_info info;
+      struct _keybox_openpgp_key_info *k;
+
+      off = buf32_to_ulong (buffer + 8);
+      len = buf32_to_ulong (buffer + 12);
+      if ((uint64_t)off + (uint64_t)len > (uint64_t)length
+          || _keybox_parse_openpgp (buffer + off, len, NULL, &info))
+        return 0;  /* Not searchable by keygrip.  */
+      err = add_entry (idx, item_hash (ITEM_GRIP, info.primary.grip, 20, 0),
+                       offset);
+      for (k = info.nsubkeys? &info.subkeys : NULL; k && !err; k = k->next)
+        err = add_entry (idx, item_hash (ITEM_GRIP, k->grip, 20, 0), offset);
+      _keybox_destroy_openpgp_info (&info);
+      if (err)
+        return err;
+    }
+  else if (blob_get_type (blob) == KEYBOX_BLOBTYPE_X509)
+    {
+      size_t snoff, snlen;
+
+      /* The names are stored in the blob; thus this works also
+       * without X.509 support.  */
+      if (_keybox_get_blob_serial (blob, &snoff, &snlen)
+          && _keybox_get_blob_name (blob, 0, &off, &len) > 0
+          && (err = add_entry (idx, issuer_sn_hash (buffer + snoff, snlen,
+                                                    buffer + off, len),
+                               offset)))
+        return err;
+      if (_keybox_get_blob_name (blob, 1, &off, &len) > 0
+          && (err = add_entry (idx, item_hash (ITEM_SUBJECT, buffer + off,
+                                               len, 0), offset)))
+        return err;
+
+#ifdef KEYBOX_WITH_X509
+      {
+        unsigned char grip[20];
+
+        if (_keybox_get_x509_keygrip (blob, grip)
+            && (err = add_entry (idx, item_hash (ITEM_GRIP, grip, 20, 0),
+                                 offset)))
+          return err;
+      }
+#else
+      idx->flags |= INDEX_FLAG_NO_X509_GRIPS;
+#endif
+    }
+
+  return 0;
+}
+
+
+static gpg_error_t
+stat_keybox (const char *fname, off_t *r_filesize, time_t *r_mtime)
+{
+  struct stat st;
+
+  if (gnupg_stat (fname, &st))
+    return gpg_error_from_syserror ();
+  *r_filesize = st.st_size;
+  *r_mtime = st.st_mtime;
+  return 0;
+}
+
+
+/* Read the index file of KB.  Returns NULL if it does not exist or
+ * is not valid for the keybox with FILESIZE and MTIME.  */
+static struct keybox_index_s *
+read_index (KB_NAME kb, off_t filesize, time_t mtime)
+{
+  char *fname;
+  estream_t fp = NULL;
+  struct keybox_index_s *idx = NULL;
+  unsigned char buf[INDEX_HDRLEN];
+  size_t n, i;
+
+  fname = index_fname (kb);
+  if (!fname)
+    return NULL;
+  fp = es_fopen (fname, "rb");
+  if (!fp)
+    goto failed;
+
+  if (es_fread (buf, INDEX_HDRLEN, 1, fp) != 1
+      || memcmp (buf, INDEX_MAGIC, 8)
+      || buf_to_u64 (buf+8) != (uint64_t)filesize
+      || buf_to_u64 (buf+16) != (uint64_t)mtime)
+    goto failed;
+  n = buf32_to_size_t (buf+28);
+  if ((uint64_t)n * INDEX_ENTLEN > (uint64_t)filesize * 8)
+    goto failed;  /* Not plausible.  */
+
+  idx = xtrycalloc (1, sizeof *idx);
+  if (!idx)
+    goto failed;
+  idx->filesize = filesize;
+  idx->mtime = mtime;
+  idx->flags = buf32_to_uint (buf+24);
+  if (!(idx->flags & INDEX_FLAG_X509_NAMES))
+    goto failed;  /* Built by an older version.  */
+  idx->entries = xtrymalloc ((n? n : 1) * sizeof *idx->entries);
+  if (!idx->entries)
+    goto failed;
+  idx->nallocated = n? n : 1;
+  for (i=0; i < n; i++)
+    {
+      if (es_fread (buf, INDEX_ENTLEN, 1, fp) != 1)
+        goto failed;
+      idx->entries[i].hash = buf_to_u64 (buf);
+      idx->entries[i].offset = buf_to_u64 (buf+8);
+      if (idx->entries[i].offset >= filesize)
+        goto failed;
+    }
+  idx->nentries = n;
+  if (es_getc (fp) != EOF)
+    goto failed;  /* Trailing garbage.  */
+  if (finish_index (idx))
+    goto failed;
+
+  es_fclose (fp);
+  xfree (fname);
+  return idx;
+
+ failed:
+  _keybox_index_release (idx);
+  es_fclose (fp);
+  xfree (fname);
+  return NULL;
+}
+
+
+/* Write IDX to the index file of KB.  Errors are ignored because the
+ * index is just an optimization; a missing or stale file is detected
+ * on the next use.  */
+static void
+write_index (KB_NAME kb, struct keybox_index_s *idx)
+{
+  char *fname, *tmpfname = NULL;
+  estream_t fp;
+  unsigned char buf[INDEX_HDRLEN];
+  size_t i;
+
+  fname = index_fname (kb);
+  if (!fname)
+    return;
+  tmpfname = strconcat (fname, ".tmp", NULL);
+  if (!tmpfname)
+    goto leave;
+  fp = es_fopen (tmpfname, "wb,mode=-rw");
+  if (!fp)
+    goto leave;
+
+  memcpy (buf, INDEX_MAGIC, 8);
+  u64_to_buf (buf+8, idx->filesize);
+  u64_to_buf (buf+16, idx->mtime);
+  ulongtobuf (buf+24, idx->flags);
+  ulongtobuf (buf+28, idx->nentries);
+  if (es_fwrite (buf, INDEX_HDRLEN, 1, fp) != 1)
+    goto failed;
+  for (i=0; i < idx->nentries; i++)
+    {
+      u64_to_buf (buf, idx->entries[i].hash);
+      u64_to_buf (buf+8, idx->entries[i].offset);
+      if (es_fwrite (buf, INDEX_ENTLEN, 1, fp) != 1)
+        goto failed;
+    }
+  if (es_fclose (fp))
+    {
+      fp = NULL;
+      goto failed;
+    }
+  if (!gnupg_rename_file (tmpfname, fname, NULL))
+    goto leave;
+  fp = NULL;
+
+ failed:
+  es_fclose (fp);
+  gnupg_remove (tmpfname);
+ leave:
+  xfree (tmpfname);
+  xfree (fname);
+}
+
+
+/* Update only the file information in the header of the index file
+ * of KB.  On error the index file is removed.  */
+static void
+write_index_header (KB_NAME kb, struct keybox_index_s *idx)
+{
+  char *fname;
+  estream_t fp;
+  unsigned char buf[16];
+  int okay = 0;
+
+  fname = index_fname (kb);
+  if (!fname)
+    return;
+  fp = es_fopen (fname, "r+b");
+  if (fp)
+    {
+      u64_to_buf (buf, idx->filesize);
+      u64_to_buf (buf+8, idx->mtime);
+      okay = (!es_fseeko (fp, 8, SEEK_SET)
+              && es_fwrite (buf, 16, 1, fp) == 1);
+      if (es_fclose (fp))
+        okay = 0;
+    }
+  if (!okay)
+    gnupg_remove (fname);
+  xfree (fname);
+}
+
+
+/* Scan the keybox of KB and return a new index or NULL on error.  */
+static struct keybox_index_s *
+build_index (KB_NAME kb)
+{
+  gpg_error_t err;
+  estream_t fp;
+  struct keybox_index_s *idx;
+  KEYBOXBLOB blob;
+  off_t filesize;
+  time_t mtime;
+  int blobtype;
+
+  idx = xtrycalloc (1, sizeof *idx);
+  if (!idx)
+    return NULL;
+  idx->flags = INDEX_FLAG_X509_NAMES;
+
+  fp = es_fopen (kb->fname, "rb");
+  if (!fp)
+    goto failed;
+  if (stat_keybox (kb->fname, &filesize, &mtime))
+    goto failed;
+
+  while (!(err = _keybox_read_blob (&blob, fp, NULL))
+         || (gpg_err_code (err) == GPG_ERR_TOO_LARGE
+             && gpg_err_source (err) == GPG_ERR_SOURCE_KEYBOX))
+    {
+      if (err)
+        continue;  /* Too large blobs are skipped by the search.  */
+      blobtype = blob_get_type (blob);
+      if (blobtype == KEYBOX_BLOBTYPE_PGP || blobtype == KEYBOX_BLOBTYPE_X509)
+        err = add_blob_entries (idx, blob, _keybox_get_blob_fileoffset (blob));
+      _keybox_release_blob (blob);
+      if (err)
+        goto failed;
+    }
+  if (err != -1)
+    goto failed;
+  es_fclose (fp);
+  fp = NULL;
+
+  /* Make sure that the file has not been modified while we were
+   * scanning it.  */
+  idx->filesize = filesize;
+  idx->mtime = mtime;
+  if (stat_keybox (kb->fname, &filesize, &mtime)
+      || filesize != idx->filesize || mtime != idx->mtime)
+    goto failed;
+
+  if (finish_index (idx))
+    goto failed;
+  return idx;
+
+ failed:
+  es_fclose (fp);
+  _keybox_index_release (idx);
+  return NULL;
+}
+
+
+/* Return the valid index for KB, reading or building it if needed.
+ * Returns NULL if no index is available.  Note that keyboxd may run
+ * several searches concurrently; thus we install a new index only
+ * once we are done with all operations which may switch threads.  */
+static struct keybox_index_s *
+get_index (KB_NAME kb)
+{
+  struct keybox_index_s *idx;
+  off_t filesize;
+  time_t mtime;
+
+  if (stat_keybox (kb->fname, &filesize, &mtime))
+    {
+      _keybox_index_release (kb->index);
+      kb->index = NULL;
+      return NULL;
+    }
+
+  if (kb->index
+      && kb->index->filesize == filesize && kb->index->mtime == mtime)
+    return kb->index;
+  _keybox_index_release (kb->index);
+  kb->index = NULL;
+  if (kb->noindex_filesize == filesize && kb->noindex_mtime == mtime)
+    return NULL;  /* We already failed for this version.  */
+
+  idx = read_index (kb, filesize, mtime);
+  if (!idx)
+    {
+      idx = build_index (kb);
+      if (idx && (idx->filesize != filesize || idx->mtime != mtime))
+        {
+          _keybox_index_release (idx);
+          idx = NULL;
+        }
+      if (idx)
+        write_index (kb, idx);
+    }
+
+  /* Check again because we may have been interrupted.  */
+  if (!stat_keybox (kb->fname, &filesize, &mtime) && idx
+      && idx->filesize == filesize && idx->mtime == mtime)
+    {
+      _keybox_index_release (kb->index);
+      kb->index = idx;
+      return idx;
+    }
+  _keybox_index_release (idx);
+  if (!idx)
+    {
+      kb->noindex_filesize = filesize;
+      kb->noindex_mtime = mtime;
+    }
+  return NULL;
+}
+
+
+/* Remove the index of KB from memory and disk.  */
+void
+_keybox_index_drop (KB_NAME kb)
+{
+  char *fname;
+
+  _keybox_index_release (kb->index);
+  kb->index = NULL;
+  fname = index_fname (kb);
+  if (fname)
+    gnupg_remove (fname);
+  xfree (fname);
+}
+
+
+/* Collect the offsets of all blobs with HASH at or after OFFSET.  */
+static gpg_error_t
+collect_candidates (struct keybox_index_s *idx, uint64_t hash, off_t offset,
+                    off_t **array, size_t *narray, size_t *nallocated)
+{
+  size_t i, end;
+
+  i = idx->buckets[hash >> (64 - idx->nbits)];
+  end = idx->buckets[(hash >> (64 - idx->nbits)) + 1];
+  for (; i < end; i++)
+    {
+      if (idx->entries[i].hash != hash || idx->entries[i].offset < offset)
+        continue;
+      if (*narray == *nallocated)
+        {
+          size_t n = *nallocated? 2 * *nallocated : 16;
+          off_t *tmp;
+
+          tmp = xtryrealloc (*array, n * sizeof *tmp);
+          if (!tmp)
+            return gpg_error_from_syserror ();
+          *array = tmp;
+          *nallocated = n;
+        }
+      (*array)[(*narray)++] = idx->entries[i].offset;
+    }
+  return 0;
+}
+
+
+/* Store the hashes of the items of the search descriptions DESC at
+ * HASHES which must provide space for 2*MAX_INDEXED_DESC items and
+ * their number at R_NHASHES.  Returns false if a search mode can't
+ * be served by the index.  */
+static int
+desc_hashes (KEYBOX_SEARCH_DESC *desc, size_t ndesc,
+             uint64_t *hashes, size_t *r_nhashes)
+{
+  size_t n, nhashes = 0;
+  const char *name;
+  size_t namelen;
+
+  if (!ndesc || ndesc > MAX_INDEXED_DESC)
+    return 0;
+  for (n=0; n < ndesc; n++)
+    {
+      switch (desc[n].mode)
+        {
+        case KEYDB_SEARCH_MODE_FPR:
+          if (desc[n].fprlen != 20 && desc[n].fprlen != 32)
+            return 0;
+          hashes[nhashes++] = item_hash (ITEM_FPR, desc[n].u.fpr,
+                                         desc[n].fprlen, 0);
+          break;
+        case KEYDB_SEARCH_MODE_LONG_KID:
+          {
+            unsigned char buf[8];
+
+            ulongtobuf (buf, desc[n].u.kid[0]);
+            ulongtobuf (buf+4, desc[n].u.kid[1]);
+            hashes[nhashes++] = item_hash (ITEM_KID, buf, 8, 0);
+          }
+          break;
+        case KEYDB_SEARCH_MODE_KEYGRIP:
+          hashes[nhashes++] = item_hash (ITEM_GRIP, desc[n].u.grip, 20, 0);
+          break;
+        case KEYDB_SEARCH_MODE_UBID:
+          hashes[nhashes++] = item_hash (ITEM_UBID, desc[n].u.ubid,
+                                         UBID_LEN, 0);
+          break;
+        case KEYDB_SEARCH_MODE_ISSUER_SN:
+          {
+            unsigned char snbuf[64];
+            const unsigned char *sn = desc[n].sn;
+            size_t snlen = desc[n].snlen;
+
+            if (!desc[n].u.name || !sn)
+              return 0;
+            if (desc[n].snhex)
+              {
+                /* Convert the hex string as done by keybox_search.  */
+                const char *s = (const char *)desc[n].sn;
+                size_t i, k;
+
+                for (i=0; s[i] && s[i] != '/' && i < desc[n].snlen; i++)
+                  ;
+                if ((i+1)/2 > sizeof snbuf)
+                  return 0;
+                snlen = (i+1)/2;
+                k = 0;
+                if ((i & 1))
+                  {
+                    snbuf[k++] = xtoi_1 (s);
+                    s++;
+                  }
+                for (; *s && *s != '/' && k < snlen; s += 2)
+                  snbuf[k++] = xtoi_2 (s);
+                sn = snbuf;
+              }
+            hashes[nhashes++] = issuer_sn_hash (sn, snlen, desc[n].u.name,
+                                                strlen (desc[n].u.name));
+          }
+          break;
+        case KEYDB_SEARCH_MODE_SUBJECT:
+          if (!desc[n].u.name)
+            return 0;
+          hashes[nhashes++] = item_hash (ITEM_SUBJECT, desc[n].u.name,
+                                         strlen (desc[n].u.name), 0);
+          break;
+        case KEYDB_SEARCH_MODE_MAIL:
+          /* See has_mail for the treatment of the angle brackets;
+           * the leading one is only stripped for OpenPGP.  */
+          name = desc[n].u.name;
+          if (!name)
+            return 0;
+          namelen = strlen (name);
+          if (namelen && name[namelen-1] == '>')
+            namelen--;
+          hashes[nhashes++] = item_hash (ITEM_MAIL, name, namelen, 1);
+          if (*name == '<' && namelen)
+            hashes[nhashes++] = item_hash (ITEM_MAIL, name+1, namelen-1, 1);
+          break;
+        default:
+          return 0;
+        }
+    }
+  *r_nhashes = nhashes;
+  return 1;
+}
+
+
+/* Look up the items of the search descriptions DESC in the index of
+ * KB.  On success a malloced array with the sorted offsets of all
+ * candidate blobs at or after OFFSET is stored at R_OFFSETS and their
+ * number at R_NOFFSETS.  Returns GPG_ERR_NOT_SUPPORTED if no index is
+ * available or a search mode can't be served by the index.  */
+gpg_error_t
+_keybox_index_lookup (KB_NAME kb, KEYBOX_SEARCH_DESC *desc, size_t ndesc,
+                      off_t offset, off_t **r_offsets, size_t *r_noffsets)
+{
+  gpg_error_t err = 0;
+  struct keybox_index_s *idx;
+  uint64_t hashes[2*MAX_INDEXED_DESC];
+  size_t nhashes;
+  off_t *array = NULL;
+  size_t i, n, narray = 0, nallocated = 0;
+
+  *r_offsets = NULL;
+  *r_noffsets = 0;
+
+  if (!desc_hashes (desc, ndesc, hashes, &nhashes))
+    return gpg_error (GPG_ERR_NOT_SUPPORTED);
+
+  idx = get_index (kb);
+  if (!idx)
+    return gpg_error (GPG_ERR_NOT_SUPPORTED);
+#ifdef KEYBOX_WITH_X509
+  if ((idx->flags & INDEX_FLAG_NO_X509_GRIPS))
+    for (n=0; n < ndesc; n++)
+      if (desc[n].mode == KEYDB_SEARCH_MODE_KEYGRIP)
+        return gpg_error (GPG_ERR_NOT_SUPPORTED);
+#endif
+
+  for (i=0; i < nhashes && !err; i++)
+    err = collect_candidates (idx, hashes[i], offset,
+                              &array, &narray, &nallocated);
+  if (err)
+    {
+      xfree (array);
+      return err;
+    }
+
+  if (narray > 1)
+    {
+      qsort (array, narray, sizeof *array, cmp_offsets);
+      for (i = n = 1; i < narray; i++)
+        if (array[i] != array[n-1])
+          array[n++] = array[i];
+      narray = n;
+    }
+  *r_offsets = array;
+  *r_noffsets = narray;
+  return 0;
+}
+
+
+/* Return true if BLOB carries one of the items of the search
+ * descriptions DESC as claimed by the index.  This is used to detect
+ * a stale index if no description matches a candidate blob; the
+ * index would then be wrong unless we hit a hash collision.  */
+int
+_keybox_index_check_blob (KEYBOX_SEARCH_DESC *desc, size_t ndesc,
+                          KEYBOXBLOB blob)
+{
+  struct keybox_index_s tmpidx;
+  uint64_t hashes[2*MAX_INDEXED_DESC];
+  size_t nhashes, i, n;
+  int found = 0;
+
+  if (!desc_hashes (desc, ndesc, hashes, &nhashes))
+    return 0;
+
+  memset (&tmpidx, 0, sizeof tmpidx);
+  if (add_blob_entries (&tmpidx, blob, 0))
+    found = 1;  /* Out of core - don't blame the index.  */
+  else
+    for (i=0; i < tmpidx.nentries && !found; i++)
+      for (n=0; n < nhashes && !found; n++)
+        if (tmpidx.entries[i].hash == hashes[n])
+          found = 1;
+  xfree (tmpidx.entries);
+  return found;
+}
+
+
+/* Make sure that the index of KB is loaded before a modification of
+ * the keybox so that it can be updated afterwards.  */
+void
+_keybox_index_prepare (KB_NAME kb)
+{
+  get_index (kb);
+}
+
+
+/* Update the index of KB after a keybox write.  START_OFFSET is the
+ * offset of the blob of length OLDLEN which has been replaced by BLOB
+ * or -1 if BLOB has been appended.  With BLOB given as NULL the
+ * keybox has been modified in place; START_OFFSET is then the offset
+ * of a blob which has been flagged as deleted or -1 if no indexed
+ * items changed.  On any problem the index is removed.  */
+void
+_keybox_index_update (KB_NAME kb, off_t start_offset, off_t oldlen,
+                      KEYBOXBLOB blob)
+{
+  struct keybox_index_s *idx = kb->index;
+  off_t filesize, delta;
+  time_t mtime;
+  size_t i, n, newlen;
+
+  if (!idx)
+    return;  /* No index or not prepared.  */
+  if (stat_keybox (kb->fname, &filesize, &mtime))
+    goto drop;
+
+  if (!blob)
+    newlen = oldlen = 0;
+  else
+    _keybox_get_blob_image (blob, &newlen);
+  if (blob && start_offset == -1)
+    {
+      start_offset = idx->filesize;
+      oldlen = 0;
+    }
+  delta = (off_t)newlen - oldlen;
+  if (filesize != idx->filesize + delta)
+    goto drop;  /* Not what we expected.  */
+
+  if (start_offset != -1)
+    {
+      for (i = n = 0; i < idx->nentries; i++)
+        {
+          if (idx->entries[i].offset == start_offset)
+            continue;
+          if (idx->entries[i].offset > start_offset)
+            idx->entries[i].offset += delta;
+          idx->entries[n++] = idx->entries[i];
+        }
+      idx->nentries = n;
+      if (blob && add_blob_entries (idx, blob, start_offset))
+        goto drop;
+      if (finish_index (idx))
+        goto drop;
+    }
+
+  idx->filesize = filesize;
+  idx->mtime = mtime;
+  if (start_offset != -1)
+    write_index (kb, idx);
+  else
+    write_index_header (kb, idx);
+  return;
+
+ drop:
+  _keybox_index_drop (kb);
+}
+
+
+/* Rebuild the index of KB; used after the keybox has been
+ * rewritten.  */
+void
+_keybox_index_rebuild (KB_NAME kb)
+{
+  _keybox_index_drop (kb);
+  kb->noindex_filesize = 0;
+  kb->noindex_mtime = 0;
+  get_index (kb);
+}
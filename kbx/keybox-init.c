@@ -64,6 +64,9 @@ keybox_register_file (const char *fname, int secret, void **r_token)
   kr->lockhd = NULL;
   kr->is_locked = 0;
   kr->did_full_scan = 0;
+  kr->index = NULL;
+  kr->noindex_filesize = 0;
+  kr->noindex_mtime = 0;
   /* keep a list of all issued pointers */
   kr->next = kb_names;
   kb_names = kr;
@@ -183,6 +186,8 @@ keybox_release (KEYBOX_HANDLE hd)
       es_fclose (hd->fp);
       hd->fp = NULL;
     }
+  _keybox_map_unref (hd->map);
+  hd->map = NULL;
   xfree (hd->word_match.name);
   xfree (hd->word_match.pattern);
   xfree (hd);
@@ -256,8 +261,12 @@ _keybox_close_file (KEYBOX_HANDLE hd)
             es_fclose (roverhd->fp);
             roverhd->fp = NULL;
           }
+        /* Blobs still referencing the mapping keep it alive.  */
+        _keybox_map_unref (roverhd->map);
+        roverhd->map = NULL;
       }
   log_assert (!hd->fp);
+  log_assert (!hd->map);
 }
 
 
@@ -29,6 +29,7 @@
 #include <gcrypt.h>
 #include "../common/host2net.h"
 #include "../common/mbox-util.h"
+#include "../common/hotpath.h"
 
 #define xtoi_1(p)   (*(p) <= '9'? (*(p)- '0'): \
                      *(p) <= 'F'? (*(p)-'A'+10):(*(p)-'a'+10))
@@ -440,22 +441,18 @@ blob_cmp_name (KEYBOXBLOB blob, int idx,
 }
 
 
-/* Compare all email addresses of the subject.  With SUBSTR given as
-   True a substring search is done in the mail address.  The X509 flag
-   indicated whether the search is done on an X.509 blob.  */
-static int
-blob_cmp_mail (KEYBOXBLOB blob, const char *name, size_t namelen, int substr,
-               int x509)
+/* Locate the serial number of the X.509 BLOB and store its offset
+ * within the blob image at R_OFF and its length at R_LEN.  Returns
+ * true on success.  */
+int
+_keybox_get_blob_serial (KEYBOXBLOB blob, size_t *r_off, size_t *r_len)
 {
   const unsigned char *buffer;
   size_t length;
-  size_t pos, off, len;
+  size_t pos;
   size_t nkeys, keyinfolen;
-  size_t nuids, uidinfolen;
   size_t nserial;
-  int idx;
 
-  /* fixme: this code is common to blob_cmp_mail */
   buffer = _keybox_get_blob_image (blob, &length);
   if (length < 40)
     return 0; /* blob too short */
@@ -466,78 +463,184 @@ blob_cmp_mail (KEYBOXBLOB blob, const char *name, size_t namelen, int substr,
   if (keyinfolen < 28)
     return 0; /* invalid blob */
   pos = 20 + keyinfolen*nkeys;
-  if (pos+2 > length)
+  if ((uint64_t)pos+2 > (uint64_t)length)
+    return 0; /* out of bounds */
+
+  /*serial*/
+  nserial = get16 (buffer+pos);
+  if (pos + 2 + nserial > length)
     return 0; /* out of bounds */
+  *r_off = pos + 2;
+  *r_len = nserial;
+  return 1;
+}
+
+
+/* Locate the name of the user id with index IDX in BLOB and store its
+ * offset within the blob image at R_OFF and its length at R_LEN.
+ * Returns 1 on success, 0 if the name is empty, and -1 if there is no
+ * such user id.  Note that for X.509 index 0 is used for the issuer
+ * name and index 1 for the subject name.  */
+int
+_keybox_get_blob_name (KEYBOXBLOB blob, int idx, size_t *r_off, size_t *r_len)
+{
+  const unsigned char *buffer;
+  size_t length;
+  size_t pos, off, len;
+  size_t nuids, uidinfolen;
+
+  buffer = _keybox_get_blob_image (blob, &length);
+  if (!_keybox_get_blob_serial (blob, &pos, &len))
+    return -1;
+  pos += len;
+  if (pos+4 > length)
+    return -1; /* out of bounds */
+
+  /* user ids*/
+  nuids = get16 (buffer + pos);  pos += 2;
+  uidinfolen = get16 (buffer + pos);  pos += 2;
+  if (uidinfolen < 12)
+    return -1; /* invalid blob */
+  if (pos + uidinfolen*nuids > length)
+    return -1; /* out of bounds */
+
+  if (idx < 0 || idx >= nuids)
+    return -1;
+
+  pos += idx*uidinfolen;
+  off = get32 (buffer+pos);
+  len = get32 (buffer+pos+4);
+  if ((uint64_t)off+(uint64_t)len > (uint64_t)length)
+    return -1; /* error: better stop here - out of bounds */
+  if (len < 1)
+    return 0; /* empty name */
+  *r_off = off;
+  *r_len = len;
+  return 1;
+}
+
+
+/* Locate the mail address of the user id with index IDX in BLOB and
+ * store its offset within the blob image at R_OFF and its length at
+ * R_LEN.  Returns 1 on success, 0 if the user id has no mail address,
+ * and -1 if there is no such user id.  Note that for X.509 index 0
+ * is used for the issuer name.  */
+int
+_keybox_get_blob_mail (KEYBOXBLOB blob, int idx, size_t *r_off, size_t *r_len)
+{
+  const unsigned char *buffer;
+  size_t length;
+  size_t pos, off, len;
+  size_t nkeys, keyinfolen;
+  size_t nuids, uidinfolen;
+  size_t nserial;
+  size_t mypos, mylen;
+
+  buffer = _keybox_get_blob_image (blob, &length);
+  if (length < 40)
+    return -1; /* blob too short */
+
+  /*keys*/
+  nkeys = get16 (buffer + 16);
+  keyinfolen = get16 (buffer + 18 );
+  if (keyinfolen < 28)
+    return -1; /* invalid blob */
+  pos = 20 + keyinfolen*nkeys;
+  if (pos+2 > length)
+    return -1; /* out of bounds */
 
   /*serial*/
   nserial = get16 (buffer+pos);
   pos += 2 + nserial;
   if (pos+4 > length)
-    return 0; /* out of bounds */
+    return -1; /* out of bounds */
 
   /* user ids*/
   nuids = get16 (buffer + pos);  pos += 2;
   uidinfolen = get16 (buffer + pos);  pos += 2;
   if (uidinfolen < 12 /* should add a: || nuidinfolen > MAX_UIDINFOLEN */)
-    return 0; /* invalid blob */
+    return -1; /* invalid blob */
   if (pos + uidinfolen*nuids > length)
-    return 0; /* out of bounds */
+    return -1; /* out of bounds */
 
-  if (namelen < 1)
-    return 0;
+  if (idx < 0 || idx >= nuids)
+    return -1;
 
-  /* Note that for X.509 we start at index 1 because index 0 is used
-     for the issuer name.  */
-  for (idx=!!x509 ;idx < nuids; idx++)
+  pos += idx*uidinfolen;
+  off = get32 (buffer+pos);
+  len = get32 (buffer+pos+4);
+  if ((uint64_t)off+(uint64_t)len > (uint64_t)length)
+    return -1; /* error: better stop here - out of bounds */
+  if (blob_get_type (blob) == KEYBOX_BLOBTYPE_X509)
+    {
+      if (len < 2 || buffer[off] != '<')
+        return 0; /* empty name or trailing 0 not stored */
+      len--; /* one back */
+      if ( len < 3 || buffer[off+len] != '>')
+        return 0; /* not a proper email address */
+      off++;
+      len--;
+    }
+  else /* OpenPGP.  */
     {
-      size_t mypos = pos;
-      size_t mylen;
-
-      mypos += idx*uidinfolen;
-      off = get32 (buffer+mypos);
-      len = get32 (buffer+mypos+4);
-      if ((uint64_t)off+(uint64_t)len > (uint64_t)length)
-        return 0; /* error: better stop here - out of bounds */
-      if (x509)
+      /* We need to forward to the mailbox part.  */
+      mypos = off;
+      mylen = len;
+      for ( ; len && buffer[off] != '<'; len--, off++)
+        ;
+      if (len < 2 || buffer[off] != '<')
         {
-          if (len < 2 || buffer[off] != '<')
-            continue; /* empty name or trailing 0 not stored */
-          len--; /* one back */
-          if ( len < 3 || buffer[off+len] != '>')
-            continue; /* not a proper email address */
-          off++;
-          len--;
+          /* Mailbox not explicitly given or too short.  Restore
+             OFF and LEN and check whether the entire string
+             resembles a mailbox without the angle brackets.  */
+          off = mypos;
+          len = mylen;
+          if (!is_valid_mailbox_mem (buffer+off, len))
+            return 0; /* Not a mail address. */
         }
-      else /* OpenPGP.  */
+      else /* Seems to be standard user id with mail address.  */
         {
-          /* We need to forward to the mailbox part.  */
-          mypos = off;
-          mylen = len;
-          for ( ; len && buffer[off] != '<'; len--, off++)
+          off++; /* Point to first char of the mail address.  */
+          len--;
+          /* Search closing '>'.  */
+          for (mypos=off; len && buffer[mypos] != '>'; len--, mypos++)
             ;
-          if (len < 2 || buffer[off] != '<')
-            {
-              /* Mailbox not explicitly given or too short.  Restore
-                 OFF and LEN and check whether the entire string
-                 resembles a mailbox without the angle brackets.  */
-              off = mypos;
-              len = mylen;
-              if (!is_valid_mailbox_mem (buffer+off, len))
-                continue; /* Not a mail address. */
-            }
-          else /* Seems to be standard user id with mail address.  */
-            {
-              off++; /* Point to first char of the mail address.  */
-              len--;
-              /* Search closing '>'.  */
-              for (mypos=off; len && buffer[mypos] != '>'; len--, mypos++)
-                ;
-              if (!len || buffer[mypos] != '>' || off == mypos)
-                continue; /* Not a proper mail address.  */
-              len = mypos - off;
-            }
-
+          if (!len || buffer[mypos] != '>' || off == mypos)
+            return 0; /* Not a proper mail address.  */
+          len = mypos - off;
         }
+    }
+
+  *r_off = off;
+  *r_len = len;
+  return 1;
+}
+
+
+/* Compare all email addresses of the subject.  With SUBSTR given as
+   True a substring search is done in the mail address.  The X509 flag
+   indicated whether the search is done on an X.509 blob.  */
+static int
+blob_cmp_mail (KEYBOXBLOB blob, const char *name, size_t namelen, int substr,
+               int x509)
+{
+  const unsigned char *buffer;
+  size_t length;
+  size_t off, len;
+  int idx, rc;
+
+  if (namelen < 1)
+    return 0;
+
+  buffer = _keybox_get_blob_image (blob, &length);
+
+  /* Note that for X.509 we start at index 1 because index 0 is used
+     for the issuer name.  */
+  for (idx=!!x509; (rc = _keybox_get_blob_mail (blob, idx, &off, &len)) >= 0;
+       idx++)
+    {
+      if (!rc)
+        continue;
 
       if (substr)
         {
@@ -607,12 +710,12 @@ blob_openpgp_has_grip (KEYBOXBLOB blob, const unsigned char *grip)
 
 
 #ifdef KEYBOX_WITH_X509
-/* Return true if the key in BLOB matches the 20 bytes keygrip GRIP.
-   We don't have the keygrips as meta data, thus we need to parse the
-   certificate. Fixme: We might want to return proper error codes
-   instead of failing a search for invalid certificates etc.  */
-static int
-blob_x509_has_grip (KEYBOXBLOB blob, const unsigned char *grip)
+/* Compute the keygrip of the certificate in BLOB and store it at
+   GRIP which must provide space for 20 bytes.  We don't have the
+   keygrips as meta data, thus we need to parse the certificate.
+   Returns true on success.  */
+int
+_keybox_get_x509_keygrip (KEYBOXBLOB blob, unsigned char *grip)
 {
   int rc;
   const unsigned char *buffer;
@@ -622,7 +725,6 @@ blob_x509_has_grip (KEYBOXBLOB blob, const unsigned char *grip)
   ksba_cert_t cert = NULL;
   ksba_sexp_t p = NULL;
   gcry_sexp_t s_pkey;
-  unsigned char array[20];
   unsigned char *rcp;
   size_t n;
 
@@ -658,7 +760,7 @@ blob_x509_has_grip (KEYBOXBLOB blob, const unsigned char *grip)
       gcry_sexp_release (s_pkey);
       goto failed;
     }
-  rcp = gcry_pk_get_keygrip (s_pkey, array);
+  rcp = gcry_pk_get_keygrip (s_pkey, grip);
   gcry_sexp_release (s_pkey);
   if (!rcp)
     goto failed; /* Can't calculate keygrip. */
@@ -666,13 +768,26 @@ blob_x509_has_grip (KEYBOXBLOB blob, const unsigned char *grip)
   xfree (p);
   ksba_cert_release (cert);
   ksba_reader_release (reader);
-  return !memcmp (array, grip, 20);
+  return 1;
  failed:
   xfree (p);
   ksba_cert_release (cert);
   ksba_reader_release (reader);
   return 0;
 }
+
+
+/* Return true if the key in BLOB matches the 20 bytes keygrip GRIP.
+   Fixme: We might want to return proper error codes instead of
+   failing a search for invalid certificates etc.  */
+static int
+blob_x509_has_grip (KEYBOXBLOB blob, const unsigned char *grip)
+{
+  unsigned char array[20];
+
+  return (_keybox_get_x509_keygrip (blob, array)
+          && !memcmp (array, grip, 20));
+}
 #endif /*KEYBOX_WITH_X509*/
 
 
@@ -873,11 +988,18 @@ release_sn_array (struct sn_array_s *array, size_t size)
 }
 
 
-/* Helper to open the file.  */
+/* Helper to open the file.  If possible the file is mapped into
+ * memory so that the blobs don't need to be copied.  */
 static gpg_error_t
 open_file (KEYBOX_HANDLE hd)
 {
 
+  if (!_keybox_map_file (hd->kb->fname, &hd->map))
+    {
+      hd->mappos = 0;
+      return 0;
+    }
+
   hd->fp = es_fopen (hd->kb->fname, "rb");
   if (!hd->fp)
     {
@@ -889,6 +1011,53 @@ open_file (KEYBOX_HANDLE hd)
 }
 
 
+/* Return true if the file of HD has been opened.  */
+static inline int
+file_is_open (KEYBOX_HANDLE hd)
+{
+  return hd->fp || hd->map;
+}
+
+
+/* Return the current read position of HD or -1 on error.  */
+static off_t
+get_position (KEYBOX_HANDLE hd)
+{
+  if (hd->map)
+    return hd->mappos;
+  return es_ftello (hd->fp);
+}
+
+
+/* Set the read position of HD to OFFSET.  Returns 0 on success or -1
+ * with ERRNO set on error.  */
+static int
+set_position (KEYBOX_HANDLE hd, off_t offset)
+{
+  if (hd->map)
+    {
+      if (offset < 0)
+        {
+          gpg_err_set_errno (EINVAL);
+          return -1;
+        }
+      hd->mappos = offset;
+      return 0;
+    }
+  return es_fseeko (hd->fp, offset, SEEK_SET);
+}
+
+
+/* Read the blob at the current position of HD; see _keybox_read_blob.  */
+static int
+read_blob (KEYBOX_HANDLE hd, KEYBOXBLOB *r_blob)
+{
+  if (hd->map)
+    return _keybox_read_blob_from_map (r_blob, hd->map, &hd->mappos, NULL);
+  return _keybox_read_blob (r_blob, hd->fp, NULL);
+}
+
+
 
 /*
 
@@ -908,7 +1077,9 @@ keybox_search_reset (KEYBOX_HANDLE hd)
       hd->found.blob = NULL;
     }
 
-  if (hd->fp)
+  if (hd->map)
+    hd->mappos = 0;
+  else if (hd->fp)
     {
       if (es_fseeko (hd->fp, 0, SEEK_SET))
         {
@@ -929,10 +1100,10 @@ keybox_search_reset (KEYBOX_HANDLE hd)
    If WANT_BLOBTYPE is not 0 only blobs of this type are considered.
    The value at R_SKIPPED is updated by the number of skipped long
    records (counts PGP and X.509). */
-gpg_error_t
-keybox_search (KEYBOX_HANDLE hd, KEYBOX_SEARCH_DESC *desc, size_t ndesc,
-               keybox_blobtype_t want_blobtype,
-               size_t *r_descindex, unsigned long *r_skipped)
+static gpg_error_t
+do_keybox_search (KEYBOX_HANDLE hd, KEYBOX_SEARCH_DESC *desc, size_t ndesc,
+                  keybox_blobtype_t want_blobtype,
+                  size_t *r_descindex, unsigned long *r_skipped)
 {
   gpg_error_t rc;
   size_t n;
@@ -940,7 +1111,11 @@ keybox_search (KEYBOX_HANDLE hd, KEYBOX_SEARCH_DESC *desc, size_t ndesc,
   KEYBOXBLOB blob = NULL;
   struct sn_array_s *sn_array = NULL;
   int pk_no, uid_no;
-  off_t lastfoundoff;
+  off_t lastfoundoff, startoff;
+  off_t *candidates = NULL;
+  size_t ncandidates = 0;
+  size_t candidx = 0;
+  int use_index = 0;
 
   if (!hd)
     return gpg_error (GPG_ERR_INV_VALUE);
@@ -990,7 +1165,7 @@ keybox_search (KEYBOX_HANDLE hd, KEYBOX_SEARCH_DESC *desc, size_t ndesc,
 
   (void)need_words;  /* Not yet implemented.  */
 
-  if (!hd->fp)
+  if (!file_is_open (hd))
     {
       rc = open_file (hd);
       if (rc)
@@ -1005,7 +1180,7 @@ keybox_search (KEYBOX_HANDLE hd, KEYBOX_SEARCH_DESC *desc, size_t ndesc,
            * returned a blob which also was not the first one.  We now
            * need to skip over that blob and hope that the file has
            * not changed.  */
-          if (es_fseeko (hd->fp, lastfoundoff, SEEK_SET))
+          if (set_position (hd, lastfoundoff))
             {
               rc = gpg_error_from_syserror ();
               log_debug ("%s: seeking to last found offset failed: %s\n",
@@ -1015,7 +1190,7 @@ keybox_search (KEYBOX_HANDLE hd, KEYBOX_SEARCH_DESC *desc, size_t ndesc,
             }
           /* log_debug ("%s: re-opened file and sought to last offset\n", */
           /*            __func__); */
-          rc = _keybox_read_blob (NULL, hd->fp, NULL);
+          rc = read_blob (hd, NULL);
           if (rc)
             {
               log_debug ("%s: skipping last found blob failed: %s\n",
@@ -1087,6 +1262,14 @@ keybox_search (KEYBOX_HANDLE hd, KEYBOX_SEARCH_DESC *desc, size_t ndesc,
     }
 
 
+  /* For exact searches the index gives us the offsets of the
+   * candidate blobs after the current position.  */
+  startoff = get_position (hd);
+  if (hd->kb && startoff != (off_t)-1
+      && !_keybox_index_lookup (hd->kb, desc, ndesc, startoff,
+                                &candidates, &ncandidates))
+    use_index = 1;
+
   pk_no = uid_no = 0;
   for (;;)
     {
@@ -1094,7 +1277,23 @@ keybox_search (KEYBOX_HANDLE hd, KEYBOX_SEARCH_DESC *desc, size_t ndesc,
       int blobtype;
 
       _keybox_release_blob (blob); blob = NULL;
-      rc = _keybox_read_blob (&blob, hd->fp, NULL);
+      if (use_index)
+        {
+          if (candidx == ncandidates)
+            {
+              rc = -1;
+              break;
+            }
+          if (set_position (hd, candidates[candidx++]))
+            {
+              rc = gpg_error_from_syserror ();
+              break;
+            }
+        }
+      rc = read_blob (hd, &blob);
+      if (rc && use_index)
+        goto index_mismatch; /* Deleted and too large blobs are not
+                              * indexed.  */
       if (gpg_err_code (rc) == GPG_ERR_TOO_LARGE
           && gpg_err_source (rc) == GPG_ERR_SOURCE_KEYBOX)
         {
@@ -1104,8 +1303,15 @@ keybox_search (KEYBOX_HANDLE hd, KEYBOX_SEARCH_DESC *desc, size_t ndesc,
 
       if (rc)
         break;
+      if (use_index
+          && _keybox_get_blob_fileoffset (blob) != candidates[candidx-1])
+        goto index_mismatch;  /* Skipped over a deleted blob.  */
 
       blobtype = blob_get_type (blob);
+      if (use_index
+          && blobtype != KEYBOX_BLOBTYPE_PGP
+          && blobtype != KEYBOX_BLOBTYPE_X509)
+        goto index_mismatch;
       if (blobtype == KEYBOX_BLOBTYPE_HEADER)
         continue;
       if (want_blobtype && blobtype != want_blobtype)
@@ -1201,7 +1407,22 @@ keybox_search (KEYBOX_HANDLE hd, KEYBOX_SEARCH_DESC *desc, size_t ndesc,
               goto found;
             }
 	}
+      if (use_index && !_keybox_index_check_blob (desc, ndesc, blob))
+        goto index_mismatch;
       continue;
+
+    index_mismatch:
+      /* The index does not match the file - fall back to a
+       * sequential search.  */
+      _keybox_index_drop (hd->kb);
+      use_index = 0;
+      if (set_position (hd, startoff))
+        {
+          rc = gpg_error_from_syserror ();
+          break;
+        }
+      continue;
+
     found:
       /* Record which DESC we matched on.  Note this value is only
 	 meaningful if this function returns with no errors. */
@@ -1239,7 +1460,22 @@ keybox_search (KEYBOX_HANDLE hd, KEYBOX_SEARCH_DESC *desc, size_t ndesc,
 
   if (sn_array)
     release_sn_array (sn_array, ndesc);
+  xfree (candidates);
+
+  return rc;
+}
+
 
+gpg_error_t
+keybox_search (KEYBOX_HANDLE hd, KEYBOX_SEARCH_DESC *desc, size_t ndesc,
+               keybox_blobtype_t want_blobtype,
+               size_t *r_descindex, unsigned long *r_skipped)
+{
+  gpg_error_t rc;
+
+  HOTPATH_COUNT ("keybox_search",
+                 rc = do_keybox_search (hd, desc, ndesc, want_blobtype,
+                                        r_descindex, r_skipped));
   return rc;
 }
 
@@ -1458,9 +1694,9 @@ keybox_get_flags (KEYBOX_HANDLE hd, int what, int idx, unsigned int *value)
 off_t
 keybox_offset (KEYBOX_HANDLE hd)
 {
-  if (!hd->fp)
+  if (!file_is_open (hd))
     return 0;
-  return es_ftello (hd->fp);
+  return get_position (hd);
 }
 
 gpg_error_t
@@ -1471,7 +1707,7 @@ keybox_seek (KEYBOX_HANDLE hd, off_t offset)
   if (hd->error)
     return hd->error; /* still in error state */
 
-  if (! hd->fp)
+  if (!file_is_open (hd))
     {
       if (!offset)
         {
@@ -1485,7 +1721,7 @@ keybox_seek (KEYBOX_HANDLE hd, off_t offset)
         return err;
     }
 
-  err = es_fseeko (hd->fp, offset, SEEK_SET);
+  err = set_position (hd, offset);
   hd->error = gpg_error_from_errno (err);
 
   return hd->error;
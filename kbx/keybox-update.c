@@ -354,6 +354,107 @@ blob_filecopy (int mode, const char *fname, KEYBOXBLOB blob,
 }
 
 
+/* Append BLOB to the keybox FNAME.  This is used instead of
+ * blob_filecopy for inserts and updates so that the time for these
+ * operations does not depend on the size of the keybox.  Readers
+ * which have the file mapped see only the old length and are thus
+ * not affected.  If FOR_OPENPGP is set the openpgp flag of the header
+ * blob is set.  If the file does not yet exist it is created.  On
+ * success the offset of the new blob is stored at R_OFF.  */
+static gpg_error_t
+blob_append (const char *fname, KEYBOXBLOB blob, int secret, int for_openpgp,
+             off_t *r_off)
+{
+  gpg_error_t err;
+  gpg_err_code_t ec;
+  estream_t fp;
+  unsigned char header[8];
+  off_t off;
+
+  *r_off = -1;
+  if ((ec = gnupg_access (fname, W_OK)))
+    {
+      if (ec == GPG_ERR_ENOENT)
+        return blob_filecopy (FILECOPY_INSERT, fname, blob, secret,
+                              for_openpgp, 0);
+      return gpg_error (ec);
+    }
+
+  fp = es_fopen (fname, "r+b");
+  if (!fp && errno == ENOENT)
+    return blob_filecopy (FILECOPY_INSERT, fname, blob, secret,
+                          for_openpgp, 0);
+  if (!fp)
+    return gpg_error_from_syserror ();
+
+  /* Make sure that the openpgp flag is set in the header.  (We
+     failsafe the blob type.)  */
+  if (es_fread (header, sizeof header, 1, fp) == 1
+      && header[4] == KEYBOX_BLOBTYPE_HEADER
+      && for_openpgp && !(header[7] & 0x02))
+    {
+      header[7] |= 0x02; /* OpenPGP data may be available.  */
+      if (es_fseeko (fp, 7, SEEK_SET)
+          || es_fputc (header[7], fp) == EOF)
+        {
+          err = gpg_error_from_syserror ();
+          goto leave;
+        }
+    }
+
+  if (es_fseeko (fp, 0, SEEK_END) || (off = es_ftello (fp)) == (off_t)-1)
+    {
+      err = gpg_error_from_syserror ();
+      goto leave;
+    }
+
+  err = _keybox_write_blob (blob, fp, NULL);
+  if (!err && es_fflush (fp))
+    err = gpg_error_from_syserror ();
+  if (err)
+    {
+      /* Do not leave a truncated blob at the end of the file.  */
+#ifndef HAVE_W32_SYSTEM
+      if (ftruncate (es_fileno (fp), off))
+        log_error ("keybox '%s': error truncating file: %s\n",
+                   fname, strerror (errno));
+#endif
+      goto leave;
+    }
+  *r_off = off;
+
+ leave:
+  if (es_fclose (fp) && !err)
+    err = gpg_error_from_syserror ();
+  return err;
+}
+
+
+/* Flag the blob at offset OFF of the keybox FNAME as deleted by
+ * setting its type to 0.  */
+static gpg_error_t
+blob_mark_deleted (const char *fname, off_t off)
+{
+  gpg_error_t err;
+  estream_t fp;
+
+  fp = es_fopen (fname, "r+b");
+  if (!fp)
+    return gpg_error_from_syserror ();
+
+  if (es_fseeko (fp, off + 4, SEEK_SET))
+    err = gpg_error_from_syserror ();
+  else if (es_fputc (0, fp) == EOF)
+    err = gpg_error_from_syserror ();
+  else
+    err = 0;
+
+  if (es_fclose (fp) && !err)
+    err = gpg_error_from_syserror ();
+  return err;
+}
+
+
 /* Insert the OpenPGP keyblock {IMAGE,IMAGELEN} into HD. */
 gpg_error_t
 keybox_insert_keyblock (KEYBOX_HANDLE hd, const void *image, size_t imagelen)
@@ -363,6 +464,7 @@ keybox_insert_keyblock (KEYBOX_HANDLE hd, const void *image, size_t imagelen)
   KEYBOXBLOB blob;
   size_t nparsed;
   struct _keybox_openpgp_info info;
+  off_t newoff;
 
   if (!hd)
     return gpg_error (GPG_ERR_INV_HANDLE);
@@ -387,7 +489,10 @@ keybox_insert_keyblock (KEYBOX_HANDLE hd, const void *image, size_t imagelen)
   _keybox_destroy_openpgp_info (&info);
   if (!err)
     {
-      err = blob_filecopy (FILECOPY_INSERT, fname, blob, hd->secret, 1, 0);
+      _keybox_index_prepare (hd->kb);
+      err = blob_append (fname, blob, hd->secret, 1, &newoff);
+      if (!err)
+        _keybox_index_update (hd->kb, -1, 0, blob);
       _keybox_release_blob (blob);
       /*    if (!rc && !hd->secret && kb_offtbl) */
       /*      { */
@@ -405,7 +510,7 @@ keybox_update_keyblock (KEYBOX_HANDLE hd, const void *image, size_t imagelen)
 {
   gpg_error_t err;
   const char *fname;
-  off_t off;
+  off_t off, newoff;
   KEYBOXBLOB blob;
   size_t nparsed;
   struct _keybox_openpgp_info info;
@@ -437,10 +542,26 @@ keybox_update_keyblock (KEYBOX_HANDLE hd, const void *image, size_t imagelen)
                                      hd->ephemeral);
   _keybox_destroy_openpgp_info (&info);
 
-  /* Update the keyblock.  */
+  /* Update the keyblock.  Instead of copying the entire file we
+   * append the new blob and then flag the old one as deleted.  If we
+   * crash in between, the next search finds both blobs; that is the
+   * same as a duplicate insert and thus less harmful than losing the
+   * key.  The space is reclaimed by keybox_compress.  */
   if (!err)
     {
-      err = blob_filecopy (FILECOPY_UPDATE, fname, blob, hd->secret, 1, off);
+      _keybox_index_prepare (hd->kb);
+      err = blob_append (fname, blob, hd->secret, 1, &newoff);
+      if (!err)
+        {
+          _keybox_index_update (hd->kb, -1, 0, blob);
+          if (newoff == -1)
+            ; /* The file has been re-created - nothing to delete.  */
+          else if ((err = blob_mark_deleted (fname, off)))
+            log_error ("keybox '%s': error deleting old blob: %s\n",
+                       fname, gpg_strerror (err));
+          else
+            _keybox_index_update (hd->kb, off, 0, NULL);
+        }
       _keybox_release_blob (blob);
     }
   return err;
@@ -456,6 +577,7 @@ keybox_insert_cert (KEYBOX_HANDLE hd, ksba_cert_t cert,
   int rc;
   const char *fname;
   KEYBOXBLOB blob;
+  off_t newoff;
 
   if (!hd)
     return gpg_error (GPG_ERR_INV_HANDLE);
@@ -473,7 +595,10 @@ keybox_insert_cert (KEYBOX_HANDLE hd, ksba_cert_t cert,
   rc = _keybox_create_x509_blob (&blob, cert, sha1_digest, hd->ephemeral);
   if (!rc)
     {
-      rc = blob_filecopy (FILECOPY_INSERT, fname, blob, hd->secret, 0, 0);
+      _keybox_index_prepare (hd->kb);
+      rc = blob_append (fname, blob, hd->secret, 0, &newoff);
+      if (!rc)
+        _keybox_index_update (hd->kb, -1, 0, blob);
       _keybox_release_blob (blob);
       /*    if (!rc && !hd->secret && kb_offtbl) */
       /*      { */
@@ -536,6 +661,7 @@ keybox_set_flags (KEYBOX_HANDLE hd, int what, int idx, unsigned int value)
   off += flag_pos;
 
   _keybox_close_file (hd);
+  _keybox_index_prepare (hd->kb);
   fp = es_fopen (hd->kb->fname, "r+b");
   if (!fp)
     return gpg_error_from_syserror ();
@@ -572,6 +698,10 @@ keybox_set_flags (KEYBOX_HANDLE hd, int what, int idx, unsigned int value)
         ec = gpg_err_code_from_syserror ();
     }
 
+  /* The flags are not indexed but the file time changed.  */
+  if (!ec)
+    _keybox_index_update (hd->kb, -1, 0, NULL);
+
   return gpg_error (ec);
 }
 
@@ -582,7 +712,6 @@ keybox_delete (KEYBOX_HANDLE hd)
 {
   off_t off;
   const char *fname;
-  estream_t fp;
   int rc;
 
   if (!hd)
@@ -598,25 +727,12 @@ keybox_delete (KEYBOX_HANDLE hd)
   off = _keybox_get_blob_fileoffset (hd->found.blob);
   if (off == (off_t)-1)
     return gpg_error (GPG_ERR_GENERAL);
-  off += 4;
 
   _keybox_close_file (hd);
-  fp = es_fopen (hd->kb->fname, "r+b");
-  if (!fp)
-    return gpg_error_from_syserror ();
-
-  if (es_fseeko (fp, off, SEEK_SET))
-    rc = gpg_error_from_syserror ();
-  else if (es_fputc (0, fp) == EOF)
-    rc = gpg_error_from_syserror ();
-  else
-    rc = 0;
-
-  if (es_fclose (fp))
-    {
-      if (!rc)
-        rc = gpg_error_from_syserror ();
-    }
+  _keybox_index_prepare (hd->kb);
+  rc = blob_mark_deleted (fname, off);
+  if (!rc)
+    _keybox_index_update (hd->kb, off, 0, NULL);
 
   return rc;
 }
@@ -791,7 +907,11 @@ keybox_compress (KEYBOX_HANDLE hd)
   if (rc || !any_changes)
     gnupg_remove (tmpfname);
   else
-    rc = rename_tmp_file (bakfname, tmpfname, fname, hd->secret);
+    {
+      rc = rename_tmp_file (bakfname, tmpfname, fname, hd->secret);
+      if (!rc)
+        _keybox_index_rebuild (hd->kb);
+    }
 
   xfree(bakfname);
   xfree(tmpfname);
@@ -59,6 +59,8 @@
 #include "../common/gc-opt-flags.h"
 #include "../common/exechelp.h"
 #include "../common/comopt.h"
+#include "../common/asynclog.h"
+#include "../common/hotpath.h"
 #include "frontend.h"
 
 
@@ -86,6 +88,7 @@ enum cmd_and_opt_values
     oNoDetach,
     oStealSocket,
     oLogFile,
+    oLogAsync,
     oServer,
     oDaemon,
     oFakedSystemTime,
@@ -117,6 +120,7 @@ static gpgrt_opt_t opts[] = {
   ARGPARSE_s_n (oDebugAll,  "debug-all",  "@"),
   ARGPARSE_s_i (oDebugWait, "debug-wait", "@"),
   ARGPARSE_s_s (oLogFile,   "log-file",  N_("use a log file for the server")),
+  ARGPARSE_s_n (oLogAsync,  "log-async", "@"),
 
   ARGPARSE_header ("Configuration",
                    N_("Options controlling the configuration")),
@@ -401,6 +405,8 @@ parse_rereadable_options (gpgrt_argparse_t *pargs, int reread)
           || strcmp (current_logfile, pargs->r.ret_str))
         {
           log_set_file (pargs->r.ret_str);
+          if (opt.log_async)
+            async_log_start ();
           xfree (current_logfile);
           current_logfile = xtrystrdup (pargs->r.ret_str);
         }
@@ -573,6 +579,7 @@ main (int argc, char **argv )
         case oNoDetach: nodetach = 1; break;
         case oStealSocket: steal_socket = 1; break;
         case oLogFile: logfile = pargs.r.ret_str; break;
+        case oLogAsync: opt.log_async = 1; break;
         case oServer: pipe_server = 1; break;
         case oDaemon: is_daemon = 1; break;
         case oFakedSystemTime:
@@ -1045,6 +1052,8 @@ reread_configuration (void)
           || strcmp (current_logfile, comopt.logfile))
         {
           log_set_file (comopt.logfile);
+          if (opt.log_async)
+            async_log_start ();
           xfree (current_logfile);
           current_logfile = comopt.logfile? xtrystrdup (comopt.logfile) : NULL;
         }
@@ -1332,6 +1341,7 @@ kbxd_sigusr2_action (void)
   if (opt.verbose)
     log_info ("SIGUSR2 received - no action\n");
   /* Nothing to do right now.  */
+  hotpath_dump ();
 }
 
 
@@ -1481,6 +1491,11 @@ handle_connections (gnupg_fd_t listen_fd)
   };
 
 
+  /* Now that we are detached and npth is running the log may be
+   * written by a separate thread.  */
+  if (opt.log_async)
+    async_log_start ();
+
   ret = npth_attr_init(&tattr);
   if (ret)
     log_fatal ("error allocating thread attributes: %s\n", strerror (ret));
@@ -40,6 +40,7 @@ struct
   int verbose;         /* Verbosity level */
   int quiet;           /* Be as quiet as possible */
   int dry_run;         /* Don't change any persistent data */
+  int log_async;       /* Write the log from a separate thread.  */
   /* True if we are running detached from the tty. */
   int running_detached;
 
@@ -52,6 +53,9 @@ struct
   pid_t transaction_pid;
   unsigned int in_transaction : 1;
   unsigned int active_transaction : 1;
+  /* Whether the requested transaction is a bulk load which defers
+   * the update of the search indices to the commit.  */
+  unsigned int bulk_transaction : 1;
 } opt;
 
 
@@ -158,6 +162,17 @@ enum kbxd_store_modes
    KBXD_STORE_UPDATE    /* Allow only updates.  */
   };
 
+/* Information about an OpenPGP keyblock as computed by the client
+ * from the self-signatures.  This is passed with STORE so that it
+ * does not need to be derived by each reader.  */
+struct kbxd_keyinfo_s
+{
+  int uidno;              /* Order number of the primary user id or 0.  */
+  unsigned int usage;     /* The usage flags of the primary key.  */
+  unsigned long expires;  /* Expiration time of the primary key or 0.  */
+  int revoked;            /* True if the primary key has been revoked.  */
+};
+
 
 
 /*-- keyboxd.c --*/
@@ -44,6 +44,7 @@
 #if defined(GNUPG_MAJOR_VERSION)
 # include "scdaemon.h"
 # include "../common/exechelp.h"
+# include "../common/opstats.h"
 #endif /*GNUPG_MAJOR_VERSION*/
 
 #include "../common/host2net.h"
@@ -121,6 +122,7 @@ struct reader_table_s {
     int pinmin;
     int pinmax;
     pcsc_dword_t current_state;
+    pcsc_dword_t watch_state;  /* State as seen by the watcher thread.  */
   } pcsc;
 #ifdef USE_G10CODE_RAPDU
   struct {
@@ -148,6 +150,18 @@ static struct reader_table_s reader_table[MAX_READER];
 
 #ifdef USE_NPTH
 static npth_mutex_t reader_table_lock;
+
+/* The PC/SC watcher thread blocks in SCardGetStatusChange and kicks
+ * the main loop on a card status change.  It uses its own context so
+ * that it can be cancelled without affecting other operations.  The
+ * timeout is only a safety net for a cancel request which arrived
+ * before the thread actually blocked.  */
+#define PCSC_WATCHER_TIMEOUT (60*1000)
+static struct {
+  int running;     /* The thread is running.  */
+  int failed;      /* Watching failed; polling is used instead.  */
+  HANDLE context;  /* The PC/SC context of the thread.  */
+} pcsc_watcher;
 #endif
 
 
@@ -477,6 +491,7 @@ new_reader_slot (void)
   reader_table[reader].pcsc.pinmin = -1;
   reader_table[reader].pcsc.pinmax = -1;
   reader_table[reader].pcsc.current_state = PCSC_STATE_UNAWARE;
+  reader_table[reader].pcsc.watch_state = PCSC_STATE_UNAWARE;
 
   return reader;
 }
@@ -842,11 +857,152 @@ release_pcsc_context (void)
   pcsc.context = 0;
 }
 
+#ifdef USE_NPTH
+/* Thread to wait for card status changes of all PC/SC readers.  */
+static void *
+pcsc_watcher_thread (void *arg)
+{
+  struct pcsc_readerstate_s rdrstates[MAX_READER];
+  char *names[MAX_READER];
+  int slots[MAX_READER];
+  int i, n, changed;
+  long err;
+
+  (void)arg;
+
+  for (;;)
+    {
+      npth_mutex_lock (&reader_table_lock);
+      for (n=i=0; i < MAX_READER; i++)
+        if (reader_table[i].used && reader_table[i].rdrname
+            && reader_table[i].get_status_reader == pcsc_get_status
+            && (names[n] = xtrystrdup (reader_table[i].rdrname)))
+          {
+            memset (&rdrstates[n], 0, sizeof *rdrstates);
+            rdrstates[n].reader = names[n];
+            rdrstates[n].current_state = reader_table[i].pcsc.watch_state;
+            slots[n++] = i;
+          }
+      npth_mutex_unlock (&reader_table_lock);
+      if (!n)
+        break;
+
+      npth_unprotect ();
+      err = pcsc_get_status_change (pcsc_watcher.context,
+                                    PCSC_WATCHER_TIMEOUT, rdrstates, n);
+      npth_protect ();
+
+      if (err && err != PCSC_E_TIMEOUT && err != PCSC_E_CANCELLED)
+        {
+          log_error ("pcsc_watcher: pcsc_get_status_change failed:"
+                     " %s (0x%lx) - falling back to polling\n",
+                     pcsc_error_string (err), err);
+          pcsc_watcher.failed = 1;
+          for (i=0; i < n; i++)
+            xfree (names[i]);
+          for (i=0; i < MAX_READER; i++)
+            if (reader_table[i].used
+                && reader_table[i].get_status_reader == pcsc_get_status)
+              reader_table[i].require_get_status = 1;
+          scd_kick_the_loop ();
+          break;
+        }
+
+      changed = 0;
+      for (i=0; i < n; i++)
+        {
+          if (!err && (rdrstates[i].event_state & PCSC_STATE_CHANGED))
+            {
+              if (reader_table[slots[i]].used
+                  && reader_table[slots[i]].rdrname
+                  && !strcmp (reader_table[slots[i]].rdrname, names[i]))
+                reader_table[slots[i]].pcsc.watch_state =
+                  (rdrstates[i].event_state & ~PCSC_STATE_CHANGED);
+              changed = 1;
+            }
+          xfree (names[i]);
+        }
+      if (changed)
+        {
+          if (DBG_READER)
+            log_debug ("pcsc_watcher: card status changed\n");
+          scd_kick_the_loop ();
+        }
+    }
+
+  pcsc_release_context (pcsc_watcher.context);
+  pcsc_watcher.context = 0;
+  pcsc_watcher.running = 0;
+  return NULL;
+}
+
+
+/* Make sure that the PC/SC watcher thread is running and tell it to
+ * re-read the list of readers.  Returns 0 if status changes are
+ * signaled by the thread.  */
+static int
+pcsc_watcher_update (void)
+{
+  npth_t thread;
+  npth_attr_t tattr;
+  long err;
+
+  if (pcsc_watcher.failed || !pcsc_cancel)
+    return -1;
+
+  if (pcsc_watcher.running)
+    {
+      err = pcsc_cancel (pcsc_watcher.context);
+      if (err)
+        log_error ("pcsc_watcher: pcsc_cancel failed: %s (0x%lx)\n",
+                   pcsc_error_string (err), err);
+      return 0;
+    }
+
+  err = pcsc_establish_context (PCSC_SCOPE_SYSTEM, NULL, NULL,
+                                &pcsc_watcher.context);
+  if (err)
+    {
+      log_error ("pcsc_watcher: pcsc_establish_context failed:"
+                 " %s (0x%lx)\n", pcsc_error_string (err), err);
+      pcsc_watcher.failed = 1;
+      return -1;
+    }
+
+  if (npth_attr_init (&tattr))
+    {
+      pcsc_release_context (pcsc_watcher.context);
+      pcsc_watcher.context = 0;
+      return -1;
+    }
+  npth_attr_setdetachstate (&tattr, NPTH_CREATE_DETACHED);
+  if (npth_create (&thread, &tattr, pcsc_watcher_thread, NULL))
+    {
+      log_error ("pcsc_watcher: npth_create failed: %s\n", strerror (errno));
+      npth_attr_destroy (&tattr);
+      pcsc_release_context (pcsc_watcher.context);
+      pcsc_watcher.context = 0;
+      pcsc_watcher.failed = 1;
+      return -1;
+    }
+  npth_setname_np (thread, "pcsc_watcher");
+  npth_attr_destroy (&tattr);
+  pcsc_watcher.running = 1;
+  return 0;
+}
+#endif /*USE_NPTH*/
+
+
 static int
 close_pcsc_reader (int slot)
 {
   /*log_debug ("%s: count=%d (ctx=%x)\n", __func__, pcsc.count, pcsc.context);*/
   (void)slot;
+#ifdef USE_NPTH
+  /* Tell the watcher thread to forget about this reader.  */
+  if (pcsc_watcher.running)
+    pcsc_cancel (pcsc_watcher.context);
+#endif
   log_assert (pcsc.count > 0);
   if (!--pcsc.count)
     release_pcsc_context ();
@@ -1267,6 +1423,12 @@ open_pcsc_reader (const char *rdrname)
   reader_table[slot].send_apdu_reader = pcsc_send_apdu;
   reader_table[slot].dump_status_reader = dump_pcsc_reader_status;
 
+#ifdef USE_NPTH
+  /* With a running watcher thread there is no need for polling.  */
+  if (!pcsc_watcher_update ())
+    reader_table[slot].require_get_status = 0;
+#endif
+
   dump_reader_status (slot);
   unlock_slot (slot);
   return slot;
@@ -2806,10 +2968,24 @@ send_apdu (int slot, unsigned char *apdu, size_t apdulen,
     return SW_HOST_NO_DRIVER;
 
   if (reader_table[slot].send_apdu_reader)
-    return reader_table[slot].send_apdu_reader (slot,
+    {
+#if defined(GNUPG_MAJOR_VERSION)
+      unsigned long long start = opstats_now ();
+      int rc;
+
+      rc = reader_table[slot].send_apdu_reader (slot,
                                                 apdu, apdulen,
                                                 buffer, buflen,
                                                 pininfo);
+      opstats_record ("APDU", start, rc? gpg_error (GPG_ERR_CARD) : 0);
+      return rc;
+#else
+      return reader_table[slot].send_apdu_reader (slot,
+                                                  apdu, apdulen,
+                                                  buffer, buflen,
+                                                  pininfo);
+#endif
+    }
   else
     return SW_HOST_NOT_SUPPORTED;
 }
@@ -3483,6 +3659,17 @@ apdu_send_direct (int slot, size_t extended_length,
 }
 
 
+/* Return true if the reader at SLOT requires periodical calls to
+   apdu_get_status to detect card removal.  */
+int
+apdu_require_get_status (int slot)
+{
+  if (slot < 0 || slot >= MAX_READER || !reader_table[slot].used)
+    return 0;
+  return reader_table[slot].require_get_status;
+}
+
+
 const char *
 apdu_get_reader_name (int slot)
 {
@@ -81,6 +81,7 @@ typedef enum
 struct card_ctx_s;
 struct app_ctx_s;
 struct app_local_s;  /* Defined by all app-*.c.  */
+struct readkey_cache_s;  /* Defined in app.c.  */
 
 
 typedef struct card_ctx_s *card_t;
@@ -95,6 +96,12 @@ struct card_ctx_s {
   /* Number of connections currently using this application context.  */
   unsigned int ref_count;
 
+  /* Number of threads holding or waiting for the lock and the total
+   * number of times the lock has been taken.  Used to pick the least
+   * busy card and for diagnostics.  */
+  unsigned int queue_len;
+  unsigned long lock_count;
+
   /* Used reader slot. */
   int slot;
 
@@ -116,6 +123,11 @@ struct card_ctx_s {
    * put the active app at the head of the list.  */
   app_t app;
 
+  /* Cache of public keys returned by the readkey function.  The cache
+   * is flushed on write operations and lives as long as the card is
+   * inserted.  */
+  struct readkey_cache_s *readkey_cache;
+
   /* Various flags.  */
   unsigned int reset_requested:1;
   unsigned int periodical_check_needed:1;
@@ -90,15 +90,15 @@ static struct {
   { 0x005E, 0,    0, 1, 0, 0, 0, 2, "Login Data" },
   { 0x5F50, 0,    0, 0, 0, 0, 0, 2, "URL" },
   { 0x5F52, 0,    0, 1, 0, 0, 0, 0, "Historical Bytes" },
-  { 0x0065, 1,    0, 1, 0, 0, 0, 0, "Cardholder Related Data"},
+  { 0x0065, 1,    0, 1, 0, 0, 0, 1, "Cardholder Related Data"},
   { 0x005B, 0, 0x65, 0, 0, 0, 0, 0, "Name" },
   { 0x5F2D, 0, 0x65, 0, 0, 0, 0, 0, "Language preferences" },
   { 0x5F35, 0, 0x65, 0, 0, 0, 0, 0, "Salutation" },
-  { 0x006E, 1,    0, 1, 0, 0, 0, 0, "Application Related Data" },
+  { 0x006E, 1,    0, 1, 0, 0, 0, 1, "Application Related Data" },
   { 0x004F, 0, 0x6E, 1, 0, 0, 0, 0, "AID" },
   { 0x0073, 1,    0, 1, 0, 0, 0, 0, "Discretionary Data Objects" },
-  { 0x0047, 0, 0x6E, 1, 1, 0, 0, 0, "Card Capabilities" },
-  { 0x00C0, 0, 0x6E, 1, 1, 0, 0, 0, "Extended Card Capabilities" },
+  { 0x0047, 0, 0x6E, 1, 0, 0, 0, 0, "Card Capabilities" },
+  { 0x00C0, 0, 0x6E, 1, 0, 0, 0, 0, "Extended Card Capabilities" },
   { 0x00C1, 0, 0x6E, 1, 1, 0, 0, 0, "Algorithm Attributes Signature" },
   { 0x00C2, 0, 0x6E, 1, 1, 0, 0, 0, "Algorithm Attributes Decryption" },
   { 0x00C3, 0, 0x6E, 1, 1, 0, 0, 0, "Algorithm Attributes Authentication" },
@@ -106,7 +106,7 @@ static struct {
   { 0x00C5, 0, 0x6E, 1, 0, 0, 0, 0, "Fingerprints" },
   { 0x00C6, 0, 0x6E, 1, 0, 0, 0, 0, "CA Fingerprints" },
   { 0x00CD, 0, 0x6E, 1, 0, 0, 0, 0, "Generation time" },
-  { 0x007A, 1,    0, 1, 0, 0, 0, 0, "Security Support Template" },
+  { 0x007A, 1,    0, 1, 0, 0, 0, 1, "Security Support Template" },
   { 0x0093, 0, 0x7A, 1, 1, 0, 0, 0, "Digital Signature Counter" },
   { 0x0101, 0,    0, 0, 0, 0, 0, 2, "Private DO 1"},
   { 0x0102, 0,    0, 0, 0, 0, 0, 2, "Private DO 2"},
@@ -150,11 +150,32 @@ rsa_key_format_t;
 struct cache_s {
   struct cache_s *next;
   int tag;
+  tlv_index_t index;  /* Index for constructed DOs or NULL.  */
   size_t length;
   unsigned char data[1];
 };
 
 
+/* DOs which never change for a card.  They are kept in a global list
+ * indexed by the serial number of the card so that they need to be
+ * read only once even if the card is re-inserted or the application
+ * is re-selected.  */
+static int const immutable_dos[] = { 0x5F52, 0x00FA, 0 };
+
+/* Maximum number of items in the global list.  */
+#define MAX_IMMUTABLE_DO_ITEMS 32
+
+struct immutable_do_s {
+  struct immutable_do_s *next;
+  unsigned char *serialno;   /* Malloced serial number of the card.  */
+  size_t serialnolen;
+  int tag;
+  size_t length;
+  unsigned char data[1];
+};
+static struct immutable_do_s *immutable_do_list;
+
+
 /* Object with application (i.e. OpenPGP card) specific data.  */
 struct app_local_s {
   /* A linked list with cached DOs.  */
@@ -351,6 +372,7 @@ do_deinit (app_t app)
       for (c = app->app_local->cache; c; c = c2)
         {
           c2 = c->next;
+          tlv_index_release (c->index);
           xfree (c);
         }
 
@@ -394,6 +416,98 @@ wipe_and_free_string (char *p)
 }
 
 
+/* Return true if TAG is listed in IMMUTABLE_DOS.  */
+static int
+is_immutable_do (int tag)
+{
+  int i;
+
+  for (i=0; immutable_dos[i]; i++)
+    if (immutable_dos[i] == tag)
+      return 1;
+  return 0;
+}
+
+
+/* Look up the immutable DO TAG of the current card in the global
+   list.  On success a malloced copy of the data is stored at RESULT
+   and its length at RESULTLEN.  Returns true if found.  */
+static int
+get_immutable_do (app_t app, int tag,
+                  unsigned char **result, size_t *resultlen)
+{
+  struct immutable_do_s *d;
+  card_t card = APP_CARD(app);
+
+  if (!card->serialno || !card->serialnolen || !is_immutable_do (tag))
+    return 0;
+
+  for (d = immutable_do_list; d; d = d->next)
+    if (d->tag == tag && d->serialnolen == card->serialnolen
+        && !memcmp (d->serialno, card->serialno, card->serialnolen))
+      {
+        *result = NULL;
+        if (d->length)
+          {
+            *result = xtrymalloc (d->length);
+            if (!*result)
+              return 0;
+            memcpy (*result, d->data, d->length);
+          }
+        *resultlen = d->length;
+        return 1;
+      }
+  return 0;
+}
+
+
+/* Store the immutable DO TAG with DATA of length LENGTH for the
+   current card in the global list.  */
+static void
+put_immutable_do (app_t app, int tag, const unsigned char *data,
+                  size_t length)
+{
+  struct immutable_do_s *d, *dprev;
+  card_t card = APP_CARD(app);
+  int count;
+
+  if (!card->serialno || !card->serialnolen || !is_immutable_do (tag))
+    return;
+
+  d = xtrymalloc (sizeof *d + length);
+  if (!d)
+    return;
+  d->serialno = xtrymalloc (card->serialnolen);
+  if (!d->serialno)
+    {
+      xfree (d);
+      return;
+    }
+  memcpy (d->serialno, card->serialno, card->serialnolen);
+  d->serialnolen = card->serialnolen;
+  d->tag = tag;
+  d->length = length;
+  if (length)
+    memcpy (d->data, data, length);
+  d->next = immutable_do_list;
+  immutable_do_list = d;
+
+  /* Drop the oldest items if the list grows too large.  */
+  for (count=0, dprev=NULL, d=immutable_do_list; d; dprev=d, d=d->next)
+    if (++count > MAX_IMMUTABLE_DO_ITEMS)
+      {
+        dprev->next = NULL;
+        for (; d; d = dprev)
+          {
+            dprev = d->next;
+            xfree (d->serialno);
+            xfree (d);
+          }
+        break;
+      }
+}
+
+
 /* Wrapper around iso7816_get_data which first tries to get the data
    from the cache.  With GET_IMMEDIATE passed as true, the cache is
    bypassed.  With TRY_EXTLEN extended lengths APDUs are use if
@@ -448,9 +562,15 @@ get_cached_data (app_t app, int tag,
   else
     exmode = 0;
 
-  err = iso7816_get_data (app_get_slot (app), exmode, tag, &p, &len);
-  if (err)
-    return err;
+  if (get_immutable_do (app, tag, &p, &len))
+    err = 0;
+  else
+    {
+      err = iso7816_get_data (app_get_slot (app), exmode, tag, &p, &len);
+      if (err)
+        return err;
+      put_immutable_do (app, tag, p, len);
+    }
   if (len)
     *result = p;
   *resultlen = len;
@@ -480,6 +600,7 @@ get_cached_data (app_t app, int tag,
         xfree (p);
       c->length = len;
       c->tag = tag;
+      c->index = NULL;
       c->next = app->app_local->cache;
       app->app_local->cache = c;
     }
@@ -504,6 +625,7 @@ flush_cache_item (app_t app, int tag)
           cprev->next = c->next;
         else
           app->app_local->cache = c->next;
+        tlv_index_release (c->index);
         xfree (c);
 
         for (c=app->app_local->cache; c ; c = c->next)
@@ -544,6 +666,7 @@ flush_cache (app_t app)
       for (c = app->app_local->cache; c; c = c2)
         {
           c2 = c->next;
+          tlv_index_release (c->index);
           xfree (c);
         }
       app->app_local->cache = NULL;
@@ -551,6 +674,25 @@ flush_cache (app_t app)
 }
 
 
+/* Return the TLV index for the cached constructed DO with TAG.  The
+   index is created on first use.  Returns NULL if the DO is not
+   cached.  */
+static tlv_index_t
+get_cached_index (app_t app, int tag)
+{
+  struct cache_s *c;
+
+  for (c=app->app_local->cache; c; c = c->next)
+    if (c->tag == tag)
+      {
+        if (!c->index && c->length)
+          tlv_index_new (&c->index, c->data, c->length);
+        return c->index;
+      }
+  return NULL;
+}
+
+
 /* Get the DO identified by TAG from the card in SLOT and return a
    buffer with its content in RESULT and NBYTES.  The return value is
    NULL if not found or a pointer which must be used to release the
@@ -602,8 +744,17 @@ get_one_do (app_t app, int tag, unsigned char **result, size_t *nbytes,
       if (!rc)
         {
           const unsigned char *s;
-
-          s = find_tlv_unchecked (buffer, buflen, tag, &valuelen);
+          tlv_index_t tix;
+          size_t off;
+
+          /* Constructed DOs like the Application Related Data are
+           * queried for many tags; use the index if we have one.  */
+          tix = get_cached_index (app, data_objects[i].get_from);
+          if (tix)
+            s = (tlv_index_lookup (tix, tag, &off, &valuelen)
+                 ? buffer + off : NULL);
+          else
+            s = find_tlv_unchecked (buffer, buflen, tag, &valuelen);
           if (!s)
             value = NULL; /* not found */
           else if (valuelen > buflen - (s - buffer))
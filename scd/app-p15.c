@@ -511,9 +511,48 @@ struct app_local_s
   /* Information on all authentication objects. */
   aodf_object_t auth_object_info;
 
+  /* The SHA-256 hash of the TokenInfo EF.  Used to validate the
+   * directory cache.  */
+  unsigned char tokeninfo_hash[32];
+
+  /* The serial number used as key for the directory cache or NULL if
+   * the cache is not used for this card.  Malloced.  */
+  unsigned char *cache_sn;
+  size_t cache_snlen;
 };
 
 
+/* A global cache with the raw content of the directory files and the
+ * certificates read from a card.  The entries are indexed by the
+ * serial number of the card and are valid as long as the TokenInfo
+ * and the ODF EFs of the card do not change; these two files are
+ * always read.  This makes re-selecting the application or
+ * re-inserting a card with a large number of objects fast.  All
+ * supported cards are read-only with respect to this application.  */
+struct p15_cache_file_s
+{
+  struct p15_cache_file_s *next;
+  char *key;            /* Malloced key describing the file.  */
+  size_t length;
+  unsigned char data[1];
+};
+
+struct p15_cache_s
+{
+  struct p15_cache_s *next;
+  unsigned char *serialno;  /* Malloced serial number of the card.  */
+  size_t serialnolen;
+  unsigned char tokeninfo_hash[32];
+  unsigned char odf_hash[32];
+  struct p15_cache_file_s *files;
+};
+static struct p15_cache_s *p15_cache;
+
+/* Maximum number of cards in the above cache.  */
+#define MAX_P15_CACHE_CARDS 8
+
+
+
 /*** Local prototypes.  ***/
 static gpg_error_t select_ef_by_path (app_t app, const unsigned short *path,
                                       size_t pathlen);
@@ -653,6 +692,173 @@ release_tokeninfo (app_t app)
 }
 
 
+/* Release the cache entry C.  */
+static void
+release_p15_cache_entry (struct p15_cache_s *c)
+{
+  struct p15_cache_file_s *f, *f2;
+
+  if (!c)
+    return;
+  for (f = c->files; f; f = f2)
+    {
+      f2 = f->next;
+      xfree (f->key);
+      xfree (f);
+    }
+  xfree (c->serialno);
+  xfree (c);
+}
+
+
+/* Return the cache entry for the current card or NULL.  */
+static struct p15_cache_s *
+find_p15_cache (app_t app)
+{
+  struct p15_cache_s *c;
+
+  if (!app->app_local->cache_sn)
+    return NULL;
+  for (c = p15_cache; c; c = c->next)
+    if (c->serialnolen == app->app_local->cache_snlen
+        && !memcmp (c->serialno, app->app_local->cache_sn, c->serialnolen))
+      return c;
+  return NULL;
+}
+
+
+/* Prepare the cache for the current card after the ODF has been read
+ * into (ODF,ODFLEN).  Cached data is dropped if the TokenInfo or the
+ * ODF changed.  */
+static void
+validate_p15_cache (app_t app, const unsigned char *odf, size_t odflen)
+{
+  card_t card = APP_CARD(app);
+  struct p15_cache_s *c, *cprev;
+  unsigned char odf_hash[32];
+  int count;
+
+  xfree (app->app_local->cache_sn);
+  app->app_local->cache_sn = NULL;
+  if (!card->serialno || !card->serialnolen)
+    return;
+  app->app_local->cache_sn = xtrymalloc (card->serialnolen);
+  if (!app->app_local->cache_sn)
+    return;
+  memcpy (app->app_local->cache_sn, card->serialno, card->serialnolen);
+  app->app_local->cache_snlen = card->serialnolen;
+
+  gcry_md_hash_buffer (GCRY_MD_SHA256, odf_hash, odf, odflen);
+
+  for (c = p15_cache, cprev = NULL; c; cprev = c, c = c->next)
+    if (c->serialnolen == card->serialnolen
+        && !memcmp (c->serialno, card->serialno, c->serialnolen))
+      break;
+  if (c)
+    {
+      if (!memcmp (c->tokeninfo_hash, app->app_local->tokeninfo_hash, 32)
+          && !memcmp (c->odf_hash, odf_hash, 32))
+        {
+          if (opt.verbose)
+            log_info ("p15: using cached directory data\n");
+          return;
+        }
+      if (cprev)
+        cprev->next = c->next;
+      else
+        p15_cache = c->next;
+      release_p15_cache_entry (c);
+    }
+
+  c = xtrycalloc (1, sizeof *c);
+  if (!c)
+    return;
+  c->serialno = xtrymalloc (card->serialnolen);
+  if (!c->serialno)
+    {
+      xfree (c);
+      return;
+    }
+  memcpy (c->serialno, card->serialno, card->serialnolen);
+  c->serialnolen = card->serialnolen;
+  memcpy (c->tokeninfo_hash, app->app_local->tokeninfo_hash, 32);
+  memcpy (c->odf_hash, odf_hash, 32);
+  c->next = p15_cache;
+  p15_cache = c;
+
+  /* Drop the oldest cards if the cache grows too large.  */
+  for (count=0, cprev=NULL, c=p15_cache; c; cprev=c, c=c->next)
+    if (++count > MAX_P15_CACHE_CARDS)
+      {
+        cprev->next = NULL;
+        for (; c; c = cprev)
+          {
+            cprev = c->next;
+            release_p15_cache_entry (c);
+          }
+        break;
+      }
+}
+
+
+/* Look up the file KEY of the current card in the cache.  On success
+ * a malloced copy of the data is stored at R_BUFFER and its length at
+ * R_BUFLEN and true is returned.  */
+static int
+get_p15_cache (app_t app, const char *key,
+               unsigned char **r_buffer, size_t *r_buflen)
+{
+  struct p15_cache_s *c;
+  struct p15_cache_file_s *f;
+
+  c = find_p15_cache (app);
+  if (!c)
+    return 0;
+  for (f = c->files; f; f = f->next)
+    if (!strcmp (f->key, key))
+      {
+        *r_buffer = xtrymalloc (f->length? f->length : 1);
+        if (!*r_buffer)
+          return 0;
+        memcpy (*r_buffer, f->data, f->length);
+        *r_buflen = f->length;
+        return 1;
+      }
+  return 0;
+}
+
+
+/* Store the file KEY with (DATA,LENGTH) of the current card in the
+ * cache.  */
+static void
+put_p15_cache (app_t app, const char *key,
+               const unsigned char *data, size_t length)
+{
+  struct p15_cache_s *c;
+  struct p15_cache_file_s *f;
+
+  c = find_p15_cache (app);
+  if (!c)
+    return;
+  for (f = c->files; f; f = f->next)
+    if (!strcmp (f->key, key))
+      return;
+  f = xtrymalloc (sizeof *f + length);
+  if (!f)
+    return;
+  f->key = xtrystrdup (key);
+  if (!f->key)
+    {
+      xfree (f);
+      return;
+    }
+  f->length = length;
+  memcpy (f->data, data, length);
+  f->next = c->files;
+  c->files = f;
+}
+
+
 /* Release all local resources.  */
 static void
 do_deinit (app_t app)
@@ -661,6 +867,7 @@ do_deinit (app_t app)
     {
       release_lists (app);
       release_tokeninfo (app);
+      xfree (app->app_local->cache_sn);
       xfree (app->app_local);
       app->app_local = NULL;
     }
@@ -1086,6 +1293,8 @@ read_ef_odf (app_t app, unsigned short odf_fid)
       return gpg_error (GPG_ERR_INV_OBJ);
     }
 
+  validate_p15_cache (app, buffer, buflen);
+
   home_df = app->app_local->home_df;
   p = buffer;
   while (buflen && *p && *p != 0xff)
@@ -1221,7 +1430,16 @@ read_first_record (app_t app, unsigned short fid, const char *fid_desc,
         }
     }
   else
-    err = select_and_read_binary (app, fid, fid_desc, r_buffer, r_buflen);
+    {
+      char key[20];
+
+      snprintf (key, sizeof key, "d%04hX/%04hX", app->app_local->home_df, fid);
+      if (get_p15_cache (app, key, r_buffer, r_buflen))
+        return 0;
+      err = select_and_read_binary (app, fid, fid_desc, r_buffer, r_buflen);
+      if (!err)
+        put_p15_cache (app, key, *r_buffer, *r_buflen);
+    }
 
   /* We get a not_found state in read_record mode if the select
    * succeeded but reading the record failed.  Map that to no_data
@@ -3463,6 +3681,8 @@ read_ef_tokeninfo (app_t app)
   err = select_and_read_binary (app, 0x5032, "TokenInfo", &buffer, &buflen);
   if (err)
     return err;
+  gcry_md_hash_buffer (GCRY_MD_SHA256, app->app_local->tokeninfo_hash,
+                       buffer, buflen);
 
   p = buffer;
   n = buflen;
@@ -4296,6 +4516,8 @@ readcert_by_cdf (app_t app, cdf_object_t cdf,
   size_t totobjlen, objlen, hdrlen;
   int rootca;
   int i;
+  membuf_t mb;
+  char *cachekey;
 
   if (r_cert)
     *r_cert = NULL;
@@ -4346,19 +4568,45 @@ readcert_by_cdf (app_t app, cdf_object_t cdf,
       log_printf ("\n");
     }
 
-  /* Read the entire file.  fixme: This could be optimized by first
-     reading the header to figure out how long the certificate
-     actually is. */
-  err = select_ef_by_path (app, cdf->path, cdf->pathlen);
-  if (err)
-    goto leave;
+  /* Build the key for the cache from the location of the cert.  */
+  init_membuf (&mb, 64);
+  put_membuf_str (&mb, "c");
+  for (i=0; i < cdf->pathlen; i++)
+    put_membuf_printf (&mb, "/%04hX", cdf->path[i]);
+  put_membuf_printf (&mb, "[%lu/%lu]", cdf->off, cdf->len);
+  put_membuf (&mb, "", 1);
+  cachekey = get_membuf (&mb, NULL);
+  if (!cachekey)
+    {
+      err = gpg_error_from_syserror ();
+      goto leave;
+    }
 
-  if (app->app_local->no_extended_mode || !cdf->len)
-    err = iso7816_read_binary_ext (app_get_slot (app), 0, cdf->off, 0,
-                                   &buffer, &buflen, NULL);
+  if (get_p15_cache (app, cachekey, &buffer, &buflen))
+    err = 0;
   else
-    err = iso7816_read_binary_ext (app_get_slot (app), 1, cdf->off, cdf->len,
-                                   &buffer, &buflen, NULL);
+    {
+      /* Read the entire file.  fixme: This could be optimized by
+         first reading the header to figure out how long the
+         certificate actually is. */
+      err = select_ef_by_path (app, cdf->path, cdf->pathlen);
+      if (err)
+        {
+          xfree (cachekey);
+          goto leave;
+        }
+
+      if (app->app_local->no_extended_mode || !cdf->len)
+        err = iso7816_read_binary_ext (app_get_slot (app), 0, cdf->off, 0,
+                                       &buffer, &buflen, NULL);
+      else
+        err = iso7816_read_binary_ext (app_get_slot (app), 1,
+                                       cdf->off, cdf->len,
+                                       &buffer, &buflen, NULL);
+      if (!err && buflen && *buffer != 0xff)
+        put_p15_cache (app, cachekey, buffer, buflen);
+    }
+  xfree (cachekey);
   if (!err && (!buflen || *buffer == 0xff))
     err = gpg_error (GPG_ERR_NOT_FOUND);
   if (err)
@@ -207,6 +207,17 @@ struct app_local_s {
   /* A linked list with cached DOs.  */
   struct cache_s *cache;
 
+  /* The keygrips of the keypair DOs, indexed like DATA_OBJECTS.  They
+   * are computed once at select time and flushed along with the DO
+   * cache.  */
+  struct
+  {
+    unsigned int valid:1;     /* The item has been computed.  */
+    unsigned int got_cert:1;  /* The keygrip was taken from a cert.  */
+    gpg_error_t err;          /* Error code if no keygrip is available.  */
+    char keygripstr[2*KEYGRIP_LEN+1];
+  } keygrip[DIM (data_objects)];
+
   /* Various flags.  */
   struct
   {
@@ -359,6 +370,11 @@ static void
 flush_cached_data (app_t app, int tag)
 {
   struct cache_s *c, *cprev;
+  int i;
+
+  for (i=0; data_objects[i].tag; i++)
+    if (data_objects[i].tag == tag || !tag)
+      app->app_local->keygrip[i].valid = 0;
 
   for (c=app->app_local->cache, cprev=NULL; c; cprev=c, c = c->next)
     if (c->tag == tag || !tag)
@@ -1256,15 +1272,34 @@ get_keygrip_by_tag (app_t app, unsigned int tag,
   gcry_sexp_t s_pkey = NULL;
   ksba_cert_t cert = NULL;
   unsigned char grip[KEYGRIP_LEN];
+  int idx = -1;
+  int from_cache = 0;
 
   *r_got_cert = 0;
   *r_keygripstr = xtrymalloc (2*KEYGRIP_LEN+1);
-  if (!r_keygripstr)
+  if (!*r_keygripstr)
     {
       err = gpg_error_from_syserror ();
       goto leave;
     }
 
+  for (idx=0; data_objects[idx].tag; idx++)
+    if (data_objects[idx].tag == tag)
+      break;
+  if (!data_objects[idx].tag)
+    idx = -1;
+  else if (app->app_local->keygrip[idx].valid)
+    {
+      from_cache = 1;
+      err = app->app_local->keygrip[idx].err;
+      if (!err)
+        {
+          strcpy (*r_keygripstr, app->app_local->keygrip[idx].keygripstr);
+          *r_got_cert = app->app_local->keygrip[idx].got_cert;
+        }
+      goto leave;
+    }
+
   /* We need to get the public key from the certificate.  */
   err = readcert_by_tag (app, tag, &certbuf, &certbuflen, &mechanism);
   if (err)
@@ -1303,6 +1338,18 @@ get_keygrip_by_tag (app_t app, unsigned int tag,
     }
 
  leave:
+  /* Remember the result; transient errors are not cached.  */
+  if (idx != -1 && !from_cache
+      && (!err
+          || gpg_err_code (err) == GPG_ERR_NOT_FOUND
+          || gpg_err_code (err) == GPG_ERR_NO_PUBKEY))
+    {
+      app->app_local->keygrip[idx].valid = 1;
+      app->app_local->keygrip[idx].err = err;
+      app->app_local->keygrip[idx].got_cert = !!*r_got_cert;
+      if (!err)
+        strcpy (app->app_local->keygrip[idx].keygripstr, *r_keygripstr);
+    }
   gcry_sexp_release (s_pkey);
   ksba_cert_release (cert);
   xfree (certbuf);
@@ -3712,6 +3759,23 @@ app_select_piv (app_t app)
   if (app->card->cardtype == CARDTYPE_YUBIKEY)
     app->app_local->flags.yubikey = 1;
 
+  /* Prefetch all keypair DOs and compute their keygrips so that
+   * LEARN, KEYINFO, READKEY and READCERT are served from the cache.
+   * Errors are ignored here; they show up again when the key is
+   * actually used.  */
+  {
+    int i, dummy_got_cert;
+    char *keygripstr;
+
+    for (i=0; data_objects[i].tag; i++)
+      if (data_objects[i].keypair)
+        {
+          if (!get_keygrip_by_tag (app, data_objects[i].tag,
+                                   &keygripstr, &dummy_got_cert))
+            xfree (keygripstr);
+        }
+  }
+
 
   /* FIXME: Parse the optional and conditional DOs in the APT.  */
 
@@ -75,6 +75,19 @@ static struct mrsw_lock card_list_lock;
  * (described by app_t) on the same physical token. */
 static card_t card_top;
 
+/* An object to cache the result of a readkey call.  */
+struct readkey_cache_s
+{
+  struct readkey_cache_s *next;
+  apptype_t apptype;     /* The application which returned the key.  */
+  unsigned char *pk;     /* The public key; allocated.  */
+  size_t pklen;
+  char keyid[1];         /* The key id as requested.  */
+};
+
+/* Maximum number of items in the readkey cache of a card.  */
+#define MAX_READKEY_CACHE_ITEMS 16
+
 
 /* The list of application names and their select function.  If no
  * specific application is selected the first available application on
@@ -287,13 +300,16 @@ print_progress_line (void *opaque, const char *what, int pc, int cur, int tot)
 static gpg_error_t
 lock_card (card_t card, ctrl_t ctrl)
 {
+  card->queue_len++;
   if (npth_mutex_lock (&card->lock))
     {
       gpg_error_t err = gpg_error_from_syserror ();
+      card->queue_len--;
       log_error ("failed to acquire CARD lock for %p: %s\n",
                  card, gpg_strerror (err));
       return err;
     }
+  card->lock_count++;
 
   apdu_set_progress_cb (card->slot, print_progress_line, ctrl);
   apdu_set_prompt_cb (card->slot, popup_prompt, ctrl);
@@ -309,6 +325,8 @@ unlock_card (card_t card)
   apdu_set_progress_cb (card->slot, NULL, NULL);
   apdu_set_prompt_cb (card->slot, NULL, NULL);
 
+  if (card->queue_len)
+    card->queue_len--;
   if (npth_mutex_unlock (&card->lock))
     {
       gpg_error_t err = gpg_error_from_syserror ();
@@ -399,8 +417,10 @@ app_dump_state (void)
   card_list_r_lock ();
   for (c = card_top; c; c = c->next)
     {
-      log_info ("app_dump_state: card=%p slot=%d type=%s refcount=%u\n",
-                c, c->slot, strcardtype (c->cardtype), c->ref_count);
+      log_info ("app_dump_state: card=%p slot=%d type=%s refcount=%u"
+                " queue=%u locks=%lu\n",
+                c, c->slot, strcardtype (c->cardtype), c->ref_count,
+                c->queue_len, c->lock_count);
       /* FIXME The use of log_info risks a race!  */
       for (a=c->app; a; a = a->next)
         log_info ("app_dump_state:   app=%p type='%s'\n",
@@ -532,12 +552,90 @@ check_application_conflict (card_t card, const char *name,
 }
 
 
+/* Flush the readkey cache of CARD.  This needs to be called after
+ * all operations which may change a key on the card.  */
+static void
+flush_readkey_cache (card_t card)
+{
+  struct readkey_cache_s *rc, *rcnext;
+
+  for (rc = card->readkey_cache; rc; rc = rcnext)
+    {
+      rcnext = rc->next;
+      xfree (rc->pk);
+      xfree (rc);
+    }
+  card->readkey_cache = NULL;
+}
+
+
+/* Return a copy of the cached public key KEYID of the current app of
+ * CARD at (PK,PKLEN).  Returns true if found.  */
+static int
+get_readkey_cache (card_t card, const char *keyid,
+                   unsigned char **pk, size_t *pklen)
+{
+  struct readkey_cache_s *rc;
+
+  for (rc = card->readkey_cache; rc; rc = rc->next)
+    if (rc->apptype == card->app->apptype && !strcmp (rc->keyid, keyid))
+      {
+        *pk = xtrymalloc (rc->pklen);
+        if (!*pk)
+          return 0;
+        memcpy (*pk, rc->pk, rc->pklen);
+        *pklen = rc->pklen;
+        return 1;
+      }
+  return 0;
+}
+
+
+/* Store a copy of the public key (PK,PKLEN) for KEYID of the current
+ * app of CARD in the readkey cache.  */
+static void
+put_readkey_cache (card_t card, const char *keyid,
+                   const unsigned char *pk, size_t pklen)
+{
+  struct readkey_cache_s *rc, *rcprev;
+  int count;
+
+  rc = xtrymalloc (sizeof *rc + strlen (keyid));
+  if (!rc)
+    return;
+  rc->pk = xtrymalloc (pklen);
+  if (!rc->pk)
+    {
+      xfree (rc);
+      return;
+    }
+  memcpy (rc->pk, pk, pklen);
+  rc->pklen = pklen;
+  rc->apptype = card->app->apptype;
+  strcpy (rc->keyid, keyid);
+  rc->next = card->readkey_cache;
+  card->readkey_cache = rc;
+
+  /* Drop the oldest entry if the cache is too large.  */
+  for (count = 0, rcprev = NULL, rc = card->readkey_cache;
+       rc; rcprev = rc, rc = rc->next)
+    if (++count > MAX_READKEY_CACHE_ITEMS)
+      {
+        rcprev->next = rc->next;
+        xfree (rc->pk);
+        xfree (rc);
+        break;
+      }
+}
+
+
 gpg_error_t
 card_reset (card_t card)
 {
   gpg_error_t err = 0;
   int sw;
 
+  flush_readkey_cache (card);
   sw = apdu_reset (card->slot);
   if (sw)
     err = gpg_error (GPG_ERR_CARD_RESET);
@@ -1195,6 +1293,7 @@ deallocate_card (card_t card)
       xfree (a);
     }
 
+  flush_readkey_cache (card);
   xfree (card->serialno);
   unlock_card (card);
   xfree (card);
@@ -1206,10 +1305,32 @@ do_with_keygrip (ctrl_t ctrl, int action, const char *keygrip_str,
                  int capability)
 {
   int locked = 0;
-  card_t c;
+  card_t c, *cards;
   app_t a, a_prev;
+  int i, j, ncards;
 
-  for (c = card_top; c; c = c->next)
+  for (ncards = 0, c = card_top; c; c = c->next)
+    ncards++;
+  cards = xtrycalloc (ncards + 1, sizeof *cards);
+  if (!cards)
+    return NULL;
+  for (i = 0, c = card_top; c; c = c->next)
+    cards[i++] = c;
+
+  /* For a lookup we try the least busy cards first.  Thus if the same
+   * key is available on several tokens the operation is scheduled to
+   * a token which can process it right away.  The sort is stable so
+   * that the order of the list is kept for idle cards.  */
+  if (action == KEYGRIP_ACTION_LOOKUP)
+    for (i = 1; i < ncards; i++)
+      {
+        c = cards[i];
+        for (j = i; j > 0 && cards[j-1]->queue_len > c->queue_len; j--)
+          cards[j] = cards[j-1];
+        cards[j] = c;
+      }
+
+  for (i = 0; (c = cards[i]); i++)
     {
       if (lock_card (c, ctrl))
         {
@@ -1264,6 +1385,7 @@ do_with_keygrip (ctrl_t ctrl, int action, const char *keygrip_str,
       unlock_card (c);
       locked = 0;
     }
+  xfree (cards);
   return c;
 }
 
@@ -1786,6 +1908,8 @@ write_learn_status_core (card_t card, app_t app, ctrl_t ctrl,
     err = gpg_error (GPG_ERR_CARD_RESET);
   else
     {
+      if (card && (flags & APP_LEARN_FLAG_REREAD))
+        flush_readkey_cache (card);
       err = app->fnc.learn_status (app, ctrl, flags);
       if (err && (flags & APP_LEARN_FLAG_REREAD))
         app->need_reset = 1;
@@ -1930,8 +2054,20 @@ app_readkey (card_t card, ctrl_t ctrl, const char *keyid, unsigned int flags,
                    card->slot, xstrapptype (card->app), keyid);
       if (card->app->need_reset)
         err = gpg_error (GPG_ERR_CARD_RESET);
+      else if (pk && pklen && !(flags & APP_READKEY_FLAG_INFO)
+               && get_readkey_cache (card, keyid, pk, pklen))
+        {
+          if (DBG_APP)
+            log_debug ("slot %d app %s: readkey(%s) served from cache\n",
+                       card->slot, xstrapptype (card->app), keyid);
+        }
       else
-        err = card->app->fnc.readkey (card->app, ctrl, keyid, flags, pk, pklen);
+        {
+          err = card->app->fnc.readkey (card->app, ctrl, keyid, flags,
+                                        pk, pklen);
+          if (!err && pk && *pk && pklen && *pklen)
+            put_readkey_cache (card, keyid, *pk, *pklen);
+        }
     }
 
   return err;
@@ -2011,8 +2147,11 @@ app_setattr (card_t card, ctrl_t ctrl, const char *name,
       if (card->app->need_reset)
         err = gpg_error (GPG_ERR_CARD_RESET);
       else
-        err = card->app->fnc.setattr (card->app, ctrl, name, pincb, pincb_arg,
-                                      value, valuelen);
+        {
+          flush_readkey_cache (card);
+          err = card->app->fnc.setattr (card->app, ctrl, name,
+                                        pincb, pincb_arg, value, valuelen);
+        }
     }
 
   return err;
@@ -2170,8 +2309,11 @@ app_writecert (card_t card, ctrl_t ctrl,
       if (card->app->need_reset)
         err = gpg_error (GPG_ERR_CARD_RESET);
       else
-        err = card->app->fnc.writecert (card->app, ctrl, certidstr,
-                                        pincb, pincb_arg, data, datalen);
+        {
+          flush_readkey_cache (card);
+          err = card->app->fnc.writecert (card->app, ctrl, certidstr,
+                                          pincb, pincb_arg, data, datalen);
+        }
     }
 
   if (opt.verbose)
@@ -2205,8 +2347,12 @@ app_writekey (card_t card, ctrl_t ctrl,
       if (card->app->need_reset)
         err = gpg_error (GPG_ERR_CARD_RESET);
       else
-        err = card->app->fnc.writekey (card->app, ctrl, keyidstr, flags,
-                                       pincb, pincb_arg, keydata, keydatalen);
+        {
+          flush_readkey_cache (card);
+          err = card->app->fnc.writekey (card->app, ctrl, keyidstr, flags,
+                                         pincb, pincb_arg,
+                                         keydata, keydatalen);
+        }
     }
 
   if (opt.verbose)
@@ -2239,8 +2385,11 @@ app_genkey (card_t card, ctrl_t ctrl, const char *keynostr,
       if (card->app->need_reset)
         err = gpg_error (GPG_ERR_CARD_RESET);
       else
-        err = card->app->fnc.genkey (card->app, ctrl, keynostr, keytype, flags,
-                                     createtime, pincb, pincb_arg);
+        {
+          flush_readkey_cache (card);
+          err = card->app->fnc.genkey (card->app, ctrl, keynostr, keytype,
+                                       flags, createtime, pincb, pincb_arg);
+        }
     }
 
   if (opt.verbose)
@@ -2409,6 +2558,11 @@ scd_update_reader_status_file (void)
       lock_card (card, NULL);
       card_next = card->next;
 
+      /* The reader may have switched back to polling.  */
+      if (!card->periodical_check_needed
+          && apdu_require_get_status (card->slot) > 0)
+        card->periodical_check_needed = 1;
+
       if (card->reset_requested)
         {
           /* Here is the post-processing of RESET request.  */
@@ -254,6 +254,11 @@ struct ccid_driver_s
 
   unsigned char intr_buf[64];
   struct libusb_transfer *transfer;
+
+  /* A bulk in transfer submitted before the command is sent.  */
+  struct libusb_transfer *bulk_in_transfer;
+  int bulk_in_posted;  /* The transfer is in flight.  */
+  int bulk_in_done;    /* Set by the callback on completion.  */
 };
 
 
@@ -287,6 +292,7 @@ static struct ccid_dev_table ccid_dev_table[CCID_MAX_DEVICE];
 
 static unsigned int compute_edc (const unsigned char *data, size_t datalen,
                                  int use_crc);
+static void bulk_in_cancel (ccid_driver_t handle);
 static int bulk_out (ccid_driver_t handle, unsigned char *msg, size_t msglen,
                      int no_debug);
 static int bulk_in (ccid_driver_t handle, unsigned char *buffer, size_t length,
@@ -953,6 +959,15 @@ parse_ccid_descriptor (ccid_driver_t handle, unsigned short bcd_device,
       handle->max_ifsd = 48;
     }
 
+  /* The IFSD is a single byte in the S-block and the largest block
+     (10 CCID header, 3 prologue, 2 EDC) must fit into a CCID
+     message.  */
+  if (handle->max_ifsd > 254)
+    handle->max_ifsd = 254;
+  if (handle->max_ccid_msglen > 15
+      && handle->max_ifsd > handle->max_ccid_msglen - 15)
+    handle->max_ifsd = handle->max_ccid_msglen - 15;
+
   if (handle->id_vendor == VENDOR_GEMPC)
     {
       DEBUGOUT ("enabling product quirk: disable non-null NAD\n");
@@ -1953,6 +1968,13 @@ do_close_reader (ccid_driver_t handle)
       handle->transfer = NULL;
     }
 
+  if (handle->bulk_in_transfer)
+    {
+      bulk_in_cancel (handle);
+      libusb_free_transfer (handle->bulk_in_transfer);
+      handle->bulk_in_transfer = NULL;
+    }
+
   DEBUGOUT ("libusb_release_interface and libusb_close\n");
   libusb_release_interface (handle->idev, handle->ifc_no);
   --ccid_usb_thread_is_alive;
@@ -2010,6 +2032,121 @@ ccid_check_card_presence (ccid_driver_t handle)
 }
 
 
+/* Completion callback for the pre-posted bulk in transfer.  */
+static void
+bulk_in_cb (struct libusb_transfer *transfer)
+{
+  ccid_driver_t handle = transfer->user_data;
+
+  handle->bulk_in_done = 1;
+}
+
+
+/* Submit a bulk in transfer for BUFFER of LENGTH before sending a
+   command so that the response of the reader is picked up as soon as
+   it is available.  The next call to bulk_in with the same BUFFER
+   waits for that transfer.  Returns 0 on success; on error the
+   caller falls back to a synchronous read.  */
+static int
+bulk_in_prepost (ccid_driver_t handle, unsigned char *buffer, size_t length)
+{
+  int rc;
+
+  if (handle->enodev_seen || handle->bulk_in_posted
+      || !ccid_usb_thread_is_alive)
+    return -1;
+
+  if (!handle->bulk_in_transfer)
+    {
+      handle->bulk_in_transfer = libusb_alloc_transfer (0);
+      if (!handle->bulk_in_transfer)
+        return -1;
+    }
+
+  memset (buffer, 0, length);
+  libusb_fill_bulk_transfer (handle->bulk_in_transfer, handle->idev,
+                             handle->ep_bulk_in, buffer, length,
+                             bulk_in_cb, handle, 0);
+  handle->bulk_in_done = 0;
+  rc = libusb_submit_transfer (handle->bulk_in_transfer);
+  if (rc)
+    {
+      DEBUGOUT_1 ("submitting bulk-in transfer failed: %s\n",
+                  libusb_error_name (rc));
+      return -1;
+    }
+  handle->bulk_in_posted = 1;
+  return 0;
+}
+
+
+/* Cancel a pre-posted bulk in transfer and wait until it is done.  */
+static void
+bulk_in_cancel (ccid_driver_t handle)
+{
+  if (!handle->bulk_in_posted)
+    return;
+
+#ifdef USE_NPTH
+  npth_unprotect ();
+#endif
+  libusb_cancel_transfer (handle->bulk_in_transfer);
+  while (!handle->bulk_in_done)
+    libusb_handle_events_completed (NULL, &handle->bulk_in_done);
+#ifdef USE_NPTH
+  npth_protect ();
+#endif
+  handle->bulk_in_posted = 0;
+}
+
+
+/* Wait for the pre-posted bulk in transfer but not longer than
+   TIMEOUT ms.  Stores the number of received bytes at NREAD and
+   returns a libusb error code.  */
+static int
+bulk_in_wait (ccid_driver_t handle, int timeout, int *nread)
+{
+  struct libusb_transfer *transfer = handle->bulk_in_transfer;
+  struct timeval tv;
+  time_t deadline;
+
+  deadline = time (NULL) + (timeout + 999) / 1000;
+#ifdef USE_NPTH
+  npth_unprotect ();
+#endif
+  while (!handle->bulk_in_done)
+    {
+      if (time (NULL) > deadline)
+        {
+          libusb_cancel_transfer (transfer);
+          while (!handle->bulk_in_done)
+            libusb_handle_events_completed (NULL, &handle->bulk_in_done);
+          break;
+        }
+      tv.tv_sec = 0;
+      tv.tv_usec = 100000;
+      libusb_handle_events_timeout_completed (NULL, &tv,
+                                              &handle->bulk_in_done);
+    }
+#ifdef USE_NPTH
+  npth_protect ();
+#endif
+  handle->bulk_in_posted = 0;
+
+  *nread = transfer->actual_length;
+  switch (transfer->status)
+    {
+    case LIBUSB_TRANSFER_COMPLETED: return 0;
+    case LIBUSB_TRANSFER_TIMED_OUT:
+    case LIBUSB_TRANSFER_CANCELLED: return LIBUSB_ERROR_TIMEOUT;
+    case LIBUSB_TRANSFER_NO_DEVICE: return LIBUSB_ERROR_NO_DEVICE;
+    case LIBUSB_TRANSFER_OVERFLOW:  return LIBUSB_ERROR_OVERFLOW;
+    case LIBUSB_TRANSFER_STALL:     return LIBUSB_ERROR_PIPE;
+    default:                        return LIBUSB_ERROR_IO;
+    }
+}
+
+
 /* Write a MSG of length MSGLEN to the designated bulk out endpoint.
    Returns 0 on success. */
 static int
@@ -2119,19 +2256,29 @@ bulk_in (ccid_driver_t handle, unsigned char *buffer, size_t length,
   int notified = 0;
   int bwi = 1;
 
+  /* A pre-posted transfer for another buffer is useless.  */
+  if (handle->bulk_in_posted && handle->bulk_in_transfer->buffer != buffer)
+    bulk_in_cancel (handle);
+
   /* Fixme: The next line for the current Valgrind without support
      for USB IOCTLs. */
-  memset (buffer, 0, length);
+  if (!handle->bulk_in_posted)
+    memset (buffer, 0, length);
  retry:
 
+  if (handle->bulk_in_posted)
+    rc = bulk_in_wait (handle, bwi*timeout, &msglen);
+  else
+    {
 #ifdef USE_NPTH
-  npth_unprotect ();
+      npth_unprotect ();
 #endif
-  rc = libusb_bulk_transfer (handle->idev, handle->ep_bulk_in,
-                             buffer, length, &msglen, bwi*timeout);
+      rc = libusb_bulk_transfer (handle->idev, handle->ep_bulk_in,
+                                 buffer, length, &msglen, bwi*timeout);
 #ifdef USE_NPTH
-  npth_protect ();
+      npth_protect ();
 #endif
+    }
   if (rc)
     {
       DEBUGOUT_1 ("usb_bulk_read error: %s\n", libusb_error_name (rc));
@@ -3318,9 +3465,14 @@ ccid_transceive (ccid_driver_t handle,
                     (!(msg[pcboff] & 0x80) && (msg[pcboff] & 0x20)?
                      " [more]":""));
 
+      if (msg != recv_buffer)
+        bulk_in_prepost (handle, recv_buffer, sizeof recv_buffer);
       rc = bulk_out (handle, msg, msglen, 0);
       if (rc)
-        return rc;
+        {
+          bulk_in_cancel (handle);
+          return rc;
+        }
 
       msg = recv_buffer;
       rc = bulk_in (handle, msg, sizeof recv_buffer, &msglen,
@@ -41,6 +41,7 @@
 #endif
 #include "../common/asshelp.h"
 #include "../common/server-help.h"
+#include "../common/opstats.h"
 #include "../common/ssh-utils.h"
 
 /* Maximum length allowed as a PIN; used for INQUIRE NEEDPIN.  That
@@ -98,6 +99,14 @@ struct server_local_s
 
   /* If set to true, status change will be reported. */
   unsigned int watching_status:1;
+
+  /* Start time of the current command for the statistics.  */
+  unsigned long long cmd_start;
+
+  /* If set the keyrefs of sent KEYPAIRINFO status lines are collected
+     in LEARN_KEYREFS.  Used by LEARN --all.  */
+  unsigned int collect_keyrefs:1;
+  strlist_t learn_keyrefs;
 };
 
 
@@ -180,6 +189,30 @@ do_reset (ctrl_t ctrl, int send_reset, int keep_lock)
 
 
 
+/* This function is called by libassuan before a command is run.  */
+static gpg_error_t
+pre_cmd_notify (assuan_context_t ctx, const char *cmd)
+{
+  ctrl_t ctrl = assuan_get_pointer (ctx);
+
+  (void)cmd;
+
+  ctrl->server_local->cmd_start = opstats_now ();
+  return 0;
+}
+
+
+/* This function is called by libassuan after a command has been run.  */
+static void
+post_cmd_notify (assuan_context_t ctx, gpg_error_t err)
+{
+  ctrl_t ctrl = assuan_get_pointer (ctx);
+
+  opstats_record (assuan_get_command_name (ctx),
+                  ctrl->server_local->cmd_start, err);
+}
+
+
 static gpg_error_t
 reset_notify (assuan_context_t ctx, char *line)
 {
@@ -458,7 +491,7 @@ cmd_switchapp (assuan_context_t ctx, char *line)
 
 
 static const char hlp_learn[] =
-  "LEARN [--force] [--keypairinfo] [--reread] [--multi]\n"
+  "LEARN [--force] [--keypairinfo] [--reread] [--multi] [--all]\n"
   "\n"
   "Learn all useful information of the currently inserted card.  When\n"
   "used without the force options, the command might do an INQUIRE\n"
@@ -528,8 +561,70 @@ static const char hlp_learn[] =
   "  S PUBKEY-URL <url>\n"
   "\n"
   "The URL to be used for locating the entire public key.\n"
+  "\n"
+  "With the option --all the attributes KEY-ATTR, $DISPSERIALNO and\n"
+  "KEY-LABEL are also returned as if requested by GETATTR, and for each\n"
+  "key listed by KEYPAIRINFO the algorithm of its public key:\n"
+  "\n"
+  "  S KEY-ALGOSTR <keyref> <algostr>\n"
+  "\n"
+  "The public keys are taken from the cache of READKEY.  The last\n"
+  "status line is then\n"
+  "\n"
+  "  S LEARN-ALL\n"
+  "\n"
+  "so that a client can detect whether the option is supported.\n"
   "  \n"
   "Note, that this function may even be used on a locked card.";
+/* Helper for cmd_learn to emit the extra information for --all.  */
+static void
+learn_all_extra (card_t card, ctrl_t ctrl, int opt_multi)
+{
+  static const char *attrs[] = { "KEY-ATTR", "$DISPSERIALNO", "KEY-LABEL" };
+  gpg_error_t err;
+  strlist_t sl;
+  unsigned char *pk;
+  size_t pklen;
+  char *algostr;
+  int i;
+
+  for (i=0; i < DIM (attrs); i++)
+    {
+      err = app_getattr (card, ctrl, attrs[i]);
+      if (err && gpg_err_code (err) != GPG_ERR_INV_NAME
+          && gpg_err_code (err) != GPG_ERR_UNSUPPORTED_OPERATION)
+        log_info ("LEARN --all: getattr %s failed: %s\n",
+                  attrs[i], gpg_strerror (err));
+    }
+
+  /* With --multi the keyrefs may belong to other apps; reading them
+   * would switch the app again.  Thus we do this only for the
+   * current app.  */
+  if (!opt_multi)
+    for (sl = ctrl->server_local->learn_keyrefs; sl; sl = sl->next)
+      {
+        err = app_readkey (card, ctrl, sl->d, 0, &pk, &pklen);
+        if (!err)
+          {
+            err = app_help_get_keygrip_string_pk (pk, pklen, NULL, NULL,
+                                                  NULL, &algostr);
+            xfree (pk);
+          }
+        if (err)
+          {
+            if (opt.verbose)
+              log_info ("LEARN --all: readkey %s failed: %s\n",
+                        sl->d, gpg_strerror (err));
+            continue;
+          }
+        send_status_printf (ctrl, "KEY-ALGOSTR", "%s %s", sl->d, algostr);
+        xfree (algostr);
+      }
+
+  send_status_direct (ctrl, "LEARN-ALL", "");
+}
+
+
 static gpg_error_t
 cmd_learn (assuan_context_t ctx, char *line)
 {
@@ -539,6 +634,7 @@ cmd_learn (assuan_context_t ctx, char *line)
   int opt_multi = has_option (line, "--multi");
   int opt_reread = has_option (line, "--reread");
   int opt_force = has_option (line, "--force");
+  int opt_all = has_option (line, "--all");
   unsigned int flags;
   card_t card;
   const char *keygrip = NULL;
@@ -625,7 +721,15 @@ cmd_learn (assuan_context_t ctx, char *line)
     flags |= APP_LEARN_FLAG_REREAD;
 
   if (!rc)
-    rc = app_write_learn_status (card, ctrl, flags);
+    {
+      ctrl->server_local->collect_keyrefs = opt_all && !only_keypairinfo;
+      rc = app_write_learn_status (card, ctrl, flags);
+      ctrl->server_local->collect_keyrefs = 0;
+      if (!rc && opt_all && !only_keypairinfo)
+        learn_all_extra (card, ctrl, opt_multi);
+      free_strlist (ctrl->server_local->learn_keyrefs);
+      ctrl->server_local->learn_keyrefs = NULL;
+    }
 
   card_put (card);
   return rc;
@@ -1854,6 +1958,8 @@ static const char hlp_getinfo[] =
   "  pid         - Return the process id of the server.\n"
   "  socket_name - Return the name of the socket.\n"
   "  connections - Return number of active connections.\n"
+  "  stats       - Return command and APDU statistics in Prometheus\n"
+  "                format.\n"
   "  status      - Return the status of the current reader (in the future,\n"
   "                may also return the status of all readers).  The status\n"
   "                is a list of one-character flags.  The following flags\n"
@@ -1941,6 +2047,18 @@ cmd_getinfo (assuan_context_t ctx, char *line)
       snprintf (numbuf, sizeof numbuf, "%d", get_active_connection_count ());
       rc = assuan_send_data (ctx, numbuf, strlen (numbuf));
     }
+  else if (!strcmp (line, "stats"))
+    {
+      char *string = opstats_format ("scdaemon");
+
+      if (!string)
+        rc = gpg_error_from_syserror ();
+      else
+        {
+          rc = assuan_send_data (ctx, string, strlen (string));
+          xfree (string);
+        }
+    }
   else if (!strcmp (line, "status"))
     {
       ctrl_t ctrl = assuan_get_pointer (ctx);
@@ -2467,6 +2585,8 @@ register_commands (assuan_context_t ctx)
 
   assuan_register_reset_notify (ctx, reset_notify);
   assuan_register_option_handler (ctx, option_handler);
+  assuan_register_pre_cmd_notify (ctx, pre_cmd_notify);
+  assuan_register_post_cmd_notify (ctx, post_cmd_notify);
   return 0;
 }
 
@@ -2579,6 +2699,43 @@ scd_command_handler (ctrl_t ctrl, gnupg_fd_t fd)
 }
 
 
+/* Record the keyref from the KEYPAIRINFO status line ARGS if this
+ * has been requested by LEARN --all.  Keys which are not yet present
+ * (keygrip "X") are ignored.  */
+static void
+note_keypairinfo (ctrl_t ctrl, const char *keyword, const char *args)
+{
+  const char *s;
+  char *keyref;
+  size_t n;
+
+  if (!ctrl->server_local->collect_keyrefs || strcmp (keyword, "KEYPAIRINFO"))
+    return;
+
+  s = args;
+  if (*s == 'X' && (!s[1] || spacep (s+1)))
+    return;
+  while (*s && !spacep (s))
+    s++;
+  while (spacep (s))
+    s++;
+  for (n=0; s[n] && !spacep (s+n); n++)
+    ;
+  if (!n)
+    return;
+
+  keyref = xtrymalloc (n+1);
+  if (!keyref)
+    return;
+  memcpy (keyref, s, n);
+  keyref[n] = 0;
+  if (!append_to_strlist_try (&ctrl->server_local->learn_keyrefs, keyref))
+    log_error ("error collecting keyref: %s\n",
+               gpg_strerror (gpg_error_from_syserror ()));
+  xfree (keyref);
+}
+
+
 /* Send a line with status information via assuan and escape all given
    buffers. The variable elements are pairs of (char *, size_t),
    terminated with a (NULL, 0). */
@@ -2623,6 +2780,7 @@ send_status_info (ctrl_t ctrl, const char *keyword, ...)
         }
     }
   *p = 0;
+  note_keypairinfo (ctrl, keyword, buf);
   assuan_write_status (ctx, keyword, buf);
 
   va_end (arg_ptr);
@@ -2658,7 +2816,21 @@ send_status_printf (ctrl_t ctrl, const char *keyword, const char *format, ...)
     return 0;
 
   va_start (arg_ptr, format);
-  err = vprint_assuan_status (ctx, keyword, format, arg_ptr);
+  if (ctrl->server_local->collect_keyrefs && !strcmp (keyword, "KEYPAIRINFO"))
+    {
+      char *buf = gpgrt_vbsprintf (format, arg_ptr);
+
+      if (!buf)
+        err = gpg_error_from_syserror ();
+      else
+        {
+          note_keypairinfo (ctrl, keyword, buf);
+          err = assuan_write_status (ctx, keyword, buf);
+          xfree (buf);
+        }
+    }
+  else
+    err = vprint_assuan_status (ctx, keyword, format, arg_ptr);
   va_end (arg_ptr);
   return err;
 }
@@ -56,6 +56,7 @@
 #include "../common/exechelp.h"
 #include "../common/comopt.h"
 #include "../common/init.h"
+#include "../common/asynclog.h"
 
 #ifndef ENAMETOOLONG
 # define ENAMETOOLONG EINVAL
@@ -86,6 +87,7 @@ enum cmd_and_opt_values
   oNoDetach,
   oNoGrab,
   oLogFile,
+  oLogAsync,
   oServer,
   oMultiServer,
   oDaemon,
@@ -140,6 +142,7 @@ static gpgrt_opt_t opts[] = {
   ARGPARSE_s_n (oDebugLogTid, "debug-log-tid", "@"),
   ARGPARSE_p_u (oDebugAssuanLogCats, "debug-assuan-log-cats", "@"),
   ARGPARSE_s_s (oLogFile,  "log-file", N_("|FILE|write a log to FILE")),
+  ARGPARSE_s_n (oLogAsync, "log-async", "@"),
 
 
   ARGPARSE_header ("Configuration",
@@ -219,15 +222,10 @@ static struct debug_flags_s debug_flags [] =
    change.
 
    For a card reader with an interrupt endpoint, this timer is not
-   used with the internal CCID driver.
-
-   This is not too good for power saving but given that there is no
-   easy way to block on card status changes it is the best we can do.
-   For PC/SC we could in theory use an extra thread to wait for status
-   changes but that requires a native thread because there is no way
-   to make the underlying PC/SC card change function block using a Npth
-   mechanism.  Given that a native thread could only be used under W32
-   we don't do that at all.  */
+   used with the internal CCID driver.  For PC/SC readers a watcher
+   thread blocks in SCardGetStatusChange and kicks the loop on a
+   status change; the timer is thus only used if that thread could not
+   be started or failed.  */
 #define TIMERTICK_INTERVAL_SEC     (0)
 #define TIMERTICK_INTERVAL_USEC    (500000)
 
@@ -596,6 +594,7 @@ main (int argc, char **argv )
         case oHomedir: gnupg_set_homedir (pargs.r.ret_str); break;
         case oNoDetach: nodetach = 1; break;
         case oLogFile: logfile = pargs.r.ret_str; break;
+        case oLogAsync: opt.log_async = 1; break;
         case oCsh: csh_style = 1; break;
         case oSh: csh_style = 0; break;
         case oServer: pipe_server = 1; break;
@@ -1261,7 +1260,14 @@ handle_connections (gnupg_fd_t listen_fd)
 #endif
 #ifdef HAVE_PSELECT_NO_EINTR
   int pipe_fd[2];
+#endif
+
+  /* Now that we are detached and npth is running the log may be
+   * written by a separate thread.  */
+  if (opt.log_async)
+    async_log_start ();
 
+#ifdef HAVE_PSELECT_NO_EINTR
   ret = gnupg_create_pipe (pipe_fd);
   if (ret)
     {
@@ -42,6 +42,20 @@
 
 static assuan_context_t agent_ctx = NULL;
 
+/* A memorized result of an ISTRUSTED command.  */
+struct istrusted_memo_s
+{
+  struct istrusted_memo_s *next;
+  int rc;
+  struct rootca_flags_s rootca_flags;
+  char fpr[41];
+};
+
+/* The memo for ISTRUSTED results; only used while memo_level is not
+ * zero.  See gpgsm_agent_begin_memo.  */
+static struct istrusted_memo_s *istrusted_memo;
+static int memo_level;
+
 
 struct cipher_parm_s
 {
@@ -937,13 +951,69 @@ gpgsm_agent_istrusted (ctrl_t ctrl, ksba_cert_t cert, const char *hexfpr,
       xfree (fpr);
     }
 
+  if (memo_level)
+    {
+      struct istrusted_memo_s *m;
+
+      for (m = istrusted_memo; m; m = m->next)
+        if (!ascii_strcasecmp (m->fpr, line + 10))
+          {
+            *rootca_flags = m->rootca_flags;
+            return m->rc;
+          }
+    }
+
   rc = assuan_transact (agent_ctx, line, NULL, NULL, NULL, NULL,
                         istrusted_status_cb, rootca_flags);
   if (!rc)
     rootca_flags->valid = 1;
+
+  if (memo_level && strlen (line + 10) < sizeof istrusted_memo->fpr)
+    {
+      struct istrusted_memo_s *m;
+
+      m = xtrymalloc (sizeof *m);
+      if (m)
+        {
+          strcpy (m->fpr, line + 10);
+          m->rc = rc;
+          m->rootca_flags = *rootca_flags;
+          m->next = istrusted_memo;
+          istrusted_memo = m;
+        }
+    }
+
   return rc;
 }
 
+
+/* Start memorizing the results of some agent queries.  This is used
+ * by operations like key listings which ask the same questions for
+ * many certificates.  Calls may be nested; each call must be matched
+ * by a call to gpgsm_agent_end_memo.  */
+void
+gpgsm_agent_begin_memo (void)
+{
+  memo_level++;
+}
+
+
+/* Stop memorizing agent results and release the memo.  */
+void
+gpgsm_agent_end_memo (void)
+{
+  struct istrusted_memo_s *m;
+
+  if (!memo_level || --memo_level)
+    return;
+
+  while ((m = istrusted_memo))
+    {
+      istrusted_memo = m->next;
+      xfree (m);
+    }
+}
+
 /* Ask the agent to mark CERT as a trusted Root-CA one */
 int
 gpgsm_agent_marktrusted (ctrl_t ctrl, ksba_cert_t cert)
@@ -1008,6 +1078,45 @@ gpgsm_agent_havekey (ctrl_t ctrl, const char *hexkeygrip)
   return rc;
 }
 
+
+/* Ask the agent for the keygrips of all available secret keys.  On
+ * success a malloced array with the concatenated binary keygrips is
+ * stored at R_GRIPS and its length at R_GRIPSLEN.  */
+gpg_error_t
+gpgsm_agent_havekey_list (ctrl_t ctrl,
+                          unsigned char **r_grips, size_t *r_gripslen)
+{
+  gpg_error_t err;
+  membuf_t data;
+
+  *r_grips = NULL;
+  *r_gripslen = 0;
+
+  err = start_agent (ctrl);
+  if (err)
+    return err;
+
+  init_membuf (&data, 4096);
+  err = assuan_transact (agent_ctx, "HAVEKEY --list",
+                         put_membuf_cb, &data, NULL, NULL, NULL, NULL);
+  if (err)
+    {
+      xfree (get_membuf (&data, NULL));
+      return err;
+    }
+  *r_grips = get_membuf (&data, r_gripslen);
+  if (!*r_grips)
+    return gpg_error_from_syserror ();
+  if ((*r_gripslen % 20))
+    {
+      xfree (*r_grips);
+      *r_grips = NULL;
+      *r_gripslen = 0;
+      return gpg_error (GPG_ERR_INV_DATA);
+    }
+  return 0;
+}
+
 
 static gpg_error_t
 learn_status_cb (void *opaque, const char *line)
@@ -53,6 +53,22 @@ static assuan_context_t dirmngr2_ctx = NULL;
 static int dirmngr_ctx_locked;
 static int dirmngr2_ctx_locked;
 
+/* In server mode we keep the results of recent ISVALID requests so
+   that certificates used by many messages are not checked again for
+   each message.  Only definite results are kept.  */
+#define ISVALID_CACHE_SIZE 64
+#define ISVALID_CACHE_TTL  60  /* seconds */
+struct isvalid_cache_s
+{
+  unsigned char fpr[20];     /* SHA-1 fingerprint of the certificate.  */
+  int use_ocsp;              /* The USE_OCSP arg of the request.  */
+  time_t stamp;              /* Time the result was stored or 0.  */
+  gpg_error_t err;           /* 0 or GPG_ERR_CERT_REVOKED.  */
+  gnupg_isotime_t revoked_at;
+  char *reason;              /* Malloced revocation reason or NULL.  */
+};
+static struct isvalid_cache_s isvalid_cache[ISVALID_CACHE_SIZE];
+
 struct inq_certificate_parm_s {
   ctrl_t ctrl;
   assuan_context_t ctx;
@@ -69,6 +85,13 @@ struct isvalid_status_parm_s {
 };
 
 
+struct prefetch_parm_s {
+  struct inq_certificate_parm_s inq;
+  ksba_cert_t *certs;
+  int ncerts;
+};
+
+
 struct lookup_parm_s {
   ctrl_t ctrl;
   assuan_context_t ctx;
@@ -516,6 +539,72 @@ isvalid_status_cb (void *opaque, const char *line)
 
 
 
+/* Return the cache slot for CERT and USE_OCSP.  FPR receives the
+   fingerprint of CERT.  */
+static struct isvalid_cache_s *
+isvalid_cache_slot (ksba_cert_t cert, int use_ocsp, unsigned char *fpr)
+{
+  gpgsm_get_fingerprint (cert, GCRY_MD_SHA1, fpr, NULL);
+  return isvalid_cache + ((fpr[0] ^ use_ocsp) % ISVALID_CACHE_SIZE);
+}
+
+
+/* Check whether a recent result for CERT is available.  Returns true
+   and stores the result at R_ERR if so.  */
+static int
+isvalid_cache_get (ctrl_t ctrl, ksba_cert_t cert, int use_ocsp,
+                   gpg_error_t *r_err,
+                   gnupg_isotime_t r_revoked_at, char **r_reason)
+{
+  unsigned char fpr[20];
+  struct isvalid_cache_s *ic;
+
+  if (!ctrl->server_local || opt.force_crl_refresh)
+    return 0;
+
+  ic = isvalid_cache_slot (cert, use_ocsp, fpr);
+  if (!ic->stamp || ic->use_ocsp != use_ocsp || memcmp (ic->fpr, fpr, 20)
+      || ic->stamp + ISVALID_CACHE_TTL < gnupg_get_time ())
+    return 0;
+
+  if (r_revoked_at && *ic->revoked_at)
+    gnupg_copy_time (r_revoked_at, ic->revoked_at);
+  if (r_reason && ic->reason)
+    *r_reason = xtrystrdup (ic->reason);
+  *r_err = ic->err;
+  if (opt.verbose > 1)
+    log_info ("using cached dirmngr response: %s\n",
+              ic->err? gpg_strerror (ic->err): "okay");
+  return 1;
+}
+
+
+/* Store the result of an ISVALID request.  */
+static void
+isvalid_cache_put (ctrl_t ctrl, ksba_cert_t cert, int use_ocsp,
+                   gpg_error_t err,
+                   const char *revoked_at, const char *reason)
+{
+  unsigned char fpr[20];
+  struct isvalid_cache_s *ic;
+
+  if (!ctrl->server_local
+      || (err && gpg_err_code (err) != GPG_ERR_CERT_REVOKED))
+    return;
+
+  ic = isvalid_cache_slot (cert, use_ocsp, fpr);
+  xfree (ic->reason);
+  memcpy (ic->fpr, fpr, 20);
+  ic->use_ocsp = use_ocsp;
+  ic->stamp = gnupg_get_time ();
+  ic->err = err;
+  *ic->revoked_at = 0;
+  if (revoked_at && !check_isotime (revoked_at))
+    gnupg_copy_time (ic->revoked_at, revoked_at);
+  ic->reason = reason? xtrystrdup (reason) : NULL;
+}
+
+
 /* Call the directory manager to check whether the certificate is valid
    Returns 0 for valid or usually one of the errors:
 
@@ -550,6 +639,9 @@ gpgsm_dirmngr_isvalid (ctrl_t ctrl,
   if (r_reason)
     *r_reason = NULL;
 
+  if (isvalid_cache_get (ctrl, cert, use_ocsp, &rc, r_revoked_at, r_reason))
+    return rc;
+
   rc = start_dirmngr (ctrl);
   if (rc)
     return rc;
@@ -605,6 +697,10 @@ gpgsm_dirmngr_isvalid (ctrl_t ctrl,
   if (opt.verbose > 1)
     log_info ("response of dirmngr: %s\n", rc? gpg_strerror (rc): "okay");
 
+  if (gpg_err_code (rc) == GPG_ERR_CERT_REVOKED)
+    isvalid_cache_put (ctrl, cert, use_ocsp, rc, stparm.revoked_at,
+                       stparm.revocation_reason);
+
   if (gpg_err_code (rc) == GPG_ERR_CERT_REVOKED
       && !check_isotime (stparm.revoked_at))
     {
@@ -676,12 +772,113 @@ gpgsm_dirmngr_isvalid (ctrl_t ctrl,
         }
     }
 
+  if (!rc)
+    isvalid_cache_put (ctrl, cert, use_ocsp, 0, NULL, NULL);
+
   release_dirmngr (ctrl);
   xfree (stparm.revocation_reason);
   return rc;
 }
 
 
+/* Inquiry callback for gpgsm_dirmngr_ocsp_prefetch.  Certificates
+   asked for by fingerprint are first taken from the list of
+   certificates to check because they may not be stored.  */
+static gpg_error_t
+prefetch_inq_cb (void *opaque, const char *line)
+{
+  struct prefetch_parm_s *parm = opaque;
+  unsigned char fpr[20], certfpr[20];
+  const unsigned char *der;
+  size_t derlen;
+  const char *s;
+  int i;
+
+  if ((s = has_leading_keyword (line, "SENDCERT")) && unhexify_fpr (s, fpr))
+    {
+      for (i=0; i < parm->ncerts; i++)
+        {
+          gpgsm_get_fingerprint (parm->certs[i], GCRY_MD_SHA1, certfpr, NULL);
+          if (!memcmp (fpr, certfpr, 20))
+            {
+              der = ksba_cert_get_image (parm->certs[i], &derlen);
+              if (!der)
+                return gpg_error (GPG_ERR_INV_CERT_OBJ);
+              return assuan_send_data (parm->inq.ctx, der, derlen);
+            }
+        }
+    }
+  return inq_certificate (&parm->inq, line);
+}
+
+
+/* Ask the dirmngr to fetch the OCSP status of the NCERTS certificates
+   in CERTS with as few requests as possible, so that the following
+   calls to gpgsm_dirmngr_isvalid are answered from the dirmngr's
+   cache.  USE_OCSP is the value which will be used for these calls.
+   Errors are not returned because the following checks will anyway
+   report them.  */
+void
+gpgsm_dirmngr_ocsp_prefetch (ctrl_t ctrl, ksba_cert_t *certs, int ncerts,
+                             int use_ocsp)
+{
+  static int not_supported;
+  gpg_error_t err;
+  char line[ASSUAN_LINELENGTH];
+  struct prefetch_parm_s parm;
+  char *certfpr;
+  size_t n;
+  int i, count;
+
+  if (not_supported || !use_ocsp || ncerts < 2)
+    return;
+
+  if (start_dirmngr (ctrl))
+    return;
+
+  parm.inq.ctx = dirmngr_ctx;
+  parm.inq.ctrl = ctrl;
+  parm.inq.cert = NULL;
+  parm.inq.issuer_cert = NULL;
+  parm.certs = certs;
+  parm.ncerts = ncerts;
+
+  /* Send the fingerprints in chunks so that they fit into a line.  */
+  for (i=0; i < ncerts && !not_supported; )
+    {
+      strcpy (line, "OCSPPREFETCH");
+      n = strlen (line);
+      for (count=0; i < ncerts && n + 42 < sizeof line; i++)
+        {
+          if (isvalid_cache_get (ctrl, certs[i], use_ocsp, &err, NULL, NULL))
+            continue;
+          certfpr = gpgsm_get_fingerprint_hexstring (certs[i], GCRY_MD_SHA1);
+          if (!certfpr)
+            continue;
+          line[n++] = ' ';
+          strcpy (line + n, certfpr);
+          n += strlen (certfpr);
+          xfree (certfpr);
+          count++;
+        }
+      if (count < 2)
+        continue;
+
+      if (opt.verbose > 1)
+        log_info ("asking dirmngr to prefetch the OCSP status of"
+                  " %d certificates\n", count);
+      err = assuan_transact (dirmngr_ctx, line, NULL, NULL,
+                             prefetch_inq_cb, &parm, NULL, NULL);
+      if (gpg_err_code (err) == GPG_ERR_ASS_UNKNOWN_CMD)
+        not_supported = 1;  /* An older dirmngr.  */
+      else if (err && opt.verbose)
+        log_info ("prefetching OCSP status failed: %s\n", gpg_strerror (err));
+    }
+
+  release_dirmngr (ctrl);
+}
+
+
 
 /* Lookup helpers*/
 static gpg_error_t
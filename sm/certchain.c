@@ -50,6 +50,24 @@ struct marktrusted_info_s
 static struct marktrusted_info_s *marktrusted_info;
 
 
+/* To avoid searching the keydb, the dirmngr or the network again and
+   again for the same issuers we memorize for each certificate the
+   issuer certificate whose signature over it has already been
+   verified.  This is a direct mapped table indexed by the first byte
+   of the subject's fingerprint.  */
+#define ISSUER_MEMO_SIZE 128
+struct issuer_memo_s
+{
+  unsigned char fpr[20];  /* SHA-1 fingerprint of the subject.  */
+  ksba_cert_t issuer;     /* The issuer certificate or NULL.  */
+};
+static struct issuer_memo_s issuer_memo[ISSUER_MEMO_SIZE];
+
+/* The maximum number of certificates for which the OCSP status is
+   prefetched in one go.  */
+#define MAX_PREFETCH_CERTS 256
+
+
 /* While running the validation function we want to keep track of the
    certificates in the chain.  This type is used for that.  */
 struct chain_item_s
@@ -102,6 +120,40 @@ set_already_asked_marktrusted (ksba_cert_t cert)
  marktrusted_info = r;
 }
 
+/* Return the memorized issuer certificate of CERT or NULL if there
+   is none.  The caller must release the returned certificate.  */
+static ksba_cert_t
+issuer_memo_get (ksba_cert_t cert)
+{
+  unsigned char fpr[20];
+  struct issuer_memo_s *m;
+
+  gpgsm_get_fingerprint (cert, GCRY_MD_SHA1, fpr, NULL);
+  m = issuer_memo + (fpr[0] % ISSUER_MEMO_SIZE);
+  if (!m->issuer || memcmp (m->fpr, fpr, 20))
+    return NULL;
+  ksba_cert_ref (m->issuer);
+  return m->issuer;
+}
+
+
+/* Memorize that the signature of ISSUER over CERT has been
+   verified.  */
+static void
+issuer_memo_put (ksba_cert_t cert, ksba_cert_t issuer)
+{
+  unsigned char fpr[20];
+  struct issuer_memo_s *m;
+
+  gpgsm_get_fingerprint (cert, GCRY_MD_SHA1, fpr, NULL);
+  m = issuer_memo + (fpr[0] % ISSUER_MEMO_SIZE);
+  ksba_cert_release (m->issuer);
+  memcpy (m->fpr, fpr, 20);
+  ksba_cert_ref (issuer);
+  m->issuer = issuer;
+}
+
+
 /* If LISTMODE is true, print FORMAT using LISTMODE to FP.  If
    LISTMODE is false, use the string to print an log_info or, if
    IS_ERROR is true, and log_error. */
@@ -1072,6 +1124,10 @@ gpgsm_walk_cert_chain (ctrl_t ctrl, ksba_cert_t start, ksba_cert_t *r_next)
       goto leave;
     }
 
+  *r_next = issuer_memo_get (start);
+  if (*r_next)
+    goto leave;
+
   err = find_up (ctrl, kh, start, issuer, 0);
   if (err)
     {
@@ -1836,6 +1892,17 @@ do_validate_chain (ctrl_t ctrl, ksba_cert_t cert, ksba_isotime_t checktime_arg,
           goto leave;
         }
 
+      /* Take a shortcut if we already know the issuer and its
+         signature has been verified before.  */
+      ksba_cert_release (issuer_cert);
+      issuer_cert = issuer_memo_get (subject_cert);
+      if (issuer_cert)
+        {
+          if (DBG_X509)
+            log_debug ("using memorized issuer certificate\n");
+          goto got_issuer;
+        }
+
       /* Find the next cert up the tree. */
       keydb_search_reset (kh);
       rc = find_up (ctrl, kh, subject_cert, issuer, 0);
@@ -1924,7 +1991,9 @@ do_validate_chain (ctrl_t ctrl, ksba_cert_t cert, ksba_isotime_t checktime_arg,
           rc = gpg_error (GPG_ERR_BAD_CERT_CHAIN);
           goto leave;
         }
+      issuer_memo_put (subject_cert, issuer_cert);
 
+    got_issuer:
       is_root = gpgsm_is_root_cert (issuer_cert);
       istrusted_rc = gpg_error (GPG_ERR_NOT_TRUSTED);
 
@@ -2146,6 +2215,54 @@ do_validate_chain (ctrl_t ctrl, ksba_cert_t cert, ksba_isotime_t checktime_arg,
 }
 
 
+/* Ask the dirmngr for the OCSP status of all non-root certificates
+   in the chains of the NCERTS certificates in CERTS with as few
+   requests as possible.  The results are cached by the dirmngr so
+   that the following validation of the chains does not need to send
+   a request for each certificate.  USE_OCSP is the value which will
+   be used by is_cert_still_valid.  */
+void
+gpgsm_prefetch_chain_status (ctrl_t ctrl, ksba_cert_t *certs, int ncerts,
+                             int use_ocsp)
+{
+  ksba_cert_t array[MAX_PREFETCH_CERTS];
+  unsigned char fprs[MAX_PREFETCH_CERTS][20];
+  ksba_cert_t cert, next;
+  int i, j, n, depth;
+
+  if (ctrl->offline || !use_ocsp)
+    return;
+
+  n = 0;
+  for (i=0; i < ncerts && n < MAX_PREFETCH_CERTS; i++)
+    {
+      cert = certs[i];
+      ksba_cert_ref (cert);
+      /* Only certificates with an issuer are checked; thus the root
+         certificate is not collected.  */
+      for (depth=0; depth < 50 && n < MAX_PREFETCH_CERTS
+             && !gpgsm_walk_cert_chain (ctrl, cert, &next); depth++)
+        {
+          gpgsm_get_fingerprint (cert, GCRY_MD_SHA1, fprs[n], NULL);
+          for (j=0; j < n; j++)
+            if (!memcmp (fprs[j], fprs[n], 20))
+              break;
+          if (j == n)
+            array[n++] = cert;
+          else
+            ksba_cert_release (cert);
+          cert = next;
+        }
+      ksba_cert_release (cert);
+    }
+
+  gpgsm_dirmngr_ocsp_prefetch (ctrl, array, n, use_ocsp);
+
+  for (i=0; i < n; i++)
+    ksba_cert_release (array[i]);
+}
+
+
 /* Validate a certificate chain.  For a description see
    do_validate_chain.  This function is a wrapper to handle a root
    certificate with the chain_model flag set.  If RETFLAGS is not
@@ -2184,6 +2301,14 @@ gpgsm_validate_chain (ctrl_t ctrl, ksba_cert_t cert, ksba_isotime_t checktime,
 
   memset (&rootca_flags, 0, sizeof rootca_flags);
 
+  /* Fetch the OCSP status of the entire chain with one request
+     instead of one request per certificate.  */
+  if (!(flags & (VALIDATE_FLAG_NO_DIRMNGR|VALIDATE_FLAG_STEED))
+      && !opt.no_chain_validation)
+    gpgsm_prefetch_chain_status (ctrl, &cert, 1,
+                                 (flags & VALIDATE_FLAG_CHAIN_MODEL)?
+                                 2 : !!ctrl->use_ocsp);
+
   rc = do_validate_chain (ctrl, cert, checktime,
                           r_exptime, listmode, listfp, flags,
                           &rootca_flags);
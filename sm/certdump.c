@@ -46,6 +46,18 @@ struct dn_array_s {
   int   done;
 };
 
+/* Listings and status output format the names of the same issuers
+ * over and over.  Thus we keep the formatted version of recently
+ * used DNs in a small direct mapped cache.  */
+#define DN_CACHE_SIZE 256
+
+struct dn_cache_s {
+  char *name;           /* The DN in rfc2253 format.  */
+  char *formatted;      /* The formatted DN.  */
+  int translate;        /* The TRANSLATE flag used for formatting.  */
+};
+static struct dn_cache_s dn_cache[DN_CACHE_SIZE];
+
 
 /* Get the first first element from the s-expression SN and return a
  * pointer to it.  Stores the length at R_LENGTH.  Returns NULL for no
@@ -674,12 +686,91 @@ pretty_es_print_sexp (estream_t fp, const unsigned char *buf, size_t buflen)
 }
 
 
+/* Return the slot in DN_CACHE for NAME.  */
+static struct dn_cache_s *
+dn_cache_slot (const char *name, int translate)
+{
+  const unsigned char *s;
+  unsigned int hash = translate;
+
+  for (s = (const unsigned char *)name; *s; s++)
+    hash = (hash * 31) + *s;
+  return dn_cache + (hash % DN_CACHE_SIZE);
+}
+
+
+/* Return the cached formatted version of the DN NAME or NULL.  */
+static const char *
+dn_cache_get (const char *name, int translate)
+{
+  struct dn_cache_s *c = dn_cache_slot (name, translate);
+
+  if (c->name && c->translate == translate && !strcmp (c->name, name))
+    return c->formatted;
+  return NULL;
+}
+
+
+/* Store the formatted version FORMATTED of the DN NAME in the cache.  */
+static void
+dn_cache_put (const char *name, int translate, const char *formatted)
+{
+  struct dn_cache_s *c = dn_cache_slot (name, translate);
+  char *n, *f;
+
+  n = xtrystrdup (name);
+  f = n? xtrystrdup (formatted) : NULL;
+  if (!f)
+    {
+      xfree (n);
+      return;  /* Out of core is not a problem here.  */
+    }
+  xfree (c->name);
+  xfree (c->formatted);
+  c->name = n;
+  c->formatted = f;
+  c->translate = translate;
+}
+
+
+/* Format the DN NAME into a string without using the cache.  The
+ * caller must release the result using es_free.  Returns NULL on
+ * error.  */
+static char *
+format_dn (const char *name, int translate)
+{
+  struct dn_array_s *dn;
+  estream_t fp;
+  char *result;
+  int i;
+
+  dn = parse_dn ((const unsigned char *)name);
+  if (!dn)
+    return NULL;
+  fp = es_fopenmem (0, "w+");
+  if (fp)
+    print_dn_parts (fp, dn, translate);
+  for (i=0; dn[i].key; i++)
+    {
+      xfree (dn[i].key);
+      xfree (dn[i].value);
+    }
+  xfree (dn);
+  if (!fp)
+    return NULL;
+  es_putc (0, fp);
+  if (es_fclose_snatch (fp, (void **)&result, NULL))
+    return NULL;
+  return result;
+}
+
+
 /* This is a variant of gpgsm_print_name sending it output to an estream. */
 void
 gpgsm_es_print_name2 (estream_t fp, const char *name, int translate)
 {
   const unsigned char *s = (const unsigned char *)name;
-  int i;
+  const char *cached;
 
   if (!s)
     {
@@ -705,21 +796,19 @@ gpgsm_es_print_name2 (estream_t fp, const char *name, int translate)
              || (*s >= 'A' && *s <= 'Z')
              || (*s >= 'a' && *s <= 'z')))
     es_fputs (_("[Error - invalid encoding]"), fp);
+  else if ((cached = dn_cache_get (name, translate)))
+    es_fputs (cached, fp);
   else
     {
-      struct dn_array_s *dn = parse_dn (s);
+      char *formatted = format_dn (name, translate);
 
-      if (!dn)
+      if (!formatted)
         es_fputs (_("[Error - invalid DN]"), fp);
       else
         {
-          print_dn_parts (fp, dn, translate);
-          for (i=0; dn[i].key; i++)
-            {
-              xfree (dn[i].key);
-              xfree (dn[i].value);
-            }
-          xfree (dn);
+          es_fputs (formatted, fp);
+          dn_cache_put (name, translate, formatted);
+          es_free (formatted);
         }
     }
 }
@@ -50,6 +50,25 @@ static const char oid_kp_emailProtection[]= "1.3.6.1.5.5.7.3.4";
 static const char oid_kp_timeStamping[]   = "1.3.6.1.5.5.7.3.8";
 static const char oid_kp_ocspSigning[]    = "1.3.6.1.5.5.7.3.9";
 
+/* The number of entries in the recipient validation cache.  */
+#define RECP_CACHE_SIZE 64
+
+/* A cache with recipient certificates which recently passed the
+ * chain validation.  This is used by gpgsm_add_to_certlist to avoid
+ * repeated chain validations including CRL and OCSP checks when the
+ * same recipients are used over and over again by a server.  The
+ * cache is only used if opt.recipient_cache_ttl is set.  */
+struct recp_cache_item_s
+{
+  unsigned char fpr[20];  /* SHA-1 fingerprint of the certificate.  */
+  int model;              /* The validation model used.  */
+  int use_ocsp;           /* Whether OCSP was used.  */
+  time_t created;         /* Time of the validation; 0 = unused.  */
+  ksba_isotime_t exptime; /* Earliest expiration time of the chain.  */
+};
+static struct recp_cache_item_s recp_cache[RECP_CACHE_SIZE];
+
+
 
 /* Return 0 if the cert is usable for encryption.  A MODE of 0 checks
    for signing a MODE of 1 checks for encryption, a MODE of 2 checks
@@ -303,6 +322,82 @@ is_cert_in_certlist (ksba_cert_t cert, certlist_t certlist)
 }
 
 
+/* Return true if CERT is in the recipient validation cache.  */
+static int
+recp_cache_lookup (ctrl_t ctrl, ksba_cert_t cert)
+{
+  unsigned char fpr[20];
+  ksba_isotime_t now;
+  time_t curtime;
+  int i;
+
+  if (!opt.recipient_cache_ttl)
+    return 0;
+
+  gpgsm_get_fingerprint (cert, GCRY_MD_SHA1, fpr, NULL);
+  curtime = gnupg_get_time ();
+  for (i=0; i < RECP_CACHE_SIZE; i++)
+    {
+      if (!recp_cache[i].created
+          || memcmp (recp_cache[i].fpr, fpr, 20)
+          || recp_cache[i].model != ctrl->validation_model
+          || recp_cache[i].use_ocsp != ctrl->use_ocsp)
+        continue;
+
+      if (recp_cache[i].created + opt.recipient_cache_ttl < curtime
+          || recp_cache[i].created > curtime)
+        {
+          recp_cache[i].created = 0;  /* Expired.  */
+          return 0;
+        }
+      if (*recp_cache[i].exptime)
+        {
+          gnupg_get_isotime (now);
+          if (strcmp (now, recp_cache[i].exptime) > 0)
+            {
+              recp_cache[i].created = 0;  /* Chain expired.  */
+              return 0;
+            }
+        }
+      if (DBG_X509)
+        log_debug ("recipient cache hit\n");
+      return 1;
+    }
+
+  return 0;
+}
+
+
+/* Store CERT which just passed the chain validation with the chain
+ * expiration time EXPTIME in the recipient cache.  The oldest entry
+ * is replaced if the cache is full.  */
+static void
+recp_cache_put (ctrl_t ctrl, ksba_cert_t cert, const ksba_isotime_t exptime)
+{
+  int i, idx = 0;
+
+  if (!opt.recipient_cache_ttl)
+    return;
+
+  for (i=0; i < RECP_CACHE_SIZE; i++)
+    {
+      if (!recp_cache[i].created)
+        {
+          idx = i;
+          break;
+        }
+      if (recp_cache[i].created < recp_cache[idx].created)
+        idx = i;
+    }
+
+  gpgsm_get_fingerprint (cert, GCRY_MD_SHA1, recp_cache[idx].fpr, NULL);
+  recp_cache[idx].model = ctrl->validation_model;
+  recp_cache[idx].use_ocsp = ctrl->use_ocsp;
+  gnupg_copy_time (recp_cache[idx].exptime, exptime);
+  recp_cache[idx].created = gnupg_get_time ();
+}
+
+
 /* Add CERT to the list of certificates at CERTADDR but avoid
    duplicates. */
 int
@@ -461,9 +556,17 @@ gpgsm_add_to_certlist (ctrl_t ctrl, const char *name, int secret,
                       xfree (p);
                     }
                 }
-              if (!rc)
-                rc = gpgsm_validate_chain (ctrl, cert, GNUPG_ISOTIME_NONE, NULL,
-                                           0, NULL, 0, NULL);
+              if (!rc && !secret && recp_cache_lookup (ctrl, cert))
+                ;
+              else if (!rc)
+                {
+                  ksba_isotime_t exptime;
+
+                  rc = gpgsm_validate_chain (ctrl, cert, GNUPG_ISOTIME_NONE,
+                                             exptime, 0, NULL, 0, NULL);
+                  if (!rc && !secret)
+                    recp_cache_put (ctrl, cert, exptime);
+                }
               if (!rc)
                 {
                   certlist_t cl = xtrycalloc (1, sizeof *cl);
@@ -629,3 +732,44 @@ gpgsm_find_cert (ctrl_t ctrl,
   return (gpg_err_code (rc) == GPG_ERR_NOT_FOUND?
           gpg_error (GPG_ERR_NO_PUBKEY): rc);
 }
+
+
+/* Fetch the OCSP status of the certificates of all recipients given
+   by NAMES and of their chains with as few requests as possible.
+   This is done before the recipients are added one by one so that
+   the validation of each of them does not need its own request.
+   Entries flagged as encrypt-to are skipped if those are disabled.
+   Errors are ignored because they show up later anyway.  */
+void
+gpgsm_prefetch_recipient_status (ctrl_t ctrl, strlist_t names)
+{
+  ksba_cert_t *certs;
+  strlist_t sl;
+  int n, ncerts;
+
+  if (!ctrl->use_ocsp || ctrl->offline || opt.no_chain_validation)
+    return;
+
+  for (n=0, sl=names; sl; sl = sl->next)
+    n++;
+  if (n < 2)
+    return;
+  certs = xtrycalloc (n, sizeof *certs);
+  if (!certs)
+    return;
+
+  for (ncerts=0, sl=names; sl && ncerts < n; sl = sl->next)
+    {
+      if ((sl->flags & 1) && opt.no_encrypt_to)
+        continue;
+      if (!gpgsm_find_cert (ctrl, sl->d, NULL, &certs[ncerts],
+                            FIND_CERT_ALLOW_AMBIG))
+        ncerts++;
+    }
+
+  gpgsm_prefetch_chain_status (ctrl, certs, ncerts, 1);
+
+  while (ncerts)
+    ksba_cert_release (certs[--ncerts]);
+  xfree (certs);
+}
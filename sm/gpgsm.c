@@ -155,6 +155,7 @@ enum cmd_and_opt_values {
 
   oDisableOCSP,
   oEnableOCSP,
+  oRecipientCacheTTL,
 
   oIncludeCerts,
   oPolicyFile,
@@ -401,6 +402,7 @@ static gpgrt_opt_t opts[] = {
                 "enable-trusted-cert-crl-check", "@"),
   ARGPARSE_s_n (oDisableOCSP, "disable-ocsp", "@"),
   ARGPARSE_s_n (oEnableOCSP,  "enable-ocsp", N_("check validity using OCSP")),
+  ARGPARSE_s_u (oRecipientCacheTTL, "recipient-cache-ttl", "@"),
   ARGPARSE_s_n (oDisablePolicyChecks, "disable-policy-checks",
                 N_("do not check certificate policies")),
   ARGPARSE_s_n (oEnablePolicyChecks, "enable-policy-checks", "@"),
@@ -1211,6 +1213,9 @@ main ( int argc, char **argv)
         case oEnableOCSP:
           ctrl.use_ocsp = opt.enable_ocsp = 1;
           break;
+        case oRecipientCacheTTL:
+          opt.recipient_cache_ttl = pargs.r.ret_uint;
+          break;
 
         case oIncludeCerts:
           ctrl.include_certs = default_include_certs = pargs.r.ret_int;
@@ -1824,6 +1829,7 @@ main ( int argc, char **argv)
          ignore duplicates and we can't allow keeping a duplicate which is
          flagged as encrypt-to as the actually encrypt function would then
          complain about no (regular) recipients. */
+      gpgsm_prefetch_recipient_status (&ctrl, remusr);
       for (sl = remusr; sl; sl = sl->next)
         if (!(sl->flags & 1))
           do_add_recipient (&ctrl, sl->d, &recplist, 0, recp_required);
@@ -129,6 +129,8 @@ struct
   int force_crl_refresh;    /* Force refreshing the CRL. */
   int enable_issuer_based_crl_check; /* Backward compatibility hack.  */
   int enable_ocsp;          /* Default to use OCSP checks. */
+  unsigned int recipient_cache_ttl; /* Seconds to cache validated
+                                       recipient certificates.  */
 
   char *policy_file;        /* full pathname of policy file */
   int no_policy_check;      /* ignore certificate policies */
@@ -386,6 +388,8 @@ int gpgsm_create_cms_signature (ctrl_t ctrl,
 gpg_error_t gpgsm_walk_cert_chain (ctrl_t ctrl,
                                    ksba_cert_t start, ksba_cert_t *r_next);
 int gpgsm_is_root_cert (ksba_cert_t cert);
+void gpgsm_prefetch_chain_status (ctrl_t ctrl, ksba_cert_t *certs, int ncerts,
+                                  int use_ocsp);
 int gpgsm_validate_chain (ctrl_t ctrl, ksba_cert_t cert,
                           ksba_isotime_t checktime,
                           ksba_isotime_t r_exptime,
@@ -412,6 +416,7 @@ void gpgsm_release_certlist (certlist_t list);
 #define FIND_CERT_WITH_EPHEM  2
 int gpgsm_find_cert (ctrl_t ctrl, const char *name, ksba_sexp_t keyid,
                      ksba_cert_t *r_cert, unsigned int flags);
+void gpgsm_prefetch_recipient_status (ctrl_t ctrl, strlist_t names);
 
 /*-- keylist.c --*/
 gpg_error_t gpgsm_list_keys (ctrl_t ctrl, strlist_t names,
@@ -485,6 +490,11 @@ int gpgsm_agent_scd_keypairinfo (ctrl_t ctrl, strlist_t *r_list);
 int gpgsm_agent_istrusted (ctrl_t ctrl, ksba_cert_t cert, const char *hexfpr,
                            struct rootca_flags_s *rootca_flags);
 int gpgsm_agent_havekey (ctrl_t ctrl, const char *hexkeygrip);
+gpg_error_t gpgsm_agent_havekey_list (ctrl_t ctrl,
+                                      unsigned char **r_grips,
+                                      size_t *r_gripslen);
+void gpgsm_agent_begin_memo (void);
+void gpgsm_agent_end_memo (void);
 int gpgsm_agent_marktrusted (ctrl_t ctrl, ksba_cert_t cert);
 int gpgsm_agent_learn (ctrl_t ctrl);
 int gpgsm_agent_passwd (ctrl_t ctrl, const char *hexkeygrip, const char *desc);
@@ -509,6 +519,8 @@ gpg_error_t gpgsm_dirmngr_isvalid (ctrl_t ctrl,
                                    int use_ocsp,
                                    gnupg_isotime_t r_revoked_at,
                                    char **r_reason);
+void gpgsm_dirmngr_ocsp_prefetch (ctrl_t ctrl, ksba_cert_t *certs, int ncerts,
+                                  int use_ocsp);
 int gpgsm_dirmngr_lookup (ctrl_t ctrl, strlist_t names, const char *uri,
                           int cache_only,
                           void (*cb)(void*, ksba_cert_t), void *cb_value);
@@ -41,6 +41,12 @@
 #define MAX_P12OBJ_SIZE 128 /*kb*/
 
 
+/* A certificate already stored during this import run.  */
+struct seen_cert_s {
+  struct seen_cert_s *next;
+  unsigned char fpr[20];
+};
+
 struct stats_s {
   unsigned long count;
   unsigned long imported;
@@ -49,6 +55,10 @@ struct stats_s {
   unsigned long secret_read;
   unsigned long secret_imported;
   unsigned long secret_dups;
+  /* The certificates stored so far, hashed by the first byte of the
+   * fingerprint.  Importing a CA bundle stores the same issuer
+   * certificates over and over while walking up the chains.  */
+  struct seen_cert_s *seen[256];
  };
 
 
@@ -162,23 +172,90 @@ print_imported_summary (ctrl_t ctrl, struct stats_s *stats)
 
 
 
+/* Return true if the certificate with fingerprint FPR has already
+ * been stored during this run.  */
+static int
+cert_seen_p (struct stats_s *stats, const unsigned char *fpr)
+{
+  struct seen_cert_s *sc;
+
+  for (sc = stats->seen[*fpr]; sc; sc = sc->next)
+    if (!memcmp (sc->fpr, fpr, 20))
+      return 1;
+  return 0;
+}
+
+
+/* Remember that the certificate with fingerprint FPR has been stored
+ * during this run.  */
+static void
+add_seen_cert (struct stats_s *stats, const unsigned char *fpr)
+{
+  struct seen_cert_s *sc;
+
+  sc = xtrymalloc (sizeof *sc);
+  if (!sc)
+    return;  /* Not an error; we will only do some extra work.  */
+  memcpy (sc->fpr, fpr, 20);
+  sc->next = stats->seen[*fpr];
+  stats->seen[*fpr] = sc;
+}
+
+
+static void
+release_seen_certs (struct stats_s *stats)
+{
+  struct seen_cert_s *sc, *sc2;
+  int i;
+
+  for (i=0; i < DIM (stats->seen); i++)
+    {
+      for (sc = stats->seen[i]; sc; sc = sc2)
+        {
+          sc2 = sc->next;
+          xfree (sc);
+        }
+      stats->seen[i] = NULL;
+    }
+}
+
+
+/* Check the certificate CERT and store it.  The statistics in STATS
+ * are updated only if DEPTH is 0; a larger DEPTH indicates that CERT
+ * is an issuer certificate found while walking up the chain.  */
 static void
 check_and_store (ctrl_t ctrl, struct stats_s *stats,
                  ksba_cert_t cert, int depth)
 {
   int rc;
+  unsigned char fpr[20];
+  int have_fpr;
 
-  if (stats)
+  if (!depth)
     stats->count++;
   if ( depth >= 50 )
     {
       log_error (_("certificate chain too long\n"));
-      if (stats)
-        stats->not_imported++;
       print_import_problem (ctrl, cert, 3);
       return;
     }
 
+  /* A certificate stored earlier in this run needs neither checks
+   * nor a database lookup; its chain has also already been walked.  */
+  have_fpr = !!gpgsm_get_fingerprint (cert, 0, fpr, NULL);
+  if (have_fpr && cert_seen_p (stats, fpr))
+    {
+      if (!depth)
+        {
+          print_imported_status (ctrl, cert, 0);
+          stats->unchanged++;
+        }
+      if (opt.verbose > 1)
+        log_info (depth? "issuer certificate already in DB\n"
+                  /**/ : "certificate already in DB\n");
+      return;
+    }
+
   /* Some basic checks, but don't care about missing certificates;
      this is so that we are able to import entire certificate chains
      w/o requiring a special order (i.e. root-CA first).  This used
@@ -203,16 +280,19 @@ check_and_store (ctrl_t ctrl, struct stats_s *stats,
         {
           ksba_cert_t next = NULL;
 
+          if (have_fpr)
+            add_seen_cert (stats, fpr);
+
           if (!existed)
             {
               print_imported_status (ctrl, cert, 1);
-              if (stats)
+              if (!depth)
                 stats->imported++;
             }
           else
             {
               print_imported_status (ctrl, cert, 0);
-              if (stats)
+              if (!depth)
                 stats->unchanged++;
             }
 
@@ -237,14 +317,14 @@ check_and_store (ctrl_t ctrl, struct stats_s *stats,
              update the statistics, though. */
           if (!gpgsm_walk_cert_chain (ctrl, cert, &next))
             {
-              check_and_store (ctrl, NULL, next, depth+1);
+              check_and_store (ctrl, stats, next, depth+1);
               ksba_cert_release (next);
             }
         }
       else
         {
           log_error (_("error storing certificate\n"));
-          if (stats)
+          if (!depth)
             stats->not_imported++;
           print_import_problem (ctrl, cert, 4);
         }
@@ -252,7 +332,7 @@ check_and_store (ctrl_t ctrl, struct stats_s *stats,
   else
     {
       log_error (_("basic certificate checks failed - not imported\n"));
-      if (stats)
+      if (!depth)
         stats->not_imported++;
       /* We keep the test for GPG_ERR_MISSING_CERT only in case
          GPG_ERR_MISSING_CERT has been used instead of the newer
@@ -520,10 +600,13 @@ gpgsm_import (ctrl_t ctrl, int in_fd, int reimport_mode)
   struct stats_s stats;
 
   memset (&stats, 0, sizeof stats);
+  keydb_begin_bulk (ctrl);
   if (reimport_mode)
     rc = reimport_one (ctrl, &stats, in_fd);
   else
     rc = import_one (ctrl, &stats, in_fd);
+  keydb_end_bulk (ctrl);
+  release_seen_certs (&stats);
   print_imported_summary (ctrl, &stats);
   /* If we never printed an error message do it now so that a command
      line invocation will return with an error (log_error keeps a
@@ -542,6 +625,7 @@ gpgsm_import_files (ctrl_t ctrl, int nfiles, char **files,
   struct stats_s stats;
 
   memset (&stats, 0, sizeof stats);
+  keydb_begin_bulk (ctrl);
 
   if (!nfiles)
     rc = import_one (ctrl, &stats, 0);
@@ -556,6 +640,8 @@ gpgsm_import_files (ctrl_t ctrl, int nfiles, char **files,
             rc = 0;
         }
     }
+  keydb_end_bulk (ctrl);
+  release_seen_certs (&stats);
   print_imported_summary (ctrl, &stats);
   /* If we never printed an error message do it now so that a command
      line invocation will return with an error (log_error keeps a
@@ -96,6 +96,10 @@ static int any_registered;
 /* Number of active handles.  */
 static int active_handles;
 
+/* Nesting level of keydb_begin_bulk.  The keyboxd transaction is
+ * only started and committed at the outermost level.  */
+static int bulk_level;
+
 
 
 struct keydb_handle {
@@ -2004,6 +2008,72 @@ keydb_store_cert (ctrl_t ctrl, ksba_cert_t cert, int ephemeral, int *existed)
 }
 
 
+/* Helper for keydb_begin_bulk and keydb_end_bulk to send the
+ * keyboxd transaction command WHAT.  */
+static gpg_error_t
+bulk_transaction (ctrl_t ctrl, const char *what)
+{
+  gpg_error_t err;
+  keydb_local_t kbl;
+  char line[40];
+
+  err = open_context (ctrl, &kbl);
+  if (err)
+    return err;
+  snprintf (line, sizeof line, "TRANSACTION %s", what);
+  err = assuan_transact (kbl->ctx, line, NULL, NULL, NULL, NULL, NULL, NULL);
+  kbl->is_active = 0;
+  return err;
+}
+
+
+/* Start a bulk operation.  With keyboxd all changes up to the
+ * matching keydb_end_bulk are done in one transaction which is much
+ * faster than committing each certificate on its own.  Calls may be
+ * nested.  */
+gpg_error_t
+keydb_begin_bulk (ctrl_t ctrl)
+{
+  gpg_error_t err = 0;
+
+  if (!opt.use_keyboxd)
+    return 0;
+
+  if (!bulk_level)
+    {
+      err = bulk_transaction (ctrl, "begin");
+      if (err)
+        {
+          log_info ("starting a keyboxd transaction failed: %s\n",
+                    gpg_strerror (err));
+          return err;
+        }
+    }
+  bulk_level++;
+  return 0;
+}
+
+
+/* Finish a bulk operation started with keydb_begin_bulk.  */
+gpg_error_t
+keydb_end_bulk (ctrl_t ctrl)
+{
+  gpg_error_t err = 0;
+
+  if (!opt.use_keyboxd || !bulk_level)
+    return 0;
+
+  if (!--bulk_level)
+    {
+      err = bulk_transaction (ctrl, "commit");
+      if (err)
+        log_error ("error committing keyboxd transaction: %s\n",
+                   gpg_strerror (err));
+    }
+  return err;
+}
+
+
 /* This is basically keydb_set_flags but it implements a complete
    transaction by locating the certificate in the DB and updating the
    flags. */
@@ -74,5 +74,8 @@ gpg_error_t keydb_set_cert_flags (ctrl_t ctrl, ksba_cert_t cert, int ephemeral,
 
 void keydb_clear_some_cert_flags (ctrl_t ctrl, strlist_t names);
 
+gpg_error_t keydb_begin_bulk (ctrl_t ctrl);
+gpg_error_t keydb_end_bulk (ctrl_t ctrl);
+
 
 #endif /*GNUPG_KEYDB_H*/
@@ -1546,6 +1546,13 @@ list_internal_keys (ctrl_t ctrl, strlist_t names, estream_t fp,
   const char *lastresname, *resname;
   int have_secret;
   int want_ephemeral = ctrl->with_ephemeral_keys;
+  unsigned char *secret_grips = NULL;
+  size_t secret_gripslen = 0;
+  int have_secret_grips = 0;
+
+  /* The same root certificates are checked for nearly each listed
+   * certificate; memorize the agent's answers.  */
+  gpgsm_agent_begin_memo ();
 
   hd = keydb_new (ctrl);
   if (!hd)
@@ -1615,6 +1622,20 @@ list_internal_keys (ctrl_t ctrl, strlist_t names, estream_t fp,
      currently we stop at the first match.  To do this we need an
      extra flag to enable this feature so */
 
+  /* Instead of asking the agent for each certificate we get the
+   * list of all secret keys once.  On error we fall back to single
+   * queries.  */
+  if (mode)
+    {
+      rc = gpgsm_agent_havekey_list (ctrl, &secret_grips, &secret_gripslen);
+      if (!rc)
+        have_secret_grips = 1;
+      else if (opt.verbose)
+        log_info ("problem with fast path key listing: %s - ignored\n",
+                  gpg_strerror (rc));
+      rc = 0;
+    }
+
   /* Suppress duplicates at least when they follow each other.  */
   lastresname = NULL;
   while (!(rc = keydb_search (ctrl, hd, desc, ndesc)))
@@ -1663,7 +1684,20 @@ list_internal_keys (ctrl_t ctrl, strlist_t names, estream_t fp,
         }
 
       have_secret = 0;
-      if (mode)
+      if (mode && have_secret_grips)
+        {
+          unsigned char grip[20];
+          size_t n;
+
+          if (gpgsm_get_keygrip (cert, grip))
+            for (n = 0; n < secret_gripslen; n += 20)
+              if (!memcmp (secret_grips + n, grip, 20))
+                {
+                  have_secret = 1;
+                  break;
+                }
+        }
+      else if (mode)
         {
           char *p = gpgsm_get_keygrip_hexstring (cert);
           if (p)
@@ -1711,7 +1745,9 @@ list_internal_keys (ctrl_t ctrl, strlist_t names, estream_t fp,
   ksba_cert_release (cert);
   ksba_cert_release (lastcert);
   xfree (desc);
+  xfree (secret_grips);
   keydb_release (hd);
+  gpgsm_agent_end_memo ();
   return rc;
 }
 
@@ -427,9 +427,98 @@ cram_octet_string (const unsigned char *input, size_t *length,
 
 
 
+/* Bags of a PKCS#12 object are often protected with the same salt
+ * and iteration count, and a wrong charset guess in decrypt_block
+ * repeats the derivation for the same password.  To avoid running
+ * the costly KDFs again we keep the last derived keys.  The entries
+ * are identified by the KDF (the PKCS#12 ID or 0 for PBKDF2), the
+ * salt, the iteration count, a hash of the password, and the key
+ * length.  The cache is cleared at the end of p12_parse and
+ * p12_build.  */
+#define KDF_CACHE_SIZE 8
+struct kdf_cache_s
+{
+  int id;
+  int iter;
+  size_t saltlen;
+  unsigned char salt[32];
+  unsigned char pwhash[32];
+  size_t keylen;
+  unsigned char *key;   /* Allocated in secure memory or NULL.  */
+};
+static struct kdf_cache_s kdf_cache[KDF_CACHE_SIZE];
+static int kdf_cache_next;
+
+
+/* Return the cache entry matching the args or NULL.  PWHASH receives
+ * the hash of PW.  */
+static struct kdf_cache_s *
+kdf_cache_find (int id, const char *salt, size_t saltlen, int iter,
+                const char *pw, size_t keylen, unsigned char *pwhash)
+{
+  int i;
+
+  gcry_md_hash_buffer (GCRY_MD_SHA256, pwhash, pw, strlen (pw));
+  if (saltlen > sizeof kdf_cache[0].salt)
+    return NULL;
+  for (i=0; i < KDF_CACHE_SIZE; i++)
+    if (kdf_cache[i].key
+        && kdf_cache[i].id == id
+        && kdf_cache[i].iter == iter
+        && kdf_cache[i].keylen == keylen
+        && kdf_cache[i].saltlen == saltlen
+        && !memcmp (kdf_cache[i].salt, salt, saltlen)
+        && !memcmp (kdf_cache[i].pwhash, pwhash, 32))
+      return kdf_cache + i;
+  return NULL;
+}
+
+
+/* Store the derived key KEY of length KEYLEN in the cache.  */
+static void
+kdf_cache_put (int id, const char *salt, size_t saltlen, int iter,
+               const unsigned char *pwhash,
+               const unsigned char *key, size_t keylen)
+{
+  struct kdf_cache_s *kc;
+
+  if (saltlen > sizeof kdf_cache[0].salt)
+    return;
+  kc = kdf_cache + kdf_cache_next;
+  kdf_cache_next = (kdf_cache_next + 1) % KDF_CACHE_SIZE;
+  gcry_free (kc->key);
+  kc->key = gcry_malloc_secure (keylen);
+  if (!kc->key)
+    return;
+  memcpy (kc->key, key, keylen);
+  kc->id = id;
+  kc->iter = iter;
+  kc->keylen = keylen;
+  kc->saltlen = saltlen;
+  memcpy (kc->salt, salt, saltlen);
+  memcpy (kc->pwhash, pwhash, 32);
+}
+
+
+/* Release all cached keys.  */
+static void
+kdf_cache_clear (void)
+{
+  int i;
+
+  for (i=0; i < KDF_CACHE_SIZE; i++)
+    {
+      gcry_free (kdf_cache[i].key);
+      kdf_cache[i].key = NULL;
+      wipememory (kdf_cache[i].pwhash, 32);
+    }
+  kdf_cache_next = 0;
+}
+
+
 static int
-string_to_key (int id, char *salt, size_t saltlen, int iter, const char *pw,
-               int req_keylen, unsigned char *keybuf)
+do_string_to_key (int id, char *salt, size_t saltlen, int iter,
+                  const char *pw, int req_keylen, unsigned char *keybuf)
 {
   int rc, i, j;
   gcry_md_hd_t md;
@@ -525,6 +614,28 @@ string_to_key (int id, char *salt, size_t saltlen, int iter, const char *pw,
 }
 
 
+static int
+string_to_key (int id, char *salt, size_t saltlen, int iter, const char *pw,
+               int req_keylen, unsigned char *keybuf)
+{
+  struct kdf_cache_s *kc;
+  unsigned char pwhash[32];
+
+  kc = kdf_cache_find (id, salt, saltlen, iter, pw, req_keylen, pwhash);
+  if (kc)
+    memcpy (keybuf, kc->key, req_keylen);
+  else if (do_string_to_key (id, salt, saltlen, iter, pw, req_keylen, keybuf))
+    {
+      wipememory (pwhash, sizeof pwhash);
+      return -1;
+    }
+  else
+    kdf_cache_put (id, salt, saltlen, iter, pwhash, keybuf, req_keylen);
+  wipememory (pwhash, sizeof pwhash);
+  return 0;
+}
+
+
 static int
 set_key_iv (gcry_cipher_hd_t chd, char *salt, size_t saltlen, int iter,
             const char *pw, int keybytes)
@@ -561,6 +672,8 @@ set_key_iv_pbes2 (gcry_cipher_hd_t chd, char *salt, size_t saltlen, int iter,
   unsigned char *keybuf;
   size_t keylen;
   int rc;
+  struct kdf_cache_s *kc;
+  unsigned char pwhash[32];
 
   keylen = gcry_cipher_get_algo_keylen (algo);
   if (!keylen)
@@ -569,14 +682,21 @@ set_key_iv_pbes2 (gcry_cipher_hd_t chd, char *salt, size_t saltlen, int iter,
   if (!keybuf)
     return -1;
 
-  rc = gcry_kdf_derive (pw, strlen (pw),
-                        GCRY_KDF_PBKDF2, GCRY_MD_SHA1,
-                        salt, saltlen, iter, keylen, keybuf);
-  if (rc)
+  kc = kdf_cache_find (0, salt, saltlen, iter, pw, keylen, pwhash);
+  if (kc)
+    memcpy (keybuf, kc->key, keylen);
+  else
     {
-      log_error ("gcry_kdf_derive failed: %s\n", gpg_strerror (rc));
-      gcry_free (keybuf);
-      return -1;
+      rc = gcry_kdf_derive (pw, strlen (pw),
+                            GCRY_KDF_PBKDF2, GCRY_MD_SHA1,
+                            salt, saltlen, iter, keylen, keybuf);
+      if (rc)
+        {
+          log_error ("gcry_kdf_derive failed: %s\n", gpg_strerror (rc));
+          gcry_free (keybuf);
+          return -1;
+        }
+      kdf_cache_put (0, salt, saltlen, iter, pwhash, keybuf, keylen);
     }
 
   rc = gcry_cipher_setkey (chd, keybuf, keylen);
@@ -1994,6 +2114,7 @@ p12_parse (const unsigned char *buffer, size_t length, const char *pw,
     *r_curve = ctx.curve;
   else
     gcry_free (ctx.curve);
+  kdf_cache_clear ();
 
   return ctx.privatekey;
 
@@ -2013,6 +2134,7 @@ p12_parse (const unsigned char *buffer, size_t length, const char *pw,
   gcry_free (ctx.curve);
   if (r_curve)
     *r_curve = NULL;
+  kdf_cache_clear ();
   return NULL;
 }
 
@@ -3015,6 +3137,7 @@ p12_build (gcry_mpi_t *kparms, const void *cert, size_t certlen,
     }
   for ( ; seqlistidx; seqlistidx--)
     gcry_free (seqlist[seqlistidx].buffer);
+  kdf_cache_clear ();
 
   *r_length = buffer? buflen : 0;
   return buffer;
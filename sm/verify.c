@@ -37,6 +37,9 @@
 #include "../common/i18n.h"
 #include "../common/compliance.h"
 
+/* The size of the buffer used to hash detached data.  */
+#define HASH_DATA_BUFSIZE (64*1024)
+
 static char *
 strtimestamp_r (ksba_isotime_t atime)
 {
@@ -57,20 +60,28 @@ hash_data (int fd, gcry_md_hd_t md)
 {
   gpg_error_t err = 0;
   estream_t fp;
-  char buffer[4096];
-  int nread;
+  char *buffer;
+  size_t nread;
+
+  /* Use a large buffer so that hashing large detached data is not
+     slowed down by the number of read calls.  */
+  buffer = xtrymalloc (HASH_DATA_BUFSIZE);
+  if (!buffer)
+    return gpg_error_from_syserror ();
 
   fp = es_fdopen_nc (fd, "rb");
   if (!fp)
     {
       err = gpg_error_from_syserror ();
       log_error ("fdopen(%d) failed: %s\n", fd, gpg_strerror (err));
+      xfree (buffer);
       return err;
     }
+  es_setvbuf (fp, NULL, _IONBF, 0);
 
   do
     {
-      nread = es_fread (buffer, 1, DIM(buffer), fp);
+      nread = es_fread (buffer, 1, HASH_DATA_BUFSIZE, fp);
       gcry_md_write (md, buffer, nread);
     }
   while (nread);
@@ -80,6 +91,7 @@ hash_data (int fd, gcry_md_hd_t md)
       log_error ("read error on fd %d: %s\n", fd, gpg_strerror (err));
     }
   es_fclose (fp);
+  xfree (buffer);
   return err;
 }
 
@@ -33,6 +33,7 @@
 #include <string.h>
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <sys/time.h>
 #include <unistd.h>
 
 #if HAVE_LIBREADLINE
@@ -541,6 +542,21 @@ do_get_time (scheme *sc, pointer args)
   FFI_RETURN_INT (sc, gnupg_get_time ());
 }
 
+/* Return the microseconds since the first call.  Counting from the
+ * first call keeps the value small enough for a long.  */
+static pointer
+do_get_time_usec (scheme *sc, pointer args)
+{
+  static time_t base;
+  struct timeval tv;
+  FFI_PROLOG ();
+  FFI_ARGS_DONE_OR_RETURN (sc, args);
+  gettimeofday (&tv, NULL);
+  if (!base)
+    base = tv.tv_sec;
+  FFI_RETURN_INT (sc, (long) (tv.tv_sec - base) * 1000000 + tv.tv_usec);
+}
+
 static pointer
 do_getpid (scheme *sc, pointer args)
 {
@@ -1390,6 +1406,7 @@ ffi_init (scheme *sc, const char *argv0, const char *scriptname,
   ffi_define_function (sc, rmdir);
   ffi_define_function (sc, get_isotime);
   ffi_define_function (sc, get_time);
+  ffi_define_function (sc, get_time_usec);
   ffi_define_function (sc, getpid);
 
   /* Random numbers.  */
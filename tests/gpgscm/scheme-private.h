@@ -115,6 +115,14 @@ int tracing;
 #ifndef CELL_MINRECOVER
 #define CELL_MINRECOVER    (CELL_SEGSIZE >> 2)
 #endif
+
+/* If less than 1/CELL_RECOVER_RATIO of all cells are recovered in a
+ * garbage collector run, the heap is grown by half of its size.  This
+ * keeps the number of collections proportional to the amount of
+ * allocated memory instead of to the number of live cells.  */
+#ifndef CELL_RECOVER_RATIO
+#define CELL_RECOVER_RATIO 4
+#endif
 struct cell_segment *cell_segments;
 
 /* We use 4 registers. */
@@ -162,6 +170,7 @@ pointer COMPILE_HOOK;  /* *compile-hook* */
 
 pointer free_cell;       /* pointer to top of free cells */
 long    fcells;          /* # of free cells */
+long    tcells;          /* # of cells in all segments */
 size_t  inhibit_gc;      /* nesting of gc_disable */
 size_t  reserved_cells;  /* # of reserved cells */
 #ifndef NDEBUG
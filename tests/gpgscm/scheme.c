@@ -794,7 +794,12 @@ static int alloc_cellseg(scheme *sc, int n) {
 
      for (k = 0; k < n; k++) {
 	 struct cell_segment *new, **s;
-	 if (_alloc_cellseg(sc, CELL_SEGSIZE, &new)) {
+	 size_t len = CELL_SEGSIZE;
+
+	 /* Grow the heap geometrically.  */
+	 if (sc->tcells / 2 > len)
+	      len = sc->tcells / 2;
+	 if (_alloc_cellseg(sc, len, &new)) {
 	      return k;
 	 }
 	 /* insert new segment in reverse address order */
@@ -807,6 +812,7 @@ static int alloc_cellseg(scheme *sc, int n) {
 	 *s = new;
 
          sc->fcells += new->cells_len;
+         sc->tcells += new->cells_len;
          last = new->cells + new->cells_len - 1;
           for (p = new->cells; p <= last; p++) {
               typeflag(p) = 0;
@@ -1767,8 +1773,10 @@ static void gc(scheme *sc, pointer a, pointer b) {
   }
 
   /* if only a few recovered, get more to avoid fruitless gc's */
-  if (sc->fcells < CELL_MINRECOVER
-       && alloc_cellseg(sc, 1) == 0)
+  if ((sc->fcells < CELL_MINRECOVER
+       || sc->fcells < sc->tcells / CELL_RECOVER_RATIO)
+      && alloc_cellseg(sc, 1) == 0
+      && sc->fcells < CELL_MINRECOVER)
        sc->no_memory = 1;
 }
 
@@ -5612,6 +5620,7 @@ int scheme_init_custom_alloc(scheme *sc, func_alloc malloc, func_dealloc free) {
 
   sc->free_cell = &sc->_NIL;
   sc->fcells = 0;
+  sc->tcells = 0;
   sc->inhibit_gc = GC_ENABLED;
   sc->reserved_cells = 0;
 #ifndef NDEBUG
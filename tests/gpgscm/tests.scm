@@ -636,6 +636,25 @@
           (echo "===================")
 	  (+ (length failed) (length xpassed))))
 
+      ;; Print the N tests which took the most time.
+      (define (report-timings n)
+	(define (duration t) (- t::end-time t::start-time))
+	(define (insert t lst)
+	  (cond
+	   ((null? lst) (list t))
+	   ((> (duration t) (duration (car lst))) (cons t lst))
+	   (else (cons (car lst) (insert t (cdr lst))))))
+	(echo "Slowest tests (seconds):")
+	(let loop ((sorted (let sort ((acc '()) (l procs))
+			     (if (null? l) acc (sort (insert (car l) acc)
+						     (cdr l)))))
+		   (i 0))
+	  (when (and (pair? sorted) (< i n))
+		(let ((t (car sorted)))
+		  (echo " " (duration t) t::name))
+		(loop (cdr sorted) (+ i 1))))
+	(echo "==================="))
+
       (define (xml)
 	(xx::document
 	 (xx::tag 'testsuites
@@ -812,6 +831,31 @@
 		   (list (xx::textnode (read-all (open-input-file log-file-name)))))
 	  (xx::tag 'system-err '() (list (xx::textnode "")))))))))))
 
+;; If requested with --timings[=N] print the N slowest tests of
+;; RESULTS.
+(define (maybe-report-timings results)
+  (let ((timings (flag "--timings" *args*)))
+    (if timings
+	(results::report-timings (if (and (pair? timings)
+					  (string->number (car timings)))
+				     (string->number (car timings))
+				     10)))))
+
+;; Select the tests of shard I out of N from TESTS.  SPEC has the form
+;; "I/N" with I counting from 1.  This allows to distribute a test
+;; suite over several machines.
+(define (select-shard tests spec)
+  (let* ((parts (string-split spec #\/))
+	 (i (and (= (length parts) 2) (string->number (car parts))))
+	 (n (and i (string->number (cadr parts)))))
+    (if (not (and n (<= 1 i n)))
+	(fail "Invalid shard specification:" spec))
+    (let loop ((acc '()) (k 0) (tests' tests))
+      (if (null? tests')
+	  (reverse acc)
+	  (loop (if (= (modulo k n) (- i 1)) (cons (car tests') acc) acc)
+		(+ k 1) (cdr tests'))))))
+
 ;; Run the setup target to create an environment, then run all given
 ;; tests in parallel.
 (define (run-tests-parallel tests n)
@@ -819,6 +863,7 @@
     (if (null? tests')
 	(let ((results (pool::wait)))
 	  ((results::xml) (open-output-file "report.xml"))
+	  (maybe-report-timings results)
 	  (exit (results::report)))
 	(let ((wd (mkdtemp-autoremove))
 	      (test (car tests')))
@@ -833,6 +878,7 @@
     (if (null? tests')
 	(let ((results (pool::wait)))
 	  ((results::xml) (open-output-file "report.xml"))
+	  (maybe-report-timings results)
 	  (exit (results::report)))
 	(let ((wd (mkdtemp-autoremove))
 	      (test (car tests')))
@@ -841,10 +887,13 @@
 		(cdr tests'))))))
 
 ;; Run tests either in sequence or in parallel, depending on the
-;; number of tests and the command line flags.
-(define (run-tests tests)
-  (let ((parallel (flag "--parallel" *args*))
-	(default-parallel-jobs 32))
+;; number of tests and the command line flags.  With --shard=I/N only
+;; every Nth test starting at the Ith is run.
+(define (run-tests tests')
+  (let* ((parallel (flag "--parallel" *args*))
+	 (shard (flag "--shard" *args*))
+	 (tests (if (pair? shard) (select-shard tests' (car shard)) tests'))
+	 (default-parallel-jobs 32))
     (if (and parallel (> (length tests) 1))
 	(run-tests-parallel tests (if (and (pair? parallel)
 					   (string->number (car parallel)))
@@ -0,0 +1,278 @@
+#!/usr/bin/env gpgscm
+
+;; Copyright (C) 2026 g10 Code GmbH
+;;
+;; This file is part of GnuPG.
+;;
+;; GnuPG is free software; you can redistribute it and/or modify
+;; it under the terms of the GNU General Public License as published by
+;; the Free Software Foundation; either version 3 of the License, or
+;; (at your option) any later version.
+;;
+;; GnuPG is distributed in the hope that it will be useful,
+;; but WITHOUT ANY WARRANTY; without even the implied warranty of
+;; MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+;; GNU General Public License for more details.
+;;
+;; You should have received a copy of the GNU General Public License
+;; along with this program; if not, see <http://www.gnu.org/licenses/>.
+
+;; This is not a test but a set of scaled benchmark scenarios.  Run it
+;; using
+;;
+;;   make -C tests/openpgp bench-scale
+;;
+;; The results are printed as JSON lines to stdout, in the same way as
+;; the micro benchmarks of "make bench":
+;;
+;;   {"bench":"NAME","ops":N,"usec":N[,"bytes":N][,"p50_usec":N,"p99_usec":N]}
+;;
+;; The size of the scenarios is controlled by these envvars:
+;;
+;;   BENCH_KEYS        Number of generated keys (1000).
+;;   BENCH_FLOOD       Number of user IDs added to the flooded key (1000).
+;;   BENCH_MSG_MB      Size of the large message in MiB (64).
+;;   BENCH_RECIPIENTS  Number of recipients for one message (100).
+;;   BENCH_CLIENTS     Number of concurrent gpg clients (8).
+;;   BENCH_ROUNDS      Number of operations per client (25).
+;;   BENCH_SSH_SIGNS   Number of ssh-agent sign requests (1000).
+;;
+;; For a release check use for example BENCH_KEYS=100000,
+;; BENCH_MSG_MB=1024 and BENCH_RECIPIENTS=1000.
+
+(define bench-dir (mkdtemp-autoremove))
+(chdir bench-dir)
+
+(load (in-srcdir "tests" "openpgp" "defs.scm"))
+(setup-environment)
+
+(define (knob name default)
+  (let ((n (string->number (getenv' name (number->string default)))))
+    (if (and n (> n 0)) n default)))
+
+(define nkeys      (knob "BENCH_KEYS" 1000))
+(define nflood     (knob "BENCH_FLOOD" 1000))
+(define msg-mb     (knob "BENCH_MSG_MB" 64))
+(define nrecp      (min nkeys (knob "BENCH_RECIPIENTS" 100)))
+(define nclients   (knob "BENCH_CLIENTS" 8))
+(define nrounds    (knob "BENCH_ROUNDS" 25))
+(define nsshsigns  (knob "BENCH_SSH_SIGNS" 1000))
+
+;; Return the list (0 1 ... N-1).
+(define (range n)
+  (let loop ((i (- n 1)) (acc '()))
+    (if (< i 0) acc (loop (- i 1) (cons i acc)))))
+
+(define (user-id i)
+  (string-append "<user" (number->string i) "@bench.example>"))
+
+;; Sort the list of numbers L in ascending order.
+(define (sort-numbers l)
+  (define (merge a b)
+    (cond
+     ((null? a) b)
+     ((null? b) a)
+     ((< (car b) (car a)) (cons (car b) (merge a (cdr b))))
+     (else (cons (car a) (merge (cdr a) b)))))
+  (define (split l a b)
+    (if (null? l)
+	(cons a b)
+	(split (cdr l) b (cons (car l) a))))
+  (if (or (null? l) (null? (cdr l)))
+      l
+      (let ((halves (split l '() '())))
+	(merge (sort-numbers (car halves)) (sort-numbers (cdr halves))))))
+
+;; Return the Pth percentile of the sorted list L.
+(define (percentile l p)
+  (list-ref l (min (- (length l) 1)
+		   (quotient (* p (length l)) 100))))
+
+;; Print one result line.  EXTRA is a list of (key value) pairs.
+(define (report name ops usec . extra)
+  (display (string-append "{\"bench\":\"" name "\""
+			  ",\"ops\":" (number->string ops)
+			  ",\"usec\":" (number->string (max usec 1))))
+  (for-each (lambda (x)
+	      (display (string-append ",\"" (car x) "\":"
+				      (number->string (cadr x)))))
+	    extra)
+  (display "}")
+  (newline)
+  (flush-stdio))
+
+;; Run the command WHAT and fail if it does not succeed.  The output
+;; is not collected because it may be huge.
+(define (run what)
+  (unless (= 0 (call what))
+	  (fail "Command failed:" what)))
+
+;; Time the thunk F and report it as NAME with OPS operations.
+(define (timed name ops f . extra)
+  (let ((start (get-time-usec)))
+    (f)
+    (apply report `(,name ,ops ,(- (get-time-usec) start) ,@extra))))
+
+;; Run CLIENTS processes in parallel.  Each client runs ROUNDS
+;; commands returned by (MAKE-CMD CLIENT ROUND) one after the other.
+;; Returns the list of latencies in microseconds.
+(define (run-concurrent clients rounds make-cmd)
+  (let ((slots (make-vector clients #f))
+	(done (make-vector clients 0))
+	(latencies '()))
+    (define (start! i)
+      (vector-set! slots i
+		   (cons (spawn-process-fd (make-cmd i (vector-ref done i))
+					   CLOSED_FD CLOSED_FD CLOSED_FD)
+			 (get-time-usec))))
+    (define (busy)
+      (filter (lambda (i) (vector-ref slots i)) (range clients)))
+    (let loop ()
+      (for-each (lambda (i)
+		  (if (and (not (vector-ref slots i))
+			   (< (vector-ref done i) rounds))
+		      (start! i)))
+		(range clients))
+      (let ((running (busy))
+	    (any #f))
+	(unless (null? running)
+		(for-each
+		 (lambda (i retcode)
+		   (unless (< retcode 0)
+			   (if (not (= retcode 0))
+			       (fail "Client" i "failed"))
+			   (set! latencies
+				 (cons (- (get-time-usec)
+					  (cdr (vector-ref slots i)))
+				       latencies))
+			   (vector-set! done i (+ 1 (vector-ref done i)))
+			   (vector-set! slots i #f)
+			   (set! any #t)))
+		 running
+		 (wait-processes (map (lambda (i) "gpg") running)
+				 (map (lambda (i) (car (vector-ref slots i)))
+				      running)
+				 #f))
+		(unless any (usleep 1000))
+		(loop))))
+    latencies))
+
+
+;;
+;; The scenarios.
+;;
+
+(info "Generating" nkeys "keys...")
+(call-with-output-file "keys.param"
+  (lambda (port)
+    (let loop ((i 0))
+      (when (< i nkeys)
+	    (display (string-append "Key-Type: default\n"
+				    "Subkey-Type: default\n"
+				    "Name-Email: user" (number->string i)
+				    "@bench.example\n"
+				    "Expire-Date: 0\n"
+				    "%no-protection\n"
+				    "%transient-key\n"
+				    "%commit\n")
+		     port)
+	    (loop (+ i 1))))))
+(timed "keygen-batch" nkeys
+       (lambda () (run `(,@GPG --generate-key keys.param))))
+
+(timed "list-keys" nkeys
+       (lambda () (run `(,@GPG --list-keys --with-colons))))
+
+(timed "export" nkeys
+       (lambda () (run `(,@GPG --yes --output all.gpg --export))))
+
+(timed "import-unchanged" nkeys
+       (lambda () (run `(,@GPG --import all.gpg))))
+
+(timed "check-trustdb" nkeys
+       (lambda () (run `(,@GPG --check-trustdb))))
+
+(info "Flooding a key with" nflood "user IDs...")
+(define flood-fpr (:fpr (assoc "fpr" (gpg-with-colons `(-k ,(user-id 0))))))
+(call-with-output-file "flood.edit"
+  (lambda (port)
+    (let loop ((i 0))
+      (when (< i nflood)
+	    (display (string-append flood-fpr " add-uid flood"
+				    (number->string i) "@bench.example\n")
+		     port)
+	    (loop (+ i 1))))))
+(timed "flood-add-uids" nflood
+       (lambda () (run `(,@GPG --quick-batch-edit flood.edit))))
+(timed "flood-check-sigs" 1
+       (lambda () (run `(,@GPG --check-signatures ,flood-fpr))))
+(timed "flood-export" 1
+       (lambda () (run `(,@GPG --yes --output flood.gpg --export ,flood-fpr))))
+(timed "flood-import-unchanged" 1
+       (lambda () (run `(,@GPG --import flood.gpg))))
+
+(info "Creating a" msg-mb "MiB message...")
+(define msg-bytes (* msg-mb 1024 1024))
+(pipe:do
+ (pipe:spawn `(,@GPG --gen-random 0 ,msg-bytes))
+ (pipe:write-to "large.msg" (logior O_WRONLY O_CREAT O_BINARY) #o600))
+(timed "large-encrypt" 1
+       (lambda () (run `(,@GPG --yes --trust-model always
+			       --compress-algo none
+			       --recipient ,(user-id 1)
+			       --output large.gpg --encrypt large.msg)))
+       (list "bytes" msg-bytes))
+(timed "large-decrypt" 1
+       (lambda () (run `(,@GPG --yes --output large.out --decrypt large.gpg)))
+       (list "bytes" msg-bytes))
+(timed "large-sign" 1
+       (lambda () (run `(,@GPG --yes --local-user ,(user-id 1)
+			       --output large.sig --detach-sign large.msg)))
+       (list "bytes" msg-bytes))
+(timed "large-verify" 1
+       (lambda () (run `(,@GPG --verify large.sig large.msg)))
+       (list "bytes" msg-bytes))
+(unlink "large.gpg")
+(unlink "large.out")
+
+(info "Encrypting to" nrecp "recipients...")
+(create-file "small.msg" "A small message.")
+(timed "many-recipients-encrypt" nrecp
+       (lambda ()
+	 (run `(,@GPG --yes --trust-model always --output many.gpg
+		      ,@(let loop ((i 0) (acc '()))
+			  (if (= i nrecp)
+			      acc
+			      (loop (+ i 1)
+				    (cons '--recipient (cons (user-id i) acc)))))
+		      --encrypt small.msg))))
+(timed "many-recipients-decrypt" 1
+       (lambda ()
+	 (run `(,@GPG --yes --output many.out --decrypt many.gpg))))
+
+(info "Running" nclients "concurrent clients...")
+(srandom (getpid))
+(define (client-cmd client round)
+  (if (even? (+ client round))
+      `(,@GPG --list-keys ,(user-id (random nkeys)))
+      `(,@GPG --yes --local-user ,(user-id (random nkeys))
+	      --output ,(string-append "client-" (number->string client) ".sig")
+	      --detach-sign small.msg)))
+(let* ((start (get-time-usec))
+       (latencies (sort-numbers (run-concurrent nclients nrounds client-cmd)))
+       (usec (- (get-time-usec) start)))
+  (report "concurrent-clients" (length latencies) usec
+	  (list "p50_usec" (percentile latencies 50))
+	  (list "p99_usec" (percentile latencies 99))))
+
+(info "Sending" nsshsigns "ssh-agent sign requests...")
+;; Enable a key for ssh by listing its keygrip in sshcontrol.  The
+;; helper prints its own result line.
+(create-file "sshcontrol"
+	     (:fpr (assoc "grp" (gpg-with-colons
+				 `(--with-keygrip -K ,(user-id 2))))))
+(run `(,(in-objdir "agent" (qualify "bench-ssh"))
+       --requests ,(number->string nsshsigns)
+       --clients ,(number->string nclients)
+       --socket ,(call-check `(,(tool 'gpgconf) --null
+					       --list-dirs agent-ssh-socket))))
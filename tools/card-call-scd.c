@@ -158,6 +158,7 @@ release_card_info (card_info_t info)
     {
       key_info_t kinfo = info->kinfo->next;
       xfree (info->kinfo->label);
+      xfree (info->kinfo->pubkey_algostr);
       xfree (info->kinfo);
       info->kinfo = kinfo;
     }
@@ -897,6 +898,10 @@ learn_status_cb (void *opaque, const char *line)
           xfree (parm->disp_name);
           parm->disp_name = unescape_status_string (line);
         }
+      else if (!memcmp (keyword, "LEARN-ALL", keywordlen))
+        {
+          parm->learn_all = 1;
+        }
       else if (!memcmp (keyword, "DISP-LANG", keywordlen))
         {
           xfree (parm->disp_lang);
@@ -1025,6 +1030,23 @@ learn_status_cb (void *opaque, const char *line)
         {
           parm->sig_counter = strtoul (line, NULL, 0);
         }
+      else if (!memcmp (keyword, "KEY-ALGOSTR", keywordlen))
+        {
+          /* The format of such a line is:
+           *   KEY-ALGOSTR <keyref> <algostr>
+           */
+          const char *fields[2];
+
+          line_buffer = pline = xstrdup (line);
+          if (split_fields (line_buffer, fields, DIM (fields)) < 2)
+            goto leave;  /* not enough args - invalid status line.  */
+
+          kinfo = find_kinfo (parm, fields[0]);
+          if (!kinfo)
+            kinfo = create_kinfo (parm, fields[0]);
+          xfree (kinfo->pubkey_algostr);
+          kinfo->pubkey_algostr = xstrdup (fields[1]);
+        }
       else if (!memcmp (keyword, "KEYPAIRINFO", keywordlen))
         {
           /* The format of such a line is:
@@ -1149,7 +1171,10 @@ learn_status_cb (void *opaque, const char *line)
 
 
 /* Call the scdaemon to learn about a smartcard.  This fills INFO
- * with data from the card. */
+ * with data from the card.  The scdaemon is asked to return all
+ * attributes and the algorithms of the public keys with the LEARN
+ * command; only if it does not support this the attributes are
+ * requested separately.  */
 gpg_error_t
 scd_learn (card_info_t info, int reread)
 {
@@ -1169,15 +1194,15 @@ scd_learn (card_info_t info, int reread)
 
   parm.ctx = agent_ctx;
   err = assuan_transact (agent_ctx,
-                         reread? "SCD LEARN --force --reread"
-                         /*  */: "SCD LEARN --force",
+                         reread? "SCD LEARN --force --all --reread"
+                         /*  */: "SCD LEARN --force --all",
                          dummy_data_cb, NULL, default_inq_cb, &parm,
                          learn_status_cb, info);
   /* Also try to get some other key attributes.  */
   if (!err)
+    info->initialized = 1;
+  if (!err && !info->learn_all)
     {
-      info->initialized = 1;
-
       err = scd_getattr ("KEY-ATTR", info);
       if (gpg_err_code (err) == GPG_ERR_INV_NAME
           || gpg_err_code (err) == GPG_ERR_UNSUPPORTED_OPERATION)
@@ -721,7 +721,12 @@ list_one_kinfo (card_info_t info, key_info_t kinfo,
       if (kinfo->label)
         tty_fprintf (fp, "      label ......: %s\n", kinfo->label);
 
-      if (!(err = scd_readkey (kinfo->keyref, create_shadow, &s_pkey)))
+      /* The algorithm returned by LEARN has been taken from the same
+       * public key; only for creating the shadow key we need to ask
+       * the agent.  */
+      if (kinfo->pubkey_algostr && !create_shadow)
+        tty_fprintf (fp, "      algorithm ..: %s\n", kinfo->pubkey_algostr);
+      else if (!(err = scd_readkey (kinfo->keyref, create_shadow, &s_pkey)))
         {
           char *tmp = pubkey_algo_string (s_pkey, NULL);
           tty_fprintf (fp, "      algorithm ..: %s\n", nullnone (tmp));
@@ -128,6 +128,10 @@ struct key_info_s
   /* An optional malloced label for the key.  */
   char *label;
 
+  /* An optional malloced algorithm string of the public key as
+   * returned by LEARN --all.  */
+  char *pubkey_algostr;
+
   /* The three next items are mostly useful for OpenPGP cards.  */
   unsigned char fprlen;  /* Use length of the next item.  */
   unsigned char fpr[32]; /* The binary fingerprint of length FPRLEN.  */
@@ -144,6 +148,7 @@ typedef struct key_info_s *key_info_t;
 struct card_info_s
 {
   int initialized;   /* True if a learn command was successful. */
+  int learn_all;     /* The LEARN command returned all attributes.  */
   int need_sn_cmd;   /* The SERIALNO command needs to be issued.  */
   int card_removed;  /* Helper flag set by some listing functions.  */
   int error;         /* private. */
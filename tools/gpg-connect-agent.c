@@ -36,6 +36,7 @@
 #include "../common/sysutils.h"
 #include "../common/membuf.h"
 #include "../common/ttyio.h"
+#include "../common/opstats.h"
 #ifdef HAVE_W32_SYSTEM
 #  include "../common/exechelp.h"
 #endif
@@ -76,6 +77,7 @@ enum cmd_and_opt_values
     oNoHistory,
     oNoAutostart,
     oChUid,
+    oPipeline,
 
     oNoop
   };
@@ -114,6 +116,7 @@ static gpgrt_opt_t opts[] = {
   ARGPARSE_s_s (oKeyboxdProgram, "keyboxd-program", "@"),
   ARGPARSE_s_s (oChUid,          "chuid",           "@"),
   ARGPARSE_s_n (oUnBuffered,     "unbuffered", "@"),
+  ARGPARSE_s_u (oPipeline,       "pipeline", "@"),
 
   ARGPARSE_end ()
 };
@@ -142,6 +145,7 @@ struct
   int trim_leading_spaces;
   int no_history;
   int unbuffered; /* Set if unbuffered mode for stdin/out is preferred.  */
+  unsigned int pipeline; /* Initial value for /pipeline.  */
 } opt;
 
 
@@ -183,6 +187,46 @@ struct loopline_s
 typedef struct loopline_s *loopline_t;
 
 
+/* The maximum number of outstanding commands in pipeline mode.  We
+ * need to limit this because the server blocks if we do not read its
+ * responses and we block if the server does not read our commands.  */
+#define MAX_PIPELINE 1024
+
+/* The state of the pipeline mode.  If WINDOW is not zero, up to that
+ * many commands are sent to the server before the oldest response is
+ * read.  QUEUE is a ring buffer of size WINDOW with the outstanding
+ * commands; HEAD is the index of the oldest one.  */
+struct pipeitem_s
+{
+  char verb[32];              /* The command verb for the statistics.  */
+  int withhash;               /* Print comment lines of the response.  */
+  unsigned long long start;   /* Time the command was sent.  */
+};
+static struct
+{
+  unsigned int window;
+  unsigned int count;
+  unsigned int head;
+  struct pipeitem_s *queue;
+} pipeline;
+
+
+/* Per command timing statistics as printed by /stats.  */
+struct cmdstat_s
+{
+  struct cmdstat_s *next;
+  unsigned long errors;
+  size_t nsamples;
+  size_t nallocated;
+  unsigned long *samples;  /* Latencies in microseconds.  */
+  char verb[1];
+};
+typedef struct cmdstat_s *cmdstat_t;
+
+static cmdstat_t cmdstat_list;
+static unsigned long long cmdstat_first, cmdstat_last;
+
+
 /* This is used to store the pid of the server.  */
 static pid_t server_pid = (pid_t)(-1);
 
@@ -1164,6 +1208,205 @@ help_cmd_p (const char *line)
 }
 
 
+/* Copy the command verb of LINE to the buffer VERB of size VERBSIZE.
+ * "SCD" is merged with its sub-command.  */
+static void
+get_cmd_verb (const char *line, char *verb, size_t verbsize)
+{
+  const char *s;
+  size_t n;
+
+  while (spacep (line))
+    line++;
+  for (s=line; *s && !spacep (s); s++)
+    ;
+  if (s - line == 3 && !ascii_strncasecmp (line, "SCD", 3))
+    {
+      while (spacep (s))
+        s++;
+      for (; *s && !spacep (s); s++)
+        ;
+    }
+  n = s - line;
+  if (n >= verbsize)
+    n = verbsize - 1;
+  memcpy (verb, line, n);
+  verb[n] = 0;
+}
+
+
+/* Record the latency of a command with VERB which has been sent at
+ * START.  FAILED is true if the command did not return OK.  */
+static void
+record_cmdstat (const char *verb, unsigned long long start, int failed)
+{
+  cmdstat_t cs;
+  unsigned long long now = opstats_now ();
+
+  for (cs = cmdstat_list; cs; cs = cs->next)
+    if (!ascii_strcasecmp (cs->verb, verb))
+      break;
+  if (!cs)
+    {
+      cs = xcalloc (1, sizeof *cs + strlen (verb));
+      strcpy (cs->verb, verb);
+      cs->next = cmdstat_list;
+      cmdstat_list = cs;
+    }
+  if (cs->nsamples == cs->nallocated)
+    {
+      cs->nallocated = cs->nallocated? 2 * cs->nallocated : 64;
+      cs->samples = xrealloc (cs->samples,
+                              cs->nallocated * sizeof *cs->samples);
+    }
+  cs->samples[cs->nsamples++] = now > start? (unsigned long)(now - start) : 0;
+  if (failed)
+    cs->errors++;
+  if (!cmdstat_first || start < cmdstat_first)
+    cmdstat_first = start;
+  cmdstat_last = now;
+}
+
+
+static int
+cmp_ulong (const void *a, const void *b)
+{
+  unsigned long x = *(const unsigned long *)a;
+  unsigned long y = *(const unsigned long *)b;
+
+  return x < y? -1 : x > y;
+}
+
+
+/* Print the statistics of all commands sent so far.  */
+static void
+show_cmdstats (void)
+{
+  cmdstat_t cs;
+  unsigned long long sum, total = 0;
+  unsigned long long elapsed;
+  size_t i;
+
+  for (cs = cmdstat_list; cs; cs = cs->next)
+    {
+      if (!cs->nsamples)
+        continue;
+      qsort (cs->samples, cs->nsamples, sizeof *cs->samples, cmp_ulong);
+      for (sum=0, i=0; i < cs->nsamples; i++)
+        sum += cs->samples[i];
+      total += cs->nsamples;
+      printf ("%-20s n=%lu err=%lu min=%lu avg=%llu p50=%lu p99=%lu max=%lu\n",
+              cs->verb, (unsigned long)cs->nsamples, cs->errors,
+              cs->samples[0], sum / cs->nsamples,
+              cs->samples[cs->nsamples / 2],
+              cs->samples[(cs->nsamples * 99) / 100],
+              cs->samples[cs->nsamples - 1]);
+    }
+  elapsed = cmdstat_last - cmdstat_first;
+  if (total && elapsed)
+    printf ("%-20s n=%llu usec=%llu rate=%.1f/s\n", "(total)",
+            total, elapsed, (double)total * 1000000.0 / (double)elapsed);
+}
+
+
+/* Release all statistics.  */
+static void
+clear_cmdstats (void)
+{
+  cmdstat_t cs;
+
+  while ((cs = cmdstat_list))
+    {
+      cmdstat_list = cs->next;
+      xfree (cs->samples);
+      xfree (cs);
+    }
+  cmdstat_first = cmdstat_last = 0;
+}
+
+
+/* Read and print the response of the oldest outstanding command in
+ * pipeline mode.  */
+static int
+pipeline_pop (assuan_context_t ctx, int *r_goterr)
+{
+  struct pipeitem_s *item;
+  int rc;
+
+  *r_goterr = 0;
+  if (!pipeline.count)
+    return 0;
+  item = pipeline.queue + pipeline.head;
+  rc = read_and_print_response (ctx, item->withhash, r_goterr);
+  record_cmdstat (item->verb, item->start, rc || *r_goterr);
+  pipeline.head = (pipeline.head + 1) % pipeline.window;
+  pipeline.count--;
+  if (rc)
+    pipeline.count = 0;  /* The connection is not usable anymore.  */
+  return rc;
+}
+
+
+/* Read the responses of all outstanding commands.  Returns the first
+ * error and sets R_GOTERR if any of the commands failed.  */
+static int
+pipeline_drain (assuan_context_t ctx, int *r_goterr)
+{
+  int rc, firstrc = 0;
+  int goterr;
+
+  *r_goterr = 0;
+  while (pipeline.count)
+    {
+      rc = pipeline_pop (ctx, &goterr);
+      if (goterr)
+        *r_goterr = 1;
+      if (rc && !firstrc)
+        firstrc = rc;
+    }
+  return firstrc;
+}
+
+
+/* Set the pipeline window to N.  All outstanding responses must have
+ * been read before this is called.  */
+static void
+set_pipeline (unsigned int n)
+{
+  log_assert (!pipeline.count);
+  if (n > MAX_PIPELINE)
+    {
+      log_info ("pipeline size limited to %d\n", MAX_PIPELINE);
+      n = MAX_PIPELINE;
+    }
+  if (n == 1)
+    n = 0;  /* A window of one is the same as no pipelining.  */
+  xfree (pipeline.queue);
+  pipeline.queue = n? xcalloc (n, sizeof *pipeline.queue) : NULL;
+  pipeline.window = n;
+  pipeline.head = 0;
+}
+
+
+/* Return true if the control command CMD requires that all responses
+ * have been read.  These are all commands which are not about
+ * variables or flow control.  */
+static int
+cmd_needs_drain_p (const char *cmd)
+{
+  static const char *const nodrain[] = {
+    "let", "slet", "showvar", "echo", "while", "if", "end",
+    "subst", "nosubst", "sleep", "history", "help", NULL
+  };
+  int i;
+
+  for (i=0; nodrain[i]; i++)
+    if (!strcmp (cmd, nodrain[i]))
+      return 0;
+  return 1;
+}
+
+
 /* gpg-connect-agent's entry point. */
 int
 main (int argc, char **argv)
@@ -1176,6 +1419,7 @@ main (int argc, char **argv)
   size_t linesize;
   int rc;
   int cmderr;
+  unsigned long long cmdstart;
   const char *opt_run = NULL;
   gpgrt_stream_t script_fp = NULL;
   int use_tty, keep_line;
@@ -1245,6 +1489,7 @@ main (int argc, char **argv)
           break;
         case oChUid:     changeuser = pargs.r.ret_str; break;
         case oUnBuffered: opt.unbuffered = 1; break;
+        case oPipeline:   opt.pipeline = pargs.r.ret_uint; break;
 
         default: pargs.err = 2; break;
 	}
@@ -1420,6 +1665,9 @@ main (int argc, char **argv)
       setvbuf (stdout, NULL, _IONBF, 0);
     }
 
+  if (opt.pipeline)
+    set_pipeline (opt.pipeline);
+
   for (loopidx=0; loopidx < DIM (loopstack); loopidx++)
     loopstack[loopidx].collecting = 0;
   loopidx = -1;
@@ -1571,6 +1819,18 @@ main (int argc, char **argv)
             *p++ = 0;
           while (spacep (p))
             p++;
+          if (pipeline.count && cmd_needs_drain_p (cmd))
+            {
+              rc = pipeline_drain (ctx, &cmderr);
+              if (rc)
+                log_info (_("receiving line failed: %s\n"), gpg_strerror (rc));
+              if ((rc || cmderr) && script_fp)
+                {
+                  log_error ("stopping script execution\n");
+                  gpgrt_fclose (script_fp);
+                  script_fp = NULL;
+                }
+            }
           if (!strcmp (cmd, "let"))
             {
               assign_variable (p, 0);
@@ -1864,6 +2124,21 @@ main (int argc, char **argv)
             {
               gnupg_sleep (1);
             }
+          else if (!strcmp (cmd, "pipeline"))
+            {
+              set_pipeline (*p? (unsigned int)strtoul (p, NULL, 10) : 0);
+            }
+          else if (!strcmp (cmd, "nopipeline"))
+            {
+              set_pipeline (0);
+            }
+          else if (!strcmp (cmd, "stats"))
+            {
+              if (!strcmp (p, "--clear"))
+                clear_cmdstats ();
+              else
+                show_cmdstats ();
+            }
           else if (!strcmp (cmd, "history"))
             {
               if (!strcmp (p, "--clear"))
@@ -1900,6 +2175,9 @@ main (int argc, char **argv)
 "/while VAR             Begin loop controlled by VAR.\n"
 "/end                   End loop or condition\n"
 "/history               Manage the history\n"
+"/pipeline [N]          Send up to N commands before reading responses.\n"
+"/nopipeline            Disable pipelining.\n"
+"/stats [--clear]       Print or clear the per-command timing statistics.\n"
 "/bye                   Terminate gpg-connect-agent.\n"
 "/help                  Print this help.");
             }
@@ -1912,6 +2190,7 @@ main (int argc, char **argv)
       if (opt.verbose && script_fp)
         puts (line);
 
+      cmdstart = opstats_now ();
       tmpline = opt.enable_varsubst? substitute_line (line) : NULL;
       if (tmpline)
         {
@@ -1928,7 +2207,28 @@ main (int argc, char **argv)
       if (*line == '#' || !*line)
         continue; /* Don't expect a response for a comment line. */
 
-      rc = read_and_print_response (ctx, help_cmd_p (line), &cmderr);
+      if (pipeline.window)
+        {
+          struct pipeitem_s *item;
+
+          item = pipeline.queue + ((pipeline.head + pipeline.count)
+                                   % pipeline.window);
+          get_cmd_verb (line, item->verb, sizeof item->verb);
+          item->withhash = help_cmd_p (line);
+          item->start = cmdstart;
+          pipeline.count++;
+          if (pipeline.count < pipeline.window)
+            continue;
+          rc = pipeline_pop (ctx, &cmderr);
+        }
+      else
+        {
+          char verb[32];
+
+          rc = read_and_print_response (ctx, help_cmd_p (line), &cmderr);
+          get_cmd_verb (line, verb, sizeof verb);
+          record_cmdstat (verb, cmdstart, rc || cmderr);
+        }
       if (rc)
         log_info (_("receiving line failed: %s\n"), gpg_strerror (rc) );
       if ((rc || cmderr) && script_fp)
@@ -1946,6 +2246,13 @@ main (int argc, char **argv)
 	 early.  */
     }
 
+  if (pipeline.count)
+    {
+      rc = pipeline_drain (ctx, &cmderr);
+      if (rc)
+        log_info (_("receiving line failed: %s\n"), gpg_strerror (rc));
+    }
+
   if (opt.verbose)
     log_info ("closing connection to %s\n",
               opt.use_dirmngr? "dirmngr" :
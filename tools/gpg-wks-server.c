@@ -156,6 +156,7 @@ static int opt_with_file;
 /* Prototypes.  */
 static gpg_error_t get_domain_list (strlist_t *r_list);
 
+static gpg_error_t command_receive_files (int argc, char **argv);
 static gpg_error_t command_receive_cb (void *opaque,
                                        const char *mediatype, estream_t fp,
                                        unsigned int flags);
@@ -372,8 +373,9 @@ main (int argc, char **argv)
     {
     case aReceive:
       if (argc)
-        wrong_args ("--receive");
-      err = wks_receive (es_stdin, command_receive_cb, NULL);
+        err = command_receive_files (argc, argv);
+      else
+        err = wks_receive (es_stdin, command_receive_cb, NULL);
       break;
 
     case aCron:
@@ -1674,6 +1676,41 @@ command_receive_cb (void *opaque, const char *mediatype,
 }
 
 
+/* Process the mails in the files given by ARGV.  A failure to
+ * process one mail does not stop the processing of the others; the
+ * first error is returned.  */
+static gpg_error_t
+command_receive_files (int argc, char **argv)
+{
+  gpg_error_t err, firsterr = 0;
+  estream_t fp;
+
+  for (; argc; argc--, argv++)
+    {
+      fp = es_fopen (*argv, "rb");
+      if (!fp)
+        {
+          err = gpg_error_from_syserror ();
+          log_error ("error opening '%s': %s\n", *argv, gpg_strerror (err));
+        }
+      else
+        {
+          if (opt.verbose)
+            log_info ("processing '%s'\n", *argv);
+          err = wks_receive (fp, command_receive_cb, NULL);
+          if (err)
+            log_error ("processing '%s' failed: %s\n",
+                       *argv, gpg_strerror (err));
+          es_fclose (fp);
+        }
+      if (err && !firsterr)
+        firsterr = err;
+    }
+
+  return firsterr;
+}
+
+
 
 /* Return a list of all configured domains.  Each list element is the
  * top directory for the domain.  To figure out the actual domain
@@ -1744,19 +1781,80 @@ get_domain_list (strlist_t *r_list)
 
 
 
+/* Return the time stored in the expire stamp file STAMPNAME or 0 if
+ * it does not exist or is not valid.  */
+static time_t
+read_expire_stamp (const char *stampname)
+{
+  estream_t fp;
+  char line[32];
+  time_t stamp = 0;
+
+  fp = es_fopen (stampname, "r");
+  if (!fp)
+    return 0;
+  if (es_fgets (line, sizeof line, fp))
+    stamp = (time_t)strtoul (line, NULL, 10);
+  es_fclose (fp);
+  return stamp;
+}
+
+
+/* Store STAMP in the expire stamp file STAMPNAME.  A STAMP of 0
+ * removes the file.  Errors are not fatal because the stamp is only
+ * used to skip work.  */
+static void
+write_expire_stamp (const char *stampname, time_t stamp)
+{
+  gpg_error_t err;
+  estream_t fp;
+
+  if (!stamp)
+    {
+      if (remove (stampname)
+          && gpg_err_code (err = gpg_error_from_syserror ()) != GPG_ERR_ENOENT)
+        log_info ("error removing '%s': %s\n",
+                  stampname, gpg_strerror (err));
+      return;
+    }
+
+  fp = es_fopen (stampname, "w,mode=-rw");
+  if (!fp)
+    {
+      log_info ("error creating '%s': %s\n",
+                stampname, gpg_strerror (gpg_error_from_syserror ()));
+      return;
+    }
+  es_fprintf (fp, "%lu\n", (unsigned long)stamp);
+  if (es_fclose (fp))
+    log_info ("error writing '%s': %s\n",
+              stampname, gpg_strerror (gpg_error_from_syserror ()));
+}
+
+
+/* Remove expired pending keys of DOMAIN.  The time the next pending
+ * key expires is stored in the file ".next-expire" of the pending
+ * directory so that the directory needs to be scanned only if there
+ * is something to expire.  New pending keys always expire later
+ * than the existing ones and thus do not need to update that file.  */
 static gpg_error_t
 expire_one_domain (const char *top_dirname, const char *domain)
 {
   gpg_error_t err;
   char *dirname;
   char *fname = NULL;
+  char *stampname = NULL;
   gnupg_dir_t dir = NULL;
   gnupg_dirent_t dentry;
   struct stat sb;
   time_t now = gnupg_get_time ();
+  time_t stamp, next_expire = 0;
+  int remove_failed = 0;
 
   dirname = make_filename_try (top_dirname, "pending", NULL);
-  if (!dirname)
+  if (dirname)
+    stampname = make_filename_try (dirname, ".next-expire", NULL);
+  if (!dirname || !stampname)
     {
       err = gpg_error_from_syserror ();
       log_error ("make_filename failed in %s: %s\n",
@@ -1764,6 +1862,15 @@ expire_one_domain (const char *top_dirname, const char *domain)
       goto leave;
     }
 
+  stamp = read_expire_stamp (stampname);
+  if (stamp && now <= stamp && stamp <= now + PENDING_TTL)
+    {
+      if (opt.verbose)
+        log_info ("domain %s: nothing to expire\n", domain);
+      err = 0;
+      goto leave;
+    }
+
   dir = gnupg_opendir (dirname);
   if (!dir)
     {
@@ -1815,16 +1922,24 @@ expire_one_domain (const char *top_dirname, const char *domain)
                * processes is cleaning up, we don't print a diagnostic
                * for ENOENT.  */
               if (gpg_err_code (err) != GPG_ERR_ENOENT)
-                log_error ("error removing '%s': %s\n",
-                           fname, gpg_strerror (err));
+                {
+                  log_error ("error removing '%s': %s\n",
+                             fname, gpg_strerror (err));
+                  remove_failed = 1;
+                }
             }
         }
+      else if (!next_expire || sb.st_mtime + PENDING_TTL < next_expire)
+        next_expire = sb.st_mtime + PENDING_TTL;
     }
+  /* Force a new scan on the next run if a key could not be removed.  */
+  write_expire_stamp (stampname, remove_failed? 0 : next_expire);
   err = 0;
 
  leave:
   gnupg_closedir (dir);
   xfree (dirname);
+  xfree (stampname);
   xfree (fname);
   return err;
 
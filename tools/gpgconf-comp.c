@@ -356,6 +356,7 @@ static known_option_t known_options_gpg_agent[] =
    { "max-passphrase-days", GC_OPT_FLAG_RUNTIME, GC_LEVEL_EXPERT },
    { "enable-passphrase-history", GC_OPT_FLAG_RUNTIME, GC_LEVEL_EXPERT },
    { "pinentry-timeout", GC_OPT_FLAG_RUNTIME, GC_LEVEL_ADVANCED },
+   { "pinentry-grace-period", GC_OPT_FLAG_RUNTIME, GC_LEVEL_EXPERT },
 
    { NULL }
  };
@@ -523,6 +524,7 @@ static known_option_t known_options_dirmngr[] =
    { "ocsp-signer",       GC_OPT_FLAG_NONE, GC_LEVEL_ADVANCED },
    { "allow-version-check",     GC_OPT_FLAG_NONE, GC_LEVEL_BASIC },
    { "ignore-ocsp-service-url", GC_OPT_FLAG_NONE, GC_LEVEL_ADVANCED },
+   { "disable-ocsp-nonce", GC_OPT_FLAG_NONE, GC_LEVEL_ADVANCED },
 
 
    { NULL }
@@ -1683,6 +1685,8 @@ struct read_line_wrapper_parm_s
   const char **extra_lines;
   int extra_lines_idx;
   char *extra_line_buffer;
+  estream_t cachefp;  /* If not NULL a copy of the lines read from FP
+                         is written to this stream.  */
 };
 
 
@@ -1697,7 +1701,11 @@ read_line_wrapper (struct read_line_wrapper_parm_s *parm)
     {
       length = es_read_line (parm->fp, &parm->line, &parm->line_len, NULL);
       if (length > 0)
-        return length;
+        {
+          if (parm->cachefp)
+            es_write (parm->cachefp, parm->line, length, NULL);
+          return length;
+        }
       if (length < 0 || es_ferror (parm->fp))
         gc_error (1, errno, "error reading from %s", parm->pgmname);
       if (es_fclose (parm->fp))
@@ -1715,6 +1723,92 @@ read_line_wrapper (struct read_line_wrapper_parm_s *parm)
   return strlen (parm->extra_line_buffer);
 }
 
+/* The output of --dump-option-table depends only on the program.
+ * Thus we cache it in the socket directory and use the cache as long
+ * as the program has not been changed.  The first line of the cache
+ * file is a key made up from our version and from the name, the size
+ * and the modification time of the program.  */
+
+/* Return the key for the option table cache of PGMNAME or NULL.  */
+static char *
+option_table_cache_key (const char *pgmname)
+{
+  struct stat st;
+
+  if (gnupg_stat (pgmname, &st))
+    return NULL;
+  return xasprintf ("# " VERSION " %s %lu %lu\n", pgmname,
+                    (unsigned long)st.st_size, (unsigned long)st.st_mtime);
+}
+
+
+/* Return the name of the option table cache file for COMPONENT.  */
+static char *
+option_table_cache_name (gc_component_id_t component)
+{
+  char *tmp, *fname;
+
+  tmp = xstrconcat ("gpgconf-", gc_component[component].name, ".cache",
+                    NULL);
+  fname = make_filename (gnupg_socketdir (), tmp, NULL);
+  xfree (tmp);
+  return fname;
+}
+
+
+/* Open the option table cache FNAME and return a stream positioned
+ * after the key line or NULL if the cache does not exist or does not
+ * match KEY.  */
+static estream_t
+open_option_table_cache (const char *fname, const char *key)
+{
+  estream_t fp;
+  char *line = NULL;
+  size_t line_len = 0;
+
+  fp = es_fopen (fname, "rb");
+  if (!fp)
+    return NULL;
+  if (es_read_line (fp, &line, &line_len, NULL) <= 0 || strcmp (line, key))
+    {
+      es_fclose (fp);
+      fp = NULL;
+    }
+  xfree (line);
+  return fp;
+}
+
+
+/* Write KEY and the content of the memory stream DATA to the option
+ * table cache FNAME.  Errors are ignored because the cache is
+ * optional.  */
+static void
+write_option_table_cache (const char *fname, const char *key, estream_t data)
+{
+  char *tmpname;
+  estream_t fp;
+  char buffer[512];
+  size_t nread;
+  int failed;
+
+  tmpname = xstrconcat (fname, ".tmp", NULL);
+  fp = es_fopen (tmpname, "wb");
+  if (!fp)
+    {
+      xfree (tmpname);
+      return;
+    }
+  failed = !!es_fputs (key, fp);
+  es_rewind (data);
+  while (!failed && !es_read (data, buffer, sizeof buffer, &nread) && nread)
+    failed = !!es_write (fp, buffer, nread, NULL);
+  if (es_fclose (fp) || failed
+      || gnupg_rename_file (tmpname, fname, NULL))
+    gnupg_remove (tmpname);
+  xfree (tmpname);
+}
+
+
 /* Retrieve the options for the component COMPONENT.  With
  * ONLY_INSTALLED set components which are not installed are silently
  * ignored. */
@@ -1745,6 +1839,10 @@ retrieve_options_from_program (gc_component_id_t component, int only_installed)
   int i;
   struct read_line_wrapper_parm_s read_line_parm;
   int pseudo_count;
+  char *cachekey;
+  char *cachefname = NULL;
+  estream_t cachefp = NULL;
+  int from_cache = 0;
 
   pgmname = (gc_component[component].module_name
              ? gnupg_module_name (gc_component[component].module_name)
@@ -1756,15 +1854,27 @@ retrieve_options_from_program (gc_component_id_t component, int only_installed)
     }
 
 
-  /* First we need to read the option table from the program.  */
-  argv[0] = "--dump-option-table";
-  argv[1] = NULL;
-  err = gnupg_spawn_process (pgmname, argv, NULL, 0,
-                             NULL, &outfp, NULL, &pid);
-  if (err)
+  /* First we need to read the option table from the program or from
+   * the cache.  */
+  cachekey = option_table_cache_key (pgmname);
+  if (cachekey)
+    cachefname = option_table_cache_name (component);
+  outfp = cachefname? open_option_table_cache (cachefname, cachekey) : NULL;
+  if (outfp)
+    from_cache = 1;
+  else
     {
-      gc_error (1, 0, "could not gather option table from '%s': %s",
-                pgmname, gpg_strerror (err));
+      argv[0] = "--dump-option-table";
+      argv[1] = NULL;
+      err = gnupg_spawn_process (pgmname, argv, NULL, 0,
+                                 NULL, &outfp, NULL, &pid);
+      if (err)
+        {
+          gc_error (1, 0, "could not gather option table from '%s': %s",
+                    pgmname, gpg_strerror (err));
+        }
+      if (cachefname)
+        cachefp = es_fopenmem (0, "w+b");
     }
 
   read_line_parm.pgmname = pgmname;
@@ -1774,6 +1884,7 @@ retrieve_options_from_program (gc_component_id_t component, int only_installed)
   read_line_parm.extra_line_buffer = NULL;
   read_line_parm.extra_lines = gc_component[component].known_pseudo_options;
   read_line_parm.extra_lines_idx = 0;
+  read_line_parm.cachefp = cachefp;
   pseudo_count = 0;
   while ((length = read_line_wrapper (&read_line_parm)) > 0)
     {
@@ -1926,11 +2037,19 @@ retrieve_options_from_program (gc_component_id_t component, int only_installed)
   log_assert (opt_table_used + pseudo_count == opt_info_used);
 
 
-  err = gnupg_wait_process (pgmname, pid, 1, &exitcode);
-  if (err)
-    gc_error (1, 0, "running %s failed (exitcode=%d): %s",
-              pgmname, exitcode, gpg_strerror (err));
-  gnupg_release_process (pid);
+  if (!from_cache)
+    {
+      err = gnupg_wait_process (pgmname, pid, 1, &exitcode);
+      if (err)
+        gc_error (1, 0, "running %s failed (exitcode=%d): %s",
+                  pgmname, exitcode, gpg_strerror (err));
+      gnupg_release_process (pid);
+      if (cachefp)
+        write_option_table_cache (cachefname, cachekey, cachefp);
+    }
+  es_fclose (cachefp);
+  xfree (cachefname);
+  xfree (cachekey);
 
   /* Make the gpgrt option table and the internal option table available.  */
   gc_component[component].opt_table = opt_table;
@@ -535,6 +535,31 @@ handle_bzip2(int algo,FILE *fpin,FILE *fpout)
 }
 #endif /* HAVE_BZIP2 */
 
+/* Copy LENGTH bytes from FPIN to FPOUT using large blocks.  If
+   TO_EOF is set LENGTH is ignored and everything up to EOF is copied.
+   Returns 0 on success, -1 on a read error or premature EOF and 2 on
+   a write error.  */
+static int
+copy_bytes (FILE *fpin, FILE *fpout, unsigned long length, int to_eof)
+{
+  static unsigned char buffer[65536];
+  size_t n, nread;
+
+  while (to_eof || length)
+    {
+      n = (to_eof || length > sizeof buffer)? sizeof buffer : length;
+      nread = fread (buffer, 1, n, fpin);
+      if (nread && fwrite (buffer, 1, nread, fpout) != nread)
+        return 2;
+      if (nread < n)
+        return (to_eof && !ferror (fpin))? 0 : -1;
+      if (!to_eof)
+        length -= nread;
+    }
+  return 0;
+}
+
+
 /* hdr must point to a buffer large enough to hold all header bytes */
 static int
 write_part (FILE *fpin, unsigned long pktlen,
@@ -698,13 +723,11 @@ write_part (FILE *fpin, unsigned long pktlen,
             }
           if (!partlen)
             partial = 0; /* end of packet */
-          for (; partlen; partlen--)
+          switch (copy_bytes (fpin, fpout, partlen, 0))
             {
-              c = getc (fpin);
-              if (c == EOF)
-                goto read_error;
-              if ( putc (c, fpout) == EOF )
-                goto write_error;
+            case 0: break;
+            case 2: goto write_error;
+            default: goto read_error;
             }
         }
       else
@@ -741,11 +764,8 @@ write_part (FILE *fpin, unsigned long pktlen,
             }
           else
             {
-              while ( (c=getc (fpin)) != EOF )
-                {
-                  if ( putc (c, fpout) == EOF )
-                    goto write_error;
-                }
+              if (copy_bytes (fpin, fpout, 0, 1) == 2)
+                goto write_error;
             }
           if (!feof (fpin))
             goto read_error;
@@ -759,13 +779,11 @@ write_part (FILE *fpin, unsigned long pktlen,
     }
 
   /* standard packet or last segment of partial length encoded packet */
-  for (; pktlen; pktlen--)
+  switch (copy_bytes (fpin, fpout, pktlen, 0))
     {
-      c = getc (fpin);
-      if (c == EOF)
-        goto read_error;
-      if ( putc (c, fpout) == EOF )
-        goto write_error;
+    case 0: break;
+    case 2: goto write_error;
+    default: goto read_error;
     }
 
  ready:
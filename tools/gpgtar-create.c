@@ -62,6 +62,16 @@ static unsigned long long global_total_data;
 /* Number of data bytes written so far.  */
 static unsigned long long global_written_data;
 
+/* Size of the buffer used to copy file data and of the output
+ * buffer.  Must be a multiple of RECORDSIZE.  */
+#define COPY_BUFFER_SIZE (64*1024)
+
+/* Emit a progress line for the data after each such amount.  */
+#define DATA_PROGRESS_STEP (100*1024*1024)
+
+/* The buffer used to copy file data.  */
+static char *copy_buffer;
+
 
 
 /* Object to control the file scanning.  */
@@ -73,9 +83,19 @@ struct scanctrl_s
   tar_header_t *flist_tail;
   unsigned long file_count;
   int nestlevel;
+
+  /* If set entries are written to this stream right when they are
+   * scanned and only directories are kept in FLIST.  */
+  estream_t outstream;
+  unsigned int *skipped_open;  /* Counter used by write_file.  */
+  gpg_error_t write_err;       /* First error from write_file.  */
 };
 
 
+static gpg_error_t write_file (estream_t stream, tar_header_t hdr,
+                               unsigned int *skipped_open);
+
+
 /* See ../g10/progress.c:write_status_progress for some background.  */
 static void
 write_progress (int countmode, unsigned long long current,
@@ -329,6 +349,9 @@ add_entry (const char *dname, const char *entryname, scanctrl_t scanctrl)
 
   log_assert (dnamelen);
 
+  if (scanctrl->write_err)
+    return scanctrl->write_err;
+
   hdr = xtrycalloc (1, sizeof *hdr + dnamelen + 1
                     + (entryname? strlen (entryname) : 0) + 1);
   if (!hdr)
@@ -359,8 +382,28 @@ add_entry (const char *dname, const char *entryname, scanctrl_t scanctrl)
        * can't print them.  */
       if (opt.verbose)
         gpgtar_print_header (hdr, NULL, log_get_stream ());
-      *scanctrl->flist_tail = hdr;
-      scanctrl->flist_tail = &hdr->next;
+      if (scanctrl->outstream)
+        {
+          /* Streaming mode: Write the entry right away; we only need
+           * to keep directories for the recursive scan.  */
+          err = write_file (scanctrl->outstream, hdr, scanctrl->skipped_open);
+          if (err)
+            {
+              scanctrl->write_err = err;
+              xfree (hdr);
+              return err;
+            }
+          if (hdr->typeflag != TF_DIRECTORY)
+            {
+              xfree (hdr);
+              hdr = NULL;
+            }
+        }
+      if (hdr)
+        {
+          *scanctrl->flist_tail = hdr;
+          scanctrl->flist_tail = &hdr->next;
+        }
       scanctrl->file_count++;
       /* Print a progress line during scnanning in increments of 5000
        * and not of 100 as we doing during write: Scanning is of
@@ -996,14 +1039,25 @@ write_file (estream_t stream, tar_header_t hdr, unsigned int *skipped_open)
 
   if (hdr->typeflag == TF_REGULAR)
     {
-      hdr->nrecords = (hdr->size + RECORDSIZE-1)/RECORDSIZE;
+      unsigned long long remaining = hdr->size;
+      unsigned long long prev;
+      size_t npadded;
+
+      if (!copy_buffer && !(copy_buffer = xtrymalloc (COPY_BUFFER_SIZE)))
+        {
+          err = gpg_error_from_syserror ();
+          goto leave;
+        }
+
+      /* We read and write large blocks of records; thus there is no
+       * need for buffering in estream.  */
+      es_setvbuf (infp, NULL, _IONBF, 0);
+
       any = 0;
-      while (hdr->nrecords--)
+      while (remaining)
         {
-          nbytes = hdr->nrecords? RECORDSIZE : (hdr->size % RECORDSIZE);
-          if (!nbytes)
-            nbytes = RECORDSIZE;
-          nread = es_fread (record, 1, nbytes, infp);
+          nbytes = remaining > COPY_BUFFER_SIZE? COPY_BUFFER_SIZE : remaining;
+          nread = es_fread (copy_buffer, 1, nbytes, infp);
           if (nread != nbytes)
             {
               err = gpg_error_from_syserror ();
@@ -1012,14 +1066,23 @@ write_file (estream_t stream, tar_header_t hdr, unsigned int *skipped_open)
                          any? " (file shrunk?)":"");
               goto leave;
             }
-          else if (nbytes < RECORDSIZE)
-            memset (record + nbytes, 0, RECORDSIZE - nbytes);
+          remaining -= nbytes;
+          /* Only the last block may need padding.  */
+          npadded = (nbytes + RECORDSIZE - 1) / RECORDSIZE * RECORDSIZE;
+          if (npadded > nbytes)
+            memset (copy_buffer + nbytes, 0, npadded - nbytes);
           any = 1;
-          err = write_record (stream, record);
-          if (err)
-            goto leave;
+          if (es_fwrite (copy_buffer, 1, npadded, stream) != npadded)
+            {
+              err = gpg_error_from_syserror ();
+              log_error ("error writing '%s': %s\n",
+                         es_fname_get (stream), gpg_strerror (err));
+              goto leave;
+            }
+          prev = global_written_data;
           global_written_data += nbytes;
-          if (!((global_written_data/nbytes) % (2048*100)))
+          if (prev / DATA_PROGRESS_STEP
+              != global_written_data / DATA_PROGRESS_STEP)
             write_progress (0, global_written_data, global_total_data);
         }
       nread = es_fread (record, 1, 1, infp);
@@ -1053,6 +1116,109 @@ write_eof_mark (estream_t stream)
 
 
 
+/* Open the output stream for the tarball and store it at
+ * R_OUTSTREAM.  If ENCRYPT or SIGN is set a gpg process is spawned
+ * whose pid is stored at R_PID.  */
+static gpg_error_t
+open_output (int encrypt, int sign, estream_t *r_outstream, pid_t *r_pid)
+{
+  gpg_error_t err = 0;
+  estream_t outstream = NULL;
+
+  if (encrypt || sign)
+    {
+      strlist_t arg;
+      ccparray_t ccp;
+      int except[2] = { -1, -1 };
+      const char **argv;
+
+      /* '--encrypt' may be combined with '--symmetric', but 'encrypt'
+       * is set either way.  Clear it if no recipients are specified.
+       */
+      if (opt.symmetric && opt.recipients == NULL)
+        encrypt = 0;
+
+      ccparray_init (&ccp, 0);
+      if (opt.batch)
+        ccparray_put (&ccp, "--batch");
+      if (opt.answer_yes)
+        ccparray_put (&ccp, "--yes");
+      if (opt.answer_no)
+        ccparray_put (&ccp, "--no");
+      if (opt.require_compliance)
+        ccparray_put (&ccp, "--require-compliance");
+      if (opt.status_fd != -1)
+        {
+          static char tmpbuf[40];
+
+          snprintf (tmpbuf, sizeof tmpbuf, "--status-fd=%d", opt.status_fd);
+          ccparray_put (&ccp, tmpbuf);
+          except[0] = opt.status_fd;
+        }
+
+      ccparray_put (&ccp, "--output");
+      ccparray_put (&ccp, opt.outfile? opt.outfile : "-");
+      if (encrypt)
+        ccparray_put (&ccp, "--encrypt");
+      if (sign)
+        ccparray_put (&ccp, "--sign");
+      if (opt.user)
+        {
+          ccparray_put (&ccp, "--local-user");
+          ccparray_put (&ccp, opt.user);
+        }
+      if (opt.symmetric)
+        ccparray_put (&ccp, "--symmetric");
+      for (arg = opt.recipients; arg; arg = arg->next)
+        {
+          ccparray_put (&ccp, "--recipient");
+          ccparray_put (&ccp, arg->d);
+        }
+      for (arg = opt.gpg_arguments; arg; arg = arg->next)
+        ccparray_put (&ccp, arg->d);
+
+      ccparray_put (&ccp, NULL);
+      argv = ccparray_get (&ccp, NULL);
+      if (!argv)
+        return gpg_error_from_syserror ();
+
+      err = gnupg_spawn_process (opt.gpg_program, argv,
+                                 except[0] == -1? NULL : except,
+                                 (GNUPG_SPAWN_KEEP_STDOUT
+                                  | GNUPG_SPAWN_KEEP_STDERR),
+                                 &outstream, NULL, NULL, r_pid);
+      xfree (argv);
+      if (err)
+        return err;
+      es_set_binary (outstream);
+    }
+  else if (opt.outfile) /* No crypto  */
+    {
+      if (!strcmp (opt.outfile, "-"))
+        outstream = es_stdout;
+      else
+        outstream = es_fopen (opt.outfile, "wb,sysopen");
+      if (!outstream)
+        return gpg_error_from_syserror ();
+      if (outstream == es_stdout)
+        es_set_binary (es_stdout);
+    }
+  else /* Also no crypto.  */
+    {
+      outstream = es_stdout;
+      es_set_binary (outstream);
+    }
+
+  /* Use a large buffer to avoid many small writes to the pipe or
+   * file.  */
+  if (outstream != es_stdout)
+    es_setvbuf (outstream, NULL, _IOFBF, COPY_BUFFER_SIZE);
+
+  *r_outstream = outstream;
+  return 0;
+}
+
+
 /* Create a new tarball using the names in the array INPATTERN.  If
    INPATTERN is NULL take the pattern as null terminated strings from
    stdin or from the file specified by FILES_FROM.  If NULL_NAMES is
@@ -1071,6 +1237,7 @@ gpgtar_create (char **inpattern, const char *files_from, int null_names,
   int eof_seen = 0;
   pid_t pid = (pid_t)(-1);
   unsigned int skipped_open = 0;
+  int streaming;
 
   memset (scanctrl, 0, sizeof *scanctrl);
   scanctrl->flist_tail = &scanctrl->flist;
@@ -1102,6 +1269,19 @@ gpgtar_create (char **inpattern, const char *files_from, int null_names,
       return err;
     }
 
+  /* Without progress lines we do not need the totals and thus we can
+   * write the entries while scanning.  This keeps the memory use low
+   * and lets gpg encrypt while we are still scanning.  */
+  streaming = !opt.status_stream;
+  if (streaming)
+    {
+      err = open_output (encrypt, sign, &outstream, &pid);
+      if (err)
+        goto leave;
+      scanctrl->outstream = outstream;
+      scanctrl->skipped_open = &skipped_open;
+    }
+
   while (!eof_seen)
     {
       char *pat, *p;
@@ -1213,6 +1393,12 @@ gpgtar_create (char **inpattern, const char *files_from, int null_names,
   if (files_from_stream && files_from_stream != es_stdin)
     es_fclose (files_from_stream);
 
+  if (scanctrl->write_err)
+    {
+      err = scanctrl->write_err;
+      goto leave;
+    }
+
   global_total_files = global_total_data = 0;
   global_written_files = global_written_data = 0;
   for (hdr = scanctrl->flist; hdr; hdr = hdr->next)
@@ -1224,103 +1410,22 @@ gpgtar_create (char **inpattern, const char *files_from, int null_names,
   write_progress (0, 0, global_total_data);
 
 
-  if (encrypt || sign)
+  if (!streaming)
     {
-      strlist_t arg;
-      ccparray_t ccp;
-      int except[2] = { -1, -1 };
-      const char **argv;
-
-      /* '--encrypt' may be combined with '--symmetric', but 'encrypt'
-       * is set either way.  Clear it if no recipients are specified.
-       */
-      if (opt.symmetric && opt.recipients == NULL)
-        encrypt = 0;
-
-      ccparray_init (&ccp, 0);
-      if (opt.batch)
-        ccparray_put (&ccp, "--batch");
-      if (opt.answer_yes)
-        ccparray_put (&ccp, "--yes");
-      if (opt.answer_no)
-        ccparray_put (&ccp, "--no");
-      if (opt.require_compliance)
-        ccparray_put (&ccp, "--require-compliance");
-      if (opt.status_fd != -1)
-        {
-          static char tmpbuf[40];
-
-          snprintf (tmpbuf, sizeof tmpbuf, "--status-fd=%d", opt.status_fd);
-          ccparray_put (&ccp, tmpbuf);
-          except[0] = opt.status_fd;
-        }
-
-      ccparray_put (&ccp, "--output");
-      ccparray_put (&ccp, opt.outfile? opt.outfile : "-");
-      if (encrypt)
-        ccparray_put (&ccp, "--encrypt");
-      if (sign)
-        ccparray_put (&ccp, "--sign");
-      if (opt.user)
-        {
-          ccparray_put (&ccp, "--local-user");
-          ccparray_put (&ccp, opt.user);
-        }
-      if (opt.symmetric)
-        ccparray_put (&ccp, "--symmetric");
-      for (arg = opt.recipients; arg; arg = arg->next)
-        {
-          ccparray_put (&ccp, "--recipient");
-          ccparray_put (&ccp, arg->d);
-        }
-      for (arg = opt.gpg_arguments; arg; arg = arg->next)
-        ccparray_put (&ccp, arg->d);
-
-      ccparray_put (&ccp, NULL);
-      argv = ccparray_get (&ccp, NULL);
-      if (!argv)
-        {
-          err = gpg_error_from_syserror ();
-          goto leave;
-        }
-
-      err = gnupg_spawn_process (opt.gpg_program, argv,
-                                 except[0] == -1? NULL : except,
-                                 (GNUPG_SPAWN_KEEP_STDOUT
-                                  | GNUPG_SPAWN_KEEP_STDERR),
-                                 &outstream, NULL, NULL, &pid);
-      xfree (argv);
+      err = open_output (encrypt, sign, &outstream, &pid);
       if (err)
         goto leave;
-      es_set_binary (outstream);
     }
-  else if (opt.outfile) /* No crypto  */
+
+  if (!streaming)
     {
-      if (!strcmp (opt.outfile, "-"))
-        outstream = es_stdout;
-      else
-        outstream = es_fopen (opt.outfile, "wb,sysopen");
-      if (!outstream)
+      skipped_open = 0;
+      for (hdr = scanctrl->flist; hdr; hdr = hdr->next)
         {
-          err = gpg_error_from_syserror ();
-          goto leave;
+          err = write_file (outstream, hdr, &skipped_open);
+          if (err)
+            goto leave;
         }
-      if (outstream == es_stdout)
-        es_set_binary (es_stdout);
-
-    }
-  else /* Also no crypto.  */
-    {
-      outstream = es_stdout;
-      es_set_binary (outstream);
-    }
-
-  skipped_open = 0;
-  for (hdr = scanctrl->flist; hdr; hdr = hdr->next)
-    {
-      err = write_file (outstream, hdr, &skipped_open);
-      if (err)
-        goto leave;
     }
 
   err = write_eof_mark (outstream);
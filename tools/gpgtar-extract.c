@@ -232,7 +232,6 @@ extract (estream_t stream, const char *dirname, tarinfo_t info,
          tar_header_t hdr, strlist_t exthdr)
 {
   gpg_error_t err;
-  size_t n;
 
   if (hdr->typeflag == TF_REGULAR || hdr->typeflag == TF_UNKNOWN)
     err = extract_regular (stream, dirname, info, hdr, exthdr);
@@ -240,8 +239,6 @@ extract (estream_t stream, const char *dirname, tarinfo_t info,
     err = extract_directory (dirname, info, hdr, exthdr);
   else
     {
-      char record[RECORDSIZE];
-
       log_info ("unsupported file type %d for '%s' - skipped\n",
                 (int)hdr->typeflag, hdr->name);
       if (hdr->typeflag == TF_SYMLINK)
@@ -250,12 +247,9 @@ extract (estream_t stream, const char *dirname, tarinfo_t info,
         info->skipped_hardlinks++;
       else
         info->skipped_other++;
-      for (err = 0, n=0; !err && n < hdr->nrecords; n++)
-        {
-          err = read_record (stream, record);
-          if (!err)
-            info->nblocks++;
-        }
+      err = skip_records (stream, hdr->nrecords);
+      if (!err)
+        info->nblocks += hdr->nrecords;
     }
   return err;
 }
@@ -34,6 +34,8 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/types.h>
+#include <sys/stat.h>
 
 #define INCLUDED_BY_MAIN_MODULE 1
 #include "../common/util.h"
@@ -625,6 +627,60 @@ read_record (estream_t stream, void *record)
 }
 
 
+/* Skip NRECORDS records of STREAM.  If STREAM is a regular file we
+   seek over them, otherwise they are read in large blocks.  Returns 0
+   on success and error code on failure; a diagnostic is printed as
+   well.  */
+gpg_error_t
+skip_records (estream_t stream, unsigned long long nrecords)
+{
+  static estream_t last_stream;
+  static int last_seekable;
+  char buffer[64 * RECORDSIZE];
+  struct stat st;
+  size_t n, nread;
+  int fd;
+
+  if (!nrecords)
+    return 0;
+
+  if (stream != last_stream)
+    {
+      last_stream = stream;
+      fd = es_fileno (stream);
+      last_seekable = (fd != -1 && !fstat (fd, &st) && S_ISREG (st.st_mode));
+    }
+
+  if (last_seekable
+      && nrecords < (1ULL << 62) / RECORDSIZE
+      && !es_fseeko (stream, (gpgrt_off_t)(nrecords * RECORDSIZE), SEEK_CUR))
+    return 0;
+
+  while (nrecords)
+    {
+      if (nrecords > sizeof buffer / RECORDSIZE)
+        n = sizeof buffer;
+      else
+        n = nrecords * RECORDSIZE;
+      nread = es_fread (buffer, 1, n, stream);
+      if (nread != n)
+        {
+          gpg_error_t err = gpg_error_from_syserror ();
+          if (es_ferror (stream))
+            log_error ("error reading '%s': %s\n",
+                       es_fname_get (stream), gpg_strerror (err));
+          else
+            log_error ("error reading '%s': premature EOF\n",
+                       es_fname_get (stream));
+          return err;
+        }
+      nrecords -= n / RECORDSIZE;
+    }
+
+  return 0;
+}
+
+
 /* Write the RECORD of size RECORDSIZE to STREAM.  FILENAME is the
    name of the file used for diagnostics.  */
 gpg_error_t
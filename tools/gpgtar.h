@@ -143,6 +143,7 @@ struct tar_header_s
 
 /*-- gpgtar.c --*/
 gpg_error_t read_record (estream_t stream, void *record);
+gpg_error_t skip_records (estream_t stream, unsigned long long nrecords);
 gpg_error_t write_record (estream_t stream, const void *record);
 
 /*-- gpgtar-create.c --*/
@@ -691,6 +691,8 @@ mime_parser_parse (mime_parser_t ctx, estream_t fp)
       log_error ("can't open mail parser: %s", gpg_strerror (err));
       goto leave;
     }
+  /* We do not need the parts after they have been processed.  */
+  rfc822parse_set_discard_parts (msg, 1);
 
   /* Fixme: We should not use fgets because it can't cope with
      embedded nul characters. */
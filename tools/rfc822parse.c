@@ -97,6 +97,7 @@ struct rfc822parse_context
   int callback_error;
   int in_body;
   int in_preamble;      /* Whether we are before the first boundary. */
+  int discard_parts;    /* Release finished parts.  */
   part_t parts;         /* The tree of parts. */
   part_t current_part;  /* Whom we are processing (points into parts). */
   const char *boundary; /* Current boundary. */
@@ -324,6 +325,19 @@ rfc822parse_open (rfc822parse_cb_t cb, void *cb_value)
 }
 
 
+/* If ENABLE is true, the parser releases a part and all its
+   subparts as soon as the next part at the same level starts.  This
+   keeps the memory use constant for messages with many parts but the
+   structure of the message is then not anymore available after
+   parsing.  */
+void
+rfc822parse_set_discard_parts (rfc822parse_t msg, int enable)
+{
+  if (msg)
+    msg->discard_parts = !!enable;
+}
+
+
 void
 rfc822parse_cancel (rfc822parse_t msg)
 {
@@ -465,7 +479,7 @@ transition_to_body (rfc822parse_t msg)
 static int
 transition_to_header (rfc822parse_t msg)
 {
-  part_t part;
+  part_t part, parent;
 
   if (!(msg->current_part
         && !msg->current_part->right))
@@ -478,7 +492,16 @@ transition_to_header (rfc822parse_t msg)
   if (!part)
     return -1;
 
-  msg->current_part->right = part;
+  if (msg->discard_parts
+      && (parent = find_parent (msg->parts, msg->current_part))
+      && parent->down == msg->current_part)
+    {
+      /* The current part is finished; replace it by the new one.  */
+      release_part (msg->current_part);
+      parent->down = part;
+    }
+  else
+    msg->current_part->right = part;
   msg->current_part = part;
   return 0;
 }
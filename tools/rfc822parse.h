@@ -52,6 +52,7 @@ int rfc822_valid_header_name_p (const char *name);
 void rfc822_capitalize_header_name (char *name);
 
 rfc822parse_t rfc822parse_open (rfc822parse_cb_t cb, void *opaque_value);
+void rfc822parse_set_discard_parts (rfc822parse_t msg, int enable);
 
 void rfc822parse_close (rfc822parse_t msg);
 
@@ -146,6 +146,52 @@ tpm2_FlushContext (TSS_CONTEXT *tssContext, TPM_HANDLE flushHandle)
   return rc;
 }
 
+static inline TPM_RC
+tpm2_ContextSave (TSS_CONTEXT *tssContext, TPM_HANDLE saveHandle,
+		  TPMS_CONTEXT *context)
+{
+  ContextSave_In in;
+  ContextSave_Out out;
+  TPM_RC rc;
+
+  in.saveHandle = saveHandle;
+
+  rc = TSS_Execute (tssContext,
+		    (RESPONSE_PARAMETERS *)&out,
+		    (COMMAND_PARAMETERS *)&in,
+		    NULL,
+		    TPM_CC_ContextSave,
+		    TPM_RH_NULL, NULL, 0);
+
+  if (rc == TPM_RC_SUCCESS)
+    *context = out.context;
+
+  return rc;
+}
+
+static inline TPM_RC
+tpm2_ContextLoad (TSS_CONTEXT *tssContext, TPMS_CONTEXT *context,
+		  TPM_HANDLE *loadedHandle)
+{
+  ContextLoad_In in;
+  ContextLoad_Out out;
+  TPM_RC rc;
+
+  in.context = *context;
+
+  rc = TSS_Execute (tssContext,
+		    (RESPONSE_PARAMETERS *)&out,
+		    (COMMAND_PARAMETERS *)&in,
+		    NULL,
+		    TPM_CC_ContextLoad,
+		    TPM_RH_NULL, NULL, 0);
+
+  if (rc == TPM_RC_SUCCESS)
+    *loadedHandle = out.loadedHandle;
+
+  return rc;
+}
+
 static inline TPM_RC
 tpm2_ReadPublic (TSS_CONTEXT *tssContext, TPM_HANDLE objectHandle,
 		 TPMT_PUBLIC *pub, TPM_HANDLE auth)
@@ -606,6 +606,30 @@ tpm2_FlushContext(TSS_CONTEXT *tssContext, TPM_HANDLE flushHandle)
   return Esys_FlushContext(tssContext, flushHandle);
 }
 
+static inline TPM_RC
+tpm2_ContextSave(TSS_CONTEXT *tssContext, TPM_HANDLE saveHandle,
+		 TPMS_CONTEXT *context)
+{
+  TPMS_CONTEXT *out;
+  TPM_RC rc;
+
+  rc = Esys_ContextSave(tssContext, saveHandle, &out);
+  if (rc)
+    return rc;
+
+  *context = *out;
+  free(out);
+
+  return rc;
+}
+
+static inline TPM_RC
+tpm2_ContextLoad(TSS_CONTEXT *tssContext, TPMS_CONTEXT *context,
+		 TPM_HANDLE *loadedHandle)
+{
+  return Esys_ContextLoad(tssContext, context, loadedHandle);
+}
+
 static inline TPM_RC
 tpm2_StartAuthSession(TSS_CONTEXT *tssContext, TPM_HANDLE tpmKey,
 		      TPM_HANDLE bind, TPM_SE sessionType,
@@ -34,6 +34,20 @@
 #include "../common/i18n.h"
 #include "../common/sexp-parse.h"
 
+/* Saved contexts of recently loaded keys.  Loading a key requires
+ * re-creating the primary parent key and a TPM2_Load; restoring a
+ * saved context is a single cheap command.  Saved contexts do not
+ * occupy transient object slots of the TPM.  */
+#define KEY_CONTEXT_CACHE_SIZE 16
+static struct
+{
+  unsigned char hash[32];  /* SHA-256 of the shadow info.  */
+  TPMI_ALG_PUBLIC type;
+  TPMS_CONTEXT context;
+  unsigned long lru;       /* Zero for an unused entry.  */
+} key_context_cache[KEY_CONTEXT_CACHE_SIZE];
+static unsigned long key_context_lru;
+
 int
 tpm2_start (TSS_CONTEXT **tssc)
 {
@@ -243,6 +257,60 @@ parse_tpm2_shadow_info (const unsigned char *shadow_info,
   return 0;
 }
 
+/* Try to restore the key with the SHA-256 fingerprint HASH of its
+ * shadow info from the saved context cache.  Returns 0 on success.  */
+static int
+load_key_from_cache (TSS_CONTEXT *tssc, const unsigned char *hash,
+                     TPM_HANDLE *key, TPMI_ALG_PUBLIC *type)
+{
+  TPM_RC rc;
+  int i;
+
+  for (i = 0; i < KEY_CONTEXT_CACHE_SIZE; i++)
+    if (key_context_cache[i].lru
+        && !memcmp (key_context_cache[i].hash, hash, 32))
+      {
+        rc = tpm2_ContextLoad (tssc, &key_context_cache[i].context, key);
+        if (rc != TPM_RC_SUCCESS)
+          {
+            /* The context is stale (e.g. the TPM has been restarted).  */
+            key_context_cache[i].lru = 0;
+            return -1;
+          }
+        *type = key_context_cache[i].type;
+        key_context_cache[i].lru = ++key_context_lru;
+        return 0;
+      }
+  return -1;
+}
+
+
+/* Save the context of the loaded KEY with the SHA-256 fingerprint
+ * HASH of its shadow info in the cache.  The least recently used
+ * entry is replaced.  */
+static void
+put_key_into_cache (TSS_CONTEXT *tssc, const unsigned char *hash,
+                    TPM_HANDLE key, TPMI_ALG_PUBLIC type)
+{
+  int i, victim;
+
+  victim = 0;
+  for (i = 1; i < KEY_CONTEXT_CACHE_SIZE; i++)
+    if (key_context_cache[i].lru < key_context_cache[victim].lru)
+      victim = i;
+
+  if (tpm2_ContextSave (tssc, key, &key_context_cache[victim].context)
+      != TPM_RC_SUCCESS)
+    {
+      key_context_cache[victim].lru = 0;
+      return;
+    }
+  memcpy (key_context_cache[victim].hash, hash, 32);
+  key_context_cache[victim].type = type;
+  key_context_cache[victim].lru = ++key_context_lru;
+}
+
+
 int
 tpm2_load_key (TSS_CONTEXT *tssc, const unsigned char *shadow_info,
 	       TPM_HANDLE *key, TPMI_ALG_PUBLIC *type)
@@ -256,12 +324,19 @@ tpm2_load_key (TSS_CONTEXT *tssc, const unsigned char *shadow_info,
   TPM_RC rc;
   BYTE *buf;
   uint32_t size;
+  unsigned char hash[32];
+  size_t infolen;
 
   ret = parse_tpm2_shadow_info (shadow_info, &parent, &pub, &pub_len,
                                 &priv, &priv_len);
   if (ret)
     return ret;
 
+  infolen = gcry_sexp_canon_len (shadow_info, 0, NULL, NULL);
+  gcry_md_hash_buffer (GCRY_MD_SHA256, hash, shadow_info, infolen);
+  if (infolen && !load_key_from_cache (tssc, hash, key, type))
+    return 0;
+
   parentHandle = tpm2_get_parent (tssc, parent);
 
   buf = (BYTE *)priv;
@@ -285,6 +360,9 @@ tpm2_load_key (TSS_CONTEXT *tssc, const unsigned char *shadow_info,
       return GPG_ERR_CARD;
     }
 
+  if (infolen)
+    put_key_into_cache (tssc, hash, *key, *type);
+
   return 0;
 }
 